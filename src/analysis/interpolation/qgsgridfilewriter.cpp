@@ -19,6 +19,33 @@
 #include "qgsinterpolator.h"
 #include <QFile>
 #include <QProgressDialog>
+#include <QThread>
+#include <QtConcurrentMap>
+
+//! interpolated values of one output row
+class QgsGridFileRowJob
+{
+  public:
+    QgsInterpolator* interpolator;
+    double y;
+    double xMin;
+    double cellSizeX;
+    int nCols;
+    QVector<double> values;
+    QVector<bool> valid;
+
+    void run()
+    {
+      values.resize( nCols );
+      valid.resize( nCols );
+      double currentXValue = xMin;
+      for ( int j = 0; j < nCols; ++j )
+      {
+        valid[j] = interpolator->interpolatePoint( currentXValue, y, values[j] ) == 0;
+        currentXValue += cellSizeX;
+      }
+    }
+};
 
 QgsGridFileWriter::QgsGridFileWriter( QgsInterpolator* i, QString outputPath, QgsRectangle extent, int nCols, int nRows , double cellSizeX, double cellSizeY )
     : mInterpolator( i ), mOutputFilePath( outputPath ), mInterpolationExtent( extent ), mNumColumns( nCols ), mNumRows( nRows )
@@ -57,8 +84,6 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
   writeHeader( outStream );
 
   double currentYValue = mInterpolationExtent.yMaximum() - mCellSizeY / 2.0; //calculate value in the center of the cell
-  double currentXValue;
-  double interpolatedValue;
 
   QProgressDialog* progressDialog = 0;
   if ( showProgressDialog )
@@ -67,32 +92,59 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
     progressDialog->setWindowModality( Qt::WindowModal );
   }
 
-  for ( int i = 0; i < mNumRows; ++i )
+  // rows are interpolated in batches, in parallel if the interpolator supports it, and written in order
+  bool parallel = mInterpolator->prepareParallelInterpolation();
+  int batchSize = parallel ? 2 * qMax( 1, QThread::idealThreadCount() ) : 1;
+
+  for ( int i = 0; i < mNumRows; i += batchSize )
   {
-    currentXValue = mInterpolationExtent.xMinimum() + mCellSizeX / 2.0; //calculate value in the center of the cell
-    for ( int j = 0; j < mNumColumns; ++j )
+    QVector<QgsGridFileRowJob> jobs( qMin( batchSize, mNumRows - i ) );
+    for ( int k = 0; k < jobs.size(); ++k )
     {
-      if ( mInterpolator->interpolatePoint( currentXValue, currentYValue, interpolatedValue ) == 0 )
-      {
-        outStream << interpolatedValue << " ";
-      }
-      else
-      {
-        outStream << "-9999 ";
-      }
-      currentXValue += mCellSizeX;
+      QgsGridFileRowJob& job = jobs[k];
+      job.interpolator = mInterpolator;
+      job.y = currentYValue;
+      job.xMin = mInterpolationExtent.xMinimum() + mCellSizeX / 2.0; //calculate value in the center of the cell
+      job.cellSizeX = mCellSizeX;
+      job.nCols = mNumColumns;
+      currentYValue -= mCellSizeY;
     }
-    outStream << endl;
-    currentYValue -= mCellSizeY;
 
-    if ( showProgressDialog )
+    if ( parallel )
+    {
+      QtConcurrent::blockingMap( jobs, &QgsGridFileRowJob::run );
+    }
+    else
     {
-      if ( progressDialog->wasCanceled() )
+      jobs[0].run();
+    }
+
+    for ( int k = 0; k < jobs.size(); ++k )
+    {
+      const QgsGridFileRowJob& job = jobs[k];
+      for ( int j = 0; j < mNumColumns; ++j )
+      {
+        if ( job.valid[j] )
+        {
+          outStream << job.values[j] << " ";
+        }
+        else
+        {
+          outStream << "-9999 ";
+        }
+      }
+      outStream << endl;
+
+      if ( showProgressDialog )
       {
-        outputFile.remove();
-        return 3;
+        if ( progressDialog->wasCanceled() )
+        {
+          delete progressDialog;
+          outputFile.remove();
+          return 3;
+        }
+        progressDialog->setValue( i + k );
       }
-      progressDialog->setValue( i );
     }
   }
 
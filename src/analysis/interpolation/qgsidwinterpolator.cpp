@@ -19,12 +19,12 @@
 #include <cmath>
 #include <limits>
 
-QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData ): QgsInterpolator( layerData ), mDistanceCoefficient( 2.0 )
+QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData ): QgsInterpolator( layerData ), mDistanceCoefficient( 2.0 ), mMaximumNeighbours( 0 ), mSearchRadius( 0 )
 {
 
 }
 
-QgsIDWInterpolator::QgsIDWInterpolator(): QgsInterpolator( QList<LayerData>() ), mDistanceCoefficient( 2.0 )
+QgsIDWInterpolator::QgsIDWInterpolator(): QgsInterpolator( QList<LayerData>() ), mDistanceCoefficient( 2.0 ), mMaximumNeighbours( 0 ), mSearchRadius( 0 )
 {
 
 }
@@ -41,6 +41,15 @@ int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
     cacheBaseData();
   }
 
+  if ( mMaximumNeighbours > 0 || mSearchRadius > 0 )
+  {
+    if ( mVertexTree.isEmpty() )
+    {
+      mVertexTree.build( mCachedBaseData );
+    }
+    return interpolateNeighbours( x, y, result );
+  }
+
   double currentWeight;
   double distance;
 
@@ -70,3 +79,57 @@ int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
   result = sumCounter / sumDenominator;
   return 0;
 }
+
+int QgsIDWInterpolator::interpolateNeighbours( double x, double y, double& result ) const
+{
+  QVector<QgsVertexKdTree::Neighbour> neighbours;
+  mVertexTree.neighbours( x, y, mMaximumNeighbours, mSearchRadius, neighbours );
+  const QVector<vertexData>& vertices = mVertexTree.vertices();
+
+  double currentWeight;
+  double distance;
+
+  double sumCounter = 0;
+  double sumDenominator = 0;
+
+  QVector<QgsVertexKdTree::Neighbour>::const_iterator neighbour_it = neighbours.constBegin();
+  for ( ; neighbour_it != neighbours.constEnd(); ++neighbour_it )
+  {
+    const vertexData& vertex = vertices[neighbour_it->second];
+    distance = sqrt( neighbour_it->first );
+    if (( distance - 0 ) < std::numeric_limits<double>::min() )
+    {
+      result = vertex.z;
+      return 0;
+    }
+    currentWeight = 1 / ( pow( distance, mDistanceCoefficient ) );
+    sumCounter += ( currentWeight * vertex.z );
+    sumDenominator += currentWeight;
+  }
+
+  if ( sumDenominator == 0.0 )
+  {
+    return 1;
+  }
+
+  result = sumCounter / sumDenominator;
+  return 0;
+}
+
+bool QgsIDWInterpolator::prepareParallelInterpolation()
+{
+  if ( !mDataIsCached )
+  {
+    if ( cacheBaseData() != 0 )
+    {
+      return false;
+    }
+    // also if there were no vertices, interpolatePoint() must not cache again
+    mDataIsCached = true;
+  }
+  if (( mMaximumNeighbours > 0 || mSearchRadius > 0 ) && mVertexTree.isEmpty() )
+  {
+    mVertexTree.build( mCachedBaseData );
+  }
+  return true;
+}
@@ -19,6 +19,7 @@
 #define QGSIDWINTERPOLATOR_H
 
 #include "qgsinterpolator.h"
+#include "qgsvertexkdtree.h"
 
 class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
 {
@@ -35,6 +36,22 @@ class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
 
     void setDistanceCoefficient( double p ) {mDistanceCoefficient = p;}
 
+    /**Sets the maximum number of nearest vertices used for a point, 0 (the default) uses all vertices
+      @note added in 2.1*/
+    void setMaximumNeighbours( int theCount ) { mMaximumNeighbours = theCount; }
+    int maximumNeighbours() const { return mMaximumNeighbours; }
+
+    /**Sets the maximum distance of the vertices used for a point, 0 (the default) for no limit.
+      Points without vertices within the distance have no value
+      @note added in 2.1*/
+    void setSearchRadius( double theRadius ) { mSearchRadius = theRadius; }
+    double searchRadius() const { return mSearchRadius; }
+
+    /**Caches the base data and builds the search tree if neighbours or radius are limited,
+      afterwards interpolatePoint() is thread safe
+      @note added in 2.1*/
+    bool prepareParallelInterpolation();
+
   private:
 
     QgsIDWInterpolator(); //forbidden
@@ -43,6 +60,15 @@ class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
        Smaller values mean sharper peaks at the data points. The default is a
        value of 2*/
     double mDistanceCoefficient;
+
+    int mMaximumNeighbours;
+    double mSearchRadius;
+
+    /**Search tree over mCachedBaseData, built for the first point if neighbours or radius are limited*/
+    QgsVertexKdTree mVertexTree;
+
+    /**Interpolation from the vertices found in mVertexTree*/
+    int interpolateNeighbours( double x, double y, double& result ) const;
 };
 
 #endif
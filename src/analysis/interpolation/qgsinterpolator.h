@@ -64,6 +64,11 @@ class ANALYSIS_EXPORT QgsInterpolator
        @return 0 in case of success*/
     virtual int interpolatePoint( double x, double y, double& result ) = 0;
 
+    /**Prepares the interpolation such that interpolatePoint() may afterwards be called from several threads at once.
+       @return false if the interpolator does not support this (the default)
+       @note added in 2.1*/
+    virtual bool prepareParallelInterpolation() { return false; }
+
   protected:
     /**Caches the vertex and value data from the provider. All the vertex data
      will be held in virtual memory
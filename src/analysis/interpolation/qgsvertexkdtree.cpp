@@ -0,0 +1,132 @@
+/***************************************************************************
+                              qgsvertexkdtree.cpp
+                              -------------------
+  begin                : 2013-12-22
+  copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsvertexkdtree.h"
+#include <algorithm>
+#include <limits>
+
+//! subtrees with at most this number of vertices are scanned
+static const int sLeafSize = 8;
+
+static bool lessX( const vertexData& v1, const vertexData& v2 )
+{
+  return v1.x < v2.x;
+}
+
+static bool lessY( const vertexData& v1, const vertexData& v2 )
+{
+  return v1.y < v2.y;
+}
+
+QgsVertexKdTree::QgsVertexKdTree()
+{
+}
+
+void QgsVertexKdTree::build( const QVector<vertexData>& theVertices )
+{
+  mVertices = theVertices;
+  build( 0, mVertices.size(), 0 );
+}
+
+void QgsVertexKdTree::build( int theBegin, int theEnd, int theDepth )
+{
+  if ( theEnd - theBegin <= sLeafSize )
+  {
+    return;
+  }
+  int myMiddle = ( theBegin + theEnd ) / 2;
+  vertexData* myData = mVertices.data();
+  std::nth_element( myData + theBegin, myData + myMiddle, myData + theEnd, theDepth % 2 == 0 ? lessX : lessY );
+  build( theBegin, myMiddle, theDepth + 1 );
+  build( myMiddle + 1, theEnd, theDepth + 1 );
+}
+
+void QgsVertexKdTree::neighbours( double x, double y, int theMaxCount, double theMaxDistance, QVector<Neighbour>& theResult ) const
+{
+  theResult.clear();
+  double myMaxSqrDistance = theMaxDistance > 0 ? theMaxDistance * theMaxDistance : std::numeric_limits<double>::infinity();
+  search( 0, mVertices.size(), 0, x, y, theMaxCount, myMaxSqrDistance, theResult );
+}
+
+void QgsVertexKdTree::addCandidate( int theIndex, double x, double y, int theMaxCount, double theMaxSqrDistance, QVector<Neighbour>& theResult ) const
+{
+  const vertexData& myVertex = mVertices[theIndex];
+  double mySqrDistance = ( myVertex.x - x ) * ( myVertex.x - x ) + ( myVertex.y - y ) * ( myVertex.y - y );
+  if ( mySqrDistance > theMaxSqrDistance )
+  {
+    return;
+  }
+  if ( theMaxCount <= 0 )
+  {
+    theResult.append( Neighbour( mySqrDistance, theIndex ) );
+  }
+  else if ( theResult.size() < theMaxCount )
+  {
+    // max heap on the distance, the farthest vertex found is replaced first
+    theResult.append( Neighbour( mySqrDistance, theIndex ) );
+    std::push_heap( theResult.begin(), theResult.end() );
+  }
+  else if ( mySqrDistance < theResult.first().first )
+  {
+    std::pop_heap( theResult.begin(), theResult.end() );
+    theResult.last() = Neighbour( mySqrDistance, theIndex );
+    std::push_heap( theResult.begin(), theResult.end() );
+  }
+}
+
+void QgsVertexKdTree::search( int theBegin, int theEnd, int theDepth, double x, double y, int theMaxCount, double theMaxSqrDistance, QVector<Neighbour>& theResult ) const
+{
+  if ( theEnd - theBegin <= sLeafSize )
+  {
+    for ( int i = theBegin; i < theEnd; ++i )
+    {
+      addCandidate( i, x, y, theMaxCount, theMaxSqrDistance, theResult );
+    }
+    return;
+  }
+
+  int myMiddle = ( theBegin + theEnd ) / 2;
+  addCandidate( myMiddle, x, y, theMaxCount, theMaxSqrDistance, theResult );
+
+  const vertexData& mySplit = mVertices[myMiddle];
+  double myOffset = theDepth % 2 == 0 ? x - mySplit.x : y - mySplit.y;
+  if ( myOffset < 0 )
+  {
+    search( theBegin, myMiddle, theDepth + 1, x, y, theMaxCount, theMaxSqrDistance, theResult );
+  }
+  else
+  {
+    search( myMiddle + 1, theEnd, theDepth + 1, x, y, theMaxCount, theMaxSqrDistance, theResult );
+  }
+
+  // the other side can only contain nearer vertices than the bound if the split line is nearer
+  double myBound = theMaxSqrDistance;
+  if ( theMaxCount > 0 && theResult.size() >= theMaxCount )
+  {
+    myBound = qMin( myBound, theResult.first().first );
+  }
+  if ( myOffset * myOffset <= myBound )
+  {
+    if ( myOffset < 0 )
+    {
+      search( myMiddle + 1, theEnd, theDepth + 1, x, y, theMaxCount, theMaxSqrDistance, theResult );
+    }
+    else
+    {
+      search( theBegin, myMiddle, theDepth + 1, x, y, theMaxCount, theMaxSqrDistance, theResult );
+    }
+  }
+}
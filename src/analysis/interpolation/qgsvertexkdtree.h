@@ -0,0 +1,57 @@
+/***************************************************************************
+                              qgsvertexkdtree.h
+                              -----------------
+  begin                : 2013-12-22
+  copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSVERTEXKDTREE_H
+#define QGSVERTEXKDTREE_H
+
+#include "qgsinterpolator.h"
+#include <QPair>
+
+/**A two dimensional kd-tree over interpolation vertices for nearest neighbour and radius searches.
+  The tree is built once and not changed afterwards, searches may run in several threads at once.
+  @note added in 2.1*/
+class ANALYSIS_EXPORT QgsVertexKdTree
+{
+  public:
+    /**A vertex found by a search: the squared distance and the index of the vertex in vertices()*/
+    typedef QPair<double, int> Neighbour;
+
+    QgsVertexKdTree();
+
+    /**Builds the tree, the vertices are copied in the order of the tree*/
+    void build( const QVector<vertexData>& theVertices );
+
+    bool isEmpty() const { return mVertices.isEmpty(); }
+
+    /**The vertices in the order of the tree*/
+    const QVector<vertexData>& vertices() const { return mVertices; }
+
+    /**Finds the vertices nearest to x, y.
+      @param theMaxCount maximum number of vertices to find, 0 for all within theMaxDistance
+      @param theMaxDistance maximum distance of the vertices, 0 for no limit
+      @param theResult out: the vertices found, unordered*/
+    void neighbours( double x, double y, int theMaxCount, double theMaxDistance, QVector<Neighbour>& theResult ) const;
+
+  private:
+    void build( int theBegin, int theEnd, int theDepth );
+    void search( int theBegin, int theEnd, int theDepth, double x, double y, int theMaxCount, double theMaxSqrDistance, QVector<Neighbour>& theResult ) const;
+    void addCandidate( int theIndex, double x, double y, int theMaxCount, double theMaxSqrDistance, QVector<Neighbour>& theResult ) const;
+
+    /**The vertices, for a subtree [begin, end) the middle vertex splits the rest along x (even depth) or y (odd depth)*/
+    QVector<vertexData> mVertices;
+};
+
+#endif
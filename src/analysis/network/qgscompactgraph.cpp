@@ -0,0 +1,93 @@
+/***************************************************************************
+  qgscompactgraph.cpp
+  --------------------------------------
+  Date                 : December 2013
+  Copyright            : (C) 2013 by the QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+// C++ standard includes
+#include <cmath>
+#include <limits>
+
+#include "qgscompactgraph.h"
+#include "qgsgraph.h"
+
+QgsCompactGraph::QgsCompactGraph( const QgsGraph* source, int criterionNum )
+    : mCriterionNum( criterionNum )
+    , mMinCostPerDistance( 0.0 )
+{
+  int vertexCount = source->vertexCount();
+  int arcCount = source->arcCount();
+
+  mPoints.resize( vertexCount );
+  for ( int i = 0; i < vertexCount; ++i )
+  {
+    mPoints[ i ] = source->vertex( i ).point();
+  }
+
+  // count the arcs of every vertex
+  mOutBegin.fill( 0, vertexCount + 1 );
+  mInBegin.fill( 0, vertexCount + 1 );
+  QVector<double> costs( arcCount );
+  double minCostPerDistance = std::numeric_limits<double>::infinity();
+  bool negativeCost = false;
+
+  for ( int i = 0; i < arcCount; ++i )
+  {
+    const QgsGraphArc& arc = source->arc( i );
+    double cost = arc.property( criterionNum ).toDouble();
+    costs[ i ] = cost;
+
+    mOutBegin[ arc.outVertex() + 1 ]++;
+    mInBegin[ arc.inVertex() + 1 ]++;
+
+    if ( cost < 0.0 )
+      negativeCost = true;
+
+    double distance = sqrt( mPoints[ arc.outVertex()].sqrDist( mPoints[ arc.inVertex()] ) );
+    if ( distance > 0.0 && cost / distance < minCostPerDistance )
+      minCostPerDistance = cost / distance;
+  }
+
+  if ( !negativeCost && minCostPerDistance != std::numeric_limits<double>::infinity() )
+    mMinCostPerDistance = minCostPerDistance;
+
+  for ( int i = 0; i < vertexCount; ++i )
+  {
+    mOutBegin[ i + 1 ] += mOutBegin[ i ];
+    mInBegin[ i + 1 ] += mInBegin[ i ];
+  }
+
+  // place the arcs, within a vertex they keep the order of the source graph
+  mOutHead.resize( arcCount );
+  mOutCost.resize( arcCount );
+  mOutArc.resize( arcCount );
+  mInTail.resize( arcCount );
+  mInCost.resize( arcCount );
+  mInArc.resize( arcCount );
+
+  QVector<int> outPos = mOutBegin;
+  QVector<int> inPos = mInBegin;
+
+  for ( int i = 0; i < arcCount; ++i )
+  {
+    const QgsGraphArc& arc = source->arc( i );
+
+    int pos = outPos[ arc.outVertex()]++;
+    mOutHead[ pos ] = arc.inVertex();
+    mOutCost[ pos ] = costs[ i ];
+    mOutArc[ pos ] = i;
+
+    pos = inPos[ arc.inVertex()]++;
+    mInTail[ pos ] = arc.outVertex();
+    mInCost[ pos ] = costs[ i ];
+    mInArc[ pos ] = i;
+  }
+}
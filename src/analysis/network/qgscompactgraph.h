@@ -0,0 +1,149 @@
+/***************************************************************************
+  qgscompactgraph.h
+  --------------------------------------
+  Date                 : December 2013
+  Copyright            : (C) 2013 by the QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSCOMPACTGRAPHH
+#define QGSCOMPACTGRAPHH
+
+// QT4 includes
+#include <QVector>
+
+// QGIS includes
+#include "qgspoint.h"
+
+class QgsGraph;
+
+/**
+ * \ingroup networkanalysis
+ * \class QgsCompactGraph
+ * \brief Read only compressed sparse row representation of a QgsGraph for one cost criterion
+ *
+ * The outgoing arcs of all vertices are stored in one array ordered by vertex, the arcs of
+ * vertex v are the positions outBegin( v ) ... outEnd( v ) - 1. Incoming arcs are stored the
+ * same way. The arc costs are converted to double once, so that searching the graph does not
+ * need to go through QVariant.
+ *
+ * Building the compact graph takes time linear in the size of the graph. It can be reused
+ * for any number of queries with QgsGraphAnalyzer and is not modified by them.
+ * @note added in 2.1
+ * @note not available in python bindings
+ */
+class ANALYSIS_EXPORT QgsCompactGraph
+{
+  public:
+    /**
+     * build the compact representation
+     * @param source The source graph
+     * @param criterionNum index of arc property used as arc cost
+     */
+    QgsCompactGraph( const QgsGraph* source, int criterionNum );
+
+    /**
+     * return vertex count
+     */
+    int vertexCount() const { return mPoints.size(); }
+
+    /**
+     * return arc count
+     */
+    int arcCount() const { return mOutHead.size(); }
+
+    /**
+     * return index of arc property used as arc cost
+     */
+    int criterionNum() const { return mCriterionNum; }
+
+    /**
+     * return vertex point
+     */
+    const QgsPoint& point( int vertex ) const { return mPoints[ vertex ]; }
+
+    /**
+     * return position of the first outgoing arc of vertex
+     */
+    int outBegin( int vertex ) const { return mOutBegin[ vertex ]; }
+
+    /**
+     * return position after the last outgoing arc of vertex
+     */
+    int outEnd( int vertex ) const { return mOutBegin[ vertex + 1 ]; }
+
+    /**
+     * return index of incoming vertex of the outgoing arc at position pos
+     */
+    int outHead( int pos ) const { return mOutHead[ pos ]; }
+
+    /**
+     * return cost of the outgoing arc at position pos
+     */
+    double outCost( int pos ) const { return mOutCost[ pos ]; }
+
+    /**
+     * return index in the source graph of the outgoing arc at position pos
+     */
+    int outArc( int pos ) const { return mOutArc[ pos ]; }
+
+    /**
+     * return position of the first incoming arc of vertex
+     */
+    int inBegin( int vertex ) const { return mInBegin[ vertex ]; }
+
+    /**
+     * return position after the last incoming arc of vertex
+     */
+    int inEnd( int vertex ) const { return mInBegin[ vertex + 1 ]; }
+
+    /**
+     * return index of outgoing vertex of the incoming arc at position pos
+     */
+    int inTail( int pos ) const { return mInTail[ pos ]; }
+
+    /**
+     * return cost of the incoming arc at position pos
+     */
+    double inCost( int pos ) const { return mInCost[ pos ]; }
+
+    /**
+     * return index in the source graph of the incoming arc at position pos
+     */
+    int inArc( int pos ) const { return mInArc[ pos ]; }
+
+    /**
+     * return the smallest ratio of arc cost and straight line distance between the arc vertices
+     * (0 if there are arcs with negative cost). The straight line distance between two vertices
+     * multiplied with this ratio never exceeds the cost of a path between them, it is used as
+     * the A* heuristic.
+     */
+    double minCostPerDistance() const { return mMinCostPerDistance; }
+
+  private:
+    int mCriterionNum;
+
+    QVector<QgsPoint> mPoints;
+
+    QVector<int> mOutBegin;
+    QVector<int> mOutHead;
+    QVector<double> mOutCost;
+    QVector<int> mOutArc;
+
+    QVector<int> mInBegin;
+    QVector<int> mInTail;
+    QVector<double> mInCost;
+    QVector<int> mInArc;
+
+    double mMinCostPerDistance;
+
+    friend class QgsGraphAnalyzer;
+};
+
+#endif //QGSCOMPACTGRAPHH
@@ -0,0 +1,704 @@
+/***************************************************************************
+  qgscontractionhierarchy.cpp
+  --------------------------------------
+  Date                 : December 2013
+  Copyright            : (C) 2013 by the QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+// C++ standard includes
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <vector>
+
+// QT includes
+#include <QFile>
+#include <QHash>
+#include <QtAlgorithms>
+
+#include "qgscontractionhierarchy.h"
+#include "qgscompactgraph.h"
+#include "qgslogger.h"
+
+// file header: magic, version, byte order mark, vertex count, arc count,
+// up arc count, down arc count and a reserved value
+static const qint32 sMagic = 0x48434751; // "QGCH"
+static const qint32 sVersion = 1;
+static const qint32 sByteOrderMark = 0x01020304;
+static const int sHeaderSize = 8 * sizeof( qint32 );
+
+// settled vertex limits of the witness searches, when the limit is reached
+// a shortcut is added although it might not be needed
+static const int sSimulateSettleLimit = 50;
+static const int sContractSettleLimit = 500;
+
+typedef std::pair<double, int> QgsChQueueItem;
+typedef std::priority_queue< QgsChQueueItem, std::vector<QgsChQueueItem>, std::greater<QgsChQueueItem> > QgsChQueue;
+
+//! arc of the remaining graph while contracting, stored at both of its vertices
+struct QgsChEdge
+{
+  QgsChEdge( int v, double c, int a ) : vertex( v ), cost( c ), arc( a ) {}
+  int vertex;
+  double cost;
+  int arc;
+};
+
+//! arc of the hierarchy
+struct QgsChArc
+{
+  int tail;
+  int head;
+  double cost;
+  int source;
+  int first;
+  int second;
+};
+
+/**
+ * Contracts the vertices of a graph in the order of a lazily updated priority:
+ * the number of shortcuts the contraction would add minus the number of arcs it would
+ * remove, plus the number of already contracted neighbours to contract evenly.
+ */
+class QgsChContractor
+{
+  public:
+    explicit QgsChContractor( const QgsCompactGraph& graph )
+        : mOut( graph.vertexCount() )
+        , mIn( graph.vertexCount() )
+        , mUpArcs( graph.vertexCount() )
+        , mDownArcs( graph.vertexCount() )
+        , mDeletedNeighbours( graph.vertexCount(), 0 )
+        , mWitnessCost( graph.vertexCount(), std::numeric_limits<double>::infinity() )
+        , mWitnessTarget( graph.vertexCount(), false )
+    {
+      for ( int v = 0; v < graph.vertexCount(); ++v )
+      {
+        for ( int pos = graph.outBegin( v ); pos < graph.outEnd( v ); ++pos )
+        {
+          // loops never are part of a shortest path
+          if ( graph.outHead( pos ) != v )
+            addEdge( v, graph.outHead( pos ), graph.outCost( pos ), graph.outArc( pos ), -1, -1 );
+        }
+      }
+    }
+
+    void contract()
+    {
+      QgsChQueue queue;
+      for ( int v = 0; v < ( int ) mOut.size(); ++v )
+        queue.push( QgsChQueueItem( priority( v ), v ) );
+
+      while ( !queue.empty() )
+      {
+        int v = queue.top().second;
+        queue.pop();
+
+        // the priority might have grown since it was queued
+        double p = priority( v );
+        if ( !queue.empty() && p > queue.top().first )
+        {
+          queue.push( QgsChQueueItem( p, v ) );
+          continue;
+        }
+
+        contractVertex( v, false );
+
+        // the remaining arcs of v lead to vertices contracted later, remove them from the remaining graph
+        for ( size_t i = 0; i < mOut[ v ].size(); ++i )
+        {
+          mUpArcs[ v ].push_back( mOut[ v ][ i ].arc );
+          removeEdge( mIn[ mOut[ v ][ i ].vertex ], v );
+          mDeletedNeighbours[ mOut[ v ][ i ].vertex ]++;
+        }
+        for ( size_t i = 0; i < mIn[ v ].size(); ++i )
+        {
+          mDownArcs[ v ].push_back( mIn[ v ][ i ].arc );
+          removeEdge( mOut[ mIn[ v ][ i ].vertex ], v );
+          mDeletedNeighbours[ mIn[ v ][ i ].vertex ]++;
+        }
+        std::vector<QgsChEdge>().swap( mOut[ v ] );
+        std::vector<QgsChEdge>().swap( mIn[ v ] );
+      }
+    }
+
+    const std::vector<QgsChArc>& arcs() const { return mArcs; }
+
+    //! arcs from v to vertices contracted later
+    const std::vector<int>& upArcs( int v ) const { return mUpArcs[ v ]; }
+
+    //! arcs to v from vertices contracted later
+    const std::vector<int>& downArcs( int v ) const { return mDownArcs[ v ]; }
+
+  private:
+    void addEdge( int tail, int head, double cost, int source, int first, int second )
+    {
+      QgsChArc arc;
+      arc.tail = tail;
+      arc.head = head;
+      arc.cost = cost;
+      arc.source = source;
+      arc.first = first;
+      arc.second = second;
+
+      std::vector<QgsChEdge>& out = mOut[ tail ];
+      for ( size_t i = 0; i < out.size(); ++i )
+      {
+        if ( out[ i ].vertex != head )
+          continue;
+
+        // keep only the cheapest of parallel arcs
+        if ( out[ i ].cost <= cost )
+          return;
+
+        mArcs.push_back( arc );
+        out[ i ].cost = cost;
+        out[ i ].arc = mArcs.size() - 1;
+
+        std::vector<QgsChEdge>& in = mIn[ head ];
+        for ( size_t j = 0; j < in.size(); ++j )
+        {
+          if ( in[ j ].vertex == tail )
+          {
+            in[ j ].cost = cost;
+            in[ j ].arc = mArcs.size() - 1;
+          }
+        }
+        return;
+      }
+
+      mArcs.push_back( arc );
+      out.push_back( QgsChEdge( head, cost, mArcs.size() - 1 ) );
+      mIn[ head ].push_back( QgsChEdge( tail, cost, mArcs.size() - 1 ) );
+    }
+
+    static void removeEdge( std::vector<QgsChEdge>& edges, int vertex )
+    {
+      for ( size_t i = 0; i < edges.size(); ++i )
+      {
+        if ( edges[ i ].vertex == vertex )
+        {
+          edges[ i ] = edges.back();
+          edges.pop_back();
+          return;
+        }
+      }
+    }
+
+    double priority( int v )
+    {
+      int removed = mOut[ v ].size() + mIn[ v ].size();
+      return contractVertex( v, true ) - removed + mDeletedNeighbours[ v ];
+    }
+
+    //! add the shortcuts needed to remove v from the remaining graph, returns their count
+    int contractVertex( int v, bool simulate )
+    {
+      int shortcuts = 0;
+      for ( size_t i = 0; i < mIn[ v ].size(); ++i )
+      {
+        // copy, adding shortcuts does not touch the arcs of v but may reallocate other lists
+        QgsChEdge in = mIn[ v ][ i ];
+
+        double maxCost = -1.0;
+        int targets = 0;
+        for ( size_t j = 0; j < mOut[ v ].size(); ++j )
+        {
+          if ( mOut[ v ][ j ].vertex != in.vertex )
+          {
+            maxCost = qMax( maxCost, in.cost + mOut[ v ][ j ].cost );
+            mWitnessTarget[ mOut[ v ][ j ].vertex ] = true;
+            ++targets;
+          }
+        }
+        if ( targets == 0 )
+          continue;
+
+        witnessSearch( in.vertex, v, maxCost, targets, simulate ? sSimulateSettleLimit : sContractSettleLimit );
+
+        for ( size_t j = 0; j < mOut[ v ].size(); ++j )
+        {
+          QgsChEdge out = mOut[ v ][ j ];
+          mWitnessTarget[ out.vertex ] = false;
+          if ( out.vertex == in.vertex || mWitnessCost[ out.vertex ] <= in.cost + out.cost )
+            continue;
+
+          ++shortcuts;
+          if ( !simulate )
+            addEdge( in.vertex, out.vertex, in.cost + out.cost, -1, in.arc, out.arc );
+        }
+
+        for ( size_t j = 0; j < mWitnessTouched.size(); ++j )
+          mWitnessCost[ mWitnessTouched[ j ] ] = std::numeric_limits<double>::infinity();
+        mWitnessTouched.clear();
+      }
+      return shortcuts;
+    }
+
+    //! dijkstra search from source in the remaining graph without the vertex skip, until all targets are settled
+    void witnessSearch( int source, int skip, double maxCost, int targets, int settleLimit )
+    {
+      QgsChQueue queue;
+      mWitnessCost[ source ] = 0.0;
+      mWitnessTouched.push_back( source );
+      queue.push( QgsChQueueItem( 0.0, source ) );
+
+      int settled = 0;
+      while ( !queue.empty() )
+      {
+        QgsChQueueItem item = queue.top();
+        queue.pop();
+        if ( item.first > mWitnessCost[ item.second ] )
+          continue;
+        if ( item.first > maxCost || ++settled > settleLimit )
+          break;
+        if ( mWitnessTarget[ item.second ] && --targets == 0 )
+          break;
+
+        const std::vector<QgsChEdge>& out = mOut[ item.second ];
+        for ( size_t i = 0; i < out.size(); ++i )
+        {
+          int w = out[ i ].vertex;
+          if ( w == skip )
+            continue;
+
+          double cost = item.first + out[ i ].cost;
+          if ( cost < mWitnessCost[ w ] )
+          {
+            if ( mWitnessCost[ w ] == std::numeric_limits<double>::infinity() )
+              mWitnessTouched.push_back( w );
+            mWitnessCost[ w ] = cost;
+            queue.push( QgsChQueueItem( cost, w ) );
+          }
+        }
+      }
+    }
+
+    std::vector<QgsChArc> mArcs;
+
+    //! arcs of the remaining graph
+    std::vector< std::vector<QgsChEdge> > mOut;
+    std::vector< std::vector<QgsChEdge> > mIn;
+
+    std::vector< std::vector<int> > mUpArcs;
+    std::vector< std::vector<int> > mDownArcs;
+    std::vector<int> mDeletedNeighbours;
+
+    std::vector<double> mWitnessCost;
+    std::vector<int> mWitnessTouched;
+    std::vector<bool> mWitnessTarget;
+};
+
+//! cost and hierarchy arc of a vertex reached by a query
+struct QgsChLabel
+{
+  QgsChLabel( double c = 0.0, int a = -1 ) : cost( c ), arc( a ) {}
+  double cost;
+  int arc;
+};
+
+QgsContractionHierarchy::QgsContractionHierarchy()
+    : mFile( NULL )
+{
+  clear();
+}
+
+QgsContractionHierarchy::QgsContractionHierarchy( const QgsGraph* source, int criterionNum )
+    : mFile( NULL )
+{
+  clear();
+  build( QgsCompactGraph( source, criterionNum ) );
+}
+
+QgsContractionHierarchy::QgsContractionHierarchy( const QgsCompactGraph& source )
+    : mFile( NULL )
+{
+  clear();
+  build( source );
+}
+
+QgsContractionHierarchy::~QgsContractionHierarchy()
+{
+  clear();
+}
+
+void QgsContractionHierarchy::clear()
+{
+  mData = NULL;
+  mVertexCount = 0;
+  mArcCount = 0;
+  mArcCost = NULL;
+  mArcTail = mArcHead = mArcSource = mArcFirst = mArcSecond = NULL;
+  mUpBegin = mUpArc = mDownBegin = mDownArc = NULL;
+
+  mBuffer.clear();
+  delete mFile;
+  mFile = NULL;
+}
+
+void QgsContractionHierarchy::build( const QgsCompactGraph& source )
+{
+  QgsChContractor contractor( source );
+  contractor.contract();
+
+  int vertexCount = source.vertexCount();
+  const std::vector<QgsChArc>& arcs = contractor.arcs();
+
+  QVector<int> upBegin( vertexCount + 1, 0 );
+  QVector<int> downBegin( vertexCount + 1, 0 );
+  for ( int v = 0; v < vertexCount; ++v )
+  {
+    upBegin[ v + 1 ] = upBegin[ v ] + contractor.upArcs( v ).size();
+    downBegin[ v + 1 ] = downBegin[ v ] + contractor.downArcs( v ).size();
+  }
+
+  int arcCount = arcs.size();
+  int upCount = upBegin[ vertexCount ];
+  int downCount = downBegin[ vertexCount ];
+
+  QByteArray buffer( sHeaderSize + arcCount * sizeof( double )
+                     + ( 5 * arcCount + 2 * ( vertexCount + 1 ) + upCount + downCount ) * sizeof( qint32 ), 0 );
+
+  qint32* header = reinterpret_cast<qint32*>( buffer.data() );
+  header[0] = sMagic;
+  header[1] = sVersion;
+  header[2] = sByteOrderMark;
+  header[3] = vertexCount;
+  header[4] = arcCount;
+  header[5] = upCount;
+  header[6] = downCount;
+  header[7] = 0;
+
+  double* arcCost = reinterpret_cast<double*>( buffer.data() + sHeaderSize );
+  qint32* arcTail = reinterpret_cast<qint32*>( arcCost + arcCount );
+  qint32* arcHead = arcTail + arcCount;
+  qint32* arcSource = arcHead + arcCount;
+  qint32* arcFirst = arcSource + arcCount;
+  qint32* arcSecond = arcFirst + arcCount;
+  qint32* up = arcSecond + arcCount;
+  qint32* upArc = up + vertexCount + 1;
+  qint32* down = upArc + upCount;
+  qint32* downArc = down + vertexCount + 1;
+
+  for ( int i = 0; i < arcCount; ++i )
+  {
+    arcCost[ i ] = arcs[ i ].cost;
+    arcTail[ i ] = arcs[ i ].tail;
+    arcHead[ i ] = arcs[ i ].head;
+    arcSource[ i ] = arcs[ i ].source;
+    arcFirst[ i ] = arcs[ i ].first;
+    arcSecond[ i ] = arcs[ i ].second;
+  }
+
+  qCopy( upBegin.begin(), upBegin.end(), up );
+  qCopy( downBegin.begin(), downBegin.end(), down );
+  for ( int v = 0; v < vertexCount; ++v )
+  {
+    std::copy( contractor.upArcs( v ).begin(), contractor.upArcs( v ).end(), upArc + upBegin[ v ] );
+    std::copy( contractor.downArcs( v ).begin(), contractor.downArcs( v ).end(), downArc + downBegin[ v ] );
+  }
+
+  mBuffer = buffer;
+  attach( mBuffer.constData(), mBuffer.size() );
+}
+
+bool QgsContractionHierarchy::attach( const char* data, qint64 size )
+{
+  if ( size < sHeaderSize )
+    return false;
+
+  const qint32* header = reinterpret_cast<const qint32*>( data );
+  if ( header[0] != sMagic || header[1] != sVersion || header[2] != sByteOrderMark )
+    return false;
+
+  qint64 vertexCount = header[3];
+  qint64 arcCount = header[4];
+  qint64 upCount = header[5];
+  qint64 downCount = header[6];
+  if ( vertexCount < 0 || arcCount < 0 || upCount < 0 || downCount < 0 )
+    return false;
+  if ( size != sHeaderSize + arcCount * ( qint64 ) sizeof( double )
+       + ( 5 * arcCount + 2 * ( vertexCount + 1 ) + upCount + downCount ) * ( qint64 ) sizeof( qint32 ) )
+    return false;
+
+  const double* arcCost = reinterpret_cast<const double*>( data + sHeaderSize );
+  const qint32* arcTail = reinterpret_cast<const qint32*>( arcCost + arcCount );
+  const qint32* arcHead = arcTail + arcCount;
+  const qint32* arcSource = arcHead + arcCount;
+  const qint32* arcFirst = arcSource + arcCount;
+  const qint32* arcSecond = arcFirst + arcCount;
+  const qint32* upBegin = arcSecond + arcCount;
+  const qint32* upArc = upBegin + vertexCount + 1;
+  const qint32* downBegin = upArc + upCount;
+  const qint32* downArc = downBegin + vertexCount + 1;
+
+  // check every index, so that queries on a damaged file cannot read outside the block
+  for ( qint64 i = 0; i < arcCount; ++i )
+  {
+    if ( arcTail[ i ] < 0 || arcTail[ i ] >= vertexCount || arcHead[ i ] < 0 || arcHead[ i ] >= vertexCount )
+      return false;
+    if ( arcSource[ i ] < 0 )
+    {
+      // the arcs of a shortcut are created before the shortcut
+      if ( arcFirst[ i ] < 0 || arcFirst[ i ] >= i || arcSecond[ i ] < 0 || arcSecond[ i ] >= i )
+        return false;
+    }
+    if ( !( arcCost[ i ] >= 0.0 ) )
+      return false;
+  }
+  if ( upBegin[ 0 ] != 0 || upBegin[ vertexCount ] != upCount || downBegin[ 0 ] != 0 || downBegin[ vertexCount ] != downCount )
+    return false;
+  for ( qint64 v = 0; v < vertexCount; ++v )
+  {
+    if ( upBegin[ v ] > upBegin[ v + 1 ] || downBegin[ v ] > downBegin[ v + 1 ] )
+      return false;
+    for ( int pos = upBegin[ v ]; pos < upBegin[ v + 1 ]; ++pos )
+    {
+      if ( upArc[ pos ] < 0 || upArc[ pos ] >= arcCount || arcTail[ upArc[ pos ] ] != v )
+        return false;
+    }
+    for ( int pos = downBegin[ v ]; pos < downBegin[ v + 1 ]; ++pos )
+    {
+      if ( downArc[ pos ] < 0 || downArc[ pos ] >= arcCount || arcHead[ downArc[ pos ] ] != v )
+        return false;
+    }
+  }
+
+  mData = data;
+  mVertexCount = vertexCount;
+  mArcCount = arcCount;
+  mArcCost = arcCost;
+  mArcTail = arcTail;
+  mArcHead = arcHead;
+  mArcSource = arcSource;
+  mArcFirst = arcFirst;
+  mArcSecond = arcSecond;
+  mUpBegin = upBegin;
+  mUpArc = upArc;
+  mDownBegin = downBegin;
+  mDownArc = downArc;
+  return true;
+}
+
+bool QgsContractionHierarchy::save( const QString& fileName ) const
+{
+  if ( !isValid() )
+    return false;
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+  {
+    QgsDebugMsg( QString( "Could not open %1 for writing" ).arg( fileName ) );
+    return false;
+  }
+
+  qint64 size = sHeaderSize + mArcCount * ( qint64 ) sizeof( double )
+                + ( 5 * ( qint64 ) mArcCount + 2 * ( mVertexCount + 1 ) + mUpBegin[ mVertexCount ] + mDownBegin[ mVertexCount ] ) * ( qint64 ) sizeof( qint32 );
+  return file.write( mData, size ) == size;
+}
+
+bool QgsContractionHierarchy::load( const QString& fileName )
+{
+  clear();
+
+  mFile = new QFile( fileName );
+  if ( !mFile->open( QIODevice::ReadOnly ) )
+  {
+    QgsDebugMsg( QString( "Could not open %1" ).arg( fileName ) );
+    clear();
+    return false;
+  }
+
+  qint64 size = mFile->size();
+  uchar* data = size > 0 ? mFile->map( 0, size ) : NULL;
+  if ( !data || !attach( reinterpret_cast<const char*>( data ), size ) )
+  {
+    QgsDebugMsg( QString( "%1 is not a valid contraction hierarchy" ).arg( fileName ) );
+    clear();
+    return false;
+  }
+  return true;
+}
+
+void QgsContractionHierarchy::unpackArc( int arc, QList<int>& path ) const
+{
+  std::vector<int> stack;
+  stack.push_back( arc );
+  while ( !stack.empty() )
+  {
+    int a = stack.back();
+    stack.pop_back();
+    if ( mArcSource[ a ] >= 0 )
+    {
+      path << mArcSource[ a ];
+    }
+    else
+    {
+      stack.push_back( mArcSecond[ a ] );
+      stack.push_back( mArcFirst[ a ] );
+    }
+  }
+}
+
+double QgsContractionHierarchy::shortestPath( int startVertexIdx, int endVertexIdx, QList<int>* resultPath ) const
+{
+  if ( resultPath != NULL )
+  {
+    resultPath->clear();
+  }
+
+  if ( startVertexIdx < 0 || startVertexIdx >= mVertexCount || endVertexIdx < 0 || endVertexIdx >= mVertexCount )
+    return std::numeric_limits<double>::infinity();
+
+  if ( startVertexIdx == endVertexIdx )
+    return 0.0;
+
+  // the search spaces are small, labels are kept in hashes instead of arrays for all vertices
+  QHash<int, QgsChLabel> label[2];
+  QgsChQueue queue[2];
+  label[0].insert( startVertexIdx, QgsChLabel() );
+  label[1].insert( endVertexIdx, QgsChLabel() );
+  queue[0].push( QgsChQueueItem( 0.0, startVertexIdx ) );
+  queue[1].push( QgsChQueueItem( 0.0, endVertexIdx ) );
+
+  double best = std::numeric_limits<double>::infinity();
+  int meeting = -1;
+
+  // a search stops when its smallest key reaches the best path found so far
+  while ( true )
+  {
+    bool forwardDone = queue[0].empty() || queue[0].top().first >= best;
+    bool backwardDone = queue[1].empty() || queue[1].top().first >= best;
+    if ( forwardDone && backwardDone )
+      break;
+
+    int dir = backwardDone || ( !forwardDone && queue[0].top().first <= queue[1].top().first ) ? 0 : 1;
+
+    QgsChQueueItem item = queue[dir].top();
+    queue[dir].pop();
+    int v = item.second;
+    if ( item.first > label[dir][ v ].cost )
+      continue;
+
+    QHash<int, QgsChLabel>::const_iterator other = label[1 - dir].constFind( v );
+    if ( other != label[1 - dir].constEnd() && item.first + other->cost < best )
+    {
+      best = item.first + other->cost;
+      meeting = v;
+    }
+
+    const int* begin = dir == 0 ? mUpBegin : mDownBegin;
+    const int* arcs = dir == 0 ? mUpArc : mDownArc;
+    for ( int pos = begin[ v ]; pos < begin[ v + 1 ]; ++pos )
+    {
+      int arc = arcs[ pos ];
+      int w = dir == 0 ? mArcHead[ arc ] : mArcTail[ arc ];
+      double cost = item.first + mArcCost[ arc ];
+
+      QHash<int, QgsChLabel>::iterator it = label[dir].find( w );
+      if ( it == label[dir].end() )
+      {
+        label[dir].insert( w, QgsChLabel( cost, arc ) );
+        queue[dir].push( QgsChQueueItem( cost, w ) );
+      }
+      else if ( cost < it->cost )
+      {
+        *it = QgsChLabel( cost, arc );
+        queue[dir].push( QgsChQueueItem( cost, w ) );
+      }
+    }
+  }
+
+  if ( resultPath != NULL && meeting >= 0 )
+  {
+    QList<int> arcs;
+    for ( int v = meeting; label[0].value( v ).arc >= 0; v = mArcTail[ label[0].value( v ).arc ] )
+      arcs.prepend( label[0].value( v ).arc );
+    for ( int v = meeting; label[1].value( v ).arc >= 0; v = mArcHead[ label[1].value( v ).arc ] )
+      arcs.append( label[1].value( v ).arc );
+
+    foreach ( int arc, arcs )
+      unpackArc( arc, *resultPath );
+  }
+
+  return best;
+}
+
+QVector<double> QgsContractionHierarchy::distances( int startVertexIdx, const QVector<int>& endVertices ) const
+{
+  QVector<double> result( endVertices.size(), std::numeric_limits<double>::infinity() );
+  if ( startVertexIdx < 0 || startVertexIdx >= mVertexCount )
+    return result;
+
+  // complete upward search from the start vertex, shared by all end vertices
+  QHash<int, double> forward;
+  QgsChQueue queue;
+  forward.insert( startVertexIdx, 0.0 );
+  queue.push( QgsChQueueItem( 0.0, startVertexIdx ) );
+  while ( !queue.empty() )
+  {
+    QgsChQueueItem item = queue.top();
+    queue.pop();
+    if ( item.first > forward[ item.second ] )
+      continue;
+
+    for ( int pos = mUpBegin[ item.second ]; pos < mUpBegin[ item.second + 1 ]; ++pos )
+    {
+      int arc = mUpArc[ pos ];
+      double cost = item.first + mArcCost[ arc ];
+      QHash<int, double>::iterator it = forward.find( mArcHead[ arc ] );
+      if ( it == forward.end() || cost < *it )
+      {
+        forward.insert( mArcHead[ arc ], cost );
+        queue.push( QgsChQueueItem( cost, mArcHead[ arc ] ) );
+      }
+    }
+  }
+
+  // upward search from every end vertex against the forward search space
+  for ( int i = 0; i < endVertices.size(); ++i )
+  {
+    if ( endVertices[ i ] < 0 || endVertices[ i ] >= mVertexCount )
+      continue;
+
+    double best = std::numeric_limits<double>::infinity();
+    QHash<int, double> backward;
+    QgsChQueue queue;
+    backward.insert( endVertices[ i ], 0.0 );
+    queue.push( QgsChQueueItem( 0.0, endVertices[ i ] ) );
+    while ( !queue.empty() && queue.top().first < best )
+    {
+      QgsChQueueItem item = queue.top();
+      queue.pop();
+      if ( item.first > backward[ item.second ] )
+        continue;
+
+      QHash<int, double>::const_iterator fwd = forward.constFind( item.second );
+      if ( fwd != forward.constEnd() && *fwd + item.first < best )
+        best = *fwd + item.first;
+
+      for ( int pos = mDownBegin[ item.second ]; pos < mDownBegin[ item.second + 1 ]; ++pos )
+      {
+        int arc = mDownArc[ pos ];
+        double cost = item.first + mArcCost[ arc ];
+        QHash<int, double>::iterator it = backward.find( mArcTail[ arc ] );
+        if ( it == backward.end() || cost < *it )
+        {
+          backward.insert( mArcTail[ arc ], cost );
+          queue.push( QgsChQueueItem( cost, mArcTail[ arc ] ) );
+        }
+      }
+    }
+    result[ i ] = best;
+  }
+
+  return result;
+}
@@ -0,0 +1,162 @@
+/***************************************************************************
+  qgscontractionhierarchy.h
+  --------------------------------------
+  Date                 : December 2013
+  Copyright            : (C) 2013 by the QGIS Development Team
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSCONTRACTIONHIERARCHYH
+#define QGSCONTRACTIONHIERARCHYH
+
+// QT4 includes
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+class QFile;
+class QgsGraph;
+class QgsCompactGraph;
+
+/**
+ * \ingroup networkanalysis
+ * \class QgsContractionHierarchy
+ * \brief Preprocessed graph for answering many shortest path queries on the same network
+ *
+ * The vertices are contracted one after another, starting with the least important ones.
+ * Contracting a vertex removes it from the remaining graph and adds shortcut arcs between
+ * its neighbours wherever the shortest path between them went through the vertex. A query
+ * is then a bidirectional dijkstra search which only follows arcs to vertices contracted
+ * later and settles a small part of the graph.
+ *
+ * The hierarchy is stored in one block of memory with the same layout as the file written
+ * by save(). load() maps the file into memory instead of reading it, so several processes
+ * can share the pages of the same hierarchy. Files are written in the byte order of the
+ * machine and are rejected by load() on machines with another byte order.
+ *
+ * Queries do not modify the hierarchy and may be run from several threads at the same time.
+ * Vertex and arc indices are the ones of the source QgsGraph. The arc costs must not be
+ * negative.
+ * @note added in 2.1
+ */
+class ANALYSIS_EXPORT QgsContractionHierarchy
+{
+  public:
+    /**
+     * create an empty hierarchy, use load() to read one from a file
+     */
+    QgsContractionHierarchy();
+
+    /**
+     * build the hierarchy
+     * @param source The source graph
+     * @param criterionNum index of arc property used as arc cost
+     */
+    QgsContractionHierarchy( const QgsGraph* source, int criterionNum );
+
+    /**
+     * build the hierarchy from a compact graph
+     * @note not available in python bindings
+     */
+    explicit QgsContractionHierarchy( const QgsCompactGraph& source );
+
+    ~QgsContractionHierarchy();
+
+    /**
+     * return true if the hierarchy was built or loaded successfully
+     */
+    bool isValid() const { return mData != NULL; }
+
+    /**
+     * return vertex count of the source graph
+     */
+    int vertexCount() const { return mVertexCount; }
+
+    /**
+     * return count of the arcs of the hierarchy, including the shortcuts
+     */
+    int arcCount() const { return mArcCount; }
+
+    /**
+     * find the shortest path between two vertices
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param resultPath indices of the arcs of the source graph forming the path from start to end vertex
+     * @return cost of the path, infinity if the end vertex is not reachable
+     */
+    double shortestPath( int startVertexIdx, int endVertexIdx, QList<int>* resultPath = NULL ) const;
+
+    /**
+     * compute the costs of the shortest paths from one vertex to several other vertices
+     * @param startVertexIdx index of start vertex
+     * @param endVertices indices of end vertices
+     * @return costs of the paths in the order of endVertices, infinity for vertices that are not reachable
+     */
+    QVector<double> distances( int startVertexIdx, const QVector<int>& endVertices ) const;
+
+    /**
+     * write the hierarchy to a file
+     * @return false if the hierarchy is not valid or the file could not be written
+     */
+    bool save( const QString& fileName ) const;
+
+    /**
+     * map a file written by save() into memory. The current hierarchy is discarded.
+     * @return false if the file could not be mapped or is not a valid hierarchy
+     */
+    bool load( const QString& fileName );
+
+  private:
+    Q_DISABLE_COPY( QgsContractionHierarchy )
+
+    void build( const QgsCompactGraph& source );
+
+    //! point the arrays into a data block laid out like the file, returns false if the block is not valid
+    bool attach( const char* data, qint64 size );
+
+    //! release the data block
+    void clear();
+
+    //! append the source graph arcs forming the arc of the hierarchy to path
+    void unpackArc( int arc, QList<int>& path ) const;
+
+    //! data block built in memory
+    QByteArray mBuffer;
+
+    //! mapped file, if the data block was loaded
+    QFile* mFile;
+
+    const char* mData;
+
+    int mVertexCount;
+    int mArcCount;
+
+    //! arcs of the hierarchy
+    const double* mArcCost;
+    const int* mArcTail;
+    const int* mArcHead;
+
+    //! index of the source graph arc, or -1 for shortcuts
+    const int* mArcSource;
+
+    //! for shortcuts the two arcs of the hierarchy the shortcut is made of
+    const int* mArcFirst;
+    const int* mArcSecond;
+
+    //! arcs to vertices contracted later, by tail vertex
+    const int* mUpBegin;
+    const int* mUpArc;
+
+    //! arcs from vertices contracted later, by head vertex
+    const int* mDownBegin;
+    const int* mDownArc;
+};
+
+#endif //QGSCONTRACTIONHIERARCHYH
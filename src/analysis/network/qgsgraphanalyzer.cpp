@@ -15,18 +15,136 @@
  *                                                                         *
  ***************************************************************************/
 // C++ standard includes
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <vector>
 
 // QT includes
-#include <QMap>
 #include <QVector>
-#include <QPair>
+#include <QtConcurrentMap>
 
 //QGIS-uncludes
 #include "qgsgraph.h"
+#include "qgscompactgraph.h"
 #include "qgsgraphanalyzer.h"
+#include "qgsgeometry.h"
+
+/**
+ * Binary min heap of vertex indices keyed by cost. The heap position of every vertex
+ * is tracked, so that the key of a queued vertex is decreased instead of queueing
+ * the vertex again.
+ */
+class QgsVertexHeap
+{
+  public:
+    explicit QgsVertexHeap( int vertexCount ) : mPos( vertexCount, -1 ) {}
+
+    bool isEmpty() const { return mVertex.empty(); }
+
+    //! key of the vertex with the smallest key
+    double topKey() const { return mKey[0]; }
+
+    //! remove and return the vertex with the smallest key
+    int pop()
+    {
+      int top = mVertex[0];
+      mPos[ top ] = -1;
+
+      int last = mVertex.size() - 1;
+      if ( last > 0 )
+      {
+        mVertex[0] = mVertex[ last ];
+        mKey[0] = mKey[ last ];
+        mVertex.pop_back();
+        mKey.pop_back();
+        siftDown( 0 );
+      }
+      else
+      {
+        mVertex.pop_back();
+        mKey.pop_back();
+      }
+      return top;
+    }
+
+    //! queue the vertex or decrease its key if it is queued with a higher key
+    void push( int vertex, double key )
+    {
+      int i = mPos[ vertex ];
+      if ( i < 0 )
+      {
+        i = mVertex.size();
+        mVertex.push_back( vertex );
+        mKey.push_back( key );
+      }
+      else if ( key < mKey[ i ] )
+      {
+        mKey[ i ] = key;
+      }
+      else
+      {
+        return;
+      }
+      siftUp( i );
+    }
+
+  private:
+    void siftUp( int i )
+    {
+      int vertex = mVertex[ i ];
+      double key = mKey[ i ];
+      while ( i > 0 )
+      {
+        int parent = ( i - 1 ) / 2;
+        if ( mKey[ parent ] <= key )
+          break;
+        mVertex[ i ] = mVertex[ parent ];
+        mKey[ i ] = mKey[ parent ];
+        mPos[ mVertex[ i ] ] = i;
+        i = parent;
+      }
+      mVertex[ i ] = vertex;
+      mKey[ i ] = key;
+      mPos[ vertex ] = i;
+    }
+
+    void siftDown( int i )
+    {
+      int size = mVertex.size();
+      int vertex = mVertex[ i ];
+      double key = mKey[ i ];
+      for ( ;; )
+      {
+        int child = 2 * i + 1;
+        if ( child >= size )
+          break;
+        if ( child + 1 < size && mKey[ child + 1 ] < mKey[ child ] )
+          ++child;
+        if ( key <= mKey[ child ] )
+          break;
+        mVertex[ i ] = mVertex[ child ];
+        mKey[ i ] = mKey[ child ];
+        mPos[ mVertex[ i ] ] = i;
+        i = child;
+      }
+      mVertex[ i ] = vertex;
+      mKey[ i ] = key;
+      mPos[ vertex ] = i;
+    }
+
+    std::vector<int> mVertex;
+    std::vector<double> mKey;
+    std::vector<int> mPos;
+};
 
 void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int criterionNum, QVector<int>* resultTree, QVector<double>* resultCost )
+{
+  QgsCompactGraph graph( source, criterionNum );
+  dijkstra( graph, startPointIdx, resultTree, resultCost );
+}
+
+void QgsGraphAnalyzer::dijkstra( const QgsCompactGraph& source, int startPointIdx, QVector<int>* resultTree, QVector<double>* resultCost )
 {
   QVector< double > * result = NULL;
   if ( resultCost != NULL )
@@ -39,52 +157,267 @@ void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int
   }
 
   result->clear();
-  result->insert( result->begin(), source->vertexCount(), std::numeric_limits<double>::infinity() );
-  ( *result )[ startPointIdx ] = 0.0;
+  result->insert( result->begin(), source.vertexCount(), std::numeric_limits<double>::infinity() );
 
+  int* tree = NULL;
   if ( resultTree != NULL )
   {
     resultTree->clear();
-    resultTree->insert( resultTree->begin(), source->vertexCount(), -1 );
+    resultTree->insert( resultTree->begin(), source.vertexCount(), -1 );
+    tree = resultTree->data();
+  }
+
+  searchCosts( source, startPointIdx, std::numeric_limits<double>::infinity(), NULL, result->data(), tree, NULL );
+
+  if ( resultCost == NULL )
+  {
+    delete result;
+  }
+}
+
+void QgsGraphAnalyzer::searchCosts( const QgsCompactGraph& source, int startVertexIdx, double maxCost, const QVector<int>* targetVertices,
+                                    double* cost, int* tree, QVector<int>* settled )
+{
+  const int* outBegin = source.mOutBegin.constData();
+  const int* outHead = source.mOutHead.constData();
+  const double* outCost = source.mOutCost.constData();
+  const int* outArc = source.mOutArc.constData();
+
+  std::vector<bool> isTarget;
+  int targetCount = 0;
+  if ( targetVertices != NULL )
+  {
+    isTarget.resize( source.vertexCount(), false );
+    foreach ( int target, *targetVertices )
+    {
+      if ( target >= 0 && target < source.vertexCount() && !isTarget[ target ] )
+      {
+        isTarget[ target ] = true;
+        ++targetCount;
+      }
+    }
   }
 
-  // QMultiMap< cost, vertexIdx > not_begin
-  // I use it and not create any struct or class.
-  QMultiMap< double, int > not_begin;
-  QMultiMap< double, int >::iterator it;
+  cost[ startVertexIdx ] = 0.0;
+  if ( targetVertices != NULL && targetCount == 0 )
+    return;
 
-  not_begin.insert( 0.0, startPointIdx );
+  QgsVertexHeap not_begin( source.vertexCount() );
+  not_begin.push( startVertexIdx, 0.0 );
 
-  while ( !not_begin.empty() )
+  while ( !not_begin.isEmpty() && not_begin.topKey() <= maxCost )
   {
-    it = not_begin.begin();
-    double curCost = it.key();
-    int curVertex = it.value();
-    not_begin.erase( it );
+    int curVertex = not_begin.pop();
+    double curCost = cost[ curVertex ];
+
+    if ( settled != NULL )
+    {
+      settled->append( curVertex );
+    }
+    if ( targetVertices != NULL && isTarget[ curVertex ] && --targetCount == 0 )
+      break;
 
-    // edge index list
-    QgsGraphArcIdList l = source->vertex( curVertex ).outArc();
-    QgsGraphArcIdList::iterator arcIt;
-    for ( arcIt = l.begin(); arcIt != l.end(); ++arcIt )
+    for ( int pos = outBegin[ curVertex ]; pos < outBegin[ curVertex + 1 ]; ++pos )
     {
-      const QgsGraphArc arc = source->arc( *arcIt );
-      double cost = arc.property( criterionNum ).toDouble() + curCost;
+      int inVertex = outHead[ pos ];
+      double newCost = outCost[ pos ] + curCost;
 
-      if ( cost < ( *result )[ arc.inVertex()] )
+      if ( newCost < cost[ inVertex ] )
       {
-        ( *result )[ arc.inVertex()] = cost;
-        if ( resultTree != NULL )
+        cost[ inVertex ] = newCost;
+        if ( tree != NULL )
         {
-          ( *resultTree )[ arc.inVertex()] = *arcIt;
+          tree[ inVertex ] = outArc[ pos ];
         }
-        not_begin.insert( cost, arc.inVertex() );
+        not_begin.push( inVertex, newCost );
       }
     }
   }
-  if ( resultCost == NULL )
+}
+
+double QgsGraphAnalyzer::shortestPath( const QgsGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum,
+                                       QList<int>* resultPath, PathAlgorithm algorithm )
+{
+  QgsCompactGraph graph( source, criterionNum );
+  return shortestPath( graph, startVertexIdx, endVertexIdx, resultPath, algorithm );
+}
+
+double QgsGraphAnalyzer::shortestPath( const QgsCompactGraph& source, int startVertexIdx, int endVertexIdx,
+                                       QList<int>* resultPath, PathAlgorithm algorithm )
+{
+  if ( resultPath != NULL )
   {
-    delete result;
+    resultPath->clear();
+  }
+
+  if ( startVertexIdx == endVertexIdx )
+    return 0.0;
+
+  switch ( algorithm )
+  {
+    case BidirectionalDijkstra:
+      return searchPathBidirectional( source, startVertexIdx, endVertexIdx, resultPath );
+
+    case AStar:
+      return searchPath( source, startVertexIdx, endVertexIdx, source.minCostPerDistance(), resultPath );
+
+    case Dijkstra:
+    default:
+      return searchPath( source, startVertexIdx, endVertexIdx, 0.0, resultPath );
+  }
+}
+
+double QgsGraphAnalyzer::searchPath( const QgsCompactGraph& source, int startVertexIdx, int endVertexIdx, double heuristicFactor, QList<int>* resultPath )
+{
+  int vertexCount = source.vertexCount();
+  QVector<double> cost( vertexCount, std::numeric_limits<double>::infinity() );
+  QVector<int> predVertex( vertexCount, -1 );
+  QVector<int> predArc( vertexCount, -1 );
+
+  const int* outBegin = source.mOutBegin.constData();
+  const int* outHead = source.mOutHead.constData();
+  const double* outCost = source.mOutCost.constData();
+  const int* outArc = source.mOutArc.constData();
+  const QgsPoint& endPoint = source.point( endVertexIdx );
+
+  QgsVertexHeap heap( vertexCount );
+  cost[ startVertexIdx ] = 0.0;
+  heap.push( startVertexIdx, 0.0 );
+
+  while ( !heap.isEmpty() )
+  {
+    int curVertex = heap.pop();
+    if ( curVertex == endVertexIdx )
+      break;
+
+    double curCost = cost[ curVertex ];
+    for ( int pos = outBegin[ curVertex ]; pos < outBegin[ curVertex + 1 ]; ++pos )
+    {
+      int inVertex = outHead[ pos ];
+      double newCost = outCost[ pos ] + curCost;
+
+      if ( newCost < cost[ inVertex ] )
+      {
+        cost[ inVertex ] = newCost;
+        predVertex[ inVertex ] = curVertex;
+        predArc[ inVertex ] = outArc[ pos ];
+
+        // the heuristic is consistent, so every vertex is taken from the heap once
+        double key = newCost;
+        if ( heuristicFactor > 0.0 )
+          key += heuristicFactor * sqrt( source.point( inVertex ).sqrDist( endPoint ) );
+        heap.push( inVertex, key );
+      }
+    }
+  }
+
+  if ( cost[ endVertexIdx ] == std::numeric_limits<double>::infinity() )
+    return cost[ endVertexIdx ];
+
+  if ( resultPath != NULL )
+  {
+    for ( int v = endVertexIdx; v != startVertexIdx; v = predVertex[ v ] )
+    {
+      resultPath->prepend( predArc[ v ] );
+    }
   }
+  return cost[ endVertexIdx ];
+}
+
+double QgsGraphAnalyzer::searchPathBidirectional( const QgsCompactGraph& source, int startVertexIdx, int endVertexIdx, QList<int>* resultPath )
+{
+  int vertexCount = source.vertexCount();
+  const double inf = std::numeric_limits<double>::infinity();
+
+  // forward search from the start vertex along outgoing arcs
+  QVector<double> costF( vertexCount, inf );
+  QVector<int> predVertexF( vertexCount, -1 );
+  QVector<int> predArcF( vertexCount, -1 );
+  QgsVertexHeap heapF( vertexCount );
+
+  // backward search from the end vertex along incoming arcs
+  QVector<double> costB( vertexCount, inf );
+  QVector<int> nextVertexB( vertexCount, -1 );
+  QVector<int> nextArcB( vertexCount, -1 );
+  QgsVertexHeap heapB( vertexCount );
+
+  costF[ startVertexIdx ] = 0.0;
+  heapF.push( startVertexIdx, 0.0 );
+  costB[ endVertexIdx ] = 0.0;
+  heapB.push( endVertexIdx, 0.0 );
+
+  double best = inf;
+  int meetVertex = -1;
+
+  while ( !heapF.isEmpty() && !heapB.isEmpty() )
+  {
+    // no path through the unsettled vertices can be shorter
+    if ( heapF.topKey() + heapB.topKey() >= best )
+      break;
+
+    if ( heapF.topKey() <= heapB.topKey() )
+    {
+      int curVertex = heapF.pop();
+      double curCost = costF[ curVertex ];
+      for ( int pos = source.outBegin( curVertex ); pos < source.outEnd( curVertex ); ++pos )
+      {
+        int v = source.mOutHead[ pos ];
+        double newCost = source.mOutCost[ pos ] + curCost;
+        if ( newCost < costF[ v ] )
+        {
+          costF[ v ] = newCost;
+          predVertexF[ v ] = curVertex;
+          predArcF[ v ] = source.mOutArc[ pos ];
+          heapF.push( v, newCost );
+
+          if ( newCost + costB[ v ] < best )
+          {
+            best = newCost + costB[ v ];
+            meetVertex = v;
+          }
+        }
+      }
+    }
+    else
+    {
+      int curVertex = heapB.pop();
+      double curCost = costB[ curVertex ];
+      for ( int pos = source.inBegin( curVertex ); pos < source.inEnd( curVertex ); ++pos )
+      {
+        int v = source.mInTail[ pos ];
+        double newCost = source.mInCost[ pos ] + curCost;
+        if ( newCost < costB[ v ] )
+        {
+          costB[ v ] = newCost;
+          nextVertexB[ v ] = curVertex;
+          nextArcB[ v ] = source.mInArc[ pos ];
+          heapB.push( v, newCost );
+
+          if ( newCost + costF[ v ] < best )
+          {
+            best = newCost + costF[ v ];
+            meetVertex = v;
+          }
+        }
+      }
+    }
+  }
+
+  if ( meetVertex == -1 )
+    return inf;
+
+  if ( resultPath != NULL )
+  {
+    for ( int v = meetVertex; v != startVertexIdx; v = predVertexF[ v ] )
+    {
+      resultPath->prepend( predArcF[ v ] );
+    }
+    for ( int v = meetVertex; v != endVertexIdx; v = nextVertexB[ v ] )
+    {
+      resultPath->append( nextArcB[ v ] );
+    }
+  }
+  return best;
 }
 
 QgsGraph* QgsGraphAnalyzer::shortestTree( const QgsGraph* source, int startVertexIdx, int criterionNum )
@@ -122,3 +455,136 @@ QgsGraph* QgsGraphAnalyzer::shortestTree( const QgsGraph* source, int startVerte
 
   return treeResult;
 }
+
+//! search of one source vertex of QgsGraphAnalyzer::costMatrix()
+struct QgsCostMatrixJob
+{
+  const QgsCompactGraph* graph;
+  int source;
+  const QVector<int>* targets;
+  QVector<double> costs;
+
+  void run()
+  {
+    costs.fill( std::numeric_limits<double>::infinity(), targets->size() );
+    if ( source < 0 || source >= graph->vertexCount() )
+      return;
+
+    QVector<double> cost( graph->vertexCount(), std::numeric_limits<double>::infinity() );
+    QgsGraphAnalyzer::searchCosts( *graph, source, std::numeric_limits<double>::infinity(), targets, cost.data(), NULL, NULL );
+
+    for ( int i = 0; i < targets->size(); ++i )
+    {
+      int target = targets->at( i );
+      if ( target >= 0 && target < graph->vertexCount() )
+        costs[ i ] = cost[ target ];
+    }
+  }
+};
+
+QVector< QVector<double> > QgsGraphAnalyzer::costMatrix( const QgsGraph* source, const QVector<int>& sourceVertices, const QVector<int>& targetVertices, int criterionNum )
+{
+  QgsCompactGraph graph( source, criterionNum );
+  return costMatrix( graph, sourceVertices, targetVertices );
+}
+
+QVector< QVector<double> > QgsGraphAnalyzer::costMatrix( const QgsCompactGraph& source, const QVector<int>& sourceVertices, const QVector<int>& targetVertices )
+{
+  QVector<QgsCostMatrixJob> jobs( sourceVertices.size() );
+  for ( int i = 0; i < sourceVertices.size(); ++i )
+  {
+    jobs[ i ].graph = &source;
+    jobs[ i ].source = sourceVertices[ i ];
+    jobs[ i ].targets = &targetVertices;
+  }
+  QtConcurrent::blockingMap( jobs, &QgsCostMatrixJob::run );
+
+  QVector< QVector<double> > result( sourceVertices.size() );
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    result[ i ] = jobs[ i ].costs;
+  }
+  return result;
+}
+
+//! search of one start vertex of QgsGraphAnalyzer::isochrones(), collects the reached parts of the arcs for every threshold
+struct QgsIsochroneJob
+{
+  const QgsCompactGraph* graph;
+  int start;
+  const QList<double>* thresholds;
+  QVector<QgsMultiPolyline> lines;
+
+  void run()
+  {
+    lines.resize( thresholds->size() );
+    if ( start < 0 || start >= graph->vertexCount() || thresholds->isEmpty() )
+      return;
+
+    double maxCost = *std::max_element( thresholds->begin(), thresholds->end() );
+    QVector<double> cost( graph->vertexCount(), std::numeric_limits<double>::infinity() );
+    QVector<int> settled;
+    QgsGraphAnalyzer::searchCosts( *graph, start, maxCost, NULL, cost.data(), NULL, &settled );
+
+    for ( int t = 0; t < thresholds->size(); ++t )
+    {
+      double threshold = thresholds->at( t );
+
+      // the vertices are settled in the order of their costs
+      for ( int i = 0; i < settled.size() && cost[ settled[ i ] ] < threshold; ++i )
+      {
+        int v = settled[ i ];
+        const QgsPoint& p1 = graph->point( v );
+        double remaining = threshold - cost[ v ];
+
+        for ( int pos = graph->outBegin( v ); pos < graph->outEnd( v ); ++pos )
+        {
+          const QgsPoint& p2 = graph->point( graph->outHead( pos ) );
+          double arcCost = graph->outCost( pos );
+          double f = arcCost > remaining ? remaining / arcCost : 1.0;
+
+          QgsPolyline line;
+          line << p1 << QgsPoint( p1.x() + f * ( p2.x() - p1.x() ), p1.y() + f * ( p2.y() - p1.y() ) );
+          lines[ t ] << line;
+        }
+      }
+    }
+  }
+};
+
+QList<QgsGeometry*> QgsGraphAnalyzer::isochrones( const QgsGraph* source, int startVertexIdx, int criterionNum, const QList<double>& costs, double bufferDistance )
+{
+  QgsCompactGraph graph( source, criterionNum );
+  return isochrones( graph, QVector<int>() << startVertexIdx, costs, bufferDistance ).at( 0 );
+}
+
+QVector< QList<QgsGeometry*> > QgsGraphAnalyzer::isochrones( const QgsCompactGraph& source, const QVector<int>& startVertices, const QList<double>& costs, double bufferDistance )
+{
+  QVector<QgsIsochroneJob> jobs( startVertices.size() );
+  for ( int i = 0; i < startVertices.size(); ++i )
+  {
+    jobs[ i ].graph = &source;
+    jobs[ i ].start = startVertices[ i ];
+    jobs[ i ].thresholds = &costs;
+  }
+  QtConcurrent::blockingMap( jobs, &QgsIsochroneJob::run );
+
+  // the polygons are built here, GEOS must not be used from several threads
+  QVector< QList<QgsGeometry*> > result( startVertices.size() );
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    for ( int t = 0; t < jobs[ i ].lines.size(); ++t )
+    {
+      QgsGeometry* reached = NULL;
+      if ( !jobs[ i ].lines[ t ].isEmpty() )
+        reached = QgsGeometry::fromMultiPolyline( jobs[ i ].lines[ t ] );
+      else if ( jobs[ i ].start >= 0 && jobs[ i ].start < source.vertexCount() )
+        reached = QgsGeometry::fromPoint( source.point( jobs[ i ].start ) );
+
+      QgsGeometry* area = reached ? reached->buffer( bufferDistance, 8 ) : NULL;
+      delete reached;
+      result[ i ] << ( area ? area : new QgsGeometry() );
+    }
+  }
+  return result;
+}
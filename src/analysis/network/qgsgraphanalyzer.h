@@ -19,10 +19,13 @@
 #define QGSGRAPHANALYZERH
 
 //QT-includes
+#include <QList>
 #include <QVector>
 
 // forward-declaration
 class QgsGraph;
+class QgsCompactGraph;
+class QgsGeometry;
 
 /** \ingroup networkanalysis
  * The QGis class provides graph analysis functions
@@ -31,6 +34,17 @@ class QgsGraph;
 class ANALYSIS_EXPORT QgsGraphAnalyzer
 {
   public:
+    /**
+     * algorithms for searching the shortest path between two vertices
+     * @note added in 2.1
+     */
+    enum PathAlgorithm
+    {
+      Dijkstra,               //!< dijkstra algorithm, stopping at the end vertex
+      BidirectionalDijkstra,  //!< dijkstra algorithm searching from both ends
+      AStar                   //!< A* with the straight line distance as heuristic, see QgsCompactGraph::minCostPerDistance()
+    };
+
     /**
      * solve shortest path problem using dijkstra algorithm
      * @param source The source graph
@@ -41,6 +55,45 @@ class ANALYSIS_EXPORT QgsGraphAnalyzer
      */
     static void dijkstra( const QgsGraph* source, int startVertexIdx, int criterionNum, QVector<int>* resultTree = NULL, QVector<double>* resultCost = NULL );
 
+    /**
+     * solve shortest path problem using dijkstra algorithm on a compact graph, which can be reused for many queries
+     * @param source The compact graph
+     * @param startVertexIdx index of start vertex
+     * @param resultTree array represents the shortest path tree. resultTree[ vertexIndex ] == inboundingArcIndex if vertex reacheble and resultTree[ vertexIndex ] == -1 others.
+     * @param resultCost array of cost paths
+     * @note added in 2.1
+     * @note not available in python bindings
+     */
+    static void dijkstra( const QgsCompactGraph& source, int startVertexIdx, QVector<int>* resultTree = NULL, QVector<double>* resultCost = NULL );
+
+    /**
+     * find the shortest path between two vertices. The arc costs must not be negative.
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param resultPath indices of the arcs of the path from start to end vertex
+     * @param algorithm search algorithm
+     * @return cost of the path, infinity if the end vertex is not reachable
+     * @note added in 2.1
+     */
+    static double shortestPath( const QgsGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum,
+                                QList<int>* resultPath = NULL, PathAlgorithm algorithm = BidirectionalDijkstra );
+
+    /**
+     * find the shortest path between two vertices of a compact graph. The arc costs must not be negative.
+     * @param source The compact graph
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param resultPath indices of the arcs of the path from start to end vertex
+     * @param algorithm search algorithm
+     * @return cost of the path, infinity if the end vertex is not reachable
+     * @note added in 2.1
+     * @note not available in python bindings
+     */
+    static double shortestPath( const QgsCompactGraph& source, int startVertexIdx, int endVertexIdx,
+                                QList<int>* resultPath = NULL, PathAlgorithm algorithm = BidirectionalDijkstra );
+
     /**
      * return shortest path tree with root-node in startVertexIdx
      * @param source The source graph
@@ -48,5 +101,64 @@ class ANALYSIS_EXPORT QgsGraphAnalyzer
      * @param criterionNum index of edge property as optimization criterion
      */
     static QgsGraph* shortestTree( const QgsGraph* source, int startVertexIdx, int criterionNum );
+
+    /**
+     * compute the costs of the shortest paths from every source vertex to every target vertex.
+     * The searches of the source vertices run in parallel and share the graph, every search stops
+     * as soon as all target vertices are reached.
+     * @param source The source graph
+     * @param sourceVertices indices of the start vertices
+     * @param targetVertices indices of the end vertices
+     * @param criterionNum index of arc property as optimization criterion
+     * @return one row per source vertex with the costs to the target vertices, infinity if a target vertex is not reachable
+     * @note added in 2.1
+     */
+    static QVector< QVector<double> > costMatrix( const QgsGraph* source, const QVector<int>& sourceVertices, const QVector<int>& targetVertices, int criterionNum );
+
+    /**
+     * compute the costs of the shortest paths from every source vertex to every target vertex of a compact graph
+     * @note added in 2.1
+     * @note not available in python bindings
+     */
+    static QVector< QVector<double> > costMatrix( const QgsCompactGraph& source, const QVector<int>& sourceVertices, const QVector<int>& targetVertices );
+
+    /**
+     * compute service areas: the parts of the network which can be reached from the start vertex
+     * within the given costs, buffered by bufferDistance. Arcs reached only in part are cut at the
+     * point where the cost is used up. All areas of a start vertex are computed from one search.
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param costs cost thresholds
+     * @param bufferDistance buffer distance in the units of the graph vertices
+     * @return one polygon for every threshold, in the order of costs. The caller takes ownership.
+     * @note added in 2.1
+     */
+    static QList<QgsGeometry*> isochrones( const QgsGraph* source, int startVertexIdx, int criterionNum, const QList<double>& costs, double bufferDistance );
+
+    /**
+     * compute service areas for several start vertices of a compact graph. The searches run in parallel.
+     * @return for every start vertex one polygon for every threshold. The caller takes ownership.
+     * @note added in 2.1
+     * @note not available in python bindings
+     */
+    static QVector< QList<QgsGeometry*> > isochrones( const QgsCompactGraph& source, const QVector<int>& startVertices, const QList<double>& costs, double bufferDistance );
+
+  private:
+    /**
+     * dijkstra search which stops when the costs exceed maxCost or all target vertices are reached.
+     * The vertices are appended to settled in the order they are reached, if not NULL.
+     */
+    static void searchCosts( const QgsCompactGraph& source, int startVertexIdx, double maxCost, const QVector<int>* targetVertices,
+                             double* cost, int* tree, QVector<int>* settled );
+
+    friend struct QgsCostMatrixJob;
+    friend struct QgsIsochroneJob;
+
+    //! dijkstra search from start to end vertex, guided by the straight line distance times heuristicFactor
+    static double searchPath( const QgsCompactGraph& source, int startVertexIdx, int endVertexIdx, double heuristicFactor, QList<int>* resultPath );
+
+    //! dijkstra search from both ends until the searches meet
+    static double searchPathBidirectional( const QgsCompactGraph& source, int startVertexIdx, int endVertexIdx, QList<int>* resultPath );
 };
 #endif //QGSGRAPHANALYZERH
@@ -23,12 +23,18 @@
 #include <qgspoint.h>
 #include <qgsgeometry.h>
 #include <qgsdistancearea.h>
+#include <qgscoordinatetransform.h>
+#include <qgscsexception.h>
+#include <qgslogger.h>
 
 // QT includes
 #include <QString>
 #include <QtAlgorithms>
+#include <QThread>
+#include <QtConcurrentMap>
 
 //standard includes
+#include <cmath>
 #include <limits>
 #include <algorithm>
 
@@ -99,6 +105,269 @@ bool TiePointInfoCompare( const TiePointInfo& a, const TiePointInfo& b )
   return a.mFirstPoint.x() == b.mFirstPoint.x() ? a.mFirstPoint.y() < b.mFirstPoint.y() : a.mFirstPoint.x() < b.mFirstPoint.x();
 }
 
+/**
+ * Uniform grid over the segments of the layer, used to find the segment nearest to a
+ * point without testing all segments. Every segment is registered in all cells touched
+ * by its bounding box. The cells are searched in rings around the point until no
+ * unsearched cell can hold a nearer segment.
+ */
+class QgsSegmentGrid
+{
+  public:
+    QgsSegmentGrid( const QVector< QgsPoint >& firstPoints, const QVector< QgsPoint >& lastPoints );
+
+    /**
+     * find the segment nearest to pt, of equally near segments the one with the lowest index
+     * @return index of the segment or -1 if there are no segments
+     */
+    int nearestSegment( const QgsPoint& pt, double& sqrDist, QgsPoint& tiedPoint ) const;
+
+  private:
+    int column( double x ) const;
+    int row( double y ) const;
+    void searchCell( int cell, const QgsPoint& pt, int& best, double& sqrDist, QgsPoint& tiedPoint ) const;
+
+    const QVector< QgsPoint >& mFirstPoints;
+    const QVector< QgsPoint >& mLastPoints;
+
+    double mXMin;
+    double mYMin;
+    double mCellSize;
+    int mColumns;
+    int mRows;
+
+    //! segments of cell c are mCellSegments[ mCellBegin[ c ] ] ... mCellSegments[ mCellBegin[ c + 1 ] - 1 ]
+    QVector< int > mCellBegin;
+    QVector< int > mCellSegments;
+};
+
+QgsSegmentGrid::QgsSegmentGrid( const QVector< QgsPoint >& firstPoints, const QVector< QgsPoint >& lastPoints )
+    : mFirstPoints( firstPoints )
+    , mLastPoints( lastPoints )
+    , mXMin( 0.0 )
+    , mYMin( 0.0 )
+    , mCellSize( 1.0 )
+    , mColumns( 0 )
+    , mRows( 0 )
+{
+  int count = firstPoints.size();
+  if ( count == 0 )
+    return;
+
+  double xMax = firstPoints[ 0 ].x();
+  double yMax = firstPoints[ 0 ].y();
+  mXMin = xMax;
+  mYMin = yMax;
+  for ( int i = 0; i < count; ++i )
+  {
+    mXMin = qMin( mXMin, qMin( firstPoints[ i ].x(), lastPoints[ i ].x() ) );
+    mYMin = qMin( mYMin, qMin( firstPoints[ i ].y(), lastPoints[ i ].y() ) );
+    xMax = qMax( xMax, qMax( firstPoints[ i ].x(), lastPoints[ i ].x() ) );
+    yMax = qMax( yMax, qMax( firstPoints[ i ].y(), lastPoints[ i ].y() ) );
+  }
+
+  // about one segment per cell, but not more than 2 * count cells along one side
+  double width = xMax - mXMin;
+  double height = yMax - mYMin;
+  mCellSize = qMax( sqrt( width * height / count ), qMax( width, height ) / count );
+  if ( mCellSize <= 0.0 )
+    mCellSize = 1.0;
+
+  mColumns = ( int )( width / mCellSize ) + 1;
+  mRows = ( int )( height / mCellSize ) + 1;
+
+  mCellBegin.fill( 0, mColumns * mRows + 1 );
+  for ( int i = 0; i < count; ++i )
+  {
+    int c0 = column( qMin( firstPoints[ i ].x(), lastPoints[ i ].x() ) );
+    int c1 = column( qMax( firstPoints[ i ].x(), lastPoints[ i ].x() ) );
+    int r0 = row( qMin( firstPoints[ i ].y(), lastPoints[ i ].y() ) );
+    int r1 = row( qMax( firstPoints[ i ].y(), lastPoints[ i ].y() ) );
+    for ( int r = r0; r <= r1; ++r )
+      for ( int c = c0; c <= c1; ++c )
+        mCellBegin[ r * mColumns + c + 1 ]++;
+  }
+
+  for ( int c = 0; c < mColumns * mRows; ++c )
+    mCellBegin[ c + 1 ] += mCellBegin[ c ];
+
+  mCellSegments.resize( mCellBegin.last() );
+  QVector< int > cellPos = mCellBegin;
+  for ( int i = 0; i < count; ++i )
+  {
+    int c0 = column( qMin( firstPoints[ i ].x(), lastPoints[ i ].x() ) );
+    int c1 = column( qMax( firstPoints[ i ].x(), lastPoints[ i ].x() ) );
+    int r0 = row( qMin( firstPoints[ i ].y(), lastPoints[ i ].y() ) );
+    int r1 = row( qMax( firstPoints[ i ].y(), lastPoints[ i ].y() ) );
+    for ( int r = r0; r <= r1; ++r )
+      for ( int c = c0; c <= c1; ++c )
+        mCellSegments[ cellPos[ r * mColumns + c ]++ ] = i;
+  }
+}
+
+int QgsSegmentGrid::column( double x ) const
+{
+  double c = floor(( x - mXMin ) / mCellSize );
+  if ( c < 0.0 )
+    return 0;
+  if ( c >= mColumns )
+    return mColumns - 1;
+  return ( int ) c;
+}
+
+int QgsSegmentGrid::row( double y ) const
+{
+  double r = floor(( y - mYMin ) / mCellSize );
+  if ( r < 0.0 )
+    return 0;
+  if ( r >= mRows )
+    return mRows - 1;
+  return ( int ) r;
+}
+
+void QgsSegmentGrid::searchCell( int cell, const QgsPoint& pt, int& best, double& sqrDist, QgsPoint& tiedPoint ) const
+{
+  for ( int i = mCellBegin[ cell ]; i < mCellBegin[ cell + 1 ]; ++i )
+  {
+    int segment = mCellSegments[ i ];
+    const QgsPoint& pt1 = mFirstPoints[ segment ];
+    const QgsPoint& pt2 = mLastPoints[ segment ];
+
+    QgsPoint minDistPoint;
+    double dist;
+    if ( pt1 == pt2 )
+    {
+      dist = pt.sqrDist( pt1 );
+      minDistPoint = pt1;
+    }
+    else
+    {
+      dist = pt.sqrDistToSegment( pt1.x(), pt1.y(), pt2.x(), pt2.y(), minDistPoint );
+    }
+
+    if ( dist < sqrDist || ( dist == sqrDist && segment < best ) )
+    {
+      best = segment;
+      sqrDist = dist;
+      tiedPoint = minDistPoint;
+    }
+  }
+}
+
+int QgsSegmentGrid::nearestSegment( const QgsPoint& pt, double& sqrDist, QgsPoint& tiedPoint ) const
+{
+  int best = -1;
+  sqrDist = std::numeric_limits<double>::infinity();
+  if ( mColumns == 0 )
+    return best;
+
+  int col = column( pt.x() );
+  int row = this->row( pt.y() );
+
+  for ( int ring = 0; ; ++ring )
+  {
+    int c0 = col - ring;
+    int c1 = col + ring;
+    int r0 = row - ring;
+    int r1 = row + ring;
+
+    for ( int r = qMax( r0, 0 ); r <= qMin( r1, mRows - 1 ); ++r )
+    {
+      if ( r == r0 || r == r1 )
+      {
+        for ( int c = qMax( c0, 0 ); c <= qMin( c1, mColumns - 1 ); ++c )
+          searchCell( r * mColumns + c, pt, best, sqrDist, tiedPoint );
+      }
+      else
+      {
+        if ( c0 >= 0 )
+          searchCell( r * mColumns + c0, pt, best, sqrDist, tiedPoint );
+        if ( c1 < mColumns )
+          searchCell( r * mColumns + c1, pt, best, sqrDist, tiedPoint );
+      }
+    }
+
+    if ( c0 <= 0 && r0 <= 0 && c1 >= mColumns - 1 && r1 >= mRows - 1 )
+      break;
+
+    // segments which are not registered in the searched cells are at least that far away
+    double bound = std::numeric_limits<double>::infinity();
+    if ( c0 > 0 )
+      bound = qMin( bound, pt.x() - ( mXMin + c0 * mCellSize ) );
+    if ( c1 < mColumns - 1 )
+      bound = qMin( bound, mXMin + ( c1 + 1 ) * mCellSize - pt.x() );
+    if ( r0 > 0 )
+      bound = qMin( bound, pt.y() - ( mYMin + r0 * mCellSize ) );
+    if ( r1 < mRows - 1 )
+      bound = qMin( bound, mYMin + ( r1 + 1 ) * mCellSize - pt.y() );
+
+    if ( best >= 0 && sqrDist < bound * bound )
+      break;
+  }
+  return best;
+}
+
+//! job for the parallel search of the segments nearest to the additional points
+struct TiePointJob
+{
+  const QgsSegmentGrid* grid;
+  QgsPoint point;
+  int segment;
+  double sqrDist;
+  QgsPoint tiedPoint;
+};
+
+static void tiePointJob( TiePointJob& job )
+{
+  job.segment = job.grid->nearestSegment( job.point, job.sqrDist, job.tiedPoint );
+}
+
+//! job for the parallel extraction and transformation of the lines of a range of features,
+//! the geometries of the features are freed once their lines are extracted
+struct FeatureLinesJob
+{
+  const QgsCoordinateTransform* ct;
+  QgsFeature* features;
+  QgsMultiPolyline* lines;
+  int begin;
+  int end;
+};
+
+static void featureLinesJob( FeatureLinesJob& job )
+{
+  for ( int i = job.begin; i < job.end; ++i )
+  {
+    QgsGeometry *geom = job.features[ i ].geometry();
+    if ( !geom )
+      continue;
+
+    QgsMultiPolyline& mpl = job.lines[ i ];
+    if ( geom->wkbType() == QGis::WKBMultiLineString )
+      mpl = geom->asMultiPolyline();
+    else if ( geom->wkbType() == QGis::WKBLineString )
+      mpl.push_back( geom->asPolyline() );
+    job.features[ i ].setGeometry(( QgsGeometry* ) 0 );
+
+    try
+    {
+      QgsMultiPolyline::iterator mplIt;
+      for ( mplIt = mpl.begin(); mplIt != mpl.end(); ++mplIt )
+      {
+        QgsPolyline::iterator pointIt;
+        for ( pointIt = mplIt->begin(); pointIt != mplIt->end(); ++pointIt )
+          *pointIt = job.ct->transform( *pointIt );
+      }
+    }
+    catch ( const QgsCsException &cse )
+    {
+      Q_UNUSED( cse );
+      QgsDebugMsg( QString( "Failed to transform the feature with ID '%1', skipping it. %2" )
+                   .arg( job.features[ i ].id() ).arg( cse.what() ) );
+      mpl.clear();
+    }
+  }
+}
+
 QgsLineVectorLayerDirector::QgsLineVectorLayerDirector( QgsVectorLayer *myLayer,
     int directionFieldId,
     const QString& directDirectionValue,
@@ -158,63 +427,140 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
   //Graph's points;
   QVector< QgsPoint > points;
 
-  QgsFeatureIterator fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QgsAttributeList() ) );
-
-  // begin: tie points to the graph
   QgsAttributeList la;
-  QgsFeature feature;
-  while ( fit.nextFeature( feature ) )
   {
-    QgsMultiPolyline mpl;
-    if ( feature.geometry()->wkbType() == QGis::WKBMultiLineString )
-      mpl = feature.geometry()->asMultiPolyline();
-    else if ( feature.geometry()->wkbType() == QGis::WKBLineString )
-      mpl.push_back( feature.geometry()->asPolyline() );
+    // fill attribute list 'la'
+    QgsAttributeList tmpAttr;
+    if ( mDirectionFieldId != -1 )
+    {
+      tmpAttr.push_back( mDirectionFieldId );
+    }
 
-    QgsMultiPolyline::iterator mplIt;
-    for ( mplIt = mpl.begin(); mplIt != mpl.end(); ++mplIt )
+    QList< QgsArcProperter* >::const_iterator it;
+    QgsAttributeList::const_iterator it2;
+
+    for ( it = mProperterList.begin(); it != mProperterList.end(); ++it )
     {
-      QgsPoint pt1, pt2;
-      bool isFirstPoint = true;
-      QgsPolyline::iterator pointIt;
-      for ( pointIt = mplIt->begin(); pointIt != mplIt->end(); ++pointIt )
+      QgsAttributeList tmp = ( *it )->requiredAttributes();
+      for ( it2 = tmp.begin(); it2 != tmp.end(); ++it2 )
       {
-        pt2 = ct.transform( *pointIt );
-        points.push_back( pt2 );
+        tmpAttr.push_back( *it2 );
+      }
+    }
+    qSort( tmpAttr.begin(), tmpAttr.end() );
 
-        if ( !isFirstPoint )
-        {
-          int i = 0;
-          for ( i = 0; i != additionalPoints.size(); ++i )
-          {
-            TiePointInfo info;
-            if ( pt1 == pt2 )
-            {
-              info.mLength = additionalPoints[ i ].sqrDist( pt1 );
-              info.mTiedPoint = pt1;
-            }
-            else
-            {
-              info.mLength = additionalPoints[ i ].sqrDistToSegment( pt1.x(), pt1.y(),
-                             pt2.x(), pt2.y(), info.mTiedPoint );
-            }
+    int lastAttrId = -1;
+    for ( it2 = tmpAttr.begin(); it2 != tmpAttr.end(); ++it2 )
+    {
+      if ( *it2 == lastAttrId )
+      {
+        continue;
+      }
 
-            if ( pointLengthMap[ i ].mLength > info.mLength )
-            {
-              Q_UNUSED( info.mTiedPoint );
-              info.mFirstPoint = pt1;
-              info.mLastPoint = pt2;
+      la.push_back( *it2 );
 
-              pointLengthMap[ i ] = info;
-              tiedPoint[ i ] = info.mTiedPoint;
-            }
-          }
+      lastAttrId = *it2;
+    }
+  } // end fill attribute list 'la'
+
+  // begin: read the features, the lines are extracted and transformed in parallel,
+  // every job has its own coordinate transform
+  int threadCount = qMax( 1, QThread::idealThreadCount() );
+  QList< QgsCoordinateTransform* > transforms;
+  for ( int i = 0; i < threadCount; ++i )
+    transforms << new QgsCoordinateTransform( ct.sourceCrs(), ct.destCRS() );
+
+  QVector< QgsFeature > features;
+  QVector< QgsMultiPolyline > lines;
+  const int batchSize = 4096;
+
+  QgsFeatureIterator fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( la ) );
+  QgsFeature fet;
+  bool atEnd = false;
+  while ( !atEnd )
+  {
+    int batchBegin = features.size();
+    while ( features.size() - batchBegin < batchSize )
+    {
+      if ( !fit.nextFeature( fet ) )
+      {
+        atEnd = true;
+        break;
+      }
+      features.push_back( fet );
+    }
+    int batchEnd = features.size();
+    if ( batchEnd == batchBegin )
+      break;
+
+    lines.resize( batchEnd );
+    // the jobs write to disjoint ranges of the vectors, which must not detach meanwhile
+    QgsFeature* featureData = features.data();
+    QgsMultiPolyline* lineData = lines.data();
+    QVector< FeatureLinesJob > jobs( threadCount );
+    int chunk = ( batchEnd - batchBegin + threadCount - 1 ) / threadCount;
+    for ( int i = 0; i < threadCount; ++i )
+    {
+      jobs[ i ].ct = transforms[ i ];
+      jobs[ i ].features = featureData;
+      jobs[ i ].lines = lineData;
+      jobs[ i ].begin = qMin( batchBegin + i * chunk, batchEnd );
+      jobs[ i ].end = qMin( batchBegin + ( i + 1 ) * chunk, batchEnd );
+    }
+    QtConcurrent::blockingMap( jobs, featureLinesJob );
+
+    for ( int i = batchBegin; i < batchEnd; ++i )
+      emit buildProgress( ++step, featureCount );
+  }
+  qDeleteAll( transforms );
+  // end: read the features
+
+  // begin: tie points to the graph
+  QVector< QgsPoint > firstPoints;
+  QVector< QgsPoint > lastPoints;
+  for ( int i = 0; i < lines.size(); ++i )
+  {
+    QgsMultiPolyline::const_iterator mplIt;
+    for ( mplIt = lines[ i ].begin(); mplIt != lines[ i ].end(); ++mplIt )
+    {
+      for ( int j = 0; j < mplIt->size(); ++j )
+      {
+        points.push_back( mplIt->at( j ) );
+        if ( j > 0 )
+        {
+          firstPoints.push_back( mplIt->at( j - 1 ) );
+          lastPoints.push_back( mplIt->at( j ) );
         }
-        pt1 = pt2;
-        isFirstPoint = false;
       }
     }
-    emit buildProgress( ++step, featureCount );
+  }
+
+  if ( !additionalPoints.isEmpty() )
+  {
+    QgsSegmentGrid grid( firstPoints, lastPoints );
+
+    QVector< TiePointJob > jobs( additionalPoints.size() );
+    for ( int i = 0; i < additionalPoints.size(); ++i )
+    {
+      jobs[ i ].grid = &grid;
+      jobs[ i ].point = additionalPoints[ i ];
+    }
+    QtConcurrent::blockingMap( jobs, tiePointJob );
+
+    for ( int i = 0; i < jobs.size(); ++i )
+    {
+      if ( jobs[ i ].segment < 0 || !( jobs[ i ].sqrDist < pointLengthMap[ i ].mLength ) )
+        continue;
+
+      TiePointInfo info;
+      info.mTiedPoint = jobs[ i ].tiedPoint;
+      info.mLength = jobs[ i ].sqrDist;
+      info.mFirstPoint = firstPoints[ jobs[ i ].segment ];
+      info.mLastPoint = lastPoints[ jobs[ i ].segment ];
+
+      pointLengthMap[ i ] = info;
+      tiedPoint[ i ] = info.mTiedPoint;
+    }
   }
   // end: tie points to graph
 
@@ -242,45 +588,10 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
 
   qSort( pointLengthMap.begin(), pointLengthMap.end(), TiePointInfoCompare );
 
-  {
-    // fill attribute list 'la'
-    QgsAttributeList tmpAttr;
-    if ( mDirectionFieldId != -1 )
-    {
-      tmpAttr.push_back( mDirectionFieldId );
-    }
-
-    QList< QgsArcProperter* >::const_iterator it;
-    QgsAttributeList::const_iterator it2;
-
-    for ( it = mProperterList.begin(); it != mProperterList.end(); ++it )
-    {
-      QgsAttributeList tmp = ( *it )->requiredAttributes();
-      for ( it2 = tmp.begin(); it2 != tmp.end(); ++it2 )
-      {
-        tmpAttr.push_back( *it2 );
-      }
-    }
-    qSort( tmpAttr.begin(), tmpAttr.end() );
-
-    int lastAttrId = -1;
-    for ( it2 = tmpAttr.begin(); it2 != tmpAttr.end(); ++it2 )
-    {
-      if ( *it2 == lastAttrId )
-      {
-        continue;
-      }
-
-      la.push_back( *it2 );
-
-      lastAttrId = *it2;
-    }
-  } // end fill attribute list 'la'
-
   // begin graph construction
-  fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( la ) );
-  while ( fit.nextFeature( feature ) )
+  for ( int featureIdx = 0; featureIdx < features.size(); ++featureIdx )
   {
+    const QgsFeature& feature = features[ featureIdx ];
     int directionType = mDefaultDirection;
 
     // What direction have feature?
@@ -299,22 +610,18 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
     }
 
     // begin features segments and add arc to the Graph;
-    QgsMultiPolyline mpl;
-    if ( feature.geometry()->wkbType() == QGis::WKBMultiLineString )
-      mpl = feature.geometry()->asMultiPolyline();
-    else if ( feature.geometry()->wkbType() == QGis::WKBLineString )
-      mpl.push_back( feature.geometry()->asPolyline() );
+    const QgsMultiPolyline& mpl = lines[ featureIdx ];
 
-    QgsMultiPolyline::iterator mplIt;
+    QgsMultiPolyline::const_iterator mplIt;
     for ( mplIt = mpl.begin(); mplIt != mpl.end(); ++mplIt )
     {
       QgsPoint pt1, pt2;
 
       bool isFirstPoint = true;
-      QgsPolyline::iterator pointIt;
+      QgsPolyline::const_iterator pointIt;
       for ( pointIt = mplIt->begin(); pointIt != mplIt->end(); ++pointIt )
       {
-        pt2 = ct.transform( *pointIt );
+        pt2 = *pointIt;
 
         if ( !isFirstPoint )
         {
@@ -322,28 +629,16 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
           pointsOnArc[ 0.0 ] = pt1;
           pointsOnArc[ pt1.sqrDist( pt2 )] = pt2;
 
+          // all points tied to this segment
           TiePointInfo t;
           t.mFirstPoint = pt1;
           t.mLastPoint  = pt2;
-          pointLengthIt = my_binary_search( pointLengthMap.begin(), pointLengthMap.end(), t, TiePointInfoCompare );
+          std::pair< QVector< TiePointInfo >::iterator, QVector< TiePointInfo >::iterator > tied =
+            std::equal_range( pointLengthMap.begin(), pointLengthMap.end(), t, TiePointInfoCompare );
 
-          if ( pointLengthIt != pointLengthMap.end() )
+          for ( pointLengthIt = tied.first; pointLengthIt != tied.second; ++pointLengthIt )
           {
-            QVector< TiePointInfo >::iterator it;
-            for ( it = pointLengthIt; it - pointLengthMap.begin() >= 0; --it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
-            for ( it = pointLengthIt + 1; it != pointLengthMap.end(); ++it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
+            pointsOnArc[ pt1.sqrDist( pointLengthIt->mTiedPoint )] = pointLengthIt->mTiedPoint;
           }
 
           std::map< double, QgsPoint >::iterator pointsIt;
@@ -389,6 +684,6 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
       } // for (it = pl.begin(); it != pl.end(); ++it)
     }
     emit buildProgress( ++step, featureCount );
-  } // while( vl->nextFeature(feature) )
+  } // for ( featureIdx = 0; featureIdx < features.size(); ++featureIdx )
 } // makeGraph( QgsGraphBuilderInterface *builder, const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoint )
 
@@ -36,6 +36,22 @@ float QgsAspectFilter::processNineCellWindow(
   float derX = calcFirstDerX( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
   float derY = calcFirstDerY( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
 
+  return aspect( derX, derY );
+}
+
+void QgsAspectFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells )
+{
+  QVector<float> derX( nCells );
+  QVector<float> derY( nCells );
+  calcFirstDerRow( rowAbove, row, rowBelow, derX.data(), derY.data(), nCells );
+  for ( int j = 0; j < nCells; ++j )
+  {
+    result[j] = aspect( derX[j], derY[j] );
+  }
+}
+
+float QgsAspectFilter::aspect( float derX, float derY ) const
+{
   if ( derX == mOutputNodataValue ||
        derY == mOutputNodataValue ||
        ( derX == 0.0 && derY == 0.0 ) )
@@ -47,4 +63,3 @@ float QgsAspectFilter::processNineCellWindow(
     return 180.0 + atan2( derX, derY ) * 180.0 / M_PI;
   }
 }
-
@@ -33,6 +33,14 @@ class ANALYSIS_EXPORT QgsAspectFilter: public QgsDerivativeFilter
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 );
 
+    /**Calculates the output values of a row of cells from the derivatives of the whole row
+      @note added in 2.1*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells );
+
+
+  private:
+    /**Aspect from the first order derivatives*/
+    float aspect( float derX, float derY ) const;
 };
 
 #endif // QGSASPECTFILTER_H
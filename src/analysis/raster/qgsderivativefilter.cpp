@@ -162,7 +162,28 @@ float QgsDerivativeFilter::calcFirstDerY( float* x11, float* x21, float* x31, fl
   return sum / ( weight * mCellSizeY * mZFactor );
 }
 
+void QgsDerivativeFilter::calcFirstDerRow( float* rowAbove, float* row, float* rowBelow, float* derX, float* derY, int nCells )
+{
+  //the basic formula for all cells, in a loop without branches
+  double divisorX = 8 * mCellSizeX * mZFactor;
+  double divisorY = 8 * mCellSizeY * mZFactor;
+  for ( int j = 0; j < nCells; ++j )
+  {
+    double sumX = ( double )( rowAbove[j+1] - rowAbove[j-1] ) + ( double )( 2 * ( row[j+1] - row[j-1] ) ) + ( double )( rowBelow[j+1] - rowBelow[j-1] );
+    double sumY = ( double )( rowAbove[j-1] - rowBelow[j-1] ) + ( double )( 2 * ( rowAbove[j] - rowBelow[j] ) ) + ( double )( rowAbove[j+1] - rowBelow[j+1] );
+    derX[j] = sumX / divisorX;
+    derY[j] = sumY / divisorY;
+  }
 
-
-
-
+  //cells with nodata values in the window need the weighted formula
+  for ( int j = 0; j < nCells; ++j )
+  {
+    if ( rowAbove[j-1] == mInputNodataValue || rowAbove[j] == mInputNodataValue || rowAbove[j+1] == mInputNodataValue
+         || row[j-1] == mInputNodataValue || row[j] == mInputNodataValue || row[j+1] == mInputNodataValue
+         || rowBelow[j-1] == mInputNodataValue || rowBelow[j] == mInputNodataValue || rowBelow[j+1] == mInputNodataValue )
+    {
+      derX[j] = calcFirstDerX( &rowAbove[j-1], &rowAbove[j], &rowAbove[j+1], &row[j-1], &row[j], &row[j+1], &rowBelow[j-1], &rowBelow[j], &rowBelow[j+1] );
+      derY[j] = calcFirstDerY( &rowAbove[j-1], &rowAbove[j], &rowAbove[j+1], &row[j-1], &row[j], &row[j+1], &rowBelow[j-1], &rowBelow[j], &rowBelow[j+1] );
+    }
+  }
+}
@@ -36,6 +36,10 @@ class ANALYSIS_EXPORT QgsDerivativeFilter : public QgsNineCellFilter
     float calcFirstDerX( float* x11, float* x21, float* x31, float* x12, float* x22, float* x32, float* x13, float* x23, float* x33 );
     /**Calculates the first order derivative in y-direction according to Horn (1981)*/
     float calcFirstDerY( float* x11, float* x21, float* x31, float* x12, float* x22, float* x32, float* x13, float* x23, float* x33 );
+    /**Calculates the first order derivatives in x- and y-direction for a row of cells, the results are the same as the ones of
+      calcFirstDerX and calcFirstDerY. The rows are laid out as for QgsNineCellFilter::processNineCellRow
+      @note added in 2.1*/
+    void calcFirstDerRow( float* rowAbove, float* row, float* rowBelow, float* derX, float* derY, int nCells );
 };
 
 #endif // QGSDERIVATIVEFILTER_H
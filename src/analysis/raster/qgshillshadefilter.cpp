@@ -36,6 +36,22 @@ float QgsHillshadeFilter::processNineCellWindow( float* x11, float* x21, float*
   float derX = calcFirstDerX( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
   float derY = calcFirstDerY( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
 
+  return hillshade( derX, derY );
+}
+
+void QgsHillshadeFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells )
+{
+  QVector<float> derX( nCells );
+  QVector<float> derY( nCells );
+  calcFirstDerRow( rowAbove, row, rowBelow, derX.data(), derY.data(), nCells );
+  for ( int j = 0; j < nCells; ++j )
+  {
+    result[j] = hillshade( derX[j], derY[j] );
+  }
+}
+
+float QgsHillshadeFilter::hillshade( float derX, float derY ) const
+{
   if ( derX == mOutputNodataValue || derY == mOutputNodataValue )
   {
     return mOutputNodataValue;
@@ -33,12 +33,19 @@ class ANALYSIS_EXPORT QgsHillshadeFilter: public QgsDerivativeFilter
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 );
 
+    /**Calculates the output values of a row of cells from the derivatives of the whole row
+      @note added in 2.1*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells );
+
     float lightAzimuth() const { return mLightAzimuth; }
     void setLightAzimuth( float azimuth ) { mLightAzimuth = azimuth; }
     float lightAngle() const { return mLightAngle; }
     void setLightAngle( float angle ) { mLightAngle = angle; }
 
   private:
+    /**Hillshade value from the first order derivatives*/
+    float hillshade( float derX, float derY ) const;
+
     float mLightAzimuth;
     float mLightAngle;
 };
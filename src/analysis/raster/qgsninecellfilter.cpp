@@ -19,6 +19,8 @@
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QThread>
+#include <QtConcurrentMap>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -26,6 +28,33 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+//! approximate count of cells of a tile
+static const int sTileCells = 1 << 18;
+
+//! rows of the raster processed by one job
+struct QgsNineCellFilterTile
+{
+  QgsNineCellFilter* filter;
+  int firstRow;
+  int nRows;
+  int nCellsX;
+  //! rows firstRow - 1 to firstRow + nRows, with a nodata cell on both sides of every row
+  QVector<float> input;
+  QVector<float> result;
+
+  void run()
+  {
+    int stride = nCellsX + 2;
+    float* in = input.data() + 1;
+    result.resize( nRows * nCellsX );
+    for ( int row = 0; row < nRows; ++row )
+    {
+      filter->processNineCellRow( in + row * stride, in + ( row + 1 ) * stride, in + ( row + 2 ) * stride,
+                                  result.data() + row * nCellsX, nCellsX );
+    }
+  }
+};
+
 QgsNineCellFilter::QgsNineCellFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : mInputFile( inputFile ), mOutputFile( outputFile ), mOutputFormat( outputFormat ), mCellSizeX( -1 ), mCellSizeY( -1 ),
     mInputNodataValue( -1 ), mOutputNodataValue( -1 ), mZFactor( 1.0 )
@@ -96,81 +125,45 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     return 6;
   }
 
-  //keep only three scanlines in memory at a time
-  float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-
-  float* resultLine = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-
   if ( p )
   {
     p->setMaximum( ySize );
   }
 
-  //values outside the layer extent (if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
-  for ( int i = 0; i < ySize; ++i )
-  {
-    if ( p )
-    {
-      p->setValue( i );
-    }
+  //the tiles of one batch are processed in parallel while the next batch is read and the previous one written from this thread
+  int rowsPerTile = qMax( 1, sTileCells / xSize );
+  int tilesPerBatch = 2 * qMax( 1, QThread::idealThreadCount() );
+  QVector<QgsNineCellFilterTile> batches[2];
+  int current = 0;
+  int nextRow = readTiles( rasterBand, batches[current], 0, rowsPerTile, tilesPerBatch, xSize, ySize );
 
-    if ( p && p->wasCanceled() )
-    {
-      break;
-    }
+  while ( !batches[current].isEmpty() )
+  {
+    QFuture<void> future = QtConcurrent::map( batches[current], &QgsNineCellFilterTile::run );
+    nextRow = readTiles( rasterBand, batches[1 - current], nextRow, rowsPerTile, tilesPerBatch, xSize, ySize );
+    future.waitForFinished();
 
-    if ( i == 0 )
+    //write the tiles in order
+    for ( int i = 0; i < batches[current].size(); ++i )
     {
-      //fill scanline 1 with (input) nodata for the values above the first row and feed scanline2 with the first row
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine1[a] = mInputNodataValue;
-      }
-      GDALRasterIO( rasterBand, GF_Read, 0, 0, xSize, 1, scanLine2, xSize, 1, GDT_Float32, 0, 0 );
-    }
-    else
-    {
-      //normally fetch only scanLine3 and release scanline 1 if we move forward one row
-      CPLFree( scanLine1 );
-      scanLine1 = scanLine2;
-      scanLine2 = scanLine3;
-      scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+      const QgsNineCellFilterTile& tile = batches[current][i];
+      GDALRasterIO( outputRasterBand, GF_Write, 0, tile.firstRow, xSize, tile.nRows, ( void* ) tile.result.constData(),
+                    xSize, tile.nRows, GDT_Float32, 0, 0 );
     }
 
-    if ( i == ySize - 1 ) //fill the row below the bottom with nodata values
-    {
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine3[a] = mInputNodataValue;
-      }
-    }
-    else
+    if ( p )
     {
-      GDALRasterIO( rasterBand, GF_Read, 0, i + 1, xSize, 1, scanLine3, xSize, 1, GDT_Float32, 0, 0 );
+      const QgsNineCellFilterTile& last = batches[current].last();
+      p->setValue( last.firstRow + last.nRows );
     }
 
-    for ( int j = 0; j < xSize; ++j )
+    if ( p && p->wasCanceled() )
     {
-      if ( j == 0 )
-      {
-        resultLine[j] = processNineCellWindow( &mInputNodataValue, &scanLine1[j], &scanLine1[j+1], &mInputNodataValue, &scanLine2[j],
-                                               &scanLine2[j+1], &mInputNodataValue, &scanLine3[j], &scanLine3[j+1] );
-      }
-      else if ( j == xSize - 1 )
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j],
-                                               &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue );
-      }
-      else
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j],
-                                               &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1] );
-      }
+      break;
     }
 
-    GDALRasterIO( outputRasterBand, GF_Write, 0, i, xSize, 1, resultLine, xSize, 1, GDT_Float32, 0, 0 );
+    batches[current].clear();
+    current = 1 - current;
   }
 
   if ( p )
@@ -178,11 +171,6 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     p->setValue( ySize );
   }
 
-  CPLFree( resultLine );
-  CPLFree( scanLine1 );
-  CPLFree( scanLine2 );
-  CPLFree( scanLine3 );
-
   GDALClose( inputDataset );
 
   if ( p && p->wasCanceled() )
@@ -196,6 +184,41 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
   return 0;
 }
 
+void QgsNineCellFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells )
+{
+  for ( int j = 0; j < nCells; ++j )
+  {
+    result[j] = processNineCellWindow( &rowAbove[j-1], &rowAbove[j], &rowAbove[j+1], &row[j-1], &row[j],
+                                       &row[j+1], &rowBelow[j-1], &rowBelow[j], &rowBelow[j+1] );
+  }
+}
+
+int QgsNineCellFilter::readTiles( GDALRasterBandH rasterBand, QVector<QgsNineCellFilterTile>& tiles, int firstRow, int rowsPerTile, int maxTiles,
+                                  int nCellsX, int nCellsY )
+{
+  int stride = nCellsX + 2;
+  while ( firstRow < nCellsY && tiles.size() < maxTiles )
+  {
+    QgsNineCellFilterTile tile;
+    tile.filter = this;
+    tile.firstRow = firstRow;
+    tile.nRows = qMin( rowsPerTile, nCellsY - firstRow );
+    tile.nCellsX = nCellsX;
+
+    //values outside the layer extent (if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
+    tile.input.fill( mInputNodataValue, ( tile.nRows + 2 ) * stride );
+    int readBegin = qMax( 0, firstRow - 1 );
+    int readEnd = qMin( nCellsY, firstRow + tile.nRows + 1 );
+    float* readStart = tile.input.data() + ( readBegin - firstRow + 1 ) * stride + 1;
+    GDALRasterIO( rasterBand, GF_Read, 0, readBegin, nCellsX, readEnd - readBegin, readStart, nCellsX, readEnd - readBegin,
+                  GDT_Float32, 0, stride * sizeof( float ) );
+
+    tiles.append( tile );
+    firstRow += tile.nRows;
+  }
+  return firstRow;
+}
+
 GDALDatasetH QgsNineCellFilter::openInputFile( int& nCellsX, int& nCellsY )
 {
   GDALDatasetH inputDataset = GDALOpen( TO8F( mInputFile ), GA_ReadOnly );
@@ -19,13 +19,19 @@
 #define QGSNINECELLFILTER_H
 
 #include <QString>
+#include <QVector>
 #include "gdal.h"
 
 class QProgressDialog;
+struct QgsNineCellFilterTile;
 
 /**Base class for raster analysis methods that work with a 3x3 cell filter and calculate the value of each cell based on
 the cell value and the eight neighbour cells. Common examples are slope and aspect calculation in DEMs. Subclasses only implement
-the method that calculates the new value from the nine values. Everything else (reading file, writing file) is done by this subclass*/
+the method that calculates the new value from the nine values. Everything else (reading file, writing file) is done by this subclass.
+
+The raster is processed in tiles of full rows, which are calculated in parallel while the next tiles are read and the previous ones
+are written. processNineCellWindow and processNineCellRow are therefore called from several threads at the same time and must not
+modify the filter.*/
 
 class ANALYSIS_EXPORT QgsNineCellFilter
 {
@@ -57,6 +63,13 @@ class ANALYSIS_EXPORT QgsNineCellFilter
                                          float* x12, float* x22, float* x32,
                                          float* x13, float* x23, float* x33 ) = 0;
 
+    /**Calculates the output values of a row of cells from the row and the rows above and below. The input rows have an additional
+      nodata cell on both sides, so rowAbove[-1] and rowAbove[nCells] can be accessed. The default implementation calls
+      processNineCellWindow for every cell, subclasses may reimplement it with a loop over the row that avoids the virtual call per cell
+      @note added in 2.1
+      @note not available in python bindings*/
+    virtual void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells );
+
   private:
     //default constructor forbidden. We need input file, output file and format obligatory
     QgsNineCellFilter();
@@ -69,6 +82,10 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     /**Opens the output file and sets the same geotransform and CRS as the input data
       @return the output dataset or NULL in case of error*/
     GDALDatasetH openOutputFile( GDALDatasetH inputDataset, GDALDriverH outputDriver );
+    /**Reads tiles of rowsPerTile rows starting at firstRow until maxTiles tiles are in the list or the last row is read
+      @return the first row not read*/
+    int readTiles( GDALRasterBandH rasterBand, QVector<QgsNineCellFilterTile>& tiles, int firstRow, int rowsPerTile, int maxTiles,
+                   int nCellsX, int nCellsY );
 
   protected:
 
@@ -68,6 +68,22 @@ class ANALYSIS_EXPORT QgsRasterCalcNode
 
     Type type() const { return mType; }
 
+    /**Returns the operator of an operator node
+      @note added in 2.1*/
+    Operator operatorType() const { return mOperator; }
+    /**Returns the left child of an operator node
+      @note added in 2.1*/
+    const QgsRasterCalcNode* left() const { return mLeft; }
+    /**Returns the right child of an operator node, 0 for operators with one argument
+      @note added in 2.1*/
+    const QgsRasterCalcNode* right() const { return mRight; }
+    /**Returns the value of a number node
+      @note added in 2.1*/
+    double number() const { return mNumber; }
+    /**Returns the raster reference of a raster node
+      @note added in 2.1*/
+    QString rasterName() const { return mRasterName; }
+
     //set left node
     void setLeft( QgsRasterCalcNode* left ) { delete mLeft; mLeft = left; }
     void setRight( QgsRasterCalcNode* right ) { delete mRight; mRight = right; }
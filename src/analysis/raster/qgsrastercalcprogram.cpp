@@ -0,0 +1,551 @@
+/***************************************************************************
+                          qgsrastercalcprogram.cpp
+            Raster calculator expression compiled for block evaluation
+                          --------------------
+    begin                : 2013-12-20
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsrastercalcprogram.h"
+#include "qgsrastermatrix.h"
+#include <string.h>
+
+#include <cmath>
+
+//! number of cells evaluated at a time, the registers of a chunk should fit into the cache
+static const int sChunkSize = 1024;
+
+//same test as QgsRasterMatrix::testPowerValidity
+static inline bool powerValid( double base, double power )
+{
+  return !(( base == 0 && power < 0 ) || ( power < 0 && ( power - floor( power ) ) > 0 ) );
+}
+
+//operators with two arguments. The expressions are the ones of QgsRasterMatrix::twoArgumentOperation
+struct QgsRasterCalcPlus { static float apply( double a, double b, float ) { return static_cast<float>( a + b ); } };
+struct QgsRasterCalcMinus { static float apply( double a, double b, float ) { return static_cast<float>( a - b ); } };
+struct QgsRasterCalcMul { static float apply( double a, double b, float ) { return static_cast<float>( a * b ); } };
+struct QgsRasterCalcDiv { static float apply( double a, double b, float nodata ) { return b == 0 ? nodata : static_cast<float>( a / b ); } };
+struct QgsRasterCalcEq { static float apply( double a, double b, float ) { return a == b ? 1.0f : 0.0f; } };
+struct QgsRasterCalcNe { static float apply( double a, double b, float ) { return a == b ? 0.0f : 1.0f; } };
+struct QgsRasterCalcGt { static float apply( double a, double b, float ) { return a > b ? 1.0f : 0.0f; } };
+struct QgsRasterCalcLt { static float apply( double a, double b, float ) { return a < b ? 1.0f : 0.0f; } };
+struct QgsRasterCalcGe { static float apply( double a, double b, float ) { return a >= b ? 1.0f : 0.0f; } };
+struct QgsRasterCalcLe { static float apply( double a, double b, float ) { return a <= b ? 1.0f : 0.0f; } };
+struct QgsRasterCalcAnd { static float apply( double a, double b, float ) { return a && b ? 1.0f : 0.0f; } };
+struct QgsRasterCalcOr { static float apply( double a, double b, float ) { return a || b ? 1.0f : 0.0f; } };
+
+//two matrices calculate the power in double precision
+struct QgsRasterCalcPowDouble
+{
+  static float apply( double a, double b, float nodata )
+  {
+    return powerValid( a, b ) ? static_cast<float>( pow( a, b ) ) : nodata;
+  }
+};
+
+//a matrix and a number calculate the power in single precision
+struct QgsRasterCalcPowFloat
+{
+  static float apply( double a, double b, float nodata )
+  {
+    if ( !powerValid( a, b ) )
+    {
+      return nodata;
+    }
+    float result = pow( static_cast<float>( a ), static_cast<float>( b ) );
+    return result;
+  }
+};
+
+//operators with one argument, see QgsRasterMatrix::oneArgumentOperation
+struct QgsRasterCalcSqrt { static float apply( double a, float nodata ) { return a < 0 ? nodata : static_cast<float>( sqrt( a ) ); } };
+struct QgsRasterCalcSin { static float apply( double a, float ) { return static_cast<float>( sin( a ) ); } };
+struct QgsRasterCalcCos { static float apply( double a, float ) { return static_cast<float>( cos( a ) ); } };
+struct QgsRasterCalcTan { static float apply( double a, float ) { return static_cast<float>( tan( a ) ); } };
+struct QgsRasterCalcAsin { static float apply( double a, float ) { return static_cast<float>( asin( a ) ); } };
+struct QgsRasterCalcAcos { static float apply( double a, float ) { return static_cast<float>( acos( a ) ); } };
+struct QgsRasterCalcAtan { static float apply( double a, float ) { return static_cast<float>( atan( a ) ); } };
+struct QgsRasterCalcSign { static float apply( double a, float ) { return static_cast<float>( -a ); } };
+
+template <class Op> static void matrixMatrix( const float* left, const float* right, float* out, int n, double leftNodata, double rightNodata )
+{
+  float nodata = static_cast<float>( leftNodata );
+  for ( int i = 0; i < n; ++i )
+  {
+    double value1 = left[i];
+    double value2 = right[i];
+    out[i] = ( value1 == leftNodata || value2 == rightNodata ) ? nodata : Op::apply( value1, value2, nodata );
+  }
+}
+
+template <class Op> static void numberMatrix( double value, const float* right, float* out, int n, double rightNodata )
+{
+  float nodata = static_cast<float>( rightNodata );
+  for ( int i = 0; i < n; ++i )
+  {
+    double value2 = right[i];
+    out[i] = value2 == rightNodata ? nodata : Op::apply( value, value2, nodata );
+  }
+}
+
+template <class Op> static void matrixNumber( const float* left, double value, float* out, int n, double leftNodata )
+{
+  float nodata = static_cast<float>( leftNodata );
+  for ( int i = 0; i < n; ++i )
+  {
+    double value1 = left[i];
+    //nodata cells keep their value
+    out[i] = value1 == leftNodata ? left[i] : Op::apply( value1, value, nodata );
+  }
+}
+
+template <class Op> static void function( const float* left, float* out, int n, double leftNodata )
+{
+  float nodata = static_cast<float>( leftNodata );
+  for ( int i = 0; i < n; ++i )
+  {
+    double value = left[i];
+    out[i] = value == leftNodata ? left[i] : Op::apply( value, nodata );
+  }
+}
+
+static bool isFunction( QgsRasterCalcNode::Operator op )
+{
+  switch ( op )
+  {
+    case QgsRasterCalcNode::opSQRT:
+    case QgsRasterCalcNode::opSIN:
+    case QgsRasterCalcNode::opCOS:
+    case QgsRasterCalcNode::opTAN:
+    case QgsRasterCalcNode::opASIN:
+    case QgsRasterCalcNode::opACOS:
+    case QgsRasterCalcNode::opATAN:
+    case QgsRasterCalcNode::opSIGN:
+      return true;
+    default:
+      return false;
+  }
+}
+
+QgsRasterCalcProgram::QgsRasterCalcProgram( const QgsRasterCalcNode* node, const QStringList& rasterNames, const QVector<double>& nodataValues )
+    : mRasterNames( rasterNames )
+    , mNodataValues( nodataValues )
+    , mRegisterCount( 0 )
+    , mValid( false )
+{
+  mResult.isNumber = false;
+  mResult.number = 0;
+  mResult.nodata = 0;
+  mResult.slot = -1;
+
+  if ( node && mNodataValues.size() == mRasterNames.size() )
+  {
+    mValid = compile( node, mResult );
+  }
+}
+
+int QgsRasterCalcProgram::allocateRegister()
+{
+  if ( !mFreeRegisters.isEmpty() )
+  {
+    int slot = mFreeRegisters.last();
+    mFreeRegisters.pop_back();
+    return slot;
+  }
+  return mRasterNames.size() + mRegisterCount++;
+}
+
+void QgsRasterCalcProgram::releaseRegister( const Operand& operand )
+{
+  if ( !operand.isNumber && operand.slot >= mRasterNames.size() )
+  {
+    mFreeRegisters.push_back( operand.slot );
+  }
+}
+
+bool QgsRasterCalcProgram::compile( const QgsRasterCalcNode* node, Operand& result )
+{
+  if ( node->type() == QgsRasterCalcNode::tRasterRef )
+  {
+    int index = mRasterNames.indexOf( node->rasterName() );
+    if ( index < 0 )
+    {
+      return false;
+    }
+    result.isNumber = false;
+    result.number = 0;
+    result.nodata = mNodataValues[index];
+    result.slot = index;
+    return true;
+  }
+  else if ( node->type() == QgsRasterCalcNode::tNumber )
+  {
+    result.isNumber = true;
+    result.number = node->number();
+    result.nodata = -FLT_MAX;
+    result.slot = -1;
+    return true;
+  }
+  else if ( node->type() != QgsRasterCalcNode::tOperator )
+  {
+    return false;
+  }
+
+  QgsRasterCalcNode::Operator op = node->operatorType();
+  bool oneArgument = isFunction( op );
+  if ( !node->left() || ( !oneArgument && !node->right() ) )
+  {
+    return false;
+  }
+
+  Operand left, right;
+  if ( !compile( node->left(), left ) )
+  {
+    return false;
+  }
+  bool rightIsNumber = true;
+  if ( !oneArgument )
+  {
+    if ( !compile( node->right(), right ) )
+    {
+      return false;
+    }
+    rightIsNumber = right.isNumber;
+  }
+
+  //no raster involved, calculate the value once
+  if ( left.isNumber && rightIsNumber )
+  {
+    QMap<QString, QgsRasterMatrix*> noRasters;
+    QgsRasterMatrix number;
+    if ( !node->calculate( noRasters, number ) || !number.isNumber() )
+    {
+      return false;
+    }
+    result.isNumber = true;
+    result.number = static_cast<float>( number.number() );
+    result.nodata = number.nodataValue();
+    result.slot = -1;
+    return true;
+  }
+
+  Instruction instruction;
+  instruction.op = op;
+  instruction.left = left.slot;
+  instruction.right = -1;
+  instruction.number = 0;
+  instruction.leftNodata = left.nodata;
+  instruction.rightNodata = 0;
+
+  result.isNumber = false;
+  result.number = 0;
+  if ( oneArgument )
+  {
+    instruction.type = Function;
+    result.nodata = left.nodata;
+  }
+  else if ( left.isNumber )
+  {
+    instruction.type = NumberMatrix;
+    instruction.number = left.number;
+    instruction.right = right.slot;
+    instruction.rightNodata = right.nodata;
+    result.nodata = right.nodata;
+  }
+  else if ( right.isNumber )
+  {
+    instruction.type = MatrixNumber;
+    instruction.number = right.number;
+    instruction.rightNodata = right.nodata;
+    result.nodata = left.nodata;
+  }
+  else
+  {
+    instruction.type = MatrixMatrix;
+    instruction.right = right.slot;
+    instruction.rightNodata = right.nodata;
+    result.nodata = left.nodata;
+  }
+
+  //the operands are read before the result is written, so the result may reuse one of their registers
+  releaseRegister( left );
+  if ( !oneArgument )
+  {
+    releaseRegister( right );
+  }
+  result.slot = allocateRegister();
+  instruction.result = result.slot;
+  mInstructions.push_back( instruction );
+  return true;
+}
+
+void QgsRasterCalcProgram::evaluate( const QVector<const float*>& inputs, int nCells, float* result ) const
+{
+  if ( !mValid )
+  {
+    return;
+  }
+
+  if ( mResult.isNumber )
+  {
+    for ( int i = 0; i < nCells; ++i )
+    {
+      result[i] = mResult.number;
+    }
+    return;
+  }
+
+  int nInputs = mRasterNames.size();
+  if ( mResult.slot < nInputs )
+  {
+    //the expression is a single raster reference
+    memcpy( result, inputs[mResult.slot], nCells * sizeof( float ) );
+    return;
+  }
+
+  QVector<float> registers( mRegisterCount * sChunkSize );
+  QVector<const float*> slots( nInputs + mRegisterCount );
+  for ( int i = 0; i < mRegisterCount; ++i )
+  {
+    slots[nInputs + i] = registers.data() + i * sChunkSize;
+  }
+
+  for ( int start = 0; start < nCells; start += sChunkSize )
+  {
+    int n = qMin( sChunkSize, nCells - start );
+    for ( int i = 0; i < nInputs; ++i )
+    {
+      slots[i] = inputs[i] + start;
+    }
+
+    QVector<Instruction>::const_iterator it = mInstructions.constBegin();
+    for ( ; it != mInstructions.constEnd(); ++it )
+    {
+      float* out = registers.data() + ( it->result - nInputs ) * sChunkSize;
+      runInstruction( *it, slots, out, n );
+    }
+    memcpy( result + start, slots[mResult.slot], n * sizeof( float ) );
+  }
+}
+
+void QgsRasterCalcProgram::runInstruction( const Instruction& instruction, const QVector<const float*>& slots, float* out, int nCells ) const
+{
+  const float* left = instruction.left >= 0 ? slots[instruction.left] : 0;
+  const float* right = instruction.right >= 0 ? slots[instruction.right] : 0;
+
+  switch ( instruction.type )
+  {
+    case Function:
+      switch ( instruction.op )
+      {
+        case QgsRasterCalcNode::opSQRT:
+          function<QgsRasterCalcSqrt>( left, out, nCells, instruction.leftNodata );
+          break;
+        case QgsRasterCalcNode::opSIN:
+          function<QgsRasterCalcSin>( left, out, nCells, instruction.leftNodata );
+          break;
+        case QgsRasterCalcNode::opCOS:
+          function<QgsRasterCalcCos>( left, out, nCells, instruction.leftNodata );
+          break;
+        case QgsRasterCalcNode::opTAN:
+          function<QgsRasterCalcTan>( left, out, nCells, instruction.leftNodata );
+          break;
+        case QgsRasterCalcNode::opASIN:
+          function<QgsRasterCalcAsin>( left, out, nCells, instruction.leftNodata );
+          break;
+        case QgsRasterCalcNode::opACOS:
+          function<QgsRasterCalcAcos>( left, out, nCells, instruction.leftNodata );
+          break;
+        case QgsRasterCalcNode::opATAN:
+          function<QgsRasterCalcAtan>( left, out, nCells, instruction.leftNodata );
+          break;
+        case QgsRasterCalcNode::opSIGN:
+          function<QgsRasterCalcSign>( left, out, nCells, instruction.leftNodata );
+          break;
+        default:
+          break;
+      }
+      return;
+
+    case MatrixMatrix:
+      switch ( instruction.op )
+      {
+        case QgsRasterCalcNode::opPLUS:
+          matrixMatrix<QgsRasterCalcPlus>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opMINUS:
+          matrixMatrix<QgsRasterCalcMinus>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opMUL:
+          matrixMatrix<QgsRasterCalcMul>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opDIV:
+          matrixMatrix<QgsRasterCalcDiv>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opPOW:
+          matrixMatrix<QgsRasterCalcPowDouble>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opEQ:
+          matrixMatrix<QgsRasterCalcEq>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opNE:
+          matrixMatrix<QgsRasterCalcNe>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opGT:
+          matrixMatrix<QgsRasterCalcGt>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opLT:
+          matrixMatrix<QgsRasterCalcLt>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opGE:
+          matrixMatrix<QgsRasterCalcGe>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opLE:
+          matrixMatrix<QgsRasterCalcLe>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opAND:
+          matrixMatrix<QgsRasterCalcAnd>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        case QgsRasterCalcNode::opOR:
+          matrixMatrix<QgsRasterCalcOr>( left, right, out, nCells, instruction.leftNodata, instruction.rightNodata );
+          break;
+        default:
+          break;
+      }
+      return;
+
+    case NumberMatrix:
+    {
+      //a nodata number makes every cell nodata
+      if ( instruction.number == instruction.rightNodata )
+      {
+        float nodata = static_cast<float>( instruction.rightNodata );
+        for ( int i = 0; i < nCells; ++i )
+        {
+          out[i] = nodata;
+        }
+        return;
+      }
+
+      double value = instruction.number;
+      double nodata = instruction.rightNodata;
+      switch ( instruction.op )
+      {
+        case QgsRasterCalcNode::opPLUS:
+          numberMatrix<QgsRasterCalcPlus>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opMINUS:
+          numberMatrix<QgsRasterCalcMinus>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opMUL:
+          numberMatrix<QgsRasterCalcMul>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opDIV:
+          numberMatrix<QgsRasterCalcDiv>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opPOW:
+          numberMatrix<QgsRasterCalcPowFloat>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opEQ:
+          numberMatrix<QgsRasterCalcEq>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opNE:
+          numberMatrix<QgsRasterCalcNe>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opGT:
+          numberMatrix<QgsRasterCalcGt>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opLT:
+          numberMatrix<QgsRasterCalcLt>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opGE:
+          numberMatrix<QgsRasterCalcGe>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opLE:
+          numberMatrix<QgsRasterCalcLe>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opAND:
+          numberMatrix<QgsRasterCalcAnd>( value, right, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opOR:
+          numberMatrix<QgsRasterCalcOr>( value, right, out, nCells, nodata );
+          break;
+        default:
+          break;
+      }
+      return;
+    }
+
+    case MatrixNumber:
+    {
+      //a nodata number makes every cell nodata
+      if ( instruction.number == instruction.rightNodata )
+      {
+        float nodata = static_cast<float>( instruction.leftNodata );
+        for ( int i = 0; i < nCells; ++i )
+        {
+          out[i] = nodata;
+        }
+        return;
+      }
+
+      double value = instruction.number;
+      double nodata = instruction.leftNodata;
+      switch ( instruction.op )
+      {
+        case QgsRasterCalcNode::opPLUS:
+          matrixNumber<QgsRasterCalcPlus>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opMINUS:
+          matrixNumber<QgsRasterCalcMinus>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opMUL:
+          matrixNumber<QgsRasterCalcMul>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opDIV:
+          matrixNumber<QgsRasterCalcDiv>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opPOW:
+          matrixNumber<QgsRasterCalcPowFloat>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opEQ:
+          matrixNumber<QgsRasterCalcEq>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opNE:
+          matrixNumber<QgsRasterCalcNe>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opGT:
+          matrixNumber<QgsRasterCalcGt>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opLT:
+          matrixNumber<QgsRasterCalcLt>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opGE:
+          matrixNumber<QgsRasterCalcGe>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opLE:
+          matrixNumber<QgsRasterCalcLe>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opAND:
+          matrixNumber<QgsRasterCalcAnd>( left, value, out, nCells, nodata );
+          break;
+        case QgsRasterCalcNode::opOR:
+          matrixNumber<QgsRasterCalcOr>( left, value, out, nCells, nodata );
+          break;
+        default:
+          break;
+      }
+      return;
+    }
+  }
+}
@@ -0,0 +1,107 @@
+/***************************************************************************
+                          qgsrastercalcprogram.h
+            Raster calculator expression compiled for block evaluation
+                          --------------------
+    begin                : 2013-12-20
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSRASTERCALCPROGRAM_H
+#define QGSRASTERCALCPROGRAM_H
+
+#include "qgsrastercalcnode.h"
+#include <QStringList>
+#include <QVector>
+
+/**A raster calculator expression compiled into a list of instructions working on blocks of cells.
+
+  QgsRasterCalcNode::calculate creates a new matrix for the result of every node of the tree. The program evaluates the whole
+  expression for a chunk of cells at a time instead, with the intermediate results in a few reused registers that stay in the
+  cache. Every instruction is a simple loop over the chunk, the operator and the nodata handling are chosen outside of the loop.
+  Parts of the expression without raster references are calculated once when the program is compiled.
+
+  The results are the same as the ones of QgsRasterCalcNode::calculate. evaluate() does not modify the program and may be
+  called from several threads at the same time.
+  @note added in 2.1
+  @note not available in python bindings
+  */
+class ANALYSIS_EXPORT QgsRasterCalcProgram
+{
+  public:
+    /**Compiles an expression
+      @param node root node of the expression
+      @param rasterNames raster references of the expression, evaluate() expects the input blocks in the same order
+      @param nodataValues nodata value of every raster*/
+    QgsRasterCalcProgram( const QgsRasterCalcNode* node, const QStringList& rasterNames, const QVector<double>& nodataValues );
+
+    /**Returns false if the expression could not be compiled, e.g. because it references an unknown raster*/
+    bool isValid() const { return mValid; }
+
+    /**Returns true if the expression does not reference any raster, the result is the same for all cells*/
+    bool isNumber() const { return mResult.isNumber; }
+
+    /**Nodata value of the results*/
+    double nodataValue() const { return mResult.nodata; }
+
+    /**Calculates the expression for a block of cells
+      @param inputs nCells values of every raster, in the order of the raster names
+      @param nCells count of cells
+      @param result receives the nCells results*/
+    void evaluate( const QVector<const float*>& inputs, int nCells, float* result ) const;
+
+  private:
+    enum InstructionType
+    {
+      MatrixMatrix,
+      NumberMatrix,
+      MatrixNumber,
+      Function
+    };
+
+    struct Instruction
+    {
+      InstructionType type;
+      QgsRasterCalcNode::Operator op;
+      //! slots of operands and result, the inputs are followed by the registers
+      int left;
+      int right;
+      int result;
+      //! value of the number operand
+      double number;
+      double leftNodata;
+      double rightNodata;
+    };
+
+    //! result of a compiled subexpression, either a number or the values in a slot
+    struct Operand
+    {
+      bool isNumber;
+      float number;
+      double nodata;
+      int slot;
+    };
+
+    bool compile( const QgsRasterCalcNode* node, Operand& result );
+    int allocateRegister();
+    void releaseRegister( const Operand& operand );
+    void runInstruction( const Instruction& instruction, const QVector<const float*>& slots, float* out, int nCells ) const;
+
+    QStringList mRasterNames;
+    QVector<double> mNodataValues;
+    QVector<Instruction> mInstructions;
+    QVector<int> mFreeRegisters;
+    int mRegisterCount;
+    bool mValid;
+    Operand mResult;
+};
+
+#endif // QGSRASTERCALCPROGRAM_H
@@ -17,11 +17,14 @@
 
 #include "qgsrastercalculator.h"
 #include "qgsrastercalcnode.h"
+#include "qgsrastercalcprogram.h"
 #include "qgsrasterlayer.h"
-#include "qgsrastermatrix.h"
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <string.h>
 
 #include "gdalwarper.h"
 #include <ogr_srs_api.h>
@@ -34,6 +37,52 @@
 #define TO8F(x)  QFile::encodeName( x ).constData()
 #endif
 
+//! approximate count of input and result cells of a tile
+static const int sTileCells = 1 << 18;
+
+//! band of an input raster
+struct QgsRasterCalcInput
+{
+  GDALRasterBandH band;
+  double geoTransform[6];
+  double nodataValue;
+};
+
+//! rows of the output raster calculated by one job
+struct QgsRasterCalcTile
+{
+  const QgsRasterCalcProgram* program;
+  int firstRow;
+  int nRows;
+  int nCells;
+  float outputNodataValue;
+  //! nCells values of every input raster
+  QVector<float> input;
+  QVector<float> result;
+
+  void run()
+  {
+    QVector<const float*> inputs;
+    for ( int i = 0; i * nCells < input.size(); ++i )
+    {
+      inputs.append( input.constData() + i * nCells );
+    }
+    result.resize( nCells );
+    program->evaluate( inputs, nCells, result.data() );
+    input.clear();
+
+    //replace all matrix nodata values with output nodatas
+    double nodataValue = program->nodataValue();
+    for ( int i = 0; i < nCells; ++i )
+    {
+      if ( result[i] == nodataValue )
+      {
+        result[i] = outputNodataValue;
+      }
+    }
+  }
+};
+
 QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QString& outputFile, const QString& outputFormat,
     const QgsRectangle& outputExtent, int nOutputColumns, int nOutputRows, const QVector<QgsRasterCalculatorEntry>& rasterEntries ): mFormulaString( formulaString ), mOutputFile( outputFile ), mOutputFormat( outputFormat ),
     mOutputRectangle( outputExtent ), mNumOutputColumns( nOutputColumns ), mNumOutputRows( nOutputRows ), mRasterEntries( rasterEntries )
@@ -51,66 +100,109 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   QgsRasterCalcNode* calcNode = QgsRasterCalcNode::parseRasterCalcString( mFormulaString, errorString );
   if ( !calcNode )
   {
-    //error
+    return 4;
   }
 
   double targetGeoTransform[6];
   outputGeoTransform( targetGeoTransform );
 
-  //open all input rasters for reading
-  QMap< QString, GDALRasterBandH > mInputRasterBands; //raster references and corresponding scanline data
-  QMap< QString, QgsRasterMatrix* > inputScanLineData; //stores raster references and corresponding scanline data
-  QVector< GDALDatasetH > mInputDatasets; //raster references and corresponding dataset
+  //open all input rasters for reading. Layers used by several entries are opened only once
+  QMap< QString, GDALDatasetH > sourceDatasets; //layer source and corresponding (north up) dataset
+  QVector< GDALDatasetH > mInputDatasets; //datasets to close at the end
+  QStringList rasterNames;
+  QVector< QgsRasterCalcInput > inputs;
 
   QVector<QgsRasterCalculatorEntry>::const_iterator it = mRasterEntries.constBegin();
   for ( ; it != mRasterEntries.constEnd(); ++it )
   {
     if ( !it->raster ) // no raster layer in entry
     {
-      return 2;
-    }
-    GDALDatasetH inputDataset = GDALOpen( TO8F( it->raster->source() ), GA_ReadOnly );
-    if ( inputDataset == NULL )
-    {
+      closeDatasets( mInputDatasets );
+      delete calcNode;
       return 2;
     }
 
-    //check if the input dataset is south up or rotated. If yes, use GDALAutoCreateWarpedVRT to create a north up raster
-    double inputGeoTransform[6];
-    if ( GDALGetGeoTransform( inputDataset, inputGeoTransform ) == CE_None
-         && ( inputGeoTransform[1] < 0.0
-              || inputGeoTransform[2] != 0.0
-              || inputGeoTransform[4] != 0.0
-              || inputGeoTransform[5] > 0.0 ) )
+    QString source = it->raster->source();
+    GDALDatasetH inputDataset;
+    if ( sourceDatasets.contains( source ) )
     {
-      GDALDatasetH vDataset = GDALAutoCreateWarpedVRT( inputDataset, NULL, NULL, GRA_NearestNeighbour, 0.2, NULL );
-      mInputDatasets.push_back( vDataset );
-      mInputDatasets.push_back( inputDataset );
-      inputDataset = vDataset;
+      inputDataset = sourceDatasets.value( source );
     }
     else
     {
-      mInputDatasets.push_back( inputDataset );
-    }
+      inputDataset = GDALOpen( TO8F( source ), GA_ReadOnly );
+      if ( inputDataset == NULL )
+      {
+        closeDatasets( mInputDatasets );
+        delete calcNode;
+        return 2;
+      }
 
+      //check if the input dataset is south up or rotated. If yes, use GDALAutoCreateWarpedVRT to create a north up raster
+      double inputGeoTransform[6];
+      if ( GDALGetGeoTransform( inputDataset, inputGeoTransform ) == CE_None
+           && ( inputGeoTransform[1] < 0.0
+                || inputGeoTransform[2] != 0.0
+                || inputGeoTransform[4] != 0.0
+                || inputGeoTransform[5] > 0.0 ) )
+      {
+        GDALDatasetH vDataset = GDALAutoCreateWarpedVRT( inputDataset, NULL, NULL, GRA_NearestNeighbour, 0.2, NULL );
+        mInputDatasets.push_back( vDataset );
+        mInputDatasets.push_back( inputDataset );
+        inputDataset = vDataset;
+      }
+      else
+      {
+        mInputDatasets.push_back( inputDataset );
+      }
+      sourceDatasets.insert( source, inputDataset );
+    }
 
     GDALRasterBandH inputRasterBand = GDALGetRasterBand( inputDataset, it->bandNumber );
     if ( inputRasterBand == NULL )
     {
+      closeDatasets( mInputDatasets );
+      delete calcNode;
       return 2;
     }
 
+    QgsRasterCalcInput input;
+    input.band = inputRasterBand;
     int nodataSuccess;
-    double nodataValue = GDALGetRasterNoDataValue( inputRasterBand, &nodataSuccess );
+    input.nodataValue = GDALGetRasterNoDataValue( inputRasterBand, &nodataSuccess );
+    GDALGetGeoTransform( inputDataset, input.geoTransform );
 
-    mInputRasterBands.insert( it->ref, inputRasterBand );
-    inputScanLineData.insert( it->ref, new QgsRasterMatrix( mNumOutputColumns, 1, new float[mNumOutputColumns], nodataValue ) );
+    //if a reference is used by several entries, the last one is taken
+    int index = rasterNames.indexOf( it->ref );
+    if ( index < 0 )
+    {
+      rasterNames.append( it->ref );
+      inputs.append( input );
+    }
+    else
+    {
+      inputs[index] = input;
+    }
+  }
+
+  QVector<double> nodataValues;
+  for ( int i = 0; i < inputs.size(); ++i )
+  {
+    nodataValues.append( inputs[i].nodataValue );
+  }
+  QgsRasterCalcProgram program( calcNode, rasterNames, nodataValues );
+  delete calcNode;
+  if ( !program.isValid() )
+  {
+    closeDatasets( mInputDatasets );
+    return 4;
   }
 
   //open output dataset for writing
   GDALDriverH outputDriver = openOutputDriver();
   if ( outputDriver == NULL )
   {
+    closeDatasets( mInputDatasets );
     return 1;
   }
   GDALDatasetH outputDataset = openOutputFile( outputDriver );
@@ -143,78 +235,49 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   float outputNodataValue = -FLT_MAX;
   GDALSetRasterNoDataValue( outputRasterBand, outputNodataValue );
 
-  float* resultScanLine = ( float * ) CPLMalloc( sizeof( float ) * mNumOutputColumns );
-
   if ( p )
   {
     p->setMaximum( mNumOutputRows );
   }
 
-  QgsRasterMatrix resultMatrix;
+  //the tiles of one batch are calculated in parallel while the next batch is read and the previous one written from this thread
+  int cellsPerTile = qMax( 1, sTileCells / ( inputs.size() + 1 ) );
+  int rowsPerTile = qMax( 1, cellsPerTile / qMax( 1, mNumOutputColumns ) );
+  int tilesPerBatch = 2 * qMax( 1, QThread::idealThreadCount() );
+  QVector<QgsRasterCalcTile> batches[2];
+  int current = 0;
+  int nextRow = readTiles( targetGeoTransform, inputs, &program, outputNodataValue, batches[current], 0, rowsPerTile, tilesPerBatch );
 
-  //read / write line by line
-  for ( int i = 0; i < mNumOutputRows; ++i )
+  while ( !batches[current].isEmpty() )
   {
-    if ( p )
-    {
-      p->setValue( i );
-    }
+    QFuture<void> future = QtConcurrent::map( batches[current], &QgsRasterCalcTile::run );
+    nextRow = readTiles( targetGeoTransform, inputs, &program, outputNodataValue, batches[1 - current], nextRow, rowsPerTile, tilesPerBatch );
+    future.waitForFinished();
 
-    if ( p && p->wasCanceled() )
+    //write the tiles in order
+    for ( int i = 0; i < batches[current].size(); ++i )
     {
-      break;
+      const QgsRasterCalcTile& tile = batches[current][i];
+      if ( GDALRasterIO( outputRasterBand, GF_Write, 0, tile.firstRow, mNumOutputColumns, tile.nRows, ( void* ) tile.result.constData(),
+                         mNumOutputColumns, tile.nRows, GDT_Float32, 0, 0 ) != CE_None )
+      {
+        qWarning( "RasterIO error!" );
+      }
     }
 
-    //fill buffers
-    QMap< QString, QgsRasterMatrix* >::iterator bufferIt = inputScanLineData.begin();
-    for ( ; bufferIt != inputScanLineData.end(); ++bufferIt )
+    if ( p )
     {
-      double sourceTransformation[6];
-      GDALRasterBandH sourceRasterBand = mInputRasterBands[bufferIt.key()];
-      GDALGetGeoTransform( GDALGetBandDataset( sourceRasterBand ), sourceTransformation );
-      //the function readRasterPart calls GDALRasterIO (and ev. does some conversion if raster transformations are not the same)
-      readRasterPart( targetGeoTransform, 0, i, mNumOutputColumns, 1, sourceTransformation, sourceRasterBand, bufferIt.value()->data() );
+      const QgsRasterCalcTile& last = batches[current].last();
+      p->setValue( last.firstRow + last.nRows );
     }
 
-    if ( calcNode->calculate( inputScanLineData, resultMatrix ) )
+    if ( p && p->wasCanceled() )
     {
-      bool resultIsNumber = resultMatrix.isNumber();
-      float* calcData;
-
-      if ( resultIsNumber ) //scalar result. Insert number for every pixel
-      {
-        calcData = new float[mNumOutputColumns];
-        for ( int j = 0; j < mNumOutputColumns; ++j )
-        {
-          calcData[j] = resultMatrix.number();
-        }
-      }
-      else //result is real matrix
-      {
-        calcData = resultMatrix.data();
-      }
-
-      //replace all matrix nodata values with output nodatas
-      for ( int j = 0; j < mNumOutputColumns; ++j )
-      {
-        if ( calcData[j] == resultMatrix.nodataValue() )
-        {
-          calcData[j] = outputNodataValue;
-        }
-      }
-
-      //write scanline to the dataset
-      if ( GDALRasterIO( outputRasterBand, GF_Write, 0, i, mNumOutputColumns, 1, calcData, mNumOutputColumns, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        qWarning( "RasterIO error!" );
-      }
-
-      if ( resultIsNumber )
-      {
-        delete[] calcData;
-      }
+      break;
     }
 
+    batches[current].clear();
+    current = 1 - current;
   }
 
   if ( p )
@@ -223,19 +286,7 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   }
 
   //close datasets and release memory
-  delete calcNode;
-  QMap< QString, QgsRasterMatrix* >::iterator bufferIt = inputScanLineData.begin();
-  for ( ; bufferIt != inputScanLineData.end(); ++bufferIt )
-  {
-    delete bufferIt.value();
-  }
-  inputScanLineData.clear();
-
-  QVector< GDALDatasetH >::iterator datasetIt = mInputDatasets.begin();
-  for ( ; datasetIt != mInputDatasets.end(); ++ datasetIt )
-  {
-    GDALClose( *datasetIt );
-  }
+  closeDatasets( mInputDatasets );
 
   if ( p && p->wasCanceled() )
   {
@@ -244,10 +295,46 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
     return 3;
   }
   GDALClose( outputDataset );
-  CPLFree( resultScanLine );
   return 0;
 }
 
+int QgsRasterCalculator::readTiles( double* targetGeoTransform, const QVector<QgsRasterCalcInput>& inputs, const QgsRasterCalcProgram* program,
+                                    float outputNodataValue, QVector<QgsRasterCalcTile>& tiles, int firstRow, int rowsPerTile, int maxTiles )
+{
+  while ( firstRow < mNumOutputRows && tiles.size() < maxTiles )
+  {
+    QgsRasterCalcTile tile;
+    tile.program = program;
+    tile.firstRow = firstRow;
+    tile.nRows = qMin( rowsPerTile, mNumOutputRows - firstRow );
+    tile.nCells = tile.nRows * mNumOutputColumns;
+    tile.outputNodataValue = outputNodataValue;
+    tile.input.resize( inputs.size() * tile.nCells );
+
+    for ( int i = 0; i < inputs.size(); ++i )
+    {
+      double sourceTransformation[6];
+      memcpy( sourceTransformation, inputs[i].geoTransform, sizeof( sourceTransformation ) );
+      //the function readRasterPart calls GDALRasterIO (and ev. does some conversion if raster transformations are not the same)
+      readRasterPart( targetGeoTransform, 0, firstRow, mNumOutputColumns, tile.nRows, sourceTransformation, inputs[i].band,
+                      tile.input.data() + i * tile.nCells );
+    }
+
+    tiles.append( tile );
+    firstRow += tile.nRows;
+  }
+  return firstRow;
+}
+
+void QgsRasterCalculator::closeDatasets( const QVector<GDALDatasetH>& datasets )
+{
+  QVector< GDALDatasetH >::const_iterator datasetIt = datasets.constBegin();
+  for ( ; datasetIt != datasets.constEnd(); ++ datasetIt )
+  {
+    GDALClose( *datasetIt );
+  }
+}
+
 QgsRasterCalculator::QgsRasterCalculator()
 {
 }
@@ -373,11 +460,11 @@ void QgsRasterCalculator::readRasterPart( double* targetGeotransform, int xOffse
       if ( sourceIndexX >= 0 && sourceIndexX < nSourcePixelsX
            && sourceIndexY >= 0 && sourceIndexY < nSourcePixelsY )
       {
-        rasterBuffer[j + i*nRows] = sourceRaster[ sourceIndexX  + nSourcePixelsX * sourceIndexY ];
+        rasterBuffer[j + i*nCols] = sourceRaster[ sourceIndexX  + nSourcePixelsX * sourceIndexY ];
       }
       else
       {
-        rasterBuffer[j + i*j] = nodataValue;
+        rasterBuffer[j + i*nCols] = nodataValue;
       }
       targetPixelX += targetGeotransform[1];
     }
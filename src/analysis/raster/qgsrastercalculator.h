@@ -25,7 +25,10 @@
 #include "gdal.h"
 
 class QgsRasterLayer;
+class QgsRasterCalcProgram;
 class QProgressDialog;
+struct QgsRasterCalcInput;
+struct QgsRasterCalcTile;
 
 
 struct ANALYSIS_EXPORT QgsRasterCalculatorEntry
@@ -43,9 +46,11 @@ class ANALYSIS_EXPORT QgsRasterCalculator
                          const QgsRectangle& outputExtent, int nOutputColumns, int nOutputRows, const QVector<QgsRasterCalculatorEntry>& rasterEntries );
     ~QgsRasterCalculator();
 
-    /**Starts the calculation and writes new raster
+    /**Starts the calculation and writes new raster. The output is calculated in tiles of rows, which are
+      processed in parallel while the next tiles are read
       @param p progress bar (or 0 if called from non-gui code)
-      @return 0 in case of success*/
+      @return 0 in case of success, 1 if the output driver can not create files, 2 if an input raster can not be read,
+      3 if the calculation was canceled and 4 if the formula is not valid*/
     int processCalculation( QProgressDialog* p = 0 );
 
   private:
@@ -78,6 +83,14 @@ class ANALYSIS_EXPORT QgsRasterCalculator
                          GDALRasterBandH sourceBand,
                          float* rasterBuffer );
 
+    /**Reads tiles of rowsPerTile output rows starting at firstRow until maxTiles tiles are in the list or the last row is read
+      @return the first row not read*/
+    int readTiles( double* targetGeoTransform, const QVector<QgsRasterCalcInput>& inputs, const QgsRasterCalcProgram* program,
+                   float outputNodataValue, QVector<QgsRasterCalcTile>& tiles, int firstRow, int rowsPerTile, int maxTiles );
+
+    /**Closes the input datasets*/
+    void closeDatasets( const QVector<GDALDatasetH>& datasets );
+
     /**Compares two geotransformations (six parameter double arrays*/
     bool transformationsEqual( double* t1, double* t2 ) const;
 
@@ -92,3 +92,11 @@ float QgsRuggednessFilter::processNineCellWindow( float* x11, float* x21, float*
   return sqrt( sum );
 }
 
+void QgsRuggednessFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells )
+{
+  for ( int j = 0; j < nCells; ++j )
+  {
+    result[j] = QgsRuggednessFilter::processNineCellWindow( &rowAbove[j-1], &rowAbove[j], &rowAbove[j+1], &row[j-1], &row[j],
+                &row[j+1], &rowBelow[j-1], &rowBelow[j], &rowBelow[j+1] );
+  }
+}
@@ -35,6 +35,10 @@ class ANALYSIS_EXPORT QgsRuggednessFilter: public QgsNineCellFilter
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 );
 
+    /**Calculates the output values of a row of cells without a virtual call per cell
+      @note added in 2.1*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells );
+
   private:
     QgsRuggednessFilter();
 };
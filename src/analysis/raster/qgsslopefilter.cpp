@@ -34,6 +34,22 @@ float QgsSlopeFilter::processNineCellWindow( float* x11, float* x21, float* x31,
   float derX = calcFirstDerX( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
   float derY = calcFirstDerY( x11, x21, x31, x12, x22, x32, x13, x23, x33 );
 
+  return slope( derX, derY );
+}
+
+void QgsSlopeFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells )
+{
+  QVector<float> derX( nCells );
+  QVector<float> derY( nCells );
+  calcFirstDerRow( rowAbove, row, rowBelow, derX.data(), derY.data(), nCells );
+  for ( int j = 0; j < nCells; ++j )
+  {
+    result[j] = slope( derX[j], derY[j] );
+  }
+}
+
+float QgsSlopeFilter::slope( float derX, float derY ) const
+{
   if ( derX == mOutputNodataValue || derY == mOutputNodataValue )
   {
     return mOutputNodataValue;
@@ -41,4 +57,3 @@ float QgsSlopeFilter::processNineCellWindow( float* x11, float* x21, float* x31,
 
   return atan( sqrt( derX * derX + derY * derY ) ) * 180.0 / M_PI;
 }
-
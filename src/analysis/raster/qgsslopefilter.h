@@ -32,6 +32,14 @@ class ANALYSIS_EXPORT QgsSlopeFilter: public QgsDerivativeFilter
     float processNineCellWindow( float* x11, float* x21, float* x31,
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 );
+
+    /**Calculates the output values of a row of cells from the derivatives of the whole row
+      @note added in 2.1*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells );
+
+  private:
+    /**Slope from the first order derivatives*/
+    float slope( float derX, float derY ) const;
 };
 
 #endif // QGSSLOPEFILTER_H
@@ -46,3 +46,12 @@ float QgsTotalCurvatureFilter::processNineCellWindow( float* x11, float* x21, fl
 
   return dxx*dxx + 2*dxy*dxy + dyy*dyy;
 }
+
+void QgsTotalCurvatureFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells )
+{
+  for ( int j = 0; j < nCells; ++j )
+  {
+    result[j] = QgsTotalCurvatureFilter::processNineCellWindow( &rowAbove[j-1], &rowAbove[j], &rowAbove[j+1], &row[j-1], &row[j],
+                &row[j+1], &rowBelow[j-1], &rowBelow[j], &rowBelow[j+1] );
+  }
+}
@@ -33,6 +33,10 @@ class ANALYSIS_EXPORT QgsTotalCurvatureFilter: public QgsNineCellFilter
     float processNineCellWindow( float* x11, float* x21, float* x31,
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 );
+
+    /**Calculates the output values of a row of cells without a virtual call per cell
+      @note added in 2.1*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCells );
 };
 
 #endif // QGSTOTALCURVATUREFILTER_H
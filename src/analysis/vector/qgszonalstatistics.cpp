@@ -20,9 +20,13 @@
 #include "qgsvectordataprovider.h"
 #include "qgsvectorlayer.h"
 #include "gdal.h"
-#include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QPair>
+#include <QSet>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
+#include <cmath>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -30,12 +34,200 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
-QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand )
+//! maximum count of cells read by one job
+static const int sJobCells = 1 << 20;
+
+//! count of cells read before the jobs are run, larger zones are read in strips of rows over several batches
+static const qint64 sBatchCells = 16 * sJobCells;
+
+//! ceil( v ) limited to [lo, hi], also for values far outside the int range
+static int clampedCeil( double v, int lo, int hi )
+{
+  if ( !( v > lo ) )
+    return lo;
+  if ( v >= hi )
+    return hi;
+  return qMin( hi, ( int ) ceil( v ) );
+}
+
+//! floor( v ) limited to [lo, hi]
+static int clampedFloor( double v, int lo, int hi )
+{
+  if ( !( v > lo ) )
+    return lo;
+  if ( v >= hi )
+    return hi;
+  return qMin( hi, ( int ) floor( v ) );
+}
+
+//! weighted statistics of the cell values of a zone or of a part of it
+struct QgsZonalStatisticsAccumulator
+{
+  QgsZonalStatisticsAccumulator()
+      : count( 0 ), sum( 0 ), mean( 0 ), m2( 0 ), min( 0 ), max( 0 )
+  {}
+
+  void add( float value, double weight, bool keepValues )
+  {
+    if ( count == 0 )
+    {
+      min = value;
+      max = value;
+    }
+    else
+    {
+      min = qMin( min, ( double ) value );
+      max = qMax( max, ( double ) value );
+    }
+
+    count += weight;
+    sum += value * weight;
+    double delta = value - mean;
+    mean += delta * weight / count;
+    m2 += weight * delta * ( value - mean );
+
+    if ( keepValues )
+      values.append( qMakePair( value, weight ) );
+  }
+
+  //! combine the statistics of two disjoint sets of cells
+  void merge( const QgsZonalStatisticsAccumulator& other )
+  {
+    if ( other.count == 0 )
+      return;
+    if ( count == 0 )
+    {
+      *this = other;
+      return;
+    }
+
+    double total = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / total;
+    m2 += other.m2 + delta * delta * count * other.count / total;
+    count = total;
+    sum += other.sum;
+    min = qMin( min, other.min );
+    max = qMax( max, other.max );
+    values += other.values;
+  }
+
+  double count;
+  double sum;
+  //! running mean and sum of squared differences from it
+  double mean;
+  double m2;
+  double min;
+  double max;
+  //! cell values and weights, only collected for median and majority
+  QVector< QPair<float, double> > values;
+};
+
+//! polygon of a feature in cell coordinates of its raster window
+struct QgsZonalStatisticsZone
+{
+  QgsFeatureId fid;
+  QVector<double> xs;
+  QVector<double> ys;
+  QVector<int> ringBegin;
+  QVector<double> ringSign;
+
+  int offsetX;
+  int offsetY;
+  int nCellsX;
+  int nCellsY;
+
+  //! weight the cells by the covered area instead of the center point test
+  bool precise;
+  //! first row not read yet, the zone is complete when all rows are read and no jobs are pending
+  int nextRow;
+  int pendingJobs;
+  QgsZonalStatisticsAccumulator stats;
+};
+
+//! statistics of a block of rows of a zone
+struct QgsZonalStatisticsJob
+{
+  QgsZonalStatisticsZone* zone;
+  int firstRow;
+  int nRows;
+  float nodata;
+  bool keepValues;
+  //! cell values read from the raster, empty if reading failed
+  QVector<float> data;
+  QgsZonalStatisticsAccumulator stats;
+
+  void run()
+  {
+    if ( data.isEmpty() )
+      return;
+
+    QVector<double> weights( nRows * zone->nCellsX, 0.0 );
+    if ( zone->precise )
+    {
+      QgsZonalStatistics::preciseCoverage( zone->xs, zone->ys, zone->ringBegin, zone->ringSign, firstRow, zone->nCellsX, nRows, weights.data() );
+    }
+    else
+    {
+      QgsZonalStatistics::middlePointCoverage( zone->xs, zone->ys, zone->ringBegin, firstRow, zone->nCellsX, nRows, weights.data() );
+    }
+
+    for ( int i = 0; i < weights.size(); ++i )
+    {
+      double weight = qMin( weights[i], 1.0 );
+      float value = data[i];
+      if ( weight <= 0 || value == nodata || qIsNaN( value ) ) //don't consider nodata values
+      {
+        continue;
+      }
+      stats.add( value, weight, keepValues );
+    }
+  }
+};
+
+//! read raster blocks of a zone from its next row on and append one job per block until about maxCells
+//! cells are read (at least one block), returns the count of cells read
+static qint64 queueZoneJobs( GDALRasterBandH band, QgsZonalStatisticsZone* zone, float nodata, bool keepValues,
+                             QVector<QgsZonalStatisticsJob>& jobs, qint64 maxCells )
+{
+  int rowsPerJob = qMax( 1, sJobCells / zone->nCellsX );
+  if ( zone->nextRow == 0 )
+  {
+    zone->pendingJobs = 0;
+    zone->stats = QgsZonalStatisticsAccumulator();
+  }
+
+  qint64 cells = 0;
+  for ( int row = zone->nextRow; row < zone->nCellsY && cells < maxCells; row += rowsPerJob )
+  {
+    QgsZonalStatisticsJob job;
+    job.zone = zone;
+    job.firstRow = row;
+    job.nRows = qMin( rowsPerJob, zone->nCellsY - row );
+    job.nodata = nodata;
+    job.keepValues = keepValues;
+    job.data.resize( job.nRows * zone->nCellsX );
+    if ( GDALRasterIO( band, GF_Read, zone->offsetX, zone->offsetY + row, zone->nCellsX, job.nRows,
+                       job.data.data(), zone->nCellsX, job.nRows, GDT_Float32, 0, 0 ) != CE_None )
+    {
+      job.data.clear();
+    }
+    jobs.append( job );
+    ++zone->pendingJobs;
+    zone->nextRow = row + job.nRows;
+    cells += ( qint64 ) job.nRows * zone->nCellsX;
+  }
+  return cells;
+}
+
+QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand,
+                                        Statistics stats )
     : mRasterFilePath( rasterFile )
     , mRasterBand( rasterBand )
     , mPolygonLayer( polygonLayer )
     , mAttributePrefix( attributePrefix )
     , mInputNodataValue( -1 )
+    , mStatistics( stats )
 {
 
 }
@@ -43,6 +235,7 @@ QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QStr
 QgsZonalStatistics::QgsZonalStatistics()
     : mRasterBand( 0 )
     , mPolygonLayer( 0 )
+    , mStatistics( Default )
 {
 
 }
@@ -109,27 +302,37 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   QgsRectangle rasterBBox( geoTransform[0], geoTransform[3] - ( nCellsYGDAL * cellsizeY ),
                            geoTransform[0] + ( nCellsXGDAL * cellsizeX ), geoTransform[3] );
 
-  //add the new count, sum, mean fields to the provider
+  //add the new statistics fields to the provider
+  QList<Statistic> statistics;
+  QStringList statisticNames;
+  statistics << Count << Sum << Mean << Min << Max << StdDev << Median << Majority;
+  statisticNames << "count" << "sum" << "mean" << "min" << "max" << "stdev" << "median" << "majority";
+
   QList<QgsField> newFieldList;
-  QString countFieldName = getUniqueFieldName( mAttributePrefix + "count" );
-  QString sumFieldName = getUniqueFieldName( mAttributePrefix + "sum" );
-  QString meanFieldName = getUniqueFieldName( mAttributePrefix + "mean" );
-  QgsField countField( countFieldName, QVariant::Double, "double precision" );
-  QgsField sumField( sumFieldName, QVariant::Double, "double precision" );
-  QgsField meanField( meanFieldName, QVariant::Double, "double precision" );
-  newFieldList.push_back( countField );
-  newFieldList.push_back( sumField );
-  newFieldList.push_back( meanField );
+  QList<Statistic> fieldStatistics;
+  for ( int i = 0; i < statistics.size(); ++i )
+  {
+    if ( !( mStatistics & statistics[i] ) )
+    {
+      continue;
+    }
+    QString fieldName = getUniqueFieldName( mAttributePrefix + statisticNames[i], newFieldList );
+    newFieldList.push_back( QgsField( fieldName, QVariant::Double, "double precision" ) );
+    fieldStatistics.push_back( statistics[i] );
+  }
   vectorProvider->addAttributes( newFieldList );
 
   //index of the new fields
-  int countIndex = vectorProvider->fieldNameIndex( countFieldName );
-  int sumIndex = vectorProvider->fieldNameIndex( sumFieldName );
-  int meanIndex = vectorProvider->fieldNameIndex( meanFieldName );
-
-  if ( countIndex == -1 || sumIndex == -1 || meanIndex == -1 )
+  QList<int> fieldIndexes;
+  for ( int i = 0; i < newFieldList.size(); ++i )
   {
-    return 8;
+    int index = vectorProvider->fieldNameIndex( newFieldList[i].name() );
+    if ( index == -1 )
+    {
+      GDALClose( inputDataset );
+      return 8;
+    }
+    fieldIndexes.push_back( index );
   }
 
   //progress dialog
@@ -139,91 +342,270 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
     p->setMaximum( featureCount );
   }
 
+  //the raster blocks are read here and the statistics of a batch of blocks computed in parallel
+  bool keepValues = mStatistics.testFlag( Median ) || mStatistics.testFlag( Majority );
+  QVector<QgsZonalStatisticsJob> jobs;
+  //zones with rows left to read, their statistics are merged over several batches
+  QList<QgsZonalStatisticsZone*> openZones;
+  qint64 queuedCells = 0;
+  bool featuresLeft = true;
+  bool canceled = false;
 
-  //iterate over each polygon
   QgsFeatureRequest request;
   request.setSubsetOfAttributes( QgsAttributeList() );
   QgsFeatureIterator fi = vectorProvider->getFeatures( request );
   QgsFeature f;
-  double count = 0;
-  double sum = 0;
-  double mean = 0;
   int featureCounter = 0;
 
-  while ( fi.nextFeature( f ) )
+  while ( featuresLeft || !jobs.isEmpty() || !openZones.isEmpty() )
   {
-    if ( p )
+    while ( !openZones.isEmpty() && queuedCells < sBatchCells )
     {
-      p->setValue( featureCounter );
+      QgsZonalStatisticsZone* zone = openZones.first();
+      queuedCells += queueZoneJobs( rasterBand, zone, mInputNodataValue, keepValues, jobs, sBatchCells - queuedCells );
+      if ( zone->nextRow >= zone->nCellsY )
+      {
+        openZones.removeFirst();
+      }
     }
 
-    if ( p && p->wasCanceled() )
+    while ( featuresLeft && queuedCells < sBatchCells )
     {
-      break;
-    }
+      if ( !fi.nextFeature( f ) )
+      {
+        featuresLeft = false;
+        break;
+      }
 
-    QgsGeometry* featureGeometry = f.geometry();
-    if ( !featureGeometry )
-    {
+      if ( p )
+      {
+        p->setValue( featureCounter );
+      }
       ++featureCounter;
-      continue;
-    }
 
-    QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
-    if ( featureRect.isEmpty() )
-    {
-      ++featureCounter;
-      continue;
+      if ( p && p->wasCanceled() )
+      {
+        canceled = true;
+        break;
+      }
+
+      QgsGeometry* featureGeometry = f.geometry();
+      if ( !featureGeometry )
+      {
+        continue;
+      }
+
+      QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
+      if ( featureRect.isEmpty() )
+      {
+        continue;
+      }
+
+      int offsetX, offsetY, nCellsX, nCellsY;
+      if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+      {
+        continue;
+      }
+
+      //avoid access to cells outside of the raster (may occur because of rounding)
+      if (( offsetX + nCellsX ) > nCellsXGDAL )
+      {
+        nCellsX = nCellsXGDAL - offsetX;
+      }
+      if (( offsetY + nCellsY ) > nCellsYGDAL )
+      {
+        nCellsY = nCellsYGDAL - offsetY;
+      }
+      if ( nCellsX <= 0 || nCellsY <= 0 )
+      {
+        continue;
+      }
+
+      //rings in cell units relative to the upper left corner of the window
+      QgsZonalStatisticsZone* zone = new QgsZonalStatisticsZone;
+      zone->fid = f.id();
+      zone->offsetX = offsetX;
+      zone->offsetY = offsetY;
+      zone->nCellsX = nCellsX;
+      zone->nCellsY = nCellsY;
+      zone->precise = false;
+      zone->nextRow = 0;
+
+      QgsMultiPolygon polygons;
+      if ( featureGeometry->isMultipart() )
+      {
+        polygons = featureGeometry->asMultiPolygon();
+      }
+      else
+      {
+        polygons << featureGeometry->asPolygon();
+      }
+
+      double originX = rasterBBox.xMinimum() + offsetX * cellsizeX;
+      double originY = rasterBBox.yMaximum() - offsetY * cellsizeY;
+      for ( int i = 0; i < polygons.size(); ++i )
+      {
+        for ( int j = 0; j < polygons[i].size(); ++j )
+        {
+          const QgsPolyline& ring = polygons[i][j];
+          zone->ringBegin.push_back( zone->xs.size() );
+
+          double area = 0;
+          for ( int k = 0; k < ring.size(); ++k )
+          {
+            zone->xs.push_back(( ring[k].x() - originX ) / cellsizeX );
+            zone->ys.push_back(( originY - ring[k].y() ) / cellsizeY );
+            if ( k > 0 )
+            {
+              int n = zone->xs.size() - 1;
+              area += ( zone->xs[n - 1] + zone->xs[n] ) * ( zone->ys[n] - zone->ys[n - 1] );
+            }
+          }
+
+          //the first ring of a polygon is the outer ring, the others are holes
+          double sign = area < 0 ? -1.0 : 1.0;
+          zone->ringSign.push_back( j == 0 ? sign : -sign );
+        }
+      }
+      zone->ringBegin.push_back( zone->xs.size() );
+
+      queuedCells += queueZoneJobs( rasterBand, zone, mInputNodataValue, keepValues, jobs, sBatchCells - queuedCells );
+      if ( zone->nextRow < zone->nCellsY )
+      {
+        openZones.append( zone );
+      }
     }
 
-    int offsetX, offsetY, nCellsX, nCellsY;
-    if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+    if ( canceled )
     {
-      ++featureCounter;
-      continue;
+      break;
     }
 
-    //avoid access to cells outside of the raster (may occur because of rounding)
-    if (( offsetX + nCellsX ) > nCellsXGDAL )
+    QtConcurrent::blockingMap( jobs, &QgsZonalStatisticsJob::run );
+
+    QList<QgsZonalStatisticsZone*> finishedZones;
+    for ( int i = 0; i < jobs.size(); ++i )
     {
-      nCellsX = nCellsXGDAL - offsetX;
+      QgsZonalStatisticsZone* zone = jobs[i].zone;
+      zone->stats.merge( jobs[i].stats );
+      if ( --zone->pendingJobs == 0 && zone->nextRow >= zone->nCellsY )
+      {
+        finishedZones.push_back( zone );
+      }
     }
-    if (( offsetY + nCellsY ) > nCellsYGDAL )
+    jobs.clear();
+    queuedCells = 0;
+
+    QgsChangedAttributesMap changeMap;
+    foreach ( QgsZonalStatisticsZone* zone, finishedZones )
     {
-      nCellsY = nCellsYGDAL - offsetY;
-    }
+      if ( !zone->precise && zone->stats.count <= 1 )
+      {
+        //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
+        zone->precise = true;
+        zone->nextRow = 0;
+        openZones.append( zone );
+        continue;
+      }
 
-    statisticsFromMiddlePointTest( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                   rasterBBox, sum, count );
+      QgsZonalStatisticsAccumulator& stats = zone->stats;
+      double median = 0;
+      double majority = 0;
+      if ( keepValues && stats.count > 0 )
+      {
+        qSort( stats.values );
 
-    if ( count <= 1 )
-    {
-      //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
-      statisticsFromPreciseIntersection( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                         rasterBBox, sum, count );
-    }
+        double half = stats.count / 2;
+        double cumulative = 0;
+        double majorityWeight = 0;
+        bool medianFound = false;
+        for ( int i = 0; i < stats.values.size(); )
+        {
+          //weight of the run of equal values
+          float value = stats.values[i].first;
+          double weight = 0;
+          for ( ; i < stats.values.size() && stats.values[i].first == value; ++i )
+          {
+            weight += stats.values[i].second;
+          }
 
+          if ( !medianFound && cumulative + weight >= half )
+          {
+            median = value;
+            if ( cumulative + weight == half && i < stats.values.size() )
+            {
+              median = ( value + stats.values[i].first ) / 2.0;
+            }
+            medianFound = true;
+          }
+          cumulative += weight;
 
-    if ( count == 0 )
-    {
-      mean = 0;
+          if ( weight > majorityWeight )
+          {
+            majority = value;
+            majorityWeight = weight;
+          }
+        }
+      }
+
+      //write the statistics value to the vector data provider
+      QgsAttributeMap changeAttributeMap;
+      for ( int i = 0; i < fieldStatistics.size(); ++i )
+      {
+        QVariant value( QVariant::Double );
+        switch ( fieldStatistics[i] )
+        {
+          case Count:
+            value = stats.count;
+            break;
+          case Sum:
+            value = stats.sum;
+            break;
+          case Mean:
+            value = stats.count == 0 ? 0.0 : stats.sum / stats.count;
+            break;
+          case Min:
+            if ( stats.count > 0 )
+              value = stats.min;
+            break;
+          case Max:
+            if ( stats.count > 0 )
+              value = stats.max;
+            break;
+          case StdDev:
+            if ( stats.count > 0 )
+              value = sqrt( qMax( 0.0, stats.m2 / stats.count ) );
+            break;
+          case Median:
+            if ( stats.count > 0 )
+              value = median;
+            break;
+          case Majority:
+            if ( stats.count > 0 )
+              value = majority;
+            break;
+          default:
+            break;
+        }
+        changeAttributeMap.insert( fieldIndexes[i], value );
+      }
+      changeMap.insert( zone->fid, changeAttributeMap );
+      delete zone;
     }
-    else
+
+    if ( !changeMap.isEmpty() )
     {
-      mean = sum / count;
+      vectorProvider->changeAttributeValues( changeMap );
     }
+  }
 
-    //write the statistics value to the vector data provider
-    QgsChangedAttributesMap changeMap;
-    QgsAttributeMap changeAttributeMap;
-    changeAttributeMap.insert( countIndex, QVariant( count ) );
-    changeAttributeMap.insert( sumIndex, QVariant( sum ) );
-    changeAttributeMap.insert( meanIndex, QVariant( mean ) );
-    changeMap.insert( f.id(), changeAttributeMap );
-    vectorProvider->changeAttributeValues( changeMap );
-
-    ++featureCounter;
+  //zones of jobs not run because of cancelation
+  QSet<QgsZonalStatisticsZone*> pendingZones = openZones.toSet();
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    pendingZones.insert( jobs[i].zone );
   }
+  qDeleteAll( pendingZones );
 
   if ( p )
   {
@@ -233,7 +615,7 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   GDALClose( inputDataset );
   mPolygonLayer->updateFields();
 
-  if ( p && p->wasCanceled() )
+  if ( canceled )
   {
     return 9;
   }
@@ -265,111 +647,157 @@ int QgsZonalStatistics::cellInfoForBBox( const QgsRectangle& rasterBBox, const Q
   return 0;
 }
 
-void QgsZonalStatistics::statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
+void QgsZonalStatistics::middlePointCoverage( const QVector<double>& xs, const QVector<double>& ys, const QVector<int>& ringBegin,
+    int firstRow, int nCellsX, int nCellsY, double* weights )
 {
-  double cellCenterX, cellCenterY;
-
-  float* scanLine = ( float * ) CPLMalloc( sizeof( float ) * nCellsX );
-  cellCenterY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  count = 0;
-  sum = 0;
+  //x coordinates where the rings cross the horizontal line through the cell centers of every row
+  QVector< QVector<double> > crossings( nCellsY );
 
-  const GEOSGeometry* polyGeos = poly->asGeos();
-  if ( !polyGeos )
+  for ( int ring = 0; ring < ringBegin.size() - 1; ++ring )
   {
-    return;
-  }
+    int begin = ringBegin[ring];
+    int end = ringBegin[ring + 1];
+    for ( int i = begin; i < end; ++i )
+    {
+      int j = i + 1 < end ? i + 1 : begin;
+      double y1 = ys[i] - firstRow;
+      double y2 = ys[j] - firstRow;
+      if ( y1 == y2 )
+      {
+        continue;
+      }
 
-  const GEOSPreparedGeometry* polyGeosPrepared = GEOSPrepare( poly->asGeos() );
-  if ( !polyGeosPrepared )
-  {
-    return;
+      //rows with center y in [min, max)
+      int rowBegin = clampedCeil( qMin( y1, y2 ) - 0.5, 0, nCellsY );
+      int rowEnd = clampedCeil( qMax( y1, y2 ) - 0.5, 0, nCellsY );
+      double dxdy = ( xs[j] - xs[i] ) / ( y2 - y1 );
+      for ( int row = rowBegin; row < rowEnd; ++row )
+      {
+        crossings[row].push_back( xs[i] + ( row + 0.5 - y1 ) * dxdy );
+      }
+    }
   }
 
-  GEOSCoordSequence* cellCenterCoords = 0;
-  GEOSGeometry* currentCellCenter = 0;
-
-  for ( int i = 0; i < nCellsY; ++i )
+  for ( int row = 0; row < nCellsY; ++row )
   {
-    if ( GDALRasterIO( band, GF_Read, pixelOffsetX, pixelOffsetY + i, nCellsX, 1, scanLine, nCellsX, 1, GDT_Float32, 0, 0 )
-         != CPLE_None )
+    QVector<double>& rowCrossings = crossings[row];
+    qSort( rowCrossings );
+    double* rowWeights = weights + row * nCellsX;
+
+    //cells with center x in [start, end) of every inside interval
+    for ( int i = 0; i + 1 < rowCrossings.size(); i += 2 )
     {
-      continue;
+      int colBegin = clampedCeil( rowCrossings[i] - 0.5, 0, nCellsX );
+      int colEnd = clampedCeil( rowCrossings[i + 1] - 0.5, 0, nCellsX );
+      for ( int col = colBegin; col < colEnd; ++col )
+      {
+        rowWeights[col] += 1.0;
+      }
     }
-    cellCenterX = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX + cellSizeX / 2;
-    for ( int j = 0; j < nCellsX; ++j )
+  }
+}
+
+void QgsZonalStatistics::preciseCoverage( const QVector<double>& xs, const QVector<double>& ys, const QVector<int>& ringBegin,
+    const QVector<double>& ringSign, int firstRow, int nCellsX, int nCellsY, double* weights )
+{
+  // By Green's theorem the integral of min( x, X ) dy along the boundary is the area of the polygon left of x = X,
+  // so the area inside a cell of column c is the integral of min( max( x - c, 0 ), 1 ) dy. Every edge is cut at
+  // the row and column borders, a piece of it in column c adds dy * ( mean x - c ) to that cell and dy to all
+  // cells left of it. The latter is collected as a difference along the row.
+  int stride = nCellsX + 1;
+  QVector<double> partial( nCellsY * nCellsX, 0.0 );
+  QVector<double> full( nCellsY * stride, 0.0 );
+
+  for ( int ring = 0; ring < ringBegin.size() - 1; ++ring )
+  {
+    int begin = ringBegin[ring];
+    int end = ringBegin[ring + 1];
+    for ( int i = begin; i < end; ++i )
     {
-      GEOSGeom_destroy( currentCellCenter );
-      cellCenterCoords = GEOSCoordSeq_create( 1, 2 );
-      GEOSCoordSeq_setX( cellCenterCoords, 0, cellCenterX );
-      GEOSCoordSeq_setY( cellCenterCoords, 0, cellCenterY );
-      currentCellCenter = GEOSGeom_createPoint( cellCenterCoords );
+      int j = i + 1 < end ? i + 1 : begin;
+      double x1 = xs[i];
+      double y1 = ys[i] - firstRow;
+      double x2 = xs[j];
+      double y2 = ys[j] - firstRow;
+      if ( y1 == y2 )
+      {
+        continue;
+      }
+
+      double direction = y2 > y1 ? ringSign[ring] : -ringSign[ring];
+      double yMin = qMin( y1, y2 );
+      double yMax = qMax( y1, y2 );
+      double dxdy = ( x2 - x1 ) / ( y2 - y1 );
 
-      if ( scanLine[j] != mInputNodataValue ) //don't consider nodata values
+      int rowBegin = clampedFloor( yMin, 0, nCellsY );
+      int rowEnd = clampedCeil( yMax, 0, nCellsY );
+      for ( int row = rowBegin; row < rowEnd; ++row )
       {
-        if ( GEOSPreparedContains( polyGeosPrepared, currentCellCenter ) )
+        //part of the edge inside the row
+        double top = qMax( yMin, ( double ) row );
+        double bottom = qMin( yMax, row + 1.0 );
+        if ( bottom <= top )
+        {
+          continue;
+        }
+        double dy = direction * ( bottom - top );
+        double xTop = x1 + ( top - y1 ) * dxdy;
+        double xBottom = x1 + ( bottom - y1 ) * dxdy;
+        double xLeft = qMin( xTop, xBottom );
+        double xRight = qMax( xTop, xBottom );
+        double width = xRight - xLeft;
+
+        double* rowPartial = partial.data() + row * nCellsX;
+        double* rowFull = full.data() + row * stride;
+
+        //part of the edge right of the window adds dy to every cell of the row
+        if ( xRight >= nCellsX )
+        {
+          double f = width > 0 ? ( xRight - qMax( xLeft, ( double ) nCellsX ) ) / width : 1.0;
+          rowFull[0] += f * dy;
+          rowFull[nCellsX] -= f * dy;
+        }
+
+        //parts left of the window do not cover any cell of it
+        int colBegin = clampedFloor( xLeft, 0, nCellsX );
+        int colEnd = width > 0 ? clampedCeil( xRight, 0, nCellsX ) : clampedFloor( xRight, 0, nCellsX - 1 ) + 1;
+        if ( xLeft >= nCellsX || xRight < 0 )
+        {
+          continue;
+        }
+        for ( int col = colBegin; col < colEnd; ++col )
         {
-          if ( !qIsNaN( scanLine[j] ) )
+          double left = qMax( xLeft, ( double ) col );
+          double right = qMin( xRight, col + 1.0 );
+          if ( right < left )
           {
-            sum += scanLine[j];
+            continue;
           }
-          ++count;
+          double pieceDy = width > 0 ? dy * ( right - left ) / width : dy;
+          rowPartial[col] += pieceDy * (( left + right ) / 2.0 - col );
+          rowFull[0] += pieceDy;
+          rowFull[col] -= pieceDy;
         }
       }
-      cellCenterX += cellSizeX;
     }
-    cellCenterY -= cellSizeY;
   }
-  CPLFree( scanLine );
-  GEOSPreparedGeom_destroy( polyGeosPrepared );
-}
-
-void QgsZonalStatistics::statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
-{
-  sum = 0;
-  count = 0;
-  double currentY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  float* pixelData = ( float * ) CPLMalloc( sizeof( float ) );
-  QgsGeometry* pixelRectGeometry = 0;
-
-  double hCellSizeX = cellSizeX / 2.0;
-  double hCellSizeY = cellSizeY / 2.0;
-  double pixelArea = cellSizeX * cellSizeY;
-  double weight = 0;
 
   for ( int row = 0; row < nCellsY; ++row )
   {
-    double currentX = rasterBBox.xMinimum() + cellSizeX / 2.0 + pixelOffsetX * cellSizeX;
+    double covered = 0;
     for ( int col = 0; col < nCellsX; ++col )
     {
-      GDALRasterIO( band, GF_Read, pixelOffsetX + col, pixelOffsetY + row, nCellsX, 1, pixelData, 1, 1, GDT_Float32, 0, 0 );
-      pixelRectGeometry = QgsGeometry::fromRect( QgsRectangle( currentX - hCellSizeX, currentY - hCellSizeY, currentX + hCellSizeX, currentY + hCellSizeY ) );
-      if ( pixelRectGeometry )
+      covered += full[row * stride + col];
+      double weight = covered + partial[row * nCellsX + col];
+      if ( weight > 0 )
       {
-        //intersection
-        QgsGeometry *intersectGeometry = pixelRectGeometry->intersection( poly );
-        if ( intersectGeometry )
-        {
-          double intersectionArea = intersectGeometry->area();
-          if ( intersectionArea >= 0.0 )
-          {
-            weight = intersectionArea / pixelArea;
-            count += weight;
-            sum += *pixelData * weight;
-          }
-          delete intersectGeometry;
-        }
+        weights[row * nCellsX + col] += weight;
       }
-      currentX += cellSizeX;
     }
-    currentY -= cellSizeY;
   }
-  CPLFree( pixelData );
 }
 
-QString QgsZonalStatistics::getUniqueFieldName( QString fieldName )
+QString QgsZonalStatistics::getUniqueFieldName( QString fieldName, const QList<QgsField>& newFields )
 {
   QgsVectorDataProvider* dp = mPolygonLayer->dataProvider();
 
@@ -378,45 +806,35 @@ QString QgsZonalStatistics::getUniqueFieldName( QString fieldName )
     return fieldName;
   }
 
+  QStringList usedNames;
   const QgsFields& providerFields = dp->fields();
-  QString shortName = fieldName.mid( 0, 10 );
-
-  bool found = false;
   for ( int idx = 0; idx < providerFields.count(); ++idx )
   {
-    if ( shortName == providerFields[idx].name() )
-    {
-      found = true;
-      break;
-    }
+    usedNames << providerFields[idx].name();
+  }
+  for ( int idx = 0; idx < newFields.size(); ++idx )
+  {
+    usedNames << newFields[idx].name();
   }
 
-  if ( !found )
+  QString shortName = fieldName.mid( 0, 10 );
+  if ( !usedNames.contains( shortName ) )
   {
     return shortName;
   }
 
   int n = 1;
   shortName = QString( "%1_%2" ).arg( fieldName.mid( 0, 8 ) ).arg( n );
-  found = true;
-  while ( found )
+  while ( usedNames.contains( shortName ) )
   {
-    found = false;
-    for ( int idx = 0; idx < providerFields.count(); ++idx )
+    n += 1;
+    if ( n < 9 )
     {
-      if ( shortName == providerFields[idx].name() )
-      {
-        n += 1;
-        if ( n < 9 )
-        {
-          shortName = QString( "%1_%2" ).arg( fieldName.mid( 0, 8 ) ).arg( n );
-        }
-        else
-        {
-          shortName = QString( "%1_%2" ).arg( fieldName.mid( 0, 7 ) ).arg( n );
-        }
-        found = true;
-      }
+      shortName = QString( "%1_%2" ).arg( fieldName.mid( 0, 8 ) ).arg( n );
+    }
+    else
+    {
+      shortName = QString( "%1_%2" ).arg( fieldName.mid( 0, 7 ) ).arg( n );
     }
   }
   return shortName;
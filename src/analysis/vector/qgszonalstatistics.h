@@ -19,17 +19,43 @@
 #define QGSZONALSTATISTICS_H
 
 #include "qgsrectangle.h"
+#include <QList>
 #include <QString>
+#include <QVector>
 
-class QgsGeometry;
+class QgsField;
 class QgsVectorLayer;
 class QProgressDialog;
 
-/**A class that calculates raster statistics (count, sum, mean) for a polygon or multipolygon layer and appends the results as attributes*/
+/**A class that calculates raster statistics (count, sum, mean and optionally min, max, standard deviation, median and majority)
+  for a polygon or multipolygon layer and appends the results as attributes.
+
+  The polygons are rasterised with a scanline algorithm directly from their rings. A cell belongs to a polygon if its
+  center point is inside. For polygons containing at most one cell center the area of the cell covered by the polygon
+  is used as weight of the cell instead. The raster is read in blocks of rows and the polygons are processed in parallel.*/
 class ANALYSIS_EXPORT QgsZonalStatistics
 {
   public:
-    QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix = "", int rasterBand = 1 );
+    //! Statistics to calculate, the cell values are weighted by the part of the cell covered by the polygon
+    enum Statistic
+    {
+      Count = 1,      //!< Sum of the cell weights
+      Sum = 2,        //!< Weighted sum of the cell values
+      Mean = 4,       //!< Weighted mean of the cell values
+      Min = 8,        //!< Smallest cell value
+      Max = 16,       //!< Largest cell value
+      StdDev = 32,    //!< Weighted population standard deviation of the cell values
+      Median = 64,    //!< Weighted median of the cell values
+      Majority = 128, //!< Cell value with the largest weight
+      Default = Count | Sum | Mean,
+      All = Count | Sum | Mean | Min | Max | StdDev | Median | Majority
+    };
+    Q_DECLARE_FLAGS( Statistics, Statistic )
+
+    /**Constructor
+      @param stats statistics to append as attributes (added in 2.1)*/
+    QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix = "", int rasterBand = 1,
+                        Statistics stats = Default );
     ~QgsZonalStatistics();
 
     /**Starts the calculation
@@ -43,18 +69,22 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     int cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
                          int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const;
 
-    /**Returns statistics by considering the pixels where the center point is within the polygon (fast)*/
-    void statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    void statisticsFromMiddlePointTest_improved( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
+    /**Adds 1 to the weight of every cell of a block of rows whose center point is inside the polygon (even-odd rule)
+      @param xs x coordinates of the ring vertices in cell units, column 0 starts at x = 0
+      @param ys y coordinates of the ring vertices in cell units growing downwards, row 0 of the block starts at y = firstRow
+      @param ringBegin index of the first vertex of every ring, followed by the vertex count
+      @param weights nCellsX * nCellsY cell weights of the block*/
+    static void middlePointCoverage( const QVector<double>& xs, const QVector<double>& ys, const QVector<int>& ringBegin,
+                                     int firstRow, int nCellsX, int nCellsY, double* weights );
 
-    /**Returns statistics with precise pixel - polygon intersection test (slow) */
-    void statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                            double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
+    /**Adds the part of the area of every cell of a block of rows that is covered by the polygon to the cell weights
+      @param ringSign +1 or -1 per ring, so that the signed area of outer rings is positive and the one of holes negative
+      @note the other parameters are the same as for middlePointCoverage*/
+    static void preciseCoverage( const QVector<double>& xs, const QVector<double>& ys, const QVector<int>& ringBegin,
+                                 const QVector<double>& ringSign, int firstRow, int nCellsX, int nCellsY, double* weights );
 
-    QString getUniqueFieldName( QString fieldName );
+    /**Returns a field name not used by the provider nor by the fields about to be added*/
+    QString getUniqueFieldName( QString fieldName, const QList<QgsField>& newFields );
 
     QString mRasterFilePath;
     /**Raster band to calculate statistics from (defaults to 1)*/
@@ -63,6 +93,12 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     QString mAttributePrefix;
     /**The nodata value of the input layer*/
     float mInputNodataValue;
+    /**Statistics to calculate*/
+    Statistics mStatistics;
+
+    friend struct QgsZonalStatisticsJob;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS( QgsZonalStatistics::Statistics )
+
 #endif // QGSZONALSTATISTICS_H
@@ -177,30 +177,41 @@ void QgsFieldCalculator::accept()
   int rownum = 1;
 
   QgsFeatureIterator fit = mVectorLayer->getFeatures( QgsFeatureRequest().setFlags( useGeometry ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry ) );
-  while ( fit.nextFeature( feature ) )
+
+  // the expression is evaluated for batches of features at once
+  QgsFeatureList batch;
+  bool moreFeatures = true;
+  while ( moreFeatures )
   {
-    if ( onlySelected )
+    batch.clear();
+    while ( batch.count() < 1000 && ( moreFeatures = fit.nextFeature( feature ) ) )
     {
-      if ( !selectedIds.contains( feature.id() ) )
+      if ( onlySelected )
       {
-        continue;
+        if ( !selectedIds.contains( feature.id() ) )
+        {
+          continue;
+        }
       }
+      batch.append( feature );
     }
 
     exp.setCurrentRowNumber( rownum );
-    QVariant value = exp.evaluate( &feature );
+    QVariantList values = exp.evaluate( batch );
     if ( exp.hasEvalError() )
     {
       calculationSuccess = false;
       error = exp.evalErrorString();
       break;
     }
-    else
+
+    for ( int i = 0; i < batch.count(); ++i )
     {
-      mVectorLayer->changeAttributeValue( feature.id(), mAttributeId, value, feature.attributes().value( mAttributeId ) );
+      const QgsFeature& f = batch.at( i );
+      mVectorLayer->changeAttributeValue( f.id(), mAttributeId, values.at( i ), f.attributes().value( mAttributeId ) );
     }
 
-    rownum++;
+    rownum += batch.count();
   }
 
   QApplication::restoreOverrideCursor();
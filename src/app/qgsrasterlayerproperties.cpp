@@ -1002,6 +1002,11 @@ void QgsRasterLayerProperties::on_buttonBuildPyramids_clicked()
       QMessageBox::warning( this, tr( "Building pyramids failed." ),
                             tr( "Building pyramid overviews is not supported on this type of raster." ) );
     }
+    else if ( res == "CANCELED" )
+    {
+      QMessageBox::information( this, tr( "Building pyramids canceled." ),
+                                tr( "Building pyramid overviews was canceled. It continues where it stopped when it is started again with the same levels and resampling method." ) );
+    }
 
   }
 
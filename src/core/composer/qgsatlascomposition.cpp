@@ -37,13 +37,14 @@ QgsAtlasComposition::QgsAtlasComposition( QgsComposition* composition ) :
     mFilterFeatures( false ), mFeatureFilter( "" )
 {
 
-  // declare special columns with a default value
+  // declare special columns with a default value. The columns of the atlas
+  // feature are kept in mExpressionContext, not in the global values
   QgsExpression::setSpecialColumn( "$page", QVariant(( int )1 ) );
-  QgsExpression::setSpecialColumn( "$feature", QVariant(( int )0 ) );
   QgsExpression::setSpecialColumn( "$numpages", QVariant(( int )1 ) );
-  QgsExpression::setSpecialColumn( "$numfeatures", QVariant(( int )0 ) );
-  QgsExpression::setSpecialColumn( "$atlasfeatureid", QVariant(( int )0 ) );
-  QgsExpression::setSpecialColumn( "$atlasgeometry", QVariant::fromValue( QgsGeometry() ) );
+  mExpressionContext.setSpecialColumn( "$feature", QVariant(( int )0 ) );
+  mExpressionContext.setSpecialColumn( "$numfeatures", QVariant(( int )0 ) );
+  mExpressionContext.setSpecialColumn( "$atlasfeatureid", QVariant(( int )0 ) );
+  mExpressionContext.setSpecialColumn( "$atlasgeometry", QVariant::fromValue( QgsGeometry() ) );
 }
 
 QgsAtlasComposition::~QgsAtlasComposition()
@@ -62,13 +63,13 @@ void QgsAtlasComposition::setCoverageLayer( QgsVectorLayer* layer )
   mCoverageLayer = layer;
 
   // update the number of features
-  QgsExpression::setSpecialColumn( "$numfeatures", QVariant(( int )mFeatureIds.size() ) );
+  mExpressionContext.setSpecialColumn( "$numfeatures", QVariant(( int )mFeatureIds.size() ) );
 
   // Grab the first feature so that user can use it to test the style in rules.
   QgsFeature fet;
   layer->getFeatures().nextFeature( fet );
-  QgsExpression::setSpecialColumn( "$atlasfeatureid", fet.id() );
-  QgsExpression::setSpecialColumn( "$atlasgeometry", QVariant::fromValue( *fet.geometry() ) );
+  mExpressionContext.setSpecialColumn( "$atlasfeatureid", fet.id() );
+  mExpressionContext.setSpecialColumn( "$atlasgeometry", QVariant::fromValue( *fet.geometry() ) );
 
   emit coverageLayerChanged( layer );
 }
@@ -205,6 +206,8 @@ int QgsAtlasComposition::updateFeatures()
     {
       throw std::runtime_error( tr( "Feature filter parser error: %1" ).arg( filterExpression->parserErrorString() ).toLocal8Bit().data() );
     }
+    // prepared once, the fields do not change while iterating
+    filterExpression->prepare( mCoverageLayer->pendingFields() );
   }
 
   // We cannot use nextFeature() directly since the feature pointer is rewinded by the rendering process
@@ -212,11 +215,12 @@ int QgsAtlasComposition::updateFeatures()
   QgsFeature feat;
   mFeatureIds.clear();
   mFeatureKeys.clear();
+  QgsExpressionContextScope expressionScope( &mExpressionContext );
   while ( fit.nextFeature( feat ) )
   {
     if ( mFilterFeatures && !mFeatureFilter.isEmpty() )
     {
-      QVariant result = filterExpression->evaluate( &feat, mCoverageLayer->pendingFields() );
+      QVariant result = filterExpression->evaluate( &feat );
       if ( filterExpression->hasEvalError() )
       {
         throw std::runtime_error( tr( "Feature filter eval error: %1" ).arg( filterExpression->evalErrorString() ).toLocal8Bit().data() );
@@ -243,7 +247,7 @@ int QgsAtlasComposition::updateFeatures()
     qSort( mFeatureIds.begin(), mFeatureIds.end(), sorter );
   }
 
-  QgsExpression::setSpecialColumn( "$numfeatures", QVariant(( int )mFeatureIds.size() ) );
+  mExpressionContext.setSpecialColumn( "$numfeatures", QVariant(( int )mFeatureIds.size() ) );
 
   //jump to first feature if currently using an atlas preview
   //need to do this in case filtering/layer change has altered matching features
@@ -285,7 +289,7 @@ bool QgsAtlasComposition::beginRender()
 
   // special columns for expressions
   QgsExpression::setSpecialColumn( "$numpages", QVariant( mComposition->numPages() ) );
-  QgsExpression::setSpecialColumn( "$numfeatures", QVariant(( int )mFeatureIds.size() ) );
+  mExpressionContext.setSpecialColumn( "$numfeatures", QVariant(( int )mFeatureIds.size() ) );
 
   return true;
 }
@@ -394,9 +398,9 @@ void QgsAtlasComposition::prepareForFeature( int featureI )
   // retrieve the next feature, based on its id
   mCoverageLayer->getFeatures( QgsFeatureRequest().setFilterFid( mFeatureIds[ featureI ] ) ).nextFeature( mCurrentFeature );
 
-  QgsExpression::setSpecialColumn( "$atlasfeatureid", mCurrentFeature.id() );
-  QgsExpression::setSpecialColumn( "$atlasgeometry", QVariant::fromValue( *mCurrentFeature.geometry() ) );
-  QgsExpression::setSpecialColumn( "$feature", QVariant(( int )featureI + 1 ) );
+  mExpressionContext.setSpecialColumn( "$atlasfeatureid", mCurrentFeature.id() );
+  mExpressionContext.setSpecialColumn( "$atlasgeometry", QVariant::fromValue( *mCurrentFeature.geometry() ) );
+  mExpressionContext.setSpecialColumn( "$feature", QVariant(( int )featureI + 1 ) );
 
   // generate filename for current feature
   evalFeatureFilename();
@@ -731,6 +735,7 @@ void QgsAtlasComposition::evalFeatureFilename()
   //generate filename for current atlas feature
   if ( !mSingleFile && mFilenamePattern.size() > 0 )
   {
+    QgsExpressionContextScope expressionScope( &mExpressionContext );
     QVariant filenameRes = mFilenameExpr->evaluate( &mCurrentFeature, mCoverageLayer->pendingFields() );
     if ( mFilenameExpr->hasEvalError() )
     {
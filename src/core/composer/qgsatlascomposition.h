@@ -17,6 +17,7 @@
 #define QGSATLASCOMPOSITION_H
 
 #include "qgscoordinatetransform.h"
+#include "qgsexpression.h"
 #include "qgsfeature.h"
 
 #include <memory>
@@ -27,7 +28,6 @@
 class QgsComposerMap;
 class QgsComposition;
 class QgsVectorLayer;
-class QgsExpression;
 
 /** \ingroup MapComposer
  * Class used to render an Atlas, iterating over geometry features.
@@ -137,6 +137,12 @@ class CORE_EXPORT QgsAtlasComposition : public QObject
     /** Recalculates the bounds of an atlas driven map */
     void prepareMap( QgsComposerMap* map );
 
+    /** Returns the context holding the special columns of the current atlas feature
+      ($feature, $numfeatures, $atlasfeatureid and $atlasgeometry). Composer items evaluate
+      their expressions with it
+      @note added in 2.1 */
+    const QgsExpressionContext& expressionContext() const { return mExpressionContext; }
+
   signals:
     /** emitted when one of the parameters changes */
     void parameterChanged();
@@ -194,6 +200,8 @@ class CORE_EXPORT QgsAtlasComposition : public QObject
 
     QgsFeature mCurrentFeature;
     bool mRestoreLayer;
+    // special columns of the current atlas feature
+    QgsExpressionContext mExpressionContext;
     std::auto_ptr<QgsExpression> mFilenameExpr;
 
     // bounding box of the current feature transformed into map crs
@@ -191,6 +191,7 @@ QString QgsComposerLabel::displayText() const
   replaceDateText( displayText );
   QMap<QString, QVariant> subs = mSubstitutions;
   subs[ "$page" ] = QVariant(( int )mComposition->itemPageNumber( this ) + 1 );
+  QgsExpressionContextScope expressionScope( &mComposition->atlasComposition().expressionContext() );
   return QgsExpression::replaceExpressionText( displayText, mExpressionFeature, mExpressionLayer, &subs );
 }
 
@@ -233,8 +233,13 @@ void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const
   bool bkLayerCaching = s.value( "/qgis/enable_render_caching", false ).toBool();
   s.setValue( "/qgis/enable_render_caching", false );
 
-  //update $map variable. Use QgsComposerItem's id since that is user-definable
-  QgsExpression::setSpecialColumn( "$map", QgsComposerItem::id() );
+  //special columns of the current atlas feature and the $map variable. Use QgsComposerItem's id since that is user-definable
+  QgsExpressionContext expressionContext( mComposition->atlasComposition().expressionContext() );
+  expressionContext.setSpecialColumn( "$map", QgsComposerItem::id() );
+  if ( theRendererContext )
+  {
+    theRendererContext->setExpressionContext( &expressionContext );
+  }
 
   if ( forceWidthScale ) //force wysiwyg line widths / marker sizes
   {
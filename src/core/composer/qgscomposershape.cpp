@@ -17,6 +17,7 @@
 
 #include "qgscomposershape.h"
 #include "qgscomposition.h"
+#include "qgsexpression.h"
 #include "qgssymbolv2.h"
 #include "qgssymbollayerv2utils.h"
 #include <QPainter>
@@ -145,6 +146,8 @@ void QgsComposerShape::drawShapeUsingSymbol( QPainter* p )
   QgsRenderContext context;
   context.setPainter( p );
   context.setScaleFactor( 1.0 );
+  // data defined symbology may use the atlas feature
+  QgsExpressionContextScope expressionScope( &mComposition->atlasComposition().expressionContext() );
   if ( mComposition->plotStyle() ==  QgsComposition::Preview )
   {
     context.setRasterScaleFactor( horizontalViewScaleFactor() );
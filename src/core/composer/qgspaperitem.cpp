@@ -17,6 +17,7 @@
 
 #include "qgspaperitem.h"
 #include "qgscomposition.h"
+#include "qgsexpression.h"
 #include "qgsstylev2.h"
 #include "qgslogger.h"
 #include <QGraphicsRectItem>
@@ -156,6 +157,8 @@ void QgsPaperItem::paint( QPainter* painter, const QStyleOptionGraphicsItem* ite
   QgsRenderContext context;
   context.setPainter( painter );
   context.setScaleFactor( 1.0 );
+  // data defined symbology may use the atlas feature
+  QgsExpressionContextScope expressionScope( &mComposition->atlasComposition().expressionContext() );
   if ( mComposition->plotStyle() ==  QgsComposition::Preview )
   {
     context.setRasterScaleFactor( horizontalViewScaleFactor() );
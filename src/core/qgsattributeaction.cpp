@@ -211,6 +211,8 @@ QString QgsAttributeAction::expandAction( QString action, QgsFeature &feat, cons
       continue;
     }
 
+    // evaluated only once, compiling would not pay off
+    exp.setCompilationEnabled( false );
     QVariant result = exp.evaluate( &feat, mLayer->pendingFields() );
     if ( exp.hasEvalError() )
     {
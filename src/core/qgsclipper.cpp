@@ -52,7 +52,7 @@ const unsigned char* QgsClipper::clippedLineWKB( const unsigned char* wkb, const
   double p1x_c, p1y_c; //clipped end coordinates
   double lastClipX = 0.0, lastClipY = 0.0; //last successfully clipped coords
 
-  line.clear();
+  line.resize( 0 ); // keeps reserved memory of a reused line
   line.reserve( nPoints + 1 );
 
   for ( unsigned int i = 0; i < nPoints; ++i )
@@ -0,0 +1,847 @@
+/***************************************************************************
+     qgscompiledexpression.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgscompiledexpression.h"
+#include "qgsfeature.h"
+
+#include <QVarLengthArray>
+
+#include <math.h>
+
+// three-value logic (same tables as the tree interpreter)
+enum CompiledTVL
+{
+  cFalse,
+  cTrue,
+  cUnknown
+};
+
+static const CompiledTVL cAND[3][3] =
+{
+  { cFalse, cFalse,   cFalse },
+  { cFalse, cTrue,    cUnknown },
+  { cFalse, cUnknown, cUnknown }
+};
+
+static const CompiledTVL cOR[3][3] =
+{
+  { cFalse,   cTrue, cUnknown },
+  { cTrue,    cTrue, cTrue },
+  { cUnknown, cTrue, cUnknown }
+};
+
+static const CompiledTVL cNOT[3] = { cTrue, cFalse, cUnknown };
+
+/**Register of the expression program. Int and double values are kept unboxed,
+  everything else (and null values, which may carry a type) as QVariant*/
+struct QgsExpressionRegister
+{
+  enum Kind
+  {
+    Null,
+    Int,
+    Double,
+    Variant
+  };
+
+  QgsExpressionRegister(): kind( Null ), i( 0 ), d( 0 ) {}
+
+  void set( const QVariant& value )
+  {
+    if ( value.isNull() )
+    {
+      kind = Null;
+      v = value;
+    }
+    else if ( value.type() == QVariant::Int )
+    {
+      kind = Int;
+      i = value.toInt();
+    }
+    else if ( value.type() == QVariant::Double )
+    {
+      kind = Double;
+      d = value.toDouble();
+    }
+    else
+    {
+      kind = Variant;
+      v = value;
+    }
+  }
+
+  void setNull() { kind = Null; v = QVariant(); }
+  void setInt( int value ) { kind = Int; i = value; }
+  void setDouble( double value ) { kind = Double; d = value; }
+  void setTVL( CompiledTVL tvl )
+  {
+    if ( tvl == cUnknown )
+      setNull();
+    else
+      setInt( tvl == cTrue ? 1 : 0 );
+  }
+
+  double toDouble() const { return kind == Int ? i : d; }
+  CompiledTVL toTVL() const
+  {
+    if ( kind == Null )
+      return cUnknown;
+    return ( kind == Int ? i != 0 : d != 0 ) ? cTrue : cFalse;
+  }
+
+  QVariant toVariant() const
+  {
+    switch ( kind )
+    {
+      case Int: return QVariant( i );
+      case Double: return QVariant( d );
+      default: return v;
+    }
+  }
+
+  Kind kind;
+  int i;
+  double d;
+  QVariant v;
+};
+
+/**Register holding the values of a whole batch of features. If all values are
+  ints or doubles they are kept in plain arrays, otherwise one register per feature*/
+struct QgsExpressionColumn
+{
+  enum Kind
+  {
+    Int,
+    Double,
+    Rows
+  };
+
+  QgsExpressionColumn(): kind( Rows ) {}
+
+  QgsExpressionRegister at( int k ) const
+  {
+    QgsExpressionRegister r;
+    switch ( kind )
+    {
+      case Int: r.setInt( i[k] ); break;
+      case Double: r.setDouble( d[k] ); break;
+      case Rows: r = rows[k]; break;
+    }
+    return r;
+  }
+
+  bool isNullAt( int k ) const { return kind == Rows && rows[k].kind == QgsExpressionRegister::Null; }
+
+  bool isNumeric() const { return kind != Rows; }
+
+  //! values as doubles, converted into tmp for int columns
+  const double* doubles( QVector<double>& tmp ) const
+  {
+    if ( kind == Double )
+      return d.constData();
+    tmp.resize( i.size() );
+    for ( int k = 0; k < i.size(); ++k )
+      tmp[k] = i[k];
+    return tmp.constData();
+  }
+
+  void resetRows( int n )
+  {
+    kind = Rows;
+    rows.fill( QgsExpressionRegister(), n );
+  }
+
+  //! switches to the int / double arrays if all rows hold values of the same numeric type
+  void compact()
+  {
+    if ( kind != Rows || rows.isEmpty() )
+      return;
+    QgsExpressionRegister::Kind first = rows[0].kind;
+    if ( first != QgsExpressionRegister::Int && first != QgsExpressionRegister::Double )
+      return;
+    for ( int k = 1; k < rows.size(); ++k )
+    {
+      if ( rows[k].kind != first )
+        return;
+    }
+    if ( first == QgsExpressionRegister::Int )
+    {
+      kind = Int;
+      i.resize( rows.size() );
+      for ( int k = 0; k < rows.size(); ++k )
+        i[k] = rows[k].i;
+    }
+    else
+    {
+      kind = Double;
+      d.resize( rows.size() );
+      for ( int k = 0; k < rows.size(); ++k )
+        d[k] = rows[k].d;
+    }
+    rows.clear();
+  }
+
+  Kind kind;
+  QVector<int> i;
+  QVector<double> d;
+  QVector<QgsExpressionRegister> rows;
+};
+
+QgsCompiledExpression::QgsCompiledExpression()
+    : mRegisterCount( 0 )
+    , mResultRegister( -1 )
+{
+}
+
+// true if the tree only consists of literals and operators, i.e. it evaluates to the same value for every feature
+static bool isConstantTree( const QgsExpression::Node* node )
+{
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntLiteral:
+      return true;
+    case QgsExpression::ntUnaryOperator:
+      return isConstantTree( static_cast<const QgsExpression::NodeUnaryOperator*>( node )->operand() );
+    case QgsExpression::ntBinaryOperator:
+    {
+      const QgsExpression::NodeBinaryOperator* n = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+      return isConstantTree( n->opLeft() ) && isConstantTree( n->opRight() );
+    }
+    default:
+      return false;
+  }
+}
+
+QgsCompiledExpression* QgsCompiledExpression::compile( QgsExpression::Node* root )
+{
+  if ( !root )
+    return 0;
+
+  QgsCompiledExpression* program = new QgsCompiledExpression();
+  program->mResultRegister = program->compileNode( root );
+
+  // nothing gained if the whole tree has to be interpreted anyway
+  if ( program->mCode.size() == 1 && program->mCode[0].op == EvalNode )
+  {
+    delete program;
+    return 0;
+  }
+  return program;
+}
+
+int QgsCompiledExpression::emit( OpCode op, int a, int b, int subOp, QgsExpression::Node* node, QgsExpression::Function* function )
+{
+  Instruction ins;
+  ins.op = op;
+  ins.dest = mRegisterCount++;
+  ins.a = a;
+  ins.b = b;
+  ins.subOp = subOp;
+  ins.node = node;
+  ins.function = function;
+  mCode.append( ins );
+  return ins.dest;
+}
+
+int QgsCompiledExpression::compileNode( QgsExpression::Node* node )
+{
+  // constant folding: operators on literals are evaluated once. Subtrees which fail
+  // are compiled normally so that the error is reported at evaluation time
+  if ( node->nodeType() != QgsExpression::ntLiteral && isConstantTree( node ) )
+  {
+    QgsExpressionContext foldContext;
+    QVariant value = node->eval( &foldContext, 0 );
+    if ( !foldContext.hasEvalError() )
+    {
+      mConstants.append( value );
+      return emit( LoadConstant, mConstants.size() - 1, 0, 0, node );
+    }
+  }
+
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntLiteral:
+    {
+      mConstants.append( static_cast<QgsExpression::NodeLiteral*>( node )->value() );
+      return emit( LoadConstant, mConstants.size() - 1, 0, 0, node );
+    }
+
+    case QgsExpression::ntColumnRef:
+    {
+      QgsExpression::NodeColumnRef* n = static_cast<QgsExpression::NodeColumnRef*>( node );
+      if ( n->index() < 0 )
+        break; // lookup by name, leave it to the node
+      return emit( LoadColumn, n->index(), 0, 0, node );
+    }
+
+    case QgsExpression::ntUnaryOperator:
+    {
+      QgsExpression::NodeUnaryOperator* n = static_cast<QgsExpression::NodeUnaryOperator*>( node );
+      int a = compileNode( n->operand() );
+      return emit( UnaryOp, a, 0, n->op(), node );
+    }
+
+    case QgsExpression::ntBinaryOperator:
+    {
+      QgsExpression::NodeBinaryOperator* n = static_cast<QgsExpression::NodeBinaryOperator*>( node );
+      int a = compileNode( n->opLeft() );
+      int b = compileNode( n->opRight() );
+      return emit( BinaryOp, a, b, n->op(), node );
+    }
+
+    case QgsExpression::ntFunction:
+    {
+      QgsExpression::NodeFunction* n = static_cast<QgsExpression::NodeFunction*>( node );
+      QgsExpression::Function* fd = QgsExpression::Functions()[n->fnIndex()];
+      // all "normal" functions return NULL when any parameter is NULL, without evaluating the remaining ones
+      bool nullPropagates = fd->name() != "coalesce";
+
+      QList<int> argRegisters;
+      QList<int> jumps;
+      if ( n->args() )
+      {
+        foreach ( QgsExpression::Node* arg, n->args()->list() )
+        {
+          int r = compileNode( arg );
+          argRegisters << r;
+          if ( nullPropagates )
+          {
+            jumps << mCode.size();
+            emit( JumpIfNull, r, -1, 0, node );
+          }
+        }
+      }
+
+      int argOffset = mArgRegisters.size();
+      foreach ( int r, argRegisters )
+        mArgRegisters.append( r );
+      int dest = emit( CallFunction, argOffset, argRegisters.size(), 0, node, fd );
+
+      // all jumps continue after the call and write the null result into its register
+      foreach ( int j, jumps )
+      {
+        mCode[j].dest = dest;
+        mCode[j].b = mCode.size();
+      }
+      return dest;
+    }
+
+    default:
+      break;
+  }
+
+  return emit( EvalNode, 0, 0, 0, node );
+}
+
+bool QgsCompiledExpression::unaryOp( const Instruction& ins, const QgsExpressionRegister& a, QgsExpressionRegister& r, QgsExpressionContext* context )
+{
+  if ( ins.subOp == QgsExpression::uoNot && a.kind != QgsExpressionRegister::Variant )
+  {
+    r.setTVL( cNOT[a.toTVL()] );
+  }
+  else if ( ins.subOp == QgsExpression::uoMinus && a.kind == QgsExpressionRegister::Int )
+  {
+    r.setInt( -a.i );
+  }
+  else if ( ins.subOp == QgsExpression::uoMinus && a.kind == QgsExpressionRegister::Double )
+  {
+    r.setDouble( -a.d );
+  }
+  else
+  {
+    r.set( static_cast<const QgsExpression::NodeUnaryOperator*>( ins.node )->evalValue( context, a.toVariant() ) );
+    return !context->hasEvalError();
+  }
+  return true;
+}
+
+bool QgsCompiledExpression::binaryOp( const Instruction& ins, const QgsExpressionRegister& a, const QgsExpressionRegister& b, QgsExpressionRegister& r, QgsExpressionContext* context )
+{
+  bool fast = a.kind != QgsExpressionRegister::Variant && b.kind != QgsExpressionRegister::Variant;
+  bool anyNull = a.kind == QgsExpressionRegister::Null || b.kind == QgsExpressionRegister::Null;
+
+  if ( fast )
+  {
+    switch ( ins.subOp )
+    {
+      case QgsExpression::boPlus:
+      case QgsExpression::boMinus:
+      case QgsExpression::boMul:
+      case QgsExpression::boDiv:
+      case QgsExpression::boMod:
+        if ( anyNull )
+        {
+          r.setNull();
+        }
+        else if ( a.kind == QgsExpressionRegister::Int && b.kind == QgsExpressionRegister::Int )
+        {
+          switch ( ins.subOp )
+          {
+            case QgsExpression::boPlus: r.setInt( a.i + b.i ); break;
+            case QgsExpression::boMinus: r.setInt( a.i - b.i ); break;
+            case QgsExpression::boMul: r.setInt( a.i * b.i ); break;
+            case QgsExpression::boDiv: if ( b.i == 0 ) r.setNull(); else r.setInt( a.i / b.i ); break;
+            default: if ( b.i == 0 ) r.setNull(); else r.setInt( a.i % b.i ); break;
+          }
+        }
+        else
+        {
+          double x = a.toDouble(), y = b.toDouble();
+          switch ( ins.subOp )
+          {
+            case QgsExpression::boPlus: r.setDouble( x + y ); break;
+            case QgsExpression::boMinus: r.setDouble( x - y ); break;
+            case QgsExpression::boMul: r.setDouble( x * y ); break;
+            case QgsExpression::boDiv: if ( y == 0 ) r.setNull(); else r.setDouble( x / y ); break;
+            default: r.setDouble( fmod( x, y ) ); break;
+          }
+        }
+        return true;
+
+      case QgsExpression::boPow:
+        if ( anyNull )
+          r.setNull();
+        else
+          r.setDouble( pow( a.toDouble(), b.toDouble() ) );
+        return true;
+
+      case QgsExpression::boAnd:
+        r.setTVL( cAND[a.toTVL()][b.toTVL()] );
+        return true;
+
+      case QgsExpression::boOr:
+        r.setTVL( cOR[a.toTVL()][b.toTVL()] );
+        return true;
+
+      case QgsExpression::boEQ:
+      case QgsExpression::boNE:
+      case QgsExpression::boLT:
+      case QgsExpression::boGT:
+      case QgsExpression::boLE:
+      case QgsExpression::boGE:
+        if ( anyNull )
+        {
+          r.setNull();
+        }
+        else
+        {
+          // same as the interpreter: compare the difference (matters for infinite values)
+          double diff = a.toDouble() - b.toDouble();
+          bool res;
+          switch ( ins.subOp )
+          {
+            case QgsExpression::boEQ: res = diff == 0; break;
+            case QgsExpression::boNE: res = diff != 0; break;
+            case QgsExpression::boLT: res = diff < 0; break;
+            case QgsExpression::boGT: res = diff > 0; break;
+            case QgsExpression::boLE: res = diff <= 0; break;
+            default: res = diff >= 0; break;
+          }
+          r.setInt( res ? 1 : 0 );
+        }
+        return true;
+
+      case QgsExpression::boIs:
+      case QgsExpression::boIsNot:
+      {
+        bool equal;
+        if ( anyNull )
+          equal = a.kind == b.kind;
+        else
+          equal = a.toDouble() == b.toDouble();
+        r.setInt(( ins.subOp == QgsExpression::boIs ) == equal ? 1 : 0 );
+        return true;
+      }
+
+      default:
+        break; // string operators
+    }
+  }
+
+  r.set( static_cast<const QgsExpression::NodeBinaryOperator*>( ins.node )->evalValues( context, a.toVariant(), b.toVariant() ) );
+  return !context->hasEvalError();
+}
+
+QVariant QgsCompiledExpression::evaluate( QgsExpressionContext* context, const QgsFeature* f ) const
+{
+  QVarLengthArray<QgsExpressionRegister, 32> regs( mRegisterCount );
+  const Instruction* code = mCode.constData();
+  const int codeSize = mCode.size();
+
+  for ( int pc = 0; pc < codeSize; ++pc )
+  {
+    const Instruction& ins = code[pc];
+    QgsExpressionRegister& r = regs[ins.dest];
+
+    switch ( ins.op )
+    {
+      case LoadConstant:
+        r.set( mConstants.at( ins.a ) );
+        break;
+
+      case LoadColumn:
+        if ( f )
+        {
+          const QgsAttributes& attrs = f->attributes();
+          if ( ins.a < attrs.count() )
+            r.set( attrs.at( ins.a ) );
+          else
+            r.setNull();
+        }
+        else
+        {
+          r.set( ins.node->eval( context, f ) );
+        }
+        break;
+
+      case UnaryOp:
+        if ( !unaryOp( ins, regs[ins.a], r, context ) )
+          return QVariant();
+        break;
+
+      case BinaryOp:
+        if ( !binaryOp( ins, regs[ins.a], regs[ins.b], r, context ) )
+          return QVariant();
+        break;
+
+      case JumpIfNull:
+        if ( regs[ins.a].kind == QgsExpressionRegister::Null )
+        {
+          r.setNull();
+          pc = ins.b - 1;
+        }
+        break;
+
+      case CallFunction:
+      {
+        QVariantList args;
+        for ( int i = 0; i < ins.b; ++i )
+        {
+          args.append( regs[mArgRegisters.at( ins.a + i )].toVariant() );
+        }
+        r.set( ins.function->func( args, f, context ) );
+        if ( context->hasEvalError() )
+          return QVariant();
+        break;
+      }
+
+      case EvalNode:
+        r.set( ins.node->eval( context, f ) );
+        if ( context->hasEvalError() )
+          return QVariant();
+        break;
+    }
+  }
+
+  return regs[mResultRegister].toVariant();
+}
+
+bool QgsCompiledExpression::unaryOpColumn( const Instruction& ins, const QgsExpressionColumn& a, QgsExpressionColumn& r )
+{
+  if ( !a.isNumeric() )
+    return false;
+
+  const int n = a.kind == QgsExpressionColumn::Int ? a.i.size() : a.d.size();
+  if ( ins.subOp == QgsExpression::uoMinus && a.kind == QgsExpressionColumn::Int )
+  {
+    r.kind = QgsExpressionColumn::Int;
+    r.i.resize( n );
+    for ( int k = 0; k < n; ++k )
+      r.i[k] = -a.i[k];
+  }
+  else if ( ins.subOp == QgsExpression::uoMinus )
+  {
+    r.kind = QgsExpressionColumn::Double;
+    r.d.resize( n );
+    for ( int k = 0; k < n; ++k )
+      r.d[k] = -a.d[k];
+  }
+  else
+  {
+    r.kind = QgsExpressionColumn::Int;
+    r.i.resize( n );
+    if ( a.kind == QgsExpressionColumn::Int )
+    {
+      for ( int k = 0; k < n; ++k )
+        r.i[k] = a.i[k] == 0 ? 1 : 0;
+    }
+    else
+    {
+      for ( int k = 0; k < n; ++k )
+        r.i[k] = a.d[k] == 0 ? 1 : 0;
+    }
+  }
+  return true;
+}
+
+bool QgsCompiledExpression::binaryOpColumn( const Instruction& ins, const QgsExpressionColumn& a, const QgsExpressionColumn& b, QgsExpressionColumn& r )
+{
+  if ( !a.isNumeric() || !b.isNumeric() )
+    return false;
+
+  const int n = a.kind == QgsExpressionColumn::Int ? a.i.size() : a.d.size();
+  const bool ints = a.kind == QgsExpressionColumn::Int && b.kind == QgsExpressionColumn::Int;
+
+  switch ( ins.subOp )
+  {
+    case QgsExpression::boPlus:
+    case QgsExpression::boMinus:
+    case QgsExpression::boMul:
+    case QgsExpression::boDiv:
+    case QgsExpression::boMod:
+      if ( ints )
+      {
+        const int* x = a.i.constData();
+        const int* y = b.i.constData();
+        if ( ins.subOp == QgsExpression::boDiv || ins.subOp == QgsExpression::boMod )
+        {
+          // division by zero gives NULL, leave such batches to the row by row evaluation
+          for ( int k = 0; k < n; ++k )
+          {
+            if ( y[k] == 0 )
+              return false;
+          }
+        }
+        r.kind = QgsExpressionColumn::Int;
+        r.i.resize( n );
+        int* z = r.i.data();
+        switch ( ins.subOp )
+        {
+          case QgsExpression::boPlus: for ( int k = 0; k < n; ++k ) z[k] = x[k] + y[k]; break;
+          case QgsExpression::boMinus: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k]; break;
+          case QgsExpression::boMul: for ( int k = 0; k < n; ++k ) z[k] = x[k] * y[k]; break;
+          case QgsExpression::boDiv: for ( int k = 0; k < n; ++k ) z[k] = x[k] / y[k]; break;
+          default: for ( int k = 0; k < n; ++k ) z[k] = x[k] % y[k]; break;
+        }
+      }
+      else
+      {
+        QVector<double> tmpA, tmpB;
+        const double* x = a.doubles( tmpA );
+        const double* y = b.doubles( tmpB );
+        if ( ins.subOp == QgsExpression::boDiv )
+        {
+          for ( int k = 0; k < n; ++k )
+          {
+            if ( y[k] == 0 )
+              return false;
+          }
+        }
+        r.kind = QgsExpressionColumn::Double;
+        r.d.resize( n );
+        double* z = r.d.data();
+        switch ( ins.subOp )
+        {
+          case QgsExpression::boPlus: for ( int k = 0; k < n; ++k ) z[k] = x[k] + y[k]; break;
+          case QgsExpression::boMinus: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k]; break;
+          case QgsExpression::boMul: for ( int k = 0; k < n; ++k ) z[k] = x[k] * y[k]; break;
+          case QgsExpression::boDiv: for ( int k = 0; k < n; ++k ) z[k] = x[k] / y[k]; break;
+          default: for ( int k = 0; k < n; ++k ) z[k] = fmod( x[k], y[k] ); break;
+        }
+      }
+      return true;
+
+    case QgsExpression::boPow:
+    {
+      QVector<double> tmpA, tmpB;
+      const double* x = a.doubles( tmpA );
+      const double* y = b.doubles( tmpB );
+      r.kind = QgsExpressionColumn::Double;
+      r.d.resize( n );
+      for ( int k = 0; k < n; ++k )
+        r.d[k] = pow( x[k], y[k] );
+      return true;
+    }
+
+    case QgsExpression::boAnd:
+    case QgsExpression::boOr:
+    case QgsExpression::boEQ:
+    case QgsExpression::boNE:
+    case QgsExpression::boLT:
+    case QgsExpression::boGT:
+    case QgsExpression::boLE:
+    case QgsExpression::boGE:
+    case QgsExpression::boIs:
+    case QgsExpression::boIsNot:
+    {
+      // numeric columns have no NULLs, so the results are never unknown
+      QVector<double> tmpA, tmpB;
+      const double* x = a.doubles( tmpA );
+      const double* y = b.doubles( tmpB );
+      r.kind = QgsExpressionColumn::Int;
+      r.i.resize( n );
+      int* z = r.i.data();
+      switch ( ins.subOp )
+      {
+        case QgsExpression::boAnd: for ( int k = 0; k < n; ++k ) z[k] = x[k] != 0 && y[k] != 0; break;
+        case QgsExpression::boOr: for ( int k = 0; k < n; ++k ) z[k] = x[k] != 0 || y[k] != 0; break;
+        case QgsExpression::boEQ: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k] == 0; break;
+        case QgsExpression::boNE: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k] != 0; break;
+        case QgsExpression::boLT: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k] < 0; break;
+        case QgsExpression::boGT: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k] > 0; break;
+        case QgsExpression::boLE: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k] <= 0; break;
+        case QgsExpression::boGE: for ( int k = 0; k < n; ++k ) z[k] = x[k] - y[k] >= 0; break;
+        case QgsExpression::boIs: for ( int k = 0; k < n; ++k ) z[k] = x[k] == y[k]; break;
+        default: for ( int k = 0; k < n; ++k ) z[k] = x[k] != y[k]; break;
+      }
+      return true;
+    }
+
+    default:
+      return false; // string operators
+  }
+}
+
+QVariantList QgsCompiledExpression::evaluate( QgsExpressionContext* context, const QList<const QgsFeature*>& features ) const
+{
+  const int n = features.size();
+  const int firstRowNumber = context->currentRowNumber();
+  const Instruction* code = mCode.constData();
+  const int codeSize = mCode.size();
+
+  QVector<QgsExpressionColumn> cols( mRegisterCount );
+  // row k takes part in instructions from resume[k] on (set by null function arguments and errors)
+  QVector<int> resume( n, 0 );
+  QVector<bool> failed( n, false );
+  QString firstError;
+
+  for ( int pc = 0; pc < codeSize; ++pc )
+  {
+    const Instruction& ins = code[pc];
+    QgsExpressionColumn& r = cols[ins.dest];
+
+    if ( ins.op == LoadConstant )
+    {
+      // no side effects, so constants and columns are loaded for all rows
+      const QVariant& value = mConstants.at( ins.a );
+      if ( !value.isNull() && value.type() == QVariant::Int )
+      {
+        r.kind = QgsExpressionColumn::Int;
+        r.i.fill( value.toInt(), n );
+      }
+      else if ( !value.isNull() && value.type() == QVariant::Double )
+      {
+        r.kind = QgsExpressionColumn::Double;
+        r.d.fill( value.toDouble(), n );
+      }
+      else
+      {
+        r.resetRows( n );
+        for ( int k = 0; k < n; ++k )
+          r.rows[k].set( value );
+      }
+      continue;
+    }
+
+    if ( ins.op == LoadColumn )
+    {
+      r.resetRows( n );
+      for ( int k = 0; k < n; ++k )
+      {
+        const QgsFeature* f = features.at( k );
+        if ( !f )
+          r.rows[k].set( ins.node->eval( context, f ) ); // same result as evaluate() without feature
+        else if ( ins.a < f->attributes().count() )
+          r.rows[k].set( f->attributes().at( ins.a ) );
+      }
+      r.compact();
+      continue;
+    }
+
+    bool allActive = true;
+    for ( int k = 0; k < n && allActive; ++k )
+      allActive = resume[k] <= pc;
+
+    if ( ins.op == UnaryOp && allActive && unaryOpColumn( ins, cols[ins.a], r ) )
+      continue;
+    if ( ins.op == BinaryOp && allActive && binaryOpColumn( ins, cols[ins.a], cols[ins.b], r ) )
+      continue;
+
+    if ( ins.op == JumpIfNull )
+    {
+      // the skipped rows get their NULL result when the function call is reached
+      const QgsExpressionColumn& a = cols[ins.a];
+      for ( int k = 0; k < n; ++k )
+      {
+        if ( resume[k] <= pc && a.isNullAt( k ) )
+          resume[k] = ins.b;
+      }
+      continue;
+    }
+
+    // row by row evaluation
+    QgsExpressionColumn result;
+    result.resetRows( n );
+    for ( int k = 0; k < n; ++k )
+    {
+      if ( resume[k] > pc )
+        continue;
+
+      QgsExpressionRegister& value = result.rows[k];
+      const QgsFeature* f = features.at( k );
+      context->setCurrentRowNumber( firstRowNumber + k );
+      switch ( ins.op )
+      {
+        case UnaryOp:
+          unaryOp( ins, cols[ins.a].at( k ), value, context );
+          break;
+
+        case BinaryOp:
+          binaryOp( ins, cols[ins.a].at( k ), cols[ins.b].at( k ), value, context );
+          break;
+
+        case CallFunction:
+        {
+          QVariantList args;
+          for ( int i = 0; i < ins.b; ++i )
+          {
+            args.append( cols[mArgRegisters.at( ins.a + i )].at( k ).toVariant() );
+          }
+          value.set( ins.function->func( args, f, context ) );
+          break;
+        }
+
+        case EvalNode:
+          value.set( ins.node->eval( context, f ) );
+          break;
+
+        default:
+          break;
+      }
+
+      if ( context->hasEvalError() )
+      {
+        if ( firstError.isNull() )
+          firstError = context->evalErrorString();
+        context->setEvalErrorString( QString() );
+        value.setNull();
+        failed[k] = true;
+        resume[k] = codeSize;
+      }
+    }
+    result.compact();
+    r = result;
+  }
+
+  context->setCurrentRowNumber( firstRowNumber );
+  context->setEvalErrorString( firstError );
+
+  QVariantList results;
+  const QgsExpressionColumn& res = cols[mResultRegister];
+  for ( int k = 0; k < n; ++k )
+  {
+    results.append( failed[k] ? QVariant() : res.at( k ).toVariant() );
+  }
+  return results;
+}
@@ -0,0 +1,106 @@
+/***************************************************************************
+     qgscompiledexpression.h
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSCOMPILEDEXPRESSION_H
+#define QGSCOMPILEDEXPRESSION_H
+
+#include "qgsexpression.h"
+
+#include <QVector>
+
+struct QgsExpressionRegister;
+struct QgsExpressionColumn;
+
+/**
+ * Flat register based program compiled from a prepared QgsExpression tree.
+ *
+ * Literals, column references, unary and binary operators and function calls are lowered
+ * to instructions working on typed registers, so that numeric arithmetic and comparisons do
+ * not need to go through QVariant conversions. Operator subtrees consisting of literals only
+ * are folded to constants. Nodes which cannot be lowered (IN, CASE) are evaluated with the
+ * tree interpreter, as are operands of types other than int and double.
+ *
+ * The result of evaluate() is identical to evaluating the tree. A program is not modified by
+ * evaluation and can be shared between threads.
+ *
+ * A batch of features can be evaluated column-wise: every instruction is applied to all features
+ * of the batch before the next one runs, and registers holding only ints or doubles for the whole
+ * batch are stored as plain arrays, so that operators run as tight loops over them.
+ *
+ * Instances are created by QgsExpression::prepare(), see QgsExpression::setCompilationEnabled().
+ * @note added in 2.1
+ * @note not available in python bindings
+ */
+class CORE_EXPORT QgsCompiledExpression
+{
+  public:
+    /**Compiles the tree below root. The column references must have been prepared already.
+      @return compiled program or 0 if the tree could not be lowered*/
+    static QgsCompiledExpression* compile( QgsExpression::Node* root );
+
+    /**Evaluates the program for a feature. Errors are reported to the context*/
+    QVariant evaluate( QgsExpressionContext* context, const QgsFeature* f ) const;
+
+    /**Evaluates the program for a batch of features and returns one value per feature. Feature i is
+      evaluated with the row number context->currentRowNumber() + i. Features failing to evaluate
+      give a NULL value, the context holds the error of the first of them*/
+    QVariantList evaluate( QgsExpressionContext* context, const QList<const QgsFeature*>& features ) const;
+
+    /**Number of instructions of the program*/
+    int instructionCount() const { return mCode.size(); }
+
+  private:
+    enum OpCode
+    {
+      LoadConstant,   //!< dest = constant[a]
+      LoadColumn,     //!< dest = attribute[a] (node evaluated if there is no feature)
+      UnaryOp,        //!< dest = op( reg[a] )
+      BinaryOp,       //!< dest = reg[a] op reg[b]
+      JumpIfNull,     //!< if reg[a] is null: dest = null, continue at b
+      CallFunction,   //!< dest = function( reg[args[a]] ... reg[args[a + b - 1]] )
+      EvalNode        //!< dest = node evaluated with the tree interpreter
+    };
+
+    struct Instruction
+    {
+      OpCode op;
+      int dest;
+      int a;
+      int b;
+      int subOp;
+      QgsExpression::Node* node;
+      QgsExpression::Function* function;
+    };
+
+    QgsCompiledExpression();
+
+    //! emits code for node and returns the register holding its value
+    int compileNode( QgsExpression::Node* node );
+    int emit( OpCode op, int a, int b, int subOp, QgsExpression::Node* node, QgsExpression::Function* function = 0 );
+
+    //! applies a unary / binary operator to single values, returns false on evaluation error
+    static bool unaryOp( const Instruction& ins, const QgsExpressionRegister& a, QgsExpressionRegister& r, QgsExpressionContext* context );
+    static bool binaryOp( const Instruction& ins, const QgsExpressionRegister& a, const QgsExpressionRegister& b, QgsExpressionRegister& r, QgsExpressionContext* context );
+
+    //! applies a unary / binary operator to whole columns of int / double values, returns false if not possible
+    static bool unaryOpColumn( const Instruction& ins, const QgsExpressionColumn& a, QgsExpressionColumn& r );
+    static bool binaryOpColumn( const Instruction& ins, const QgsExpressionColumn& a, const QgsExpressionColumn& b, QgsExpressionColumn& r );
+
+    QVector<Instruction> mCode;
+    QVector<QVariant> mConstants;
+    QVector<int> mArgRegisters;
+    int mRegisterCount;
+    int mResultRegister;
+};
+
+#endif // QGSCOMPILEDEXPRESSION_H
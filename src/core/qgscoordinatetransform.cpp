@@ -26,6 +26,7 @@
 #include <QApplication>
 #include <QPolygonF>
 #include <QStringList>
+#include <QThreadStorage>
 #include <QVector>
 
 extern "C"
@@ -362,6 +363,10 @@ void QgsCoordinateTransform::transformInPlace( double& x, double& y, double& z,
   }
 }
 
+// zeroed z coordinates and the transformed points of transformPolygon, reused by each thread
+static QThreadStorage< QVector<double>* > sPolygonZ;
+static QThreadStorage< QPolygonF* > sPolygonResult;
+
 void QgsCoordinateTransform::transformPolygon( QPolygonF& poly, TransformDirection direction ) const
 {
   if ( mShortCircuit || !mInitialisedFlag )
@@ -369,8 +374,46 @@ void QgsCoordinateTransform::transformPolygon( QPolygonF& poly, TransformDirecti
     return;
   }
 
-  //create x, y arrays
   int nVertices = poly.size();
+  if ( nVertices == 0 )
+  {
+    return;
+  }
+
+  if ( sizeof( qreal ) == sizeof( double ) )
+  {
+    // transform the interleaved coordinates of a copy of the points, the polygon
+    // is only replaced when all of them were transformed
+    if ( !sPolygonZ.hasLocalData() )
+    {
+      sPolygonZ.setLocalData( new QVector<double>() );
+      sPolygonResult.setLocalData( new QPolygonF() );
+    }
+    QVector<double>& z = *sPolygonZ.localData();
+    z.resize( 2 * nVertices );
+    z.fill( 0 );
+    QPolygonF& result = *sPolygonResult.localData();
+    result.resize( nVertices );
+    qCopy( poly.constBegin(), poly.constEnd(), result.begin() );
+
+    double* coords = reinterpret_cast<double*>( result.data() );
+    try
+    {
+      transformCoords( nVertices, 2, coords, coords + 1, z.data(), direction );
+    }
+    catch ( const QgsCsException & )
+    {
+      // rethrow the exception
+      QgsDebugMsg( "rethrowing exception" );
+      throw;
+    }
+
+    // the buffer of the polygon is reused for the next one
+    qSwap( poly, result );
+    return;
+  }
+
+  //create x, y arrays
 
   QVector<double> x( nVertices );
   QVector<double> y( nVertices );
@@ -591,6 +634,11 @@ QgsRectangle QgsCoordinateTransform::transformBoundingBox( const QgsRectangle re
 }
 
 void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, double *y, double *z, TransformDirection direction ) const
+{
+  transformCoords( numPoints, 1, x, y, z, direction );
+}
+
+void QgsCoordinateTransform::transformCoords( int numPoints, int pointOffset, double *x, double *y, double *z, TransformDirection direction ) const
 {
   // Refuse to transform the points if the srs's are invalid
   if ( !mSourceCRS.isValid() )
@@ -620,7 +668,7 @@ void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, d
   if (( pj_is_latlong( mDestinationProjection ) && ( direction == ReverseTransform ) )
       || ( pj_is_latlong( mSourceProjection ) && ( direction == ForwardTransform ) ) )
   {
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       x[i] *= DEG_TO_RAD;
       y[i] *= DEG_TO_RAD;
@@ -631,13 +679,13 @@ void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, d
   int projResult;
   if ( direction == ReverseTransform )
   {
-    projResult = pj_transform( mDestinationProjection, mSourceProjection, numPoints, 0, x, y, z );
+    projResult = pj_transform( mDestinationProjection, mSourceProjection, numPoints, pointOffset, x, y, z );
   }
   else
   {
     Q_ASSERT( mSourceProjection != 0 );
     Q_ASSERT( mDestinationProjection != 0 );
-    projResult = pj_transform( mSourceProjection, mDestinationProjection, numPoints, 0, x, y, z );
+    projResult = pj_transform( mSourceProjection, mDestinationProjection, numPoints, pointOffset, x, y, z );
   }
 
   if ( projResult != 0 )
@@ -645,7 +693,7 @@ void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, d
     //something bad happened....
     QString points;
 
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       if ( direction == ForwardTransform )
       {
@@ -682,7 +730,7 @@ void QgsCoordinateTransform::transformCoords( const int& numPoints, double *x, d
   if (( pj_is_latlong( mDestinationProjection ) && ( direction == ForwardTransform ) )
       || ( pj_is_latlong( mSourceProjection ) && ( direction == ReverseTransform ) ) )
   {
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       x[i] *= RAD_TO_DEG;
       y[i] *= RAD_TO_DEG;
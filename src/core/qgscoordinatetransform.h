@@ -152,13 +152,15 @@ class CORE_EXPORT QgsCoordinateTransform : public QObject
 
     // Same as for the other transform() functions, but alters the x
     // and y variables in place. The second one works with good old-fashioned
-    // C style arrays.
+    // C style arrays. If a QgsCsException is thrown the coordinates are
+    // left partly transformed.
     void transformInPlace( double& x, double& y, double &z, TransformDirection direction = ForwardTransform ) const;
 
     //! @note not available in python bindings
     void transformInPlace( QVector<double>& x, QVector<double>& y, QVector<double>& z,
                            TransformDirection direction = ForwardTransform ) const;
 
+    //! Transforms the points of the polygon. If a QgsCsException is thrown the polygon is unchanged.
     void transformPolygon( QPolygonF& poly, TransformDirection direction = ForwardTransform ) const;
 
 #ifdef ANDROID
@@ -248,6 +250,12 @@ class CORE_EXPORT QgsCoordinateTransform : public QObject
 
   private:
 
+    /*!
+     * Transform coordinates which are pointOffset doubles apart, e.g.
+     * the interleaved x and y of QPointF arrays with pointOffset 2
+     */
+    void transformCoords( int numPoints, int pointOffset, double *x, double *y, double *z, TransformDirection direction ) const;
+
     /*!
      * Flag to indicate that the source and destination coordinate systems are
      * equal and not transformation needs to be done
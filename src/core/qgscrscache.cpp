@@ -18,6 +18,27 @@
 #include "qgscrscache.h"
 #include "qgscoordinatetransform.h"
 
+#include <QMutexLocker>
+
+
+class QgsCoordinateTransformCache::ThreadTransforms
+{
+  public:
+    ThreadTransforms( QgsCoordinateTransformCache* cache ): mCache( cache ) {}
+    ~ThreadTransforms()
+    {
+      if ( mCache )
+      {
+        QMutexLocker locker( &mCache->mMutex );
+        mCache->mAllThreadTransforms.remove( this );
+      }
+      qDeleteAll( mTransforms );
+    }
+
+    /**Cache the transformations belong to, 0 once the cache is destroyed*/
+    QgsCoordinateTransformCache* mCache;
+    QMultiHash< QPair< QString, QString >, QgsCoordinateTransform* > mTransforms; //same auth_id pairs might have different datum transformations
+};
 
 QgsCoordinateTransformCache* QgsCoordinateTransformCache::instance()
 {
@@ -27,17 +48,33 @@ QgsCoordinateTransformCache* QgsCoordinateTransformCache::instance()
 
 QgsCoordinateTransformCache::~QgsCoordinateTransformCache()
 {
-  QHash< QPair< QString, QString >, QgsCoordinateTransform* >::const_iterator tIt = mTransforms.constBegin();
-  for ( ; tIt != mTransforms.constEnd(); ++tIt )
+  //QThreadStorage does not delete the data of the other threads once it is destroyed
+  QMutexLocker locker( &mMutex );
+  QSet< ThreadTransforms* >::const_iterator tIt = mAllThreadTransforms.constBegin();
+  for ( ; tIt != mAllThreadTransforms.constEnd(); ++tIt )
   {
-    delete tIt.value();
+    ( *tIt )->mCache = 0;
+    delete *tIt;
   }
+  mAllThreadTransforms.clear();
 }
 
 const QgsCoordinateTransform* QgsCoordinateTransformCache::transform( const QString& srcAuthId, const QString& destAuthId, int srcDatumTransform, int destDatumTransform )
 {
+  if ( !mThreadTransforms.hasLocalData() )
+  {
+    ThreadTransforms* threadTransforms = new ThreadTransforms( this );
+    mThreadTransforms.setLocalData( threadTransforms );
+    QMutexLocker locker( &mMutex );
+    mAllThreadTransforms.insert( threadTransforms );
+  }
+  ThreadTransforms* threadTransforms = mThreadTransforms.localData();
+
+  //other threads only touch the transformations of this thread in invalidateCrs()
+  mMutex.lock();
   QList< QgsCoordinateTransform* > values =
-    mTransforms.values( qMakePair( srcAuthId, destAuthId ) );
+    threadTransforms->mTransforms.values( qMakePair( srcAuthId, destAuthId ) );
+  mMutex.unlock();
 
   QList< QgsCoordinateTransform* >::const_iterator valIt = values.constBegin();
   for ( ; valIt != values.constEnd(); ++valIt )
@@ -55,40 +92,59 @@ const QgsCoordinateTransform* QgsCoordinateTransformCache::transform( const QStr
   ct->setSourceDatumTransform( srcDatumTransform );
   ct->setDestinationDatumTransform( destDatumTransform );
   ct->initialise();
-  mTransforms.insertMulti( qMakePair( srcAuthId, destAuthId ), ct );
+
+  QMutexLocker locker( &mMutex );
+  threadTransforms->mTransforms.insertMulti( qMakePair( srcAuthId, destAuthId ), ct );
   return ct;
 }
 
 void QgsCoordinateTransformCache::invalidateCrs( const QString& crsAuthId )
 {
-  //get keys to remove first
-  QHash< QPair< QString, QString >, QgsCoordinateTransform* >::const_iterator it = mTransforms.constBegin();
-  QList< QPair< QString, QString > > updateList;
+  QMutexLocker locker( &mMutex );
 
-  for ( ; it != mTransforms.constEnd(); ++it )
+  QSet< ThreadTransforms* >::const_iterator threadIt = mAllThreadTransforms.constBegin();
+  for ( ; threadIt != mAllThreadTransforms.constEnd(); ++threadIt )
   {
-    if ( it.key().first == crsAuthId || it.key().second == crsAuthId )
+    QMultiHash< QPair< QString, QString >, QgsCoordinateTransform* >& transforms = ( *threadIt )->mTransforms;
+
+    //get keys to remove first
+    QHash< QPair< QString, QString >, QgsCoordinateTransform* >::const_iterator it = transforms.constBegin();
+    QList< QPair< QString, QString > > updateList;
+
+    for ( ; it != transforms.constEnd(); ++it )
     {
-      updateList.append( it.key() );
+      if ( it.key().first == crsAuthId || it.key().second == crsAuthId )
+      {
+        updateList.append( it.key() );
+      }
     }
-  }
 
-  //and remove after
-  QList< QPair< QString, QString > >::const_iterator updateIt = updateList.constBegin();
-  for ( ; updateIt != updateList.constEnd(); ++updateIt )
-  {
-    mTransforms.remove( *updateIt );
+    //and remove after
+    QList< QPair< QString, QString > >::const_iterator updateIt = updateList.constBegin();
+    for ( ; updateIt != updateList.constEnd(); ++updateIt )
+    {
+      qDeleteAll( transforms.values( *updateIt ) );
+      transforms.remove( *updateIt );
+    }
   }
 }
 
 
+struct QgsCRSCache::ThreadCRS
+{
+  ThreadCRS(): generation( 0 ) {}
+  /**Generation of the shared cache the copies were taken from*/
+  int generation;
+  QHash< QString, QgsCoordinateReferenceSystem > crs;
+};
+
 QgsCRSCache* QgsCRSCache::instance()
 {
   static QgsCRSCache mInstance;
   return &mInstance;
 }
 
-QgsCRSCache::QgsCRSCache()
+QgsCRSCache::QgsCRSCache(): mGeneration( 0 )
 {
 }
 
@@ -99,7 +155,10 @@ QgsCRSCache::~QgsCRSCache()
 void QgsCRSCache::updateCRSCache( const QString& authid )
 {
   QgsCoordinateReferenceSystem s;
-  if ( s.createFromOgcWmsCrs( authid ) )
+  bool valid = s.createFromOgcWmsCrs( authid );
+
+  mLock.lockForWrite();
+  if ( valid )
   {
     mCRS.insert( authid, s );
   }
@@ -107,26 +166,68 @@ void QgsCRSCache::updateCRSCache( const QString& authid )
   {
     mCRS.remove( authid );
   }
+  ++mGeneration;
+  mLock.unlock();
 
   QgsCoordinateTransformCache::instance()->invalidateCrs( authid );
 }
 
 const QgsCoordinateReferenceSystem& QgsCRSCache::crsByAuthId( const QString& authid )
 {
-  QHash< QString, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRS.find( authid );
-  if ( crsIt == mCRS.constEnd() )
+  if ( !mThreadCRS.hasLocalData() )
+  {
+    mThreadCRS.setLocalData( new ThreadCRS() );
+  }
+  ThreadCRS* threadCRS = mThreadCRS.localData();
+  QHash< QString, QgsCoordinateReferenceSystem >& threadCopies = threadCRS->crs;
+
+  mLock.lockForRead();
+  if ( threadCRS->generation != mGeneration )
   {
-    QgsCoordinateReferenceSystem s;
-    if ( ! s.createFromOgcWmsCrs( authid ) )
+    //a CRS has been updated. Refresh the copies in place, so that references returned before stay valid
+    QHash< QString, QgsCoordinateReferenceSystem >::iterator copyIt = threadCopies.begin();
+    while ( copyIt != threadCopies.end() )
     {
-      return mInvalidCRS;
+      QHash< QString, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRS.constFind( copyIt.key() );
+      if ( crsIt != mCRS.constEnd() )
+      {
+        copyIt.value() = crsIt.value();
+        ++copyIt;
+      }
+      else
+      {
+        copyIt = threadCopies.erase( copyIt );
+      }
     }
-    return mCRS.insert( authid, s ).value();
+    threadCRS->generation = mGeneration;
   }
-  else
+
+  QHash< QString, QgsCoordinateReferenceSystem >::const_iterator copyIt = threadCopies.constFind( authid );
+  if ( copyIt != threadCopies.constEnd() )
   {
-    return crsIt.value();
+    mLock.unlock();
+    return copyIt.value();
   }
+
+  QHash< QString, QgsCoordinateReferenceSystem >::const_iterator crsIt = mCRS.constFind( authid );
+  if ( crsIt != mCRS.constEnd() )
+  {
+    QHash< QString, QgsCoordinateReferenceSystem >::iterator newCopyIt = threadCopies.insert( authid, crsIt.value() );
+    mLock.unlock();
+    return newCopyIt.value();
+  }
+  mLock.unlock();
+
+  QgsCoordinateReferenceSystem s;
+  if ( ! s.createFromOgcWmsCrs( authid ) )
+  {
+    return mInvalidCRS;
+  }
+
+  mLock.lockForWrite();
+  mCRS.insert( authid, s );
+  mLock.unlock();
+  return threadCopies.insert( authid, s ).value();
 }
 
 const QgsCoordinateReferenceSystem& QgsCRSCache::crsByEpsgId( long epsg )
@@ -20,11 +20,16 @@
 
 #include "qgscoordinatereferencesystem.h"
 #include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QThreadStorage>
 
 class QgsCoordinateTransform;
 
 /**Cache coordinate transform by authid of source/dest transformation to avoid the
-overhead of initialisation for each redraw*/
+overhead of initialisation for each redraw. As proj handles must not be used by several
+threads at once, each thread gets its own transformations. They are deleted when the thread finishes*/
 class CORE_EXPORT QgsCoordinateTransformCache
 {
   public:
@@ -37,30 +42,47 @@ class CORE_EXPORT QgsCoordinateTransformCache
         @param destDatumTransform id of destinations's datum transform
      */
     const QgsCoordinateTransform* transform( const QString& srcAuthId, const QString& destAuthId, int srcDatumTransform = -1, int destDatumTransform = -1 );
-    /**Removes transformations where a changed crs is involved from the cache*/
+    /**Removes and deletes transformations where a changed crs is involved (for all threads).
+      Transformations returned before must not be in use in other threads at that time*/
     void invalidateCrs( const QString& crsAuthId );
 
   private:
-    static QgsCoordinateTransformCache* mInstance;
-    QMultiHash< QPair< QString, QString >, QgsCoordinateTransform* > mTransforms; //same auth_id pairs might have different datum transformations
+    /**Transformations created for one thread*/
+    class ThreadTransforms;
+
+    /**Transformations of the calling thread. QThreadStorage deletes them when the thread finishes*/
+    QThreadStorage< ThreadTransforms* > mThreadTransforms;
+    /**Transformations of all threads, to invalidate them*/
+    QSet< ThreadTransforms* > mAllThreadTransforms;
+    QMutex mMutex;
 };
 
+/**Cache of CRS by authid. The cache is shared between threads, each thread gets references to its own copies*/
 class CORE_EXPORT QgsCRSCache
 {
   public:
     static QgsCRSCache* instance();
     ~QgsCRSCache();
-    /**Returns the CRS for authid, e.g. 'EPSG:4326' (or an invalid CRS in case of error)*/
+    /**Returns the CRS for authid, e.g. 'EPSG:4326' (or an invalid CRS in case of error).
+      The reference stays valid in the calling thread until the CRS is removed with updateCRSCache()*/
     const QgsCoordinateReferenceSystem& crsByAuthId( const QString& authid );
     const QgsCoordinateReferenceSystem& crsByEpsgId( long epsg );
 
+    /**Reloads the CRS of authid from the database and removes transformations involving it from QgsCoordinateTransformCache*/
     void updateCRSCache( const QString &authid );
 
   protected:
     QgsCRSCache();
 
   private:
+    /**Copies of the cached CRS handed out to one thread*/
+    struct ThreadCRS;
+
     QHash< QString, QgsCoordinateReferenceSystem > mCRS;
+    QReadWriteLock mLock;
+    /**Incremented by updateCRSCache() to let the threads refresh their copies*/
+    int mGeneration;
+    QThreadStorage< ThreadCRS* > mThreadCRS;
     /**CRS that is not initialised (returned in case of error)*/
     QgsCoordinateReferenceSystem mInvalidCRS;
 };
@@ -14,6 +14,7 @@
  ***************************************************************************/
 
 #include "qgsexpression.h"
+#include "qgscompiledexpression.h"
 
 #include <QtDebug>
 #include <QDomDocument>
@@ -22,6 +23,11 @@
 #include <QRegExp>
 #include <QColor>
 #include <QUuid>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QSet>
+#include <QThreadStorage>
 
 #include <math.h>
 #include <limits>
@@ -198,8 +204,8 @@ inline bool isNull( const QVariant& v ) { return v.isNull(); }
 ///////////////////////////////////////////////
 // evaluation error macros
 
-#define ENSURE_NO_EVAL_ERROR   {  if (parent->hasEvalError()) return QVariant(); }
-#define SET_EVAL_ERROR(x)   { parent->setEvalErrorString(x); return QVariant(); }
+#define ENSURE_NO_EVAL_ERROR   {  if (context->hasEvalError()) return QVariant(); }
+#define SET_EVAL_ERROR(x)   { context->setEvalErrorString(x); return QVariant(); }
 
 ///////////////////////////////////////////////
 // operators
@@ -221,24 +227,24 @@ const char* QgsExpression::UnaryOperatorText[] =
 // functions
 
 // implicit conversion to string
-static QString getStringValue( const QVariant& value, QgsExpression* )
+static QString getStringValue( const QVariant& value, QgsExpressionContext* )
 {
   return value.toString();
 }
 
-static double getDoubleValue( const QVariant& value, QgsExpression* parent )
+static double getDoubleValue( const QVariant& value, QgsExpressionContext* context )
 {
   bool ok;
   double x = value.toDouble( &ok );
   if ( !ok )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1' to double" ).arg( value.toString() ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1' to double" ).arg( value.toString() ) );
     return 0;
   }
   return x;
 }
 
-static int getIntValue( const QVariant& value, QgsExpression* parent )
+static int getIntValue( const QVariant& value, QgsExpressionContext* context )
 {
   bool ok;
   qint64 x = value.toLongLong( &ok );
@@ -248,12 +254,12 @@ static int getIntValue( const QVariant& value, QgsExpression* parent )
   }
   else
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1' to int" ).arg( value.toString() ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1' to int" ).arg( value.toString() ) );
     return 0;
   }
 }
 
-static QDateTime getDateTimeValue( const QVariant& value, QgsExpression* parent )
+static QDateTime getDateTimeValue( const QVariant& value, QgsExpressionContext* context )
 {
   QDateTime d = value.toDateTime();
   if ( d.isValid() )
@@ -262,12 +268,12 @@ static QDateTime getDateTimeValue( const QVariant& value, QgsExpression* parent
   }
   else
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1' to DateTime" ).arg( value.toString() ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1' to DateTime" ).arg( value.toString() ) );
     return QDateTime();
   }
 }
 
-static QDate getDateValue( const QVariant& value, QgsExpression* parent )
+static QDate getDateValue( const QVariant& value, QgsExpressionContext* context )
 {
   QDate d = value.toDate();
   if ( d.isValid() )
@@ -276,12 +282,12 @@ static QDate getDateValue( const QVariant& value, QgsExpression* parent )
   }
   else
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1' to Date" ).arg( value.toString() ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1' to Date" ).arg( value.toString() ) );
     return QDate();
   }
 }
 
-static QTime getTimeValue( const QVariant& value, QgsExpression* parent )
+static QTime getTimeValue( const QVariant& value, QgsExpressionContext* context )
 {
   QTime t = value.toTime();
   if ( t.isValid() )
@@ -290,12 +296,12 @@ static QTime getTimeValue( const QVariant& value, QgsExpression* parent )
   }
   else
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1' to Time" ).arg( value.toString() ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1' to Time" ).arg( value.toString() ) );
     return QTime();
   }
 }
 
-static QgsExpression::Interval getInterval( const QVariant& value, QgsExpression* parent, bool report_error = false )
+static QgsExpression::Interval getInterval( const QVariant& value, QgsExpressionContext* context, bool report_error = false )
 {
   if ( value.canConvert<QgsExpression::Interval>() )
     return value.value<QgsExpression::Interval>();
@@ -307,22 +313,22 @@ static QgsExpression::Interval getInterval( const QVariant& value, QgsExpression
   }
   // If we get here then we can't convert so we just error and return invalid.
   if ( report_error )
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1' to Interval" ).arg( value.toString() ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1' to Interval" ).arg( value.toString() ) );
 
   return QgsExpression::Interval::invalidInterVal();
 }
-static QgsGeometry getGeometry( const QVariant& value, QgsExpression* parent )
+static QgsGeometry getGeometry( const QVariant& value, QgsExpressionContext* context )
 {
   if ( value.canConvert<QgsGeometry>() )
     return value.value<QgsGeometry>();
 
-  parent->setEvalErrorString( "Cannot convert to QgsGeometry" );
+  context->setEvalErrorString( "Cannot convert to QgsGeometry" );
   return QgsGeometry();
 }
 
 
 // this handles also NULL values
-static TVL getTVLValue( const QVariant& value, QgsExpression* parent )
+static TVL getTVLValue( const QVariant& value, QgsExpressionContext* context )
 {
   // we need to convert to TVL
   if ( value.isNull() )
@@ -335,7 +341,7 @@ static TVL getTVLValue( const QVariant& value, QgsExpression* parent )
   double x = value.toDouble( &ok );
   if ( !ok )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1' to boolean" ).arg( value.toString() ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1' to boolean" ).arg( value.toString() ) );
     return Unknown;
   }
   return x != 0 ? True : False;
@@ -343,85 +349,85 @@ static TVL getTVLValue( const QVariant& value, QgsExpression* parent )
 
 //////
 
-static QVariant fcnSqrt( const QVariantList& values, const QgsFeature* /*f*/, QgsExpression* parent )
+static QVariant fcnSqrt( const QVariantList& values, const QgsFeature* /*f*/, QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( sqrt( x ) );
 }
 
-static QVariant fcnAbs( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnAbs( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
-  double val = getDoubleValue( values.at( 0 ), parent );
+  double val = getDoubleValue( values.at( 0 ), context );
   return QVariant( fabs( val ) );
 }
 
-static QVariant fcnSin( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnSin( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( sin( x ) );
 }
-static QVariant fcnCos( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnCos( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( cos( x ) );
 }
-static QVariant fcnTan( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnTan( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( tan( x ) );
 }
-static QVariant fcnAsin( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnAsin( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( asin( x ) );
 }
-static QVariant fcnAcos( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnAcos( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( acos( x ) );
 }
-static QVariant fcnAtan( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnAtan( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( atan( x ) );
 }
-static QVariant fcnAtan2( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnAtan2( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double y = getDoubleValue( values.at( 0 ), parent );
-  double x = getDoubleValue( values.at( 1 ), parent );
+  double y = getDoubleValue( values.at( 0 ), context );
+  double x = getDoubleValue( values.at( 1 ), context );
   return QVariant( atan2( y, x ) );
 }
-static QVariant fcnExp( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnExp( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( exp( x ) );
 }
-static QVariant fcnLn( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnLn( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   if ( x <= 0 )
     return QVariant();
   return QVariant( log( x ) );
 }
-static QVariant fcnLog10( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnLog10( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   if ( x <= 0 )
     return QVariant();
   return QVariant( log10( x ) );
 }
-static QVariant fcnLog( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnLog( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double b = getDoubleValue( values.at( 0 ), parent );
-  double x = getDoubleValue( values.at( 1 ), parent );
+  double b = getDoubleValue( values.at( 0 ), context );
+  double x = getDoubleValue( values.at( 1 ), context );
   if ( x <= 0 || b <= 0 )
     return QVariant();
   return QVariant( log( x ) / log( b ) );
 }
-static QVariant fcnRndF( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnRndF( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double min = getDoubleValue( values.at( 0 ), parent );
-  double max = getDoubleValue( values.at( 1 ), parent );
+  double min = getDoubleValue( values.at( 0 ), context );
+  double max = getDoubleValue( values.at( 1 ), context );
   if ( max < min )
     return QVariant();
 
@@ -429,10 +435,10 @@ static QVariant fcnRndF( const QVariantList& values, const QgsFeature* , QgsExpr
   double f = ( double )rand() / RAND_MAX;
   return QVariant( min + f * ( max - min ) ) ;
 }
-static QVariant fcnRnd( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnRnd( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  int min = getIntValue( values.at( 0 ), parent );
-  int max = getIntValue( values.at( 1 ), parent );
+  int min = getIntValue( values.at( 0 ), context );
+  int max = getIntValue( values.at( 1 ), context );
   if ( max < min )
     return QVariant();
 
@@ -440,17 +446,17 @@ static QVariant fcnRnd( const QVariantList& values, const QgsFeature* , QgsExpre
   return QVariant( min + ( rand() % ( int )( max - min + 1 ) ) );
 }
 
-static QVariant fcnLinearScale( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnLinearScale( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double val = getDoubleValue( values.at( 0 ), parent );
-  double domainMin = getDoubleValue( values.at( 1 ), parent );
-  double domainMax = getDoubleValue( values.at( 2 ), parent );
-  double rangeMin = getDoubleValue( values.at( 3 ), parent );
-  double rangeMax = getDoubleValue( values.at( 4 ), parent );
+  double val = getDoubleValue( values.at( 0 ), context );
+  double domainMin = getDoubleValue( values.at( 1 ), context );
+  double domainMax = getDoubleValue( values.at( 2 ), context );
+  double rangeMin = getDoubleValue( values.at( 3 ), context );
+  double rangeMax = getDoubleValue( values.at( 4 ), context );
 
   if ( domainMin >= domainMax )
   {
-    parent->setEvalErrorString( QObject::tr( "Domain max must be greater than domain min" ) );
+    context->setEvalErrorString( QObject::tr( "Domain max must be greater than domain min" ) );
     return QVariant();
   }
 
@@ -472,23 +478,23 @@ static QVariant fcnLinearScale( const QVariantList& values, const QgsFeature* ,
   return QVariant( m * val + c );
 }
 
-static QVariant fcnExpScale( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnExpScale( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double val = getDoubleValue( values.at( 0 ), parent );
-  double domainMin = getDoubleValue( values.at( 1 ), parent );
-  double domainMax = getDoubleValue( values.at( 2 ), parent );
-  double rangeMin = getDoubleValue( values.at( 3 ), parent );
-  double rangeMax = getDoubleValue( values.at( 4 ), parent );
-  double exponent = getDoubleValue( values.at( 5 ), parent );
+  double val = getDoubleValue( values.at( 0 ), context );
+  double domainMin = getDoubleValue( values.at( 1 ), context );
+  double domainMax = getDoubleValue( values.at( 2 ), context );
+  double rangeMin = getDoubleValue( values.at( 3 ), context );
+  double rangeMax = getDoubleValue( values.at( 4 ), context );
+  double exponent = getDoubleValue( values.at( 5 ), context );
 
   if ( domainMin >= domainMax )
   {
-    parent->setEvalErrorString( QObject::tr( "Domain max must be greater than domain min" ) );
+    context->setEvalErrorString( QObject::tr( "Domain max must be greater than domain min" ) );
     return QVariant();
   }
   if ( exponent <= 0 )
   {
-    parent->setEvalErrorString( QObject::tr( "Exponent must be greater than 0" ) );
+    context->setEvalErrorString( QObject::tr( "Exponent must be greater than 0" ) );
     return QVariant();
   }
 
@@ -506,15 +512,15 @@ static QVariant fcnExpScale( const QVariantList& values, const QgsFeature* , Qgs
   return QVariant((( rangeMax - rangeMin ) / pow( domainMax - domainMin, exponent ) ) * pow( val - domainMin, exponent ) + rangeMin );
 }
 
-static QVariant fcnMax( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnMax( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   //initially set max as first value
-  double maxVal = getDoubleValue( values.at( 0 ), parent );
+  double maxVal = getDoubleValue( values.at( 0 ), context );
 
   //check against all other values
   for ( int i = 1; i < values.length(); ++i )
   {
-    double testVal = getDoubleValue( values[i], parent );
+    double testVal = getDoubleValue( values[i], context );
     if ( testVal > maxVal )
     {
       maxVal = testVal;
@@ -524,15 +530,15 @@ static QVariant fcnMax( const QVariantList& values, const QgsFeature* , QgsExpre
   return QVariant( maxVal );
 }
 
-static QVariant fcnMin( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnMin( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   //initially set min as first value
-  double minVal = getDoubleValue( values.at( 0 ), parent );
+  double minVal = getDoubleValue( values.at( 0 ), context );
 
   //check against all other values
   for ( int i = 1; i < values.length(); ++i )
   {
-    double testVal = getDoubleValue( values[i], parent );
+    double testVal = getDoubleValue( values[i], context );
     if ( testVal < minVal )
     {
       minVal = testVal;
@@ -542,11 +548,11 @@ static QVariant fcnMin( const QVariantList& values, const QgsFeature* , QgsExpre
   return QVariant( minVal );
 }
 
-static QVariant fcnClamp( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnClamp( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double minValue = getDoubleValue( values.at( 0 ), parent );
-  double testValue = getDoubleValue( values.at( 1 ), parent );
-  double maxValue = getDoubleValue( values.at( 2 ), parent );
+  double minValue = getDoubleValue( values.at( 0 ), context );
+  double testValue = getDoubleValue( values.at( 1 ), context );
+  double maxValue = getDoubleValue( values.at( 2 ), context );
 
   // force testValue to sit inside the range specified by the min and max value
   if ( testValue <= minValue )
@@ -563,37 +569,37 @@ static QVariant fcnClamp( const QVariantList& values, const QgsFeature* , QgsExp
   }
 }
 
-static QVariant fcnFloor( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnFloor( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( floor( x ) );
 }
 
-static QVariant fcnCeil( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnCeil( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  double x = getDoubleValue( values.at( 0 ), parent );
+  double x = getDoubleValue( values.at( 0 ), context );
   return QVariant( ceil( x ) );
 }
 
-static QVariant fcnToInt( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnToInt( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant( getIntValue( values.at( 0 ), parent ) );
+  return QVariant( getIntValue( values.at( 0 ), context ) );
 }
-static QVariant fcnToReal( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnToReal( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant( getDoubleValue( values.at( 0 ), parent ) );
+  return QVariant( getDoubleValue( values.at( 0 ), context ) );
 }
-static QVariant fcnToString( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnToString( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant( getStringValue( values.at( 0 ), parent ) );
+  return QVariant( getStringValue( values.at( 0 ), context ) );
 }
 
-static QVariant fcnToDateTime( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnToDateTime( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant( getDateTimeValue( values.at( 0 ), parent ) );
+  return QVariant( getDateTimeValue( values.at( 0 ), context ) );
 }
 
-static QVariant fcnCoalesce( const QVariantList& values, const QgsFeature* , QgsExpression* )
+static QVariant fcnCoalesce( const QVariantList& values, const QgsFeature* , QgsExpressionContext* )
 {
   foreach ( const QVariant &value, values )
   {
@@ -603,19 +609,19 @@ static QVariant fcnCoalesce( const QVariantList& values, const QgsFeature* , Qgs
   }
   return QVariant();
 }
-static QVariant fcnLower( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnLower( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
   return QVariant( str.toLower() );
 }
-static QVariant fcnUpper( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnUpper( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
   return QVariant( str.toUpper() );
 }
-static QVariant fcnTitle( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnTitle( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
   QStringList elems = str.split( " " );
   for ( int i = 0; i < elems.size(); i++ )
   {
@@ -625,62 +631,62 @@ static QVariant fcnTitle( const QVariantList& values, const QgsFeature* , QgsExp
   return QVariant( elems.join( " " ) );
 }
 
-static QVariant fcnTrim( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnTrim( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
   return QVariant( str.trimmed() );
 }
 
-static QVariant fcnLength( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnLength( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
   return QVariant( str.length() );
 }
-static QVariant fcnReplace( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnReplace( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
-  QString before = getStringValue( values.at( 1 ), parent );
-  QString after = getStringValue( values.at( 2 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
+  QString before = getStringValue( values.at( 1 ), context );
+  QString after = getStringValue( values.at( 2 ), context );
   return QVariant( str.replace( before, after ) );
 }
-static QVariant fcnRegexpReplace( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnRegexpReplace( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
-  QString regexp = getStringValue( values.at( 1 ), parent );
-  QString after = getStringValue( values.at( 2 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
+  QString regexp = getStringValue( values.at( 1 ), context );
+  QString after = getStringValue( values.at( 2 ), context );
 
   QRegExp re( regexp );
   if ( !re.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Invalid regular expression '%1': %2" ).arg( regexp ).arg( re.errorString() ) );
+    context->setEvalErrorString( QObject::tr( "Invalid regular expression '%1': %2" ).arg( regexp ).arg( re.errorString() ) );
     return QVariant();
   }
   return QVariant( str.replace( re, after ) );
 }
 
-static QVariant fcnRegexpMatch( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnRegexpMatch( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
-  QString regexp = getStringValue( values.at( 1 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
+  QString regexp = getStringValue( values.at( 1 ), context );
 
   QRegExp re( regexp );
   if ( !re.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Invalid regular expression '%1': %2" ).arg( regexp ).arg( re.errorString() ) );
+    context->setEvalErrorString( QObject::tr( "Invalid regular expression '%1': %2" ).arg( regexp ).arg( re.errorString() ) );
     return QVariant();
   }
   return QVariant( str.contains( re ) ? 1 : 0 );
 }
 
-static QVariant fcnRegexpSubstr( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnRegexpSubstr( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
-  QString regexp = getStringValue( values.at( 1 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
+  QString regexp = getStringValue( values.at( 1 ), context );
 
   QRegExp re( regexp );
   if ( !re.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Invalid regular expression '%1': %2" ).arg( regexp ).arg( re.errorString() ) );
+    context->setEvalErrorString( QObject::tr( "Invalid regular expression '%1': %2" ).arg( regexp ).arg( re.errorString() ) );
     return QVariant();
   }
 
@@ -697,216 +703,216 @@ static QVariant fcnRegexpSubstr( const QVariantList& values, const QgsFeature* ,
   }
 }
 
-static QVariant fcnUuid( const QVariantList&, const QgsFeature* , QgsExpression* )
+static QVariant fcnUuid( const QVariantList&, const QgsFeature* , QgsExpressionContext* )
 {
   return QUuid::createUuid().toString();
 }
 
-static QVariant fcnSubstr( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnSubstr( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString str = getStringValue( values.at( 0 ), parent );
-  int from = getIntValue( values.at( 1 ), parent );
-  int len = getIntValue( values.at( 2 ), parent );
+  QString str = getStringValue( values.at( 0 ), context );
+  int from = getIntValue( values.at( 1 ), context );
+  int len = getIntValue( values.at( 2 ), context );
   return QVariant( str.mid( from -1, len ) );
 }
 
-static QVariant fcnRowNumber( const QVariantList& , const QgsFeature* , QgsExpression* parent )
+static QVariant fcnRowNumber( const QVariantList& , const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant( parent->currentRowNumber() );
+  return QVariant( context->currentRowNumber() );
 }
 
-static QVariant fcnFeatureId( const QVariantList& , const QgsFeature* f, QgsExpression* )
+static QVariant fcnFeatureId( const QVariantList& , const QgsFeature* f, QgsExpressionContext* )
 {
   // TODO: handling of 64-bit feature ids?
   return f ? QVariant(( int )f->id() ) : QVariant();
 }
 
-static QVariant fcnConcat( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnConcat( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QString concat;
   foreach ( const QVariant &value, values )
   {
-    concat += getStringValue( value, parent );
+    concat += getStringValue( value, context );
   }
   return concat;
 }
 
-static QVariant fcnStrpos( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnStrpos( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString string = getStringValue( values.at( 0 ), parent );
-  return string.indexOf( QRegExp( getStringValue( values.at( 1 ), parent ) ) );
+  QString string = getStringValue( values.at( 0 ), context );
+  return string.indexOf( QRegExp( getStringValue( values.at( 1 ), context ) ) );
 }
 
-static QVariant fcnRight( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnRight( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString string = getStringValue( values.at( 0 ), parent );
-  int pos = getIntValue( values.at( 1 ), parent );
+  QString string = getStringValue( values.at( 0 ), context );
+  int pos = getIntValue( values.at( 1 ), context );
   return string.right( pos );
 }
 
-static QVariant fcnLeft( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnLeft( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString string = getStringValue( values.at( 0 ), parent );
-  int pos = getIntValue( values.at( 1 ), parent );
+  QString string = getStringValue( values.at( 0 ), context );
+  int pos = getIntValue( values.at( 1 ), context );
   return string.left( pos );
 }
 
-static QVariant fcnRPad( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnRPad( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString string = getStringValue( values.at( 0 ), parent );
-  int length = getIntValue( values.at( 1 ), parent );
-  QString fill = getStringValue( values.at( 2 ), parent );
+  QString string = getStringValue( values.at( 0 ), context );
+  int length = getIntValue( values.at( 1 ), context );
+  QString fill = getStringValue( values.at( 2 ), context );
   return string.leftJustified( length, fill.at( 0 ), true );
 }
 
-static QVariant fcnLPad( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnLPad( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString string = getStringValue( values.at( 0 ), parent );
-  int length = getIntValue( values.at( 1 ), parent );
-  QString fill = getStringValue( values.at( 2 ), parent );
+  QString string = getStringValue( values.at( 0 ), context );
+  int length = getIntValue( values.at( 1 ), context );
+  QString fill = getStringValue( values.at( 2 ), context );
   return string.rightJustified( length, fill.at( 0 ), true );
 }
 
-static QVariant fcnFormatString( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnFormatString( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QString string = getStringValue( values.at( 0 ), parent );
+  QString string = getStringValue( values.at( 0 ), context );
   for ( int n = 1; n < values.length(); n++ )
   {
-    string = string.arg( getStringValue( values.at( n ), parent ) );
+    string = string.arg( getStringValue( values.at( n ), context ) );
   }
   return string;
 }
 
 
-static QVariant fcnNow( const QVariantList&, const QgsFeature* , QgsExpression * )
+static QVariant fcnNow( const QVariantList&, const QgsFeature* , QgsExpressionContext* )
 {
   return QVariant( QDateTime::currentDateTime() );
 }
 
-static QVariant fcnToDate( const QVariantList& values, const QgsFeature* , QgsExpression * parent )
+static QVariant fcnToDate( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant( getDateValue( values.at( 0 ), parent ) );
+  return QVariant( getDateValue( values.at( 0 ), context ) );
 }
 
-static QVariant fcnToTime( const QVariantList& values, const QgsFeature* , QgsExpression * parent )
+static QVariant fcnToTime( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant( getTimeValue( values.at( 0 ), parent ) );
+  return QVariant( getTimeValue( values.at( 0 ), context ) );
 }
 
-static QVariant fcnToInterval( const QVariantList& values, const QgsFeature* , QgsExpression * parent )
+static QVariant fcnToInterval( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  return QVariant::fromValue( getInterval( values.at( 0 ), parent ) );
+  return QVariant::fromValue( getInterval( values.at( 0 ), context ) );
 }
 
-static QVariant fcnAge( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnAge( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QDateTime d1 = getDateTimeValue( values.at( 0 ), parent );
-  QDateTime d2 = getDateTimeValue( values.at( 1 ), parent );
+  QDateTime d1 = getDateTimeValue( values.at( 0 ), context );
+  QDateTime d2 = getDateTimeValue( values.at( 1 ), context );
   int seconds = d2.secsTo( d1 );
   return QVariant::fromValue( QgsExpression::Interval( seconds ) );
 }
 
-static QVariant fcnDay( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnDay( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QVariant value = values.at( 0 );
-  QgsExpression::Interval inter = getInterval( value, parent, false );
+  QgsExpression::Interval inter = getInterval( value, context, false );
   if ( inter.isValid() )
   {
     return QVariant( inter.days() );
   }
   else
   {
-    QDateTime d1 =  getDateTimeValue( value, parent );
+    QDateTime d1 =  getDateTimeValue( value, context );
     return QVariant( d1.date().day() );
   }
 }
 
-static QVariant fcnYear( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnYear( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QVariant value = values.at( 0 );
-  QgsExpression::Interval inter = getInterval( value, parent, false );
+  QgsExpression::Interval inter = getInterval( value, context, false );
   if ( inter.isValid() )
   {
     return QVariant( inter.years() );
   }
   else
   {
-    QDateTime d1 =  getDateTimeValue( value, parent );
+    QDateTime d1 =  getDateTimeValue( value, context );
     return QVariant( d1.date().year() );
   }
 }
 
-static QVariant fcnMonth( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnMonth( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QVariant value = values.at( 0 );
-  QgsExpression::Interval inter = getInterval( value, parent, false );
+  QgsExpression::Interval inter = getInterval( value, context, false );
   if ( inter.isValid() )
   {
     return QVariant( inter.months() );
   }
   else
   {
-    QDateTime d1 =  getDateTimeValue( value, parent );
+    QDateTime d1 =  getDateTimeValue( value, context );
     return QVariant( d1.date().month() );
   }
 }
 
-static QVariant fcnWeek( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnWeek( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QVariant value = values.at( 0 );
-  QgsExpression::Interval inter = getInterval( value, parent, false );
+  QgsExpression::Interval inter = getInterval( value, context, false );
   if ( inter.isValid() )
   {
     return QVariant( inter.weeks() );
   }
   else
   {
-    QDateTime d1 =  getDateTimeValue( value, parent );
+    QDateTime d1 =  getDateTimeValue( value, context );
     return QVariant( d1.date().weekNumber() );
   }
 }
 
-static QVariant fcnHour( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnHour( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QVariant value = values.at( 0 );
-  QgsExpression::Interval inter = getInterval( value, parent, false );
+  QgsExpression::Interval inter = getInterval( value, context, false );
   if ( inter.isValid() )
   {
     return QVariant( inter.hours() );
   }
   else
   {
-    QDateTime d1 =  getDateTimeValue( value, parent );
+    QDateTime d1 =  getDateTimeValue( value, context );
     return QVariant( d1.time().hour() );
   }
 }
 
-static QVariant fcnMinute( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnMinute( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QVariant value = values.at( 0 );
-  QgsExpression::Interval inter = getInterval( value, parent, false );
+  QgsExpression::Interval inter = getInterval( value, context, false );
   if ( inter.isValid() )
   {
     return QVariant( inter.minutes() );
   }
   else
   {
-    QDateTime d1 =  getDateTimeValue( value, parent );
+    QDateTime d1 =  getDateTimeValue( value, context );
     return QVariant( d1.time().minute() );
   }
 }
 
-static QVariant fcnSeconds( const QVariantList& values, const QgsFeature* , QgsExpression *parent )
+static QVariant fcnSeconds( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
   QVariant value = values.at( 0 );
-  QgsExpression::Interval inter = getInterval( value, parent, false );
+  QgsExpression::Interval inter = getInterval( value, context, false );
   if ( inter.isValid() )
   {
     return QVariant( inter.seconds() );
   }
   else
   {
-    QDateTime d1 =  getDateTimeValue( value, parent );
+    QDateTime d1 =  getDateTimeValue( value, context );
     return QVariant( d1.time().second() );
   }
 }
@@ -917,7 +923,7 @@ static QVariant fcnSeconds( const QVariantList& values, const QgsFeature* , QgsE
   if (!g || g->type() != geomtype) return QVariant();
 
 
-static QVariant fcnX( const QVariantList& , const QgsFeature* f, QgsExpression* )
+static QVariant fcnX( const QVariantList& , const QgsFeature* f, QgsExpressionContext* )
 {
   ENSURE_GEOM_TYPE( f, g, QGis::Point );
   if ( g->isMultipart() )
@@ -929,7 +935,7 @@ static QVariant fcnX( const QVariantList& , const QgsFeature* f, QgsExpression*
     return g->asPoint().x();
   }
 }
-static QVariant fcnY( const QVariantList& , const QgsFeature* f, QgsExpression* )
+static QVariant fcnY( const QVariantList& , const QgsFeature* f, QgsExpressionContext* )
 {
   ENSURE_GEOM_TYPE( f, g, QGis::Point );
   if ( g->isMultipart() )
@@ -942,9 +948,9 @@ static QVariant fcnY( const QVariantList& , const QgsFeature* f, QgsExpression*
   }
 }
 
-static QVariant pointAt( const QVariantList& values, const QgsFeature* f, QgsExpression* parent ) // helper function
+static QVariant pointAt( const QVariantList& values, const QgsFeature* f, QgsExpressionContext* context ) // helper function
 {
-  int idx = getIntValue( values.at( 0 ), parent );
+  int idx = getIntValue( values.at( 0 ), context );
   ENSURE_GEOM_TYPE( f, g, QGis::Line );
   QgsPolyline polyline = g->asPolyline();
   if ( idx < 0 )
@@ -952,29 +958,29 @@ static QVariant pointAt( const QVariantList& values, const QgsFeature* f, QgsExp
 
   if ( idx < 0 || idx >= polyline.count() )
   {
-    parent->setEvalErrorString( QObject::tr( "Index is out of range" ) );
+    context->setEvalErrorString( QObject::tr( "Index is out of range" ) );
     return QVariant();
   }
   return QVariant( QPointF( polyline[idx].x(), polyline[idx].y() ) );
 }
 
-static QVariant fcnXat( const QVariantList& values, const QgsFeature* f, QgsExpression* parent )
+static QVariant fcnXat( const QVariantList& values, const QgsFeature* f, QgsExpressionContext* context )
 {
-  QVariant v = pointAt( values, f, parent );
+  QVariant v = pointAt( values, f, context );
   if ( v.type() == QVariant::PointF )
     return QVariant( v.toPointF().x() );
   else
     return QVariant();
 }
-static QVariant fcnYat( const QVariantList& values, const QgsFeature* f, QgsExpression* parent )
+static QVariant fcnYat( const QVariantList& values, const QgsFeature* f, QgsExpressionContext* context )
 {
-  QVariant v = pointAt( values, f, parent );
+  QVariant v = pointAt( values, f, context );
   if ( v.type() == QVariant::PointF )
     return QVariant( v.toPointF().y() );
   else
     return QVariant();
 }
-static QVariant fcnGeometry( const QVariantList& , const QgsFeature* f, QgsExpression* )
+static QVariant fcnGeometry( const QVariantList& , const QgsFeature* f, QgsExpressionContext* )
 {
   QgsGeometry* geom = f ? f->geometry() : 0;
   if ( geom )
@@ -982,18 +988,18 @@ static QVariant fcnGeometry( const QVariantList& , const QgsFeature* f, QgsExpre
   else
     return QVariant();
 }
-static QVariant fcnGeomFromWKT( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnGeomFromWKT( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
-  QString wkt = getStringValue( values.at( 0 ), parent );
+  QString wkt = getStringValue( values.at( 0 ), context );
   QgsGeometry* geom = QgsGeometry::fromWkt( wkt );
   if ( geom )
     return QVariant::fromValue( *geom );
   else
     return QVariant();
 }
-static QVariant fcnGeomFromGML( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnGeomFromGML( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
-  QString gml = getStringValue( values.at( 0 ), parent );
+  QString gml = getStringValue( values.at( 0 ), context );
   QgsGeometry* geom = QgsOgcUtils::geometryFromGML( gml );
 
   if ( geom )
@@ -1002,376 +1008,382 @@ static QVariant fcnGeomFromGML( const QVariantList& values, const QgsFeature*, Q
     return QVariant();
 }
 
-static QVariant fcnGeomArea( const QVariantList& , const QgsFeature* f, QgsExpression* parent )
+static QVariant fcnGeomArea( const QVariantList& , const QgsFeature* f, QgsExpressionContext* context )
 {
   ENSURE_GEOM_TYPE( f, g, QGis::Polygon );
-  QgsDistanceArea* calc = parent->geomCalculator();
+  QgsDistanceArea* calc = context->geomCalculator();
   return QVariant( calc->measure( f->geometry() ) );
 }
-static QVariant fcnGeomLength( const QVariantList& , const QgsFeature* f, QgsExpression* parent )
+static QVariant fcnGeomLength( const QVariantList& , const QgsFeature* f, QgsExpressionContext* context )
 {
   ENSURE_GEOM_TYPE( f, g, QGis::Line );
-  QgsDistanceArea* calc = parent->geomCalculator();
+  QgsDistanceArea* calc = context->geomCalculator();
   return QVariant( calc->measure( f->geometry() ) );
 }
-static QVariant fcnGeomPerimeter( const QVariantList& , const QgsFeature* f, QgsExpression* parent )
+static QVariant fcnGeomPerimeter( const QVariantList& , const QgsFeature* f, QgsExpressionContext* context )
 {
   ENSURE_GEOM_TYPE( f, g, QGis::Polygon );
-  QgsDistanceArea* calc = parent->geomCalculator();
+  QgsDistanceArea* calc = context->geomCalculator();
   return QVariant( calc->measurePerimeter( f->geometry() ) );
 }
 
-static QVariant fcnBbox( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnBbox( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.intersects( sGeom.boundingBox() ) ? TVL_True : TVL_False;
 }
-static QVariant fcnDisjoint( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnDisjoint( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.disjoint( &sGeom ) ? TVL_True : TVL_False;
 }
-static QVariant fcnIntersects( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnIntersects( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.intersects( &sGeom ) ? TVL_True : TVL_False;
 }
-static QVariant fcnTouches( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnTouches( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.touches( &sGeom ) ? TVL_True : TVL_False;
 }
-static QVariant fcnCrosses( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnCrosses( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.crosses( &sGeom ) ? TVL_True : TVL_False;
 }
-static QVariant fcnContains( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnContains( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.contains( &sGeom ) ? TVL_True : TVL_False;
 }
-static QVariant fcnOverlaps( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnOverlaps( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.overlaps( &sGeom ) ? TVL_True : TVL_False;
 }
-static QVariant fcnWithin( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnWithin( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return fGeom.within( &sGeom ) ? TVL_True : TVL_False;
 }
-static QVariant fcnBuffer( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnBuffer( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
   if ( values.length() < 2 || values.length() > 3 )
     return QVariant();
 
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  double dist = getDoubleValue( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  double dist = getDoubleValue( values.at( 1 ), context );
   int seg = 8;
   if ( values.length() == 3 )
-    seg = getIntValue( values.at( 2 ), parent );
+    seg = getIntValue( values.at( 2 ), context );
 
   QgsGeometry* geom = fGeom.buffer( dist, seg );
   if ( geom )
     return QVariant::fromValue( *geom );
   return QVariant();
 }
-static QVariant fcnCentroid( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnCentroid( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
   QgsGeometry* geom = fGeom.centroid();
   if ( geom )
     return QVariant::fromValue( *geom );
   return QVariant();
 }
-static QVariant fcnConvexHull( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnConvexHull( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
   QgsGeometry* geom = fGeom.convexHull();
   if ( geom )
     return QVariant::fromValue( *geom );
   return QVariant();
 }
-static QVariant fcnDifference( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnDifference( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   QgsGeometry* geom = fGeom.difference( &sGeom );
   if ( geom )
     return QVariant::fromValue( *geom );
   return QVariant();
 }
-static QVariant fcnDistance( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnDistance( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   return QVariant( fGeom.distance( sGeom ) );
 }
-static QVariant fcnIntersection( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnIntersection( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   QgsGeometry* geom = fGeom.intersection( &sGeom );
   if ( geom )
     return QVariant::fromValue( *geom );
   return QVariant();
 }
-static QVariant fcnSymDifference( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnSymDifference( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   QgsGeometry* geom = fGeom.symDifference( &sGeom );
   if ( geom )
     return QVariant::fromValue( *geom );
   return QVariant();
 }
-static QVariant fcnCombine( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnCombine( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
-  QgsGeometry sGeom = getGeometry( values.at( 1 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
+  QgsGeometry sGeom = getGeometry( values.at( 1 ), context );
   QgsGeometry* geom = fGeom.combine( &sGeom );
   if ( geom )
     return QVariant::fromValue( *geom );
   return QVariant();
 }
-static QVariant fcnGeomToWKT( const QVariantList& values, const QgsFeature* , QgsExpression* parent )
+static QVariant fcnGeomToWKT( const QVariantList& values, const QgsFeature* , QgsExpressionContext* context )
 {
-  QgsGeometry fGeom = getGeometry( values.at( 0 ), parent );
+  QgsGeometry fGeom = getGeometry( values.at( 0 ), context );
   QString wkt = fGeom.exportToWkt();
   return QVariant( wkt );
 }
 
-static QVariant fcnRound( const QVariantList& values , const QgsFeature *f, QgsExpression* parent )
+static QVariant fcnRound( const QVariantList& values , const QgsFeature *f, QgsExpressionContext* context )
 {
   Q_UNUSED( f );
   if ( values.length() == 2 )
   {
-    double number = getDoubleValue( values.at( 0 ), parent );
-    double scaler = pow( 10.0, getIntValue( values.at( 1 ), parent ) );
+    double number = getDoubleValue( values.at( 0 ), context );
+    double scaler = pow( 10.0, getIntValue( values.at( 1 ), context ) );
     return QVariant( qRound( number * scaler ) / scaler );
   }
 
   if ( values.length() == 1 )
   {
-    double number = getIntValue( values.at( 0 ), parent );
+    double number = getIntValue( values.at( 0 ), context );
     return QVariant( qRound( number ) ).toInt();
   }
 
   return QVariant();
 }
 
-static QVariant fcnPi( const QVariantList& values , const QgsFeature *f, QgsExpression* parent )
+static QVariant fcnPi( const QVariantList& values , const QgsFeature *f, QgsExpressionContext* context )
 {
   Q_UNUSED( values );
   Q_UNUSED( f );
-  Q_UNUSED( parent );
+  Q_UNUSED( context );
   return M_PI;
 }
 
-static QVariant fcnScale( const QVariantList&, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnScale( const QVariantList&, const QgsFeature*, QgsExpressionContext* context )
 {
-  return QVariant( parent->scale() );
+  return QVariant( context->scale() );
 }
 
-static QVariant fcnFormatNumber( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnFormatNumber( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
-  double value = getDoubleValue( values.at( 0 ), parent );
-  int places = getIntValue( values.at( 1 ), parent );
+  double value = getDoubleValue( values.at( 0 ), context );
+  int places = getIntValue( values.at( 1 ), context );
   return QString( "%L1" ).arg( value, 0, 'f', places );
 }
 
-static QVariant fcnFormatDate( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+static QVariant fcnFormatDate( const QVariantList& values, const QgsFeature*, QgsExpressionContext* context )
 {
-  QDateTime dt = getDateTimeValue( values.at( 0 ), parent );
-  QString format = getStringValue( values.at( 1 ), parent );
+  QDateTime dt = getDateTimeValue( values.at( 0 ), context );
+  QString format = getStringValue( values.at( 1 ), context );
   return dt.toString( format );
 }
 
-static QVariant fcnColorRgb( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fcnColorRgb( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
-  int red = getIntValue( values.at( 0 ), parent );
-  int green = getIntValue( values.at( 1 ), parent );
-  int blue = getIntValue( values.at( 2 ), parent );
+  int red = getIntValue( values.at( 0 ), context );
+  int green = getIntValue( values.at( 1 ), context );
+  int blue = getIntValue( values.at( 2 ), context );
   QColor color = QColor( red, green, blue );
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3' to color" ).arg( red ).arg( green ).arg( blue ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3' to color" ).arg( red ).arg( green ).arg( blue ) );
     color = QColor( 0, 0, 0 );
   }
 
   return QString( "%1,%2,%3" ).arg( color.red() ).arg( color.green() ).arg( color.blue() );
 }
 
-static QVariant fncColorRgba( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fncColorRgba( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
-  int red = getIntValue( values.at( 0 ), parent );
-  int green = getIntValue( values.at( 1 ), parent );
-  int blue = getIntValue( values.at( 2 ), parent );
-  int alpha = getIntValue( values.at( 3 ), parent );
+  int red = getIntValue( values.at( 0 ), context );
+  int green = getIntValue( values.at( 1 ), context );
+  int blue = getIntValue( values.at( 2 ), context );
+  int alpha = getIntValue( values.at( 3 ), context );
   QColor color = QColor( red, green, blue, alpha );
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( red ).arg( green ).arg( blue ).arg( alpha ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( red ).arg( green ).arg( blue ).arg( alpha ) );
     color = QColor( 0, 0, 0 );
   }
   return QgsSymbolLayerV2Utils::encodeColor( color );
 }
 
-QVariant fcnRampColor( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+QVariant fcnRampColor( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
-  QString rampName = getStringValue( values.at( 0 ), parent );
+  QString rampName = getStringValue( values.at( 0 ), context );
   const QgsVectorColorRampV2 *mRamp = QgsStyleV2::defaultStyle()->colorRampRef( rampName );
   if ( ! mRamp )
   {
-    parent->setEvalErrorString( QObject::tr( "\"%1\" is not a valid color ramp" ).arg( rampName ) );
+    context->setEvalErrorString( QObject::tr( "\"%1\" is not a valid color ramp" ).arg( rampName ) );
     return QColor( 0, 0, 0 ).name();
   }
-  double value = getDoubleValue( values.at( 1 ), parent );
+  double value = getDoubleValue( values.at( 1 ), context );
   QColor color = mRamp->color( value );
   return QgsSymbolLayerV2Utils::encodeColor( color );
 }
 
-static QVariant fcnColorHsl( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fcnColorHsl( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
   // Hue ranges from 0 - 360
-  double hue = getIntValue( values.at( 0 ), parent ) / 360.0;
+  double hue = getIntValue( values.at( 0 ), context ) / 360.0;
   // Saturation ranges from 0 - 100
-  double saturation = getIntValue( values.at( 1 ), parent ) / 100.0;
+  double saturation = getIntValue( values.at( 1 ), context ) / 100.0;
   // Lightness ranges from 0 - 100
-  double lightness = getIntValue( values.at( 2 ), parent ) / 100.0;
+  double lightness = getIntValue( values.at( 2 ), context ) / 100.0;
 
   QColor color = QColor::fromHslF( hue, saturation, lightness );
 
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3' to color" ).arg( hue ).arg( saturation ).arg( lightness ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3' to color" ).arg( hue ).arg( saturation ).arg( lightness ) );
     color = QColor( 0, 0, 0 );
   }
 
   return QString( "%1,%2,%3" ).arg( color.red() ).arg( color.green() ).arg( color.blue() );
 }
 
-static QVariant fncColorHsla( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fncColorHsla( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
   // Hue ranges from 0 - 360
-  double hue = getIntValue( values.at( 0 ), parent ) / 360.0;
+  double hue = getIntValue( values.at( 0 ), context ) / 360.0;
   // Saturation ranges from 0 - 100
-  double saturation = getIntValue( values.at( 1 ), parent ) / 100.0;
+  double saturation = getIntValue( values.at( 1 ), context ) / 100.0;
   // Lightness ranges from 0 - 100
-  double lightness = getIntValue( values.at( 2 ), parent ) / 100.0;
+  double lightness = getIntValue( values.at( 2 ), context ) / 100.0;
   // Alpha ranges from 0 - 255
-  double alpha = getIntValue( values.at( 3 ), parent ) / 255.0;
+  double alpha = getIntValue( values.at( 3 ), context ) / 255.0;
 
   QColor color = QColor::fromHslF( hue, saturation, lightness, alpha );
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( hue ).arg( saturation ).arg( lightness ).arg( alpha ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( hue ).arg( saturation ).arg( lightness ).arg( alpha ) );
     color = QColor( 0, 0, 0 );
   }
   return QgsSymbolLayerV2Utils::encodeColor( color );
 }
 
-static QVariant fcnColorHsv( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fcnColorHsv( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
   // Hue ranges from 0 - 360
-  double hue = getIntValue( values.at( 0 ), parent ) / 360.0;
+  double hue = getIntValue( values.at( 0 ), context ) / 360.0;
   // Saturation ranges from 0 - 100
-  double saturation = getIntValue( values.at( 1 ), parent ) / 100.0;
+  double saturation = getIntValue( values.at( 1 ), context ) / 100.0;
   // Value ranges from 0 - 100
-  double value = getIntValue( values.at( 2 ), parent ) / 100.0;
+  double value = getIntValue( values.at( 2 ), context ) / 100.0;
 
   QColor color = QColor::fromHsvF( hue, saturation, value );
 
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3' to color" ).arg( hue ).arg( saturation ).arg( value ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3' to color" ).arg( hue ).arg( saturation ).arg( value ) );
     color = QColor( 0, 0, 0 );
   }
 
   return QString( "%1,%2,%3" ).arg( color.red() ).arg( color.green() ).arg( color.blue() );
 }
 
-static QVariant fncColorHsva( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fncColorHsva( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
   // Hue ranges from 0 - 360
-  double hue = getIntValue( values.at( 0 ), parent ) / 360.0;
+  double hue = getIntValue( values.at( 0 ), context ) / 360.0;
   // Saturation ranges from 0 - 100
-  double saturation = getIntValue( values.at( 1 ), parent ) / 100.0;
+  double saturation = getIntValue( values.at( 1 ), context ) / 100.0;
   // Value ranges from 0 - 100
-  double value = getIntValue( values.at( 2 ), parent ) / 100.0;
+  double value = getIntValue( values.at( 2 ), context ) / 100.0;
   // Alpha ranges from 0 - 255
-  double alpha = getIntValue( values.at( 3 ), parent ) / 255.0;
+  double alpha = getIntValue( values.at( 3 ), context ) / 255.0;
 
   QColor color = QColor::fromHsvF( hue, saturation, value, alpha );
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( hue ).arg( saturation ).arg( value ).arg( alpha ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( hue ).arg( saturation ).arg( value ).arg( alpha ) );
     color = QColor( 0, 0, 0 );
   }
   return QgsSymbolLayerV2Utils::encodeColor( color );
 }
 
-static QVariant fcnColorCmyk( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fcnColorCmyk( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
   // Cyan ranges from 0 - 100
-  double cyan = getIntValue( values.at( 0 ), parent ) / 100.0;
+  double cyan = getIntValue( values.at( 0 ), context ) / 100.0;
   // Magenta ranges from 0 - 100
-  double magenta = getIntValue( values.at( 1 ), parent ) / 100.0;
+  double magenta = getIntValue( values.at( 1 ), context ) / 100.0;
   // Yellow ranges from 0 - 100
-  double yellow = getIntValue( values.at( 2 ), parent ) / 100.0;
+  double yellow = getIntValue( values.at( 2 ), context ) / 100.0;
   // Black ranges from 0 - 100
-  double black = getIntValue( values.at( 3 ), parent ) / 100.0;
+  double black = getIntValue( values.at( 3 ), context ) / 100.0;
 
   QColor color = QColor::fromCmykF( cyan, magenta, yellow, black );
 
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( cyan ).arg( magenta ).arg( yellow ).arg( black ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4' to color" ).arg( cyan ).arg( magenta ).arg( yellow ).arg( black ) );
     color = QColor( 0, 0, 0 );
   }
 
   return QString( "%1,%2,%3" ).arg( color.red() ).arg( color.green() ).arg( color.blue() );
 }
 
-static QVariant fncColorCmyka( const QVariantList &values, const QgsFeature *, QgsExpression *parent )
+static QVariant fncColorCmyka( const QVariantList &values, const QgsFeature *, QgsExpressionContext* context )
 {
   // Cyan ranges from 0 - 100
-  double cyan = getIntValue( values.at( 0 ), parent ) / 100.0;
+  double cyan = getIntValue( values.at( 0 ), context ) / 100.0;
   // Magenta ranges from 0 - 100
-  double magenta = getIntValue( values.at( 1 ), parent ) / 100.0;
+  double magenta = getIntValue( values.at( 1 ), context ) / 100.0;
   // Yellow ranges from 0 - 100
-  double yellow = getIntValue( values.at( 2 ), parent ) / 100.0;
+  double yellow = getIntValue( values.at( 2 ), context ) / 100.0;
   // Black ranges from 0 - 100
-  double black = getIntValue( values.at( 3 ), parent ) / 100.0;
+  double black = getIntValue( values.at( 3 ), context ) / 100.0;
   // Alpha ranges from 0 - 255
-  double alpha = getIntValue( values.at( 4 ), parent ) / 255.0;
+  double alpha = getIntValue( values.at( 4 ), context ) / 255.0;
 
   QColor color = QColor::fromCmykF( cyan, magenta, yellow, black, alpha );
   if ( ! color.isValid() )
   {
-    parent->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4:%5' to color" ).arg( cyan ).arg( magenta ).arg( yellow ).arg( black ).arg( alpha ) );
+    context->setEvalErrorString( QObject::tr( "Cannot convert '%1:%2:%3:%4:%5' to color" ).arg( cyan ).arg( magenta ).arg( yellow ).arg( black ).arg( alpha ) );
     color = QColor( 0, 0, 0 );
   }
   return QgsSymbolLayerV2Utils::encodeColor( color );
 }
 
-static QVariant fcnSpecialColumn( const QVariantList& values, const QgsFeature* /*f*/, QgsExpression* parent )
+static QVariant fcnSpecialColumn( const QVariantList& values, const QgsFeature* /*f*/, QgsExpressionContext* context )
 {
-  QString varName = getStringValue( values.at( 0 ), parent );
-  return QgsExpression::specialColumn( varName );
+  QString varName = getStringValue( values.at( 0 ), context );
+  return context->specialColumn( varName );
 }
 
+// protects the lazy initialization of the function lists and the registration of functions,
+// expressions may be parsed and evaluated in worker threads
+static QMutex gFunctionsMutex( QMutex::Recursive );
+static QAtomicInt gFunctionsInitialized( 0 );
+
 bool QgsExpression::registerFunction( QgsExpression::Function* function )
 {
+  QMutexLocker locker( &gFunctionsMutex );
   int fnIdx = functionIndex( function->name() );
   if ( fnIdx != -1 )
   {
@@ -1383,6 +1395,7 @@ bool QgsExpression::registerFunction( QgsExpression::Function* function )
 
 bool QgsExpression::unregisterFunction( QString name )
 {
+  QMutexLocker locker( &gFunctionsMutex );
   // You can never override the built in functions.
   if ( QgsExpression::BuiltinFunctions().contains( name ) )
   {
@@ -1403,6 +1416,7 @@ QStringList QgsExpression::gmBuiltinFunctions;
 
 const QStringList &QgsExpression::BuiltinFunctions()
 {
+  QMutexLocker locker( &gFunctionsMutex );
   if ( gmBuiltinFunctions.isEmpty() )
   {
     gmBuiltinFunctions
@@ -1435,6 +1449,12 @@ QList<QgsExpression::Function*> QgsExpression::gmFunctions;
 
 const QList<QgsExpression::Function*> &QgsExpression::Functions()
 {
+  if ( gFunctionsInitialized.testAndSetAcquire( 1, 1 ) )
+  {
+    return gmFunctions;
+  }
+
+  QMutexLocker locker( &gFunctionsMutex );
   if ( gmFunctions.isEmpty() )
   {
     gmFunctions
@@ -1542,10 +1562,52 @@ const QList<QgsExpression::Function*> &QgsExpression::Functions()
     << new StaticFunction( "_specialcol_", 1, fcnSpecialColumn, "Special" )
     ;
   }
+  gFunctionsInitialized.fetchAndStoreRelease( 1 );
   return gmFunctions;
 }
 
-QMap<QString, QVariant> QgsExpression::gmSpecialColumns;
+// Pre-register special columns that will exist within QGIS so that expressions that may use them are parsed correctly.
+static QMap<QString, QVariant> initSpecialColumns()
+{
+  QMap<QString, QVariant> specialColumns;
+  QStringList lst;
+  lst << "$page" << "$feature" << "$numpages" << "$numfeatures" << "$atlasfeatureid" << "$atlasgeometry" << "$map";
+  foreach ( QString c, lst )
+  {
+    specialColumns.insert( c, QVariant() );
+  }
+  return specialColumns;
+}
+
+QMap<QString, QVariant> QgsExpression::gmSpecialColumns = initSpecialColumns();
+
+// protects the global special columns, they may be read by evaluations in worker threads
+static QReadWriteLock gSpecialColumnsLock;
+
+// names of special columns only known to the parser while replaceExpressionText()
+// runs in the current thread, their values live in the evaluation context
+static QThreadStorage<QSet<QString>*> gScopedSpecialColumns;
+
+class QgsScopedSpecialColumns
+{
+  public:
+    QgsScopedSpecialColumns( const QMap<QString, QVariant>* theColumns )
+        : mPrevious( gScopedSpecialColumns.hasLocalData() ? *gScopedSpecialColumns.localData() : QSet<QString>() )
+    {
+      if ( !gScopedSpecialColumns.hasLocalData() )
+        gScopedSpecialColumns.setLocalData( new QSet<QString>() );
+      if ( theColumns )
+        gScopedSpecialColumns.localData()->unite( theColumns->keys().toSet() );
+    }
+
+    ~QgsScopedSpecialColumns()
+    {
+      *gScopedSpecialColumns.localData() = mPrevious;
+    }
+
+  private:
+    QSet<QString> mPrevious;
+};
 
 void QgsExpression::setSpecialColumn( const QString& name, QVariant variant )
 {
@@ -1555,11 +1617,13 @@ void QgsExpression::setSpecialColumn( const QString& name, QVariant variant )
     // function of the same name already exists
     return;
   }
+  QWriteLocker locker( &gSpecialColumnsLock );
   gmSpecialColumns[ name ] = variant;
 }
 
 void QgsExpression::unsetSpecialColumn( const QString& name )
 {
+  QWriteLocker locker( &gSpecialColumnsLock );
   QMap<QString, QVariant>::iterator fit = gmSpecialColumns.find( name );
   if ( fit != gmSpecialColumns.end() )
   {
@@ -1575,42 +1639,29 @@ QVariant QgsExpression::specialColumn( const QString& name )
     // function of the same name already exists
     return QVariant();
   }
-  QMap<QString, QVariant>::iterator it = gmSpecialColumns.find( name );
-  if ( it == gmSpecialColumns.end() )
-  {
-    return QVariant();
-  }
-  return it.value();
+  QReadLocker locker( &gSpecialColumnsLock );
+  return gmSpecialColumns.value( name );
 }
 
 bool QgsExpression::hasSpecialColumn( const QString& name )
 {
-  static bool initialized = false;
-  if ( !initialized )
-  {
-    // Pre-register special columns that will exist within QGIS so that expressions that may use them are parsed correctly.
-    // This is really sub-optimal, we should get rid of the special columns and instead have contexts in which some values
-    // are defined and some are not ($rownum makes sense only in field calculator, $scale only when rendering, $page only for composer etc.)
-
-    QStringList lst;
-    lst << "$page" << "$feature" << "$numpages" << "$numfeatures" << "$atlasfeatureid" << "$atlasgeometry" << "$map";
-    foreach ( QString c, lst )
-      setSpecialColumn( c, QVariant() );
-
-    initialized = true;
-  }
-
   if ( functionIndex( name ) != -1 )
     return false;
+
+  if ( gScopedSpecialColumns.hasLocalData() && gScopedSpecialColumns.localData()->contains( name ) )
+    return true;
+
+  QReadLocker locker( &gSpecialColumnsLock );
   return gmSpecialColumns.contains( name );
 }
 
 QList<QgsExpression::Function*> QgsExpression::specialColumns()
 {
+  QReadLocker locker( &gSpecialColumnsLock );
   QList<Function*> defs;
   for ( QMap<QString, QVariant>::const_iterator it = gmSpecialColumns.begin(); it != gmSpecialColumns.end(); ++it )
   {
-    defs << new StaticFunction( it.key(), 0, 0, "Record" );
+    defs << new StaticFunction( it.key(), 0, ( FcnEval ) 0, "Record" );
   }
   return defs;
 }
@@ -1637,11 +1688,207 @@ int QgsExpression::functionCount()
 }
 
 
-QgsExpression::QgsExpression( const QString& expr )
+///////////////////////////////////////////////
+// evaluation context
+
+QgsExpressionContext::QgsExpressionContext()
     : mRowNumber( 0 )
     , mScale( 0 )
-    , mExp( expr )
     , mCalc( 0 )
+{
+}
+
+QgsExpressionContext::QgsExpressionContext( const QgsExpressionContext& other )
+    : mSpecialColumns( other.mSpecialColumns )
+    , mRowNumber( other.mRowNumber )
+    , mScale( other.mScale )
+    , mEvalErrorString( other.mEvalErrorString )
+    , mCalc( other.mCalc ? new QgsDistanceArea( *other.mCalc ) : 0 )
+{
+}
+
+QgsExpressionContext& QgsExpressionContext::operator=( const QgsExpressionContext & other )
+{
+  if ( this != &other )
+  {
+    mSpecialColumns = other.mSpecialColumns;
+    mRowNumber = other.mRowNumber;
+    mScale = other.mScale;
+    mEvalErrorString = other.mEvalErrorString;
+    delete mCalc;
+    mCalc = other.mCalc ? new QgsDistanceArea( *other.mCalc ) : 0;
+  }
+  return *this;
+}
+
+QgsExpressionContext::~QgsExpressionContext()
+{
+  delete mCalc;
+}
+
+void QgsExpressionContext::setSpecialColumn( const QString& name, const QVariant& value )
+{
+  if ( QgsExpression::functionIndex( name ) != -1 )
+  {
+    // function of the same name already exists
+    return;
+  }
+  mSpecialColumns[ name ] = value;
+}
+
+void QgsExpressionContext::unsetSpecialColumn( const QString& name )
+{
+  mSpecialColumns.remove( name );
+}
+
+QVariant QgsExpressionContext::specialColumn( const QString& name ) const
+{
+  QMap<QString, QVariant>::const_iterator it = mSpecialColumns.constFind( name );
+  if ( it != mSpecialColumns.constEnd() )
+  {
+    return it.value();
+  }
+  const QgsExpressionContext* scoped = QgsExpressionContextScope::current();
+  if ( scoped && scoped != this )
+  {
+    it = scoped->mSpecialColumns.constFind( name );
+    if ( it != scoped->mSpecialColumns.constEnd() )
+    {
+      return it.value();
+    }
+  }
+  return QgsExpression::specialColumn( name );
+}
+
+bool QgsExpressionContext::hasSpecialColumn( const QString& name ) const
+{
+  if ( mSpecialColumns.contains( name ) )
+  {
+    return true;
+  }
+  const QgsExpressionContext* scoped = QgsExpressionContextScope::current();
+  if ( scoped && scoped != this && scoped->mSpecialColumns.contains( name ) )
+  {
+    return true;
+  }
+  return QgsExpression::hasSpecialColumn( name );
+}
+
+QgsDistanceArea* QgsExpressionContext::geomCalculator()
+{
+  if ( !mCalc )
+  {
+    // Use planimetric as default
+    mCalc = new QgsDistanceArea();
+    mCalc->setEllipsoidalMode( false );
+  }
+  return mCalc;
+}
+
+void QgsExpressionContext::setGeomCalculator( const QgsDistanceArea& calc )
+{
+  delete mCalc;
+  mCalc = new QgsDistanceArea( calc );
+}
+
+///////////////////////////////////////////////
+// context scope
+
+// scoped context of a thread, set by QgsExpressionContextScope
+struct QgsScopedContextHolder
+{
+  QgsScopedContextHolder() : context( 0 ) {}
+  const QgsExpressionContext* context;
+};
+
+static QThreadStorage<QgsScopedContextHolder*> gScopedContext;
+
+QgsExpressionContextScope::QgsExpressionContextScope( const QgsExpressionContext* context )
+{
+  if ( !gScopedContext.hasLocalData() )
+    gScopedContext.setLocalData( new QgsScopedContextHolder() );
+  mPrevious = gScopedContext.localData()->context;
+  if ( context )
+    gScopedContext.localData()->context = context;
+}
+
+QgsExpressionContextScope::~QgsExpressionContextScope()
+{
+  gScopedContext.localData()->context = mPrevious;
+}
+
+const QgsExpressionContext* QgsExpressionContextScope::current()
+{
+  return gScopedContext.hasLocalData() ? gScopedContext.localData()->context : 0;
+}
+
+///////////////////////////////////////////////
+// functions and nodes evaluated with a parent expression
+
+// Expression handed to functions and nodes which reimplement the variants taking a parent expression.
+// It borrows the evaluation context for its lifetime, so they see its special columns, row number,
+// scale and calculator, and their errors are reported to it
+class QgsContextExpression : public QgsExpression
+{
+  public:
+    QgsContextExpression( QgsExpressionContext* context ) : mBorrowedContext( context ) { swapContexts(); }
+    ~QgsContextExpression() { swapContexts(); }
+
+  private:
+    void swapContexts()
+    {
+      qSwap( mContext.mSpecialColumns, mBorrowedContext->mSpecialColumns );
+      qSwap( mContext.mRowNumber, mBorrowedContext->mRowNumber );
+      qSwap( mContext.mScale, mBorrowedContext->mScale );
+      qSwap( mContext.mEvalErrorString, mBorrowedContext->mEvalErrorString );
+      qSwap( mContext.mCalc, mBorrowedContext->mCalc );
+    }
+
+    QgsExpressionContext* mBorrowedContext;
+};
+
+QVariant QgsExpression::Function::func( const QVariantList& values, const QgsFeature* f, QgsExpression* parent )
+{
+  if ( parent )
+  {
+    return func( values, f, parent->expressionContext() );
+  }
+  QgsExpressionContext context;
+  return func( values, f, &context );
+}
+
+QVariant QgsExpression::Function::func( const QVariantList& values, const QgsFeature* f, QgsExpressionContext* context )
+{
+  QgsExpressionContext defaultContext;
+  QgsContextExpression parent( context ? context : &defaultContext );
+  return func( values, f, &parent );
+}
+
+QVariant QgsExpression::Node::eval( QgsExpression* parent, const QgsFeature* f )
+{
+  if ( parent )
+  {
+    return eval( parent->expressionContext(), f );
+  }
+  QgsExpressionContext context;
+  return eval( &context, f );
+}
+
+QVariant QgsExpression::Node::eval( QgsExpressionContext* context, const QgsFeature* f )
+{
+  QgsExpressionContext defaultContext;
+  QgsContextExpression parent( context ? context : &defaultContext );
+  return eval( &parent, f );
+}
+
+///////////////////////////////////////////////
+// expression
+
+QgsExpression::QgsExpression( const QString& expr )
+    : mExp( expr )
+    , mCompiled( 0 )
+    , mCompilationEnabled( true )
+    , mPrepared( false )
 {
   mRootNode = ::parseExpression( expr, mParserErrorString );
 
@@ -1651,7 +1898,7 @@ QgsExpression::QgsExpression( const QString& expr )
 
 QgsExpression::~QgsExpression()
 {
-  delete mCalc;
+  delete mCompiled;
   delete mRootNode;
 }
 
@@ -1685,52 +1932,149 @@ bool QgsExpression::needsGeometry()
   return mRootNode->needsGeometry();
 }
 
-void QgsExpression::initGeomCalculator()
-{
-  if ( mCalc )
-    return;
-
-  // Use planimetric as default
-  mCalc = new QgsDistanceArea();
-  mCalc->setEllipsoidalMode( false );
-}
-
 void QgsExpression::setGeomCalculator( const QgsDistanceArea &calc )
 {
-  delete mCalc;
-  mCalc = new QgsDistanceArea( calc );
+  mContext.setGeomCalculator( calc );
 }
 
 bool QgsExpression::prepare( const QgsFields& fields )
 {
-  mEvalErrorString = QString();
+  delete mCompiled;
+  mCompiled = 0;
+  mPrepared = false;
+
+  mContext.setEvalErrorString( QString() );
   if ( !mRootNode )
   {
-    mEvalErrorString = QObject::tr( "No root node! Parsing failed?" );
+    mContext.setEvalErrorString( QObject::tr( "No root node! Parsing failed?" ) );
+    return false;
+  }
+
+  if ( !mRootNode->prepare( this, fields ) )
     return false;
+
+  mPrepared = true;
+  mPreparedFields = fields.toList();
+
+  if ( mCompilationEnabled )
+  {
+    // column indexes are baked into the program, so it is rebuilt on every prepare
+    mCompiled = QgsCompiledExpression::compile( mRootNode );
   }
+  return true;
+}
 
-  return mRootNode->prepare( this, fields );
+void QgsExpression::setCompilationEnabled( bool enabled )
+{
+  mCompilationEnabled = enabled;
+  if ( !enabled )
+  {
+    delete mCompiled;
+    mCompiled = 0;
+  }
 }
 
 QVariant QgsExpression::evaluate( const QgsFeature* f )
 {
-  mEvalErrorString = QString();
+  return evaluate( f, &mContext );
+}
+
+QVariant QgsExpression::evaluate( const QgsFeature* f, QgsExpressionContext* context ) const
+{
+  if ( !context )
+  {
+    context = const_cast<QgsExpressionContext*>( &mContext );
+  }
+
+  context->setEvalErrorString( QString() );
   if ( !mRootNode )
   {
-    mEvalErrorString = QObject::tr( "No root node! Parsing failed?" );
+    context->setEvalErrorString( QObject::tr( "No root node! Parsing failed?" ) );
     return QVariant();
   }
 
-  return mRootNode->eval( this, f );
+  // measurements use a private copy of the expression's calculator, QgsDistanceArea is not thread safe
+  if ( !context->mCalc && mContext.mCalc )
+  {
+    context->setGeomCalculator( *mContext.mCalc );
+  }
+
+  if ( mCompiled )
+  {
+    return mCompiled->evaluate( context, f );
+  }
+  return mRootNode->eval( context, f );
+}
+
+QVariantList QgsExpression::evaluate( const QList<QgsFeature>& features, QgsExpressionContext* context ) const
+{
+  QList<const QgsFeature*> featurePointers;
+  featurePointers.reserve( features.size() );
+  for ( QList<QgsFeature>::const_iterator it = features.constBegin(); it != features.constEnd(); ++it )
+  {
+    featurePointers << &( *it );
+  }
+  return evaluate( featurePointers, context );
+}
+
+QVariantList QgsExpression::evaluate( const QList<const QgsFeature*>& features, QgsExpressionContext* context ) const
+{
+  if ( !context )
+  {
+    context = const_cast<QgsExpressionContext*>( &mContext );
+  }
+
+  context->setEvalErrorString( QString() );
+  if ( !mRootNode )
+  {
+    context->setEvalErrorString( QObject::tr( "No root node! Parsing failed?" ) );
+    QVariantList results;
+    for ( int i = 0; i < features.size(); ++i )
+      results << QVariant();
+    return results;
+  }
+
+  if ( !context->mCalc && mContext.mCalc )
+  {
+    context->setGeomCalculator( *mContext.mCalc );
+  }
+
+  if ( mCompiled )
+  {
+    return mCompiled->evaluate( context, features );
+  }
+
+  // not compiled: evaluate the tree feature by feature
+  QVariantList results;
+  QString firstError;
+  int firstRowNumber = context->currentRowNumber();
+  for ( int i = 0; i < features.size(); ++i )
+  {
+    context->setCurrentRowNumber( firstRowNumber + i );
+    QVariant value = mRootNode->eval( context, features.at( i ) );
+    if ( context->hasEvalError() )
+    {
+      if ( firstError.isNull() )
+        firstError = context->evalErrorString();
+      context->setEvalErrorString( QString() );
+      value = QVariant();
+    }
+    results << value;
+  }
+  context->setCurrentRowNumber( firstRowNumber );
+  context->setEvalErrorString( firstError );
+  return results;
 }
 
 QVariant QgsExpression::evaluate( const QgsFeature* f, const QgsFields& fields )
 {
-  // first prepare
-  bool res = prepare( fields );
-  if ( !res )
-    return QVariant();
+  // first prepare, unless already prepared for the same fields: callers evaluating
+  // feature by feature would otherwise rebuild the compiled program for every feature
+  if ( !mPrepared || mPreparedFields != fields.toList() )
+  {
+    if ( !prepare( fields ) )
+      return QVariant();
+  }
 
   // then evaluate
   return evaluate( f );
@@ -1756,18 +2100,15 @@ QString QgsExpression::replaceExpressionText( const QString &action, const QgsFe
 {
   QString expr_action;
 
-  QMap<QString, QVariant> savedValues;
+  // variables with a local scope: values only live in the evaluation context,
+  // the parser only knows the names until this call returns
+  QgsScopedSpecialColumns scopedColumns( substitutionMap );
+  QgsExpressionContext context;
   if ( substitutionMap )
   {
-    // variables with a local scope (must be restored after evaluation)
     for ( QMap<QString, QVariant>::const_iterator sit = substitutionMap->begin(); sit != substitutionMap->end(); ++sit )
     {
-      QVariant oldValue = QgsExpression::specialColumn( sit.key() );
-      if ( !oldValue.isNull() )
-        savedValues.insert( sit.key(), oldValue );
-
-      // set the new value
-      QgsExpression::setSpecialColumn( sit.key(), sit.value() );
+      context.setSpecialColumn( sit.key(), sit.value() );
     }
   }
 
@@ -1793,18 +2134,19 @@ QString QgsExpression::replaceExpressionText( const QString &action, const QgsFe
       continue;
     }
 
-    QVariant result;
-    if ( layer )
-    {
-      result = exp.evaluate( feat, layer->pendingFields() );
-    }
-    else
+    // evaluated only once, compiling would not pay off
+    exp.setCompilationEnabled( false );
+    if ( layer && !exp.prepare( layer->pendingFields() ) )
     {
-      result = exp.evaluate( feat );
+      QgsDebugMsg( "Expression parser eval error: " + exp.evalErrorString() );
+      expr_action += action.mid( start, index - start );
+      continue;
     }
-    if ( exp.hasEvalError() )
+
+    QVariant result = exp.evaluate( feat, &context );
+    if ( context.hasEvalError() )
     {
-      QgsDebugMsg( "Expression parser eval error: " + exp.evalErrorString() );
+      QgsDebugMsg( "Expression parser eval error: " + context.evalErrorString() );
       expr_action += action.mid( start, index - start );
       continue;
     }
@@ -1815,12 +2157,6 @@ QString QgsExpression::replaceExpressionText( const QString &action, const QgsFe
 
   expr_action += action.mid( index );
 
-  // restore overwritten local values
-  for ( QMap<QString, QVariant>::const_iterator sit = savedValues.begin(); sit != savedValues.end(); ++sit )
-  {
-    QgsExpression::setSpecialColumn( sit.key(), sit.value() );
-  }
-
   return expr_action;
 }
 
@@ -1842,25 +2178,30 @@ QString QgsExpression::NodeList::dump() const
 
 //
 
-QVariant QgsExpression::NodeUnaryOperator::eval( QgsExpression* parent, const QgsFeature* f )
+QVariant QgsExpression::NodeUnaryOperator::eval( QgsExpressionContext* context, const QgsFeature* f )
 {
-  QVariant val = mOperand->eval( parent, f );
+  QVariant val = mOperand->eval( context, f );
   ENSURE_NO_EVAL_ERROR;
 
+  return evalValue( context, val );
+}
+
+QVariant QgsExpression::NodeUnaryOperator::evalValue( QgsExpressionContext* context, const QVariant& val ) const
+{
   switch ( mOp )
   {
     case uoNot:
     {
-      TVL tvl = getTVLValue( val, parent );
+      TVL tvl = getTVLValue( val, context );
       ENSURE_NO_EVAL_ERROR;
       return tvl2variant( NOT[tvl] );
     }
 
     case uoMinus:
       if ( isIntSafe( val ) )
-        return QVariant( - getIntValue( val, parent ) );
+        return QVariant( - getIntValue( val, context ) );
       else if ( isDoubleSafe( val ) )
-        return QVariant( - getDoubleValue( val, parent ) );
+        return QVariant( - getDoubleValue( val, context ) );
       else
         SET_EVAL_ERROR( QObject::tr( "Unary minus only for numeric values." ) );
       break;
@@ -1882,13 +2223,18 @@ QString QgsExpression::NodeUnaryOperator::dump() const
 
 //
 
-QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const QgsFeature* f )
+QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpressionContext* context, const QgsFeature* f )
 {
-  QVariant vL = mOpLeft->eval( parent, f );
+  QVariant vL = mOpLeft->eval( context, f );
   ENSURE_NO_EVAL_ERROR;
-  QVariant vR = mOpRight->eval( parent, f );
+  QVariant vR = mOpRight->eval( context, f );
   ENSURE_NO_EVAL_ERROR;
 
+  return evalValues( context, vL, vR );
+}
+
+QVariant QgsExpression::NodeBinaryOperator::evalValues( QgsExpressionContext* context, const QVariant& vL, const QVariant& vR ) const
+{
   switch ( mOp )
   {
     case boPlus:
@@ -1901,18 +2247,18 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
       else if ( isIntSafe( vL ) && isIntSafe( vR ) )
       {
         // both are integers - let's use integer arithmetics
-        int iL = getIntValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-        int iR = getIntValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
-        if ( mOp == boDiv && iR == 0 ) return QVariant(); // silently handle division by zero and return NULL
+        int iL = getIntValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+        int iR = getIntValue( vR, context ); ENSURE_NO_EVAL_ERROR;
+        if (( mOp == boDiv || mOp == boMod ) && iR == 0 ) return QVariant(); // silently handle division by zero and return NULL
         return QVariant( computeInt( iL, iR ) );
       }
       else if ( isDateTimeSafe( vL ) && isIntervalSafe( vR ) )
       {
-        QDateTime dL = getDateTimeValue( vL, parent );  ENSURE_NO_EVAL_ERROR;
-        QgsExpression::Interval iL = getInterval( vR, parent ); ENSURE_NO_EVAL_ERROR;
+        QDateTime dL = getDateTimeValue( vL, context );  ENSURE_NO_EVAL_ERROR;
+        QgsExpression::Interval iL = getInterval( vR, context ); ENSURE_NO_EVAL_ERROR;
         if ( mOp == boDiv || mOp == boMul || mOp == boMod )
         {
-          parent->setEvalErrorString( QObject::tr( "Can't preform /, *, or % on DateTime and Interval" ) );
+          context->setEvalErrorString( QObject::tr( "Can't preform /, *, or % on DateTime and Interval" ) );
           return QVariant();
         }
         return QVariant( computeDateTimeFromInterval( dL, &iL ) );
@@ -1920,8 +2266,8 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
       else
       {
         // general floating point arithmetic
-        double fL = getDoubleValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-        double fR = getDoubleValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+        double fL = getDoubleValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+        double fR = getDoubleValue( vR, context ); ENSURE_NO_EVAL_ERROR;
         if ( mOp == boDiv && fR == 0 )
           return QVariant(); // silently handle division by zero and return NULL
         return QVariant( computeDouble( fL, fR ) );
@@ -1932,21 +2278,21 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
         return QVariant();
       else
       {
-        double fL = getDoubleValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-        double fR = getDoubleValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+        double fL = getDoubleValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+        double fR = getDoubleValue( vR, context ); ENSURE_NO_EVAL_ERROR;
         return QVariant( pow( fL, fR ) );
       }
 
     case boAnd:
     {
-      TVL tvlL = getTVLValue( vL, parent ), tvlR = getTVLValue( vR, parent );
+      TVL tvlL = getTVLValue( vL, context ), tvlR = getTVLValue( vR, context );
       ENSURE_NO_EVAL_ERROR;
       return tvl2variant( AND[tvlL][tvlR] );
     }
 
     case boOr:
     {
-      TVL tvlL = getTVLValue( vL, parent ), tvlR = getTVLValue( vR, parent );
+      TVL tvlL = getTVLValue( vL, context ), tvlR = getTVLValue( vR, context );
       ENSURE_NO_EVAL_ERROR;
       return tvl2variant( OR[tvlL][tvlR] );
     }
@@ -1964,15 +2310,15 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
       else if ( isDoubleSafe( vL ) && isDoubleSafe( vR ) )
       {
         // do numeric comparison if both operators can be converted to numbers
-        double fL = getDoubleValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-        double fR = getDoubleValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+        double fL = getDoubleValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+        double fR = getDoubleValue( vR, context ); ENSURE_NO_EVAL_ERROR;
         return compare( fL - fR ) ? TVL_True : TVL_False;
       }
       else
       {
         // do string comparison otherwise
-        QString sL = getStringValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-        QString sR = getStringValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+        QString sL = getStringValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+        QString sR = getStringValue( vR, context ); ENSURE_NO_EVAL_ERROR;
         int diff = QString::compare( sL, sR );
         return compare( diff ) ? TVL_True : TVL_False;
       }
@@ -1988,14 +2334,14 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
         bool equal = false;
         if ( isDoubleSafe( vL ) && isDoubleSafe( vR ) )
         {
-          double fL = getDoubleValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-          double fR = getDoubleValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+          double fL = getDoubleValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+          double fR = getDoubleValue( vR, context ); ENSURE_NO_EVAL_ERROR;
           equal = fL == fR;
         }
         else
         {
-          QString sL = getStringValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-          QString sR = getStringValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+          QString sL = getStringValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+          QString sR = getStringValue( vR, context ); ENSURE_NO_EVAL_ERROR;
           equal = QString::compare( sL, sR ) == 0;
         }
         if ( equal )
@@ -2013,8 +2359,8 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
         return TVL_Unknown;
       else
       {
-        QString str    = getStringValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-        QString regexp = getStringValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+        QString str    = getStringValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+        QString regexp = getStringValue( vR, context ); ENSURE_NO_EVAL_ERROR;
         // TODO: cache QRegExp in case that regexp is a literal string (i.e. it will stay constant)
         bool matches;
         if ( mOp == boLike || mOp == boILike || mOp == boNotLike || mOp == boNotILike ) // change from LIKE syntax to regexp
@@ -2043,8 +2389,8 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
         return QVariant();
       else
       {
-        QString sL = getStringValue( vL, parent ); ENSURE_NO_EVAL_ERROR;
-        QString sR = getStringValue( vR, parent ); ENSURE_NO_EVAL_ERROR;
+        QString sL = getStringValue( vL, context ); ENSURE_NO_EVAL_ERROR;
+        QString sR = getStringValue( vR, context ); ENSURE_NO_EVAL_ERROR;
         return QVariant( sL + sR );
       }
 
@@ -2054,7 +2400,7 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression* parent, const Q
   return QVariant();
 }
 
-bool QgsExpression::NodeBinaryOperator::compare( double diff )
+bool QgsExpression::NodeBinaryOperator::compare( double diff ) const
 {
   switch ( mOp )
   {
@@ -2068,7 +2414,7 @@ bool QgsExpression::NodeBinaryOperator::compare( double diff )
   }
 }
 
-int QgsExpression::NodeBinaryOperator::computeInt( int x, int y )
+int QgsExpression::NodeBinaryOperator::computeInt( int x, int y ) const
 {
   switch ( mOp )
   {
@@ -2081,7 +2427,7 @@ int QgsExpression::NodeBinaryOperator::computeInt( int x, int y )
   }
 }
 
-QDateTime QgsExpression::NodeBinaryOperator::computeDateTimeFromInterval( QDateTime d, QgsExpression::Interval *i )
+QDateTime QgsExpression::NodeBinaryOperator::computeDateTimeFromInterval( QDateTime d, QgsExpression::Interval *i ) const
 {
   switch ( mOp )
   {
@@ -2091,7 +2437,7 @@ QDateTime QgsExpression::NodeBinaryOperator::computeDateTimeFromInterval( QDateT
   }
 }
 
-double QgsExpression::NodeBinaryOperator::computeDouble( double x, double y )
+double QgsExpression::NodeBinaryOperator::computeDouble( double x, double y ) const
 {
   switch ( mOp )
   {
@@ -2119,11 +2465,11 @@ QString QgsExpression::NodeBinaryOperator::dump() const
 
 //
 
-QVariant QgsExpression::NodeInOperator::eval( QgsExpression* parent, const QgsFeature* f )
+QVariant QgsExpression::NodeInOperator::eval( QgsExpressionContext* context, const QgsFeature* f )
 {
   if ( mList->count() == 0 )
     return mNotIn ? TVL_True : TVL_False;
-  QVariant v1 = mNode->eval( parent, f );
+  QVariant v1 = mNode->eval( context, f );
   ENSURE_NO_EVAL_ERROR;
   if ( isNull( v1 ) )
     return TVL_Unknown;
@@ -2132,7 +2478,7 @@ QVariant QgsExpression::NodeInOperator::eval( QgsExpression* parent, const QgsFe
 
   foreach ( Node* n, mList->list() )
   {
-    QVariant v2 = n->eval( parent, f );
+    QVariant v2 = n->eval( context, f );
     ENSURE_NO_EVAL_ERROR;
     if ( isNull( v2 ) )
       listHasNull = true;
@@ -2142,14 +2488,14 @@ QVariant QgsExpression::NodeInOperator::eval( QgsExpression* parent, const QgsFe
       // check whether they are equal
       if ( isDoubleSafe( v1 ) && isDoubleSafe( v2 ) )
       {
-        double f1 = getDoubleValue( v1, parent ); ENSURE_NO_EVAL_ERROR;
-        double f2 = getDoubleValue( v2, parent ); ENSURE_NO_EVAL_ERROR;
+        double f1 = getDoubleValue( v1, context ); ENSURE_NO_EVAL_ERROR;
+        double f2 = getDoubleValue( v2, context ); ENSURE_NO_EVAL_ERROR;
         equal = f1 == f2;
       }
       else
       {
-        QString s1 = getStringValue( v1, parent ); ENSURE_NO_EVAL_ERROR;
-        QString s2 = getStringValue( v2, parent ); ENSURE_NO_EVAL_ERROR;
+        QString s1 = getStringValue( v1, context ); ENSURE_NO_EVAL_ERROR;
+        QString s2 = getStringValue( v2, context ); ENSURE_NO_EVAL_ERROR;
         equal = QString::compare( s1, s2 ) == 0;
       }
 
@@ -2182,7 +2528,7 @@ QString QgsExpression::NodeInOperator::dump() const
 
 //
 
-QVariant QgsExpression::NodeFunction::eval( QgsExpression* parent, const QgsFeature* f )
+QVariant QgsExpression::NodeFunction::eval( QgsExpressionContext* context, const QgsFeature* f )
 {
   Function* fd = Functions()[mFnIndex];
 
@@ -2192,7 +2538,7 @@ QVariant QgsExpression::NodeFunction::eval( QgsExpression* parent, const QgsFeat
   {
     foreach ( Node* n, mArgs->list() )
     {
-      QVariant v = n->eval( parent, f );
+      QVariant v = n->eval( context, f );
       ENSURE_NO_EVAL_ERROR;
       if ( isNull( v ) && fd->name() != "coalesce" )
         return QVariant(); // all "normal" functions return NULL, when any parameter is NULL (so coalesce is abnormal)
@@ -2201,7 +2547,7 @@ QVariant QgsExpression::NodeFunction::eval( QgsExpression* parent, const QgsFeat
   }
 
   // run the function
-  QVariant res = fd->func( argValues, f, parent );
+  QVariant res = fd->func( argValues, f, context );
   ENSURE_NO_EVAL_ERROR;
 
   // everything went fine
@@ -2232,7 +2578,7 @@ QString QgsExpression::NodeFunction::dump() const
 
 //
 
-QVariant QgsExpression::NodeLiteral::eval( QgsExpression* , const QgsFeature* )
+QVariant QgsExpression::NodeLiteral::eval( QgsExpressionContext* , const QgsFeature* )
 {
   return mValue;
 }
@@ -2259,7 +2605,7 @@ QString QgsExpression::NodeLiteral::dump() const
 
 //
 
-QVariant QgsExpression::NodeColumnRef::eval( QgsExpression* /*parent*/, const QgsFeature* f )
+QVariant QgsExpression::NodeColumnRef::eval( QgsExpressionContext* /*context*/, const QgsFeature* f )
 {
   if ( f )
   {
@@ -2281,7 +2627,7 @@ bool QgsExpression::NodeColumnRef::prepare( QgsExpression* parent, const QgsFiel
       return true;
     }
   }
-  parent->mEvalErrorString = QObject::tr( "Column '%1' not found" ).arg( mName );
+  parent->setEvalErrorString( QObject::tr( "Column '%1' not found" ).arg( mName ) );
   mIndex = -1;
   return false;
 }
@@ -2293,16 +2639,16 @@ QString QgsExpression::NodeColumnRef::dump() const
 
 //
 
-QVariant QgsExpression::NodeCondition::eval( QgsExpression* parent, const QgsFeature* f )
+QVariant QgsExpression::NodeCondition::eval( QgsExpressionContext* context, const QgsFeature* f )
 {
   foreach ( WhenThen* cond, mConditions )
   {
-    QVariant vWhen = cond->mWhenExp->eval( parent, f );
-    TVL tvl = getTVLValue( vWhen, parent );
+    QVariant vWhen = cond->mWhenExp->eval( context, f );
+    TVL tvl = getTVLValue( vWhen, context );
     ENSURE_NO_EVAL_ERROR;
     if ( tvl == True )
     {
-      QVariant vRes = cond->mThenExp->eval( parent, f );
+      QVariant vRes = cond->mThenExp->eval( context, f );
       ENSURE_NO_EVAL_ERROR;
       return vRes;
     }
@@ -2310,7 +2656,7 @@ QVariant QgsExpression::NodeCondition::eval( QgsExpression* parent, const QgsFea
 
   if ( mElseExp )
   {
-    QVariant vElse = mElseExp->eval( parent, f );
+    QVariant vElse = mElseExp->eval( context, f );
     ENSURE_NO_EVAL_ERROR;
     return vElse;
   }
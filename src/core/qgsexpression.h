@@ -25,6 +25,7 @@
 #include "qgsfield.h"
 #include "qgsdistancearea.h"
 
+class QgsCompiledExpression;
 class QgsFeature;
 class QgsGeometry;
 class QgsOgcUtils;
@@ -33,6 +34,105 @@ class QgsVectorDataProvider;
 
 class QDomElement;
 
+/**
+Evaluation state of QgsExpression: values of special columns ($page, $atlasgeometry, ...),
+the current row number ($rownum), the map scale ($scale), the calculator used for
+geometry measurements and the error of the last evaluation.
+
+A prepared expression does not change while it is evaluated with an explicit context,
+so one expression may be shared by several threads as long as each thread uses its own context:
+
+  QgsExpressionContext context;
+  context.setSpecialColumn( "$page", 3 );
+  QVariant result = exp.evaluate( &feature, &context );
+  if ( context.hasEvalError() )
+  {
+    // show error message with context.evalErrorString()
+  }
+
+Special columns not set in the context fall back to the global values assigned with
+QgsExpression::setSpecialColumn().
+
+@note added in 2.1
+*/
+class CORE_EXPORT QgsExpressionContext
+{
+  public:
+    QgsExpressionContext();
+    QgsExpressionContext( const QgsExpressionContext& other );
+    QgsExpressionContext& operator=( const QgsExpressionContext& other );
+    ~QgsExpressionContext();
+
+    //! Assign a special column in this context
+    void setSpecialColumn( const QString& name, const QVariant& value );
+    //! Unset a special column of this context (global value becomes visible again)
+    void unsetSpecialColumn( const QString& name );
+    //! Return the value of the given special column (from this context or the global values) or a null QVariant if undefined
+    QVariant specialColumn( const QString& name ) const;
+    //! Check whether a special column exists in this context or globally
+    bool hasSpecialColumn( const QString& name ) const;
+    //! Return the special columns assigned in this context
+    QMap<QString, QVariant> specialColumns() const { return mSpecialColumns; }
+
+    //! Set the number for $rownum special column
+    void setCurrentRowNumber( int rowNumber ) { mRowNumber = rowNumber; }
+    //! Return the number used for $rownum special column
+    int currentRowNumber() const { return mRowNumber; }
+
+    //! Set the scale for $scale special column
+    void setScale( double scale ) { mScale = scale; }
+    //! Return the scale used for $scale special column
+    double scale() const { return mScale; }
+
+    //! Returns true if an error occurred when evaluating last input
+    bool hasEvalError() const { return !mEvalErrorString.isNull(); }
+    //! Returns evaluation error
+    QString evalErrorString() const { return mEvalErrorString; }
+    //! Set evaluation error (used internally by evaluation functions)
+    void setEvalErrorString( const QString& str ) { mEvalErrorString = str; }
+
+    //! Return calculator used for distance and area calculations (planimetric if none was set)
+    QgsDistanceArea* geomCalculator();
+    //! Sets the geometry calculator used in evaluation of expressions
+    void setGeomCalculator( const QgsDistanceArea& calc );
+
+  private:
+    QMap<QString, QVariant> mSpecialColumns;
+    int mRowNumber;
+    double mScale;
+    QString mEvalErrorString;
+    QgsDistanceArea* mCalc;
+
+    friend class QgsExpression;
+    friend class QgsContextExpression;
+};
+
+/**
+Makes the special columns of a context visible to all expressions evaluated by the current thread
+while the scope exists, e.g. the values of the current atlas feature while a composer map is rendered.
+Special columns not set by an evaluation context are looked up in the scoped context first, then in the
+global values. The previous scope of the thread is restored when the object is destroyed.
+
+  QgsExpressionContextScope scope( &atlasContext );
+  renderer.render( painter ); // renderers see $atlasgeometry of atlasContext
+
+@note added in 2.1
+@note not available in python bindings
+*/
+class CORE_EXPORT QgsExpressionContextScope
+{
+  public:
+    //! Makes context the scoped context of the current thread. The current scope is kept if context is 0
+    QgsExpressionContextScope( const QgsExpressionContext* context );
+    ~QgsExpressionContextScope();
+
+    //! Returns the scoped context of the current thread or 0 if there is none
+    static const QgsExpressionContext* current();
+
+  private:
+    const QgsExpressionContext* mPrevious;
+};
+
 /**
 Class for parsing and evaluation of expressions (formerly called "search strings").
 The expressions try to follow both syntax and semantics of SQL expressions.
@@ -72,6 +172,10 @@ There is no special (three-value) 'boolean' type: true/false is represented as
 For better performance with many evaluations you may first call prepare(fields) function
 to find out indices of columns and then repeatedly call evaluate(feature).
 
+The evaluate() variants without a context use the expression's own context (see expressionContext()),
+they are not safe to call from several threads at once. A prepared expression can be shared between
+threads by evaluating it with evaluate(feature, context) and a separate QgsExpressionContext per thread.
+
 Type conversion: operators and functions that expect arguments to be of particular
 type automatically convert the arguments to that type, e.g. sin('2.1') will convert
 the argument to a double, length(123) will first convert the number to a string.
@@ -103,8 +207,20 @@ class CORE_EXPORT QgsExpression
     const Node* rootNode() const { return mRootNode; }
 
     //! Get the expression ready for evaluation - find out column indexes.
+    //! If compilation is enabled, the tree is also compiled to a flat program (see setCompilationEnabled())
     bool prepare( const QgsFields &fields );
 
+    //! Enables or disables compilation of the expression tree in prepare(). Compiled expressions evaluate
+    //! numeric arithmetic and comparisons without QVariant conversions, the results are the same. Enabled by default
+    //! @note added in 2.1
+    void setCompilationEnabled( bool enabled );
+    //! Returns whether prepare() compiles the expression tree
+    //! @note added in 2.1
+    bool isCompilationEnabled() const { return mCompilationEnabled; }
+    //! Returns true if the last call to prepare() compiled the expression
+    //! @note added in 2.1
+    bool isCompiled() const { return mCompiled != 0; }
+
     //! Get list of columns referenced by the expression
     QStringList referencedColumns();
     //! Returns true if the expression uses feature geometry for some computation
@@ -122,38 +238,69 @@ class CORE_EXPORT QgsExpression
     inline QVariant evaluate( const QgsFeature& f ) { return evaluate( &f ); }
 
     //! Evaluate the feature and return the result
-    //! @note this method does not expect that prepare() has been called on this instance
+    //! @note this method does not expect that prepare() has been called on this instance,
+    //! it is only prepared again if the fields differ from those of the last preparation
     QVariant evaluate( const QgsFeature* f, const QgsFields& fields );
 
     //! Evaluate the feature and return the result
     //! @note this method does not expect that prepare() has been called on this instance
     inline QVariant evaluate( const QgsFeature& f, const QgsFields& fields ) { return evaluate( &f, fields ); }
 
+    //! Evaluate the feature with the given context and return the result.
+    //! Special columns, row number, scale and evaluation error are taken from / reported to the context,
+    //! the expression itself is not modified. The expression's own context is used if context is 0.
+    //! @note prepare() should be called before calling this method
+    //! @note added in 2.1
+    QVariant evaluate( const QgsFeature* f, QgsExpressionContext* context ) const;
+
+    //! Evaluate the feature with the given context and return the result
+    //! @note prepare() should be called before calling this method
+    //! @note added in 2.1
+    inline QVariant evaluate( const QgsFeature& f, QgsExpressionContext* context ) const { return evaluate( &f, context ); }
+
+    //! Evaluate a batch of features and return one value per feature. Feature i is evaluated with the row
+    //! number currentRowNumber() + i of the context. Features which fail to evaluate give NULL,
+    //! hasEvalError() / evalErrorString() of the context report the error of the first of them.
+    //! A compiled expression evaluates the batch column by column, which is much faster than
+    //! evaluating the features one by one for numeric expressions.
+    //! @note prepare() should be called before calling this method
+    //! @note added in 2.1
+    QVariantList evaluate( const QList<QgsFeature>& features, QgsExpressionContext* context = 0 ) const;
+
+    //! Evaluate a batch of features given by pointers, see above
+    //! @note added in 2.1
+    //! @note not available in python bindings
+    QVariantList evaluate( const QList<const QgsFeature*>& features, QgsExpressionContext* context = 0 ) const;
+
+    //! Returns the context used by the evaluate() variants without explicit context
+    //! @note added in 2.1
+    QgsExpressionContext* expressionContext() { return &mContext; }
+
     //! Returns true if an error occurred when evaluating last input
-    bool hasEvalError() const { return !mEvalErrorString.isNull(); }
+    bool hasEvalError() const { return mContext.hasEvalError(); }
     //! Returns evaluation error
-    QString evalErrorString() const { return mEvalErrorString; }
+    QString evalErrorString() const { return mContext.evalErrorString(); }
     //! Set evaluation error (used internally by evaluation functions)
-    void setEvalErrorString( QString str ) { mEvalErrorString = str; }
+    void setEvalErrorString( QString str ) { mContext.setEvalErrorString( str ); }
 
     //! Set the number for $rownum special column
-    void setCurrentRowNumber( int rowNumber ) { mRowNumber = rowNumber; }
+    void setCurrentRowNumber( int rowNumber ) { mContext.setCurrentRowNumber( rowNumber ); }
     //! Return the number used for $rownum special column
-    int currentRowNumber() { return mRowNumber; }
+    int currentRowNumber() { return mContext.currentRowNumber(); }
 
-    //! Assign a special column
+    //! Assign a global special column (visible to all contexts which do not assign it themselves)
     static void setSpecialColumn( const QString& name, QVariant value );
-    //! Unset a special column
+    //! Unset a global special column
     static void unsetSpecialColumn( const QString& name );
-    //! Return the value of the given special column or a null QVariant if undefined
+    //! Return the global value of the given special column or a null QVariant if undefined
     static QVariant specialColumn( const QString& name );
-    //! Check whether a special column exists
+    //! Check whether a global special column exists
     //! @note added in 2.2
     static bool hasSpecialColumn( const QString& name );
 
-    void setScale( double scale ) { mScale = scale; }
+    void setScale( double scale ) { mContext.setScale( scale ); }
 
-    int scale() {return mScale; }
+    int scale() { return mContext.scale(); }
 
     //! Return the expression string that was given when created.
     const QString expression() const { return dump(); }
@@ -163,7 +310,7 @@ class CORE_EXPORT QgsExpression
 
     //! Return calculator used for distance and area calculations
     //! (used by internal functions)
-    QgsDistanceArea *geomCalculator() { initGeomCalculator(); return mCalc; }
+    QgsDistanceArea *geomCalculator() { return mContext.geomCalculator(); }
 
     //! Sets the geometry calculator used in evaluation of expressions,
     // instead of the default.
@@ -233,6 +380,8 @@ class CORE_EXPORT QgsExpression
     static const char* UnaryOperatorText[];
 
     typedef QVariant( *FcnEval )( const QVariantList& values, const QgsFeature* f, QgsExpression* parent );
+    //! @note added in 2.1
+    typedef QVariant( *FcnContextEval )( const QVariantList& values, const QgsFeature* f, QgsExpressionContext* context );
 
 
     /**
@@ -254,7 +403,14 @@ class CORE_EXPORT QgsExpression
         /** The help text for the function. */
         QString helptext() { return mHelpText.isEmpty() ? QgsExpression::helptext( mName ) : mHelpText; }
 
-        virtual QVariant func( const QVariantList& values, const QgsFeature* f, QgsExpression* parent ) = 0;
+        //! Evaluates the function. Errors are reported to the parent expression.
+        //! Functions reimplement either this variant or the one taking an evaluation context,
+        //! the default implementation calls the other one
+        virtual QVariant func( const QVariantList& values, const QgsFeature* f, QgsExpression* parent );
+
+        //! Evaluates the function in the given evaluation context. Errors are reported to the context
+        //! @note added in 2.1
+        virtual QVariant func( const QVariantList& values, const QgsFeature* f, QgsExpressionContext* context );
 
         bool operator==( const Function& other ) const
         {
@@ -276,15 +432,29 @@ class CORE_EXPORT QgsExpression
     {
       public:
         StaticFunction( QString fnname, int params, FcnEval fcn, QString group, QString helpText = QString(), bool usesGeometry = false )
-            : Function( fnname, params, group, helpText, usesGeometry ), mFnc( fcn ) {}
+            : Function( fnname, params, group, helpText, usesGeometry ), mFnc( fcn ), mContextFnc( 0 ) {}
+
+        //! @note added in 2.1
+        StaticFunction( QString fnname, int params, FcnContextEval fcn, QString group, QString helpText = QString(), bool usesGeometry = false )
+            : Function( fnname, params, group, helpText, usesGeometry ), mFnc( 0 ), mContextFnc( fcn ) {}
 
         virtual QVariant func( const QVariantList& values, const QgsFeature* f, QgsExpression* parent )
         {
-          return mFnc( values, f, parent );
+          if ( mFnc )
+            return mFnc( values, f, parent );
+          return Function::func( values, f, parent );
+        }
+
+        virtual QVariant func( const QVariantList& values, const QgsFeature* f, QgsExpressionContext* context )
+        {
+          if ( mContextFnc )
+            return mContextFnc( values, f, context );
+          return Function::func( values, f, context );
         }
 
       private:
         FcnEval mFnc;
+        FcnContextEval mContextFnc;
     };
 
     static const QList<Function*> &Functions();
@@ -337,9 +507,10 @@ class CORE_EXPORT QgsExpression
       public:
         virtual ~Node() {}
         virtual NodeType nodeType() const = 0;
-        // abstract virtual eval function
-        // errors are reported to the parent
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f ) = 0;
+        // virtual eval function
+        // errors are reported to the parent. Nodes reimplement either this variant or the one
+        // taking an evaluation context, the default implementation calls the other one
+        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
 
         // abstract virtual preparation function
         // errors are reported to the parent
@@ -352,6 +523,11 @@ class CORE_EXPORT QgsExpression
 
         // support for visitor pattern
         virtual void accept( Visitor& v ) const = 0;
+
+        // evaluation in the given context, errors are reported to the context.
+        // Evaluation must not modify the node, so that a prepared tree can be evaluated from several threads
+        //! @note added in 2.1
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
     };
 
     class CORE_EXPORT NodeList
@@ -410,9 +586,14 @@ class CORE_EXPORT QgsExpression
 
         virtual NodeType nodeType() const { return ntUnaryOperator; }
         virtual bool prepare( QgsExpression* parent, const QgsFields &fields );
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
+        using Node::eval;
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
         virtual QString dump() const;
 
+        //! Applies the operator to an already evaluated operand
+        //! @note added in 2.1
+        QVariant evalValue( QgsExpressionContext* context, const QVariant& val ) const;
+
         virtual QStringList referencedColumns() const { return mOperand->referencedColumns(); }
         virtual bool needsGeometry() const { return mOperand->needsGeometry(); }
         virtual void accept( Visitor& v ) const { v.visit( *this ); }
@@ -434,18 +615,23 @@ class CORE_EXPORT QgsExpression
 
         virtual NodeType nodeType() const { return ntBinaryOperator; }
         virtual bool prepare( QgsExpression* parent, const QgsFields &fields );
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
+        using Node::eval;
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
         virtual QString dump() const;
 
+        //! Applies the operator to already evaluated operands
+        //! @note added in 2.1
+        QVariant evalValues( QgsExpressionContext* context, const QVariant& vL, const QVariant& vR ) const;
+
         virtual QStringList referencedColumns() const { return mOpLeft->referencedColumns() + mOpRight->referencedColumns(); }
         virtual bool needsGeometry() const { return mOpLeft->needsGeometry() || mOpRight->needsGeometry(); }
         virtual void accept( Visitor& v ) const { v.visit( *this ); }
 
       protected:
-        bool compare( double diff );
-        int computeInt( int x, int y );
-        double computeDouble( double x, double y );
-        QDateTime computeDateTimeFromInterval( QDateTime d, QgsExpression::Interval *i );
+        bool compare( double diff ) const;
+        int computeInt( int x, int y ) const;
+        double computeDouble( double x, double y ) const;
+        QDateTime computeDateTimeFromInterval( QDateTime d, QgsExpression::Interval *i ) const;
 
         BinaryOperator mOp;
         Node* mOpLeft;
@@ -464,7 +650,8 @@ class CORE_EXPORT QgsExpression
 
         virtual NodeType nodeType() const { return ntInOperator; }
         virtual bool prepare( QgsExpression* parent, const QgsFields &fields );
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
+        using Node::eval;
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
         virtual QString dump() const;
 
         virtual QStringList referencedColumns() const { QStringList lst( mNode->referencedColumns() ); foreach ( Node* n, mList->list() ) lst.append( n->referencedColumns() ); return lst; }
@@ -489,7 +676,8 @@ class CORE_EXPORT QgsExpression
 
         virtual NodeType nodeType() const { return ntFunction; }
         virtual bool prepare( QgsExpression* parent, const QgsFields &fields );
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
+        using Node::eval;
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
         virtual QString dump() const;
 
         virtual QStringList referencedColumns() const { QStringList lst; if ( !mArgs ) return lst; foreach ( Node* n, mArgs->list() ) lst.append( n->referencedColumns() ); return lst; }
@@ -511,7 +699,8 @@ class CORE_EXPORT QgsExpression
 
         virtual NodeType nodeType() const { return ntLiteral; }
         virtual bool prepare( QgsExpression* parent, const QgsFields &fields );
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
+        using Node::eval;
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
         virtual QString dump() const;
 
         virtual QStringList referencedColumns() const { return QStringList(); }
@@ -528,10 +717,14 @@ class CORE_EXPORT QgsExpression
         NodeColumnRef( QString name ) : mName( name ), mIndex( -1 ) {}
 
         QString name() const { return mName; }
+        //! Attribute index found by prepare() or -1
+        //! @note added in 2.1
+        int index() const { return mIndex; }
 
         virtual NodeType nodeType() const { return ntColumnRef; }
         virtual bool prepare( QgsExpression* parent, const QgsFields &fields );
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
+        using Node::eval;
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
         virtual QString dump() const;
 
         virtual QStringList referencedColumns() const { return QStringList( mName ); }
@@ -563,7 +756,8 @@ class CORE_EXPORT QgsExpression
         ~NodeCondition() { delete mElseExp; qDeleteAll( mConditions ); }
 
         virtual NodeType nodeType() const { return ntCondition; }
-        virtual QVariant eval( QgsExpression* parent, const QgsFeature* f );
+        using Node::eval;
+        virtual QVariant eval( QgsExpressionContext* context, const QgsFeature* f );
         virtual bool prepare( QgsExpression* parent, const QgsFields &fields );
         virtual QString dump() const;
 
@@ -601,21 +795,25 @@ class CORE_EXPORT QgsExpression
 
   protected:
     // internally used to create an empty expression
-    QgsExpression() : mRootNode( 0 ), mRowNumber( 0 ), mCalc( 0 ) {}
-
-    void initGeomCalculator();
+    QgsExpression() : mRootNode( 0 ), mCompiled( 0 ), mCompilationEnabled( true ), mPrepared( false ) {}
 
     Node* mRootNode;
 
     QString mParserErrorString;
-    QString mEvalErrorString;
 
-    int mRowNumber;
-    double mScale;
+    //! context of the evaluate() variants without explicit context (also holds preparation errors)
+    QgsExpressionContext mContext;
     QString mExp;
 
+    //! program compiled by prepare(), 0 if not compiled
+    QgsCompiledExpression* mCompiled;
+    bool mCompilationEnabled;
+
+    //! whether the last prepare() succeeded and the fields it used
+    bool mPrepared;
+    QList<QgsField> mPreparedFields;
+
     static QMap<QString, QVariant> gmSpecialColumns;
-    QgsDistanceArea *mCalc;
 
     friend class QgsOgcUtils;
 
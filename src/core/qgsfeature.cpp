@@ -71,6 +71,13 @@ QgsFeature & QgsFeature::operator=( QgsFeature const & rhs )
   mValid =  rhs.mValid;
   mFields = rhs.mFields;
 
+  if ( rhs.mGeometry && mGeometry && mOwnsGeometry )
+  {
+    // copy into the own geometry, which keeps its buffer if the new geometry fits in
+    *mGeometry = *rhs.mGeometry;
+    return *this;
+  }
+
   // make sure to delete the old geometry (if exists)
   if ( mGeometry && mOwnsGeometry )
     delete mGeometry;
@@ -159,6 +166,16 @@ void QgsFeature::setGeometryAndOwnership( unsigned char *geom, size_t length )
   setGeometry( g );
 }
 
+unsigned char *QgsFeature::geometryBuffer( size_t length )
+{
+  if ( !mGeometry || !mOwnsGeometry )
+  {
+    setGeometry( new QgsGeometry() );
+  }
+
+  return mGeometry->wkbBuffer( length );
+}
+
 void QgsFeature::setFields( const QgsFields* fields, bool init )
 {
   mFields = fields;
@@ -210,6 +210,17 @@ class CORE_EXPORT QgsFeature
      */
     void setGeometryAndOwnership( unsigned char * geom, size_t length );
 
+    /**
+     * Returns a buffer for length bytes of WKB to be filled in with this feature's new geometry.
+     *
+     * The geometry owned by this feature and its buffer are kept from one call to the next, so that
+     * providers filling the same feature during an iteration only allocate for geometries larger
+     * than all before.
+     * @note added in 2.1
+     * @note not available in python bindings
+     */
+    unsigned char* geometryBuffer( size_t length );
+
     /** Assign a field map with the feature to allow attribute access by attribute name
      *
      *  @param fields         The attribute fields which this feature holds. When used from python, make sure
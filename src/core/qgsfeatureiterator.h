@@ -33,6 +33,7 @@ class CORE_EXPORT QgsAbstractFeatureIterator
     virtual ~QgsAbstractFeatureIterator();
 
     //! fetch next feature, return true on success
+    //! Passing the same feature for the whole iteration lets providers reuse its geometry buffer and attributes
     virtual bool nextFeature( QgsFeature& f );
 
     //! reset the iterator to the starting position
@@ -0,0 +1,543 @@
+/***************************************************************************
+     qgsfeaturetable.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsfeaturetable.h"
+#include "qgsgeometry.h"
+
+#include <QBitArray>
+#include <QHash>
+
+#include <cstring>
+
+//! values of one field, in an array of the field type
+class QgsFeatureTableColumn
+{
+  public:
+    enum Storage
+    {
+      Int,
+      LongLong,
+      Double,
+      String,  // codes into the dictionary in mInts
+      Variant
+    };
+
+    QgsFeatureTableColumn( QVariant::Type theType, int theCount );
+
+    int count() const { return mNulls.size(); }
+    void resize( int theCount );
+    void reserve( int theCount );
+    void clear();
+
+    QVariant value( int theRow ) const;
+    void setValue( int theRow, const QVariant& theValue );
+    void setNull( int theRow );
+
+    //! copies a value over another one, for removing rows
+    void moveValue( int theFrom, int theTo );
+
+    qint64 memoryUsage() const;
+
+  private:
+    //! code of a string, the reference count of the code is incremented
+    int code( const QString& theString );
+
+    //! true if the row refers to a string of the dictionary
+    bool hasCode( int theRow ) const;
+
+    //! drops the reference of the row to its string, unused strings are removed from the dictionary
+    void release( int theRow );
+
+    QVariant::Type mType;
+    Storage mStorage;
+
+    QVector<int> mInts;
+    QVector<qlonglong> mLongLongs;
+    QVector<double> mDoubles;
+    QVector<QVariant> mVariants;
+
+    //! distinct strings of a string column, the codes are indexes
+    QVector<QString> mDictionary;
+    QHash<QString, int> mCodes;
+    //! number of rows using a code and the codes of removed strings for reuse
+    QVector<int> mRefCounts;
+    QVector<int> mFreeCodes;
+
+    //! set for nulls of the field type
+    QBitArray mNulls;
+
+    //! values of another type than the field including invalid values, kept as they are
+    QHash<int, QVariant> mMixed;
+};
+
+QgsFeatureTableColumn::QgsFeatureTableColumn( QVariant::Type theType, int theCount )
+    : mType( theType )
+{
+  switch ( theType )
+  {
+    case QVariant::Int:
+      mStorage = Int;
+      break;
+    case QVariant::LongLong:
+      mStorage = LongLong;
+      break;
+    case QVariant::Double:
+      mStorage = Double;
+      break;
+    case QVariant::String:
+      mStorage = String;
+      break;
+    default:
+      mStorage = Variant;
+      break;
+  }
+  resize( theCount );
+}
+
+void QgsFeatureTableColumn::resize( int theCount )
+{
+  int myOldCount = count();
+  for ( int i = theCount; i < myOldCount; ++i )
+  {
+    release( i );
+    if ( !mMixed.isEmpty() )
+      mMixed.remove( i );
+  }
+
+  switch ( mStorage )
+  {
+    case Int:
+    case String:
+      mInts.resize( theCount );
+      break;
+    case LongLong:
+      mLongLongs.resize( theCount );
+      break;
+    case Double:
+      mDoubles.resize( theCount );
+      break;
+    case Variant:
+      mVariants.resize( theCount );
+      break;
+  }
+
+  mNulls.resize( theCount );
+  if ( theCount > myOldCount )
+  {
+    // new rows are null
+    mNulls.fill( true, myOldCount, theCount );
+  }
+}
+
+void QgsFeatureTableColumn::reserve( int theCount )
+{
+  switch ( mStorage )
+  {
+    case Int:
+    case String:
+      mInts.reserve( theCount );
+      break;
+    case LongLong:
+      mLongLongs.reserve( theCount );
+      break;
+    case Double:
+      mDoubles.reserve( theCount );
+      break;
+    case Variant:
+      mVariants.reserve( theCount );
+      break;
+  }
+}
+
+void QgsFeatureTableColumn::clear()
+{
+  mInts.clear();
+  mLongLongs.clear();
+  mDoubles.clear();
+  mVariants.clear();
+  mDictionary.clear();
+  mCodes.clear();
+  mRefCounts.clear();
+  mFreeCodes.clear();
+  mNulls.clear();
+  mMixed.clear();
+}
+
+int QgsFeatureTableColumn::code( const QString& theString )
+{
+  QHash<QString, int>::const_iterator it = mCodes.constFind( theString );
+  if ( it != mCodes.constEnd() )
+  {
+    ++mRefCounts[it.value()];
+    return it.value();
+  }
+
+  int myCode;
+  if ( mFreeCodes.isEmpty() )
+  {
+    myCode = mDictionary.size();
+    mDictionary.append( theString );
+    mRefCounts.append( 1 );
+  }
+  else
+  {
+    myCode = mFreeCodes.last();
+    mFreeCodes.pop_back();
+    mDictionary[myCode] = theString;
+    mRefCounts[myCode] = 1;
+  }
+  mCodes.insert( theString, myCode );
+  return myCode;
+}
+
+bool QgsFeatureTableColumn::hasCode( int theRow ) const
+{
+  return mStorage == String && !mNulls.testBit( theRow ) && ( mMixed.isEmpty() || !mMixed.contains( theRow ) );
+}
+
+void QgsFeatureTableColumn::release( int theRow )
+{
+  if ( !hasCode( theRow ) )
+    return;
+
+  int myCode = mInts[theRow];
+  if ( --mRefCounts[myCode] == 0 )
+  {
+    mCodes.remove( mDictionary[myCode] );
+    mDictionary[myCode] = QString();
+    mFreeCodes.append( myCode );
+  }
+}
+
+QVariant QgsFeatureTableColumn::value( int theRow ) const
+{
+  if ( mNulls.testBit( theRow ) )
+    return QVariant( mType );
+
+  if ( !mMixed.isEmpty() )
+  {
+    QHash<int, QVariant>::const_iterator it = mMixed.constFind( theRow );
+    if ( it != mMixed.constEnd() )
+      return it.value();
+  }
+
+  switch ( mStorage )
+  {
+    case Int:
+      return QVariant( mInts[theRow] );
+    case LongLong:
+      return QVariant( mLongLongs[theRow] );
+    case Double:
+      return QVariant( mDoubles[theRow] );
+    case String:
+      return QVariant( mDictionary[mInts[theRow]] );
+    case Variant:
+      break;
+  }
+  return mVariants[theRow];
+}
+
+void QgsFeatureTableColumn::setNull( int theRow )
+{
+  release( theRow );
+  if ( !mMixed.isEmpty() )
+    mMixed.remove( theRow );
+
+  mNulls.setBit( theRow );
+  if ( mStorage == Variant )
+    mVariants[theRow] = QVariant();
+}
+
+void QgsFeatureTableColumn::setValue( int theRow, const QVariant& theValue )
+{
+  // only nulls of the field type go to the bitmap, so that invalid values
+  // and nulls of other types are returned as they were set
+  if ( theValue.isNull() && theValue.type() == mType )
+  {
+    setNull( theRow );
+    return;
+  }
+
+  release( theRow );
+  if ( !mMixed.isEmpty() )
+    mMixed.remove( theRow );
+  mNulls.clearBit( theRow );
+
+  if ( mStorage == Variant )
+  {
+    mVariants[theRow] = theValue;
+    return;
+  }
+
+  if ( theValue.type() != mType )
+  {
+    mMixed.insert( theRow, theValue );
+    return;
+  }
+
+  switch ( mStorage )
+  {
+    case Int:
+      mInts[theRow] = theValue.toInt();
+      break;
+    case LongLong:
+      mLongLongs[theRow] = theValue.toLongLong();
+      break;
+    case Double:
+      mDoubles[theRow] = theValue.toDouble();
+      break;
+    case String:
+      mInts[theRow] = code( theValue.toString() );
+      break;
+    case Variant:
+      break;
+  }
+}
+
+void QgsFeatureTableColumn::moveValue( int theFrom, int theTo )
+{
+  release( theTo );
+
+  switch ( mStorage )
+  {
+    case Int:
+    case String:
+      mInts[theTo] = mInts[theFrom];
+      break;
+    case LongLong:
+      mLongLongs[theTo] = mLongLongs[theFrom];
+      break;
+    case Double:
+      mDoubles[theTo] = mDoubles[theFrom];
+      break;
+    case Variant:
+      mVariants[theTo] = mVariants[theFrom];
+      break;
+  }
+  mNulls.setBit( theTo, mNulls.testBit( theFrom ) );
+
+  if ( !mMixed.isEmpty() )
+  {
+    mMixed.remove( theTo );
+    if ( mMixed.contains( theFrom ) )
+      mMixed.insert( theTo, mMixed.value( theFrom ) );
+  }
+
+  // both rows refer to the string until theFrom is released
+  if ( hasCode( theTo ) )
+    ++mRefCounts[mInts[theTo]];
+}
+
+qint64 QgsFeatureTableColumn::memoryUsage() const
+{
+  // hash nodes hold the key, the value and the next and hash fields
+  qint64 mySize = sizeof( *this ) + mNulls.size() / 8;
+  mySize += mInts.capacity() * sizeof( int );
+  mySize += mLongLongs.capacity() * sizeof( qlonglong );
+  mySize += mDoubles.capacity() * sizeof( double );
+  mySize += mVariants.capacity() * sizeof( QVariant );
+  for ( int i = 0; i < mVariants.size(); ++i )
+  {
+    if ( mVariants[i].type() == QVariant::String )
+      mySize += mVariants[i].toString().capacity() * sizeof( QChar );
+  }
+  mySize += mDictionary.capacity() * sizeof( QString );
+  mySize += ( mRefCounts.capacity() + mFreeCodes.capacity() ) * sizeof( int );
+  for ( int i = 0; i < mDictionary.size(); ++i )
+  {
+    if ( mDictionary[i].isNull() )
+      continue;
+    mySize += mDictionary[i].capacity() * sizeof( QChar ) + sizeof( QString ) + sizeof( int ) + 2 * sizeof( void* );
+  }
+  mySize += mMixed.size() * ( sizeof( QVariant ) + sizeof( int ) + 2 * sizeof( void* ) );
+  return mySize;
+}
+
+
+QgsFeatureTable::QgsFeatureTable( const QgsFields& fields )
+{
+  for ( int i = 0; i < fields.count(); ++i )
+  {
+    addField( fields[i] );
+  }
+}
+
+QgsFeatureTable::~QgsFeatureTable()
+{
+  qDeleteAll( mGeometries );
+  qDeleteAll( mColumns );
+}
+
+void QgsFeatureTable::clear()
+{
+  qDeleteAll( mGeometries );
+  mGeometries.clear();
+  mIds.clear();
+  foreach ( QgsFeatureTableColumn* myColumn, mColumns )
+  {
+    myColumn->clear();
+  }
+}
+
+void QgsFeatureTable::reserve( int theCount )
+{
+  mIds.reserve( theCount );
+  mGeometries.reserve( theCount );
+  foreach ( QgsFeatureTableColumn* myColumn, mColumns )
+  {
+    myColumn->reserve( theCount );
+  }
+}
+
+int QgsFeatureTable::append( const QgsFeature& theFeature )
+{
+  int myRow = mIds.size();
+  mIds.append( theFeature.id() );
+  mGeometries.append( theFeature.geometry() ? new QgsGeometry( *theFeature.geometry() ) : 0 );
+
+  const QgsAttributes& myAttributes = theFeature.attributes();
+  for ( int i = 0; i < mColumns.size(); ++i )
+  {
+    mColumns[i]->resize( myRow + 1 );
+    if ( i < myAttributes.size() )
+      mColumns[i]->setValue( myRow, myAttributes[i] );
+  }
+  return myRow;
+}
+
+void QgsFeatureTable::removeRow( int theRow )
+{
+  int myLast = mIds.size() - 1;
+  delete mGeometries[theRow];
+  if ( theRow != myLast )
+  {
+    mIds[theRow] = mIds[myLast];
+    mGeometries[theRow] = mGeometries[myLast];
+    foreach ( QgsFeatureTableColumn* myColumn, mColumns )
+    {
+      myColumn->moveValue( myLast, theRow );
+    }
+  }
+
+  mIds.resize( myLast );
+  mGeometries.resize( myLast );
+  foreach ( QgsFeatureTableColumn* myColumn, mColumns )
+  {
+    myColumn->resize( myLast );
+  }
+}
+
+void QgsFeatureTable::setGeometry( int theRow, const QgsGeometry* theGeometry )
+{
+  QgsGeometry*& myGeometry = mGeometries[theRow];
+  if ( myGeometry && theGeometry )
+  {
+    *myGeometry = *theGeometry;
+  }
+  else
+  {
+    delete myGeometry;
+    myGeometry = theGeometry ? new QgsGeometry( *theGeometry ) : 0;
+  }
+}
+
+QVariant QgsFeatureTable::attribute( int theRow, int theField ) const
+{
+  if ( theField < 0 || theField >= mColumns.size() )
+    return QVariant();
+
+  return mColumns[theField]->value( theRow );
+}
+
+bool QgsFeatureTable::setAttribute( int theRow, int theField, const QVariant& theValue )
+{
+  if ( theField < 0 || theField >= mColumns.size() )
+    return false;
+
+  mColumns[theField]->setValue( theRow, theValue );
+  return true;
+}
+
+QgsAttributes QgsFeatureTable::attributes( int theRow ) const
+{
+  QgsAttributes myAttributes( mColumns.size() );
+  for ( int i = 0; i < mColumns.size(); ++i )
+  {
+    myAttributes[i] = mColumns[i]->value( theRow );
+  }
+  return myAttributes;
+}
+
+void QgsFeatureTable::setAttributes( int theRow, const QgsAttributes& theAttributes )
+{
+  for ( int i = 0; i < mColumns.size(); ++i )
+  {
+    if ( i < theAttributes.size() )
+      mColumns[i]->setValue( theRow, theAttributes[i] );
+    else
+      mColumns[i]->setNull( theRow );
+  }
+}
+
+void QgsFeatureTable::feature( int theRow, QgsFeature& theFeature ) const
+{
+  theFeature.setFeatureId( mIds[theRow] );
+
+  const QgsGeometry* myGeometry = mGeometries[theRow];
+  if ( myGeometry && myGeometry->asWkb() )
+  {
+    const unsigned char* myWkb = myGeometry->asWkb();
+    size_t mySize = myGeometry->wkbSize();
+    memcpy( theFeature.geometryBuffer( mySize ), myWkb, mySize );
+  }
+  else
+  {
+    theFeature.setGeometry( myGeometry ? new QgsGeometry( *myGeometry ) : 0 );
+  }
+
+  QgsAttributes& myAttributes = theFeature.attributes();
+  myAttributes.resize( mColumns.size() );
+  for ( int i = 0; i < mColumns.size(); ++i )
+  {
+    myAttributes[i] = mColumns[i]->value( theRow );
+  }
+}
+
+void QgsFeatureTable::addField( const QgsField& theField )
+{
+  mColumns.append( new QgsFeatureTableColumn( theField.type(), mIds.size() ) );
+}
+
+void QgsFeatureTable::removeField( int theField )
+{
+  if ( theField < 0 || theField >= mColumns.size() )
+    return;
+
+  delete mColumns.takeAt( theField );
+}
+
+qint64 QgsFeatureTable::memoryUsage() const
+{
+  qint64 mySize = mIds.capacity() * sizeof( QgsFeatureId ) + mGeometries.capacity() * sizeof( QgsGeometry* );
+  foreach ( const QgsGeometry* myGeometry, mGeometries )
+  {
+    if ( myGeometry )
+      mySize += sizeof( QgsGeometry ) + myGeometry->wkbSize();
+  }
+  foreach ( const QgsFeatureTableColumn* myColumn, mColumns )
+  {
+    mySize += myColumn->memoryUsage();
+  }
+  return mySize;
+}
@@ -0,0 +1,107 @@
+/***************************************************************************
+     qgsfeaturetable.h
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSFEATURETABLE_H
+#define QGSFEATURETABLE_H
+
+#include "qgsfeature.h"
+#include "qgsfield.h"
+
+#include <QList>
+#include <QVector>
+
+class QgsFeatureTableColumn;
+
+/** \ingroup core
+ * Features held in memory with their attributes in typed columns.
+ *
+ * Integer, 64 bit integer and double attributes are stored in plain arrays and strings
+ * once per distinct value in use with a code per feature, nulls of the field type in a bitmap
+ * per column. Values of other field types and values not of the type of their field, including
+ * invalid values, are kept as QVariant and returned as they were set.
+ * Features are addressed by their row, removing a row moves the last row into its place.
+ * Rows must be valid, i.e. 0 <= row < count().
+ * @note added in 2.1
+ */
+class CORE_EXPORT QgsFeatureTable
+{
+  public:
+    //! Constructor
+    QgsFeatureTable( const QgsFields& fields = QgsFields() );
+
+    //! Destructor
+    ~QgsFeatureTable();
+
+    /** Number of features */
+    int count() const { return mIds.size(); }
+
+    /** Number of attribute columns */
+    int fieldCount() const { return mColumns.size(); }
+
+    /** Removes all features, the columns are kept */
+    void clear();
+
+    /** Reserves memory for the given number of features */
+    void reserve( int theCount );
+
+    /** Appends a copy of the id, geometry and attributes of the feature
+     * @return row of the new feature */
+    int append( const QgsFeature& theFeature );
+
+    /** Removes a feature, the last feature moves into its row */
+    void removeRow( int theRow );
+
+    QgsFeatureId id( int theRow ) const { return mIds[theRow]; }
+    void setId( int theRow, QgsFeatureId theId ) { mIds[theRow] = theId; }
+
+    /** Geometry of a feature, 0 if it has none */
+    QgsGeometry* geometry( int theRow ) const { return mGeometries[theRow]; }
+
+    /** Sets a copy of the geometry, 0 removes the geometry */
+    void setGeometry( int theRow, const QgsGeometry* theGeometry );
+
+    /** Value of an attribute, invalid if the field does not exist */
+    QVariant attribute( int theRow, int theField ) const;
+
+    /** Sets the value of an attribute
+     * @return false, if the field does not exist */
+    bool setAttribute( int theRow, int theField, const QVariant& theValue );
+
+    QgsAttributes attributes( int theRow ) const;
+
+    /** Sets the attributes of a feature, missing attributes are set to null of the field type */
+    void setAttributes( int theRow, const QgsAttributes& theAttributes );
+
+    /** Fills a feature with the id, geometry and attributes of a row. The geometry buffer
+     * and attributes of the feature are reused, see QgsFeature::geometryBuffer() */
+    void feature( int theRow, QgsFeature& theFeature ) const;
+
+    /** Appends a column for the field, null for the existing features */
+    void addField( const QgsField& theField );
+
+    /** Removes the column of a field */
+    void removeField( int theField );
+
+    /** Approximate number of bytes used for the features */
+    qint64 memoryUsage() const;
+
+  private:
+    QgsFeatureTable( const QgsFeatureTable& rh );
+    QgsFeatureTable& operator=( const QgsFeatureTable& rh );
+
+    QVector<QgsFeatureId> mIds;
+    QVector<QgsGeometry*> mGeometries;
+    QList<QgsFeatureTableColumn*> mColumns;
+};
+
+#endif
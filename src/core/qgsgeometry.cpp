@@ -18,6 +18,10 @@ email                : morb at ozemail dot com dot au
 #include <cstdio>
 #include <cmath>
 
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+
 #include "qgis.h"
 #include "qgsgeometry.h"
 #include "qgsapplication.h"
@@ -40,6 +44,55 @@ email                : morb at ozemail dot com dot au
 
 #define DEFAULT_QUADRANT_SEGMENTS 8
 
+// Allocated sizes of the WKB buffers which are larger than their geometry, see wkbBuffer().
+// They are kept outside of QgsGeometry so that its layout is unchanged. A geometry without
+// an entry has a buffer of exactly mGeometrySize bytes, every function replacing the buffer
+// of a geometry removes its entry.
+struct QgsWkbCapacities
+{
+  QMutex mutex;
+  QHash<const QgsGeometry*, size_t> capacities;
+};
+Q_GLOBAL_STATIC( QgsWkbCapacities, wkbCapacities )
+
+// number of entries, to skip the lock while no geometry has a larger buffer
+static QAtomicInt sWkbCapacityCount;
+
+static size_t wkbCapacity( const QgsGeometry* geom, size_t size )
+{
+  QgsWkbCapacities* c = wkbCapacities();
+  if ( sWkbCapacityCount == 0 || !c )
+    return size;
+
+  QMutexLocker locker( &c->mutex );
+  return c->capacities.value( geom, size );
+}
+
+static void clearWkbCapacity( const QgsGeometry* geom )
+{
+  QgsWkbCapacities* c = wkbCapacities();
+  if ( sWkbCapacityCount == 0 || !c )
+    return;
+
+  QMutexLocker locker( &c->mutex );
+  if ( c->capacities.remove( geom ) )
+    sWkbCapacityCount = c->capacities.size();
+}
+
+static void setWkbCapacity( const QgsGeometry* geom, size_t capacity, size_t size )
+{
+  QgsWkbCapacities* c = wkbCapacities();
+  if ( capacity <= size || !c )
+  {
+    clearWkbCapacity( geom );
+    return;
+  }
+
+  QMutexLocker locker( &c->mutex );
+  c->capacities.insert( geom, capacity );
+  sWkbCapacityCount = c->capacities.size();
+}
+
 #define CATCH_GEOS(r) \
   catch (GEOSException &e) \
   { \
@@ -221,6 +274,7 @@ QgsGeometry::~QgsGeometry()
 {
   if ( mGeometry )
     delete [] mGeometry;
+  clearWkbCapacity( this );
 
   if ( mGeos )
     GEOSGeom_destroy( mGeos );
@@ -547,28 +601,19 @@ QgsGeometry & QgsGeometry::operator=( QgsGeometry const & rhs )
   if ( &rhs == this )
     return *this;
 
-  // remove old geometry if it exists
-  if ( mGeometry )
-  {
-    delete [] mGeometry;
-    mGeometry = 0;
-  }
+  // replace the old geometry, keeping its buffer if the new one fits in
+  unsigned char *wkb = wkbBuffer( rhs.mGeometry ? rhs.mGeometrySize : 0 );
+  if ( wkb )
+    memcpy( wkb, rhs.mGeometry, rhs.mGeometrySize );
 
   mGeometrySize    = rhs.mGeometrySize;
 
   // deep-copy the GEOS Geometry if appropriate
-  GEOSGeom_destroy( mGeos );
   mGeos = rhs.mGeos ? GEOSGeom_clone( rhs.mGeos ) : 0;
 
   mDirtyGeos = rhs.mDirtyGeos;
   mDirtyWkb  = rhs.mDirtyWkb;
 
-  if ( mGeometrySize && rhs.mGeometry )
-  {
-    mGeometry = new unsigned char[mGeometrySize];
-    memcpy( mGeometry, rhs.mGeometry, mGeometrySize );
-  }
-
   return *this;
 } // QgsGeometry::operator=( QgsGeometry const & rhs )
 
@@ -589,10 +634,36 @@ void QgsGeometry::fromWkb( unsigned char *wkb, size_t length )
   }
 
   mGeometry = wkb;
+  mGeometrySize = length;
+  clearWkbCapacity( this );
+
+  mDirtyWkb   = false;
+  mDirtyGeos  = true;
+}
+
+unsigned char *QgsGeometry::wkbBuffer( size_t length )
+{
+  if ( mGeos )
+  {
+    GEOSGeom_destroy( mGeos );
+    mGeos = 0;
+  }
+
+  size_t capacity = mGeometry ? wkbCapacity( this, mGeometrySize ) : 0;
+  if ( length == 0 || length > capacity )
+  {
+    delete [] mGeometry;
+    mGeometry = length > 0 ? new unsigned char[length] : 0;
+    capacity = length;
+  }
+  setWkbCapacity( this, capacity, length );
+
   mGeometrySize = length;
 
   mDirtyWkb   = false;
   mDirtyGeos  = true;
+
+  return mGeometry;
 }
 
 const unsigned char *QgsGeometry::asWkb() const
@@ -694,6 +765,7 @@ void QgsGeometry::fromGeos( GEOSGeometry *geos )
   {
     delete [] mGeometry;
     mGeometry = 0;
+    clearWkbCapacity( this );
   }
 
   mGeos = geos;
@@ -1564,6 +1636,7 @@ bool QgsGeometry::deleteVertex( int atVertex )
     delete [] mGeometry;
     mGeometry = dstBuffer;
     mGeometrySize -= ps;
+    clearWkbCapacity( this );
     mDirtyGeos = true;
     return true;
   }
@@ -1757,6 +1830,7 @@ bool QgsGeometry::insertVertex( double x, double y, int beforeVertex )
     delete [] mGeometry;
     mGeometry = dstBuffer;
     mGeometrySize += ps;
+    clearWkbCapacity( this );
     mDirtyGeos = true;
     return true;
   }
@@ -4104,6 +4178,7 @@ bool QgsGeometry::exportGeosToWkb() const
   {
     delete [] mGeometry;
     mGeometry = 0;
+    clearWkbCapacity( this );
   }
 
   if ( !mGeos )
@@ -4124,6 +4199,7 @@ bool QgsGeometry::exportGeosToWkb() const
                       sizeof( int ) +
                       2 * sizeof( double );
       mGeometry = new unsigned char[mGeometrySize];
+      clearWkbCapacity( this );
 
 
       const GEOSCoordSequence *cs = GEOSGeom_getCoordSeq( mGeos );
@@ -4155,6 +4231,7 @@ bool QgsGeometry::exportGeosToWkb() const
                          sizeof( double ) ) * nPoints );
 
       mGeometry = new unsigned char[mGeometrySize];
+      clearWkbCapacity( this );
       QgsWkbPtr wkbPtr( mGeometry );
 
       wkbPtr << byteOrder << QGis::WKBLineString << nPoints;
@@ -4206,6 +4283,7 @@ bool QgsGeometry::exportGeosToWkb() const
 
       mGeometry = new unsigned char[geometrySize];
       mGeometrySize = geometrySize;
+      clearWkbCapacity( this );
 
       //then fill the geometry itself into the wkb
       QgsWkbPtr wkbPtr( mGeometry );
@@ -4269,6 +4347,7 @@ bool QgsGeometry::exportGeosToWkb() const
 
       mGeometry = new unsigned char[geometrySize];
       mGeometrySize = geometrySize;
+      clearWkbCapacity( this );
 
       QgsWkbPtr wkbPtr( mGeometry );
       int numPoints = GEOSGetNumGeometries( mGeos );
@@ -4305,6 +4384,7 @@ bool QgsGeometry::exportGeosToWkb() const
 
       mGeometry = new unsigned char[geometrySize];
       mGeometrySize = geometrySize;
+      clearWkbCapacity( this );
 
       QgsWkbPtr wkbPtr( mGeometry );
 
@@ -4361,6 +4441,7 @@ bool QgsGeometry::exportGeosToWkb() const
 
       mGeometry = new unsigned char[geometrySize];
       mGeometrySize = geometrySize;
+      clearWkbCapacity( this );
 
       QgsWkbPtr wkbPtr( mGeometry );
       int numPolygons = GEOSGetNumGeometries( mGeos );
@@ -4490,6 +4571,7 @@ bool QgsGeometry::convertToMultiType()
   delete [] mGeometry;
   mGeometry = newGeometry;
   mGeometrySize = newGeomSize;
+  clearWkbCapacity( this );
   mDirtyGeos = true;
   return true;
 }
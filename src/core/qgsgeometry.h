@@ -117,6 +117,15 @@ class CORE_EXPORT QgsGeometry
      */
     void fromWkb( unsigned char * wkb, size_t length );
 
+    /**
+      Returns a buffer for length bytes of WKB to be filled in by the caller, the previous geometry is discarded.
+      The buffer of the previous geometry is reused if the new one fits in, so that a geometry refilled
+      feature by feature only allocates for features larger than all before.
+      @note added in 2.1
+      @note not available in python bindings
+     */
+    unsigned char* wkbBuffer( size_t length );
+
     /**
        Returns the buffer containing this geometry in WKB format.
        You may wish to use in conjunction with wkbSize().
@@ -19,12 +19,25 @@
 #include "qgsmaplayer.h"
 #include "qgslogger.h"
 
+#include <QThreadStorage>
+
 //
 // Static calls to enforce singleton behaviour
 //
 QgsMapLayerRegistry *QgsMapLayerRegistry::mInstance = 0;
+bool QgsMapLayerRegistry::mThreadLocalInstances = false;
 QgsMapLayerRegistry *QgsMapLayerRegistry::instance()
 {
+  if ( mThreadLocalInstances )
+  {
+    static QThreadStorage<QgsMapLayerRegistry*> sInstances;
+    if ( !sInstances.hasLocalData() )
+    {
+      sInstances.setLocalData( new QgsMapLayerRegistry() );
+    }
+    return sInstances.localData();
+  }
+
   if ( mInstance == 0 )
   {
     mInstance = new QgsMapLayerRegistry();
@@ -32,6 +45,11 @@ QgsMapLayerRegistry *QgsMapLayerRegistry::instance()
   return mInstance;
 }
 
+void QgsMapLayerRegistry::setThreadLocalInstances( bool enabled )
+{
+  mThreadLocalInstances = enabled;
+}
+
 //
 // Main class begins now...
 //
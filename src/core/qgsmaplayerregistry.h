@@ -38,6 +38,13 @@ class CORE_EXPORT QgsMapLayerRegistry : public QObject
     //! Returns the instance pointer, creating the object on the first call
     static QgsMapLayerRegistry * instance();
 
+    /** Use a separate registry in every thread. This is meant for multi-threaded
+     * servers where each request handling thread manages its own set of layers.
+     * Must be set before the registry is used for the first time.
+     * @note added in 2.1
+     */
+    static void setThreadLocalInstances( bool enabled );
+
     //! Return the number of registered layers.
     int count();
 
@@ -248,6 +255,7 @@ class CORE_EXPORT QgsMapLayerRegistry : public QObject
 
   private:
     static QgsMapLayerRegistry *mInstance;
+    static bool mThreadLocalInstances;
     QMap<QString, QgsMapLayer*> mMapLayers;
     QSet<QgsMapLayer*> mOwnedLayers;
 }; // class QgsMapLayerRegistry
@@ -27,6 +27,7 @@
 #include "qgsmaplayerregistry.h"
 #include "qgsdistancearea.h"
 #include "qgsproject.h"
+#include "qgsrasterlayer.h"
 #include "qgsvectorlayer.h"
 
 
@@ -38,6 +39,8 @@
 #include <QSettings>
 #include <QTime>
 #include <QCoreApplication>
+#include <QWaitCondition>
+#include <QtConcurrentMap>
 
 QgsMapRenderer::QgsMapRenderer()
 {
@@ -59,6 +62,12 @@ QgsMapRenderer::QgsMapRenderer()
   mOutputUnits = QgsMapRenderer::Millimeters;
 
   mLabelingEngine = NULL;
+
+  QSettings settings;
+  mParallelRendering = settings.value( "/qgis/parallel_rendering", false ).toBool();
+  mParallelJobs = 0;
+
+  connect( QgsMapLayerRegistry::instance(), SIGNAL( layersWillBeRemoved( QStringList ) ), this, SLOT( onLayersWillBeRemoved( QStringList ) ) );
 }
 
 QgsMapRenderer::~QgsMapRenderer()
@@ -345,6 +354,19 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
   QListIterator<QString> li( mLayerSet );
   li.toBack();
 
+  // parallel rendering composites per-layer images, so it is only used
+  // when painting unscaled onto a raster device
+  if ( mParallelRendering
+       && !mRenderContext.forceVectorOutput()
+       && ( thePaintDevice->devType() == QInternal::Image || thePaintDevice->devType() == QInternal::Pixmap )
+       && painter->worldTransform().isIdentity()
+       && qAbs( rasterScaleFactor - 1.0 ) < 0.000001 )
+  {
+    renderLayersParallel( painter, mySameAsLastFlag );
+    // all layers are done, skip the sequential rendering loop
+    li.toFront();
+  }
+
   QgsRectangle r1, r2;
 
   while ( li.hasPrevious() )
@@ -694,6 +716,369 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
   mDrawing = false;
 }
 
+/** Shared progress state of a parallel rendering run */
+struct QgsMapRendererParallelState
+{
+  QMutex mutex;
+  QWaitCondition jobFinished;
+  int finishedJobs;
+};
+
+/** Rendering of a single layer into its own image in parallel rendering mode */
+struct QgsMapRendererLayerJob
+{
+  QgsMapRendererLayerJob()
+      : layer( 0 )
+      , split( false )
+      , image( 0 )
+      , ct( 0 )
+      , mainThread( false )
+      , cached( false )
+      , cacheable( false )
+      , antialiasing( true )
+      , error( false )
+      , state( 0 )
+  {}
+
+  QgsMapLayer* layer;
+  QgsRenderContext context;
+  //! second extent if the layer extent crosses the 180 degree line
+  QgsRectangle extent2;
+  bool split;
+  QImage* image;
+  //! private copy of the layer transformation (proj handles may not be shared between threads)
+  QgsCoordinateTransform* ct;
+  //! layer has to be rendered in the main thread
+  bool mainThread;
+  //! image is the layer's cache image and does not need rendering
+  bool cached;
+  //! image may be stored as the layer's cache image
+  bool cacheable;
+  bool antialiasing;
+  //! layer's draw() returned false
+  bool error;
+  QgsMapRendererParallelState* state;
+};
+
+static void renderLayerJob( QgsMapRendererLayerJob& job )
+{
+  if ( !job.cached && !job.context.renderingStopped() )
+  {
+    QPainter painter( job.image );
+    if ( job.antialiasing )
+    {
+      painter.setRenderHint( QPainter::Antialiasing );
+    }
+    job.context.setPainter( &painter );
+
+    QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( job.layer );
+    if ( vl && job.context.useAdvancedEffects() && vl->featureBlendMode() != QPainter::CompositionMode_SourceOver )
+    {
+      // features drawn on this layer interact and blend with each other
+      painter.setCompositionMode( vl->featureBlendMode() );
+    }
+
+    job.error = !job.layer->draw( job.context );
+    if ( job.split )
+    {
+      job.context.setExtent( job.extent2 );
+      job.error = !job.layer->draw( job.context ) || job.error;
+    }
+
+    if ( vl && job.context.useAdvancedEffects() && vl->layerTransparency() != 0 )
+    {
+      // combine the alpha of the flattened layer with the layer transparency
+      QColor transparentFillColor = QColor( 0, 0, 0, 255 - ( 255 * vl->layerTransparency() / 100 ) );
+      painter.setCompositionMode( QPainter::CompositionMode_DestinationIn );
+      painter.fillRect( 0, 0, job.image->width(), job.image->height(), transparentFillColor );
+    }
+
+    painter.end();
+    job.context.setPainter( 0 );
+  }
+
+  QMutexLocker locker( &job.state->mutex );
+  job.state->finishedJobs++;
+  job.state->jobFinished.wakeAll();
+}
+
+static void renderWorkerLayerJob( QgsMapRendererLayerJob& job )
+{
+  if ( !job.mainThread )
+  {
+    renderLayerJob( job );
+  }
+}
+
+void QgsMapRenderer::renderLayersParallel( QPainter* painter, bool sameAsLastRender )
+{
+  QSettings mySettings;
+  bool useRenderCaching = mySettings.value( "/qgis/enable_render_caching", false ).toBool();
+  bool antialiasing = mySettings.value( "/qgis/enable_anti_aliasing", true ).toBool();
+
+  QgsMapRendererParallelState state;
+  state.finishedJobs = 0;
+
+  // the job contexts are copies of the render context sharing its stop flag, so
+  // cancelling the render reaches the layers drawn by the workers and in the main thread
+  QAtomicInt stopped( mRenderContext.renderingStopped() );
+  mRenderContext.setRenderingStoppedFlag( &stopped );
+
+  QList<QgsMapRendererLayerJob> jobs;
+
+  // prepare the jobs in the main thread, starting at the base of the stack
+  QListIterator<QString> li( mLayerSet );
+  li.toBack();
+  while ( li.hasPrevious() )
+  {
+    QString layerId = li.previous();
+    QgsMapLayer *ml = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+    if ( !ml )
+    {
+      QgsDebugMsg( "Layer not found in registry!" );
+      continue;
+    }
+
+    if ( ml->hasScaleBasedVisibility() && ( ml->minimumScale() > mScale || mScale >= ml->maximumScale() ) && !mOverview )
+    {
+      QgsDebugMsg( "Layer not rendered because it is not within the defined visibility scale range" );
+      continue;
+    }
+
+    QgsMapRendererLayerJob job;
+    job.layer = ml;
+    job.context = mRenderContext;
+    job.mainThread = !canRenderLayerInThread( ml );
+    job.antialiasing = antialiasing;
+    job.state = &state;
+
+    if ( hasCrsTransformEnabled() )
+    {
+      QgsRectangle r1 = mExtent;
+      job.split = splitLayersExtent( ml, r1, job.extent2 );
+      if ( !r1.isFinite() || !job.extent2.isFinite() ) //there was a problem transforming the extent. Skip the layer
+      {
+        continue;
+      }
+      job.context.setExtent( r1 );
+
+      const QgsCoordinateTransform* ct = transformation( ml );
+      if ( ct && !job.mainThread )
+      {
+        job.ct = new QgsCoordinateTransform( ct->sourceCrs(), ct->destCRS() );
+        job.ct->setSourceDatumTransform( ct->sourceDatumTransform() );
+        job.ct->setDestinationDatumTransform( ct->destinationDatumTransform() );
+        job.ct->initialise();
+        ct = job.ct;
+      }
+      job.context.setCoordinateTransform( ct );
+    }
+    else
+    {
+      job.context.setCoordinateTransform( 0 );
+    }
+
+    // Force render of layers that are being edited
+    // or if there's a labeling engine that needs the layer to register features
+    if ( ml->type() == QgsMapLayer::VectorLayer )
+    {
+      QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( ml );
+      if ( vl->isEditable() || ( mLabelingEngine && mLabelingEngine->willUseLayer( vl ) ) )
+      {
+        ml->setCacheImage( 0 );
+      }
+    }
+
+    //render caching does not yet cater for split extents
+    job.cacheable = useRenderCaching && !job.split;
+    if ( job.cacheable && sameAsLastRender && ml->cacheImage() )
+    {
+      QgsDebugMsg( "Caching enabled --- drawing layer from cached image" );
+      job.cached = true;
+      job.image = ml->cacheImage();
+    }
+    else
+    {
+      job.image = new QImage( painter->device()->width(), painter->device()->height(), QImage::Format_ARGB32_Premultiplied );
+      if ( job.image->isNull() )
+      {
+        QgsDebugMsg( "insufficient memory for image " + QString::number( painter->device()->width() ) + "x" + QString::number( painter->device()->height() ) );
+        emit drawError( ml );
+        delete job.image;
+        delete job.ct;
+        continue;
+      }
+      job.image->fill( 0 );
+    }
+
+    jobs.append( job );
+  }
+
+  // hand the thread safe layers to the worker pool and meanwhile
+  // render the remaining ones in the main thread
+  mParallelJobs = &jobs;
+  mParallelFuture = QtConcurrent::map( jobs, renderWorkerLayerJob );
+
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    QgsMapRendererLayerJob& job = jobs[i];
+    if ( !job.mainThread || !job.layer )
+      continue;
+
+    QgsMapLayer* ml = job.layer;
+    connect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
+    renderLayerJob( job );
+    if ( job.layer )
+      disconnect( ml, SIGNAL( drawingProgress( int, int ) ), this, SLOT( onDrawingProgress( int, int ) ) );
+  }
+
+  // wait for the workers, keeping progress reporting and cancellation alive
+  int reportedJobs = -1;
+  while ( true )
+  {
+    state.mutex.lock();
+    if ( state.finishedJobs == reportedJobs && !mParallelFuture.isFinished() )
+    {
+      state.jobFinished.wait( &state.mutex, 100 );
+    }
+    int finishedJobs = state.finishedJobs;
+    state.mutex.unlock();
+
+    if ( finishedJobs != reportedJobs )
+    {
+      emit drawingProgress( finishedJobs, jobs.size() );
+      reportedJobs = finishedJobs;
+    }
+
+    if ( mParallelFuture.isFinished() )
+      break;
+
+    // layers removed meanwhile are waited for in onLayersWillBeRemoved()
+    QCoreApplication::processEvents();
+
+    if ( mRenderContext.renderingStopped() )
+    {
+      mParallelFuture.cancel();
+    }
+  }
+  mParallelFuture.waitForFinished();
+  mParallelFuture = QFuture<void>();
+  mParallelJobs = 0;
+  mRenderContext.setRenderingStoppedFlag( 0 );
+  mRenderContext.setRenderingStopped( stopped != 0 );
+
+  // composite the layer images in layer order
+  for ( int i = 0; i < jobs.size(); ++i )
+  {
+    QgsMapRendererLayerJob& job = jobs[i];
+
+    if ( !job.layer )
+    {
+      // removed from the registry while rendering
+      if ( !job.cached )
+        delete job.image;
+      delete job.ct;
+      continue;
+    }
+
+    if ( job.error )
+    {
+      emit drawError( job.layer );
+    }
+
+    if ( mRenderContext.useAdvancedEffects() )
+    {
+      // Set the QPainter composition mode so that this layer is rendered using
+      // the desired blending mode
+      painter->setCompositionMode( job.layer->blendMode() );
+    }
+    painter->drawImage( 0, 0, *job.image );
+
+    if ( !job.cached )
+    {
+      if ( job.cacheable && !mRenderContext.renderingStopped() )
+      {
+        job.layer->setCacheImage( job.image ); //no need to delete the old one, maplayer does it for you
+      }
+      else
+      {
+        delete job.image;
+      }
+    }
+    delete job.ct;
+  }
+}
+
+void QgsMapRenderer::onLayersWillBeRemoved( QStringList theLayerIds )
+{
+  if ( !mParallelJobs )
+    return;
+
+  bool rendered = false;
+  for ( int i = 0; i < mParallelJobs->size(); ++i )
+  {
+    QgsMapRendererLayerJob& job = ( *mParallelJobs )[i];
+    if ( job.layer && theLayerIds.contains( job.layer->id() ) )
+    {
+      rendered = true;
+      break;
+    }
+  }
+  if ( !rendered )
+    return;
+
+  // the workers still iterate the providers of the layers about to be deleted
+  QgsDebugMsg( "Layer removed while rendering in parallel - stopping the render" );
+  mRenderContext.setRenderingStopped( true );
+  mParallelFuture.cancel();
+  mParallelFuture.waitForFinished();
+
+  for ( int i = 0; i < mParallelJobs->size(); ++i )
+  {
+    QgsMapRendererLayerJob& job = ( *mParallelJobs )[i];
+    if ( job.layer && theLayerIds.contains( job.layer->id() ) )
+    {
+      if ( job.cached )
+      {
+        // the cache image is deleted with the layer
+        job.image = 0;
+        job.cached = false;
+      }
+      job.layer = 0;
+    }
+  }
+}
+
+bool QgsMapRenderer::canRenderLayerInThread( QgsMapLayer* layer ) const
+{
+  if ( layer->type() == QgsMapLayer::VectorLayer )
+  {
+    // layers in edit mode and layers registering features with the
+    // labeling engine share state with the main thread. Database providers
+    // share their connections between layers, so only file based and
+    // in-memory providers are rendered by workers. The delimited text provider
+    // is not, its iterators share one file stream and it rescans the file and
+    // resets its indexes from the main thread when the file watcher fires.
+    QgsVectorLayer* vl = qobject_cast<QgsVectorLayer *>( layer );
+    if ( !vl || vl->isEditable() || vl->diagramRenderer() )
+      return false;
+
+    if ( mLabelingEngine && mLabelingEngine->willUseLayer( vl ) )
+      return false;
+
+    QString provider = vl->providerType();
+    return provider == "ogr" || provider == "memory" || provider == "gpx";
+  }
+  else if ( layer->type() == QgsMapLayer::RasterLayer )
+  {
+    // remote providers depend on the event loop of the main thread
+    QgsRasterLayer* rl = qobject_cast<QgsRasterLayer *>( layer );
+    return rl && rl->providerType() == "gdal";
+  }
+
+  return false;
+}
+
 void QgsMapRenderer::setMapUnits( QGis::UnitType u )
 {
   mScaleCalculator->setMapUnits( u );
@@ -16,6 +16,7 @@
 #ifndef QGSMAPRENDER_H
 #define QGSMAPRENDER_H
 
+#include <QFuture>
 #include <QMutex>
 #include <QSize>
 #include <QStringList>
@@ -42,6 +43,8 @@ class QgsVectorLayer;
 class QgsPalLayerSettings;
 class QgsDiagramLayerSettings;
 
+struct QgsMapRendererLayerJob;
+
 class CORE_EXPORT QgsLabelPosition
 {
   public:
@@ -288,6 +291,18 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! Added in QGIS v1.4
     void setLabelingEngine( QgsLabelingEngineInterface* iface );
 
+    //! Enable or disable parallel rendering. When enabled, every layer is rendered
+    //! into its own image on a pool of worker threads and the images are then
+    //! composited in layer order, honouring layer blend modes and transparency.
+    //! Layers which are not safe to render outside of the main thread (e.g. layers
+    //! in edit mode or layers used by the labeling engine) are still rendered in
+    //! the main thread. The default is taken from the "/qgis/parallel_rendering" setting.
+    //! @note added in 2.1
+    void setParallelRenderingEnabled( bool enabled ) { mParallelRendering = enabled; }
+    //! Returns true if layers are rendered in parallel
+    //! @note added in 2.1
+    bool isParallelRenderingEnabled() const { return mParallelRendering; }
+
     //! Returns a QPainter::CompositionMode corresponding to a BlendMode
     //! Added in 1.9
     static QPainter::CompositionMode getCompositionMode( const QgsMapRenderer::BlendMode &blendMode );
@@ -335,6 +350,11 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! called by signal from layer current being drawn
     void onDrawingProgress( int current, int total );
 
+  private slots:
+
+    //! stops a running parallel render and waits for its workers before layers are deleted
+    void onLayersWillBeRemoved( QStringList theLayerIds );
+
   protected:
 
     //! adjust extent to fit the pixmap size
@@ -348,6 +368,18 @@ class CORE_EXPORT QgsMapRenderer : public QObject
      */
     bool splitLayersExtent( QgsMapLayer* layer, QgsRectangle& extent, QgsRectangle& r2 );
 
+    /** Renders all visible layers of the layer set concurrently, each one into its
+     * own image, and composites the images onto the painter in layer order.
+     * @param painter destination painter
+     * @param sameAsLastRender true if extent and scale did not change since the last render
+     * @note added in 2.1
+     */
+    void renderLayersParallel( QPainter* painter, bool sameAsLastRender );
+
+    //! Returns true if the layer may be rendered outside of the main thread
+    //! @note added in 2.1
+    bool canRenderLayerInThread( QgsMapLayer* layer ) const;
+
     //! indicates drawing in progress
     static bool mDrawing;
 
@@ -402,6 +434,15 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! Locks rendering loop for concurrent draws
     QMutex mRenderMutex;
 
+    //! Whether layers are rendered concurrently into separate images
+    bool mParallelRendering;
+
+    //! Layer jobs of the running parallel render, 0 if there is none
+    QList<QgsMapRendererLayerJob>* mParallelJobs;
+
+    //! Workers of the running parallel render
+    QFuture<void> mParallelFuture;
+
     QHash< QString, QgsLayerCoordinateTransform > mLayerCoordinateTransformInfo;
 
 };
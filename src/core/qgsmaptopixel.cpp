@@ -146,6 +146,17 @@ void QgsMapToPixel::transformInPlace( QVector<double>& x,
     transformInPlace( x[i], y[i] );
 }
 
+void QgsMapToPixel::transformInPlace( QPolygonF& poly ) const
+{
+  QPointF* ptr = poly.data();
+  QPointF* end = ptr + poly.size();
+  for ( ; ptr != end; ++ptr )
+  {
+    ptr->rx() = ( ptr->x() - xMin ) / mMapUnitsPerPixel;
+    ptr->ry() = yMax - ( ptr->y() - yMin ) / mMapUnitsPerPixel;
+  }
+}
+
 #ifdef ANDROID
 void QgsMapToPixel::transformInPlace( float& x, float& y ) const
 {
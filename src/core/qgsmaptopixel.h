@@ -18,6 +18,7 @@
 #define QGSMAPTOPIXEL
 
 #include "qgspoint.h"
+#include <QPolygonF>
 #include <vector>
 
 #include <cassert>
@@ -74,6 +75,13 @@ class CORE_EXPORT QgsMapToPixel
      */
     void transformInPlace( QVector<double>& x, QVector<double>& y ) const;
 
+    /* Transform the points of a polygon from map coordinates to device
+       coordinates in place, in one loop over the points which the
+       compiler can vectorise.
+       @note added in 2.1
+     */
+    void transformInPlace( QPolygonF& poly ) const;
+
 #ifdef ANDROID
     void transformInPlace( float& x, float& y ) const;
     void transformInPlace( QVector<float>& x, QVector<float>& y ) const;
@@ -25,11 +25,13 @@ QgsRenderContext::QgsRenderContext()
     mForceVectorOutput( false ),
     mUseAdvancedEffects( true ),
     mRenderingStopped( false ),
+    mRenderingStoppedFlag( 0 ),
     mScaleFactor( 1.0 ),
     mRasterScaleFactor( 1.0 ),
     mRendererScale( 1.0 ),
     mLabelingEngine( NULL ),
-    mUseRenderingOptimization( true )
+    mUseRenderingOptimization( true ),
+    mExpressionContext( 0 )
 {
 
 }
@@ -42,3 +44,12 @@ void QgsRenderContext::setCoordinateTransform( const QgsCoordinateTransform* t )
 {
   mCoordTransform = t;
 }
+
+void QgsRenderContext::setRenderingStopped( bool stopped )
+{
+  mRenderingStopped = stopped;
+  if ( mRenderingStoppedFlag )
+  {
+    mRenderingStoppedFlag->fetchAndStoreOrdered( stopped );
+  }
+}
@@ -18,6 +18,7 @@
 #ifndef QGSRENDERCONTEXT_H
 #define QGSRENDERCONTEXT_H
 
+#include <QAtomicInt>
 #include <QColor>
 
 #include "qgscoordinatetransform.h"
@@ -26,6 +27,7 @@
 
 class QPainter;
 
+class QgsExpressionContext;
 class QgsLabelingEngineInterface;
 
 /** \ingroup core
@@ -55,7 +57,7 @@ class CORE_EXPORT QgsRenderContext
 
     double rasterScaleFactor() const {return mRasterScaleFactor;}
 
-    bool renderingStopped() const {return mRenderingStopped;}
+    bool renderingStopped() const {return mRenderingStopped || ( mRenderingStoppedFlag && *mRenderingStoppedFlag );}
 
     bool forceVectorOutput() const {return mForceVectorOutput;}
 
@@ -83,7 +85,7 @@ class CORE_EXPORT QgsRenderContext
     void setMapToPixel( const QgsMapToPixel& mtp ) {mMapToPixel = mtp;}
     void setExtent( const QgsRectangle& extent ) {mExtent = extent;}
     void setDrawEditingInformation( bool b ) {mDrawEditingInformation = b;}
-    void setRenderingStopped( bool stopped ) {mRenderingStopped = stopped;}
+    void setRenderingStopped( bool stopped );
     void setScaleFactor( double factor ) {mScaleFactor = factor;}
     void setRasterScaleFactor( double factor ) {mRasterScaleFactor = factor;}
     void setRendererScale( double scale ) {mRendererScale = scale;}
@@ -99,6 +101,22 @@ class CORE_EXPORT QgsRenderContext
     bool useRenderingOptimization() const { return mUseRenderingOptimization; }
     void setUseRenderingOptimization( bool enabled ) { mUseRenderingOptimization = enabled; }
 
+    /**Shares a stop flag between this context and its copies, e.g. the contexts of layers
+      rendered by other threads. While it is set, renderingStopped() also returns true if
+      the flag is set and setRenderingStopped() sets the flag. QgsRenderContext does not take ownership.
+      @note added in 2.1
+      @note not available in python bindings */
+    void setRenderingStoppedFlag( QAtomicInt* flag ) { mRenderingStoppedFlag = flag; }
+
+    /**Returns the expression context with the special columns of this rendering, e.g. the
+      values of the current atlas feature (can be NULL)
+      @note added in 2.1*/
+    const QgsExpressionContext* expressionContext() const { return mExpressionContext; }
+    /**Sets the expression context whose special columns are visible to the expressions evaluated
+      while layers are drawn. QgsRenderContext does not take ownership
+      @note added in 2.1*/
+    void setExpressionContext( const QgsExpressionContext* context ) { mExpressionContext = context; }
+
   private:
 
     /**Painter for rendering operations*/
@@ -123,6 +141,9 @@ class CORE_EXPORT QgsRenderContext
     /**True if the rendering has been canceled*/
     bool mRenderingStopped;
 
+    /**Stop flag shared with the copies of the context (can be NULL)*/
+    QAtomicInt* mRenderingStoppedFlag;
+
     /**Factor to scale line widths and point marker sizes*/
     double mScaleFactor;
 
@@ -140,6 +161,9 @@ class CORE_EXPORT QgsRenderContext
 
     /**True if the rendering optimization (geometry simplification) can be executed*/
     bool mUseRenderingOptimization;
+
+    /**Special columns for the expressions evaluated while rendering (can be NULL)*/
+    const QgsExpressionContext* mExpressionContext;
 };
 
 #endif
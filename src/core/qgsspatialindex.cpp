@@ -15,13 +15,24 @@
 
 #include "qgsspatialindex.h"
 
+#include "qgsapplication.h"
 #include "qgsgeometry.h"
 #include "qgsfeature.h"
+#include "qgsfeatureiterator.h"
 #include "qgsrectangle.h"
 #include "qgslogger.h"
 
 #include "SpatialIndex.h"
 
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QTemporaryFile>
+
+#include <limits>
+
 using namespace SpatialIndex;
 
 
@@ -48,7 +59,221 @@ class QgisVisitor : public SpatialIndex::IVisitor
 };
 
 
+// bounding boxes of the features of an iterator which have a geometry
+class QgsFeatureIteratorEntryStream : public QgsSpatialIndex::EntryStream
+{
+  public:
+    QgsFeatureIteratorEntryStream( const QgsFeatureIterator& fi )
+        : mIterator( fi ) {}
+
+    bool nextEntry( QgsFeatureId& theId, QgsRectangle& theRect )
+    {
+      QgsFeature f;
+      while ( mIterator.nextFeature( f ) )
+      {
+        if ( f.geometry() )
+        {
+          theId = f.id();
+          theRect = f.geometry()->boundingBox();
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    QgsFeatureIterator mIterator;
+};
+
+// data stream for the bulk loader, reports the progress and stops if building is canceled
+class QgisDataStream : public SpatialIndex::IDataStream
+{
+  public:
+    QgisDataStream( QgsSpatialIndex::EntryStream& stream, QgsSpatialIndex::BuildFeedback* feedback )
+        : mStream( stream ), mFeedback( feedback ), mNext( 0 ), mCount( 0 ), mCanceled( false )
+    {
+      readNext();
+    }
+
+    ~QgisDataStream()
+    {
+      delete mNext;
+    }
+
+    IData* getNext()
+    {
+      RTree::Data* data = mNext;
+      mNext = 0;
+      readNext();
+      return data;
+    }
+
+    bool hasNext() throw ( Tools::NotSupportedException )
+    {
+      return mNext != 0;
+    }
+
+    uint32_t size() throw ( Tools::NotSupportedException )
+    {
+      throw Tools::NotSupportedException( "Operation not supported." );
+    }
+
+    void rewind() throw ( Tools::NotSupportedException )
+    {
+      throw Tools::NotSupportedException( "Operation not supported." );
+    }
+
+    bool isCanceled() const { return mCanceled; }
+
+  private:
+    void readNext()
+    {
+      QgsFeatureId id;
+      QgsRectangle rect;
+      if ( mCanceled || !mStream.nextEntry( id, rect ) )
+      {
+        return;
+      }
+
+      ++mCount;
+      if ( mFeedback && mCount % 1000 == 0 && !mFeedback->progress( mCount ) )
+      {
+        QgsDebugMsg( QString( "building spatial index canceled after %1 features" ).arg( mCount ) );
+        mCanceled = true;
+        return;
+      }
+
+      double pt1[2], pt2[2];
+      pt1[0] = rect.xMinimum();
+      pt1[1] = rect.yMinimum();
+      pt2[0] = rect.xMaximum();
+      pt2[1] = rect.yMaximum();
+      Region r( pt1, pt2, 2 );
+      mNext = new RTree::Data( 0, 0, r, FID_TO_NUMBER( id ) );
+    }
+
+    QgsSpatialIndex::EntryStream& mStream;
+    QgsSpatialIndex::BuildFeedback* mFeedback;
+    RTree::Data* mNext;
+    int mCount;
+    bool mCanceled;
+};
+
+
+// layout of the files of writeToFile(): the header, the UTF-8 encoded name of the source
+// padded to a multiple of 8 bytes, and the entries. Everything is in native byte order,
+// a file of another platform has a wrong magic number or version and is not read.
+static const char sFileMagic[8] = { 'Q', 'G', 'S', 'S', 'I', 'D', 'X', 0 };
+static const quint32 sFileVersion = 1;
+
+struct QgsSpatialIndexFileHeader
+{
+  char magic[8];
+  quint32 version;
+  quint32 sourceLength;
+  qint64 sourceSize;
+  qint64 sourceModified;  // milliseconds since the epoch
+  qint64 count;
+};
+
+struct QgsSpatialIndexFileEntry
+{
+  qint64 id;
+  double xMin, yMin, xMax, yMax;
+};
+
+// custom visitor that writes the entries of the found features to a file
+class QgisFileVisitor : public SpatialIndex::IVisitor
+{
+  public:
+    QgisFileVisitor( QFile& file )
+        : mFile( file ), mCount( 0 ), mOk( true ) {}
+
+    void visitNode( const INode& n )
+    { Q_UNUSED( n ); }
+
+    void visitData( const IData& d )
+    {
+      IShape* shape;
+      d.getShape( &shape );
+      Region r;
+      shape->getMBR( r );
+      delete shape;
+
+      QgsSpatialIndexFileEntry entry;
+      entry.id = d.getIdentifier();
+      entry.xMin = r.getLow( 0 );
+      entry.yMin = r.getLow( 1 );
+      entry.xMax = r.getHigh( 0 );
+      entry.yMax = r.getHigh( 1 );
+      mBuffer.append( entry );
+      ++mCount;
+      if ( mBuffer.size() == 4096 )
+        flush();
+    }
+
+    void visitData( std::vector<const IData*>& v )
+    { Q_UNUSED( v ); }
+
+    bool flush()
+    {
+      qint64 len = mBuffer.size() * sizeof( QgsSpatialIndexFileEntry );
+      mOk = mOk && mFile.write( reinterpret_cast<const char*>( mBuffer.constData() ), len ) == len;
+      mBuffer.clear();
+      return mOk;
+    }
+
+    qint64 count() const { return mCount; }
+
+  private:
+    QFile& mFile;
+    QVector<QgsSpatialIndexFileEntry> mBuffer;
+    qint64 mCount;
+    bool mOk;
+};
+
+// entries of a memory mapped file of writeToFile()
+class QgsMappedEntryStream : public QgsSpatialIndex::EntryStream
+{
+  public:
+    QgsMappedEntryStream( const QgsSpatialIndexFileEntry* entries, qint64 count )
+        : mEntries( entries ), mCount( count ), mNext( 0 ) {}
+
+    bool nextEntry( QgsFeatureId& theId, QgsRectangle& theRect )
+    {
+      if ( mNext >= mCount )
+        return false;
+
+      const QgsSpatialIndexFileEntry& entry = mEntries[mNext++];
+      theId = entry.id;
+      theRect.set( entry.xMin, entry.yMin, entry.xMax, entry.yMax );
+      return true;
+    }
+
+  private:
+    const QgsSpatialIndexFileEntry* mEntries;
+    qint64 mCount;
+    qint64 mNext;
+};
+
+
 QgsSpatialIndex::QgsSpatialIndex()
+{
+  initTree( 0, 0 );
+}
+
+QgsSpatialIndex::QgsSpatialIndex( const QgsFeatureIterator& fi, BuildFeedback* feedback )
+{
+  QgsFeatureIteratorEntryStream stream( fi );
+  initTree( &stream, feedback );
+}
+
+QgsSpatialIndex::QgsSpatialIndex( EntryStream& stream, BuildFeedback* feedback )
+{
+  initTree( &stream, feedback );
+}
+
+bool QgsSpatialIndex::initTree( EntryStream* stream, BuildFeedback* feedback )
 {
   // for now only memory manager
   mStorageManager = StorageManager::createNewMemoryStorageManager();
@@ -68,15 +293,64 @@ QgsSpatialIndex::QgsSpatialIndex()
 
   // create R-tree
   SpatialIndex::id_type indexId;
-  mRTree = RTree::createNewRTree( *mStorage, fillFactor, indexCapacity,
-                                  leafCapacity, dimension, variant, indexId );
+  mRTree = 0;
+  bool canceled = false;
+
+  if ( stream )
+  {
+    // the bulk loader does not accept an empty stream
+    QgisDataStream dataStream( *stream, feedback );
+    if ( dataStream.hasNext() )
+    {
+      try
+      {
+        mRTree = RTree::createAndBulkLoadNewRTree( RTree::BLM_STR, dataStream, *mStorage, fillFactor, indexCapacity,
+                 leafCapacity, dimension, variant, indexId );
+      }
+      catch ( Tools::Exception &e )
+      {
+        Q_UNUSED( e );
+        QgsDebugMsg( QString( "Tools::Exception caught: " ).arg( e.what().c_str() ) );
+      }
+      catch ( const std::exception &e )
+      {
+        Q_UNUSED( e );
+        QgsDebugMsg( QString( "std::exception caught: " ).arg( e.what() ) );
+      }
+    }
+
+    canceled = dataStream.isCanceled();
+    if ( mRTree && canceled )
+    {
+      // start again with empty storage
+      deleteTree();
+      mStorageManager = StorageManager::createNewMemoryStorageManager();
+      mStorage = StorageManager::createNewRandomEvictionsBuffer( *mStorageManager, capacity, writeThrough );
+    }
+  }
+
+  if ( !mRTree )
+  {
+    mRTree = RTree::createNewRTree( *mStorage, fillFactor, indexCapacity,
+                                    leafCapacity, dimension, variant, indexId );
+  }
+
+  return !canceled;
 }
 
-QgsSpatialIndex:: ~QgsSpatialIndex()
+void QgsSpatialIndex::deleteTree()
 {
   delete mRTree;
   delete mStorage;
   delete mStorageManager;
+  mRTree = 0;
+  mStorage = 0;
+  mStorageManager = 0;
+}
+
+QgsSpatialIndex:: ~QgsSpatialIndex()
+{
+  deleteTree();
 }
 
 Region QgsSpatialIndex::rectToRegion( QgsRectangle rect )
@@ -168,3 +442,124 @@ QList<QgsFeatureId> QgsSpatialIndex::nearestNeighbor( QgsPoint point, int neighb
 
   return list;
 }
+
+bool QgsSpatialIndex::writeToFile( const QString& theFileName, const QString& theSourceFile,
+                                   qint64 theSourceSize, const QDateTime& theSourceModified )
+{
+  QDir().mkpath( QFileInfo( theFileName ).absolutePath() );
+
+  // write to a temporary file of its own first, readers and other writers of
+  // the same index never see a partly written file
+  QTemporaryFile file( theFileName + ".XXXXXX" );
+  file.setAutoRemove( false );
+  if ( !file.open() )
+  {
+    QgsDebugMsg( "cannot write spatial index file " + theFileName );
+    return false;
+  }
+
+  QByteArray source = theSourceFile.toUtf8();
+  source.append( QByteArray(( 8 - source.size() % 8 ) % 8, 0 ) );
+
+  QgsSpatialIndexFileHeader header;
+  memcpy( header.magic, sFileMagic, sizeof( header.magic ) );
+  header.version = sFileVersion;
+  header.sourceLength = source.size();
+  header.sourceSize = theSourceSize;
+  header.sourceModified = theSourceModified.isValid() ? theSourceModified.toMSecsSinceEpoch() : 0;
+  header.count = 0;
+
+  bool ok = file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) ) == ( qint64 ) sizeof( header )
+            && file.write( source ) == source.size();
+
+  if ( ok )
+  {
+    double lo[2] = { -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max() };
+    double hi[2] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    QgisFileVisitor visitor( file );
+    mRTree->intersectsWithQuery( Region( lo, hi, 2 ), visitor );
+
+    // the entry count is known at the end
+    header.count = visitor.count();
+    ok = visitor.flush()
+         && file.seek( 0 )
+         && file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) ) == ( qint64 ) sizeof( header );
+  }
+  QString tempName = file.fileName();
+  file.close();
+
+  if ( !ok )
+  {
+    QgsDebugMsg( "writing spatial index file " + tempName + " failed" );
+    QFile::remove( tempName );
+    return false;
+  }
+
+  QFile::remove( theFileName );
+  if ( !QFile::rename( tempName, theFileName ) )
+  {
+    QFile::remove( tempName );
+    return false;
+  }
+  return true;
+}
+
+bool QgsSpatialIndex::readFromFile( const QString& theFileName, const QString& theSourceFile, BuildFeedback* feedback )
+{
+  QFile file( theFileName );
+  if ( !file.open( QIODevice::ReadOnly ) || file.size() < ( qint64 ) sizeof( QgsSpatialIndexFileHeader ) )
+    return false;
+
+  uchar* data = file.map( 0, file.size() );
+  if ( !data )
+  {
+    QgsDebugMsg( "cannot map spatial index file " + theFileName );
+    return false;
+  }
+
+  const QgsSpatialIndexFileHeader* header = reinterpret_cast<const QgsSpatialIndexFileHeader*>( data );
+  qint64 entriesOffset = sizeof( QgsSpatialIndexFileHeader ) + header->sourceLength;
+  // the count is checked against the file size before multiplying, so that a corrupt count cannot overflow
+  if ( memcmp( header->magic, sFileMagic, sizeof( sFileMagic ) ) != 0
+       || header->version != sFileVersion
+       || entriesOffset > file.size()
+       || header->count < 0
+       || header->count > ( file.size() - entriesOffset ) / ( qint64 ) sizeof( QgsSpatialIndexFileEntry )
+       || file.size() != entriesOffset + header->count * ( qint64 ) sizeof( QgsSpatialIndexFileEntry ) )
+  {
+    QgsDebugMsg( "invalid spatial index file " + theFileName );
+    return false;
+  }
+
+  QByteArray source = QByteArray( reinterpret_cast<const char*>( data ) + sizeof( QgsSpatialIndexFileHeader ), header->sourceLength );
+  source.truncate( qstrnlen( source.constData(), source.size() ) );
+  if ( QString::fromUtf8( source ) != theSourceFile )
+  {
+    QgsDebugMsg( "spatial index file " + theFileName + " was written for another source" );
+    return false;
+  }
+
+  if ( !theSourceFile.isEmpty() )
+  {
+    QFileInfo sourceInfo( theSourceFile );
+    if ( !sourceInfo.exists()
+         || sourceInfo.size() != header->sourceSize
+         || sourceInfo.lastModified().toMSecsSinceEpoch() != header->sourceModified )
+    {
+      QgsDebugMsg( "spatial index file " + theFileName + " is out of date" );
+      return false;
+    }
+  }
+
+  QgsMappedEntryStream stream( reinterpret_cast<const QgsSpatialIndexFileEntry*>( data + entriesOffset ), header->count );
+  deleteTree();
+  return initTree( &stream, feedback );
+}
+
+QString QgsSpatialIndex::cacheFileName( const QString& theSource )
+{
+  QSettings settings;
+  QString cacheDirectory = settings.value( "cache/directory", QgsApplication::qgisSettingsDirPath() + "cache" ).toString();
+  QByteArray hash = QCryptographicHash::hash( theSource.toUtf8(), QCryptographicHash::Md5 ).toHex();
+  return QDir( cacheDirectory ).filePath( "spatialindex/" + QString::fromAscii( hash ) + ".qsi" );
+}
@@ -31,9 +31,11 @@ namespace SpatialIndex
 }
 
 class QgsFeature;
+class QgsFeatureIterator;
 class QgsRectangle;
 class QgsPoint;
 
+#include <QDateTime>
 #include <QList>
 
 #include "qgsfeature.h"
@@ -43,11 +45,43 @@ class CORE_EXPORT QgsSpatialIndex
 
   public:
 
+    /** Bounding boxes of features for bulk loading an index, see QgsSpatialIndex( EntryStream&, BuildFeedback* )
+     * @note added in 2.1 */
+    class CORE_EXPORT EntryStream
+    {
+      public:
+        virtual ~EntryStream() {}
+
+        /** Returns the id and bounding box of the next feature, false if there are no more features */
+        virtual bool nextEntry( QgsFeatureId& theId, QgsRectangle& theRect ) = 0;
+    };
+
+    /** Receives the progress of bulk loading an index
+     * @note added in 2.1 */
+    class CORE_EXPORT BuildFeedback
+    {
+      public:
+        virtual ~BuildFeedback() {}
+
+        /** Called after every 1000 features read, return false to cancel building. A canceled index is empty */
+        virtual bool progress( int theCount ) = 0;
+    };
+
     /* creation of spatial index */
 
     /** constructor - creates R-tree */
     QgsSpatialIndex();
 
+    /** constructor - creates R-tree and bulk loads it with the features of the iterator which have a geometry.
+     * The tree is packed with the Sort-Tile-Recursive method, which is much faster than inserting
+     * the features one by one and gives a tree with less overlapping nodes.
+     * @note added in 2.1 */
+    explicit QgsSpatialIndex( const QgsFeatureIterator& fi, BuildFeedback* feedback = 0 );
+
+    /** constructor - creates R-tree and bulk loads it with the entries of the stream, see above
+     * @note added in 2.1 */
+    explicit QgsSpatialIndex( EntryStream& stream, BuildFeedback* feedback = 0 );
+
     /** destructor finalizes work with spatial index */
     ~QgsSpatialIndex();
 
@@ -70,6 +104,28 @@ class CORE_EXPORT QgsSpatialIndex
     QList<QgsFeatureId> nearestNeighbor( QgsPoint point, int neighbors );
 
 
+    /* persistence */
+
+    /** writes the bounding boxes of the index to a file, which readFromFile() maps into memory.
+     * If the index was built from theSourceFile, the file is stamped with theSourceSize and
+     * theSourceModified, which should be taken before the source was read.
+     * @note added in 2.1 */
+    bool writeToFile( const QString& theFileName, const QString& theSourceFile = QString(),
+                      qint64 theSourceSize = 0, const QDateTime& theSourceModified = QDateTime() );
+
+    /** replaces the index by the one written to a file. The file is memory mapped and bulk loaded.
+     * Returns false and leaves the index unchanged if the file cannot be read, was written for
+     * another source than theSourceFile, or if the size or modification time of theSourceFile changed since.
+     * If building is canceled by feedback false is returned and the index is empty.
+     * @note added in 2.1 */
+    bool readFromFile( const QString& theFileName, const QString& theSourceFile = QString(), BuildFeedback* feedback = 0 );
+
+    /** returns the name of the file in the spatial index cache directory of the user for a data source.
+     * theSource identifies the source and everything the index depends on, e.g. the data source uri.
+     * @note added in 2.1 */
+    static QString cacheFileName( const QString& theSource );
+
+
   protected:
     // @note not available in python bindings
     SpatialIndex::Region rectToRegion( QgsRectangle rect );
@@ -78,6 +134,13 @@ class CORE_EXPORT QgsSpatialIndex
 
   private:
 
+    /** creates the storage and an R-tree, bulk loaded from stream if it is not null.
+     * Returns false if building was canceled */
+    bool initTree( EntryStream* stream, BuildFeedback* feedback );
+
+    /** deletes the R-tree and the storage */
+    void deleteTree();
+
     /** storage manager */
     SpatialIndex::IStorageManager* mStorageManager;
 
@@ -0,0 +1,387 @@
+/***************************************************************************
+    qgssqlexpressioncompiler.cpp
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgssqlexpressioncompiler.h"
+
+#include <QStringList>
+
+QgsSqlExpressionCompiler::QgsSqlExpressionCompiler( const QgsFields& fields, int flags )
+    : mFields( fields )
+    , mFlags( flags )
+{
+}
+
+QgsSqlExpressionCompiler::~QgsSqlExpressionCompiler()
+{
+}
+
+// collects the terms of the top level AND
+static void collectAndTerms( const QgsExpression::Node* node, QList<const QgsExpression::Node*>& terms )
+{
+  if ( node->nodeType() == QgsExpression::ntBinaryOperator )
+  {
+    const QgsExpression::NodeBinaryOperator* n = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+    if ( n->op() == QgsExpression::boAnd )
+    {
+      collectAndTerms( n->opLeft(), terms );
+      collectAndTerms( n->opRight(), terms );
+      return;
+    }
+  }
+  terms << node;
+}
+
+QgsSqlExpressionCompiler::Result QgsSqlExpressionCompiler::compile( const QgsExpression* exp )
+{
+  mResult = QString();
+  if ( !exp )
+    return None;
+  if ( !exp->rootNode() )
+    return Fail;
+
+  QList<const QgsExpression::Node*> terms;
+  collectAndTerms( exp->rootNode(), terms );
+
+  QStringList translated;
+  bool complete = true;
+  foreach ( const QgsExpression::Node* term, terms )
+  {
+    QString sql;
+    ValueKind kind;
+    if ( compileNode( term, sql, kind ) && kind == BooleanValue )
+      translated << QString( "(%1)" ).arg( sql );
+    else
+      complete = false;
+  }
+
+  if ( translated.isEmpty() )
+    return Fail;
+
+  mResult = translated.join( " AND " );
+  return complete ? Complete : Partial;
+}
+
+QString QgsSqlExpressionCompiler::quotedIdentifier( const QString& identifier )
+{
+  QString quoted = identifier;
+  quoted.replace( "\"", "\"\"" );
+  return QString( "\"%1\"" ).arg( quoted );
+}
+
+QString QgsSqlExpressionCompiler::quotedValue( const QVariant& value )
+{
+  switch ( value.type() )
+  {
+    case QVariant::Int:
+      return QString::number( value.toInt() );
+
+    case QVariant::Double:
+      return QString::number( value.toDouble(), 'g', 17 );
+
+    default:
+    {
+      QString quoted = value.toString();
+      quoted.replace( "'", "''" );
+      return QString( "'%1'" ).arg( quoted );
+    }
+  }
+}
+
+bool QgsSqlExpressionCompiler::isStringField( const QgsField& field )
+{
+  return field.type() == QVariant::String;
+}
+
+bool QgsSqlExpressionCompiler::compileStringLiteral( const QgsExpression::Node* node, QString& sql )
+{
+  if ( node->nodeType() != QgsExpression::ntLiteral )
+    return false;
+
+  QVariant value = static_cast<const QgsExpression::NodeLiteral*>( node )->value();
+  if ( value.isNull() || value.type() != QVariant::String )
+    return false;
+
+  // numeric strings are compared as numbers by the expression engine
+  bool isNumber;
+  value.toString().toDouble( &isNumber );
+  if ( isNumber )
+    return false;
+
+  sql = quotedValue( value );
+  return true;
+}
+
+bool QgsSqlExpressionCompiler::compileNode( const QgsExpression::Node* node, QString& sql, ValueKind& kind )
+{
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntLiteral:
+    {
+      QVariant value = static_cast<const QgsExpression::NodeLiteral*>( node )->value();
+      if ( value.isNull() )
+      {
+        sql = "NULL";
+        kind = NullValue;
+        return true;
+      }
+      if ( value.type() == QVariant::Int || value.type() == QVariant::Double )
+      {
+        sql = quotedValue( value );
+        kind = value.type() == QVariant::Int ? IntegerValue : DoubleValue;
+        return true;
+      }
+      if ( value.type() == QVariant::String )
+      {
+        sql = quotedValue( value );
+        kind = StringValue;
+        return true;
+      }
+      return false;
+    }
+
+    case QgsExpression::ntColumnRef:
+    {
+      const QgsExpression::NodeColumnRef* n = static_cast<const QgsExpression::NodeColumnRef*>( node );
+      int idx = mFields.indexFromName( n->name() );
+      if ( idx < 0 )
+        return false; // e.g. joined or virtual field
+
+      switch ( mFields[idx].type() )
+      {
+        case QVariant::Int:
+          kind = IntegerValue;
+          break;
+        case QVariant::Double:
+          kind = DoubleValue;
+          break;
+        case QVariant::String:
+          if ( !isStringField( mFields[idx] ) )
+            return false;
+          kind = StringValue;
+          break;
+        default:
+          return false;
+      }
+      sql = quotedIdentifier( n->name() );
+      return true;
+    }
+
+    case QgsExpression::ntUnaryOperator:
+    {
+      const QgsExpression::NodeUnaryOperator* n = static_cast<const QgsExpression::NodeUnaryOperator*>( node );
+      QString operand;
+      ValueKind operandKind;
+      if ( !compileNode( n->operand(), operand, operandKind ) )
+        return false;
+
+      if ( n->op() == QgsExpression::uoNot && operandKind == BooleanValue )
+      {
+        sql = QString( "NOT (%1)" ).arg( operand );
+        kind = BooleanValue;
+        return true;
+      }
+      // negating an integer only overflows for the smallest one, which is not a valid literal
+      if ( n->op() == QgsExpression::uoMinus &&
+           ( operandKind == DoubleValue || ( operandKind == IntegerValue && n->operand()->nodeType() == QgsExpression::ntLiteral ) ) )
+      {
+        sql = QString( "-(%1)" ).arg( operand );
+        kind = operandKind;
+        return true;
+      }
+      return false;
+    }
+
+    case QgsExpression::ntBinaryOperator:
+    {
+      const QgsExpression::NodeBinaryOperator* n = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+      QString left, right;
+      ValueKind leftKind, rightKind;
+      if ( !compileNode( n->opLeft(), left, leftKind ) || !compileNode( n->opRight(), right, rightKind ) )
+        return false;
+
+      switch ( n->op() )
+      {
+        case QgsExpression::boAnd:
+        case QgsExpression::boOr:
+          if ( leftKind != BooleanValue || rightKind != BooleanValue )
+            return false;
+          sql = QString( "(%1) %2 (%3)" ).arg( left ).arg( n->op() == QgsExpression::boAnd ? "AND" : "OR" ).arg( right );
+          kind = BooleanValue;
+          return true;
+
+        case QgsExpression::boEQ:
+        case QgsExpression::boNE:
+        case QgsExpression::boLT:
+        case QgsExpression::boGT:
+        case QgsExpression::boLE:
+        case QgsExpression::boGE:
+        {
+          if ( leftKind == StringValue && rightKind == StringValue )
+          {
+            // strings are only compared for equality and only with a non-numeric literal,
+            // ordering depends on the collation of the database
+            if (( mFlags & CaseInsensitiveStrings ) || ( n->op() != QgsExpression::boEQ && n->op() != QgsExpression::boNE ) )
+              return false;
+            QString literal;
+            if ( !compileStringLiteral( n->opLeft(), literal ) && !compileStringLiteral( n->opRight(), literal ) )
+              return false;
+          }
+          else if ( !isNumeric( leftKind ) || !isNumeric( rightKind ) )
+          {
+            return false;
+          }
+
+          QString op;
+          switch ( n->op() )
+          {
+            case QgsExpression::boEQ: op = "="; break;
+            case QgsExpression::boNE: op = "<>"; break;
+            case QgsExpression::boLT: op = "<"; break;
+            case QgsExpression::boGT: op = ">"; break;
+            case QgsExpression::boLE: op = "<="; break;
+            default: op = ">="; break;
+          }
+          sql = QString( "%1 %2 %3" ).arg( left ).arg( op ).arg( right );
+          kind = BooleanValue;
+          return true;
+        }
+
+        case QgsExpression::boIs:
+        case QgsExpression::boIsNot:
+        {
+          // only comparison with NULL, IS of two values has no SQL counterpart
+          QString value;
+          if ( rightKind == NullValue && ( isNumeric( leftKind ) || leftKind == StringValue ) )
+            value = left;
+          else if ( leftKind == NullValue && ( isNumeric( rightKind ) || rightKind == StringValue ) )
+            value = right;
+          else
+            return false;
+          sql = QString( "%1 %2" ).arg( value ).arg( n->op() == QgsExpression::boIs ? "IS NULL" : "IS NOT NULL" );
+          kind = BooleanValue;
+          return true;
+        }
+
+        case QgsExpression::boPlus:
+        case QgsExpression::boMinus:
+        case QgsExpression::boMul:
+        {
+          // no division: the expression engine returns NULL when dividing by zero, databases fail.
+          // integers are computed with 32 bits and wrap around in the expression engine, while
+          // databases fail (e.g. postgres, MSSQL) or widen the type on overflow
+          if ( !isNumeric( leftKind ) || !isNumeric( rightKind ) )
+            return false;
+          if ( leftKind != DoubleValue && rightKind != DoubleValue )
+            return false;
+          QString op = n->op() == QgsExpression::boPlus ? "+" : n->op() == QgsExpression::boMinus ? "-" : "*";
+          sql = QString( "(%1 %2 %3)" ).arg( left ).arg( op ).arg( right );
+          kind = DoubleValue;
+          return true;
+        }
+
+        case QgsExpression::boLike:
+        case QgsExpression::boNotLike:
+        case QgsExpression::boILike:
+        case QgsExpression::boNotILike:
+        {
+          if ( leftKind != StringValue || rightKind != StringValue || n->opRight()->nodeType() != QgsExpression::ntLiteral )
+            return false;
+          if ( mFlags & CaseInsensitiveStrings )
+            return false;
+
+          // escape characters are not handled the same way by all databases
+          QString pattern = static_cast<const QgsExpression::NodeLiteral*>( n->opRight() )->value().toString();
+          if ( pattern.contains( '\\' ) || pattern.contains( '[' ) )
+            return false;
+
+          bool caseSensitive = n->op() == QgsExpression::boLike || n->op() == QgsExpression::boNotLike;
+          bool negate = n->op() == QgsExpression::boNotLike || n->op() == QgsExpression::boNotILike;
+          QString op = negate ? "NOT LIKE" : "LIKE";
+
+          if ( mFlags & LikeIsCaseInsensitive )
+          {
+            // such LIKE operators usually only fold the case of ASCII characters
+            if ( caseSensitive )
+              return false;
+            for ( int i = 0; i < pattern.length(); ++i )
+            {
+              if ( pattern[i].unicode() > 127 )
+                return false;
+            }
+          }
+          else if ( !caseSensitive )
+          {
+            if ( mFlags & ILikeOperator )
+            {
+              op = negate ? "NOT ILIKE" : "ILIKE";
+            }
+            else
+            {
+              left = QString( "UPPER(%1)" ).arg( left );
+              right = QString( "UPPER(%1)" ).arg( right );
+            }
+          }
+
+          sql = QString( "%1 %2 %3" ).arg( left ).arg( op ).arg( right );
+          kind = BooleanValue;
+          return true;
+        }
+
+        default:
+          return false;
+      }
+    }
+
+    case QgsExpression::ntInOperator:
+    {
+      const QgsExpression::NodeInOperator* n = static_cast<const QgsExpression::NodeInOperator*>( node );
+      QString value;
+      ValueKind valueKind;
+      if ( !compileNode( n->node(), value, valueKind ) )
+        return false;
+      if ( !isNumeric( valueKind ) && valueKind != StringValue )
+        return false;
+      if ( valueKind == StringValue && ( mFlags & CaseInsensitiveStrings ) )
+        return false;
+
+      QList<QgsExpression::Node*> items = n->list()->list();
+      if ( items.isEmpty() )
+        return false;
+
+      QStringList values;
+      foreach ( const QgsExpression::Node* item, items )
+      {
+        QString itemSql;
+        ValueKind itemKind;
+        if ( valueKind == StringValue )
+        {
+          if ( !compileStringLiteral( item, itemSql ) )
+            return false;
+        }
+        else if ( item->nodeType() != QgsExpression::ntLiteral || !compileNode( item, itemSql, itemKind ) || !isNumeric( itemKind ) )
+        {
+          return false;
+        }
+        values << itemSql;
+      }
+
+      sql = QString( "%1 %2 (%3)" ).arg( value ).arg( n->isNotIn() ? "NOT IN" : "IN" ).arg( values.join( "," ) );
+      kind = BooleanValue;
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
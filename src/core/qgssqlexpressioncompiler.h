@@ -0,0 +1,101 @@
+/***************************************************************************
+    qgssqlexpressioncompiler.h
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSSQLEXPRESSIONCOMPILER_H
+#define QGSSQLEXPRESSIONCOMPILER_H
+
+#include "qgsexpression.h"
+#include "qgsfield.h"
+
+/** \ingroup core
+ * Translates a QgsExpression to an SQL WHERE clause, so that data providers can filter
+ * features in the database instead of fetching all of them and evaluating the expression locally.
+ *
+ * Only nodes which give exactly the same result in SQL are translated: references to int,
+ * double and string fields (see isStringField()), literals, comparisons, AND / OR / NOT, +, -, *, IS [NOT] NULL,
+ * [NOT] IN and [NOT] LIKE / ILIKE with a literal pattern. Strings are only compared with
+ * non-numeric string literals, because the expression engine compares numeric strings as numbers.
+ * Arithmetic is only translated if an operand is a double: the expression engine computes
+ * integers with 32 bits and wraps around, databases fail or widen the type on overflow.
+ *
+ * If only some of the terms of a top level AND can be translated, the result is Partial:
+ * the WHERE clause then selects a superset of the matching features and the expression
+ * still has to be evaluated for the fetched features.
+ *
+ * Providers derive from this class to quote identifiers and values for their SQL dialect.
+ * @note added in 2.1
+ * @note not available in python bindings
+ */
+class CORE_EXPORT QgsSqlExpressionCompiler
+{
+  public:
+    enum Result
+    {
+      None,     //!< no expression
+      Complete, //!< the whole expression was translated
+      Partial,  //!< only a part was translated, the expression needs to be evaluated locally too
+      Fail      //!< nothing could be translated
+    };
+
+    enum Flag
+    {
+      LikeIsCaseInsensitive = 1,  //!< LIKE of the provider ignores case (LIKE cannot be translated, ILIKE becomes LIKE)
+      ILikeOperator = 1 << 1,     //!< the provider supports ILIKE (otherwise UPPER() is used)
+      CaseInsensitiveStrings = 1 << 2 //!< string comparisons depend on a collation which may ignore case, strings are not compared
+    };
+
+    QgsSqlExpressionCompiler( const QgsFields& fields, int flags = 0 );
+    virtual ~QgsSqlExpressionCompiler();
+
+    //! translate the expression, the WHERE clause is returned by result()
+    virtual Result compile( const QgsExpression* exp );
+
+    //! the WHERE clause of the last compile() call
+    QString result() const { return mResult; }
+
+  protected:
+    //! type of the value of a translated node
+    enum ValueKind
+    {
+      NullValue,
+      IntegerValue,
+      DoubleValue,
+      StringValue,
+      BooleanValue
+    };
+
+    //! whether the value is an integer or a double
+    static bool isNumeric( ValueKind kind ) { return kind == IntegerValue || kind == DoubleValue; }
+
+    //! quote a column name
+    virtual QString quotedIdentifier( const QString& identifier );
+    //! quote a literal value (int, double or string)
+    virtual QString quotedValue( const QVariant& value );
+
+    //! whether a field of type QVariant::String is compared like a string by the database.
+    //! Providers map other native types (e.g. boolean, uuid or padded char) to strings too,
+    //! their columns are only translated if this returns true.
+    virtual bool isStringField( const QgsField& field );
+
+    //! translate a node, returns false if it cannot be translated
+    virtual bool compileNode( const QgsExpression::Node* node, QString& sql, ValueKind& kind );
+
+    //! translate a string literal used in a string comparison
+    bool compileStringLiteral( const QgsExpression::Node* node, QString& sql );
+
+    QgsFields mFields;
+    int mFlags;
+    QString mResult;
+};
+
+#endif // QGSSQLEXPRESSIONCOMPILER_H
@@ -30,6 +30,7 @@
 #include <QProgressDialog>
 #include <QSettings>
 #include <QString>
+#include <QThread>
 #include <QDomNode>
 #include <QVector>
 
@@ -41,6 +42,7 @@
 #include "qgsapplication.h"
 #include "qgscoordinatetransform.h"
 #include "qgsdatasourceuri.h"
+#include "qgsexpression.h"
 #include "qgsfeature.h"
 #include "qgsfeaturerequest.h"
 #include "qgsfield.h"
@@ -412,75 +414,101 @@ void QgsVectorLayer::drawRendererV2( QgsFeatureIterator &fit, QgsRenderContext&
 
 #ifndef Q_WS_MAC
   int featureCount = 0;
+  // layers rendered by worker threads (parallel rendering) must not process events
+  bool inMainThread = QThread::currentThread() == qApp->thread();
 #endif //Q_WS_MAC
 
+  // features are classified and rendered in batches, so that the renderer can evaluate
+  // its expressions for all of them at once
   QgsFeature fet;
-  while ( fit.nextFeature( fet ) )
-  {
-    try
+  QgsFeatureList batch;
+  QList<bool> batchSelected;
+  QList<bool> batchDrawMarker;
+  bool moreFeatures = true;
+  while ( moreFeatures )
+  {
+    batch.clear();
+    batchSelected.clear();
+    batchDrawMarker.clear();
+    while ( batch.count() < 500 && ( moreFeatures = fit.nextFeature( fet ) ) )
     {
-      if ( !fet.geometry() )
-        continue; // skip features without geometry
+      if ( fet.geometry() ) // skip features without geometry
+      {
+        bool sel = mSelectedFeatureIds.contains( fet.id() );
+        batch.append( fet );
+        batchSelected.append( sel );
+        batchDrawMarker.append( mEditBuffer && ( !vertexMarkerOnlyForSelection || sel ) );
+      }
+      if ( rendererContext.renderingStopped() )
+        break;
+    }
 
 #ifndef Q_WS_MAC //MH: disable this on Mac for now to avoid problems with resizing
 #ifdef Q_WS_X11
-      if ( !mEnableBackbuffer ) // do not handle events, as we're already inside a paint event
-      {
+    if ( !mEnableBackbuffer ) // do not handle events, as we're already inside a paint event
+    {
 #endif // Q_WS_X11
-        if ( mUpdateThreshold > 0 && 0 == featureCount % mUpdateThreshold )
+      if ( inMainThread )
+      {
+        if ( mUpdateThreshold > 0 && featureCount / mUpdateThreshold != ( featureCount + batch.count() ) / mUpdateThreshold )
         {
           emit screenUpdateRequested();
-          // emit drawingProgress( featureCount, totalFeatures );
-          qApp->processEvents();
         }
-        else if ( featureCount % 1000 == 0 )
-        {
-          // emit drawingProgress( featureCount, totalFeatures );
-          qApp->processEvents();
-        }
-#ifdef Q_WS_X11
+        // emit drawingProgress( featureCount, totalFeatures );
+        qApp->processEvents();
       }
+#ifdef Q_WS_X11
+    }
 #endif // Q_WS_X11
 #endif // Q_WS_MAC
 
+    if ( rendererContext.renderingStopped() )
+    {
+      break;
+    }
+
+    // render features
+    QList<bool> rendered = mRendererV2->renderFeatures( batch, rendererContext, batchSelected, batchDrawMarker );
+
+    for ( int i = 0; i < batch.count(); ++i )
+    {
+      // labeling registration may be slow, so do not wait for the end of the batch
       if ( rendererContext.renderingStopped() )
       {
         break;
       }
 
-      bool sel = mSelectedFeatureIds.contains( fet.id() );
-      bool drawMarker = ( mEditBuffer && ( !vertexMarkerOnlyForSelection || sel ) );
-
-      // render feature
-      bool rendered = mRendererV2->renderFeature( fet, rendererContext, -1, sel, drawMarker );
-
+      QgsFeature& f = batch[i];
       if ( mEditBuffer )
       {
         // Cache this for the use of (e.g.) modifying the feature's uncommitted geometry.
-        mCache->cacheGeometry( fet.id(), *fet.geometry() );
+        mCache->cacheGeometry( f.id(), *f.geometry() );
       }
 
       // labeling - register feature
-      if ( rendered && rendererContext.labelingEngine() )
+      if ( rendered.at( i ) && rendererContext.labelingEngine() )
       {
-        if ( labeling )
+        try
         {
-          rendererContext.labelingEngine()->registerFeature( this, fet, rendererContext );
+          if ( labeling )
+          {
+            rendererContext.labelingEngine()->registerFeature( this, f, rendererContext );
+          }
+          if ( mDiagramRenderer )
+          {
+            rendererContext.labelingEngine()->registerDiagramFeature( this, f, rendererContext );
+          }
         }
-        if ( mDiagramRenderer )
+        catch ( const QgsCsException &cse )
         {
-          rendererContext.labelingEngine()->registerDiagramFeature( this, fet, rendererContext );
+          Q_UNUSED( cse );
+          QgsDebugMsg( QString( "Failed to transform a point while labeling a feature with ID '%1'. Ignoring this feature. %2" )
+                       .arg( f.id() ).arg( cse.what() ) );
         }
       }
     }
-    catch ( const QgsCsException &cse )
-    {
-      Q_UNUSED( cse );
-      QgsDebugMsg( QString( "Failed to transform a point while drawing a feature with ID '%1'. Ignoring this feature. %2" )
-                   .arg( fet.id() ).arg( cse.what() ) );
-    }
 #ifndef Q_WS_MAC
-    ++featureCount;
+    featureCount += batch.count();
 #endif //Q_WS_MAC
   }
 
@@ -516,11 +544,22 @@ void QgsVectorLayer::drawRendererV2Levels( QgsFeatureIterator &fit, QgsRenderCon
   QgsFeature fet;
 #ifndef Q_WS_MAC
   int featureCount = 0;
+  // layers rendered by worker threads (parallel rendering) must not process events
+  bool inMainThread = QThread::currentThread() == qApp->thread();
 #endif //Q_WS_MAC
-  while ( fit.nextFeature( fet ) )
+  // features are classified in batches, so that the renderer can evaluate its expressions for all of them at once
+  QgsFeatureList batch;
+  bool moreFeatures = true;
+  while ( moreFeatures )
   {
-    if ( !fet.geometry() )
-      continue; // skip features without geometry
+    batch.clear();
+    while ( batch.count() < 500 && ( moreFeatures = fit.nextFeature( fet ) ) )
+    {
+      if ( fet.geometry() ) // skip features without geometry
+        batch.append( fet );
+      if ( rendererContext.renderingStopped() )
+        break;
+    }
 
     if ( rendererContext.renderingStopped() )
     {
@@ -528,44 +567,57 @@ void QgsVectorLayer::drawRendererV2Levels( QgsFeatureIterator &fit, QgsRenderCon
       return;
     }
 #ifndef Q_WS_MAC
-    if ( featureCount % 1000 == 0 )
+    if ( inMainThread )
     {
       qApp->processEvents();
     }
 #endif //Q_WS_MAC
-    QgsSymbolV2* sym = mRendererV2->symbolForFeature( fet );
-    if ( !sym )
-    {
-      continue;
-    }
 
-    if ( !features.contains( sym ) )
+    QgsSymbolV2List batchSymbols = mRendererV2->symbolForFeatures( batch );
+    for ( int i = 0; i < batch.count(); ++i )
     {
-      features.insert( sym, QList<QgsFeature>() );
-    }
-    features[sym].append( fet );
+      // labeling registration may be slow, so do not wait for the end of the batch
+      if ( rendererContext.renderingStopped() )
+      {
+        stopRendererV2( rendererContext, selRenderer );
+        return;
+      }
 
-    if ( mEditBuffer )
-    {
-      // Cache this for the use of (e.g.) modifying the feature's uncommitted geometry.
-      mCache->cacheGeometry( fet.id(), *fet.geometry() );
-    }
+      QgsSymbolV2* sym = batchSymbols[i];
+      if ( !sym )
+      {
+        continue;
+      }
 
-    if ( sym && rendererContext.labelingEngine() )
-    {
-      if ( labeling )
+      QgsFeature& f = batch[i];
+      if ( !features.contains( sym ) )
       {
-        rendererContext.labelingEngine()->registerFeature( this, fet, rendererContext );
+        features.insert( sym, QList<QgsFeature>() );
       }
-      if ( mDiagramRenderer )
+      features[sym].append( f );
+
+      if ( mEditBuffer )
       {
-        rendererContext.labelingEngine()->registerDiagramFeature( this, fet, rendererContext );
+        // Cache this for the use of (e.g.) modifying the feature's uncommitted geometry.
+        mCache->cacheGeometry( f.id(), *f.geometry() );
+      }
+
+      if ( rendererContext.labelingEngine() )
+      {
+        if ( labeling )
+        {
+          rendererContext.labelingEngine()->registerFeature( this, f, rendererContext );
+        }
+        if ( mDiagramRenderer )
+        {
+          rendererContext.labelingEngine()->registerDiagramFeature( this, f, rendererContext );
+        }
       }
-    }
 
 #ifndef Q_WS_MAC
-    ++featureCount;
+      ++featureCount;
 #endif //Q_WS_MAC
+    }
   }
 
   // find out the order
@@ -612,7 +664,7 @@ void QgsVectorLayer::drawRendererV2Levels( QgsFeatureIterator &fit, QgsRenderCon
           return;
         }
 #ifndef Q_WS_MAC
-        if ( featureCount % 1000 == 0 )
+        if ( inMainThread && featureCount % 1000 == 0 )
         {
           qApp->processEvents();
         }
@@ -673,6 +725,9 @@ bool QgsVectorLayer::draw( QgsRenderContext& rendererContext )
 
   QgsDebugMsg( "rendering v2:\n" + mRendererV2->dump() );
 
+  // renderers, symbol layers and labeling evaluate their expressions without explicit context
+  QgsExpressionContextScope expressionScope( rendererContext.expressionContext() );
+
   if ( mEditBuffer )
   {
     // Destroy all cached geometries and clear the references to them
@@ -1116,31 +1171,40 @@ bool QgsVectorLayer::countSymbolFeatures( bool showProgress )
   renderContext.setRendererScale( 0 );
   mRendererV2->startRender( renderContext, this );
 
+  // features are classified in batches, so that the renderer can evaluate its expressions for all of them at once
   QgsFeature f;
-  while ( fit.nextFeature( f ) )
+  QgsFeatureList batch;
+  bool moreFeatures = true;
+  while ( moreFeatures )
   {
-    QgsSymbolV2List featureSymbolList = mRendererV2->symbolsForFeature( f );
-    for ( QgsSymbolV2List::iterator symbolIt = featureSymbolList.begin(); symbolIt != featureSymbolList.end(); ++symbolIt )
+    batch.clear();
+    while ( batch.count() < 500 && ( moreFeatures = fit.nextFeature( f ) ) )
     {
-      mSymbolFeatureCountMap[*symbolIt] += 1;
+      batch.append( f );
     }
-    ++featuresCounted;
+
+    QList<QgsSymbolV2List> batchSymbols = mRendererV2->symbolsForFeatures( batch );
+    for ( QList<QgsSymbolV2List>::const_iterator listIt = batchSymbols.constBegin(); listIt != batchSymbols.constEnd(); ++listIt )
+    {
+      for ( QgsSymbolV2List::const_iterator symbolIt = listIt->constBegin(); symbolIt != listIt->constEnd(); ++symbolIt )
+      {
+        mSymbolFeatureCountMap[*symbolIt] += 1;
+      }
+    }
+    featuresCounted += batch.count();
 
     if ( showProgress )
     {
-      if ( featuresCounted % 50 == 0 )
+      if ( featuresCounted > nFeatures ) //sometimes the feature count is not correct
       {
-        if ( featuresCounted > nFeatures ) //sometimes the feature count is not correct
-        {
-          progressDialog.setMaximum( 0 );
-        }
-        progressDialog.setValue( featuresCounted );
-        if ( progressDialog.wasCanceled() )
-        {
-          mSymbolFeatureCountMap.clear();
-          mRendererV2->stopRender( renderContext );
-          return false;
-        }
+        progressDialog.setMaximum( 0 );
+      }
+      progressDialog.setValue( featuresCounted );
+      if ( progressDialog.wasCanceled() )
+      {
+        mSymbolFeatureCountMap.clear();
+        mRendererV2->stopRender( renderContext );
+        return false;
       }
     }
   }
@@ -16,8 +16,8 @@
  ***************************************************************************/
 
 #include "qgsbilinearrasterresampler.h"
+#include "qgsrasterresamplerkernels.h"
 #include <QImage>
-#include <cmath>
 
 QgsBilinearRasterResampler::QgsBilinearRasterResampler()
 {
@@ -34,5 +34,13 @@ QgsRasterResampler * QgsBilinearRasterResampler::clone() const
 
 void QgsBilinearRasterResampler::resample( const QImage& srcImage, QImage& dstImage )
 {
-  dstImage = srcImage.scaled( dstImage.width(), dstImage.height(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+  // when zooming out Qt's smooth scaling averages all source pixels of an output pixel
+  if ( dstImage.width() >= srcImage.width() && dstImage.height() >= srcImage.height() )
+  {
+    QgsRasterResamplerKernels::bilinear( srcImage, dstImage );
+  }
+  else
+  {
+    dstImage = srcImage.scaled( dstImage.width(), dstImage.height(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+  }
 }
@@ -22,14 +22,20 @@ originally part of the larger QgsRasterLayer class
 #include "qgslogger.h"
 
 #include "qgscolorrampshader.h"
+#include "qgsrasterblock.h"
+
+#include <QtAlgorithms>
 
 #include <cmath>
 
-QgsColorRampShader::QgsColorRampShader( double theMinimumValue, double theMaximumValue ) : QgsRasterShaderFunction( theMinimumValue, theMaximumValue )
+QgsColorRampShader::QgsColorRampShader( double theMinimumValue, double theMaximumValue )
+    : QgsRasterShaderFunction( theMinimumValue, theMaximumValue )
+    , mColorRampType( INTERPOLATED )
+    , mLookupTableOffset( 0 )
+    , mMaximumColorCacheSize( 65536 ) //enough for 16-bit data
+    , mClip( false )
 {
   QgsDebugMsg( "called." );
-  mMaximumColorCacheSize = 1024; //good starting value
-  mCurrentColorRampItemIndex = 0;
 }
 
 QString QgsColorRampShader::colorRampTypeAsQString()
@@ -49,192 +55,192 @@ QString QgsColorRampShader::colorRampTypeAsQString()
   return QString( "Unknown" );
 }
 
-bool QgsColorRampShader::discreteColor( double theValue, int* theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue, int* theReturnAlphaValue )
+void QgsColorRampShader::updateLookup()
 {
-  int myColorRampItemCount = mColorRampItemList.count();
-  if ( myColorRampItemCount <= 0 )
+  mLookupItems.clear();
+  mLookupTable.clear();
+  mLookupTableValid.clear();
+  mLookupTableOffset = 0;
+
+  //the search assumes the items sorted by value
+  QList<QgsColorRampShader::ColorRampItem> mySortedItemList = mColorRampItemList;
+  qStableSort( mySortedItemList );
+
+  mLookupItems.reserve( mySortedItemList.size() );
+  QList<QgsColorRampShader::ColorRampItem>::const_iterator myIt = mySortedItemList.constBegin();
+  for ( ; myIt != mySortedItemList.constEnd(); ++myIt )
   {
-    return false;
+    LookupItem myItem;
+    myItem.value = myIt->value;
+    myItem.red = myIt->color.red();
+    myItem.green = myIt->color.green();
+    myItem.blue = myIt->color.blue();
+    myItem.alpha = myIt->color.alpha();
+    mLookupItems.append( myItem );
   }
 
-  double myTinyDiff = 0.0;
-  QgsColorRampShader::ColorRampItem myColorRampItem;
-  while ( mCurrentColorRampItemIndex >= 0 && mCurrentColorRampItemIndex < myColorRampItemCount )
+  if ( mLookupItems.isEmpty() )
   {
-    //Start searching from the last index - assumtion is that neighboring pixels tend to be similar values
-    myColorRampItem = mColorRampItemList.value( mCurrentColorRampItemIndex );
-    myTinyDiff = qAbs( theValue - myColorRampItem.value );
-    //If the previous entry is less, then search closer to the top of the list (assumes mColorRampItemList is sorted)
-    if ( mCurrentColorRampItemIndex != 0 &&
-         theValue <= mColorRampItemList.at( mCurrentColorRampItemIndex - 1 ).value )
-    {
-      mCurrentColorRampItemIndex--;
-    }
-    else if ( theValue <= myColorRampItem.value || myTinyDiff <= DOUBLE_DIFF_THRESHOLD )
+    return;
+  }
+
+  //integer values between the first and the last item are shaded in advance,
+  //values outside are still found by the binary search
+  double myFirstValue = floor( mLookupItems.first().value );
+  double myLastValue = ceil( mLookupItems.last().value );
+  if ( qIsNaN( myFirstValue ) || qIsNaN( myLastValue ) || qIsInf( myFirstValue ) || qIsInf( myLastValue )
+       || myLastValue - myFirstValue + 1 > mMaximumColorCacheSize )
+  {
+    QgsDebugMsg( "range of values too large for a lookup table" );
+    return;
+  }
+
+  int mySize = ( int )( myLastValue - myFirstValue ) + 1;
+  mLookupTableOffset = ( qint64 ) myFirstValue;
+  mLookupTable.resize( mySize );
+  mLookupTableValid.resize( mySize );
+  int myRed, myGreen, myBlue, myAlpha;
+  for ( int i = 0; i < mySize; i++ )
+  {
+    mLookupTableValid[i] = color(( double )( mLookupTableOffset + i ), &myRed, &myGreen, &myBlue, &myAlpha );
+    mLookupTable[i] = mLookupTableValid[i] ? premultipliedColor( myRed, myGreen, myBlue, myAlpha ) : 0;
+  }
+}
+
+int QgsColorRampShader::lookupItemIndex( double theValue ) const
+{
+  //binary search for the first item which is not below theValue
+  int myLow = 0;
+  int myHigh = mLookupItems.size();
+  while ( myLow < myHigh )
+  {
+    int myMiddle = ( myLow + myHigh ) / 2;
+    if ( mLookupItems[myMiddle].value + DOUBLE_DIFF_THRESHOLD < theValue )
     {
-      *theReturnRedValue = myColorRampItem.color.red();
-      *theReturnGreenValue = myColorRampItem.color.green();
-      *theReturnBlueValue = myColorRampItem.color.blue();
-      *theReturnAlphaValue = myColorRampItem.color.alpha();
-      //Cache the shaded value
-      if ( mMaximumColorCacheSize >= mColorCache.size() )
-      {
-        mColorCache.insert( theValue, myColorRampItem.color );
-      }
-      return true;
+      myLow = myMiddle + 1;
     }
-    //Search deeper into the color ramp list
     else
     {
-      mCurrentColorRampItemIndex++;
+      myHigh = myMiddle;
     }
   }
-
-  return false; // value not found
+  return myLow;
 }
 
-bool QgsColorRampShader::exactColor( double theValue, int* theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue , int *theReturnAlphaValue )
+bool QgsColorRampShader::color( double theValue, int* theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue, int* theReturnAlphaValue ) const
 {
-  int myColorRampItemCount = mColorRampItemList.count();
-  if ( myColorRampItemCount <= 0 )
+  if ( mLookupItems.isEmpty() || qIsNaN( theValue ) )
   {
     return false;
   }
 
-  double myTinyDiff = 0.0;
-  QgsColorRampShader::ColorRampItem myColorRampItem;
-  while ( mCurrentColorRampItemIndex >= 0 && mCurrentColorRampItemIndex < myColorRampItemCount )
+  if ( QgsColorRampShader::EXACT == mColorRampType )
   {
-    //Start searching from the last index - assumtion is that neighboring pixels tend to be similar values
-    myColorRampItem = mColorRampItemList.value( mCurrentColorRampItemIndex );
-    myTinyDiff = qAbs( theValue - myColorRampItem.value );
-    if ( theValue == myColorRampItem.value || myTinyDiff <= DOUBLE_DIFF_THRESHOLD )
-    {
-      *theReturnRedValue = myColorRampItem.color.red();
-      *theReturnGreenValue = myColorRampItem.color.green();
-      *theReturnBlueValue = myColorRampItem.color.blue();
-      *theReturnAlphaValue = myColorRampItem.color.alpha();
-      //Cache the shaded value
-      if ( mMaximumColorCacheSize >= mColorCache.size() )
-      {
-        mColorCache.insert( theValue, myColorRampItem.color );
-      }
-      return true;
-    }
-    //pixel value sits between ramp entries so bail
-    else if ( mCurrentColorRampItemIndex != myColorRampItemCount - 1 &&
-              theValue > myColorRampItem.value && theValue < mColorRampItemList.at(
-                mCurrentColorRampItemIndex + 1 ).value )
-    {
-      return false;
-    }
-    //Search deeper into the color ramp list
-    else if ( theValue > myColorRampItem.value )
-    {
-      mCurrentColorRampItemIndex++;
-    }
-    //Search back toward the beginning of the list
-    else
-    {
-      mCurrentColorRampItemIndex--;
-    }
+    return exactColor( theValue, theReturnRedValue, theReturnGreenValue, theReturnBlueValue, theReturnAlphaValue );
+  }
+  else if ( QgsColorRampShader::INTERPOLATED == mColorRampType )
+  {
+    return interpolatedColor( theValue, theReturnRedValue, theReturnGreenValue, theReturnBlueValue, theReturnAlphaValue );
   }
 
-  return false; // value not found
+  return discreteColor( theValue, theReturnRedValue, theReturnGreenValue, theReturnBlueValue, theReturnAlphaValue );
 }
 
-bool QgsColorRampShader::interpolatedColor( double theValue, int*
-    theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue , int* theReturnAlphaValue )
+bool QgsColorRampShader::discreteColor( double theValue, int* theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue, int* theReturnAlphaValue ) const
 {
-  int myColorRampItemCount = mColorRampItemList.count();
-  if ( myColorRampItemCount <= 0 )
+  //the first item not below the value gives the class
+  int myIndex = lookupItemIndex( theValue );
+  if ( myIndex >= mLookupItems.size() )
+  {
+    return false; // value not found
+  }
+
+  const LookupItem& myItem = mLookupItems[myIndex];
+  *theReturnRedValue = myItem.red;
+  *theReturnGreenValue = myItem.green;
+  *theReturnBlueValue = myItem.blue;
+  *theReturnAlphaValue = myItem.alpha;
+  return true;
+}
+
+bool QgsColorRampShader::exactColor( double theValue, int* theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue , int *theReturnAlphaValue ) const
+{
+  int myIndex = lookupItemIndex( theValue );
+  //pixel value sits between ramp entries so bail
+  if ( myIndex >= mLookupItems.size() || qAbs( theValue - mLookupItems[myIndex].value ) > DOUBLE_DIFF_THRESHOLD )
   {
     return false;
   }
 
-  double myTinyDiff = 0.0;
-  double myCurrentRampRange; //difference between two consecutive entry values
-  double myOffsetInRange; //difference between the previous entry value and value
-  QgsColorRampShader::ColorRampItem myColorRampItem;
-  while ( mCurrentColorRampItemIndex >= 0 && mCurrentColorRampItemIndex < myColorRampItemCount )
+  const LookupItem& myItem = mLookupItems[myIndex];
+  *theReturnRedValue = myItem.red;
+  *theReturnGreenValue = myItem.green;
+  *theReturnBlueValue = myItem.blue;
+  *theReturnAlphaValue = myItem.alpha;
+  return true;
+}
+
+bool QgsColorRampShader::interpolatedColor( double theValue, int*
+    theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue , int* theReturnAlphaValue ) const
+{
+  int myColorRampItemCount = mLookupItems.size();
+  int myIndex = lookupItemIndex( theValue );
+  const LookupItem* myItem = 0;
+
+  if ( myIndex == myColorRampItemCount )
   {
-    //Start searching from the last index - assumtion is that neighboring pixels tend to be similar values
-    myColorRampItem = mColorRampItemList.value( mCurrentColorRampItemIndex );
-    myTinyDiff = qAbs( theValue - myColorRampItem.value );
-    //If the previous entry is less, then search closer to the top of the list (assumes mColorRampItemList is sorted)
-    if ( mCurrentColorRampItemIndex != 0 && theValue <= mColorRampItemList.at( mCurrentColorRampItemIndex - 1 ).value )
+    // Values above the last entry are rendered if mClip is false
+    if ( mClip )
     {
-      mCurrentColorRampItemIndex--;
-    }
-    else if ( mCurrentColorRampItemIndex != 0 && ( theValue <= myColorRampItem.value || myTinyDiff <= DOUBLE_DIFF_THRESHOLD ) )
-    {
-      QgsColorRampShader::ColorRampItem myPreviousColorRampItem = mColorRampItemList.value( mCurrentColorRampItemIndex - 1 );
-      myCurrentRampRange = myColorRampItem.value - myPreviousColorRampItem.value;
-      myOffsetInRange = theValue - myPreviousColorRampItem.value;
-      double scale = myOffsetInRange / myCurrentRampRange;
-
-      *theReturnRedValue = ( int )(( double ) myPreviousColorRampItem.color.red() + (( double )( myColorRampItem.color.red() - myPreviousColorRampItem.color.red() ) * scale ) ) ;
-      *theReturnGreenValue = ( int )(( double ) myPreviousColorRampItem.color.green() + (( double )( myColorRampItem.color.green() - myPreviousColorRampItem.color.green() ) * scale ) );
-      *theReturnBlueValue = ( int )(( double ) myPreviousColorRampItem.color.blue() + (( double )( myColorRampItem.color.blue() - myPreviousColorRampItem.color.blue() ) * scale ) );
-      *theReturnAlphaValue = ( int )(( double ) myPreviousColorRampItem.color.alpha() + (( double )( myColorRampItem.color.alpha() - myPreviousColorRampItem.color.alpha() ) * scale ) );
-      if ( mMaximumColorCacheSize >= mColorCache.size() )
-      {
-        QColor myNewColor( *theReturnRedValue, *theReturnGreenValue, *theReturnBlueValue, *theReturnAlphaValue );
-        mColorCache.insert( theValue, myNewColor );
-      }
-      return true;
-    }
-    // Values outside total range are rendered if mClip is false
-    else if (( mCurrentColorRampItemIndex == 0 && ( myTinyDiff <= DOUBLE_DIFF_THRESHOLD || ( !mClip && theValue <= myColorRampItem.value ) ) )
-             || ( mCurrentColorRampItemIndex == myColorRampItemCount - 1 && ( myTinyDiff <= DOUBLE_DIFF_THRESHOLD || ( !mClip && theValue >= myColorRampItem.value ) ) ) )
-    {
-      //QgsColorRampShader::ColorRampItem myPreviousColorRampItem = mColorRampItemList.value( mCurrentColorRampItemIndex - 1 );
-      //myCurrentRampRange = myColorRampItem.value - myPreviousColorRampItem.value;
-      //myOffsetInRange = theValue - myPreviousColorRampItem.value;
-
-      *theReturnRedValue = myColorRampItem.color.red();
-      *theReturnGreenValue = myColorRampItem.color.green();
-      *theReturnBlueValue = myColorRampItem.color.blue();
-      *theReturnAlphaValue = myColorRampItem.color.alpha();
-      if ( mMaximumColorCacheSize >= mColorCache.size() )
-      {
-        QColor myNewColor( *theReturnRedValue, *theReturnGreenValue, *theReturnBlueValue, *theReturnAlphaValue );
-        mColorCache.insert( theValue, myNewColor );
-      }
-      return true;
-    }
-    //Search deeper into the color ramp list
-    else if ( theValue > myColorRampItem.value )
-    {
-      mCurrentColorRampItemIndex++;
+      return false;
     }
-    else
+    myItem = &mLookupItems[myColorRampItemCount - 1];
+  }
+  else if ( myIndex == 0 )
+  {
+    // Values below the first entry are rendered if mClip is false
+    if ( mClip && qAbs( theValue - mLookupItems[0].value ) > DOUBLE_DIFF_THRESHOLD )
     {
       return false;
     }
+    myItem = &mLookupItems[0];
   }
+  else
+  {
+    const LookupItem& myNextItem = mLookupItems[myIndex];
+    const LookupItem& myPreviousItem = mLookupItems[myIndex - 1];
+    double myCurrentRampRange = myNextItem.value - myPreviousItem.value; //difference between two consecutive entry values
+    double myOffsetInRange = theValue - myPreviousItem.value; //difference between the previous entry value and value
+    double scale = myOffsetInRange / myCurrentRampRange;
 
-  return false;
+    *theReturnRedValue = ( int )(( double ) myPreviousItem.red + (( double )( myNextItem.red - myPreviousItem.red ) * scale ) );
+    *theReturnGreenValue = ( int )(( double ) myPreviousItem.green + (( double )( myNextItem.green - myPreviousItem.green ) * scale ) );
+    *theReturnBlueValue = ( int )(( double ) myPreviousItem.blue + (( double )( myNextItem.blue - myPreviousItem.blue ) * scale ) );
+    *theReturnAlphaValue = ( int )(( double ) myPreviousItem.alpha + (( double )( myNextItem.alpha - myPreviousItem.alpha ) * scale ) );
+    return true;
+  }
+
+  *theReturnRedValue = myItem->red;
+  *theReturnGreenValue = myItem->green;
+  *theReturnBlueValue = myItem->blue;
+  *theReturnAlphaValue = myItem->alpha;
+  return true;
 }
 
 void QgsColorRampShader::setColorRampItemList( const QList<QgsColorRampShader::ColorRampItem>& theList )
 {
   mColorRampItemList = theList;
-  //Clear the cache
-  mColorCache.clear();
+  updateLookup();
 }
 
 void QgsColorRampShader::setColorRampType( QgsColorRampShader::ColorRamp_TYPE theColorRampType )
 {
-  //When the ramp type changes we need to clear out the cache
-  mColorCache.clear();
   mColorRampType = theColorRampType;
+  updateLookup();
 }
 
 void QgsColorRampShader::setColorRampType( QString theType )
 {
-  //When the type of the ramp changes we need to clear out the cache
-  mColorCache.clear();
   if ( theType == "INTERPOLATED" )
   {
     mColorRampType = INTERPOLATED;
@@ -247,44 +253,123 @@ void QgsColorRampShader::setColorRampType( QString theType )
   {
     mColorRampType = EXACT;
   }
+  updateLookup();
 }
 
-bool QgsColorRampShader::shade( double theValue, int* theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue , int *theReturnAlphaValue )
+void QgsColorRampShader::setMaximumColorCacheSize( int theSize )
 {
+  mMaximumColorCacheSize = theSize;
+  updateLookup();
+}
 
-  //Get the shaded value from the cache if it exists already
-  QColor myColor = mColorCache.value( theValue );
-  if ( myColor.isValid() )
-  {
-    *theReturnRedValue = myColor.red();
-    *theReturnGreenValue = myColor.green();
-    *theReturnBlueValue = myColor.blue();
-    *theReturnAlphaValue = myColor.alpha();
-    return true;
-  }
+void QgsColorRampShader::setClip( bool clip )
+{
+  mClip = clip;
+  updateLookup();
+}
 
-  //pixel value not in cache so generate new value
+bool QgsColorRampShader::shade( double theValue, int* theReturnRedValue, int* theReturnGreenValue, int* theReturnBlueValue , int *theReturnAlphaValue )
+{
+  return color( theValue, theReturnRedValue, theReturnGreenValue, theReturnBlueValue, theReturnAlphaValue );
+}
 
-  //Check to be sure mCurrentColorRampItemIndex is within the valid range.
-  if ( mCurrentColorRampItemIndex < 0 )
+void QgsColorRampShader::shadeBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor )
+{
+  if ( !theInput || !theOutput )
   {
-    mCurrentColorRampItemIndex = 0;
+    return;
   }
-  else if ( mCurrentColorRampItemIndex >= mColorRampItemList.size() )
+
+  const void* myData = theInput->bits();
+  if ( myData && !mLookupTable.isEmpty() )
   {
-    mCurrentColorRampItemIndex = mColorRampItemList.size() - 1;
+    switch ( theInput->dataType() )
+    {
+      case QGis::Byte:
+        shadeIntegerBlock( theInput, ( const quint8* )myData, theOutput, theDefaultColor );
+        return;
+      case QGis::UInt16:
+        shadeIntegerBlock( theInput, ( const quint16* )myData, theOutput, theDefaultColor );
+        return;
+      case QGis::Int16:
+        shadeIntegerBlock( theInput, ( const qint16* )myData, theOutput, theDefaultColor );
+        return;
+      case QGis::UInt32:
+        shadeIntegerBlock( theInput, ( const quint32* )myData, theOutput, theDefaultColor );
+        return;
+      case QGis::Int32:
+        shadeIntegerBlock( theInput, ( const qint32* )myData, theOutput, theDefaultColor );
+        return;
+      default:
+        break;
+    }
   }
 
-  if ( QgsColorRampShader::EXACT == mColorRampType )
+  shadeValueBlock( theInput, theOutput, theDefaultColor );
+}
+
+template <typename T>
+void QgsColorRampShader::shadeIntegerBlock( QgsRasterBlock* theInput, const T* theData, QRgb* theOutput, QRgb theDefaultColor ) const
+{
+  qgssize myCount = ( qgssize )theInput->width() * theInput->height();
+  bool myCheckNoData = theInput->hasNoData();
+  const QRgb* myTable = mLookupTable.constData();
+  const bool* myTableValid = mLookupTableValid.constData();
+  qint64 myTableSize = mLookupTable.size();
+  int myRed, myGreen, myBlue, myAlpha;
+
+  for ( qgssize i = 0; i < myCount; i++ )
   {
-    return exactColor( theValue, theReturnRedValue, theReturnGreenValue, theReturnBlueValue, theReturnAlphaValue );
+    if ( myCheckNoData && theInput->isNoData( i ) )
+    {
+      theOutput[i] = theDefaultColor;
+      continue;
+    }
+
+    qint64 myIndex = ( qint64 )theData[i] - mLookupTableOffset;
+    if ( myIndex >= 0 && myIndex < myTableSize )
+    {
+      theOutput[i] = myTableValid[myIndex] ? myTable[myIndex] : theDefaultColor;
+    }
+    else if ( color(( double )theData[i], &myRed, &myGreen, &myBlue, &myAlpha ) )
+    {
+      theOutput[i] = premultipliedColor( myRed, myGreen, myBlue, myAlpha );
+    }
+    else
+    {
+      theOutput[i] = theDefaultColor;
+    }
   }
-  else if ( QgsColorRampShader::INTERPOLATED == mColorRampType )
+}
+
+void QgsColorRampShader::shadeValueBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor ) const
+{
+  qgssize myCount = ( qgssize )theInput->width() * theInput->height();
+  bool myCheckNoData = theInput->hasNoData();
+  int myRed, myGreen, myBlue, myAlpha;
+
+  //neighboring pixels tend to have the same value, so the last color is reused
+  bool myHasLastValue = false;
+  double myLastValue = 0.0;
+  QRgb myLastColor = theDefaultColor;
+
+  for ( qgssize i = 0; i < myCount; i++ )
   {
-    return interpolatedColor( theValue, theReturnRedValue, theReturnGreenValue, theReturnBlueValue, theReturnAlphaValue );
-  }
+    if ( myCheckNoData && theInput->isNoData( i ) )
+    {
+      theOutput[i] = theDefaultColor;
+      continue;
+    }
 
-  return discreteColor( theValue, theReturnRedValue, theReturnGreenValue, theReturnBlueValue, theReturnAlphaValue );
+    double myValue = theInput->value( i );
+    if ( !myHasLastValue || myValue != myLastValue )
+    {
+      myHasLastValue = true;
+      myLastValue = myValue;
+      myLastColor = color( myValue, &myRed, &myGreen, &myBlue, &myAlpha ) ? premultipliedColor( myRed, myGreen, myBlue, myAlpha ) : theDefaultColor;
+    }
+    theOutput[i] = myLastColor;
+  }
 }
 
 bool QgsColorRampShader::shade( double theRedValue, double theGreenValue,
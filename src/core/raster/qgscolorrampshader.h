@@ -22,7 +22,7 @@ originally part of the larger QgsRasterLayer class
 #define QGSCOLORRAMPSHADER_H
 
 #include <QColor>
-#include <QMap>
+#include <QVector>
 
 #include "qgsrastershaderfunction.h"
 
@@ -70,7 +70,7 @@ class CORE_EXPORT QgsColorRampShader : public QgsRasterShaderFunction
     /** \brief Get the color ramp type as a string */
     QString colorRampTypeAsQString();
 
-    /** \brief Get the maximum size the color cache can be*/
+    /** \brief Get the maximum number of entries of the lookup table used for integer data*/
     int maximumColorCacheSize() { return mMaximumColorCacheSize; }
 
     /** \brief Set custom colormap */
@@ -82,8 +82,10 @@ class CORE_EXPORT QgsColorRampShader : public QgsRasterShaderFunction
     /** \brief Set the color ramp type*/
     void setColorRampType( QString );
 
-    /** \brief Set the maximum size the color cache can be */
-    void setMaximumColorCacheSize( int theSize ) { mMaximumColorCacheSize = theSize; }
+    /** \brief Set the maximum number of entries of the lookup table used for integer data.
+     * If the integer values between the first and the last ramp item do not fit,
+     * every value is looked up by binary search. */
+    void setMaximumColorCacheSize( int theSize );
 
     /** \brief Generates and new RGB value based on one input value */
     bool shade( double, int*, int*, int*, int* );
@@ -91,14 +93,27 @@ class CORE_EXPORT QgsColorRampShader : public QgsRasterShaderFunction
     /** \brief Generates and new RGB value based on original RGB value */
     bool shade( double, double, double, double, int*, int*, int*, int* );
 
+    /** \brief Shades a block using the lookup table for integer data types
+     * and binary search otherwise. Shading keeps no state, so the shader
+     * may be used from several threads at the same time.
+     * @note added in 2.1 */
+    void shadeBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor );
+
     void legendSymbologyItems( QList< QPair< QString, QColor > >& symbolItems ) const;
 
-    void setClip( bool clip ) { mClip = clip; }
+    void setClip( bool clip );
     bool clip() const { return mClip; }
 
   private:
-    /** Current index from which to start searching the color table*/
-    int mCurrentColorRampItemIndex;
+    /** Ramp item reduced to what is needed for shading */
+    struct LookupItem
+    {
+      double value;
+      int red;
+      int green;
+      int blue;
+      int alpha;
+    };
 
     //TODO: Consider pulling this out as a separate class and internally storing as a QMap rather than a QList
     /** This vector holds the information for classification based on values.
@@ -111,27 +126,53 @@ class CORE_EXPORT QgsColorRampShader : public QgsRasterShaderFunction
     /** \brief The color ramp type */
     QgsColorRampShader::ColorRamp_TYPE mColorRampType;
 
-    /** \brief Cache of values that have already been looked up */
-    QMap<double, QColor> mColorCache;
+    /** Ramp items sorted by value, searched by binary search */
+    QVector<LookupItem> mLookupItems;
+
+    /** Premultiplied colors for the integer values from mLookupTableOffset on */
+    QVector<QRgb> mLookupTable;
+
+    /** Whether the integer value at the same position of mLookupTable can be shaded */
+    QVector<bool> mLookupTableValid;
 
-    /** Maximum size of the color cache. The color cache could eat a ton of
+    /** Integer value of the first entry of mLookupTable */
+    qint64 mLookupTableOffset;
+
+    /** Maximum number of entries of the lookup table. The table could eat a ton of
      * memory if you have 32-bit data */
     int mMaximumColorCacheSize;
 
+    /** Rebuilds mLookupItems and mLookupTable, called whenever the items, the
+     * type or the clipping change */
+    void updateLookup();
+
+    /** Returns the index of the first item not below theValue - DOUBLE_DIFF_THRESHOLD,
+     * or the number of items if there is none */
+    int lookupItemIndex( double theValue ) const;
+
+    /** Gets the color for a pixel value according to the ramp type */
+    bool color( double, int*, int*, int*, int* ) const;
+
     /** Gets the color for a pixel value from the classification vector
      * mValueClassification. Assigns the color of the lower class for every
      * pixel between two class breaks.*/
-    bool discreteColor( double, int*, int*, int*, int* );
+    bool discreteColor( double, int*, int*, int*, int* ) const;
 
     /** Gets the color for a pixel value from the classification vector
      * mValueClassification. Assigns the color of the exact matching value in
      * the color ramp item list */
-    bool exactColor( double, int*, int*, int*, int* );
+    bool exactColor( double, int*, int*, int*, int* ) const;
 
     /** Gets the color for a pixel value from the classification vector
      * mValueClassification. Interpolates the color between two class breaks
      * linearly.*/
-    bool interpolatedColor( double, int*, int*, int*, int* );
+    bool interpolatedColor( double, int*, int*, int*, int* ) const;
+
+    /** Shades a block of integer values through the lookup table */
+    template <typename T> void shadeIntegerBlock( QgsRasterBlock* theInput, const T* theData, QRgb* theOutput, QRgb theDefaultColor ) const;
+
+    /** Shades a block of arbitrary values through binary search */
+    void shadeValueBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor ) const;
 
     /** Do not render values out of range */
     bool mClip;
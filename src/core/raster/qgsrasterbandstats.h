@@ -55,6 +55,7 @@ class CORE_EXPORT QgsRasterBandStats
       mean = 0.0;
       sumOfSquares = 0.0;
       stdDev = 0.0;
+      meanStandardError = 0.0;
       sum = 0.0;
       elementCount = 0;
       width = 0;
@@ -95,6 +96,11 @@ class CORE_EXPORT QgsRasterBandStats
     /** \brief The standard deviation of the cell values. */
     double stdDev;
 
+    /** \brief Standard error of the mean if the statistics were calculated
+     * from a sample of cells, 0 if all cells were used and NaN if unknown.
+     * @note added in 2.1 */
+    double meanStandardError;
+
     /** \brief Collected statistics */
     int statsGathered;
 
@@ -138,6 +138,14 @@ class CORE_EXPORT QgsRasterBlock
     /** Returns data type */
     QGis::DataType dataType() const { return mDataType; }
 
+    /** Returns the width of the block in pixels
+     * @note added in 2.1 */
+    int width() const { return mWidth; }
+
+    /** Returns the height of the block in pixels
+     * @note added in 2.1 */
+    int height() const { return mHeight; }
+
     /** For given data type returns wider type and sets no data value */
     static QGis::DataType typeWithNoDataValue( QGis::DataType dataType, double *noDataValue );
 
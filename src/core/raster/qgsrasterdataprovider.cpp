@@ -19,6 +19,7 @@
 #include "qgsrasterdataprovider.h"
 #include "qgsrasteridentifyresult.h"
 #include "qgsrasterprojector.h"
+#include "qgsrasterstatscache.h"
 #include "qgslogger.h"
 
 #include <QTime>
@@ -40,7 +41,11 @@ void QgsRasterDataProvider::setUseSrcNoDataValue( int bandNo, bool use )
       mUseSrcNoDataValue.append( false );
     }
   }
-  mUseSrcNoDataValue[bandNo-1] = use;
+  if ( mUseSrcNoDataValue[bandNo-1] != use )
+  {
+    clearStatistics( bandNo );
+    mUseSrcNoDataValue[bandNo-1] = use;
+  }
 }
 
 QgsRasterBlock * QgsRasterDataProvider::block( int theBandNo, QgsRectangle  const & theExtent, int theWidth, int theHeight )
@@ -401,22 +406,112 @@ void QgsRasterDataProvider::setUserNoDataValue( int bandNo, QgsRasterRangeList n
 
   if ( mUserNoDataValue[bandNo-1] != noData )
   {
-    // Clear statistics
-    int i = 0;
-    while ( i < mStatistics.size() )
+    clearStatistics( bandNo );
+    mUserNoDataValue[bandNo-1] = noData;
+  }
+}
+
+void QgsRasterDataProvider::clearStatistics( int bandNo )
+{
+  int i = 0;
+  while ( i < mStatistics.size() )
+  {
+    if ( mStatistics.value( i ).bandNumber == bandNo )
     {
-      if ( mStatistics.value( i ).bandNumber == bandNo )
-      {
-        mStatistics.removeAt( i );
-        mHistograms.removeAt( i );
-      }
-      else
-      {
-        i++;
-      }
+      mStatistics.removeAt( i );
+    }
+    else
+    {
+      i++;
+    }
+  }
+  i = 0;
+  while ( i < mHistograms.size() )
+  {
+    if ( mHistograms.value( i ).bandNumber == bandNo )
+    {
+      mHistograms.removeAt( i );
+    }
+    else
+    {
+      i++;
+    }
+  }
+  // statistics of the new no data values may be in the persistent cache
+  mStatisticsCacheBands.remove( bandNo );
+}
+
+QString QgsRasterDataProvider::noDataKey( int bandNo ) const
+{
+  QStringList myParts;
+  if ( srcHasNoDataValue( bandNo ) && useSrcNoDataValue( bandNo ) )
+  {
+    myParts << QString::number( srcNoDataValue( bandNo ), 'g', 17 );
+  }
+  else
+  {
+    myParts << "none";
+  }
+  foreach ( QgsRasterRange myRange, userNoDataValues( bandNo ) )
+  {
+    myParts << QString( "%1:%2" ).arg( myRange.min(), 0, 'g', 17 ).arg( myRange.max(), 0, 'g', 17 );
+  }
+  return myParts.join( " " );
+}
+
+void QgsRasterDataProvider::readStatisticsCache( int bandNo )
+{
+  if ( mStatisticsCacheBands.contains( bandNo ) )
+  {
+    return;
+  }
+  mStatisticsCacheBands.insert( bandNo );
+
+  QgsRasterStatsCache myCache( dataSourceUri() );
+  if ( !myCache.isValid() )
+  {
+    return;
+  }
+
+  QList<QgsRasterBandStats> myStatistics;
+  QList<QgsRasterHistogram> myHistograms;
+  if ( myCache.read( bandNo, noDataKey( bandNo ), myStatistics, myHistograms ) )
+  {
+    QgsDebugMsg( QString( "%1 statistics and %2 histograms of band %3 read from cache" ).arg( myStatistics.size() ).arg( myHistograms.size() ).arg( bandNo ) );
+    mStatistics << myStatistics;
+    mHistograms << myHistograms;
+  }
+}
+
+void QgsRasterDataProvider::writeStatisticsCache( int bandNo )
+{
+  QgsRasterStatsCache myCache( dataSourceUri() );
+  if ( !myCache.isValid() )
+  {
+    return;
+  }
+
+  // statistics of other extents depend on the view and approximations on the sample size,
+  // only exact full extent results are kept
+  QList<QgsRasterBandStats> myStatistics;
+  foreach ( const QgsRasterBandStats& myStats, mStatistics )
+  {
+    if ( myStats.bandNumber == bandNo && myStats.extent == extent() &&
+         myStats.width == xSize() && myStats.height == ySize() && myStats.meanStandardError == 0 )
+    {
+      myStatistics << myStats;
+    }
+  }
+  QList<QgsRasterHistogram> myHistograms;
+  foreach ( const QgsRasterHistogram& myHistogram, mHistograms )
+  {
+    if ( myHistogram.bandNumber == bandNo && myHistogram.extent == extent() &&
+         myHistogram.width == xSize() && myHistogram.height == ySize() )
+    {
+      myHistograms << myHistogram;
     }
-    mUserNoDataValue[bandNo-1] = noData;
   }
+  myCache.write( bandNo, noDataKey( bandNo ), myStatistics, myHistograms );
 }
 
 typedef QgsRasterDataProvider * createFunction_t( const QString&,
@@ -22,7 +22,9 @@
 
 #include <cmath>
 
+#include <QAtomicInt>
 #include <QDateTime>
+#include <QSet>
 #include <QVariant>
 #include <QImage>
 
@@ -207,6 +209,17 @@ class CORE_EXPORT QgsRasterDataProvider : public QgsDataProvider, public QgsRast
       return "FAILED_NOT_SUPPORTED";
     };
 
+    /** \brief Requests a running buildPyramids() to stop as soon as possible.
+     * May be called from a slot connected to progress() or from another thread.
+     * buildPyramids() then returns "CANCELED"; providers which support it keep
+     * the overviews written so far and resume the build on the next call.
+     * @note added in 2.1 */
+    void cancelBuildPyramids() { mBuildPyramidsCanceled = 1; }
+
+    /** \brief True if cancelBuildPyramids() was called since buildPyramids() started
+     * @note added in 2.1 */
+    bool buildPyramidsCanceled() const { return mBuildPyramidsCanceled != 0; }
+
     /** \brief Accessor for ths raster layers pyramid list.
      * @param overviewList used to construct the pyramid list (optional), when empty the list is defined by the provider.
      * A pyramid list defines the
@@ -370,6 +383,25 @@ class CORE_EXPORT QgsRasterDataProvider : public QgsDataProvider, public QgsRast
     /** Returns true if user no data contains value */
     bool userNoDataValuesContains( int bandNo, double value ) const;
 
+    /** Adds statistics and histograms of a band calculated in previous sessions
+     * from the persistent cache, once per band and no data configuration.
+     * @note added in 2.1 */
+    void readStatisticsCache( int bandNo );
+
+    /** Stores the statistics and histograms of the whole extent of a band in
+     * the persistent cache, see QgsRasterStatsCache
+     * @note added in 2.1 */
+    void writeStatisticsCache( int bandNo );
+
+    /** Describes the no data values used for a band, statistics are only reused
+     * from the persistent cache if they were calculated with the same no data values
+     * @note added in 2.1 */
+    QString noDataKey( int bandNo ) const;
+
+    /** Removes the statistics and histograms of a band from the memory cache
+     * @note added in 2.1 */
+    void clearStatistics( int bandNo );
+
     static QStringList cStringList2Q_( char ** stringList );
 
     static QString makeTableCell( const QString & value );
@@ -401,6 +433,12 @@ class CORE_EXPORT QgsRasterDataProvider : public QgsDataProvider, public QgsRast
 
     QgsRectangle mExtent;
 
+    /** Bands for which the persistent statistics cache was read already */
+    QSet<int> mStatisticsCacheBands;
+
+    /** Set by cancelBuildPyramids(), providers reset it when buildPyramids() starts */
+    QAtomicInt mBuildPyramidsCanceled;
+
     static void initPyramidResamplingDefs();
     static QStringList mPyramidResamplingListGdal;
     static QgsStringMap mPyramidResamplingMapGdal;
@@ -712,7 +712,7 @@ void QgsRasterFileWriter::buildPyramids( const QString& filename )
   // QApplication::restoreOverrideCursor();
 
   // TODO put this in provider or elsewhere
-  if ( !res.isNull() )
+  if ( !res.isNull() && res != "CANCELED" )
   {
     QString title, message;
     if ( res == "ERROR_WRITE_ACCESS" )
@@ -19,7 +19,9 @@
 #include <typeinfo>
 
 #include <QByteArray>
+#include <QThread>
 #include <QTime>
+#include <QtConcurrentMap>
 
 #include <qmath.h>
 
@@ -27,8 +29,132 @@
 #include "qgsrasterbandstats.h"
 #include "qgsrasterhistogram.h"
 #include "qgsrasterinterface.h"
+#include "qgsrasterstatsaccumulator.h"
 #include "qgsrectangle.h"
 
+//! minimum count of cells of a block read for statistics
+static const qgssize sMinStatsBlockCells = 1 << 16;
+
+//! block read for statistics and the values collected from it by one job
+template <typename Accumulator>
+struct QgsRasterStatsJob
+{
+  QgsRasterBlock* block;
+  Accumulator accumulator;
+
+  void run()
+  {
+    accumulator.addBlock( block );
+    delete block;
+    block = 0;
+  }
+};
+
+//! block grid of an extent read for statistics
+struct QgsRasterStatsGrid
+{
+  QgsRectangle extent;
+  int width;
+  int height;
+  int xBlockSize;
+  int yBlockSize;
+  int nXBlocks;
+  int nYBlocks;
+  double xRes;
+  double yRes;
+};
+
+/** Reads blocks from theFirstBlock on until theBatch holds theBatchSize jobs,
+ * returns the index of the next block to read */
+template <typename Accumulator>
+static int readStatsBlocks( QgsRasterInterface* theInterface, int theBandNo, const QgsRasterStatsGrid& theGrid,
+                            const Accumulator& theEmptyAccumulator, QVector< QgsRasterStatsJob<Accumulator> >& theBatch,
+                            int theFirstBlock, int theBatchSize )
+{
+  int myBlockCount = theGrid.nXBlocks * theGrid.nYBlocks;
+  int myBlock = theFirstBlock;
+  for ( ; myBlock < myBlockCount && theBatch.size() < theBatchSize; myBlock++ )
+  {
+    int myYBlock = myBlock / theGrid.nXBlocks;
+    int myXBlock = myBlock % theGrid.nXBlocks;
+    QgsDebugMsgLevel( QString( "myYBlock = %1 myXBlock = %2" ).arg( myYBlock ).arg( myXBlock ), 4 );
+    int myBlockWidth = qMin( theGrid.xBlockSize, theGrid.width - myXBlock * theGrid.xBlockSize );
+    int myBlockHeight = qMin( theGrid.yBlockSize, theGrid.height - myYBlock * theGrid.yBlockSize );
+
+    double xmin = theGrid.extent.xMinimum() + myXBlock * theGrid.xBlockSize * theGrid.xRes;
+    double xmax = xmin + myBlockWidth * theGrid.xRes;
+    double ymin = theGrid.extent.yMaximum() - myYBlock * theGrid.yBlockSize * theGrid.yRes;
+    double ymax = ymin - myBlockHeight * theGrid.yRes;
+
+    QgsRectangle myPartExtent( xmin, ymin, xmax, ymax );
+
+    QgsRasterStatsJob<Accumulator> myJob;
+    myJob.block = theInterface->block( theBandNo, myPartExtent, myBlockWidth, myBlockHeight );
+    myJob.accumulator = theEmptyAccumulator;
+    theBatch.append( myJob );
+  }
+  return myBlock;
+}
+
+/** Collects the values of theWidth x theHeight cells of theExtent in theAccumulator,
+ * which must be empty. Blocks are read from the calling thread only, their values
+ * are collected in parallel while the next batch of blocks is read. Partial results
+ * are merged in block order, so the result does not depend on the number of threads. */
+template <typename Accumulator>
+static void accumulateStatsBlocks( QgsRasterInterface* theInterface, int theBandNo, const QgsRectangle& theExtent,
+                                   int theWidth, int theHeight, Accumulator& theAccumulator )
+{
+  if ( theWidth <= 0 || theHeight <= 0 )
+  {
+    return;
+  }
+
+  QgsRasterStatsGrid myGrid;
+  myGrid.extent = theExtent;
+  myGrid.width = theWidth;
+  myGrid.height = theHeight;
+  myGrid.xBlockSize = theInterface->xBlockSize();
+  myGrid.yBlockSize = theInterface->yBlockSize();
+  if ( myGrid.xBlockSize == 0 ) // should not happen, but happens
+  {
+    myGrid.xBlockSize = 500;
+  }
+  if ( myGrid.yBlockSize == 0 ) // should not happen, but happens
+  {
+    myGrid.yBlockSize = 500;
+  }
+  // strips of few rows are joined, a job per row would cost more than it saves
+  while (( qgssize )myGrid.xBlockSize * myGrid.yBlockSize < sMinStatsBlockCells && myGrid.yBlockSize < theHeight )
+  {
+    myGrid.yBlockSize *= 2;
+  }
+  myGrid.nXBlocks = ( theWidth + myGrid.xBlockSize - 1 ) / myGrid.xBlockSize;
+  myGrid.nYBlocks = ( theHeight + myGrid.yBlockSize - 1 ) / myGrid.yBlockSize;
+  myGrid.xRes = theExtent.width() / theWidth;
+  myGrid.yRes = theExtent.height() / theHeight;
+
+  int myBatchSize = 2 * qMax( 1, QThread::idealThreadCount() );
+  Accumulator myEmptyAccumulator = theAccumulator;
+
+  // TODO: progress signals
+  QVector< QgsRasterStatsJob<Accumulator> > myBatches[2];
+  int myCurrent = 0;
+  int myNextBlock = readStatsBlocks( theInterface, theBandNo, myGrid, myEmptyAccumulator, myBatches[myCurrent], 0, myBatchSize );
+  while ( !myBatches[myCurrent].isEmpty() )
+  {
+    QFuture<void> myFuture = QtConcurrent::map( myBatches[myCurrent], &QgsRasterStatsJob<Accumulator>::run );
+    myNextBlock = readStatsBlocks( theInterface, theBandNo, myGrid, myEmptyAccumulator, myBatches[1 - myCurrent], myNextBlock, myBatchSize );
+    myFuture.waitForFinished();
+
+    for ( int i = 0; i < myBatches[myCurrent].size(); i++ )
+    {
+      theAccumulator.merge( myBatches[myCurrent][i].accumulator );
+    }
+    myBatches[myCurrent].clear();
+    myCurrent = 1 - myCurrent;
+  }
+}
+
 QgsRasterInterface::QgsRasterInterface( QgsRasterInterface * input )
     : mInput( input )
     , mOn( true )
@@ -139,99 +265,24 @@ QgsRasterBandStats QgsRasterInterface::bandStatistics( int theBandNo,
     }
   }
 
-  QgsRectangle myExtent = myRasterBandStats.extent;
-  int myWidth = myRasterBandStats.width;
-  int myHeight = myRasterBandStats.height;
+  QgsRasterStatsAccumulator myAccumulator;
+  accumulateStatsBlocks( this, theBandNo, myRasterBandStats.extent, myRasterBandStats.width, myRasterBandStats.height, myAccumulator );
+  myAccumulator.fillStatistics( myRasterBandStats );
 
-  //int myDataType = dataType( theBandNo );
-
-  int myXBlockSize = xBlockSize();
-  int myYBlockSize = yBlockSize();
-  if ( myXBlockSize == 0 ) // should not happen, but happens
-  {
-    myXBlockSize = 500;
-  }
-  if ( myYBlockSize == 0 ) // should not happen, but happens
+  // Error bound of the mean if only a sample of cells was used
+  if ( theSampleSize > 0 && myRasterBandStats.elementCount > 1 )
   {
-    myYBlockSize = 500;
-  }
-
-  int myNXBlocks = ( myWidth + myXBlockSize - 1 ) / myXBlockSize;
-  int myNYBlocks = ( myHeight + myYBlockSize - 1 ) / myYBlockSize;
-
-  double myXRes = myExtent.width() / myWidth;
-  double myYRes = myExtent.height() / myHeight;
-  // TODO: progress signals
-
-  // used by single pass stdev
-  double myMean = 0;
-  double mySumOfSquares = 0;
-
-  bool myFirstIterationFlag = true;
-  for ( int myYBlock = 0; myYBlock < myNYBlocks; myYBlock++ )
-  {
-    for ( int myXBlock = 0; myXBlock < myNXBlocks; myXBlock++ )
+    double mySampledFraction = 0.0;
+    if ( capabilities() & Size )
     {
-      QgsDebugMsg( QString( "myYBlock = %1 myXBlock = %2" ).arg( myYBlock ).arg( myXBlock ) );
-      int myBlockWidth = qMin( myXBlockSize, myWidth - myXBlock * myXBlockSize );
-      int myBlockHeight = qMin( myYBlockSize, myHeight - myYBlock * myYBlockSize );
-
-      double xmin = myExtent.xMinimum() + myXBlock * myXBlockSize * myXRes;
-      double xmax = xmin + myBlockWidth * myXRes;
-      double ymin = myExtent.yMaximum() - myYBlock * myYBlockSize * myYRes;
-      double ymax = ymin - myBlockHeight * myYRes;
-
-      QgsRectangle myPartExtent( xmin, ymin, xmax, ymax );
-
-      QgsRasterBlock* blk = block( theBandNo, myPartExtent, myBlockWidth, myBlockHeight );
-
-      // Collect the histogram counts.
-      for ( qgssize i = 0; i < (( qgssize ) myBlockHeight ) * myBlockWidth; i++ )
-      {
-        if ( blk->isNoData( i ) ) continue; // NULL
-
-        double myValue = blk->value( i );
-
-        myRasterBandStats.sum += myValue;
-        myRasterBandStats.elementCount++;
-
-        if ( myFirstIterationFlag )
-        {
-          myFirstIterationFlag = false;
-          myRasterBandStats.minimumValue = myValue;
-          myRasterBandStats.maximumValue = myValue;
-        }
-        else
-        {
-          if ( myValue < myRasterBandStats.minimumValue )
-          {
-            myRasterBandStats.minimumValue = myValue;
-          }
-          if ( myValue > myRasterBandStats.maximumValue )
-          {
-            myRasterBandStats.maximumValue = myValue;
-          }
-        }
-
-        // Single pass stdev
-        double myDelta = myValue - myMean;
-        myMean += myDelta / myRasterBandStats.elementCount;
-        mySumOfSquares += myDelta * ( myValue - myMean );
-      }
-      delete blk;
+      double srcXRes = extent().width() / xSize();
+      double srcYRes = extent().height() / ySize();
+      double mySrcCells = ( myRasterBandStats.extent.width() / srcXRes ) * ( myRasterBandStats.extent.height() / srcYRes );
+      mySampledFraction = qMin( 1.0, ( double )myRasterBandStats.width * myRasterBandStats.height / mySrcCells );
     }
+    myRasterBandStats.meanStandardError = myRasterBandStats.stdDev / sqrt(( double )myRasterBandStats.elementCount ) * sqrt( 1.0 - mySampledFraction );
   }
 
-  myRasterBandStats.range = myRasterBandStats.maximumValue - myRasterBandStats.minimumValue;
-  myRasterBandStats.mean = myRasterBandStats.sum / myRasterBandStats.elementCount;
-
-  myRasterBandStats.sumOfSquares = mySumOfSquares; // OK with single pass?
-
-  // stdDev may differ  from GDAL stats, because GDAL is using naive single pass
-  // algorithm which is more error prone (because of rounding errors)
-  // Divide result by sample size - 1 and get square root to get stdev
-  myRasterBandStats.stdDev = sqrt( mySumOfSquares / ( myRasterBandStats.elementCount - 1 ) );
-
   QgsDebugMsg( "************ STATS **************" );
   QgsDebugMsg( QString( "MIN %1" ).arg( myRasterBandStats.minimumValue ) );
   QgsDebugMsg( QString( "MAX %1" ).arg( myRasterBandStats.maximumValue ) );
@@ -408,24 +459,6 @@ QgsRasterHistogram QgsRasterInterface::histogram( int theBandNo,
   int myWidth = myHistogram.width;
   int myHeight = myHistogram.height;
   QgsRectangle myExtent = myHistogram.extent;
-  myHistogram.histogramVector.resize( myBinCount );
-
-  int myXBlockSize = xBlockSize();
-  int myYBlockSize = yBlockSize();
-  if ( myXBlockSize == 0 ) // should not happen, but happens
-  {
-    myXBlockSize = 500;
-  }
-  if ( myYBlockSize == 0 ) // should not happen, but happens
-  {
-    myYBlockSize = 500;
-  }
-
-  int myNXBlocks = ( myWidth + myXBlockSize - 1 ) / myXBlockSize;
-  int myNYBlocks = ( myHeight + myYBlockSize - 1 ) / myYBlockSize;
-
-  double myXRes = myExtent.width() / myWidth;
-  double myYRes = myExtent.height() / myHeight;
 
   double myMinimum = myHistogram.minimum;
   double myMaximum = myHistogram.maximum;
@@ -440,47 +473,10 @@ QgsRasterHistogram QgsRasterInterface::histogram( int theBandNo,
 
   double myBinSize = ( myMaximum - myMinimum ) / myBinCount;
 
-  // TODO: progress signals
-  for ( int myYBlock = 0; myYBlock < myNYBlocks; myYBlock++ )
-  {
-    for ( int myXBlock = 0; myXBlock < myNXBlocks; myXBlock++ )
-    {
-      int myBlockWidth = qMin( myXBlockSize, myWidth - myXBlock * myXBlockSize );
-      int myBlockHeight = qMin( myYBlockSize, myHeight - myYBlock * myYBlockSize );
-
-      double xmin = myExtent.xMinimum() + myXBlock * myXBlockSize * myXRes;
-      double xmax = xmin + myBlockWidth * myXRes;
-      double ymin = myExtent.yMaximum() - myYBlock * myYBlockSize * myYRes;
-      double ymax = ymin - myBlockHeight * myYRes;
-
-      QgsRectangle myPartExtent( xmin, ymin, xmax, ymax );
-
-      QgsRasterBlock* blk = block( theBandNo, myPartExtent, myBlockWidth, myBlockHeight );
-
-      // Collect the histogram counts.
-      for ( qgssize i = 0; i < (( qgssize ) myBlockHeight ) * myBlockWidth; i++ )
-      {
-        if ( blk->isNoData( i ) )
-        {
-          continue; // NULL
-        }
-        double myValue = blk->value( i );
-
-        int myBinIndex = static_cast <int>( qFloor(( myValue - myMinimum ) /  myBinSize ) ) ;
-
-        if (( myBinIndex < 0 || myBinIndex > ( myBinCount - 1 ) ) && !theIncludeOutOfRange )
-        {
-          continue;
-        }
-        if ( myBinIndex < 0 ) myBinIndex = 0;
-        if ( myBinIndex > ( myBinCount - 1 ) ) myBinIndex = myBinCount - 1;
-
-        myHistogram.histogramVector[myBinIndex] += 1;
-        myHistogram.nonNullCount++;
-      }
-      delete blk;
-    }
-  }
+  QgsRasterHistogramAccumulator myAccumulator( myMinimum, myBinSize, myBinCount, theIncludeOutOfRange );
+  accumulateStatsBlocks( this, theBandNo, myExtent, myWidth, myHeight, myAccumulator );
+  myHistogram.histogramVector = myAccumulator.histogramVector();
+  myHistogram.nonNullCount = myAccumulator.nonNullCount();
 
   myHistogram.valid = true;
   mHistograms.append( myHistogram );
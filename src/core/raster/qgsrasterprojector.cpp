@@ -21,6 +21,13 @@
 #include "qgsrasterprojector.h"
 #include "qgscoordinatetransform.h"
 
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QStringList>
+#include <QtConcurrentMap>
+#include <qnumeric.h>
+
 QgsRasterProjector::QgsRasterProjector(
   QgsCoordinateReferenceSystem theSrcCRS,
   QgsCoordinateReferenceSystem theDestCRS,
@@ -38,7 +45,6 @@ QgsRasterProjector::QgsRasterProjector(
     , mDestExtent( theDestExtent )
     , mExtent( theExtent )
     , mDestRows( theDestRows ), mDestCols( theDestCols )
-    , pHelperTop( 0 ), pHelperBottom( 0 )
     , mMaxSrcXRes( theMaxSrcXRes ), mMaxSrcYRes( theMaxSrcYRes )
 {
   QgsDebugMsg( "Entered" );
@@ -62,7 +68,6 @@ QgsRasterProjector::QgsRasterProjector(
     , mDestExtent( theDestExtent )
     , mExtent( theExtent )
     , mDestRows( theDestRows ), mDestCols( theDestCols )
-    , pHelperTop( 0 ), pHelperBottom( 0 )
     , mMaxSrcXRes( theMaxSrcXRes ), mMaxSrcYRes( theMaxSrcYRes )
 {
   QgsDebugMsg( "Entered" );
@@ -82,14 +87,13 @@ QgsRasterProjector::QgsRasterProjector(
     , mSrcDatumTransform( -1 )
     , mDestDatumTransform( -1 )
     , mExtent( theExtent )
-    , pHelperTop( 0 ), pHelperBottom( 0 )
     , mMaxSrcXRes( theMaxSrcXRes ), mMaxSrcYRes( theMaxSrcYRes )
 {
   QgsDebugMsg( "Entered" );
 }
 
 QgsRasterProjector::QgsRasterProjector()
-    : QgsRasterInterface( 0 ), mSrcDatumTransform( -1 ), mDestDatumTransform( -1 ) , pHelperTop( 0 ), pHelperBottom( 0 )
+    : QgsRasterInterface( 0 ), mSrcDatumTransform( -1 ), mDestDatumTransform( -1 )
 {
   QgsDebugMsg( "Entered" );
 }
@@ -132,8 +136,6 @@ QgsRasterInterface * QgsRasterProjector::clone() const
 
 QgsRasterProjector::~QgsRasterProjector()
 {
-  delete[] pHelperTop;
-  delete[] pHelperBottom;
 }
 
 int QgsRasterProjector::bandCount() const
@@ -158,15 +160,50 @@ void QgsRasterProjector::setCRS( const QgsCoordinateReferenceSystem & theSrcCRS,
   mDestDatumTransform = destDatumTransform;
 }
 
+//! control point matrix and source grid of a projector, see QgsRasterProjector::readCachedGrid()
+struct QgsRasterProjectorGrid
+{
+  QVector<QgsPoint> cpMatrix;
+  QVector<bool> cpLegalMatrix;
+  int cpRows;
+  int cpCols;
+  bool approximate;
+  QgsRectangle srcExtent;
+  int srcRows;
+  int srcCols;
+};
+
+//! grids of the last renders, the most recently used first
+static QMutex sGridCacheMutex;
+static QList< QPair<QString, QgsRasterProjectorGrid> > sGridCache;
+static const int sGridCacheSize = 16;
+
+//! minimum count of destination cells projected by one job
+static const int sJobCells = 1 << 16;
+
+//! destination rows filled by one job
+class QgsRasterProjectorRowsJob
+{
+  public:
+    const QgsRasterProjector* projector;
+    int firstRow;
+    int lastRow;
+    QgsRasterBlock* input;
+    QgsRasterBlock* output;
+    const char* srcBits;
+    char* destBits;
+
+    void run()
+    {
+      projector->projectRows( firstRow, lastRow, input, output, srcBits, destBits, false, 0 );
+    }
+};
+
 void QgsRasterProjector::calc()
 {
   QgsDebugMsg( "Entered" );
   mCPMatrix.clear();
   mCPLegalMatrix.clear();
-  delete[] pHelperTop;
-  pHelperTop = 0;
-  delete[] pHelperBottom;
-  pHelperBottom = 0;
 
   // Get max source resolution and extent if possible
   mMaxSrcXRes = 0;
@@ -196,54 +233,73 @@ void QgsRasterProjector::calc()
   double myDestRes = mDestXRes < mDestYRes ? mDestXRes : mDestYRes;
   mSqrTolerance = myDestRes * myDestRes;
 
-  const QgsCoordinateTransform* ct = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
-
-  // Initialize the matrix by corners and middle points
-  mCPCols = mCPRows = 3;
-  for ( int i = 0; i < mCPRows; i++ )
-  {
-    QList<QgsPoint> myRow;
-    myRow.append( QgsPoint() );
-    myRow.append( QgsPoint() );
-    myRow.append( QgsPoint() );
-    mCPMatrix.insert( i,  myRow );
-    // And the legal points
-    QList<bool> myLegalRow;
-    myLegalRow.append( bool( false ) );
-    myLegalRow.append( bool( false ) );
-    myLegalRow.append( bool( false ) );
-    mCPLegalMatrix.insert( i,  myLegalRow );
-  }
-  for ( int i = 0; i < mCPRows; i++ )
-  {
-    calcRow( i, ct );
-  }
-
-  while ( true )
-  {
-    bool myColsOK = checkCols( ct );
-    if ( !myColsOK )
+  // The matrix depends only on the CRSs, extents and sizes, which are mostly the same
+  // for repeated renders (e.g. WMS tiles or redraws)
+  QString myGridKey;
+  if ( !mSrcCRS.authid().isEmpty() && !mDestCRS.authid().isEmpty() )
+  {
+    QStringList myKeyParts;
+    myKeyParts << mSrcCRS.authid() << mDestCRS.authid()
+    << QString::number( mSrcDatumTransform ) << QString::number( mDestDatumTransform )
+    << QString::number( mDestExtent.xMinimum(), 'g', 17 ) << QString::number( mDestExtent.yMinimum(), 'g', 17 )
+    << QString::number( mDestExtent.xMaximum(), 'g', 17 ) << QString::number( mDestExtent.yMaximum(), 'g', 17 )
+    << QString::number( mDestRows ) << QString::number( mDestCols )
+    << QString::number( mExtent.xMinimum(), 'g', 17 ) << QString::number( mExtent.yMinimum(), 'g', 17 )
+    << QString::number( mExtent.xMaximum(), 'g', 17 ) << QString::number( mExtent.yMaximum(), 'g', 17 )
+    << QString::number( mMaxSrcXRes, 'g', 17 ) << QString::number( mMaxSrcYRes, 'g', 17 );
+    myGridKey = myKeyParts.join( " " );
+  }
+
+  if ( myGridKey.isEmpty() || !readCachedGrid( myGridKey ) )
+  {
+    const QgsCoordinateTransform* ct = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
+
+    // Initialize the matrix by corners and middle points
+    mCPCols = mCPRows = 3;
+    mCPMatrix.fill( QgsPoint(), mCPRows * mCPCols );
+    mCPLegalMatrix.fill( false, mCPRows * mCPCols );
+    QVector<int> myIndexes;
+    for ( int i = 0; i < mCPRows * mCPCols; i++ )
     {
-      insertRows( ct );
+      myIndexes.append( i );
     }
-    bool myRowsOK = checkRows( ct );
-    if ( !myRowsOK )
-    {
-      insertCols( ct );
-    }
-    if ( myColsOK && myRowsOK )
+    calcCPs( myIndexes, ct );
+
+    while ( true )
     {
-      QgsDebugMsg( "CP matrix within tolerance" );
-      mApproximate = true;
-      break;
+      bool myColsOK = checkCols( ct );
+      if ( !myColsOK )
+      {
+        insertRows( ct );
+      }
+      bool myRowsOK = checkRows( ct );
+      if ( !myRowsOK )
+      {
+        insertCols( ct );
+      }
+      if ( myColsOK && myRowsOK )
+      {
+        QgsDebugMsg( "CP matrix within tolerance" );
+        mApproximate = true;
+        break;
+      }
+      // What is the maximum reasonable size of transformatio matrix?
+      // TODO: consider better when to break - ratio
+      if ( mCPRows * mCPCols > 0.25 * mDestRows * mDestCols )
+      {
+        QgsDebugMsg( "Too large CP matrix" );
+        mApproximate = false;
+        break;
+      }
     }
-    // What is the maximum reasonable size of transformatio matrix?
-    // TODO: consider better when to break - ratio
-    if ( mCPRows * mCPCols > 0.25 * mDestRows * mDestCols )
+
+    // Calculate source dimensions
+    calcSrcExtent();
+    calcSrcRowsCols();
+
+    if ( !myGridKey.isEmpty() )
     {
-      QgsDebugMsg( "Too large CP matrix" );
-      mApproximate = false;
-      break;
+      writeCachedGrid( myGridKey );
     }
   }
   QgsDebugMsg( QString( "CPMatrix size: mCPRows = %1 mCPCols = %2" ).arg( mCPRows ).arg( mCPCols ) );
@@ -253,18 +309,52 @@ void QgsRasterProjector::calc()
   QgsDebugMsgLevel( "CPMatrix:", 5 );
   QgsDebugMsgLevel( cpToString(), 5 );
 
-  // Calculate source dimensions
-  calcSrcExtent();
-  calcSrcRowsCols();
   mSrcYRes = mSrcExtent.height() / mSrcRows;
   mSrcXRes = mSrcExtent.width() / mSrcCols;
+}
 
-  // init helper points
-  pHelperTop = new QgsPoint[mDestCols];
-  pHelperBottom = new QgsPoint[mDestCols];
-  calcHelper( 0, pHelperTop );
-  calcHelper( 1, pHelperBottom );
-  mHelperTopRow = 0;
+bool QgsRasterProjector::readCachedGrid( const QString &theKey )
+{
+  QMutexLocker locker( &sGridCacheMutex );
+  for ( int i = 0; i < sGridCache.size(); i++ )
+  {
+    if ( sGridCache[i].first == theKey )
+    {
+      const QgsRasterProjectorGrid &myGrid = sGridCache[i].second;
+      mCPMatrix = myGrid.cpMatrix;
+      mCPLegalMatrix = myGrid.cpLegalMatrix;
+      mCPRows = myGrid.cpRows;
+      mCPCols = myGrid.cpCols;
+      mApproximate = myGrid.approximate;
+      mSrcExtent = myGrid.srcExtent;
+      mSrcRows = myGrid.srcRows;
+      mSrcCols = myGrid.srcCols;
+      sGridCache.move( i, 0 );
+      QgsDebugMsg( "CP matrix found in cache" );
+      return true;
+    }
+  }
+  return false;
+}
+
+void QgsRasterProjector::writeCachedGrid( const QString &theKey ) const
+{
+  QgsRasterProjectorGrid myGrid;
+  myGrid.cpMatrix = mCPMatrix;
+  myGrid.cpLegalMatrix = mCPLegalMatrix;
+  myGrid.cpRows = mCPRows;
+  myGrid.cpCols = mCPCols;
+  myGrid.approximate = mApproximate;
+  myGrid.srcExtent = mSrcExtent;
+  myGrid.srcRows = mSrcRows;
+  myGrid.srcCols = mSrcCols;
+
+  QMutexLocker locker( &sGridCacheMutex );
+  sGridCache.prepend( qMakePair( theKey, myGrid ) );
+  while ( sGridCache.size() > sGridCacheSize )
+  {
+    sGridCache.removeLast();
+  }
 }
 
 void QgsRasterProjector::calcSrcExtent()
@@ -275,17 +365,14 @@ void QgsRasterProjector::calcSrcExtent()
   // the maximum y may be in the middle of destination extent
   // TODO: How to find extent exactly and quickly?
   // For now, we runt through all matrix
-  QgsPoint myPoint = mCPMatrix[0][0];
+  QgsPoint myPoint = mCPMatrix[0];
   mSrcExtent = QgsRectangle( myPoint.x(), myPoint.y(), myPoint.x(), myPoint.y() );
-  for ( int i = 0; i < mCPRows; i++ )
+  for ( int i = 0; i < mCPRows * mCPCols; i++ )
   {
-    for ( int j = 0; j < mCPCols ; j++ )
+    myPoint = mCPMatrix[i];
+    if ( mCPLegalMatrix[i] )
     {
-      myPoint = mCPMatrix[i][j];
-      if ( mCPLegalMatrix[i][j] )
-      {
-        mSrcExtent.combineExtentWith( myPoint.x(), myPoint.y() );
-      }
+      mSrcExtent.combineExtentWith( myPoint.x(), myPoint.y() );
     }
   }
   // Expand a bit to avoid possible approx coords falling out because of representation error?
@@ -340,8 +427,8 @@ QString QgsRasterProjector::cpToString()
     {
       if ( j > 0 )
         myString += "  ";
-      QgsPoint myPoint = mCPMatrix[i][j];
-      if ( mCPLegalMatrix[i][j] )
+      QgsPoint myPoint = mCPMatrix[i * mCPCols + j];
+      if ( mCPLegalMatrix[i * mCPCols + j] )
       {
         myString += myPoint.toString();
       }
@@ -373,10 +460,11 @@ void QgsRasterProjector::calcSrcRowsCols()
   {
     for ( int j = 0; j < mCPCols - 1; j++ )
     {
-      QgsPoint myPointA = mCPMatrix[i][j];
-      QgsPoint myPointB = mCPMatrix[i][j+1];
-      QgsPoint myPointC = mCPMatrix[i+1][j];
-      if ( mCPLegalMatrix[i][j] && mCPLegalMatrix[i][j+1] && mCPLegalMatrix[i+1][j] )
+      int myIndex = i * mCPCols + j;
+      QgsPoint myPointA = mCPMatrix[myIndex];
+      QgsPoint myPointB = mCPMatrix[myIndex + 1];
+      QgsPoint myPointC = mCPMatrix[myIndex + mCPCols];
+      if ( mCPLegalMatrix[myIndex] && mCPLegalMatrix[myIndex + 1] && mCPLegalMatrix[myIndex + mCPCols] )
       {
         double mySize = sqrt( myPointA.sqrDist( myPointB ) ) / myDestColsPerMatrixCell;
         if ( mySize < myMinSize )
@@ -409,112 +497,33 @@ void QgsRasterProjector::calcSrcRowsCols()
 }
 
 
-inline void QgsRasterProjector::destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY )
+inline void QgsRasterProjector::destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY ) const
 {
   *theX = mDestExtent.xMinimum() + theCol * mDestExtent.width() / ( mCPCols - 1 );
   *theY = mDestExtent.yMaximum() - theRow * mDestExtent.height() / ( mCPRows - 1 );
 }
 
-inline int QgsRasterProjector::matrixRow( int theDestRow )
-{
-  return ( int )( floor(( theDestRow + 0.5 ) / mDestRowsPerMatrixRow ) );
-}
-inline int QgsRasterProjector::matrixCol( int theDestCol )
-{
-  return ( int )( floor(( theDestCol + 0.5 ) / mDestColsPerMatrixCol ) );
-}
-
-QgsPoint QgsRasterProjector::srcPoint( int theDestRow, int theCol )
-{
-  Q_UNUSED( theDestRow );
-  Q_UNUSED( theCol );
-  return QgsPoint();
-}
-
-void QgsRasterProjector::calcHelper( int theMatrixRow, QgsPoint *thePoints )
+inline int QgsRasterProjector::matrixRow( int theDestRow ) const
 {
-  // TODO?: should we also precalc dest cell center coordinates for x and y?
-  for ( int myDestCol = 0; myDestCol < mDestCols; myDestCol++ )
-  {
-    double myDestX = mDestExtent.xMinimum() + ( myDestCol + 0.5 ) * mDestXRes;
-
-    int myMatrixCol = matrixCol( myDestCol );
-
-    double myDestXMin, myDestYMin, myDestXMax, myDestYMax;
-
-    destPointOnCPMatrix( theMatrixRow, myMatrixCol, &myDestXMin, &myDestYMin );
-    destPointOnCPMatrix( theMatrixRow, myMatrixCol + 1, &myDestXMax, &myDestYMax );
-
-    double xfrac = ( myDestX - myDestXMin ) / ( myDestXMax - myDestXMin );
-
-    QgsPoint &mySrcPoint0 = mCPMatrix[theMatrixRow][myMatrixCol];
-    QgsPoint &mySrcPoint1 = mCPMatrix[theMatrixRow][myMatrixCol+1];
-    double s = mySrcPoint0.x() + ( mySrcPoint1.x() - mySrcPoint0.x() ) * xfrac;
-    double t = mySrcPoint0.y() + ( mySrcPoint1.y() - mySrcPoint0.y() ) * xfrac;
-
-    thePoints[myDestCol].setX( s );
-    thePoints[myDestCol].setY( t );
-  }
-}
-void QgsRasterProjector::nextHelper()
-{
-  // We just switch pHelperTop and pHelperBottom, memory is not lost
-  QgsPoint *tmp;
-  tmp = pHelperTop;
-  pHelperTop = pHelperBottom;
-  pHelperBottom = tmp;
-  calcHelper( mHelperTopRow + 2, pHelperBottom );
-  mHelperTopRow++;
+  // the last destination row may fall on the last matrix row because of rounding
+  return qMin(( int )( floor(( theDestRow + 0.5 ) / mDestRowsPerMatrixRow ) ), mCPRows - 2 );
 }
-
-bool QgsRasterProjector::srcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform* ct )
+inline int QgsRasterProjector::matrixCol( int theDestCol ) const
 {
-  if ( mApproximate )
-  {
-    return approximateSrcRowCol( theDestRow, theDestCol, theSrcRow, theSrcCol );
-  }
-  else
-  {
-    return preciseSrcRowCol( theDestRow, theDestCol, theSrcRow, theSrcCol, ct );
-  }
+  return qMin(( int )( floor(( theDestCol + 0.5 ) / mDestColsPerMatrixCol ) ), mCPCols - 2 );
 }
 
-bool QgsRasterProjector::preciseSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform* ct )
+inline bool QgsRasterProjector::srcRowCol( double theX, double theY, int *theSrcRow, int *theSrcCol ) const
 {
-#ifdef QGISDEBUG
-  QgsDebugMsgLevel( QString( "theDestRow = %1" ).arg( theDestRow ), 5 );
-  QgsDebugMsgLevel( QString( "theDestRow = %1 mDestExtent.yMaximum() = %2 mDestYRes = %3" ).arg( theDestRow ).arg( mDestExtent.yMaximum() ).arg( mDestYRes ), 5 );
-#endif
-
-  // Get coordinate of center of destination cell
-  double x = mDestExtent.xMinimum() + ( theDestCol + 0.5 ) * mDestXRes;
-  double y = mDestExtent.yMaximum() - ( theDestRow + 0.5 ) * mDestYRes;
-  double z = 0;
-
-#ifdef QGISDEBUG
-  QgsDebugMsgLevel( QString( "x = %1 y = %2" ).arg( x ).arg( y ), 5 );
-#endif
-
-  if ( ct )
+  if ( !mExtent.contains( QgsPoint( theX, theY ) ) )
   {
-    ct->transformInPlace( x, y, z );
+    return false;
   }
 
-#ifdef QGISDEBUG
-  QgsDebugMsgLevel( QString( "x = %1 y = %2" ).arg( x ).arg( y ), 5 );
-#endif
+  // TODO: check again cell selection (coor is in the middle)
 
-  if ( !mExtent.contains( QgsPoint( x, y ) ) )
-  {
-    return false;
-  }
-  // Get source row col
-  *theSrcRow = ( int ) floor(( mSrcExtent.yMaximum() - y ) / mSrcYRes );
-  *theSrcCol = ( int ) floor(( x - mSrcExtent.xMinimum() ) / mSrcXRes );
-#ifdef QGISDEBUG
-  QgsDebugMsgLevel( QString( "mSrcExtent.yMinimum() = %1 mSrcExtent.yMaximum() = %2 mSrcYRes = %3" ).arg( mSrcExtent.yMinimum() ).arg( mSrcExtent.yMaximum() ).arg( mSrcYRes ), 5 );
-  QgsDebugMsgLevel( QString( "theSrcRow = %1 theSrcCol = %2" ).arg( *theSrcRow ).arg( *theSrcCol ), 5 );
-#endif
+  *theSrcRow = ( int ) floor(( mSrcExtent.yMaximum() - theY ) / mSrcYRes );
+  *theSrcCol = ( int ) floor(( theX - mSrcExtent.xMinimum() ) / mSrcXRes );
 
   // With epsg 32661 (Polar Stereographic) it was happening that *theSrcCol == mSrcCols
   // For now silently correct limits to avoid crashes
@@ -528,240 +537,346 @@ bool QgsRasterProjector::preciseSrcRowCol( int theDestRow, int theDestCol, int *
   return true;
 }
 
-bool QgsRasterProjector::approximateSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol )
+void QgsRasterProjector::preciseSrcRowCols( int theDestRow, int *theSrcRows, int *theSrcCols, const QgsCoordinateTransform* ct ) const
 {
-  int myMatrixRow = matrixRow( theDestRow );
-  int myMatrixCol = matrixCol( theDestCol );
+  // Get coordinates of centers of destination cells
+  QVector<double> x( mDestCols );
+  QVector<double> y( mDestCols, mDestExtent.yMaximum() - ( theDestRow + 0.5 ) * mDestYRes );
+  QVector<double> z( mDestCols, 0.0 );
+  for ( int myDestCol = 0; myDestCol < mDestCols; myDestCol++ )
+  {
+    x[myDestCol] = mDestExtent.xMinimum() + ( myDestCol + 0.5 ) * mDestXRes;
+  }
 
-  if ( myMatrixRow > mHelperTopRow )
+  QVector<bool> myLegal( mDestCols, true );
+  if ( ct )
   {
-    // TODO: make it more robust (for random, not sequential reading)
-    nextHelper();
+    try
+    {
+      ct->transformCoords( mDestCols, x.data(), y.data(), z.data() );
+    }
+    catch ( QgsCsException &e )
+    {
+      Q_UNUSED( e );
+      // Some point failed, transform the cells one by one to find the others
+      for ( int myDestCol = 0; myDestCol < mDestCols; myDestCol++ )
+      {
+        x[myDestCol] = mDestExtent.xMinimum() + ( myDestCol + 0.5 ) * mDestXRes;
+        y[myDestCol] = mDestExtent.yMaximum() - ( theDestRow + 0.5 ) * mDestYRes;
+        z[myDestCol] = 0;
+        try
+        {
+          ct->transformInPlace( x[myDestCol], y[myDestCol], z[myDestCol] );
+        }
+        catch ( QgsCsException &e )
+        {
+          Q_UNUSED( e );
+          myLegal[myDestCol] = false;
+        }
+      }
+    }
   }
 
+  for ( int myDestCol = 0; myDestCol < mDestCols; myDestCol++ )
+  {
+    if ( !myLegal[myDestCol] || !srcRowCol( x[myDestCol], y[myDestCol], &theSrcRows[myDestCol], &theSrcCols[myDestCol] ) )
+    {
+      theSrcRows[myDestCol] = -1;
+      theSrcCols[myDestCol] = -1;
+    }
+  }
+}
+
+void QgsRasterProjector::approximateSrcRowCols( int theDestRow, const int *theMatrixCols, const double *theXFracs,
+    int *theSrcRows, int *theSrcCols ) const
+{
+  int myMatrixRow = matrixRow( theDestRow );
+
   double myDestY = mDestExtent.yMaximum() - ( theDestRow + 0.5 ) * mDestYRes;
 
   // See the schema in javax.media.jai.WarpGrid doc (but up side down)
-  // TODO: use some kind of cache of values which can be reused
-  double myDestXMin, myDestYMin, myDestXMax, myDestYMax;
-
-  destPointOnCPMatrix( myMatrixRow + 1, myMatrixCol, &myDestXMin, &myDestYMin );
-  destPointOnCPMatrix( myMatrixRow, myMatrixCol + 1, &myDestXMax, &myDestYMax );
+  double myDestX, myDestYMin, myDestYMax;
+  destPointOnCPMatrix( myMatrixRow + 1, 0, &myDestX, &myDestYMin );
+  destPointOnCPMatrix( myMatrixRow, 0, &myDestX, &myDestYMax );
 
   double yfrac = ( myDestY - myDestYMin ) / ( myDestYMax - myDestYMin );
 
-  QgsPoint &myTop = pHelperTop[theDestCol];
-  QgsPoint &myBot = pHelperBottom[theDestCol];
-
-  // Warning: this is very SLOW compared to the following code!:
-  //double mySrcX = myBot.x() + (myTop.x() - myBot.x()) * yfrac;
-  //double mySrcY = myBot.y() + (myTop.y() - myBot.y()) * yfrac;
-
-  double tx = myTop.x();
-  double ty = myTop.y();
-  double bx = myBot.x();
-  double by = myBot.y();
-  double mySrcX = bx + ( tx - bx ) * yfrac;
-  double mySrcY = by + ( ty - by ) * yfrac;
-
-  if ( !mExtent.contains( QgsPoint( mySrcX, mySrcY ) ) )
+  // Interpolate along the top and bottom matrix rows and then between them
+  const QgsPoint *myTopRow = mCPMatrix.constData() + myMatrixRow * mCPCols;
+  const QgsPoint *myBottomRow = myTopRow + mCPCols;
+  for ( int myDestCol = 0; myDestCol < mDestCols; myDestCol++ )
   {
-    return false;
-  }
-
-  // TODO: check again cell selection (coor is in the middle)
+    int myMatrixCol = theMatrixCols[myDestCol];
+    double xfrac = theXFracs[myDestCol];
 
-  *theSrcRow = ( int ) floor(( mSrcExtent.yMaximum() - mySrcY ) / mSrcYRes );
-  *theSrcCol = ( int ) floor(( mySrcX - mSrcExtent.xMinimum() ) / mSrcXRes );
+    const QgsPoint &myTop0 = myTopRow[myMatrixCol];
+    const QgsPoint &myTop1 = myTopRow[myMatrixCol + 1];
+    const QgsPoint &myBot0 = myBottomRow[myMatrixCol];
+    const QgsPoint &myBot1 = myBottomRow[myMatrixCol + 1];
+    double tx = myTop0.x() + ( myTop1.x() - myTop0.x() ) * xfrac;
+    double ty = myTop0.y() + ( myTop1.y() - myTop0.y() ) * xfrac;
+    double bx = myBot0.x() + ( myBot1.x() - myBot0.x() ) * xfrac;
+    double by = myBot0.y() + ( myBot1.y() - myBot0.y() ) * xfrac;
 
-  // For now silently correct limits to avoid crashes
-  // TODO: review
-  // should not happen
-  if ( *theSrcRow >= mSrcRows ) return false;
-  if ( *theSrcRow < 0 ) return false;
-  if ( *theSrcCol >= mSrcCols ) return false;
-  if ( *theSrcCol < 0 ) return false;
+    double mySrcX = bx + ( tx - bx ) * yfrac;
+    double mySrcY = by + ( ty - by ) * yfrac;
 
-  return true;
+    if ( !srcRowCol( mySrcX, mySrcY, &theSrcRows[myDestCol], &theSrcCols[myDestCol] ) )
+    {
+      theSrcRows[myDestCol] = -1;
+      theSrcCols[myDestCol] = -1;
+    }
+  }
 }
 
 void QgsRasterProjector::insertRows( const QgsCoordinateTransform* ct )
 {
-  for ( int r = 0; r < mCPRows - 1; r++ )
+  int myRows = mCPRows + mCPRows - 1;
+  QVector<QgsPoint> myMatrix( myRows * mCPCols );
+  QVector<bool> myLegalMatrix( myRows * mCPCols, false );
+  QVector<int> myIndexes;
+  for ( int r = 0; r < myRows; r++ )
   {
-    QList<QgsPoint> myRow;
-    QList<bool> myLegalRow;
     for ( int c = 0; c < mCPCols; c++ )
     {
-      myRow.append( QgsPoint() );
-      myLegalRow.append( false );
+      if ( r % 2 == 0 )
+      {
+        myMatrix[r * mCPCols + c] = mCPMatrix[r / 2 * mCPCols + c];
+        myLegalMatrix[r * mCPCols + c] = mCPLegalMatrix[r / 2 * mCPCols + c];
+      }
+      else
+      {
+        myIndexes.append( r * mCPCols + c );
+      }
     }
-    QgsDebugMsgLevel( QString( "insert new row at %1" ).arg( 1 + r*2 ), 3 );
-    mCPMatrix.insert( 1 + r*2,  myRow );
-    mCPLegalMatrix.insert( 1 + r*2,  myLegalRow );
-  }
-  mCPRows += mCPRows - 1;
-  for ( int r = 1; r < mCPRows - 1; r += 2 )
-  {
-    calcRow( r, ct );
   }
+  QgsDebugMsgLevel( QString( "insert %1 new rows" ).arg( mCPRows - 1 ), 3 );
+  mCPMatrix = myMatrix;
+  mCPLegalMatrix = myLegalMatrix;
+  mCPRows = myRows;
+  calcCPs( myIndexes, ct );
 }
 
 void QgsRasterProjector::insertCols( const QgsCoordinateTransform* ct )
 {
+  int myCols = mCPCols + mCPCols - 1;
+  QVector<QgsPoint> myMatrix( mCPRows * myCols );
+  QVector<bool> myLegalMatrix( mCPRows * myCols, false );
+  QVector<int> myIndexes;
   for ( int r = 0; r < mCPRows; r++ )
   {
-    QList<QgsPoint> myRow;
-    QList<bool> myLegalRow;
-    for ( int c = 0; c < mCPCols - 1; c++ )
+    for ( int c = 0; c < myCols; c++ )
     {
-      mCPMatrix[r].insert( 1 + c*2,  QgsPoint() );
-      mCPLegalMatrix[r].insert( 1 + c*2,  false );
+      if ( c % 2 == 0 )
+      {
+        myMatrix[r * myCols + c] = mCPMatrix[r * mCPCols + c / 2];
+        myLegalMatrix[r * myCols + c] = mCPLegalMatrix[r * mCPCols + c / 2];
+      }
+      else
+      {
+        myIndexes.append( r * myCols + c );
+      }
     }
   }
-  mCPCols += mCPCols - 1;
-  for ( int c = 1; c < mCPCols - 1; c += 2 )
-  {
-    calcCol( c, ct );
-  }
-
+  QgsDebugMsgLevel( QString( "insert %1 new cols" ).arg( mCPCols - 1 ), 3 );
+  mCPMatrix = myMatrix;
+  mCPLegalMatrix = myLegalMatrix;
+  mCPCols = myCols;
+  calcCPs( myIndexes, ct );
 }
 
-void QgsRasterProjector::calcCP( int theRow, int theCol, const QgsCoordinateTransform* ct )
+void QgsRasterProjector::calcCPs( const QVector<int> &theIndexes, const QgsCoordinateTransform* ct )
 {
-  double myDestX, myDestY;
-  destPointOnCPMatrix( theRow, theCol, &myDestX, &myDestY );
-  QgsPoint myDestPoint( myDestX, myDestY );
-  try
+  int myCount = theIndexes.size();
+  if ( !ct )
   {
-    if ( ct )
+    for ( int i = 0; i < myCount; i++ )
     {
-      mCPMatrix[theRow][theCol] = ct->transform( myDestPoint );
-      mCPLegalMatrix[theRow][theCol] = true;
-    }
-    else
-    {
-      mCPLegalMatrix[theRow][theCol] = false;
+      mCPLegalMatrix[theIndexes[i]] = false;
     }
+    return;
+  }
+
+  QVector<double> x( myCount );
+  QVector<double> y( myCount );
+  QVector<double> z( myCount, 0.0 );
+  for ( int i = 0; i < myCount; i++ )
+  {
+    destPointOnCPMatrix( theIndexes[i] / mCPCols, theIndexes[i] % mCPCols, &x[i], &y[i] );
+  }
+
+  try
+  {
+    ct->transformCoords( myCount, x.data(), y.data(), z.data() );
   }
   catch ( QgsCsException &e )
   {
     Q_UNUSED( e );
-    // Caught an error in transform
-    mCPLegalMatrix[theRow][theCol] = false;
+    // Caught an error in transform, find the points which cannot be transformed one by one
+    for ( int i = 0; i < myCount; i++ )
+    {
+      double myDestX, myDestY;
+      destPointOnCPMatrix( theIndexes[i] / mCPCols, theIndexes[i] % mCPCols, &myDestX, &myDestY );
+      try
+      {
+        mCPMatrix[theIndexes[i]] = ct->transform( QgsPoint( myDestX, myDestY ) );
+        mCPLegalMatrix[theIndexes[i]] = true;
+      }
+      catch ( QgsCsException &e )
+      {
+        Q_UNUSED( e );
+        mCPLegalMatrix[theIndexes[i]] = false;
+      }
+    }
+    return;
+  }
+
+  // Points failing within a batch are set to HUGE_VAL by proj
+  for ( int i = 0; i < myCount; i++ )
+  {
+    bool myLegal = qIsFinite( x[i] ) && qIsFinite( y[i] ) && x[i] != HUGE_VAL && y[i] != HUGE_VAL;
+    mCPMatrix[theIndexes[i]] = myLegal ? QgsPoint( x[i], y[i] ) : QgsPoint();
+    mCPLegalMatrix[theIndexes[i]] = myLegal;
   }
 }
 
-bool QgsRasterProjector::calcRow( int theRow, const QgsCoordinateTransform* ct )
+bool QgsRasterProjector::checkCols( const QgsCoordinateTransform* ct )
 {
-  QgsDebugMsgLevel( QString( "theRow = %1" ).arg( theRow ), 3 );
-  for ( int i = 0; i < mCPCols; i++ )
+  QVector<int> myIndexes, myNeighbours1, myNeighbours2;
+  for ( int c = 0; c < mCPCols; c++ )
   {
-    calcCP( theRow, i, ct );
+    for ( int r = 1; r < mCPRows - 1; r += 2 )
+    {
+      myIndexes.append( r * mCPCols + c );
+      myNeighbours1.append(( r - 1 ) * mCPCols + c );
+      myNeighbours2.append(( r + 1 ) * mCPCols + c );
+    }
   }
-
-  return true;
+  return checkApproximation( myIndexes, myNeighbours1, myNeighbours2, ct );
 }
 
-bool QgsRasterProjector::calcCol( int theCol, const QgsCoordinateTransform* ct )
+bool QgsRasterProjector::checkRows( const QgsCoordinateTransform* ct )
 {
-  QgsDebugMsgLevel( QString( "theCol = %1" ).arg( theCol ), 3 );
-  for ( int i = 0; i < mCPRows; i++ )
+  QVector<int> myIndexes, myNeighbours1, myNeighbours2;
+  for ( int r = 0; r < mCPRows; r++ )
   {
-    calcCP( i, theCol, ct );
+    for ( int c = 1; c < mCPCols - 1; c += 2 )
+    {
+      myIndexes.append( r * mCPCols + c );
+      myNeighbours1.append( r * mCPCols + c - 1 );
+      myNeighbours2.append( r * mCPCols + c + 1 );
+    }
   }
-
-  return true;
+  return checkApproximation( myIndexes, myNeighbours1, myNeighbours2, ct );
 }
 
-bool QgsRasterProjector::checkCols( const QgsCoordinateTransform* ct )
+bool QgsRasterProjector::checkApproximation( const QVector<int> &theIndexes, const QVector<int> &theNeighbours1,
+    const QVector<int> &theNeighbours2, const QgsCoordinateTransform* ct )
 {
   if ( !ct )
   {
     return false;
   }
 
-  for ( int c = 0; c < mCPCols; c++ )
+  int myCount = theIndexes.size();
+  QVector<double> x( myCount );
+  QVector<double> y( myCount );
+  QVector<double> z( myCount, 0.0 );
+  for ( int i = 0; i < myCount; i++ )
   {
-    for ( int r = 1; r < mCPRows - 1; r += 2 )
+    if ( !mCPLegalMatrix[theNeighbours1[i]] || !mCPLegalMatrix[theIndexes[i]] || !mCPLegalMatrix[theNeighbours2[i]] )
     {
-      double myDestX, myDestY;
-      destPointOnCPMatrix( r, c, &myDestX, &myDestY );
-      QgsPoint myDestPoint( myDestX, myDestY );
+      // There was an error earlier in transform, just abort
+      return false;
+    }
+    const QgsPoint &mySrcPoint1 = mCPMatrix[theNeighbours1[i]];
+    const QgsPoint &mySrcPoint3 = mCPMatrix[theNeighbours2[i]];
+    x[i] = ( mySrcPoint1.x() + mySrcPoint3.x() ) / 2;
+    y[i] = ( mySrcPoint1.y() + mySrcPoint3.y() ) / 2;
+  }
 
-      QgsPoint mySrcPoint1 = mCPMatrix[r-1][c];
-      QgsPoint mySrcPoint2 = mCPMatrix[r][c];
-      QgsPoint mySrcPoint3 = mCPMatrix[r+1][c];
+  try
+  {
+    ct->transformCoords( myCount, x.data(), y.data(), z.data(), QgsCoordinateTransform::ReverseTransform );
+  }
+  catch ( QgsCsException &e )
+  {
+    Q_UNUSED( e );
+    // Caught an error in transform
+    return false;
+  }
 
-      QgsPoint mySrcApprox(( mySrcPoint1.x() + mySrcPoint3.x() ) / 2, ( mySrcPoint1.y() + mySrcPoint3.y() ) / 2 );
-      if ( !mCPLegalMatrix[r-1][c] || !mCPLegalMatrix[r][c] || !mCPLegalMatrix[r+1][c] )
-      {
-        // There was an error earlier in transform, just abort
-        return false;
-      }
-      try
-      {
-        QgsPoint myDestApprox = ct->transform( mySrcApprox, QgsCoordinateTransform::ReverseTransform );
-        double mySqrDist = myDestApprox.sqrDist( myDestPoint );
-        if ( mySqrDist > mSqrTolerance )
-        {
-          return false;
-        }
-      }
-      catch ( QgsCsException &e )
-      {
-        Q_UNUSED( e );
-        // Caught an error in transform
-        return false;
-      }
+  for ( int i = 0; i < myCount; i++ )
+  {
+    double myDestX, myDestY;
+    destPointOnCPMatrix( theIndexes[i] / mCPCols, theIndexes[i] % mCPCols, &myDestX, &myDestY );
+    double mySqrDist = ( x[i] - myDestX ) * ( x[i] - myDestX ) + ( y[i] - myDestY ) * ( y[i] - myDestY );
+    // also false for points which failed within the batch
+    if ( !( mySqrDist <= mSqrTolerance ) )
+    {
+      return false;
     }
   }
   return true;
 }
 
-bool QgsRasterProjector::checkRows( const QgsCoordinateTransform* ct )
+void QgsRasterProjector::projectRows( int theFirstRow, int theLastRow, QgsRasterBlock *theInput, QgsRasterBlock *theOutput,
+                                      const char *theSrcBits, char *theDestBits, bool theDoNoData, const QgsCoordinateTransform* ct ) const
 {
-  if ( !ct )
+  qgssize pixelSize = QgsRasterBlock::typeSize( theInput->dataType() );
+
+  // matrix columns and fractions are the same for all rows
+  QVector<int> myMatrixCols( mDestCols );
+  QVector<double> myXFracs( mDestCols );
+  if ( mApproximate )
   {
-    return false;
+    for ( int myDestCol = 0; myDestCol < mDestCols; myDestCol++ )
+    {
+      double myDestX = mDestExtent.xMinimum() + ( myDestCol + 0.5 ) * mDestXRes;
+      int myMatrixCol = matrixCol( myDestCol );
+      double myDestXMin, myDestXMax, myDestY;
+      destPointOnCPMatrix( 0, myMatrixCol, &myDestXMin, &myDestY );
+      destPointOnCPMatrix( 0, myMatrixCol + 1, &myDestXMax, &myDestY );
+      myMatrixCols[myDestCol] = myMatrixCol;
+      myXFracs[myDestCol] = ( myDestX - myDestXMin ) / ( myDestXMax - myDestXMin );
+    }
   }
 
-  for ( int r = 0; r < mCPRows; r++ )
+  QVector<int> mySrcRows( mDestCols );
+  QVector<int> mySrcCols( mDestCols );
+  for ( int i = theFirstRow; i < theLastRow; ++i )
   {
-    for ( int c = 1; c < mCPCols - 1; c += 2 )
+    if ( mApproximate )
     {
-      double myDestX, myDestY;
-      destPointOnCPMatrix( r, c, &myDestX, &myDestY );
+      approximateSrcRowCols( i, myMatrixCols.constData(), myXFracs.constData(), mySrcRows.data(), mySrcCols.data() );
+    }
+    else
+    {
+      preciseSrcRowCols( i, mySrcRows.data(), mySrcCols.data(), ct );
+    }
 
-      QgsPoint myDestPoint( myDestX, myDestY );
-      QgsPoint mySrcPoint1 = mCPMatrix[r][c-1];
-      QgsPoint mySrcPoint2 = mCPMatrix[r][c];
-      QgsPoint mySrcPoint3 = mCPMatrix[r][c+1];
+    for ( int j = 0; j < mDestCols; ++j )
+    {
+      int srcRow = mySrcRows[j];
+      int srcCol = mySrcCols[j];
+      if ( srcRow < 0 ) continue; // we have everything set to no data
 
-      QgsPoint mySrcApprox(( mySrcPoint1.x() + mySrcPoint3.x() ) / 2, ( mySrcPoint1.y() + mySrcPoint3.y() ) / 2 );
-      if ( !mCPLegalMatrix[r][c-1] || !mCPLegalMatrix[r][c] || !mCPLegalMatrix[r][c+1] )
-      {
-        // There was an error earlier in transform, just abort
-        return false;
-      }
-      try
-      {
-        QgsPoint myDestApprox = ct->transform( mySrcApprox, QgsCoordinateTransform::ReverseTransform );
-        double mySqrDist = myDestApprox.sqrDist( myDestPoint );
-        if ( mySqrDist > mSqrTolerance )
-        {
-          return false;
-        }
-      }
-      catch ( QgsCsException &e )
+      qgssize srcIndex = ( qgssize )srcRow * mSrcCols + srcCol;
+      QgsDebugMsgLevel( QString( "row = %1 col = %2 srcRow = %3 srcCol = %4" ).arg( i ).arg( j ).arg( srcRow ).arg( srcCol ), 5 );
+
+      // isNoData() may be slow so we check doNoData first
+      if ( theDoNoData && theInput->isNoData( srcRow, srcCol ) )
       {
-        Q_UNUSED( e );
-        // Caught an error in transform
-        return false;
+        theOutput->setIsNoData( i, j );
+        continue ;
       }
+
+      qgssize destIndex = ( qgssize )i * mDestCols + j;
+      const char *srcBits = theSrcBits + srcIndex * pixelSize;
+      char *destBits = theDestBits + destIndex * pixelSize;
+      memcpy( destBits, srcBits, pixelSize );
     }
   }
-  return true;
 }
 
 QgsRasterBlock * QgsRasterProjector::block( int bandNo, QgsRectangle  const & extent, int width, int height )
@@ -803,8 +918,6 @@ QgsRasterBlock * QgsRasterProjector::block( int bandNo, QgsRectangle  const & ex
     return new QgsRasterBlock();
   }
 
-  qgssize pixelSize = QgsRasterBlock::typeSize( mInput->dataType( bandNo ) );
-
   QgsRasterBlock *outputBlock;
   if ( inputBlock->hasNoDataValue() )
   {
@@ -836,47 +949,45 @@ QgsRasterBlock * QgsRasterProjector::block( int bandNo, QgsRectangle  const & ex
   // we cannot fill output block with no data because we use memcpy for data, not setValue().
   bool doNoData = !QgsRasterBlock::typeIsNumeric( inputBlock->dataType() ) && inputBlock->hasNoData() && !inputBlock->hasNoDataValue();
 
-  const QgsCoordinateTransform* ct = 0;
-  if ( !mApproximate )
+  // the data are accessed directly, bits() may detach an image
+  const char *srcBits = inputBlock->bits();
+  char *destBits = outputBlock->bits();
+  if ( !srcBits || !destBits )
   {
-    ct = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
+    QgsDebugMsg( "Cannot get block data" );
+    delete inputBlock;
+    return outputBlock;
   }
 
-  outputBlock->setIsNoData();
-
-  int srcRow, srcCol;
-  for ( int i = 0; i < height; ++i )
+  if ( mApproximate && !doNoData && ( qgssize )width * height >= 2 * sJobCells )
   {
-    for ( int j = 0; j < width; ++j )
+    // Rows are independent with the approximation, fill them in parallel. Not with the no data
+    // bitmap, cells of neighbouring rows may share its bytes. Not with the precise transformation,
+    // proj objects must not be used from several threads.
+    QVector<QgsRasterProjectorRowsJob> jobs;
+    int rowsPerJob = qMax( 1, sJobCells / width );
+    for ( int row = 0; row < height; row += rowsPerJob )
     {
-      bool inside = srcRowCol( i, j, &srcRow, &srcCol, ct );
-      if ( !inside ) continue; // we have everything set to no data
-
-      qgssize srcIndex = ( qgssize )srcRow * mSrcCols + srcCol;
-      QgsDebugMsgLevel( QString( "row = %1 col = %2 srcRow = %3 srcCol = %4" ).arg( i ).arg( j ).arg( srcRow ).arg( srcCol ), 5 );
-
-      // isNoData() may be slow so we check doNoData first
-      if ( doNoData && inputBlock->isNoData( srcRow, srcCol ) )
-      {
-        outputBlock->setIsNoData( i, j );
-        continue ;
-      }
-
-      qgssize destIndex = ( qgssize )i * width + j;
-      char *srcBits = inputBlock->bits( srcIndex );
-      char *destBits = outputBlock->bits( destIndex );
-      if ( !srcBits )
-      {
-        QgsDebugMsg( QString( "Cannot get input block data: row = %1 col = %2" ).arg( i ).arg( j ) );
-        continue;
-      }
-      if ( !destBits )
-      {
-        QgsDebugMsg( QString( "Cannot set output block data: srcRow = %1 srcCol = %2" ).arg( srcRow ).arg( srcCol ) );
-        continue;
-      }
-      memcpy( destBits, srcBits, pixelSize );
+      QgsRasterProjectorRowsJob job;
+      job.projector = this;
+      job.firstRow = row;
+      job.lastRow = qMin( row + rowsPerJob, height );
+      job.input = inputBlock;
+      job.output = outputBlock;
+      job.srcBits = srcBits;
+      job.destBits = destBits;
+      jobs.append( job );
+    }
+    QtConcurrent::blockingMap( jobs, &QgsRasterProjectorRowsJob::run );
+  }
+  else
+  {
+    const QgsCoordinateTransform* ct = 0;
+    if ( !mApproximate )
+    {
+      ct = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
     }
+    projectRows( 0, height, inputBlock, outputBlock, srcBits, destBits, doNoData, ct );
   }
 
   delete inputBlock;
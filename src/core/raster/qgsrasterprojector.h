@@ -104,6 +104,8 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     QgsRasterBlock *block( int bandNo, const QgsRectangle & extent, int width, int height );
 
   private:
+    friend class QgsRasterProjectorRowsJob;
+
     /** get source extent */
     QgsRectangle srcExtent() { return mSrcExtent; }
 
@@ -113,48 +115,58 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     void setSrcRows( int theRows ) { mSrcRows = theRows; mSrcXRes = mSrcExtent.height() / mSrcRows; }
     void setSrcCols( int theCols ) { mSrcCols = theCols; mSrcYRes = mSrcExtent.width() / mSrcCols; }
 
-    /** \brief Get source row and column indexes for current source extent and resolution
-        If source pixel is outside source extent theSrcRow and theSrcCol are left unchanged.
-        @return true if inside source
+    /** \brief Get source row and column index of a source point
+        @return false if the point is outside of the source
      */
-    bool srcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform* ct );
+    inline bool srcRowCol( double theX, double theY, int *theSrcRow, int *theSrcCol ) const;
 
     int dstRows() const { return mDestRows; }
     int dstCols() const { return mDestCols; }
 
     /** \brief get destination point for _current_ destination position */
-    void destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY );
+    void destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY ) const;
 
     /** \brief Get matrix upper left row/col indexes for destination row/col */
-    int matrixRow( int theDestRow );
-    int matrixCol( int theDestCol );
-
-    /** \brief get destination point for _current_ matrix position */
-    QgsPoint srcPoint( int theRow, int theCol );
-
-    /** \brief Get precise source row and column indexes for current source extent and resolution */
-    inline bool preciseSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform* ct );
-
-    /** \brief Get approximate source row and column indexes for current source extent and resolution */
-    inline bool approximateSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol );
+    int matrixRow( int theDestRow ) const;
+    int matrixCol( int theDestCol ) const;
+
+    /** \brief Get precise source row and column indexes of a destination row,
+        the cell centers are transformed in one batch. -1 for cells outside of the source */
+    void preciseSrcRowCols( int theDestRow, int *theSrcRows, int *theSrcCols, const QgsCoordinateTransform* ct ) const;
+
+    /** \brief Get approximate source row and column indexes of a destination row by bilinear
+        interpolation of the control point matrix. -1 for cells outside of the source.
+        Does not modify the projector, may be called from several threads.
+        @param theMatrixCols matrix column of every destination column
+        @param theXFracs position of every destination column inside of its matrix column */
+    void approximateSrcRowCols( int theDestRow, const int *theMatrixCols, const double *theXFracs,
+                                int *theSrcRows, int *theSrcCols ) const;
+
+    /** \brief Copy the source cells of destination rows theFirstRow to theLastRow - 1 to the output block
+        @param theSrcBits data of the input block
+        @param theDestBits data of the output block
+        @param theDoNoData use the no data bitmaps of the blocks
+        @param ct transformation for the precise calculation, not used with the approximation */
+    void projectRows( int theFirstRow, int theLastRow, QgsRasterBlock *theInput, QgsRasterBlock *theOutput,
+                      const char *theSrcBits, char *theDestBits, bool theDoNoData, const QgsCoordinateTransform* ct ) const;
 
     /** \brief Calculate matrix */
     void calc();
 
+    /** \brief Read matrix and source grid calculated for the same CRS, extents and size from the shared cache */
+    bool readCachedGrid( const QString &theKey );
+
+    /** \brief Store matrix and source grid in the shared cache */
+    void writeCachedGrid( const QString &theKey ) const;
+
     /** \brief insert rows to matrix */
     void insertRows( const QgsCoordinateTransform* ct );
 
     /** \brief insert columns to matrix */
     void insertCols( const QgsCoordinateTransform* ct );
 
-    /* calculate single control point in current matrix */
-    void calcCP( int theRow, int theCol, const QgsCoordinateTransform* ct );
-
-    /** \brief calculate matrix row */
-    bool calcRow( int theRow, const QgsCoordinateTransform* ct );
-
-    /** \brief calculate matrix column */
-    bool calcCol( int theCol, const QgsCoordinateTransform* ct );
+    /** \brief calculate control points of the matrix with given indexes, transformed in one batch */
+    void calcCPs( const QVector<int> &theIndexes, const QgsCoordinateTransform* ct );
 
     /** \brief calculate source extent */
     void calcSrcExtent();
@@ -170,11 +182,10 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
       * returns true if within threshold */
     bool checkRows( const QgsCoordinateTransform* ct );
 
-    /** Calculate array of src helper points */
-    void calcHelper( int theMatrixRow, QgsPoint *thePoints );
-
-    /** Calc / switch helper */
-    void nextHelper();
+    /** \brief check error of control points approximated as middle of their neighbours
+      * returns true if within threshold */
+    bool checkApproximation( const QVector<int> &theIndexes, const QVector<int> &theNeighbours1,
+                             const QVector<int> &theNeighbours2, const QgsCoordinateTransform* ct );
 
     /** get mCPMatrix as string */
     QString cpToString();
@@ -230,23 +241,12 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     /** number of destination cols per matrix col */
     double mDestColsPerMatrixCol;
 
-    /** Grid of source control points */
-    QList< QList<QgsPoint> > mCPMatrix;
+    /** Grid of source control points, mCPRows x mCPCols, row by row */
+    QVector<QgsPoint> mCPMatrix;
 
     /** Grid of source control points transformation possible indicator */
     /* Same size as mCPMatrix */
-    QList< QList<bool> > mCPLegalMatrix;
-
-    /** Array of source points for each destination column on top of current CPMatrix grid row */
-    /* Warning: using QList is slow on access */
-    QgsPoint *pHelperTop;
-
-    /** Array of source points for each destination column on bottom of current CPMatrix grid row */
-    /* Warning: using QList is slow on access */
-    QgsPoint *pHelperBottom;
-
-    /** Current mHelperTop matrix row */
-    int mHelperTopRow;
+    QVector<bool> mCPLegalMatrix;
 
     /** Number of mCPMatrix columns */
     int mCPCols;
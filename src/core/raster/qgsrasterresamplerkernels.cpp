@@ -0,0 +1,570 @@
+/***************************************************************************
+                        qgsrasterresamplerkernels.cpp
+          Vectorised row kernels of the bilinear and cubic resamplers
+                              -------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsrasterresamplerkernels.h"
+#include "qgslogger.h"
+
+#include <QImage>
+#include <QVector>
+#include <cmath>
+
+// SSE2 is part of every x86-64 CPU, it is used whenever the compiler targets it
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define QGS_RESAMPLER_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 kernels are compiled with a function target attribute and only used if the CPU has AVX2
+#if defined(QGS_RESAMPLER_SSE2) && !defined(_MSC_VER) && \
+  ( defined(__clang__) ? __clang_major__ >= 4 : ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) )
+#define QGS_RESAMPLER_AVX2
+#include <immintrin.h>
+#define QGS_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#endif
+
+static QgsRasterResamplerKernels::InstructionSet detectInstructionSet()
+{
+#ifdef QGS_RESAMPLER_AVX2
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports( "avx2" ) )
+  {
+    return QgsRasterResamplerKernels::AVX2;
+  }
+#endif
+#ifdef QGS_RESAMPLER_SSE2
+  return QgsRasterResamplerKernels::SSE2;
+#else
+  return QgsRasterResamplerKernels::Scalar;
+#endif
+}
+
+static const QgsRasterResamplerKernels::InstructionSet sSupportedInstructionSet = detectInstructionSet();
+static QgsRasterResamplerKernels::InstructionSet sInstructionSet = sSupportedInstructionSet;
+
+QgsRasterResamplerKernels::InstructionSet QgsRasterResamplerKernels::supportedInstructionSet()
+{
+  return sSupportedInstructionSet;
+}
+
+QgsRasterResamplerKernels::InstructionSet QgsRasterResamplerKernels::instructionSet()
+{
+  return sInstructionSet;
+}
+
+void QgsRasterResamplerKernels::setInstructionSet( InstructionSet theSet )
+{
+  sInstructionSet = qMin( theSet, sSupportedInstructionSet );
+  QgsDebugMsg( "resampling with " + instructionSetName( sInstructionSet ) );
+}
+
+QString QgsRasterResamplerKernels::instructionSetName( InstructionSet theSet )
+{
+  switch ( theSet )
+  {
+    case AVX2:
+      return "AVX2";
+    case SSE2:
+      return "SSE2";
+    case Scalar:
+    default:
+      return "scalar";
+  }
+}
+
+//
+// scalar kernels
+//
+
+static void verticalTapsScalar( const QRgb* const* theRows, const float* theWeights, int theTaps, int theWidth, float* theOutput )
+{
+  for ( int i = 0; i < theWidth; ++i )
+  {
+    float b = 0, g = 0, r = 0, a = 0;
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      QRgb px = theRows[k][i];
+      float w = theWeights[k];
+      b += w * qBlue( px );
+      g += w * qGreen( px );
+      r += w * qRed( px );
+      a += w * qAlpha( px );
+    }
+    float* out = theOutput + 4 * i;
+    out[0] = b;
+    out[1] = g;
+    out[2] = r;
+    out[3] = a;
+  }
+}
+
+static inline int clampChannel( float theValue, float theMax )
+{
+  float v = qMin( theValue, theMax );
+  return v <= 0 ? 0 : ( v >= 255 ? 255 : ( int ) floor( v + 0.5f ) );
+}
+
+static void horizontalTapsScalar( const float* theRow, const int* theIndexes, const float* theWeights, int theTaps, int theWidth, QRgb* theOutput )
+{
+  for ( int j = 0; j < theWidth; ++j )
+  {
+    float b = 0, g = 0, r = 0, a = 0;
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      const float* px = theRow + 4 * theIndexes[k];
+      float w = theWeights[k];
+      b += w * px[0];
+      g += w * px[1];
+      r += w * px[2];
+      a += w * px[3];
+    }
+    theIndexes += theTaps;
+    theWeights += theTaps;
+    theOutput[j] = qRgba( clampChannel( r, a ), clampChannel( g, a ), clampChannel( b, a ), clampChannel( a, 255 ) );
+  }
+}
+
+//
+// SSE2 kernels, one pixel (four channels) per register
+//
+
+#ifdef QGS_RESAMPLER_SSE2
+//! converts the channels of a pixel to floats
+static inline __m128 unpackPixel( QRgb thePixel )
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i px = _mm_unpacklo_epi8( _mm_cvtsi32_si128(( int ) thePixel ), zero );
+  return _mm_cvtepi32_ps( _mm_unpacklo_epi16( px, zero ) );
+}
+
+//! rounds the channels, limits the colors to alpha and saturates them to 0..255
+static inline QRgb packPixel( __m128 thePixel )
+{
+  thePixel = _mm_min_ps( thePixel, _mm_shuffle_ps( thePixel, thePixel, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+  __m128i px = _mm_cvtps_epi32( thePixel );
+  px = _mm_packs_epi32( px, px );
+  px = _mm_packus_epi16( px, px );
+  return ( QRgb ) _mm_cvtsi128_si32( px );
+}
+
+static void verticalTapsSSE2( const QRgb* const* theRows, const float* theWeights, int theTaps, int theWidth, float* theOutput )
+{
+  __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  // four pixels per step
+  for ( ; i + 4 <= theWidth; i += 4 )
+  {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      __m128 w = _mm_set1_ps( theWeights[k] );
+      __m128i px = _mm_loadu_si128( reinterpret_cast<const __m128i*>( theRows[k] + i ) );
+      __m128i lo = _mm_unpacklo_epi8( px, zero );
+      __m128i hi = _mm_unpackhi_epi8( px, zero );
+      acc0 = _mm_add_ps( acc0, _mm_mul_ps( w, _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ) ) ) );
+      acc1 = _mm_add_ps( acc1, _mm_mul_ps( w, _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ) ) ) );
+      acc2 = _mm_add_ps( acc2, _mm_mul_ps( w, _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ) ) ) );
+      acc3 = _mm_add_ps( acc3, _mm_mul_ps( w, _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ) ) ) );
+    }
+    float* out = theOutput + 4 * i;
+    _mm_storeu_ps( out, acc0 );
+    _mm_storeu_ps( out + 4, acc1 );
+    _mm_storeu_ps( out + 8, acc2 );
+    _mm_storeu_ps( out + 12, acc3 );
+  }
+  for ( ; i < theWidth; ++i )
+  {
+    __m128 acc = _mm_setzero_ps();
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      acc = _mm_add_ps( acc, _mm_mul_ps( _mm_set1_ps( theWeights[k] ), unpackPixel( theRows[k][i] ) ) );
+    }
+    _mm_storeu_ps( theOutput + 4 * i, acc );
+  }
+}
+
+static void horizontalTapsSSE2( const float* theRow, const int* theIndexes, const float* theWeights, int theTaps, int theWidth, QRgb* theOutput )
+{
+  for ( int j = 0; j < theWidth; ++j )
+  {
+    __m128 acc = _mm_setzero_ps();
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      acc = _mm_add_ps( acc, _mm_mul_ps( _mm_set1_ps( theWeights[k] ), _mm_loadu_ps( theRow + 4 * theIndexes[k] ) ) );
+    }
+    theIndexes += theTaps;
+    theWeights += theTaps;
+    theOutput[j] = packPixel( acc );
+  }
+}
+#endif
+
+//
+// AVX2 kernels, two pixels per register
+//
+
+#ifdef QGS_RESAMPLER_AVX2
+QGS_TARGET_AVX2
+static void verticalTapsAVX2( const QRgb* const* theRows, const float* theWeights, int theTaps, int theWidth, float* theOutput )
+{
+  int i = 0;
+  // eight pixels per step
+  for ( ; i + 8 <= theWidth; i += 8 )
+  {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      __m256 w = _mm256_set1_ps( theWeights[k] );
+      __m128i px0 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( theRows[k] + i ) );
+      __m128i px1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( theRows[k] + i + 4 ) );
+      acc0 = _mm256_add_ps( acc0, _mm256_mul_ps( w, _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( px0 ) ) ) );
+      acc1 = _mm256_add_ps( acc1, _mm256_mul_ps( w, _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_srli_si128( px0, 8 ) ) ) ) );
+      acc2 = _mm256_add_ps( acc2, _mm256_mul_ps( w, _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( px1 ) ) ) );
+      acc3 = _mm256_add_ps( acc3, _mm256_mul_ps( w, _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_srli_si128( px1, 8 ) ) ) ) );
+    }
+    float* out = theOutput + 4 * i;
+    _mm256_storeu_ps( out, acc0 );
+    _mm256_storeu_ps( out + 8, acc1 );
+    _mm256_storeu_ps( out + 16, acc2 );
+    _mm256_storeu_ps( out + 24, acc3 );
+  }
+  for ( ; i < theWidth; ++i )
+  {
+    __m128 acc = _mm_setzero_ps();
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      acc = _mm_add_ps( acc, _mm_mul_ps( _mm_set1_ps( theWeights[k] ), unpackPixel( theRows[k][i] ) ) );
+    }
+    _mm_storeu_ps( theOutput + 4 * i, acc );
+  }
+}
+
+QGS_TARGET_AVX2
+static void horizontalTapsAVX2( const float* theRow, const int* theIndexes, const float* theWeights, int theTaps, int theWidth, QRgb* theOutput )
+{
+  const int* nextIndexes = theIndexes + theTaps;
+  const float* nextWeights = theWeights + theTaps;
+  int j = 0;
+  // output pixels j and j + 1 in the low and high lanes
+  for ( ; j + 2 <= theWidth; j += 2 )
+  {
+    __m256 acc = _mm256_setzero_ps();
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      __m256 px = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( theRow + 4 * theIndexes[k] ) ),
+                                        _mm_loadu_ps( theRow + 4 * nextIndexes[k] ), 1 );
+      __m256 w = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_set1_ps( theWeights[k] ) ),
+                                       _mm_set1_ps( nextWeights[k] ), 1 );
+      acc = _mm256_add_ps( acc, _mm256_mul_ps( w, px ) );
+    }
+    theIndexes += 2 * theTaps;
+    theWeights += 2 * theTaps;
+    nextIndexes += 2 * theTaps;
+    nextWeights += 2 * theTaps;
+
+    acc = _mm256_min_ps( acc, _mm256_shuffle_ps( acc, acc, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+    __m256i px = _mm256_cvtps_epi32( acc );
+    __m128i packed = _mm_packs_epi32( _mm256_castsi256_si128( px ), _mm256_extracti128_si256( px, 1 ) );
+    packed = _mm_packus_epi16( packed, packed );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( theOutput + j ), packed );
+  }
+  if ( j < theWidth )
+  {
+    __m128 acc = _mm_setzero_ps();
+    for ( int k = 0; k < theTaps; ++k )
+    {
+      acc = _mm_add_ps( acc, _mm_mul_ps( _mm_set1_ps( theWeights[k] ), _mm_loadu_ps( theRow + 4 * theIndexes[k] ) ) );
+    }
+    theOutput[j] = packPixel( acc );
+  }
+}
+#endif
+
+void QgsRasterResamplerKernels::verticalTaps( const QRgb* const* theRows, const float* theWeights, int theTaps, int theWidth, float* theOutput )
+{
+  switch ( sInstructionSet )
+  {
+#ifdef QGS_RESAMPLER_AVX2
+    case AVX2:
+      verticalTapsAVX2( theRows, theWeights, theTaps, theWidth, theOutput );
+      return;
+#endif
+#ifdef QGS_RESAMPLER_SSE2
+    case SSE2:
+      verticalTapsSSE2( theRows, theWeights, theTaps, theWidth, theOutput );
+      return;
+#endif
+    default:
+      verticalTapsScalar( theRows, theWeights, theTaps, theWidth, theOutput );
+  }
+}
+
+void QgsRasterResamplerKernels::horizontalTaps( const float* theRow, const int* theIndexes, const float* theWeights, int theTaps, int theWidth, QRgb* theOutput )
+{
+  switch ( sInstructionSet )
+  {
+#ifdef QGS_RESAMPLER_AVX2
+    case AVX2:
+      horizontalTapsAVX2( theRow, theIndexes, theWeights, theTaps, theWidth, theOutput );
+      return;
+#endif
+#ifdef QGS_RESAMPLER_SSE2
+    case SSE2:
+      horizontalTapsSSE2( theRow, theIndexes, theWeights, theTaps, theWidth, theOutput );
+      return;
+#endif
+    default:
+      horizontalTapsScalar( theRow, theIndexes, theWeights, theTaps, theWidth, theOutput );
+  }
+}
+
+//
+// taps
+//
+
+//! source pixel left of (above) the center of output pixel theDst and the offset from it,
+//! outside of the first and last source pixel centers the border pixel is used
+static void samplePosition( int theDst, double theScale, int theSrcSize, int& theIndex, double& theOffset )
+{
+  double myPos = ( theDst + 0.5 ) * theScale - 0.5;
+  theIndex = ( int ) floor( myPos );
+  theOffset = myPos - theIndex;
+  if ( theIndex < 0 )
+  {
+    theIndex = 0;
+    theOffset = 0;
+  }
+  else if ( theIndex >= theSrcSize - 1 )
+  {
+    theIndex = theSrcSize - 1;
+    theOffset = 0;
+  }
+}
+
+//! adds theWeight times the central difference at source pixel theSrc to the weights of pixels theFirst...
+static void addDerivative( int theSrc, double theWeight, int theSrcSize, int theFirst, double* theWeights )
+{
+  if ( theWeight == 0 || theSrcSize < 2 || theSrc >= theSrcSize )
+  {
+    return;
+  }
+  if ( theSrc == 0 )
+  {
+    theWeights[theSrc + 1 - theFirst] += theWeight;
+    theWeights[theSrc - theFirst] -= theWeight;
+  }
+  else if ( theSrc == theSrcSize - 1 )
+  {
+    theWeights[theSrc - theFirst] += theWeight;
+    theWeights[theSrc - 1 - theFirst] -= theWeight;
+  }
+  else
+  {
+    theWeights[theSrc + 1 - theFirst] += theWeight / 2.0;
+    theWeights[theSrc - 1 - theFirst] -= theWeight / 2.0;
+  }
+}
+
+//! cubic Hermite interpolation between pixels i and i + 1 as weights of pixels i - 1 ... i + 2, split into
+//! the weights of the pixel values (theValueWeights) and of their central differences (theDerivativeWeights)
+static void cubicTaps( int theDst, double theScale, int theSrcSize, int* theIndexes, float* theValueWeights, float* theDerivativeWeights )
+{
+  int i;
+  double t;
+  samplePosition( theDst, theScale, theSrcSize, i, t );
+
+  // Bernstein polynomials of the Bezier form, inner control points are value +- derivative / 3
+  double s = 1.0 - t;
+  double b0 = s * s * s;
+  double b1 = 3.0 * t * s * s;
+  double b2 = 3.0 * t * t * s;
+  double b3 = t * t * t;
+
+  double myDerivativeWeights[4] = { 0, 0, 0, 0 };
+  addDerivative( i, b1 / 3.0, theSrcSize, i - 1, myDerivativeWeights );
+  addDerivative( i + 1, -b2 / 3.0, theSrcSize, i - 1, myDerivativeWeights );
+
+  for ( int m = 0; m < 4; ++m )
+  {
+    theIndexes[m] = qBound( 0, i - 1 + m, theSrcSize - 1 );
+    theDerivativeWeights[m] = myDerivativeWeights[m];
+  }
+  theValueWeights[0] = 0;
+  theValueWeights[1] = b0 + b1;
+  theValueWeights[2] = b2 + b3;
+  theValueWeights[3] = 0;
+}
+
+//
+// images
+//
+
+static inline const QRgb* constRow( const QImage& theImage, int theRow )
+{
+  return reinterpret_cast<const QRgb*>( theImage.constScanLine( theRow ) );
+}
+
+//! converts theImage to premultiplied ARGB if necessary
+static QImage premultiplied( const QImage& theImage )
+{
+  if ( theImage.format() == QImage::Format_ARGB32_Premultiplied )
+  {
+    return theImage;
+  }
+  return theImage.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+}
+
+void QgsRasterResamplerKernels::bilinear( const QImage& theSrc, QImage& theDst )
+{
+  int mySrcWidth = theSrc.width();
+  int mySrcHeight = theSrc.height();
+  int myDstWidth = theDst.width();
+  int myDstHeight = theDst.height();
+  if ( mySrcWidth <= 0 || mySrcHeight <= 0 || myDstWidth <= 0 || myDstHeight <= 0 )
+  {
+    return;
+  }
+
+  // the kernels write to theDst itself if it is premultiplied
+  QImage mySrc = premultiplied( theSrc );
+  bool myConvert = theDst.format() != QImage::Format_ARGB32_Premultiplied;
+  QImage myConverted;
+  if ( myConvert )
+  {
+    myConverted = QImage( myDstWidth, myDstHeight, QImage::Format_ARGB32_Premultiplied );
+  }
+  QImage& myDst = myConvert ? myConverted : theDst;
+
+  double myScaleX = ( double ) mySrcWidth / myDstWidth;
+  double myScaleY = ( double ) mySrcHeight / myDstHeight;
+
+  QVector<int> myIndexes( 2 * myDstWidth );
+  QVector<float> myWeights( 2 * myDstWidth );
+  for ( int j = 0; j < myDstWidth; ++j )
+  {
+    int i;
+    double t;
+    samplePosition( j, myScaleX, mySrcWidth, i, t );
+    myIndexes[2 * j] = i;
+    myIndexes[2 * j + 1] = qMin( i + 1, mySrcWidth - 1 );
+    myWeights[2 * j] = 1.0 - t;
+    myWeights[2 * j + 1] = t;
+  }
+
+  QVector<float> myRow( 4 * mySrcWidth );
+  for ( int j = 0; j < myDstHeight; ++j )
+  {
+    int i;
+    double t;
+    samplePosition( j, myScaleY, mySrcHeight, i, t );
+    const QRgb* myRows[2] = { constRow( mySrc, i ), constRow( mySrc, qMin( i + 1, mySrcHeight - 1 ) ) };
+    float myRowWeights[2] = { ( float )( 1.0 - t ), ( float ) t };
+
+    verticalTaps( myRows, myRowWeights, 2, mySrcWidth, myRow.data() );
+    horizontalTaps( myRow.constData(), myIndexes.constData(), myWeights.constData(), 2, myDstWidth,
+                    reinterpret_cast<QRgb*>( myDst.scanLine( j ) ) );
+  }
+
+  if ( myConvert )
+  {
+    theDst = myConverted.convertToFormat( theDst.format() );
+  }
+}
+
+void QgsRasterResamplerKernels::cubic( const QImage& theSrc, QImage& theDst )
+{
+  int mySrcWidth = theSrc.width();
+  int mySrcHeight = theSrc.height();
+  int myDstWidth = theDst.width();
+  int myDstHeight = theDst.height();
+  if ( mySrcWidth <= 0 || mySrcHeight <= 0 || myDstWidth <= 0 || myDstHeight <= 0 )
+  {
+    return;
+  }
+
+  // the kernels write to theDst itself if it is premultiplied
+  QImage mySrc = premultiplied( theSrc );
+  bool myConvert = theDst.format() != QImage::Format_ARGB32_Premultiplied;
+  QImage myConverted;
+  if ( myConvert )
+  {
+    myConverted = QImage( myDstWidth, myDstHeight, QImage::Format_ARGB32_Premultiplied );
+  }
+  QImage& myDst = myConvert ? myConverted : theDst;
+
+  double myScaleX = ( double ) mySrcWidth / myDstWidth;
+  double myScaleY = ( double ) mySrcHeight / myDstHeight;
+
+  // The patch is interpolated along the rows first: A are the values interpolated with the
+  // vertical derivatives, C the values interpolated without them. The x derivatives of the
+  // patch are the central differences of C, so an output pixel is 2 taps on A and 4 taps on C.
+  // A and C share one row buffer, C starts at pixel mySrcWidth.
+  const int myTaps = 6;
+  QVector<int> myIndexes( myTaps * myDstWidth );
+  QVector<float> myWeights( myTaps * myDstWidth );
+  for ( int j = 0; j < myDstWidth; ++j )
+  {
+    int myTapIndexes[4];
+    float myValueWeights[4];
+    float myDerivativeWeights[4];
+    cubicTaps( j, myScaleX, mySrcWidth, myTapIndexes, myValueWeights, myDerivativeWeights );
+
+    int* myPixelIndexes = myIndexes.data() + myTaps * j;
+    float* myPixelWeights = myWeights.data() + myTaps * j;
+    myPixelIndexes[0] = myTapIndexes[1];
+    myPixelWeights[0] = myValueWeights[1];
+    myPixelIndexes[1] = myTapIndexes[2];
+    myPixelWeights[1] = myValueWeights[2];
+    for ( int m = 0; m < 4; ++m )
+    {
+      myPixelIndexes[2 + m] = mySrcWidth + myTapIndexes[m];
+      myPixelWeights[2 + m] = myDerivativeWeights[m];
+    }
+  }
+
+  QVector<float> myRow( 8 * mySrcWidth );
+  for ( int j = 0; j < myDstHeight; ++j )
+  {
+    int myTapIndexes[4];
+    float myValueWeights[4];
+    float myDerivativeWeights[4];
+    cubicTaps( j, myScaleY, mySrcHeight, myTapIndexes, myValueWeights, myDerivativeWeights );
+
+    const QRgb* myRows[4];
+    float myRowWeights[4];
+    for ( int m = 0; m < 4; ++m )
+    {
+      myRows[m] = constRow( mySrc, myTapIndexes[m] );
+      myRowWeights[m] = myValueWeights[m] + myDerivativeWeights[m];
+    }
+    verticalTaps( myRows, myRowWeights, 4, mySrcWidth, myRow.data() );
+    verticalTaps( myRows + 1, myValueWeights + 1, 2, mySrcWidth, myRow.data() + 4 * mySrcWidth );
+
+    horizontalTaps( myRow.constData(), myIndexes.constData(), myWeights.constData(), myTaps, myDstWidth,
+                    reinterpret_cast<QRgb*>( myDst.scanLine( j ) ) );
+  }
+
+  if ( myConvert )
+  {
+    theDst = myConverted.convertToFormat( theDst.format() );
+  }
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+                        qgsrasterresamplerkernels.h
+          Vectorised row kernels of the bilinear and cubic resamplers
+                              -------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSRASTERRESAMPLERKERNELS_H
+#define QGSRASTERRESAMPLERKERNELS_H
+
+#include <QRgb>
+#include <QString>
+
+class QImage;
+
+/** \ingroup core
+ * Separable resampling of premultiplied ARGB images.
+ *
+ * An output row is computed in two passes: a vertical pass blends a few source rows into a row of
+ * floats (four channels per pixel), a horizontal pass blends a few of these pixels into each output
+ * pixel. Both passes exist as SSE2 (four channels at once) and AVX2 (two pixels at once) kernels
+ * and as a scalar fallback, the best one supported by the CPU is selected at runtime.
+ *
+ * The images are interpolated in premultiplied ARGB, other formats are converted first. Results are
+ * clamped to valid premultiplied colors (color channels not larger than alpha).
+ * @note added in 2.1
+ */
+class CORE_EXPORT QgsRasterResamplerKernels
+{
+  public:
+    enum InstructionSet
+    {
+      Scalar = 0,
+      SSE2,
+      AVX2
+    };
+
+    /** Best instruction set supported by the build and the CPU */
+    static InstructionSet supportedInstructionSet();
+
+    /** Instruction set used by the kernels */
+    static InstructionSet instructionSet();
+
+    /** Selects the instruction set used by the kernels (e.g. for comparisons), it is limited to
+     *  the supported one */
+    static void setInstructionSet( InstructionSet theSet );
+
+    static QString instructionSetName( InstructionSet theSet );
+
+    /** Bilinear interpolation of theSrc to the size of theDst */
+    static void bilinear( const QImage& theSrc, QImage& theDst );
+
+    /** Bicubic interpolation of theSrc to the size of theDst. Each source cell is a bicubic patch
+     *  with the pixel values and central differences at its corners as values and derivatives,
+     *  the border pixels are interpolated along the border only (as QgsCubicRasterResampler always did) */
+    static void cubic( const QImage& theSrc, QImage& theDst );
+
+    /** Vertical pass: theOutput[4 * i + c] = sum over k of theWeights[k] * channel c of theRows[k][i].
+     *  Channel c is ( pixel >> ( 8 * c ) ) & 0xff, so alpha is channel 3 */
+    static void verticalTaps( const QRgb* const* theRows, const float* theWeights, int theTaps, int theWidth, float* theOutput );
+
+    /** Horizontal pass: output pixel j is the sum over k of theWeights[j * theTaps + k] times pixel
+     *  theIndexes[j * theTaps + k] of theRow, rounded and clamped to a premultiplied color */
+    static void horizontalTaps( const float* theRow, const int* theIndexes, const float* theWeights, int theTaps, int theWidth, QRgb* theOutput );
+};
+
+#endif // QGSRASTERRESAMPLERKERNELS_H
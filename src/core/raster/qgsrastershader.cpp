@@ -19,6 +19,7 @@ email                : ersts@amnh.org
 #include "qgslogger.h"
 #include "qgscolorrampshader.h"
 #include "qgsrastershader.h"
+#include "qgsrasterblock.h"
 #include <QDomDocument>
 #include <QDomElement>
 
@@ -79,6 +80,26 @@ bool QgsRasterShader::shade( double theRedValue, double theGreenValue, double th
   return false;
 }
 
+void QgsRasterShader::shadeBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor )
+{
+  if ( !theInput || !theOutput )
+  {
+    return;
+  }
+
+  if ( 0 != mRasterShaderFunction )
+  {
+    mRasterShaderFunction->shadeBlock( theInput, theOutput, theDefaultColor );
+    return;
+  }
+
+  qgssize myCount = ( qgssize )theInput->width() * theInput->height();
+  for ( qgssize i = 0; i < myCount; i++ )
+  {
+    theOutput[i] = theDefaultColor;
+  }
+}
+
 /**
     A public function that allows the user to set their own custom shader function.
 
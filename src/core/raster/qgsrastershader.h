@@ -60,6 +60,10 @@ class CORE_EXPORT QgsRasterShader
     /** \brief generates and new RGBA value based on original RGBA value */
     bool shade( double, double, double, double, int*, int*, int* , int* );
 
+    /** \brief Shades all values of a block into premultiplied colors, see QgsRasterShaderFunction::shadeBlock()
+     * @note added in 2.1 */
+    void shadeBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor );
+
     /** \brief A public method that allows the user to set their own shader function
       \note Raster shader takes ownership of the shader function instance */
     void setRasterShaderFunction( QgsRasterShaderFunction* );
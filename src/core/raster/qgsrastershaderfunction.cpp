@@ -18,6 +18,7 @@ email                : ersts@amnh.org
 #include "qgslogger.h"
 
 #include "qgsrastershaderfunction.h"
+#include "qgsrasterblock.h"
 
 QgsRasterShaderFunction::QgsRasterShaderFunction( double theMinimumValue, double theMaximumValue )
 {
@@ -104,3 +105,34 @@ bool QgsRasterShaderFunction::shade( double theRedValue, double theGreenValue, d
 
   return false;
 }
+
+void QgsRasterShaderFunction::shadeBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor )
+{
+  if ( !theInput || !theOutput )
+  {
+    return;
+  }
+
+  qgssize myCount = ( qgssize )theInput->width() * theInput->height();
+  int myRed, myGreen, myBlue, myAlpha;
+  for ( qgssize i = 0; i < myCount; i++ )
+  {
+    if ( theInput->isNoData( i ) || !shade( theInput->value( i ), &myRed, &myGreen, &myBlue, &myAlpha ) )
+    {
+      theOutput[i] = theDefaultColor;
+      continue;
+    }
+    theOutput[i] = premultipliedColor( myRed, myGreen, myBlue, myAlpha );
+  }
+}
+
+QRgb QgsRasterShaderFunction::premultipliedColor( int theRed, int theGreen, int theBlue, int theAlpha )
+{
+  if ( theAlpha < 255 )
+  {
+    theRed *= ( theAlpha / 255.0 );
+    theGreen *= ( theAlpha / 255.0 );
+    theBlue *= ( theAlpha / 255.0 );
+  }
+  return qRgba( theRed, theGreen, theBlue, theAlpha );
+}
@@ -27,6 +27,8 @@ email                : ersts@amnh.org
 #include <QColor>
 #include <QPair>
 
+class QgsRasterBlock;
+
 class CORE_EXPORT QgsRasterShaderFunction
 {
 
@@ -46,6 +48,14 @@ class CORE_EXPORT QgsRasterShaderFunction
     /** \brief generates and new RGBA value based on original RGBA value */
     virtual bool shade( double, double, double, double, int*, int*, int*, int* );
 
+    /** \brief Shades all values of a block into premultiplied colors
+     * @param theInput block of numeric values
+     * @param theOutput buffer of at least width * height colors
+     * @param theDefaultColor color for no data values and values which cannot be shaded
+     * The default implementation calls shade() for every pixel.
+     * @note added in 2.1 */
+    virtual void shadeBlock( QgsRasterBlock* theInput, QRgb* theOutput, QRgb theDefaultColor );
+
     double minimumMaximumRange() const { return mMinimumMaximumRange; }
 
     double minimumValue() const { return mMinimumValue; }
@@ -54,6 +64,9 @@ class CORE_EXPORT QgsRasterShaderFunction
     virtual void legendSymbologyItems( QList< QPair< QString, QColor > >& symbolItems ) const { Q_UNUSED( symbolItems ); }
 
   protected:
+    /** \brief Returns the color with its components multiplied by alpha */
+    static QRgb premultipliedColor( int theRed, int theGreen, int theBlue, int theAlpha );
+
     /** \brief User defineable maximum value for the shading function */
     double mMaximumValue;
 
@@ -0,0 +1,166 @@
+/***************************************************************************
+                        qgsrasterstatsaccumulator.cpp
+          Single pass accumulation of raster statistics and histograms
+                              -------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsrasterstatsaccumulator.h"
+#include "qgsrasterblock.h"
+
+#include <cmath>
+#include <qmath.h>
+
+QgsRasterStatsAccumulator::QgsRasterStatsAccumulator()
+    : mCount( 0 )
+    , mMinimum( 0.0 )
+    , mMaximum( 0.0 )
+    , mSum( 0.0 )
+    , mMean( 0.0 )
+    , mSumOfSquares( 0.0 )
+{
+}
+
+void QgsRasterStatsAccumulator::addBlock( QgsRasterBlock* theBlock )
+{
+  if ( !theBlock || theBlock->isEmpty() )
+  {
+    return;
+  }
+
+  qgssize myCount = ( qgssize )theBlock->width() * theBlock->height();
+  bool myCheckNoData = theBlock->hasNoData();
+  for ( qgssize i = 0; i < myCount; i++ )
+  {
+    if ( myCheckNoData && theBlock->isNoData( i ) )
+    {
+      continue;
+    }
+    addValue( theBlock->value( i ) );
+  }
+}
+
+void QgsRasterStatsAccumulator::addValue( double theValue )
+{
+  mCount++;
+  if ( mCount == 1 )
+  {
+    mMinimum = theValue;
+    mMaximum = theValue;
+  }
+  else
+  {
+    if ( theValue < mMinimum ) mMinimum = theValue;
+    if ( theValue > mMaximum ) mMaximum = theValue;
+  }
+  mSum += theValue;
+
+  // Single pass stdev
+  double myDelta = theValue - mMean;
+  mMean += myDelta / mCount;
+  mSumOfSquares += myDelta * ( theValue - mMean );
+}
+
+void QgsRasterStatsAccumulator::merge( const QgsRasterStatsAccumulator& theOther )
+{
+  if ( theOther.mCount == 0 )
+  {
+    return;
+  }
+  if ( mCount == 0 )
+  {
+    *this = theOther;
+    return;
+  }
+
+  // combine means and sums of squares of both parts (Chan et al.)
+  double myCount = ( double ) mCount + ( double ) theOther.mCount;
+  double myDelta = theOther.mMean - mMean;
+  mMean += myDelta * theOther.mCount / myCount;
+  mSumOfSquares += theOther.mSumOfSquares + myDelta * myDelta * (( double ) mCount * theOther.mCount / myCount );
+  mCount += theOther.mCount;
+  mSum += theOther.mSum;
+  mMinimum = qMin( mMinimum, theOther.mMinimum );
+  mMaximum = qMax( mMaximum, theOther.mMaximum );
+}
+
+void QgsRasterStatsAccumulator::fillStatistics( QgsRasterBandStats& theStats ) const
+{
+  theStats.elementCount = mCount;
+  if ( mCount > 0 )
+  {
+    theStats.minimumValue = mMinimum;
+    theStats.maximumValue = mMaximum;
+  }
+  theStats.range = theStats.maximumValue - theStats.minimumValue;
+  theStats.sum = mSum;
+  theStats.mean = mSum / mCount;
+  theStats.sumOfSquares = mSumOfSquares;
+
+  // stdDev may differ  from GDAL stats, because GDAL is using naive single pass
+  // algorithm which is more error prone (because of rounding errors)
+  // Divide result by sample size - 1 and get square root to get stdev
+  theStats.stdDev = sqrt( mSumOfSquares / ( mCount - 1 ) );
+}
+
+QgsRasterHistogramAccumulator::QgsRasterHistogramAccumulator( double theMinimum, double theBinSize, int theBinCount, bool theIncludeOutOfRange )
+    : mMinimum( theMinimum )
+    , mBinSize( theBinSize )
+    , mBinCount( theBinCount )
+    , mIncludeOutOfRange( theIncludeOutOfRange )
+    , mHistogramVector( theBinCount )
+    , mNonNullCount( 0 )
+{
+}
+
+void QgsRasterHistogramAccumulator::addBlock( QgsRasterBlock* theBlock )
+{
+  if ( !theBlock || theBlock->isEmpty() || mBinCount <= 0 )
+  {
+    return;
+  }
+
+  int* myBins = mHistogramVector.data();
+  qgssize myCount = ( qgssize )theBlock->width() * theBlock->height();
+  bool myCheckNoData = theBlock->hasNoData();
+  for ( qgssize i = 0; i < myCount; i++ )
+  {
+    if ( myCheckNoData && theBlock->isNoData( i ) )
+    {
+      continue; // NULL
+    }
+    double myValue = theBlock->value( i );
+
+    int myBinIndex = static_cast <int>( qFloor(( myValue - mMinimum ) / mBinSize ) );
+
+    if (( myBinIndex < 0 || myBinIndex > ( mBinCount - 1 ) ) && !mIncludeOutOfRange )
+    {
+      continue;
+    }
+    if ( myBinIndex < 0 ) myBinIndex = 0;
+    if ( myBinIndex > ( mBinCount - 1 ) ) myBinIndex = mBinCount - 1;
+
+    myBins[myBinIndex] += 1;
+    mNonNullCount++;
+  }
+}
+
+void QgsRasterHistogramAccumulator::merge( const QgsRasterHistogramAccumulator& theOther )
+{
+  int myBinCount = qMin( mHistogramVector.size(), theOther.mHistogramVector.size() );
+  for ( int i = 0; i < myBinCount; i++ )
+  {
+    mHistogramVector[i] += theOther.mHistogramVector[i];
+  }
+  mNonNullCount += theOther.mNonNullCount;
+}
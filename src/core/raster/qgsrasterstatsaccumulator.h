@@ -0,0 +1,99 @@
+/***************************************************************************
+                        qgsrasterstatsaccumulator.h
+          Single pass accumulation of raster statistics and histograms
+                              -------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSRASTERSTATSACCUMULATOR_H
+#define QGSRASTERSTATSACCUMULATOR_H
+
+#include "qgsrasterbandstats.h"
+#include "qgsrasterhistogram.h"
+
+class QgsRasterBlock;
+
+/** \ingroup core
+ * Collects count, minimum, maximum, sum, mean and sum of squared deviations
+ * of raster values in a single pass (Welford). Accumulators of disjoint parts
+ * of a raster can be merged, so blocks may be processed in parallel.
+ * @note added in 2.1
+ */
+class CORE_EXPORT QgsRasterStatsAccumulator
+{
+  public:
+    QgsRasterStatsAccumulator();
+
+    /** Adds all values of the block which are not no data */
+    void addBlock( QgsRasterBlock* theBlock );
+
+    /** Adds a single value */
+    void addValue( double theValue );
+
+    /** Adds the values collected by another accumulator */
+    void merge( const QgsRasterStatsAccumulator& theOther );
+
+    /** Number of values added */
+    qgssize count() const { return mCount; }
+
+    /** Writes the collected values to theStats, statsGathered is not changed */
+    void fillStatistics( QgsRasterBandStats& theStats ) const;
+
+  private:
+    qgssize mCount;
+    double mMinimum;
+    double mMaximum;
+    double mSum;
+    double mMean;
+    /** Sum of squared deviations from mMean */
+    double mSumOfSquares;
+};
+
+/** \ingroup core
+ * Counts raster values in bins of fixed size. Accumulators with the same bins
+ * can be merged, so blocks may be processed in parallel.
+ * @note added in 2.1
+ */
+class CORE_EXPORT QgsRasterHistogramAccumulator
+{
+  public:
+    /** Creates bins starting at theMinimum
+     * @param theMinimum lower bound of the first bin
+     * @param theBinSize width of a bin
+     * @param theBinCount number of bins
+     * @param theIncludeOutOfRange count values outside the bins in the first and the last bin
+     */
+    QgsRasterHistogramAccumulator( double theMinimum = 0.0, double theBinSize = 1.0, int theBinCount = 0, bool theIncludeOutOfRange = false );
+
+    /** Adds all values of the block which are not no data */
+    void addBlock( QgsRasterBlock* theBlock );
+
+    /** Adds the counts of another accumulator with the same bins */
+    void merge( const QgsRasterHistogramAccumulator& theOther );
+
+    /** Counts of the bins */
+    const QgsRasterHistogram::HistogramVector& histogramVector() const { return mHistogramVector; }
+
+    /** Number of values counted in any bin */
+    int nonNullCount() const { return mNonNullCount; }
+
+  private:
+    double mMinimum;
+    double mBinSize;
+    int mBinCount;
+    bool mIncludeOutOfRange;
+    QgsRasterHistogram::HistogramVector mHistogramVector;
+    int mNonNullCount;
+};
+
+#endif
@@ -0,0 +1,298 @@
+/***************************************************************************
+                        qgsrasterstatscache.cpp
+          Persistent cache of raster statistics and histograms
+                              -------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsrasterstatscache.h"
+#include "qgsapplication.h"
+#include "qgslogger.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
+#include <QDomElement>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#include <limits>
+
+QgsRasterStatsCache::QgsRasterStatsCache( const QString& theDataSource )
+    : mDataSource( theDataSource )
+{
+  QSettings mySettings;
+  if ( !mySettings.value( "/Raster/cacheStatistics", true ).toBool() )
+  {
+    return;
+  }
+
+  QFileInfo myFileInfo( theDataSource );
+  if ( theDataSource.isEmpty() || !myFileInfo.isFile() )
+  {
+    return;
+  }
+
+  mFileStamp = QString( "%1 %2" ).arg( myFileInfo.size() ).arg( myFileInfo.lastModified().toMSecsSinceEpoch() );
+  QByteArray myHash = QCryptographicHash::hash( myFileInfo.absoluteFilePath().toUtf8(), QCryptographicHash::Md5 ).toHex();
+  mCacheFile = cacheDirectory() + QDir::separator() + QString::fromAscii( myHash ) + ".xml";
+}
+
+QString QgsRasterStatsCache::cacheDirectory()
+{
+  return QgsApplication::qgisSettingsDirPath() + "rasterstats";
+}
+
+bool QgsRasterStatsCache::read( int theBandNo, const QString& theNoDataKey,
+                                QList<QgsRasterBandStats>& theStatistics, QList<QgsRasterHistogram>& theHistograms ) const
+{
+  if ( !isValid() )
+  {
+    return false;
+  }
+
+  QFile myFile( mCacheFile );
+  if ( !myFile.open( QIODevice::ReadOnly ) )
+  {
+    return false;
+  }
+
+  QDomDocument myDoc;
+  if ( !myDoc.setContent( &myFile ) )
+  {
+    QgsDebugMsg( "Cannot parse " + mCacheFile );
+    return false;
+  }
+
+  QDomElement myRootElem = myDoc.documentElement();
+  if ( myRootElem.attribute( "source" ) != QFileInfo( mDataSource ).absoluteFilePath() ||
+       myRootElem.attribute( "stamp" ) != mFileStamp )
+  {
+    QgsDebugMsg( "Cached statistics are out of date: " + mCacheFile );
+    return false;
+  }
+
+  QDomElement myBandElem = myRootElem.firstChildElement( "band" );
+  for ( ; !myBandElem.isNull(); myBandElem = myBandElem.nextSiblingElement( "band" ) )
+  {
+    if ( myBandElem.attribute( "number" ).toInt() != theBandNo ||
+         myBandElem.attribute( "nodata" ) != theNoDataKey )
+    {
+      continue;
+    }
+
+    QDomElement myStatsElem = myBandElem.firstChildElement( "statistics" );
+    for ( ; !myStatsElem.isNull(); myStatsElem = myStatsElem.nextSiblingElement( "statistics" ) )
+    {
+      QgsRasterBandStats myStats;
+      myStats.bandNumber = theBandNo;
+      myStats.statsGathered = myStatsElem.attribute( "statsGathered" ).toInt();
+      myStats.elementCount = myStatsElem.attribute( "elementCount" ).toULongLong();
+      myStats.minimumValue = myStatsElem.attribute( "minimum" ).toDouble();
+      myStats.maximumValue = myStatsElem.attribute( "maximum" ).toDouble();
+      myStats.range = myStatsElem.attribute( "range" ).toDouble();
+      myStats.sum = myStatsElem.attribute( "sum" ).toDouble();
+      myStats.mean = myStatsElem.attribute( "mean" ).toDouble();
+      myStats.stdDev = myStatsElem.attribute( "stdDev" ).toDouble();
+      myStats.sumOfSquares = myStatsElem.attribute( "sumOfSquares" ).toDouble();
+      QString myError = myStatsElem.attribute( "meanStandardError", "0" );
+      myStats.meanStandardError = myError == "nan" ? std::numeric_limits<double>::quiet_NaN() : myError.toDouble();
+      myStats.width = myStatsElem.attribute( "width" ).toInt();
+      myStats.height = myStatsElem.attribute( "height" ).toInt();
+      myStats.extent = readRectangle( myStatsElem );
+      theStatistics.append( myStats );
+    }
+
+    QDomElement myHistogramElem = myBandElem.firstChildElement( "histogram" );
+    for ( ; !myHistogramElem.isNull(); myHistogramElem = myHistogramElem.nextSiblingElement( "histogram" ) )
+    {
+      QgsRasterHistogram myHistogram;
+      myHistogram.bandNumber = theBandNo;
+      myHistogram.binCount = myHistogramElem.attribute( "binCount" ).toInt();
+      myHistogram.nonNullCount = myHistogramElem.attribute( "nonNullCount" ).toInt();
+      myHistogram.includeOutOfRange = myHistogramElem.attribute( "includeOutOfRange" ).toInt();
+      myHistogram.minimum = myHistogramElem.attribute( "minimum" ).toDouble();
+      myHistogram.maximum = myHistogramElem.attribute( "maximum" ).toDouble();
+      myHistogram.width = myHistogramElem.attribute( "width" ).toInt();
+      myHistogram.height = myHistogramElem.attribute( "height" ).toInt();
+      myHistogram.extent = readRectangle( myHistogramElem );
+
+      QStringList myCounts = myHistogramElem.text().split( ' ', QString::SkipEmptyParts );
+      if ( myCounts.size() != myHistogram.binCount )
+      {
+        continue;
+      }
+      myHistogram.histogramVector.reserve( myHistogram.binCount );
+      foreach ( QString myCount, myCounts )
+      {
+        myHistogram.histogramVector.append( myCount.toInt() );
+      }
+      myHistogram.valid = true;
+      theHistograms.append( myHistogram );
+    }
+  }
+  return true;
+}
+
+bool QgsRasterStatsCache::write( int theBandNo, const QString& theNoDataKey,
+                                 const QList<QgsRasterBandStats>& theStatistics, const QList<QgsRasterHistogram>& theHistograms )
+{
+  if ( !isValid() )
+  {
+    return false;
+  }
+
+  if ( !QDir().mkpath( cacheDirectory() ) )
+  {
+    QgsDebugMsg( "Cannot create " + cacheDirectory() );
+    return false;
+  }
+
+  // keep the entries of other bands if the file is up to date
+  QString mySource = QFileInfo( mDataSource ).absoluteFilePath();
+  QDomDocument myDoc;
+  QFile myFile( mCacheFile );
+  if ( myFile.open( QIODevice::ReadOnly ) )
+  {
+    if ( !myDoc.setContent( &myFile ) ||
+         myDoc.documentElement().attribute( "source" ) != mySource ||
+         myDoc.documentElement().attribute( "stamp" ) != mFileStamp )
+    {
+      myDoc.clear();
+    }
+    myFile.close();
+  }
+
+  QDomElement myRootElem = myDoc.documentElement();
+  if ( myRootElem.isNull() )
+  {
+    myRootElem = myDoc.createElement( "rasterstatistics" );
+    myRootElem.setAttribute( "source", mySource );
+    myRootElem.setAttribute( "stamp", mFileStamp );
+    myDoc.appendChild( myRootElem );
+  }
+
+  QDomElement myBandElem = myRootElem.firstChildElement( "band" );
+  while ( !myBandElem.isNull() )
+  {
+    QDomElement myNextElem = myBandElem.nextSiblingElement( "band" );
+    if ( myBandElem.attribute( "number" ).toInt() == theBandNo &&
+         myBandElem.attribute( "nodata" ) == theNoDataKey )
+    {
+      myRootElem.removeChild( myBandElem );
+    }
+    myBandElem = myNextElem;
+  }
+
+  myBandElem = myDoc.createElement( "band" );
+  myBandElem.setAttribute( "number", theBandNo );
+  myBandElem.setAttribute( "nodata", theNoDataKey );
+  myRootElem.appendChild( myBandElem );
+
+  foreach ( const QgsRasterBandStats& myStats, theStatistics )
+  {
+    QDomElement myStatsElem = myDoc.createElement( "statistics" );
+    myStatsElem.setAttribute( "statsGathered", myStats.statsGathered );
+    myStatsElem.setAttribute( "elementCount", QString::number( myStats.elementCount ) );
+    myStatsElem.setAttribute( "minimum", QString::number( myStats.minimumValue, 'g', 17 ) );
+    myStatsElem.setAttribute( "maximum", QString::number( myStats.maximumValue, 'g', 17 ) );
+    myStatsElem.setAttribute( "range", QString::number( myStats.range, 'g', 17 ) );
+    myStatsElem.setAttribute( "sum", QString::number( myStats.sum, 'g', 17 ) );
+    myStatsElem.setAttribute( "mean", QString::number( myStats.mean, 'g', 17 ) );
+    myStatsElem.setAttribute( "stdDev", QString::number( myStats.stdDev, 'g', 17 ) );
+    myStatsElem.setAttribute( "sumOfSquares", QString::number( myStats.sumOfSquares, 'g', 17 ) );
+    myStatsElem.setAttribute( "meanStandardError", QString::number( myStats.meanStandardError, 'g', 17 ) );
+    myStatsElem.setAttribute( "width", myStats.width );
+    myStatsElem.setAttribute( "height", myStats.height );
+    writeRectangle( myStatsElem, myStats.extent );
+    myBandElem.appendChild( myStatsElem );
+  }
+
+  foreach ( const QgsRasterHistogram& myHistogram, theHistograms )
+  {
+    if ( !myHistogram.valid )
+    {
+      continue;
+    }
+    QDomElement myHistogramElem = myDoc.createElement( "histogram" );
+    myHistogramElem.setAttribute( "binCount", myHistogram.binCount );
+    myHistogramElem.setAttribute( "nonNullCount", myHistogram.nonNullCount );
+    myHistogramElem.setAttribute( "includeOutOfRange", myHistogram.includeOutOfRange ? 1 : 0 );
+    myHistogramElem.setAttribute( "minimum", QString::number( myHistogram.minimum, 'g', 17 ) );
+    myHistogramElem.setAttribute( "maximum", QString::number( myHistogram.maximum, 'g', 17 ) );
+    myHistogramElem.setAttribute( "width", myHistogram.width );
+    myHistogramElem.setAttribute( "height", myHistogram.height );
+    writeRectangle( myHistogramElem, myHistogram.extent );
+
+    QStringList myCounts;
+    foreach ( int myCount, myHistogram.histogramVector )
+    {
+      myCounts << QString::number( myCount );
+    }
+    myHistogramElem.appendChild( myDoc.createTextNode( myCounts.join( " " ) ) );
+    myBandElem.appendChild( myHistogramElem );
+  }
+
+  // written to a temporary file first, so that other processes never read a partly written file
+  QString myTempName;
+  {
+    QTemporaryFile myTempFile( mCacheFile + ".XXXXXX" );
+    myTempFile.setAutoRemove( false );
+    if ( !myTempFile.open() )
+    {
+      QgsDebugMsg( "Cannot write " + myTempFile.fileTemplate() );
+      return false;
+    }
+    myTempName = myTempFile.fileName();
+    QTextStream myStream( &myTempFile );
+    myStream.setCodec( "UTF-8" );
+    myDoc.save( myStream, 2 );
+    myStream.flush();
+    if ( myStream.status() != QTextStream::Ok || myTempFile.error() != QFile::NoError )
+    {
+      QgsDebugMsg( "Cannot write " + myTempName );
+      myTempFile.close();
+      QFile::remove( myTempName );
+      return false;
+    }
+  }
+
+  // QFile::rename() does not replace existing files
+  QFile::remove( mCacheFile );
+  if ( !QFile::rename( myTempName, mCacheFile ) )
+  {
+    QgsDebugMsg( "Cannot rename " + myTempName + " to " + mCacheFile );
+    QFile::remove( myTempName );
+    return false;
+  }
+  return true;
+}
+
+void QgsRasterStatsCache::writeRectangle( QDomElement& theElem, const QgsRectangle& theRectangle )
+{
+  theElem.setAttribute( "xmin", QString::number( theRectangle.xMinimum(), 'g', 17 ) );
+  theElem.setAttribute( "ymin", QString::number( theRectangle.yMinimum(), 'g', 17 ) );
+  theElem.setAttribute( "xmax", QString::number( theRectangle.xMaximum(), 'g', 17 ) );
+  theElem.setAttribute( "ymax", QString::number( theRectangle.yMaximum(), 'g', 17 ) );
+}
+
+QgsRectangle QgsRasterStatsCache::readRectangle( const QDomElement& theElem )
+{
+  return QgsRectangle( theElem.attribute( "xmin" ).toDouble(), theElem.attribute( "ymin" ).toDouble(),
+                       theElem.attribute( "xmax" ).toDouble(), theElem.attribute( "ymax" ).toDouble() );
+}
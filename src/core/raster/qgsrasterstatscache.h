@@ -0,0 +1,69 @@
+/***************************************************************************
+                        qgsrasterstatscache.h
+          Persistent cache of raster statistics and histograms
+                              -------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSRASTERSTATSCACHE_H
+#define QGSRASTERSTATSCACHE_H
+
+#include <QList>
+#include <QString>
+
+#include "qgsrasterbandstats.h"
+#include "qgsrasterhistogram.h"
+
+class QDomElement;
+
+/** \ingroup core
+ * Stores statistics and histograms of a raster file in the settings directory,
+ * so that they do not have to be calculated again in the next session.
+ * Entries are keyed by the file path and become stale when the size or the
+ * modification time of the file change. Every band entry also carries a key
+ * of the no data values used, statistics calculated with different no data
+ * values are not returned.
+ * @note added in 2.1
+ */
+class CORE_EXPORT QgsRasterStatsCache
+{
+  public:
+    /** Creates the cache of a data source, only local files are cached */
+    QgsRasterStatsCache( const QString& theDataSource );
+
+    /** True if the data source is a local file and the cache is enabled in the settings */
+    bool isValid() const { return !mCacheFile.isEmpty(); }
+
+    /** Reads the statistics and histograms stored for a band
+     * @return true if the cache file exists and is up to date */
+    bool read( int theBandNo, const QString& theNoDataKey,
+               QList<QgsRasterBandStats>& theStatistics, QList<QgsRasterHistogram>& theHistograms ) const;
+
+    /** Replaces the statistics and histograms stored for a band */
+    bool write( int theBandNo, const QString& theNoDataKey,
+                const QList<QgsRasterBandStats>& theStatistics, const QList<QgsRasterHistogram>& theHistograms );
+
+    /** Directory where the cache files are stored */
+    static QString cacheDirectory();
+
+  private:
+    QString mDataSource;
+    QString mCacheFile;
+    /** Size and modification time of the data source */
+    QString mFileStamp;
+
+    static void writeRectangle( QDomElement& theElem, const QgsRectangle& theRectangle );
+    static QgsRectangle readRectangle( const QDomElement& theElem );
+};
+
+#endif
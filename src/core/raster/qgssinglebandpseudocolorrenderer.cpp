@@ -56,6 +56,7 @@ QgsRasterInterface * QgsSingleBandPseudoColorRenderer::clone() const
       colorRampShader->setColorRampType( origColorRampShader->colorRampType() );
 
       colorRampShader->setColorRampItemList( origColorRampShader->colorRampItemList() );
+      colorRampShader->setClip( origColorRampShader->clip() );
       shader->setRasterShaderFunction( colorRampShader );
     }
   }
@@ -148,47 +149,32 @@ QgsRasterBlock* QgsSingleBandPseudoColorRenderer::block( int bandNo, QgsRectangl
 
   QRgb myDefaultColor = NODATA_COLOR;
 
-  for ( qgssize i = 0; i < ( qgssize )width*height; i++ )
-  {
-    if ( inputBlock->isNoData( i ) )
-    {
-      outputBlock->setColor( i, myDefaultColor );
-      continue;
-    }
-    double val = inputBlock->value( i );
-    int red, green, blue, alpha;
-    if ( !mShader->shade( val, &red, &green, &blue, &alpha ) )
-    {
-      outputBlock->setColor( i, myDefaultColor );
-      continue;
-    }
+  //shade the whole block at once, the colors are already premultiplied
+  QRgb* outputData = ( QRgb* )outputBlock->bits();
+  mShader->shadeBlock( inputBlock, outputData, myDefaultColor );
 
-    if ( alpha < 255 )
+  if ( hasTransparency )
+  {
+    for ( qgssize i = 0; i < ( qgssize )width*height; i++ )
     {
-      // Working with premultiplied colors, so multiply values by alpha
-      red *= ( alpha / 255.0 );
-      blue *= ( alpha / 255.0 );
-      green *= ( alpha / 255.0 );
-    }
+      QRgb myColor = outputData[i];
+      if ( myColor == myDefaultColor )
+      {
+        continue;
+      }
 
-    if ( !hasTransparency )
-    {
-      outputBlock->setColor( i, qRgba( red, green, blue, alpha ) );
-    }
-    else
-    {
       //opacity
       double currentOpacity = mOpacity;
       if ( mRasterTransparency )
       {
-        currentOpacity = mRasterTransparency->alphaValue( val, mOpacity * 255 ) / 255.0;
+        currentOpacity = mRasterTransparency->alphaValue( inputBlock->value( i ), mOpacity * 255 ) / 255.0;
       }
       if ( mAlphaBand > 0 )
       {
         currentOpacity *= alphaBlock->value( i ) / 255.0;
       }
 
-      outputBlock->setColor( i, qRgba( currentOpacity * red, currentOpacity * green, currentOpacity * blue, currentOpacity * alpha ) );
+      outputData[i] = qRgba( currentOpacity * qRed( myColor ), currentOpacity * qGreen( myColor ), currentOpacity * qBlue( myColor ), currentOpacity * qAlpha( myColor ) );
     }
   }
 
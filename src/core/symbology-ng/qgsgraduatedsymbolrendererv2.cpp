@@ -21,6 +21,7 @@
 #include "qgsfeature.h"
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
+#include "qgscsexception.h"
 #include "qgsvectordataprovider.h"
 #include "qgsexpression.h"
 #include <QDomDocument>
@@ -183,6 +184,67 @@ QgsSymbolV2* QgsGraduatedSymbolRendererV2::symbolForFeature( QgsFeature& feature
     value = attrs[mAttrNum];
   }
 
+  return symbolForFeatureValue( feature, value );
+}
+
+QgsSymbolV2List QgsGraduatedSymbolRendererV2::symbolForFeatures( QgsFeatureList& features )
+{
+  if ( mAttrNum >= 0 )
+    return QgsFeatureRendererV2::symbolForFeatures( features );
+
+  // classify the whole batch with one evaluation of the expression
+  QVariantList values = mExpression->evaluate( features );
+
+  QgsSymbolV2List symbols;
+  for ( int i = 0; i < features.count(); ++i )
+  {
+    symbols.append( symbolForFeatureValue( features[i], values.at( i ) ) );
+  }
+  return symbols;
+}
+
+QList<bool> QgsGraduatedSymbolRendererV2::renderFeatures( QgsFeatureList& features, QgsRenderContext& context, const QList<bool>& selected, const QList<bool>& drawVertexMarker )
+{
+  if ( mAttrNum >= 0 )
+    return QgsFeatureRendererV2::renderFeatures( features, context, selected, drawVertexMarker );
+
+  // classify the whole batch with one evaluation of the expression
+  QVariantList values = mExpression->evaluate( features );
+
+  QList<bool> rendered;
+  for ( int i = 0; i < features.count(); ++i )
+  {
+    if ( context.renderingStopped() )
+      break;
+
+    bool r = false;
+    try
+    {
+      // the symbol may be a temporary one modified for each feature (data-defined
+      // rotation or size scale), so it is taken right before rendering the feature
+      QgsSymbolV2* symbol = symbolForFeatureValue( features[i], values.at( i ) );
+      if ( symbol )
+      {
+        renderFeatureWithSymbol( features[i], symbol, context, -1, selected.at( i ), drawVertexMarker.at( i ) );
+        r = true;
+      }
+    }
+    catch ( const QgsCsException &cse )
+    {
+      Q_UNUSED( cse );
+      QgsDebugMsg( QString( "Failed to transform a point while drawing a feature with ID '%1'. Ignoring this feature. %2" )
+                   .arg( features[i].id() ).arg( cse.what() ) );
+    }
+    rendered.append( r );
+  }
+
+  while ( rendered.count() < features.count() )
+    rendered.append( false );
+  return rendered;
+}
+
+QgsSymbolV2* QgsGraduatedSymbolRendererV2::symbolForFeatureValue( QgsFeature& feature, const QVariant& value )
+{
   // Null values should not be categorized
   if ( value.isNull() )
     return NULL;
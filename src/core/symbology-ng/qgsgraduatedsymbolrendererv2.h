@@ -71,6 +71,15 @@ class CORE_EXPORT QgsGraduatedSymbolRendererV2 : public QgsFeatureRendererV2
 
     virtual QgsSymbolV2* symbolForFeature( QgsFeature& feature );
 
+    //! classifies the batch with one evaluation of the classification expression
+    //! @note added in 2.1
+    virtual QgsSymbolV2List symbolForFeatures( QList<QgsFeature>& features );
+
+    //! classifies the batch with one evaluation of the classification expression,
+    //! each symbol is taken right before its feature is rendered
+    //! @note added in 2.1
+    virtual QList<bool> renderFeatures( QList<QgsFeature>& features, QgsRenderContext& context, const QList<bool>& selected, const QList<bool>& drawVertexMarker );
+
     virtual void startRender( QgsRenderContext& context, const QgsVectorLayer *vlayer );
 
     virtual void stopRender( QgsRenderContext& context );
@@ -199,6 +208,9 @@ class CORE_EXPORT QgsGraduatedSymbolRendererV2 : public QgsFeatureRendererV2
 
     QgsSymbolV2* symbolForValue( double value );
 
+    //! symbol for a feature with the given classification value
+    //! @note added in 2.1
+    QgsSymbolV2* symbolForFeatureValue( QgsFeature& feature, const QVariant& value );
 };
 
 #endif // QGSGRADUATEDSYMBOLRENDERERV2_H
@@ -27,10 +27,28 @@
 #include "qgsfeature.h"
 #include "qgslogger.h"
 #include "qgsvectorlayer.h"
+#include "qgscsexception.h"
 
 #include <QDomElement>
 #include <QDomDocument>
 #include <QPolygonF>
+#include <QThreadStorage>
+
+// coordinate buffers of renderFeatureWithSymbol, reused by each thread so that
+// the points of lines and polygons are not allocated again for every feature
+struct QgsRenderPointBuffers
+{
+  QPolygonF pts;
+};
+
+static QThreadStorage<QgsRenderPointBuffers*> sRenderPointBuffers;
+
+static QgsRenderPointBuffers& renderPointBuffers()
+{
+  if ( !sRenderPointBuffers.hasLocalData() )
+    sRenderPointBuffers.setLocalData( new QgsRenderPointBuffers );
+  return *sRenderPointBuffers.localData();
+}
 
 
 
@@ -58,8 +76,38 @@ const unsigned char* QgsFeatureRendererV2::_getPoint( QPointF& pt, QgsRenderCont
   return wkb;
 }
 
+// Reads nPoints points from WKB straight into pts and tells whether they
+// are all within rect
+static const unsigned char* readPointsWkb( QPolygonF& pts, const unsigned char* wkb, unsigned int nPoints, bool hasZValue,
+    const QgsRectangle& rect, bool& inside )
+{
+  int sizeOfDoubleY = hasZValue ? 2 * sizeof( double ) : sizeof( double );
+  double xMin = rect.xMinimum(), xMax = rect.xMaximum();
+  double yMin = rect.yMinimum(), yMax = rect.yMaximum();
+  double x, y;
+
+  // reserving keeps the memory when later points are fewer
+  if ( pts.capacity() < ( int ) nPoints )
+    pts.reserve( nPoints );
+  pts.resize( nPoints );
+  QPointF* ptr = pts.data();
+  int in = 1;
+  for ( unsigned int i = 0; i < nPoints; ++i, ++ptr )
+  {
+    memcpy( &x, wkb, sizeof( double ) ); wkb += sizeof( double );
+    memcpy( &y, wkb, sizeof( double ) ); wkb += sizeOfDoubleY;
+
+    *ptr = QPointF( x, y );
+    in &= ( x >= xMin ) & ( x <= xMax ) & ( y >= yMin ) & ( y <= yMax );
+  }
+
+  inside = in;
+  return wkb;
+}
+
 const unsigned char* QgsFeatureRendererV2::_getLineString( QPolygonF& pts, QgsRenderContext& context, const unsigned char* wkb )
 {
+  const unsigned char* lineWkb = wkb;
   wkb++; // jump over endian info
   unsigned int wkbType = *(( int* ) wkb );
   wkb += sizeof( unsigned int );
@@ -68,33 +116,22 @@ const unsigned char* QgsFeatureRendererV2::_getLineString( QPolygonF& pts, QgsRe
 
   bool hasZValue = ( wkbType == QGis::WKBLineString25D );
 
-  int sizeOfDoubleX = sizeof( double );
-  int sizeOfDoubleY = hasZValue ? 2 * sizeof( double ) : sizeof( double );
-
-  double x, y;
   const QgsCoordinateTransform* ct = context.coordinateTransform();
   const QgsMapToPixel& mtp = context.mapToPixel();
 
-  //apply clipping for large lines to achieve a better rendering performance
-  if ( nPoints > 1 )
-  {
-    const QgsRectangle& e = context.extent();
-    double cw = e.width() / 10; double ch = e.height() / 10;
-    QgsRectangle clipRect( e.xMinimum() - cw, e.yMinimum() - ch, e.xMaximum() + cw, e.yMaximum() + ch );
-    wkb = QgsClipper::clippedLineWKB( wkb - ( 2 * sizeof( unsigned int ) + 1 ), clipRect, pts );
-  }
-  else
-  {
-    pts.resize( nPoints );
+  const QgsRectangle& e = context.extent();
+  double cw = e.width() / 10; double ch = e.height() / 10;
+  QgsRectangle clipRect( e.xMinimum() - cw, e.yMinimum() - ch, e.xMaximum() + cw, e.yMaximum() + ch );
 
-    QPointF* ptr = pts.data();
-    for ( unsigned int i = 0; i < nPoints; ++i, ++ptr )
-    {
-      memcpy( &x, wkb, sizeof( double ) ); wkb += sizeOfDoubleX;
-      memcpy( &y, wkb, sizeof( double ) ); wkb += sizeOfDoubleY;
+  // read the points straight into pts, reusing its memory
+  bool inside;
+  wkb = readPointsWkb( pts, wkb, nPoints, hasZValue, clipRect, inside );
 
-      *ptr = QPointF( x, y );
-    }
+  //apply clipping for large lines to achieve a better rendering performance.
+  //Lines within the clip rectangle are not changed by clipping.
+  if ( nPoints > 1 && !inside )
+  {
+    wkb = QgsClipper::clippedLineWKB( lineWkb, clipRect, pts );
   }
 
   //transform the QPolygonF to screen coordinates
@@ -103,12 +140,7 @@ const unsigned char* QgsFeatureRendererV2::_getLineString( QPolygonF& pts, QgsRe
     ct->transformPolygon( pts );
   }
 
-  QPointF* ptr = pts.data();
-  for ( int i = 0; i < pts.size(); ++i, ++ptr )
-  {
-    mtp.transformInPlace( ptr->rx(), ptr->ry() );
-  }
-
+  mtp.transformInPlace( pts );
 
   return wkb;
 }
@@ -121,17 +153,14 @@ const unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QP
   unsigned int numRings = *(( int* ) wkb );
   wkb += sizeof( unsigned int );
 
+  pts.resize( 0 );
+  holes.clear();
+
   if ( numRings == 0 )  // sanity check for zero rings in polygon
     return wkb;
 
   bool hasZValue = ( wkbType == QGis::WKBPolygon25D );
 
-  int sizeOfDoubleX = sizeof( double );
-  int sizeOfDoubleY = hasZValue ? 2 * sizeof( double ) : sizeof( double );
-
-  double x, y;
-  holes.clear();
-
   const QgsCoordinateTransform* ct = context.coordinateTransform();
   const QgsMapToPixel& mtp = context.mapToPixel();
   const QgsRectangle& e = context.extent();
@@ -143,24 +172,23 @@ const unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QP
     unsigned int nPoints = *(( int* )wkb );
     wkb += sizeof( unsigned int );
 
-    QPolygonF poly( nPoints );
+    // the exterior ring is read straight into pts, holes straight into the list
+    if ( idx > 0 )
+      holes.append( QPolygonF() );
+    QPolygonF& poly = idx == 0 ? pts : holes.last();
 
-    // Extract the points from the WKB and store in a pair of vectors.
-    QPointF* ptr = poly.data();
-    for ( unsigned int jdx = 0; jdx < nPoints; ++jdx, ++ptr )
-    {
-      memcpy( &x, wkb, sizeof( double ) ); wkb += sizeOfDoubleX;
-      memcpy( &y, wkb, sizeof( double ) ); wkb += sizeOfDoubleY;
-
-      *ptr = QPointF( x, y );
-    }
+    bool inside;
+    wkb = readPointsWkb( poly, wkb, nPoints, hasZValue, e, inside );
 
     if ( nPoints < 1 )
+    {
+      if ( idx > 0 )
+        holes.removeLast();
       continue;
+    }
 
     //clip close to view extent, if needed
-    QRectF ptsRect = poly.boundingRect();
-    if ( !context.extent().contains( ptsRect ) ) QgsClipper::trimPolygon( poly, clipRect );
+    if ( !inside ) QgsClipper::trimPolygon( poly, clipRect );
 
     //transform the QPolygonF to screen coordinates
     if ( ct )
@@ -168,17 +196,7 @@ const unsigned char* QgsFeatureRendererV2::_getPolygon( QPolygonF& pts, QList<QP
       ct->transformPolygon( poly );
     }
 
-
-    ptr = poly.data();
-    for ( int i = 0; i < poly.size(); ++i, ++ptr )
-    {
-      mtp.transformInPlace( ptr->rx(), ptr->ry() );
-    }
-
-    if ( idx == 0 )
-      pts = poly;
-    else
-      holes.append( poly );
+    mtp.transformInPlace( poly );
   }
 
   return wkb;
@@ -255,7 +273,7 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
         QgsDebugMsg( "linestring can be drawn only with line symbol!" );
         break;
       }
-      QPolygonF pts;
+      QPolygonF& pts = renderPointBuffers().pts;
       _getLineString( pts, context, geom->asWkb() );
       (( QgsLineSymbolV2* )symbol )->renderPolyline( pts, &feature, context, layer, selected );
 
@@ -272,7 +290,7 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
         QgsDebugMsg( "polygon can be drawn only with fill symbol!" );
         break;
       }
-      QPolygonF pts;
+      QPolygonF& pts = renderPointBuffers().pts;
       QList<QPolygonF> holes;
       _getPolygon( pts, holes, context, geom->asWkb() );
       (( QgsFillSymbolV2* )symbol )->renderPolygon( pts, ( holes.count() ? &holes : NULL ), &feature, context, layer, selected );
@@ -319,7 +337,7 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
       const unsigned char* wkb = geom->asWkb();
       unsigned int num = *(( int* )( wkb + 5 ) );
       const unsigned char* ptr = wkb + 9;
-      QPolygonF pts;
+      QPolygonF& pts = renderPointBuffers().pts;
 
       for ( unsigned int i = 0; i < num; ++i )
       {
@@ -344,7 +362,7 @@ void QgsFeatureRendererV2::renderFeatureWithSymbol( QgsFeature& feature, QgsSymb
       const unsigned char* wkb = geom->asWkb();
       unsigned int num = *(( int* )( wkb + 5 ) );
       const unsigned char* ptr = wkb + 9;
-      QPolygonF pts;
+      QPolygonF& pts = renderPointBuffers().pts;
       QList<QPolygonF> holes;
 
       for ( unsigned int i = 0; i < num; ++i )
@@ -556,3 +574,64 @@ QgsSymbolV2List QgsFeatureRendererV2::symbolsForFeature( QgsFeature& feat )
   if ( s ) lst.append( s );
   return lst;
 }
+
+QgsSymbolV2List QgsFeatureRendererV2::symbolForFeatures( QgsFeatureList& features )
+{
+  QgsSymbolV2List lst;
+  for ( QgsFeatureList::iterator it = features.begin(); it != features.end(); ++it )
+  {
+    lst.append( symbolForFeature( *it ) );
+  }
+  return lst;
+}
+
+QList<QgsSymbolV2List> QgsFeatureRendererV2::symbolsForFeatures( QgsFeatureList& features )
+{
+  QList<QgsSymbolV2List> lst;
+  if ( capabilities() & MoreSymbolsPerFeature )
+  {
+    for ( QgsFeatureList::iterator it = features.begin(); it != features.end(); ++it )
+    {
+      lst.append( symbolsForFeature( *it ) );
+    }
+  }
+  else
+  {
+    // one symbol per feature: use the batch classification
+    QgsSymbolV2List symbols = symbolForFeatures( features );
+    foreach ( QgsSymbolV2* s, symbols )
+    {
+      QgsSymbolV2List featureSymbols;
+      if ( s ) featureSymbols.append( s );
+      lst.append( featureSymbols );
+    }
+  }
+  return lst;
+}
+
+QList<bool> QgsFeatureRendererV2::renderFeatures( QgsFeatureList& features, QgsRenderContext& context, const QList<bool>& selected, const QList<bool>& drawVertexMarker )
+{
+  QList<bool> rendered;
+  for ( int i = 0; i < features.count(); ++i )
+  {
+    if ( context.renderingStopped() )
+      break;
+
+    bool r = false;
+    try
+    {
+      r = renderFeature( features[i], context, -1, selected.at( i ), drawVertexMarker.at( i ) );
+    }
+    catch ( const QgsCsException &cse )
+    {
+      Q_UNUSED( cse );
+      QgsDebugMsg( QString( "Failed to transform a point while drawing a feature with ID '%1'. Ignoring this feature. %2" )
+                   .arg( features[i].id() ).arg( cse.what() ) );
+    }
+    rendered.append( r );
+  }
+
+  while ( rendered.count() < features.count() )
+    rendered.append( false );
+  return rendered;
+}
@@ -173,6 +173,27 @@ class CORE_EXPORT QgsFeatureRendererV2
     //! @note added in 1.9
     virtual QgsSymbolV2List symbolsForFeature( QgsFeature& feat );
 
+    //! return symbols for a batch of features: one symbol per feature (0 if the feature
+    //! will not be rendered), the same as calling symbolForFeature() for each of them.
+    //! Renderers classifying features by an expression evaluate it for the whole batch at once.
+    //! Must be called between startRender() and stopRender() calls.
+    //! @note added in 2.1
+    virtual QgsSymbolV2List symbolForFeatures( QList<QgsFeature>& features );
+
+    //! return the lists of symbols for a batch of features, the same as calling
+    //! symbolsForFeature() for each of them.
+    //! Must be called between startRender() and stopRender() calls.
+    //! @note added in 2.1
+    virtual QList<QgsSymbolV2List> symbolsForFeatures( QList<QgsFeature>& features );
+
+    //! render a batch of features, the same as calling renderFeature() for each of them
+    //! (features whose coordinates cannot be transformed are skipped). Returns for each feature
+    //! whether it has been rendered. Stops early when rendering is stopped, the remaining
+    //! features are reported as not rendered.
+    //! Must be called between startRender() and stopRender() calls.
+    //! @note added in 2.1
+    virtual QList<bool> renderFeatures( QList<QgsFeature>& features, QgsRenderContext& context, const QList<bool>& selected, const QList<bool>& drawVertexMarker );
+
   protected:
     QgsFeatureRendererV2( QString type );
 
@@ -495,6 +495,45 @@ QgsSymbolV2List QgsRuleBasedRendererV2::Rule::symbolsForFeature( QgsFeature& fea
   return lst;
 }
 
+void QgsRuleBasedRendererV2::Rule::symbolsForFeatures( QgsFeatureList& features, const QList<int>& indexes, QList<QgsSymbolV2List>& symbols )
+{
+  QList<int> passed = filterFeatures( features, indexes );
+  if ( passed.isEmpty() )
+    return;
+
+  if ( mSymbol )
+  {
+    foreach ( int idx, passed )
+      symbols[idx].append( mSymbol );
+  }
+
+  for ( QList<Rule*>::iterator it = mActiveChildren.begin(); it != mActiveChildren.end(); ++it )
+  {
+    Rule* rule = *it;
+    rule->symbolsForFeatures( features, passed, symbols );
+  }
+}
+
+QList<int> QgsRuleBasedRendererV2::Rule::filterFeatures( QgsFeatureList& features, const QList<int>& indexes ) const
+{
+  if ( ! mFilter || mElseRule )
+    return indexes;
+
+  QList<const QgsFeature*> batch;
+  foreach ( int idx, indexes )
+    batch.append( &features.at( idx ) );
+
+  QVariantList res = mFilter->evaluate( batch );
+
+  QList<int> passed;
+  for ( int i = 0; i < indexes.count(); ++i )
+  {
+    if ( res.at( i ).toInt() != 0 )
+      passed.append( indexes.at( i ) );
+  }
+  return passed;
+}
+
 QgsRuleBasedRendererV2::RuleList QgsRuleBasedRendererV2::Rule::rulesForFeature( QgsFeature& feat )
 {
   RuleList lst;
@@ -981,3 +1020,16 @@ QgsSymbolV2List QgsRuleBasedRendererV2::symbolsForFeature( QgsFeature& feat )
 {
   return mRootRule->symbolsForFeature( feat );
 }
+
+QList<QgsSymbolV2List> QgsRuleBasedRendererV2::symbolsForFeatures( QgsFeatureList& features )
+{
+  QList<QgsSymbolV2List> symbols;
+  QList<int> indexes;
+  for ( int i = 0; i < features.count(); ++i )
+  {
+    symbols.append( QgsSymbolV2List() );
+    indexes.append( i );
+  }
+  mRootRule->symbolsForFeatures( features, indexes, symbols );
+  return symbols;
+}
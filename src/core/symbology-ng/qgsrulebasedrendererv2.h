@@ -140,6 +140,17 @@ class CORE_EXPORT QgsRuleBasedRendererV2 : public QgsFeatureRendererV2
         //! @note added in 1.9
         QgsSymbolV2List symbolsForFeature( QgsFeature& feat );
 
+        //! append the symbols of this rule and its children to the symbol lists of the features
+        //! with the given indexes, evaluating the filters for all of them at once
+        //! @note added in 2.1
+        //! @note not available in python bindings
+        void symbolsForFeatures( QgsFeatureList& features, const QList<int>& indexes, QList<QgsSymbolV2List>& symbols );
+
+        //! return the indexes of the features passing the filter
+        //! @note added in 2.1
+        //! @note not available in python bindings
+        QList<int> filterFeatures( QgsFeatureList& features, const QList<int>& indexes ) const;
+
         //! tell which rules will be used to render the feature
         RuleList rulesForFeature( QgsFeature& feat );
 
@@ -242,6 +253,10 @@ class CORE_EXPORT QgsRuleBasedRendererV2 : public QgsFeatureRendererV2
     //! @note added in 1.9
     virtual QgsSymbolV2List symbolsForFeature( QgsFeature& feat );
 
+    //! return lists of symbols for a batch of features, the rule filters are evaluated for the whole batch
+    //! @note added in 2.1
+    virtual QList<QgsSymbolV2List> symbolsForFeatures( QgsFeatureList& features );
+
     //! returns bitwise OR-ed capabilities of the renderer
     //! \note added in 2.0
     virtual int capabilities() { return MoreSymbolsPerFeature | Filter | ScaleDependent; }
@@ -35,6 +35,7 @@
 #include <QFileInfo>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QMutexLocker>
 
 QgsSvgCacheEntry::QgsSvgCacheEntry(): file( QString() ), size( 0.0 ), outlineWidth( 0 ), widthScaleFactor( 1.0 ), rasterScaleFactor( 1.0 ), fill( Qt::black ),
     outline( Qt::black ), image( 0 ), picture( 0 )
@@ -89,6 +90,7 @@ QgsSvgCache* QgsSvgCache::instance()
 
 QgsSvgCache::QgsSvgCache( QObject *parent )
     : QObject( parent )
+    , mMutex( QMutex::Recursive )
     , mTotalSize( 0 )
     , mLeastRecentEntry( 0 )
     , mMostRecentEntry( 0 )
@@ -106,9 +108,11 @@ QgsSvgCache::~QgsSvgCache()
 }
 
 
-const QImage& QgsSvgCache::svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                                       double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache )
+QImage QgsSvgCache::svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                                double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache )
 {
+  QMutexLocker locker( &mMutex );
+
   fitsInCache = true;
   QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
 
@@ -146,12 +150,15 @@ const QImage& QgsSvgCache::svgAsImage( const QString& file, double size, const Q
     trimToMaximumSize();
   }
 
-  return *( currentEntry->image );
+  //the image is copied (implicitly shared), the entry may be removed by another thread once the lock is released
+  return currentEntry->image ? *( currentEntry->image ) : QImage();
 }
 
-const QPicture& QgsSvgCache::svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-    double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput )
+QPicture QgsSvgCache::svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                                    double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput )
 {
+  QMutexLocker locker( &mMutex );
+
   QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
 
   //if current entry picture is 0: cache picture for entry
@@ -162,7 +169,15 @@ const QPicture& QgsSvgCache::svgAsPicture( const QString& file, double size, con
     trimToMaximumSize();
   }
 
-  return *( currentEntry->picture );
+  if ( !currentEntry->picture )
+  {
+    return QPicture();
+  }
+
+  //playing a picture is not thread safe on shared picture data
+  QPicture picture = *( currentEntry->picture );
+  picture.detach();
+  return picture;
 }
 
 QgsSvgCacheEntry* QgsSvgCache::insertSVG( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
@@ -21,6 +21,7 @@
 #include <QColor>
 #include <QMap>
 #include <QMultiHash>
+#include <QMutex>
 #include <QString>
 #include <QUrl>
 
@@ -68,7 +69,8 @@ class CORE_EXPORT QgsSvgCacheEntry
 
 /**A cache for images / pictures derived from svg files. This class supports parameter replacement in svg files
 according to the svg params specification (http://www.w3.org/TR/2009/WD-SVGParamPrimer-20090616/). Supported are
-the parameters 'fill-color', 'pen-color', 'outline-width', 'stroke-width'. E.g. <circle fill="param(fill-color red)" stroke="param(pen-color black)" stroke-width="param(outline-width 1)"*/
+the parameters 'fill-color', 'pen-color', 'outline-width', 'stroke-width'. E.g. <circle fill="param(fill-color red)" stroke="param(pen-color black)" stroke-width="param(outline-width 1)".
+The cache is shared between threads, images and pictures are returned as copies*/
 class CORE_EXPORT QgsSvgCache : public QObject
 {
     Q_OBJECT
@@ -88,9 +90,9 @@ class CORE_EXPORT QgsSvgCache : public QObject
      * @param rasterScaleFactor raster scale factor
      * @param fitsInCache
      */
-    const QImage& svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                              double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache );
-    /** Get SVG  as QPicture&.
+    QImage svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                       double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache );
+    /** Get SVG  as QPicture.
      * @param file Absolute or relative path to SVG file.
      * @param size size of cached image
      * @param fill color of fill
@@ -100,8 +102,8 @@ class CORE_EXPORT QgsSvgCache : public QObject
      * @param rasterScaleFactor raster scale factor
      * @param forceVectorOutput
      */
-    const QPicture& svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
-                                  double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput = false );
+    QPicture svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
+                           double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput = false );
 
     /**Tests if an svg file contains parameters for fill, outline color, outline width. If yes, possible default values are returned. If there are several
       default values in the svg file, only the first one is considered*/
@@ -149,6 +151,9 @@ class CORE_EXPORT QgsSvgCache : public QObject
     void downloadProgress( qint64, qint64 );
 
   private:
+    /**Protects the entries against concurrent access. Recursive, as downloading remote svg files processes events*/
+    QMutex mMutex;
+
     /**Entry pointers accessible by file name*/
     QMultiHash< QString, QgsSvgCacheEntry* > mEntryLookup;
     /**Estimated total size of all images, pictures and svgContent*/
@@ -34,18 +34,29 @@ map service syntax for SOAP/HTTP POST
 #include "qgsprojectparser.h"
 #include "qgssldparser.h"
 #include "qgsnetworkaccessmanager.h"
+#include "qgsmaplayerregistry.h"
+#include "qgsmslayercache.h"
+#include "qgsmsutils.h"
 
 #include <QDomDocument>
 #include <QNetworkDiskCache>
 #include <QImage>
 #include <QSettings>
 #include <QDateTime>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
 
 //for CMAKE_INSTALL_PREFIX
 #include "qgsconfig.h"
 
 #include <fcgi_stdio.h>
 
+#ifndef Q_OS_WIN
+#include <pthread.h>
+#include <signal.h>
+#endif
+
 
 void dummyMessageHandler( QtMsgType type, const char *msg )
 {
@@ -85,45 +96,45 @@ void printRequestInfos()
   QgsDebugMsg( "************************new request**********************" );
   QgsDebugMsg( QDateTime::currentDateTime().toString( "yyyy-MM-dd hh:mm:ss" ) );
 
-  if ( getenv( "REMOTE_ADDR" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "REMOTE_ADDR" ) != NULL )
   {
-    QgsDebugMsg( "remote ip: " + QString( getenv( "REMOTE_ADDR" ) ) );
+    QgsDebugMsg( "remote ip: " + QString( QgsMSUtils::requestVariable( "REMOTE_ADDR" ) ) );
   }
-  if ( getenv( "REMOTE_HOST" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "REMOTE_HOST" ) != NULL )
   {
-    QgsDebugMsg( "remote host: " + QString( getenv( "REMOTE_HOST" ) ) );
+    QgsDebugMsg( "remote host: " + QString( QgsMSUtils::requestVariable( "REMOTE_HOST" ) ) );
   }
-  if ( getenv( "REMOTE_USER" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "REMOTE_USER" ) != NULL )
   {
-    QgsDebugMsg( "remote user: " + QString( getenv( "REMOTE_USER" ) ) );
+    QgsDebugMsg( "remote user: " + QString( QgsMSUtils::requestVariable( "REMOTE_USER" ) ) );
   }
-  if ( getenv( "REMOTE_IDENT" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "REMOTE_IDENT" ) != NULL )
   {
-    QgsDebugMsg( "REMOTE_IDENT: " + QString( getenv( "REMOTE_IDENT" ) ) );
+    QgsDebugMsg( "REMOTE_IDENT: " + QString( QgsMSUtils::requestVariable( "REMOTE_IDENT" ) ) );
   }
-  if ( getenv( "CONTENT_TYPE" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "CONTENT_TYPE" ) != NULL )
   {
-    QgsDebugMsg( "CONTENT_TYPE: " + QString( getenv( "CONTENT_TYPE" ) ) );
+    QgsDebugMsg( "CONTENT_TYPE: " + QString( QgsMSUtils::requestVariable( "CONTENT_TYPE" ) ) );
   }
-  if ( getenv( "AUTH_TYPE" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "AUTH_TYPE" ) != NULL )
   {
-    QgsDebugMsg( "AUTH_TYPE: " + QString( getenv( "AUTH_TYPE" ) ) );
+    QgsDebugMsg( "AUTH_TYPE: " + QString( QgsMSUtils::requestVariable( "AUTH_TYPE" ) ) );
   }
-  if ( getenv( "HTTP_USER_AGENT" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "HTTP_USER_AGENT" ) != NULL )
   {
-    QgsDebugMsg( "HTTP_USER_AGENT: " + QString( getenv( "HTTP_USER_AGENT" ) ) );
+    QgsDebugMsg( "HTTP_USER_AGENT: " + QString( QgsMSUtils::requestVariable( "HTTP_USER_AGENT" ) ) );
   }
-  if ( getenv( "HTTP_PROXY" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "HTTP_PROXY" ) != NULL )
   {
-    QgsDebugMsg( "HTTP_PROXY: " + QString( getenv( "HTTP_PROXY" ) ) );
+    QgsDebugMsg( "HTTP_PROXY: " + QString( QgsMSUtils::requestVariable( "HTTP_PROXY" ) ) );
   }
-  if ( getenv( "HTTPS_PROXY" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "HTTPS_PROXY" ) != NULL )
   {
-    QgsDebugMsg( "HTTPS_PROXY: " + QString( getenv( "HTTPS_PROXY" ) ) );
+    QgsDebugMsg( "HTTPS_PROXY: " + QString( QgsMSUtils::requestVariable( "HTTPS_PROXY" ) ) );
   }
-  if ( getenv( "NO_PROXY" ) != NULL )
+  if ( QgsMSUtils::requestVariable( "NO_PROXY" ) != NULL )
   {
-    QgsDebugMsg( "NO_PROXY: " + QString( getenv( "NO_PROXY" ) ) );
+    QgsDebugMsg( "NO_PROXY: " + QString( QgsMSUtils::requestVariable( "NO_PROXY" ) ) );
   }
 
 #endif //QGSMSDEBUG
@@ -166,100 +177,86 @@ int fcgi_accept()
 #endif
 }
 
-int main( int argc, char * argv[] )
-{
-#ifndef _MSC_VER
-  qInstallMsgHandler( dummyMessageHandler );
+#ifdef QGSMSDEBUG
+static bool testFontLoaded = false;
 #endif
 
-  QgsApplication qgsapp( argc, argv, getenv( "DISPLAY" ) );
+//request thread waiting in FCGX_Accept_r and whether the request threads stop accepting connections
+static QMutex acceptStateMutex;
+static Qt::HANDLE acceptingThread = 0;
+static bool acceptShutdown = false;
 
-  //Default prefix path may be altered by environment variable
-  char* prefixPath = getenv( "QGIS_PREFIX_PATH" );
-  if ( prefixPath )
-  {
-    QgsApplication::setPrefixPath( prefixPath, TRUE );
-  }
-#if !defined(Q_OS_WIN)
-  else
+/**Accepts the next request. The process wide FastCGI stream is used if fcgiRequest is 0*/
+int acceptRequest( FCGX_Request* fcgiRequest )
+{
+  if ( !fcgiRequest )
   {
-    // init QGIS's paths - true means that all path will be inited from prefix
-    QgsApplication::setPrefixPath( CMAKE_INSTALL_PREFIX, TRUE );
+    return fcgi_accept();
   }
-#endif
-
-#if defined(MAPSERVER_SKIP_ECW)
-  QgsDebugMsg( "Skipping GDAL ECW drivers in server." );
-  QgsApplication::skipGdalDriver( "ECW" );
-  QgsApplication::skipGdalDriver( "JP2ECW" );
-#endif
-
-  QSettings settings;
-
-  QgsNetworkAccessManager *nam = QgsNetworkAccessManager::instance();
-  QNetworkDiskCache *cache = new QNetworkDiskCache( 0 );
-
-  QString cacheDirectory = settings.value( "cache/directory", QgsApplication::qgisSettingsDirPath() + "cache" ).toString();
-  qint64 cacheSize = settings.value( "cache/size", 50 * 1024 * 1024 ).toULongLong();
-  QgsDebugMsg( QString( "setCacheDirectory: %1" ).arg( cacheDirectory ) );
-  QgsDebugMsg( QString( "setMaximumCacheSize: %1" ).arg( cacheSize ) );
-  cache->setCacheDirectory( cacheDirectory );
-  cache->setMaximumCacheSize( cacheSize );
-  QgsDebugMsg( QString( "cacheDirectory: %1" ).arg( cache->cacheDirectory() ) );
-  QgsDebugMsg( QString( "maximumCacheSize: %1" ).arg( cache->maximumCacheSize() ) );
 
-  nam->setCache( cache );
+  //FCGX_Accept_r is not thread safe on all platforms
+  static QMutex acceptMutex;
+  QMutexLocker locker( &acceptMutex );
 
-  QDomImplementation::setInvalidDataPolicy( QDomImplementation::DropInvalidChars );
-
-  // Instantiate the plugin directory so that providers are loaded
-  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
-  QgsDebugMsg( "Prefix  PATH: " + QgsApplication::prefixPath() );
-  QgsDebugMsg( "Plugin  PATH: " + QgsApplication::pluginPath() );
-  QgsDebugMsg( "PkgData PATH: " + QgsApplication::pkgDataPath() );
-  QgsDebugMsg( "User DB PATH: " + QgsApplication::qgisUserDbFilePath() );
+  acceptStateMutex.lock();
+  if ( acceptShutdown )
+  {
+    acceptStateMutex.unlock();
+    return -1;
+  }
+  acceptingThread = QThread::currentThreadId();
+  acceptStateMutex.unlock();
 
-  QgsDebugMsg( qgsapp.applicationDirPath() + "/qgis_wms_server.log" );
-  QgsApplication::createDB(); //init qgis.db (e.g. necessary for user crs)
+  int result = FCGX_Accept_r( fcgiRequest );
 
-  //create config cache and search for config files in the current directory.
-  //These configurations are used if no mapfile parameter is present in the request
-  QString defaultConfigFilePath;
-  QFileInfo projectFileInfo = defaultProjectFile(); //try to find a .qgs file in the server directory
-  if ( projectFileInfo.exists() )
+  acceptStateMutex.lock();
+  acceptingThread = 0;
+  if ( result < 0 )
   {
-    defaultConfigFilePath = projectFileInfo.absoluteFilePath();
-    QgsDebugMsg( "Using default project file: " + defaultConfigFilePath );
+    //the connection is closed, the other threads stop as well
+    acceptShutdown = true;
   }
-  else
+  acceptStateMutex.unlock();
+  return result;
+}
+
+/**Stops the request threads from accepting further connections. The FastCGI library treats SIGUSR1 as
+  a pending shutdown, so the thread blocked in FCGX_Accept_r is interrupted with it.
+  @return false if a thread blocked in FCGX_Accept_r cannot be interrupted on this platform*/
+bool shutdownRequestThreads()
+{
+  QMutexLocker locker( &acceptStateMutex );
+  acceptShutdown = true;
+  FCGX_ShutdownPending();
+  if ( !acceptingThread )
   {
-    QFileInfo adminSLDFileInfo = defaultAdminSLD();
-    if ( adminSLDFileInfo.exists() )
-    {
-      defaultConfigFilePath = adminSLDFileInfo.absoluteFilePath();
-    }
+    return true;
   }
+#ifndef Q_OS_WIN
+  pthread_kill(( pthread_t ) acceptingThread, SIGUSR1 );
+  return true;
+#else
+  return false;
+#endif
+}
 
-  //create cache for capabilities XML
-  QgsCapabilitiesCache capabilitiesCache;
+/**Serves requests until the FastCGI connection is closed. Each calling thread uses its own map renderer, the
+  configuration and layer caches lend their entries to one request at a time. fcgiRequest is 0 for the single threaded server*/
+void serveRequests( FCGX_Request* fcgiRequest, QgsCapabilitiesCache& capabilitiesCache, const QString& defaultConfigFilePath )
+{
+  QgsMSUtils::setThreadRequest( fcgiRequest );
 
   //creating QgsMapRenderer is expensive (access to srs.db), so we do it here before the fcgi loop
   QgsMapRenderer* theMapRenderer = new QgsMapRenderer();
   theMapRenderer->setLabelingEngine( new QgsPalLabeling() );
 
-#ifdef QGSMSDEBUG
-  // load standard test font from testdata.qrc (for unit tests)
-  bool testFontLoaded = false;
-  QFile testFont( ":/testdata/font/FreeSansQGIS.ttf" );
-  if ( testFont.open( QIODevice::ReadOnly ) )
+  while ( acceptRequest( fcgiRequest ) >= 0 )
   {
-    int fontID = QFontDatabase::addApplicationFontFromData( testFont.readAll() );
-    testFontLoaded = ( fontID != -1 );
-  } // else app wasn't built with ENABLE_TESTS or not GUI app
-#endif
+    //make the configurations and layers of the previous request available to the other threads
+    QgsConfigCache::instance()->releaseConfigurations();
+    QgsMSLayerCache::instance()->releaseLayers();
 
-  while ( fcgi_accept() >= 0 )
-  {
+    QCoreApplication::processEvents(); //get updates from the file system watchers
     printRequestInfos(); //print request infos if in debug mode
 #ifdef QGSMSDEBUG
     QgsDebugMsg( QString( "Test font %1 loaded from testdata.qrc" ).arg( testFontLoaded ? "" : "NOT " ) );
@@ -267,7 +264,7 @@ int main( int argc, char * argv[] )
 
     //use QgsGetRequestHandler in case of HTTP GET and QgsSOAPRequestHandler in case of HTTP POST
     QgsRequestHandler* theRequestHandler = 0;
-    char* requestMethod = getenv( "REQUEST_METHOD" );
+    const char* requestMethod = QgsMSUtils::requestVariable( "REQUEST_METHOD" );
     if ( requestMethod != NULL )
     {
       if ( strcmp( requestMethod, "POST" ) == 0 )
@@ -306,7 +303,12 @@ int main( int argc, char * argv[] )
     //set admin config file to wms server object
     QString configFilePath( defaultConfigFilePath );
 
-    QString projectFile = getenv( "QGIS_PROJECT_FILE" );
+    //QGIS_PROJECT_FILE may be passed with the request or set in the server process environment
+    QString projectFile = QgsMSUtils::requestVariable( "QGIS_PROJECT_FILE" );
+    if ( projectFile.isEmpty() )
+    {
+      projectFile = getenv( "QGIS_PROJECT_FILE" );
+    }
     if ( !projectFile.isEmpty() )
     {
       configFilePath = projectFile;
@@ -554,7 +556,11 @@ int main( int argc, char * argv[] )
         continue;
       }
 
-      return 0;
+      //unknown WFS request
+      theRequestHandler->sendServiceException( QgsMapServiceException( "OperationNotSupported", "Operation " + request + " not supported" ) );
+      delete theRequestHandler;
+      delete theServer;
+      continue;
     }
 
     try
@@ -592,14 +598,13 @@ int main( int argc, char * argv[] )
 
     if ( request.compare( "GetCapabilities", Qt::CaseInsensitive ) == 0 || getProjectSettings )
     {
-      const QDomDocument* capabilitiesDocument = capabilitiesCache.searchCapabilitiesDocument( configFilePath, getProjectSettings ? "projectSettings" : version );
-      if ( !capabilitiesDocument ) //capabilities xml not in cache. Create a new one
+      QDomDocument capabilitiesDocument = capabilitiesCache.searchCapabilitiesDocument( configFilePath, getProjectSettings ? "projectSettings" : version );
+      if ( capabilitiesDocument.isNull() ) //capabilities xml not in cache. Create a new one
       {
         QgsDebugMsg( "Capabilities document not found in cache" );
-        QDomDocument doc;
         try
         {
-          doc = theServer->getCapabilities( version, getProjectSettings );
+          capabilitiesDocument = theServer->getCapabilities( version, getProjectSettings );
         }
         catch ( QgsMapServiceException& ex )
         {
@@ -608,18 +613,14 @@ int main( int argc, char * argv[] )
           delete theServer;
           continue;
         }
-        capabilitiesCache.insertCapabilitiesDocument( configFilePath, getProjectSettings ? "projectSettings" : version, &doc );
-        capabilitiesDocument = capabilitiesCache.searchCapabilitiesDocument( configFilePath, getProjectSettings ? "projectSettings" : version );
+        capabilitiesCache.insertCapabilitiesDocument( configFilePath, getProjectSettings ? "projectSettings" : version, &capabilitiesDocument );
       }
       else
       {
         QgsDebugMsg( "Found capabilities document in cache" );
       }
 
-      if ( capabilitiesDocument )
-      {
-        theRequestHandler->sendGetCapabilitiesResponse( *capabilitiesDocument );
-      }
+      theRequestHandler->sendGetCapabilitiesResponse( capabilitiesDocument );
       delete theRequestHandler;
       delete theServer;
       continue;
@@ -800,7 +801,175 @@ int main( int argc, char * argv[] )
     }
   }
 
+
+  QgsConfigCache::instance()->releaseConfigurations();
+  QgsMSLayerCache::instance()->releaseLayers();
+
+  if ( fcgiRequest )
+  {
+    FCGX_Finish_r( fcgiRequest );
+  }
   delete theMapRenderer;
+}
+
+/**Request handling thread of the multi threaded server (see QGIS_SERVER_THREADS)*/
+class QgsRequestThread: public QThread
+{
+  public:
+    QgsRequestThread( QgsCapabilitiesCache& capabilitiesCache, const QString& defaultConfigFilePath )
+        : mCapabilitiesCache( capabilitiesCache ), mDefaultConfigFilePath( defaultConfigFilePath ) {}
+
+  protected:
+    void run()
+    {
+      FCGX_Request request;
+      FCGX_InitRequest( &request, 0, 0 );
+      serveRequests( &request, mCapabilitiesCache, mDefaultConfigFilePath );
+    }
+
+  private:
+    QgsCapabilitiesCache& mCapabilitiesCache;
+    QString mDefaultConfigFilePath;
+};
+
+int main( int argc, char * argv[] )
+{
+#ifndef _MSC_VER
+  qInstallMsgHandler( dummyMessageHandler );
+#endif
+
+  QgsApplication qgsapp( argc, argv, getenv( "DISPLAY" ) );
+
+  //Default prefix path may be altered by environment variable
+  char* prefixPath = getenv( "QGIS_PREFIX_PATH" );
+  if ( prefixPath )
+  {
+    QgsApplication::setPrefixPath( prefixPath, TRUE );
+  }
+#if !defined(Q_OS_WIN)
+  else
+  {
+    // init QGIS's paths - true means that all path will be inited from prefix
+    QgsApplication::setPrefixPath( CMAKE_INSTALL_PREFIX, TRUE );
+  }
+#endif
+
+#if defined(MAPSERVER_SKIP_ECW)
+  QgsDebugMsg( "Skipping GDAL ECW drivers in server." );
+  QgsApplication::skipGdalDriver( "ECW" );
+  QgsApplication::skipGdalDriver( "JP2ECW" );
+#endif
+
+  QSettings settings;
+
+  QgsNetworkAccessManager *nam = QgsNetworkAccessManager::instance();
+  QNetworkDiskCache *cache = new QNetworkDiskCache( 0 );
+
+  QString cacheDirectory = settings.value( "cache/directory", QgsApplication::qgisSettingsDirPath() + "cache" ).toString();
+  qint64 cacheSize = settings.value( "cache/size", 50 * 1024 * 1024 ).toULongLong();
+  QgsDebugMsg( QString( "setCacheDirectory: %1" ).arg( cacheDirectory ) );
+  QgsDebugMsg( QString( "setMaximumCacheSize: %1" ).arg( cacheSize ) );
+  cache->setCacheDirectory( cacheDirectory );
+  cache->setMaximumCacheSize( cacheSize );
+  QgsDebugMsg( QString( "cacheDirectory: %1" ).arg( cache->cacheDirectory() ) );
+  QgsDebugMsg( QString( "maximumCacheSize: %1" ).arg( cache->maximumCacheSize() ) );
+
+  nam->setCache( cache );
+
+  QDomImplementation::setInvalidDataPolicy( QDomImplementation::DropInvalidChars );
+
+  // Instantiate the plugin directory so that providers are loaded
+  QgsProviderRegistry::instance( QgsApplication::pluginPath() );
+  QgsDebugMsg( "Prefix  PATH: " + QgsApplication::prefixPath() );
+  QgsDebugMsg( "Plugin  PATH: " + QgsApplication::pluginPath() );
+  QgsDebugMsg( "PkgData PATH: " + QgsApplication::pkgDataPath() );
+  QgsDebugMsg( "User DB PATH: " + QgsApplication::qgisUserDbFilePath() );
+
+  QgsDebugMsg( qgsapp.applicationDirPath() + "/qgis_wms_server.log" );
+  QgsApplication::createDB(); //init qgis.db (e.g. necessary for user crs)
+
+  //create config cache and search for config files in the current directory.
+  //These configurations are used if no mapfile parameter is present in the request
+  QString defaultConfigFilePath;
+  QFileInfo projectFileInfo = defaultProjectFile(); //try to find a .qgs file in the server directory
+  if ( projectFileInfo.exists() )
+  {
+    defaultConfigFilePath = projectFileInfo.absoluteFilePath();
+    QgsDebugMsg( "Using default project file: " + defaultConfigFilePath );
+  }
+  else
+  {
+    QFileInfo adminSLDFileInfo = defaultAdminSLD();
+    if ( adminSLDFileInfo.exists() )
+    {
+      defaultConfigFilePath = adminSLDFileInfo.absoluteFilePath();
+    }
+  }
+
+  //create cache for capabilities XML
+  QgsCapabilitiesCache capabilitiesCache;
+
+  //the configuration and layer caches are created in the main thread, which dispatches their file system watcher events
+  QgsConfigCache::instance();
+  QgsMSLayerCache::instance();
+
+#ifdef QGSMSDEBUG
+  // load standard test font from testdata.qrc (for unit tests)
+  QFile testFont( ":/testdata/font/FreeSansQGIS.ttf" );
+  if ( testFont.open( QIODevice::ReadOnly ) )
+  {
+    int fontID = QFontDatabase::addApplicationFontFromData( testFont.readAll() );
+    testFontLoaded = ( fontID != -1 );
+  } // else app wasn't built with ENABLE_TESTS or not GUI app
+#endif
+
+  //number of request handling threads. Only available for FastCGI, CGI processes serve exactly one request
+  int nThreads = 1;
+  char* threadsEnv = getenv( "QGIS_SERVER_THREADS" );
+  if ( threadsEnv && !FCGX_IsCGI() )
+  {
+    nThreads = qMax( 1, QString( threadsEnv ).toInt() );
+  }
+
+  if ( nThreads > 1 )
+  {
+    QgsDebugMsg( QString( "Serving requests with %1 threads" ).arg( nThreads ) );
+    FCGX_Init();
+    QgsMapLayerRegistry::setThreadLocalInstances( true );
+
+    QList<QgsRequestThread*> threads;
+    for ( int i = 0; i < nThreads; ++i )
+    {
+      QgsRequestThread* thread = new QgsRequestThread( capabilitiesCache, defaultConfigFilePath );
+      QObject::connect( thread, SIGNAL( finished() ), &qgsapp, SLOT( quit() ) );
+      threads << thread;
+      thread->start();
+    }
+
+    //the main thread only dispatches events (e.g. file system watchers of the caches)
+    qgsapp.exec();
+
+    //the threads waiting for connections never return from FCGX_Accept_r by themselves
+    foreach ( QgsRequestThread* thread, threads )
+    {
+      while ( !thread->wait( 100 ) )
+      {
+        if ( !shutdownRequestThreads() )
+        {
+          break;
+        }
+      }
+      if ( thread->isFinished() )
+      {
+        delete thread;
+      }
+    }
+  }
+  else
+  {
+    serveRequests( 0, capabilitiesCache, defaultConfigFilePath );
+  }
+
   QgsDebugMsg( "************* all done ***************" );
   return 0;
 }
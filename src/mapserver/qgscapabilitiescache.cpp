@@ -18,6 +18,7 @@
 #include "qgscapabilitiescache.h"
 #include "qgslogger.h"
 #include <QCoreApplication>
+#include <QMutexLocker>
 
 QgsCapabilitiesCache::QgsCapabilitiesCache()
 {
@@ -28,42 +29,60 @@ QgsCapabilitiesCache::~QgsCapabilitiesCache()
 {
 }
 
-const QDomDocument* QgsCapabilitiesCache::searchCapabilitiesDocument( QString configFilePath, QString version )
+QDomDocument QgsCapabilitiesCache::searchCapabilitiesDocument( QString configFilePath, QString version )
 {
   QCoreApplication::processEvents(); //get updates from file system watcher
 
+  QMutexLocker locker( &mMutex );
   if ( mCachedCapabilities.contains( configFilePath ) && mCachedCapabilities[ configFilePath ].contains( version ) )
   {
-    return &mCachedCapabilities[configFilePath][version];
+    //deep copy, DOM trees must not be shared between threads
+    return mCachedCapabilities[configFilePath][version].cloneNode().toDocument();
   }
   else
   {
-    return 0;
+    return QDomDocument();
   }
 }
 
 void QgsCapabilitiesCache::insertCapabilitiesDocument( QString configFilePath, QString version, const QDomDocument* doc )
 {
+  QDomDocument docCopy = doc->cloneNode().toDocument();
+
+  QMutexLocker locker( &mMutex );
   if ( mCachedCapabilities.size() > 40 )
   {
     //remove another cache entry to avoid memory problems
     QHash<QString, QHash<QString, QDomDocument> >::iterator capIt = mCachedCapabilities.begin();
-    mFileSystemWatcher.removePath( capIt.key() );
+    QMetaObject::invokeMethod( this, "watchFile", Q_ARG( QString, capIt.key() ), Q_ARG( bool, false ) );
     mCachedCapabilities.erase( capIt );
   }
 
   if ( !mCachedCapabilities.contains( configFilePath ) )
   {
-    mFileSystemWatcher.addPath( configFilePath );
+    QMetaObject::invokeMethod( this, "watchFile", Q_ARG( QString, configFilePath ), Q_ARG( bool, true ) );
     mCachedCapabilities.insert( configFilePath, QHash<QString, QDomDocument>() );
   }
 
-  mCachedCapabilities[ configFilePath ].insert( version, doc->cloneNode().toDocument() );
+  mCachedCapabilities[ configFilePath ].insert( version, docCopy );
 }
 
 void QgsCapabilitiesCache::removeChangedEntry( const QString& path )
 {
   QgsDebugMsg( "Remove capabilities cache entry because file changed" );
+  QMutexLocker locker( &mMutex );
   mCachedCapabilities.remove( path );
   mFileSystemWatcher.removePath( path );
 }
+
+void QgsCapabilitiesCache::watchFile( const QString& path, bool watch )
+{
+  if ( watch )
+  {
+    mFileSystemWatcher.addPath( path );
+  }
+  else
+  {
+    mFileSystemWatcher.removePath( path );
+  }
+}
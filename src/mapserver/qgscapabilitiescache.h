@@ -21,9 +21,11 @@
 #include <QDomDocument>
 #include <QFileSystemWatcher>
 #include <QHash>
+#include <QMutex>
 #include <QObject>
 
-/**A cache for capabilities xml documents (by configuration file path)*/
+/**A cache for capabilities xml documents (by configuration file path).
+  The cache is shared between request threads, all methods are thread safe*/
 class QgsCapabilitiesCache: public QObject
 {
     Q_OBJECT
@@ -31,18 +33,23 @@ class QgsCapabilitiesCache: public QObject
     QgsCapabilitiesCache();
     ~QgsCapabilitiesCache();
 
-    /**Returns cached capabilities document (or 0 if document for configuration file not in cache)*/
-    const QDomDocument* searchCapabilitiesDocument( QString configFilePath, QString version );
+    /**Returns a copy of the cached capabilities document (or a null document if document for configuration file not in cache)*/
+    QDomDocument searchCapabilitiesDocument( QString configFilePath, QString version );
     /**Inserts new capabilities document (creates a copy of the document, does not take ownership)*/
     void insertCapabilitiesDocument( QString configFilePath, QString version, const QDomDocument* doc );
 
   private:
     QHash< QString, QHash< QString, QDomDocument > > mCachedCapabilities;
     QFileSystemWatcher mFileSystemWatcher;
+    /**Protects the cached documents against concurrent access from request threads*/
+    QMutex mMutex;
 
   private slots:
     /**Removes changed entry from this cache*/
     void removeChangedEntry( const QString &path );
+    /**Adds or removes a path to / from the file system watcher. Called queued if invoked from another thread
+      because QFileSystemWatcher must only be used from the thread owning the cache*/
+    void watchFile( const QString &path, bool watch );
 };
 
 #endif // QGSCAPABILITIESCACHE_H
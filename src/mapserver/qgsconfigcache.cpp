@@ -22,6 +22,8 @@
 #include "qgsprojectparser.h"
 #include "qgssldparser.h"
 #include <QCoreApplication>
+#include <QMutexLocker>
+#include <QThread>
 
 
 QgsConfigCache* QgsConfigCache::instance()
@@ -37,16 +39,41 @@ QgsConfigCache::QgsConfigCache()
 
 QgsConfigCache::~QgsConfigCache()
 {
-  foreach ( QgsConfigParser *parser, mCachedConfigurations.values() )
+  foreach ( QgsConfigCacheEntry entry, mCachedConfigurations.values() + mChangedConfigurations )
   {
-    delete parser;
+    delete entry.parser;
   }
 }
 
 QgsConfigParser* QgsConfigCache::searchConfiguration( const QString& filePath )
 {
   QCoreApplication::processEvents(); //check for updates from file system watcher
-  QgsConfigParser* p = mCachedConfigurations.value( filePath, 0 );
+
+  QThread* thread = QThread::currentThread();
+  QgsConfigParser* p = 0;
+
+  mMutex.lock();
+  //the parser already used in this request or an unused one
+  QMultiHash<QString, QgsConfigCacheEntry>::iterator unusedIt = mCachedConfigurations.end();
+  QMultiHash<QString, QgsConfigCacheEntry>::iterator configIt = mCachedConfigurations.find( filePath );
+  for ( ; configIt != mCachedConfigurations.end() && configIt.key() == filePath; ++configIt )
+  {
+    if ( configIt.value().thread == thread )
+    {
+      p = configIt.value().parser;
+      break;
+    }
+    if ( !configIt.value().thread && unusedIt == mCachedConfigurations.end() )
+    {
+      unusedIt = configIt;
+    }
+  }
+  if ( !p && unusedIt != mCachedConfigurations.end() )
+  {
+    unusedIt.value().thread = thread;
+    p = unusedIt.value().parser;
+  }
+  mMutex.unlock();
 
   if ( p )
   {
@@ -67,20 +94,37 @@ QgsConfigParser* QgsConfigCache::searchConfiguration( const QString& filePath )
   return p;
 }
 
-QgsConfigParser* QgsConfigCache::insertConfiguration( const QString& filePath )
+void QgsConfigCache::releaseConfigurations()
 {
-  if ( mCachedConfigurations.size() > 40 )
+  QThread* thread = QThread::currentThread();
+  QMutexLocker locker( &mMutex );
+
+  QMultiHash<QString, QgsConfigCacheEntry>::iterator configIt = mCachedConfigurations.begin();
+  for ( ; configIt != mCachedConfigurations.end(); ++configIt )
   {
-    //remove a cache entry to avoid memory problems
-    QHash<QString, QgsConfigParser*>::iterator configIt = mCachedConfigurations.begin();
-    if ( configIt != mCachedConfigurations.end() )
+    if ( configIt.value().thread == thread )
     {
-      mFileSystemWatcher.removePath( configIt.key() );
-      delete configIt.value();
-      mCachedConfigurations.erase( configIt );
+      configIt.value().thread = 0;
     }
   }
 
+  QList<QgsConfigCacheEntry>::iterator changedIt = mChangedConfigurations.begin();
+  while ( changedIt != mChangedConfigurations.end() )
+  {
+    if ( changedIt->thread == thread )
+    {
+      delete changedIt->parser;
+      changedIt = mChangedConfigurations.erase( changedIt );
+    }
+    else
+    {
+      ++changedIt;
+    }
+  }
+}
+
+QgsConfigParser* QgsConfigCache::insertConfiguration( const QString& filePath )
+{
   //first open file
   QFile* configFile = new QFile( filePath );
   if ( !configFile->exists() || !configFile->open( QIODevice::ReadOnly ) )
@@ -124,20 +168,68 @@ QgsConfigParser* QgsConfigCache::insertConfiguration( const QString& filePath )
     return 0;
   }
 
-  mCachedConfigurations.insert( filePath, configParser );
-  mFileSystemWatcher.addPath( filePath );
   delete configFile;
+
+  QMutexLocker locker( &mMutex );
+  if ( mCachedConfigurations.size() > 40 )
+  {
+    //remove an unused cache entry to avoid memory problems
+    QMultiHash<QString, QgsConfigCacheEntry>::iterator configIt = mCachedConfigurations.begin();
+    for ( ; configIt != mCachedConfigurations.end(); ++configIt )
+    {
+      if ( !configIt.value().thread )
+      {
+        QString path = configIt.key();
+        delete configIt.value().parser;
+        mCachedConfigurations.erase( configIt );
+        if ( !mCachedConfigurations.contains( path ) )
+        {
+          QMetaObject::invokeMethod( this, "watchFile", Q_ARG( QString, path ), Q_ARG( bool, false ) );
+        }
+        break;
+      }
+    }
+  }
+
+  if ( !mCachedConfigurations.contains( filePath ) )
+  {
+    QMetaObject::invokeMethod( this, "watchFile", Q_ARG( QString, filePath ), Q_ARG( bool, true ) );
+  }
+  QgsConfigCacheEntry entry;
+  entry.parser = configParser;
+  entry.thread = QThread::currentThread();
+  mCachedConfigurations.insertMulti( filePath, entry );
   return configParser;
 }
 
 void QgsConfigCache::removeChangedEntry( const QString& path )
 {
   QgsDebugMsg( "Remove config cache entry because file changed" );
-  QHash<QString, QgsConfigParser*>::iterator configIt = mCachedConfigurations.find( path );
-  if ( configIt != mCachedConfigurations.end() )
+  QMutexLocker locker( &mMutex );
+  foreach ( QgsConfigCacheEntry entry, mCachedConfigurations.values( path ) )
   {
-    delete configIt.value();
-    mCachedConfigurations.erase( configIt );
+    if ( entry.thread )
+    {
+      //still used by a request, deleted when released
+      mChangedConfigurations.append( entry );
+    }
+    else
+    {
+      delete entry.parser;
+    }
   }
+  mCachedConfigurations.remove( path );
   mFileSystemWatcher.removePath( path );
 }
+
+void QgsConfigCache::watchFile( const QString& path, bool watch )
+{
+  if ( watch )
+  {
+    mFileSystemWatcher.addPath( path );
+  }
+  else
+  {
+    mFileSystemWatcher.removePath( path );
+  }
+}
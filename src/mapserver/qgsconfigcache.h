@@ -20,12 +20,24 @@
 
 #include <QFileSystemWatcher>
 #include <QHash>
+#include <QList>
+#include <QMutex>
 #include <QObject>
 #include <QString>
 
 class QgsConfigParser;
+class QThread;
 
-/**A cache for configuration XML (useful because of the mapfile parameter)*/
+struct QgsConfigCacheEntry
+{
+  QgsConfigParser* parser;
+  QThread* thread; //request thread using the parser, 0 if it is not in use
+};
+
+/**A cache for configuration XML (useful because of the mapfile parameter).
+  The cache is shared between request threads. Config parsers keep per-request state (parameter map,
+  temporary layers), so a parser is lent to one request thread at a time. Another parser for the same
+  file is only created if all cached ones are in use*/
 class QgsConfigCache: public QObject
 {
     Q_OBJECT
@@ -33,27 +45,37 @@ class QgsConfigCache: public QObject
     static QgsConfigCache* instance();
     ~QgsConfigCache();
 
-    /**Returns configuration for given config file path. The calling function does _not_ take ownership*/
+    /**Returns configuration for given config file path. The calling function does _not_ take ownership.
+      The configuration is reserved for the calling thread until it calls releaseConfigurations()*/
     QgsConfigParser* searchConfiguration( const QString& filePath );
 
+    /**Makes the configurations used by the calling thread available to other threads (at the end of a request)*/
+    void releaseConfigurations();
+
   protected:
     QgsConfigCache();
 
   private:
-    static QgsConfigCache* mInstance;
-
     /**Creates configuration parser depending on the file type and, if successfull, inserts it to the cached configuration map
         @param filePath path of the configuration file
         @return the inserted config parser or 0 in case of error*/
     QgsConfigParser* insertConfiguration( const QString& filePath );
-    /**Cached XML configuration documents. Key: file path, value: config parser. Default configuration has key '$default$'*/
-    QHash<QString, QgsConfigParser*> mCachedConfigurations;
+    /**Cached XML configuration documents. Key: file path, value: config parser. Default configuration has key '$default$'.
+      There may be several parsers for the same file if it is used by concurrent requests*/
+    QMultiHash<QString, QgsConfigCacheEntry> mCachedConfigurations;
+    /**Parsers of changed files which were in use when the file changed. Deleted when they are released*/
+    QList<QgsConfigCacheEntry> mChangedConfigurations;
     /**Check for configuration file updates (remove entry from cache if file changes)*/
     QFileSystemWatcher mFileSystemWatcher;
+    /**Protects the cache against concurrent access from request threads*/
+    QMutex mMutex;
 
   private slots:
     /**Removes changed entry from this cache*/
     void removeChangedEntry( const QString& path );
+    /**Adds or removes a path to / from the file system watcher. Called queued if invoked from another thread
+      because QFileSystemWatcher must only be used from the thread owning the cache*/
+    void watchFile( const QString &path, bool watch );
 };
 
 #endif // QGSCONFIGCACHE_H
@@ -14,6 +14,7 @@
  ***************************************************************************/
 #include "qgsgetrequesthandler.h"
 #include "qgslogger.h"
+#include "qgsmsutils.h"
 #include "qgsremotedatasourcebuilder.h"
 #include <QStringList>
 #include <QUrl>
@@ -29,7 +30,7 @@ QMap<QString, QString> QgsGetRequestHandler::parseInput()
   QString queryString;
   QMap<QString, QString> parameters;
 
-  const char* qs = getenv( "QUERY_STRING" );
+  const char* qs = QgsMSUtils::requestVariable( "QUERY_STRING" );
   if ( qs )
   {
     queryString = QString( qs );
@@ -20,6 +20,7 @@
 #include "qgshttptransaction.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsmsutils.h"
 #include <QBuffer>
 #include <QByteArray>
 #include <QDomDocument>
@@ -28,7 +29,6 @@
 #include <QTextStream>
 #include <QStringList>
 #include <QUrl>
-#include <fcgi_stdio.h>
 
 QgsHttpRequestHandler::QgsHttpRequestHandler(): QgsRequestHandler()
 {
@@ -56,12 +56,10 @@ void QgsHttpRequestHandler::sendHttpResponse( QByteArray* ba, const QString& for
   QgsDebugMsg( "Byte array looks good, returning response..." );
   QgsDebugMsg( QString( "Content size: %1" ).arg( ba->size() ) );
   QgsDebugMsg( QString( "Content format: %1" ).arg( format ) );
-  printf( "Content-Type: " );
-  printf( format.toLocal8Bit() );
-  printf( "\n" );
-  printf( "Content-Length: %d\n", ba->size() );
-  printf( "\n" );
-  size_t result = fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
+  QgsMSUtils::writeResponse( "Content-Type: " + format.toLocal8Bit() + "\n" );
+  QgsMSUtils::writeResponse( QString( "Content-Length: %1\n" ).arg( ba->size() ).toLocal8Bit() );
+  QgsMSUtils::writeResponse( "\n" );
+  int result = QgsMSUtils::writeResponse( *ba );
 #ifdef QGISDEBUG
   QgsDebugMsg( QString( "Sent %1 bytes" ).arg( result ) );
 #else
@@ -354,11 +352,9 @@ bool QgsHttpRequestHandler::startGetFeatureResponse( QByteArray* ba, const QStri
   else
     format = "text/xml";
 
-  printf( "Content-Type: " );
-  printf( format.toLocal8Bit() );
-  printf( "\n" );
-  printf( "\n" );
-  fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
+  QgsMSUtils::writeResponse( "Content-Type: " + format.toLocal8Bit() + "\n" );
+  QgsMSUtils::writeResponse( "\n" );
+  QgsMSUtils::writeResponse( *ba );
   return true;
 }
 
@@ -373,7 +369,7 @@ void QgsHttpRequestHandler::sendGetFeatureResponse( QByteArray* ba ) const
   {
     return;
   }
-  fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
+  QgsMSUtils::writeResponse( *ba );
 }
 
 void QgsHttpRequestHandler::endGetFeatureResponse( QByteArray* ba ) const
@@ -383,7 +379,7 @@ void QgsHttpRequestHandler::endGetFeatureResponse( QByteArray* ba ) const
     return;
   }
 
-  fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
+  QgsMSUtils::writeResponse( *ba );
 }
 
 void QgsHttpRequestHandler::sendGetCoverageResponse( QByteArray* ba ) const
@@ -486,13 +482,13 @@ void QgsHttpRequestHandler::requestStringToParameterMap( const QString& request,
 
 QString QgsHttpRequestHandler::readPostBody() const
 {
-  char* lengthString = NULL;
+  const char* lengthString = NULL;
   int length = 0;
   char* input = NULL;
   QString inputString;
   QString lengthQString;
 
-  lengthString = getenv( "CONTENT_LENGTH" );
+  lengthString = QgsMSUtils::requestVariable( "CONTENT_LENGTH" );
   if ( lengthString != NULL )
   {
     bool conversionSuccess = false;
@@ -505,7 +501,7 @@ QString QgsHttpRequestHandler::readPostBody() const
       memset( input, 0, length + 1 );
       for ( int i = 0; i < length; ++i )
       {
-        input[i] = getchar();
+        input[i] = QgsMSUtils::readRequestChar();
       }
       //fgets(input, length+1, stdin);
       if ( input != NULL )
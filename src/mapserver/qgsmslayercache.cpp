@@ -19,6 +19,8 @@
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
 #include <QFile>
+#include <QMutexLocker>
+#include <QThread>
 
 QgsMSLayerCache* QgsMSLayerCache::instance()
 {
@@ -29,6 +31,7 @@ QgsMSLayerCache* QgsMSLayerCache::instance()
 QgsMSLayerCache::QgsMSLayerCache()
 {
   mDefaultMaxLayers = 100;
+  mProjectMaxLayers = 0;
   //max layer from environment variable overrides default
   char* maxLayerEnv = getenv( "MAX_CACHE_LAYERS" );
   if ( maxLayerEnv )
@@ -46,7 +49,7 @@ QgsMSLayerCache::QgsMSLayerCache()
 QgsMSLayerCache::~QgsMSLayerCache()
 {
   QgsDebugMsg( "removing all entries" );
-  foreach ( QgsMSLayerCacheEntry entry, mEntries )
+  foreach ( QgsMSLayerCacheEntry entry, mEntries.values() + mRemovedEntries )
   {
     delete entry.layerPointer;
   }
@@ -55,16 +58,25 @@ QgsMSLayerCache::~QgsMSLayerCache()
 void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName, QgsMapLayer* layer, const QString& configFile, const QList<QString>& tempFiles )
 {
   QgsDebugMsg( "inserting layer" );
+  QThread* thread = QThread::currentThread();
+  QMutexLocker locker( &mMutex );
+
   if ( mEntries.size() > std::max( mDefaultMaxLayers, mProjectMaxLayers ) ) //force cache layer examination after 10 inserted layers
   {
     updateEntries();
   }
 
+  //replace the layer this thread uses for the key
   QPair<QString, QString> urlLayerPair = qMakePair( url, layerName );
-  QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator it = mEntries.find( urlLayerPair );
-  if ( it != mEntries.end() )
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator it = mEntries.find( urlLayerPair );
+  for ( ; it != mEntries.end() && it.key() == urlLayerPair; ++it )
   {
-    delete it.value().layerPointer;
+    if ( it.value().thread == thread )
+    {
+      freeEntryRessources( it.value() );
+      mEntries.erase( it );
+      break;
+    }
   }
 
   QgsMSLayerCacheEntry newEntry;
@@ -74,8 +86,9 @@ void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName,
   newEntry.lastUsedTime = time( NULL );
   newEntry.temporaryFiles = tempFiles;
   newEntry.configFile = configFile;
+  newEntry.thread = thread;
 
-  mEntries.insert( urlLayerPair, newEntry );
+  mEntries.insertMulti( urlLayerPair, newEntry );
 
   //update config file map
   if ( !configFile.isEmpty() )
@@ -84,7 +97,7 @@ void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName,
     if ( configIt == mConfigFiles.end() )
     {
       mConfigFiles.insert( configFile, 1 );
-      mFileSystemWatcher.addPath( configFile );
+      QMetaObject::invokeMethod( this, "watchFile", Q_ARG( QString, configFile ), Q_ARG( bool, true ) );
     }
     else
     {
@@ -95,39 +108,100 @@ void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName,
 
 QgsMapLayer* QgsMSLayerCache::searchLayer( const QString& url, const QString& layerName )
 {
+  QThread* thread = QThread::currentThread();
+  QMutexLocker locker( &mMutex );
+
+  //the layer already used in this request or an unused one
   QPair<QString, QString> urlNamePair = qMakePair( url, layerName );
-  if ( !mEntries.contains( urlNamePair ) )
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator unusedIt = mEntries.end();
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator it = mEntries.find( urlNamePair );
+  for ( ; it != mEntries.end() && it.key() == urlNamePair; ++it )
+  {
+    if ( it.value().thread == thread )
+    {
+      unusedIt = it;
+      break;
+    }
+    if ( !it.value().thread && unusedIt == mEntries.end() )
+    {
+      unusedIt = it;
+    }
+  }
+
+  if ( unusedIt == mEntries.end() )
   {
     QgsDebugMsg( "Layer not found in cache" );
     return 0;
   }
   else
   {
-    QgsMSLayerCacheEntry &entry = mEntries[ urlNamePair ];
+    QgsMSLayerCacheEntry &entry = unusedIt.value();
     entry.lastUsedTime = time( NULL );
+    entry.thread = thread;
     QgsDebugMsg( "Layer found in cache" );
     return entry.layerPointer;
   }
 }
 
-void QgsMSLayerCache::removeProjectFileLayers( const QString& project )
+void QgsMSLayerCache::releaseLayers()
 {
-  QList< QPair< QString, QString > > removeEntries;
+  QThread* thread = QThread::currentThread();
+  QMutexLocker locker( &mMutex );
 
-  QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator entryIt = mEntries.begin();
-  for ( ; entryIt != mEntries.end(); ++entryIt )
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator it = mEntries.begin();
+  for ( ; it != mEntries.end(); ++it )
   {
-    if ( entryIt.value().configFile == project )
+    if ( it.value().thread == thread )
     {
-      removeEntries.push_back( entryIt.key() );
-      freeEntryRessources( entryIt.value() );
+      it.value().thread = 0;
     }
   }
 
-  QList< QPair< QString, QString > >::const_iterator removeIt = removeEntries.constBegin();
-  for ( ; removeIt != removeEntries.constEnd(); ++removeIt )
+  QList<QgsMSLayerCacheEntry>::iterator removedIt = mRemovedEntries.begin();
+  while ( removedIt != mRemovedEntries.end() )
   {
-    mEntries.remove( *removeIt );
+    if ( removedIt->thread == thread )
+    {
+      freeEntryRessources( *removedIt );
+      removedIt = mRemovedEntries.erase( removedIt );
+    }
+    else
+    {
+      ++removedIt;
+    }
+  }
+}
+
+void QgsMSLayerCache::setProjectMaxLayers( int n )
+{
+  QMutexLocker locker( &mMutex );
+  mProjectMaxLayers = n;
+}
+
+void QgsMSLayerCache::removeProjectFileLayers( const QString& project )
+{
+  QMutexLocker locker( &mMutex );
+
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator entryIt = mEntries.begin();
+  while ( entryIt != mEntries.end() )
+  {
+    if ( entryIt.value().configFile == project )
+    {
+      if ( entryIt.value().thread )
+      {
+        //still used by a request, freed when released
+        mRemovedEntries.append( entryIt.value() );
+      }
+      else
+      {
+        freeEntryRessources( entryIt.value() );
+      }
+      entryIt = mEntries.erase( entryIt );
+    }
+    else
+    {
+      ++entryIt;
+    }
   }
 }
 
@@ -148,25 +222,24 @@ void QgsMSLayerCache::updateEntries()
 
 void QgsMSLayerCache::removeLeastUsedEntry()
 {
-
-  if ( mEntries.size() < 1 )
-  {
-    return;
-  }
+  //layers in use by a request are not removed
   QgsDebugMsg( "removeLeastUsedEntry" );
-  QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator it = mEntries.begin();
-  QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator lowest_it = it;
-  time_t lowest_time = it->lastUsedTime;
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator it = mEntries.begin();
+  QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator lowest_it = mEntries.end();
 
   for ( ; it != mEntries.end(); ++it )
   {
-    if ( it->lastUsedTime < lowest_time )
+    if ( !it->thread && ( lowest_it == mEntries.end() || it->lastUsedTime < lowest_it->lastUsedTime ) )
     {
       lowest_it = it;
-      lowest_time = it->lastUsedTime;
     }
   }
 
+  if ( lowest_it == mEntries.end() )
+  {
+    return;
+  }
+
   freeEntryRessources( *lowest_it );
   mEntries.erase( lowest_it );
 }
@@ -194,7 +267,7 @@ void QgsMSLayerCache::freeEntryRessources( QgsMSLayerCacheEntry& entry )
     if ( configFileCount < 2 )
     {
       mConfigFiles.remove( entry.configFile );
-      mFileSystemWatcher.removePath( entry.configFile );
+      QMetaObject::invokeMethod( this, "watchFile", Q_ARG( QString, entry.configFile ), Q_ARG( bool, false ) );
     }
     else
     {
@@ -202,3 +275,15 @@ void QgsMSLayerCache::freeEntryRessources( QgsMSLayerCacheEntry& entry )
     }
   }
 }
+
+void QgsMSLayerCache::watchFile( const QString& path, bool watch )
+{
+  if ( watch )
+  {
+    mFileSystemWatcher.addPath( path );
+  }
+  else
+  {
+    mFileSystemWatcher.removePath( path );
+  }
+}
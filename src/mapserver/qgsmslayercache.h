@@ -21,11 +21,14 @@
 #include <time.h>
 #include <QFileSystemWatcher>
 #include <QHash>
+#include <QList>
+#include <QMutex>
 #include <QObject>
 #include <QPair>
 #include <QString>
 
 class QgsMapLayer;
+class QThread;
 
 struct QgsMSLayerCacheEntry
 {
@@ -35,10 +38,13 @@ struct QgsMSLayerCacheEntry
   QgsMapLayer* layerPointer;
   QList<QString> temporaryFiles; //path to the temporary files written for the layer
   QString configFile; //path to the project file associated with the layer
+  QThread* thread; //request thread using the layer, 0 if it is not in use
 };
 
 /**A singleton class that caches layer objects for the
-QGIS mapserver*/
+QGIS mapserver. The cache is shared between request threads. Layers are not thread safe, so
+a layer is lent to one request thread at a time. Another layer for the same datasource is only
+created if the cached ones are in use*/
 class QgsMSLayerCache: public QObject
 {
     Q_OBJECT
@@ -50,15 +56,20 @@ class QgsMSLayerCache: public QObject
     @param url the layer datasource
     @param layerName the layer name (to distinguish between different layers in a request using the same datasource
     @param configFile path of the config file (to invalidate entries if file changes). Can be empty (e.g. layers from sld)
-    @param tempFiles some layers have temporary files. The cash makes sure they are removed when removing the layer from the cash*/
+    @param tempFiles some layers have temporary files. The cash makes sure they are removed when removing the layer from the cash.
+    The layer is reserved for the calling thread until it calls releaseLayers()*/
     void insertLayer( const QString& url, const QString& layerName, QgsMapLayer* layer, const QString& configFile = QString(), const QList<QString>& tempFiles = QList<QString>() );
-    /**Searches for the layer with the given url.
+    /**Searches for the layer with the given url which is not in use by another thread.
+     The layer is reserved for the calling thread until it calls releaseLayers()
      @return a pointer to the layer or 0 if no such layer*/
     QgsMapLayer* searchLayer( const QString& url, const QString& layerName );
 
+    /**Makes the layers used by the calling thread available to other threads (at the end of a request)*/
+    void releaseLayers();
+
     int projectsMaxLayers() const { return mProjectMaxLayers; }
 
-    void setProjectMaxLayers( int n ) { mProjectMaxLayers = n; }
+    void setProjectMaxLayers( int n );
 
   protected:
     /**Protected singleton constructor*/
@@ -75,8 +86,11 @@ class QgsMSLayerCache: public QObject
   private:
     /**Cash entries with pair url/layer name as a key. The layer name is necessary for cases where the same
       url is used several time in a request. It ensures that different layer instances are created for different
-      layer names*/
-    QHash<QPair<QString, QString>, QgsMSLayerCacheEntry> mEntries;
+      layer names. There may be several entries for a key if the layer is used by concurrent requests*/
+    QMultiHash<QPair<QString, QString>, QgsMSLayerCacheEntry> mEntries;
+
+    /**Entries removed while their layer was in use. Freed when the layer is released*/
+    QList<QgsMSLayerCacheEntry> mRemovedEntries;
 
     /**Config files used in the cache (with reference counter)*/
     QHash< QString, int > mConfigFiles;
@@ -90,10 +104,17 @@ class QgsMSLayerCache: public QObject
     /**Maximum number of layers in the cache, overrides DEFAULT_MAX_N_LAYERS if larger*/
     int mProjectMaxLayers;
 
+    /**Protects the cache against concurrent access from request threads*/
+    QMutex mMutex;
+
   private slots:
 
     /**Removes entries from a project (e.g. if a project file has changed)*/
     void removeProjectFileLayers( const QString& project );
+
+    /**Adds or removes a path to / from the file system watcher. Called queued if invoked from another thread
+      because QFileSystemWatcher must only be used from the thread owning the cache*/
+    void watchFile( const QString &path, bool watch );
 };
 
 #endif
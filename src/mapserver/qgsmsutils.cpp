@@ -19,6 +19,22 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QTextStream>
+#include <QThreadStorage>
+
+#include <fcgi_stdio.h>
+
+/**FastCGI request of a request handling thread (QThreadStorage needs a pointer type it may delete)*/
+struct QgsMSThreadRequest
+{
+  FCGX_Request* request;
+};
+
+static QThreadStorage<QgsMSThreadRequest*> sThreadRequest;
+
+static FCGX_Request* threadRequest()
+{
+  return sThreadRequest.hasLocalData() ? sThreadRequest.localData()->request : 0;
+}
 
 QString QgsMSUtils::createTempFilePath()
 {
@@ -82,3 +98,47 @@ int QgsMSUtils::createTextFile( QString filePath, const QString& text )
     return 1;
   }
 }
+
+void QgsMSUtils::setThreadRequest( FCGX_Request* request )
+{
+  if ( !sThreadRequest.hasLocalData() )
+  {
+    sThreadRequest.setLocalData( new QgsMSThreadRequest );
+  }
+  sThreadRequest.localData()->request = request;
+}
+
+const char* QgsMSUtils::requestVariable( const char* name )
+{
+  FCGX_Request* request = threadRequest();
+  if ( request )
+  {
+    return FCGX_GetParam( name, request->envp );
+  }
+  return getenv( name );
+}
+
+int QgsMSUtils::writeResponse( const char* data, int size )
+{
+  FCGX_Request* request = threadRequest();
+  if ( request )
+  {
+    return FCGX_PutStr( data, size, request->out );
+  }
+  return fwrite( data, 1, size, FCGI_stdout );
+}
+
+int QgsMSUtils::writeResponse( const QByteArray& ba )
+{
+  return writeResponse( ba.constData(), ba.size() );
+}
+
+int QgsMSUtils::readRequestChar()
+{
+  FCGX_Request* request = threadRequest();
+  if ( request )
+  {
+    return FCGX_GetChar( request->in );
+  }
+  return getchar();
+}
@@ -15,8 +15,11 @@
 #ifndef QGSMSUTILS_H
 #define QGSMSUTILS_H
 
+#include <QByteArray>
 #include <QString>
 
+struct FCGX_Request;
+
 /**Some utility functions that may be included from everywhere in the code*/
 namespace QgsMSUtils
 {
@@ -26,6 +29,17 @@ namespace QgsMSUtils
   QString createTempFilePath();
   /**Stores the specified text in a temporary file. Returns 0 in case of success*/
   int createTextFile( QString filePath, const QString& text );
+
+  /**Sets the FastCGI request handled by the calling thread. If no request is set (the default),
+     the process wide FastCGI streams and the environment are used*/
+  void setThreadRequest( FCGX_Request* request );
+  /**Returns the CGI variable of the current request or 0 if it is not set*/
+  const char* requestVariable( const char* name );
+  /**Writes data to the output stream of the current request. Returns the number of bytes written*/
+  int writeResponse( const char* data, int size );
+  int writeResponse( const QByteArray& ba );
+  /**Reads the next character from the input stream of the current request (EOF at the end of the stream)*/
+  int readRequestChar();
 }
 
 #endif
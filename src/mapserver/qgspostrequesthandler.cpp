@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include "qgspostrequesthandler.h"
 #include "qgslogger.h"
+#include "qgsmsutils.h"
 #include <QDomDocument>
 
 QgsPostRequestHandler::QgsPostRequestHandler()
@@ -43,7 +44,7 @@ QMap<QString, QString> QgsPostRequestHandler::parseInput()
   else
   {
     QString queryString;
-    const char* qs = getenv( "QUERY_STRING" );
+    const char* qs = QgsMSUtils::requestVariable( "QUERY_STRING" );
     if ( qs )
     {
       queryString = QString( qs );
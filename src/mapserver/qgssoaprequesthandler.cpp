@@ -18,6 +18,7 @@
 #include "qgssoaprequesthandler.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsmsutils.h"
 #include <QBuffer>
 #include <QDir>
 #include <QDomDocument>
@@ -25,7 +26,6 @@
 #include <QImage>
 #include <QTextStream>
 #include <time.h>
-#include <fcgi_stdio.h>
 
 QgsSOAPRequestHandler::QgsSOAPRequestHandler()
 {
@@ -680,32 +680,32 @@ int QgsSOAPRequestHandler::sendSOAPWithAttachments( QImage* img ) const
   img->save( &buffer, mFormat.toLocal8Bit().data(), -1 ); // writes image into ba
 
   QByteArray xmlByteArray = xmlResponse.toString().toLocal8Bit();
-  printf( "MIME-Version: 1.0\n" );
-  printf( "Content-Type: Multipart/Related; boundary=\"MIME_boundary\"; type=\"text/xml\"; start=\"<xml@mapservice>\"\n" );
-  printf( "\n" );
-  printf( "--MIME_boundary\r\n" );
-  printf( "Content-Type: text/xml\n" );
-  printf( "Content-ID: <xml@mapservice>\n" );
-  printf( "\n" );
-  printf( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" );
-  fwrite( xmlByteArray.data(), xmlByteArray.size(), 1, FCGI_stdout );
-  printf( "\n" );
-  printf( "\r\n" );
-  printf( "--MIME_boundary\r\n" );
+  QgsMSUtils::writeResponse( "MIME-Version: 1.0\n" );
+  QgsMSUtils::writeResponse( "Content-Type: Multipart/Related; boundary=\"MIME_boundary\"; type=\"text/xml\"; start=\"<xml@mapservice>\"\n" );
+  QgsMSUtils::writeResponse( "\n" );
+  QgsMSUtils::writeResponse( "--MIME_boundary\r\n" );
+  QgsMSUtils::writeResponse( "Content-Type: text/xml\n" );
+  QgsMSUtils::writeResponse( "Content-ID: <xml@mapservice>\n" );
+  QgsMSUtils::writeResponse( "\n" );
+  QgsMSUtils::writeResponse( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" );
+  QgsMSUtils::writeResponse( xmlByteArray );
+  QgsMSUtils::writeResponse( "\n" );
+  QgsMSUtils::writeResponse( "\r\n" );
+  QgsMSUtils::writeResponse( "--MIME_boundary\r\n" );
   if ( mFormat == "JPG" )
   {
-    printf( "Content-Type: image/jpg\n" );
+    QgsMSUtils::writeResponse( "Content-Type: image/jpg\n" );
   }
   else if ( mFormat == "PNG" )
   {
-    printf( "Content-Type: image/png\n" );
+    QgsMSUtils::writeResponse( "Content-Type: image/png\n" );
   }
-  printf( "Content-Transfer-Encoding: binary\n" );
-  printf( "Content-ID: <image@mapservice>\n" );
-  printf( "\n" );
-  fwrite( ba.data(), ba.size(), 1, FCGI_stdout );
-  printf( "\r\n" );
-  printf( "--MIME_boundary\r\n" );
+  QgsMSUtils::writeResponse( "Content-Transfer-Encoding: binary\n" );
+  QgsMSUtils::writeResponse( "Content-ID: <image@mapservice>\n" );
+  QgsMSUtils::writeResponse( "\n" );
+  QgsMSUtils::writeResponse( ba );
+  QgsMSUtils::writeResponse( "\r\n" );
+  QgsMSUtils::writeResponse( "--MIME_boundary\r\n" );
 
   return 0;
 }
@@ -22,6 +22,7 @@
 #include "qgsrasterprojector.h"
 #include "qgsrasterfilewriter.h"
 #include "qgslogger.h"
+#include "qgsmsutils.h"
 #include "qgsmapserviceexception.h"
 
 #include <QUrl>
@@ -340,11 +341,11 @@ QByteArray* QgsWCSServer::getCoverage()
 
 QString QgsWCSServer::serviceUrl() const
 {
-  QUrl mapUrl( getenv( "REQUEST_URI" ) );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  QUrl mapUrl( QgsMSUtils::requestVariable( "REQUEST_URI" ) );
+  mapUrl.setHost( QgsMSUtils::requestVariable( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsMSUtils::requestVariable( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -358,7 +359,7 @@ QString QgsWCSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QString( QgsMSUtils::requestVariable( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
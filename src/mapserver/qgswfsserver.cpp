@@ -33,6 +33,7 @@
 #include "qgsvectorlayer.h"
 #include "qgsfilter.h"
 #include "qgslogger.h"
+#include "qgsmsutils.h"
 #include "qgsmapserviceexception.h"
 #include "qgssldparser.h"
 #include "qgssymbolv2.h"
@@ -1817,11 +1818,11 @@ QDomElement QgsWFSServer::createFeatureGML3( QgsFeature* feat, QDomDocument& doc
 
 QString QgsWFSServer::serviceUrl() const
 {
-  QUrl mapUrl( getenv( "REQUEST_URI" ) );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  QUrl mapUrl( QgsMSUtils::requestVariable( "REQUEST_URI" ) );
+  mapUrl.setHost( QgsMSUtils::requestVariable( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsMSUtils::requestVariable( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -1835,7 +1836,7 @@ QString QgsWFSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QString( QgsMSUtils::requestVariable( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
@@ -24,7 +24,6 @@
 #include "qgsmaplayerregistry.h"
 #include "qgsmaprenderer.h"
 #include "qgsmaptopixel.h"
-#include "qgsproject.h"
 #include "qgsrasteridentifyresult.h"
 #include "qgsrasterlayer.h"
 #include "qgsscalecalculator.h"
@@ -32,6 +31,7 @@
 #include "qgsvectordataprovider.h"
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
+#include "qgsmsutils.h"
 #include "qgsmapserviceexception.h"
 #include "qgssldparser.h"
 #include "qgssymbolv2.h"
@@ -166,7 +166,7 @@ QDomDocument QgsWMSServer::getCapabilities( QString version, bool fullProjectInf
   QDomElement postResourceElement = doc.createElement( "OnlineResource"/*wms:OnlineResource*/ );
   postResourceElement.setAttribute( "xmlns:xlink", "http://www.w3.org/1999/xlink" );
   postResourceElement.setAttribute( "xlink:type", "simple" );
-  postResourceElement.setAttribute( "xlink:href", "http://" + QString( getenv( "SERVER_NAME" ) ) + QString( getenv( "REQUEST_URI" ) ) );
+  postResourceElement.setAttribute( "xlink:href", "http://" + QString( QgsMSUtils::requestVariable( "SERVER_NAME" ) ) + QString( QgsMSUtils::requestVariable( "REQUEST_URI" ) ) );
   postElement.appendChild( postResourceElement );
   dcpTypeElement.appendChild( postElement );
 #endif
@@ -1257,13 +1257,12 @@ int QgsWMSServer::configureMapRender( const QPaintDevice* paintDevice ) const
   if ( crs.isEmpty() )
   {
     //disable on the fly projection
-    QgsProject::instance()->writeEntry( "SpatialRefSys", "/ProjectionsEnabled", 0 );
+    mMapRenderer->setProjectionsEnabled( false );
   }
   else
   {
     //enable on the fly projection
     QgsDebugMsg( "enable on the fly projection" );
-    QgsProject::instance()->writeEntry( "SpatialRefSys", "/ProjectionsEnabled", 1 );
 
     //destination SRS
     outputCRS = QgsCRSCache::instance()->crsByAuthId( crs );
@@ -2328,11 +2327,11 @@ bool QgsWMSServer::checkMaximumWidthHeight() const
 
 QString QgsWMSServer::serviceUrl() const
 {
-  QUrl mapUrl( getenv( "REQUEST_URI" ) );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  QUrl mapUrl( QgsMSUtils::requestVariable( "REQUEST_URI" ) );
+  mapUrl.setHost( QgsMSUtils::requestVariable( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsMSUtils::requestVariable( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -2346,7 +2345,7 @@ QString QgsWMSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QString( QgsMSUtils::requestVariable( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
@@ -29,5 +29,7 @@ QgsInterpolator* QgsIDWInterpolatorDialog::createInterpolator() const
 {
   QgsIDWInterpolator* theInterpolator = new QgsIDWInterpolator( mInputData );
   theInterpolator->setDistanceCoefficient( mPSpinBox->value() );
+  theInterpolator->setMaximumNeighbours( mNeighboursSpinBox->value() );
+  theInterpolator->setSearchRadius( mRadiusSpinBox->value() );
   return theInterpolator;
 }
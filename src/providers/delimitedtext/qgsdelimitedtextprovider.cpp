@@ -27,6 +27,7 @@
 #include <QSettings>
 #include <QRegExp>
 #include <QUrl>
+#include <QtConcurrentRun>
 
 #include "qgsapplication.h"
 #include "qgsdataprovider.h"
@@ -53,6 +54,80 @@ static const QString TEXT_PROVIDER_DESCRIPTION = "Delimited text data provider";
 
 static const int SUBSET_ID_THRESHOLD_FACTOR = 10;
 
+// Uri parameters which do not change the geometries of the features, and so
+// are not part of the key of the cached spatial index
+
+static const char *SPATIAL_INDEX_CACHE_IGNORED_PARAMETERS[] = { "subset", "subsetIndex", "spatialIndex", "quiet", "crs", 0 };
+
+// Bounding boxes collected while scanning the file
+
+class QgsDelimitedTextSpatialIndexEntries : public QgsSpatialIndex::EntryStream
+{
+  public:
+    QgsDelimitedTextSpatialIndexEntries( const QVector< QPair<QgsFeatureId, QgsRectangle> > &entries )
+        : mEntries( entries ), mNext( 0 ) {}
+
+    bool nextEntry( QgsFeatureId &theId, QgsRectangle &theRect )
+    {
+      if ( mNext >= mEntries.size() ) return false;
+      theId = mEntries[mNext].first;
+      theRect = mEntries[mNext].second;
+      mNext++;
+      return true;
+    }
+
+  private:
+    QVector< QPair<QgsFeatureId, QgsRectangle> > mEntries;
+    int mNext;
+};
+
+// Builds the spatial index in a background thread and writes it to the cache.
+// The build is canceled as soon as the generation of the provider changes.
+
+class QgsDelimitedTextSpatialIndexJob : public QgsDelimitedTextSpatialIndexEntries, public QgsSpatialIndex::BuildFeedback
+{
+  public:
+    QgsDelimitedTextSpatialIndexJob( const QVector< QPair<QgsFeatureId, QgsRectangle> > &entries, const QAtomicInt *generation )
+        : QgsDelimitedTextSpatialIndexEntries( entries )
+        , sourceSize( 0 )
+        , mGeneration( generation )
+        , mStartGeneration( *generation )
+    {}
+
+    bool progress( int theCount )
+    {
+      Q_UNUSED( theCount );
+      return isCurrent();
+    }
+
+    bool isCurrent() const { return *mGeneration == mStartGeneration; }
+
+    QString cacheFile;
+    QString sourceFile;
+    qint64 sourceSize;
+    QDateTime sourceModified;
+
+  private:
+    const QAtomicInt *mGeneration;
+    int mStartGeneration;
+};
+
+static QgsSpatialIndex *buildSpatialIndex( QgsDelimitedTextSpatialIndexJob *job )
+{
+  QgsSpatialIndex *index = new QgsSpatialIndex( *job, job );
+  if ( job->isCurrent() )
+  {
+    index->writeToFile( job->cacheFile, job->sourceFile, job->sourceSize, job->sourceModified );
+  }
+  else
+  {
+    delete index;
+    index = 0;
+  }
+  delete job;
+  return index;
+}
+
 QRegExp QgsDelimitedTextProvider::WktPrefixRegexp( "^\\s*(?:\\d+\\s+|SRID\\=\\d+\\;)", Qt::CaseInsensitive );
 QRegExp QgsDelimitedTextProvider::WktZMRegexp( "\\s*(?:z|m|zm)(?=\\s*\\()", Qt::CaseInsensitive );
 QRegExp QgsDelimitedTextProvider::WktCrdRegexp( "(\\-?\\d+(?:\\.\\d*)?\\s+\\-?\\d+(?:\\.\\d*)?)\\s[\\s\\d\\.\\-]+" );
@@ -83,9 +158,12 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
     , mGeometryType( QGis::UnknownGeometry )
     , mBuildSpatialIndex( false )
     , mSpatialIndex( 0 )
+    , mSpatialIndexGeneration( 0 )
 {
   QgsDebugMsg( "Delimited text file uri is " + uri );
 
+  connect( &mSpatialIndexWatcher, SIGNAL( finished() ), this, SLOT( onSpatialIndexBuilt() ) );
+
   QUrl url = QUrl::fromEncoded( uri.toAscii() );
   mFile = new QgsDelimitedTextFile();
   mFile->setFromUrl( url );
@@ -168,6 +246,8 @@ QgsDelimitedTextProvider::QgsDelimitedTextProvider( QString uri )
 
 QgsDelimitedTextProvider::~QgsDelimitedTextProvider()
 {
+  cancelSpatialIndexBuild();
+
   while ( !mActiveIterators.empty() )
   {
     QgsDelimitedTextFeatureIterator *it = *mActiveIterators.begin();
@@ -278,6 +358,7 @@ void QgsDelimitedTextProvider::resetCachedSubset()
 
 void QgsDelimitedTextProvider::resetIndexes()
 {
+  cancelSpatialIndexBuild();
   resetCachedSubset();
   mUseSubsetIndex = false;
   mUseSpatialIndex = false;
@@ -298,10 +379,90 @@ bool QgsDelimitedTextProvider::createSpatialIndex()
 
   mBuildSpatialIndex = true;
   setUriParameter( "spatialIndex", "yes" );
+
+  // The features are already counted, so if the index of the complete file is
+  // cached and up to date there is no need to scan the file again
+
+  if ( mValid && ! mRescanRequired && ! mSubsetExpression && mCachedSubsetString.isNull() )
+  {
+    QgsSpatialIndex *index = new QgsSpatialIndex();
+    if ( index->readFromFile( spatialIndexCacheFile(), mFile->fileName() ) )
+    {
+      delete mSpatialIndex;
+      mSpatialIndex = index;
+      mUseSpatialIndex = true;
+      return true;
+    }
+    delete index;
+  }
+
   rescanFile();
   return true;
 }
 
+// The spatial index of the complete file is cached, keyed on the parts of the uri
+// that define the geometries.  It is reused while the size and modification time of
+// the file are unchanged, otherwise it is rebuilt in the background.
+
+QString QgsDelimitedTextProvider::spatialIndexCacheFile() const
+{
+  QUrl url = QUrl::fromEncoded( dataSourceUri().toAscii() );
+  for ( int i = 0; SPATIAL_INDEX_CACHE_IGNORED_PARAMETERS[i]; i++ )
+  {
+    url.removeAllQueryItems( SPATIAL_INDEX_CACHE_IGNORED_PARAMETERS[i] );
+  }
+  return QgsSpatialIndex::cacheFileName( QString::fromAscii( url.toEncoded() ) );
+}
+
+void QgsDelimitedTextProvider::startSpatialIndexBuild( QVector< QPair<QgsFeatureId, QgsRectangle> > &entries, qint64 sourceSize, const QDateTime &sourceModified )
+{
+  QgsDelimitedTextSpatialIndexJob *job = new QgsDelimitedTextSpatialIndexJob( entries, &mSpatialIndexGeneration );
+  job->cacheFile = spatialIndexCacheFile();
+  job->sourceFile = mFile->fileName();
+  job->sourceSize = sourceSize;
+  job->sourceModified = sourceModified;
+  entries.clear();
+
+  QgsDebugMsg( "Building spatial index in the background for " + job->sourceFile );
+  mSpatialIndexWatcher.setFuture( QtConcurrent::run( buildSpatialIndex, job ) );
+}
+
+void QgsDelimitedTextProvider::cancelSpatialIndexBuild()
+{
+  if ( mSpatialIndexWatcher.future().resultCount() == 0 && ! mSpatialIndexWatcher.isRunning() ) return;
+  mSpatialIndexGeneration.ref();
+  mSpatialIndexWatcher.waitForFinished();
+  delete takeBuiltSpatialIndex();
+}
+
+QgsSpatialIndex *QgsDelimitedTextProvider::takeBuiltSpatialIndex()
+{
+  QFuture<QgsSpatialIndex *> future = mSpatialIndexWatcher.future();
+  QgsSpatialIndex *index = future.resultCount() > 0 ? future.result() : 0;
+  mSpatialIndexWatcher.setFuture( QFuture<QgsSpatialIndex *>() );
+  return index;
+}
+
+void QgsDelimitedTextProvider::onSpatialIndexBuilt()
+{
+  QgsSpatialIndex *index = takeBuiltSpatialIndex();
+  if ( ! index ) return;
+
+  QgsDebugMsg( "Spatial index built in the background" );
+  delete mSpatialIndex;
+  mSpatialIndex = index;
+
+  // If a temporary subset is set then use the index when the subset is reset
+  if ( mCachedSubsetString.isNull() )
+  {
+    mUseSpatialIndex = true;
+  }
+  else
+  {
+    mCachedUseSpatialIndex = true;
+  }
+}
+
 // Really want to merge scanFile and rescan into single code.  Currently the reason
 // this is not done is that scanFile is done initially to create field names and, rescan
 // file includes building subset expression and assumes field names/types are already
@@ -376,6 +537,16 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
     return;
   }
 
+  // Use the cached spatial index if it is up to date.  Otherwise collect the
+  // bounding boxes to build it once the file is scanned.  The file size and time
+  // are taken before scanning, so that changes while scanning make the index stale.
+
+  QFileInfo fileInfo( mFile->fileName() );
+  qint64 fileSize = fileInfo.size();
+  QDateTime fileModified = fileInfo.lastModified();
+  QVector< QPair<QgsFeatureId, QgsRectangle> > spatialIndexEntries;
+  bool spatialIndexCached = buildSpatialIndex && mSpatialIndex->readFromFile( spatialIndexCacheFile(), mFile->fileName() );
+
   // Scan the entire file to determine
   // 1) the number of fields (this is handled by QgsDelimitedTextFile mFile
   // 2) the number of valid features.  Note that the selection of valid features
@@ -459,15 +630,9 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
                 QgsRectangle bbox( geom->boundingBox() );
                 mExtent.combineExtentWith( &bbox );
               }
-              if ( buildSpatialIndex )
+              if ( buildSpatialIndex && ! spatialIndexCached )
               {
-                QgsFeature f;
-                f.setFeatureId( mFile->recordId() );
-                f.setGeometry( geom );
-                mSpatialIndex->insertFeature( f );
-                // Feature now has ownership of geometry, so set to null
-                // here to avoid deleting twice.
-                geom = 0;
+                spatialIndexEntries.append( qMakePair(( QgsFeatureId ) mFile->recordId(), geom->boundingBox() ) );
               }
             }
             else
@@ -517,12 +682,9 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
             mGeometryType = QGis::Point;
           }
           mNumberFeatures++;
-          if ( buildSpatialIndex )
+          if ( buildSpatialIndex && ! spatialIndexCached )
           {
-            QgsFeature f;
-            f.setFeatureId( mFile->recordId() );
-            f.setGeometry( QgsGeometry::fromPoint( pt ) );
-            mSpatialIndex->insertFeature( f );
+            spatialIndexEntries.append( qMakePair(( QgsFeatureId ) mFile->recordId(), QgsRectangle( pt.x(), pt.y(), pt.x(), pt.y() ) ) );
           }
         }
         else
@@ -661,7 +823,13 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
     if ( ! mUseSubsetIndex ) mSubsetIndex = QList<quintptr>();
   }
 
-  mUseSpatialIndex = buildSpatialIndex;
+  // Until the spatial index is built, features are selected by scanning the file
+
+  if ( buildSpatialIndex && ! spatialIndexCached )
+  {
+    startSpatialIndexBuild( spatialIndexEntries, fileSize, fileModified );
+  }
+  mUseSpatialIndex = buildSpatialIndex && spatialIndexCached;
 
   mValid = mGeometryType != QGis::UnknownGeometry;
   mLayerValid = mValid;
@@ -730,6 +898,16 @@ void QgsDelimitedTextProvider::rescanFile()
     attributeColumns[i] = mFile->fieldIndex( attributeFields[i].name() );
   }
 
+  // The cached spatial index only applies without a subset, otherwise the
+  // index is built from the features in the subset
+
+  bool cacheSpatialIndex = buildSpatialIndex && ! mSubsetExpression;
+  QFileInfo fileInfo( mFile->fileName() );
+  qint64 fileSize = fileInfo.size();
+  QDateTime fileModified = fileInfo.lastModified();
+  QVector< QPair<QgsFeatureId, QgsRectangle> > spatialIndexEntries;
+  bool spatialIndexCached = cacheSpatialIndex && mSpatialIndex->readFromFile( spatialIndexCacheFile(), mFile->fileName() );
+
   // Scan through the features in the file
 
   mSubsetIndex.clear();
@@ -751,7 +929,7 @@ void QgsDelimitedTextProvider::rescanFile()
         QgsRectangle bbox( f.geometry()->boundingBox() );
         mExtent.combineExtentWith( &bbox );
       }
-      if ( buildSpatialIndex ) mSpatialIndex->insertFeature( f );
+      if ( buildSpatialIndex && ! spatialIndexCached ) spatialIndexEntries.append( qMakePair( f.id(), f.geometry()->boundingBox() ) );
     }
     if ( buildSubsetIndex ) mSubsetIndex.append(( quintptr ) f.id() );
     mNumberFeatures++;
@@ -764,7 +942,21 @@ void QgsDelimitedTextProvider::rescanFile()
     if ( ! mUseSubsetIndex ) mSubsetIndex.clear();
   }
 
-  mUseSpatialIndex = buildSpatialIndex;
+  if ( cacheSpatialIndex && ! spatialIndexCached )
+  {
+    startSpatialIndexBuild( spatialIndexEntries, fileSize, fileModified );
+    mUseSpatialIndex = false;
+  }
+  else
+  {
+    if ( buildSpatialIndex && ! spatialIndexCached )
+    {
+      delete mSpatialIndex;
+      QgsDelimitedTextSpatialIndexEntries stream( spatialIndexEntries );
+      mSpatialIndex = new QgsSpatialIndex( stream );
+    }
+    mUseSpatialIndex = buildSpatialIndex;
+  }
 }
 
 QgsGeometry *QgsDelimitedTextProvider::geomFromWkt( QString &sWkt )
@@ -872,6 +1064,11 @@ QgsFeatureIterator QgsDelimitedTextProvider::getFeatures( const QgsFeatureReques
   //
   if (( mLayerValid && ! mValid ) || mRescanRequired ) rescanFile();
 
+  // Use an index built in the background as soon as it is finished, the finished()
+  // signal is only delivered by an event loop which may not be running
+
+  if ( mSpatialIndexWatcher.isFinished() && mSpatialIndexWatcher.future().resultCount() > 0 ) onSpatialIndexBuilt();
+
   return QgsFeatureIterator( new QgsDelimitedTextFeatureIterator( this, request ) );
 }
 
@@ -22,7 +22,12 @@
 #include "qgscoordinatereferencesystem.h"
 #include "qgsdelimitedtextfile.h"
 
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QFutureWatcher>
+#include <QPair>
 #include <QStringList>
+#include <QVector>
 
 class QgsFeature;
 class QgsField;
@@ -212,6 +217,7 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
   private slots:
 
     void onFileUpdated();
+    void onSpatialIndexBuilt();
 
   private:
 
@@ -234,6 +240,12 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     void setUriParameter( QString parameter, QString value );
     bool setNextFeatureId( qint64 fid ) { return mFile->setNextRecordId(( long ) fid ); }
 
+    // Spatial index cache, see QgsSpatialIndex::cacheFileName
+    QString spatialIndexCacheFile() const;
+    void startSpatialIndexBuild( QVector< QPair<QgsFeatureId, QgsRectangle> > &entries, qint64 sourceSize, const QDateTime &sourceModified );
+    void cancelSpatialIndexBuild();
+    QgsSpatialIndex *takeBuiltSpatialIndex();
+
 
     QgsGeometry *geomFromWkt( QString &sWkt );
     bool pointFromXY( QString &sX, QString &sY, QgsPoint &point );
@@ -320,6 +332,11 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     bool mCachedUseSpatialIndex;
     QgsSpatialIndex *mSpatialIndex;
 
+    // Builds the spatial index in the background if the cached one is missing
+    // or out of date.  Incrementing the generation cancels the build.
+    QFutureWatcher<QgsSpatialIndex *> mSpatialIndexWatcher;
+    QAtomicInt mSpatialIndexGeneration;
+
     friend class QgsDelimitedTextFeatureIterator;
     QSet< QgsDelimitedTextFeatureIterator* > mActiveIterators;
 };
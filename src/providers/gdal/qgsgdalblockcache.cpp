@@ -0,0 +1,80 @@
+/***************************************************************************
+                          qgsgdalblockcache.cpp
+            Cache of decoded raster tiles shared by all GDAL layers
+                          --------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsgdalblockcache.h"
+#include "qgslogger.h"
+
+#include <QMutexLocker>
+#include <QSettings>
+
+static QMutex sInstanceMutex;
+static QgsGdalBlockCache* sInstance = 0;
+
+QgsGdalBlockCache* QgsGdalBlockCache::instance()
+{
+  QMutexLocker locker( &sInstanceMutex );
+  if ( !sInstance )
+  {
+    sInstance = new QgsGdalBlockCache();
+  }
+  return sInstance;
+}
+
+QgsGdalBlockCache::QgsGdalBlockCache()
+{
+  QSettings mySettings;
+  setMaximumSize( qMax( 0, mySettings.value( "/Raster/blockCacheSize", 64 ).toInt() ) * 1024 );
+}
+
+void QgsGdalBlockCache::setMaximumSize( int theKiloBytes )
+{
+  QMutexLocker locker( &mMutex );
+  mMaxSize = qMax( 0, theKiloBytes );
+  mCache.setMaxCost( mMaxSize );
+  QgsDebugMsg( QString( "block cache size %1 kB" ).arg( mMaxSize ) );
+}
+
+QByteArray QgsGdalBlockCache::tile( const QgsGdalBlockKey& theKey )
+{
+  QMutexLocker locker( &mMutex );
+  QByteArray* myData = mCache.object( theKey );
+  // the array is implicitly shared, the copy stays valid when the tile is dropped
+  return myData ? *myData : QByteArray();
+}
+
+void QgsGdalBlockCache::insert( const QgsGdalBlockKey& theKey, const QByteArray& theData )
+{
+  QMutexLocker locker( &mMutex );
+  int myCost = qMax( 1, theData.size() / 1024 );
+  if ( myCost > mMaxSize )
+  {
+    return;
+  }
+  mCache.insert( theKey, new QByteArray( theData ), myCost );
+}
+
+void QgsGdalBlockCache::removeSource( const QString& theSource )
+{
+  QMutexLocker locker( &mMutex );
+  foreach ( const QgsGdalBlockKey& key, mCache.keys() )
+  {
+    if ( key.source == theSource )
+    {
+      mCache.remove( key );
+    }
+  }
+}
@@ -0,0 +1,86 @@
+/***************************************************************************
+                          qgsgdalblockcache.h
+            Cache of decoded raster tiles shared by all GDAL layers
+                          --------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSGDALBLOCKCACHE_H
+#define QGSGDALBLOCKCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QString>
+
+/**Identifies a tile of a band at one resolution of a data source*/
+struct QgsGdalBlockKey
+{
+  //! data source with its modification stamp, see QgsGdalProvider::blockCacheSource()
+  QString source;
+  int band;
+  //! 0 for the full resolution, i + 1 for overview i
+  int level;
+  int x;
+  int y;
+
+  bool operator==( const QgsGdalBlockKey& other ) const
+  {
+    return band == other.band && level == other.level && x == other.x && y == other.y && source == other.source;
+  }
+};
+
+inline uint qHash( const QgsGdalBlockKey& key )
+{
+  return qHash( key.source ) ^ ( key.band * 0x9e3779b1 ) ^ ( key.level << 24 ) ^ ( key.x * 0x85ebca6b ) ^ ( key.y * 0xc2b2ae35 );
+}
+
+/**Least recently used cache of decoded raster tiles.
+
+  The tiles are aligned to the natural blocks of the band at the resolution they were read from, so that panning
+  and repeated requests of the same area read the data from memory instead of decoding and resampling it again.
+  There is one instance shared by all layers, it may be used from several threads. The memory budget is read from
+  the /Raster/blockCacheSize setting in MB, 0 disables the cache.
+  */
+class QgsGdalBlockCache
+{
+  public:
+    static QgsGdalBlockCache* instance();
+
+    /**Returns false if the memory budget is 0*/
+    bool isEnabled() const { return mMaxSize > 0; }
+
+    /**Sets the memory budget in kB, tiles are dropped if it is smaller than the cached data*/
+    void setMaximumSize( int theKiloBytes );
+
+    /**Memory budget in kB*/
+    int maximumSize() const { return mMaxSize; }
+
+    /**Returns the data of a tile or a null array if it is not cached*/
+    QByteArray tile( const QgsGdalBlockKey& theKey );
+
+    /**Adds a tile, it is not cached if it is larger than the memory budget*/
+    void insert( const QgsGdalBlockKey& theKey, const QByteArray& theData );
+
+    /**Drops all tiles of a data source, e.g. because it was written*/
+    void removeSource( const QString& theSource );
+
+  private:
+    QgsGdalBlockCache();
+
+    QMutex mMutex;
+    QCache<QgsGdalBlockKey, QByteArray> mCache;
+    int mMaxSize;
+};
+
+#endif // QGSGDALBLOCKCACHE_H
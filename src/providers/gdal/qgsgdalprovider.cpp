@@ -19,6 +19,8 @@
 #include "qgslogger.h"
 #include "qgsgdalproviderbase.h"
 #include "qgsgdalprovider.h"
+#include "qgsgdalblockcache.h"
+#include "qgsgdalpyramidbuilder.h"
 #include "qgsconfig.h"
 
 #include "qgsapplication.h"
@@ -91,6 +93,10 @@ int CPL_STDCALL progressCallback( double dfComplete,
   }
   dfLastComplete = dfComplete;
 
+  // returning false makes GDAL and the pyramid builder stop
+  if ( prog->type == QgsRaster::ProgressPyramids && mypProvider->buildPyramidsCanceled() )
+    return false;
+
   return true;
 }
 
@@ -568,38 +574,93 @@ void QgsGdalProvider::readBlock( int theBandNo, QgsRectangle  const & theExtent,
 
   double tmpXMin = mExtent.xMinimum() + srcLeft * srcXRes;
   double tmpYMax = mExtent.yMaximum() + srcTop * srcYRes;
-  QgsDebugMsg( QString( "tmpXMin = %1 tmpYMax = %2 tmpWidth = %3 tmpHeight = %4" ).arg( tmpXMin ).arg( tmpYMax ).arg( tmpWidth ).arg( tmpHeight ) );
+  double tmpXRes = srcWidth * srcXRes / tmpWidth;
+  double tmpYRes = srcHeight * srcYRes / tmpHeight; // negative
+  GDALRasterBandH gdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
+  char *tmpBlock = 0;
+
+  // Read the window from the shared block cache at the resolution of the overview which is closest
+  // to the requested one without being coarser. If that would read much more cells than requested
+  // (no overviews while zoomed out), GDAL reads and downsamples directly as before.
+  QgsGdalBlockCache* cache = QgsGdalBlockCache::instance();
+  if ( cache->isEnabled() )
+  {
+    double factor = qMin( srcWidth / ( double ) tmpWidth, srcHeight / ( double ) tmpHeight );
+    int level = 0;
+    int levelWidth = xSize();
+    int levelHeight = ySize();
+    for ( int i = 0; i < GDALGetOverviewCount( gdalBand ); i++ )
+    {
+      GDALRasterBandH overview = GDALGetOverview( gdalBand, i );
+      int overviewWidth = GDALGetRasterBandXSize( overview );
+      int overviewHeight = GDALGetRasterBandYSize( overview );
+      if ( overviewWidth < levelWidth && xSize() / ( double ) overviewWidth <= factor )
+      {
+        level = i + 1;
+        levelWidth = overviewWidth;
+        levelHeight = overviewHeight;
+      }
+    }
 
-  // Allocate temporary block
-  char *tmpBlock = ( char * )qgsMalloc( dataSize * tmpWidth * tmpHeight );
-  if ( ! tmpBlock )
-  {
-    QgsDebugMsg( QString( "Coudn't allocate temporary buffer of %1 bytes" ).arg( dataSize * tmpWidth * tmpHeight ) );
-    return;
+    double levelXRes = mExtent.width() / levelWidth;
+    double levelYRes = -mExtent.height() / levelHeight;
+    int levelLeft = qBound( 0, static_cast<int>( floor(( myRasterExtent.xMinimum() - mExtent.xMinimum() ) / levelXRes ) ), levelWidth - 1 );
+    int levelRight = qBound( 0, static_cast<int>( floor(( myRasterExtent.xMaximum() - mExtent.xMinimum() ) / levelXRes ) ), levelWidth - 1 );
+    int levelTop = qBound( 0, static_cast<int>( floor( -1. * ( mExtent.yMaximum() - myRasterExtent.yMaximum() ) / levelYRes ) ), levelHeight - 1 );
+    int levelBottom = qBound( 0, static_cast<int>( floor( -1. * ( mExtent.yMaximum() - myRasterExtent.yMinimum() ) / levelYRes ) ), levelHeight - 1 );
+    int levelWindowWidth = levelRight - levelLeft + 1;
+    int levelWindowHeight = levelBottom - levelTop + 1;
+
+    if (( double ) levelWindowWidth * levelWindowHeight <= 4. * qMax( width * height, tmpWidth * tmpHeight ) )
+    {
+      tmpBlock = ( char * )qgsMalloc( dataSize * levelWindowWidth * levelWindowHeight );
+      if ( tmpBlock && readCachedWindow( theBandNo, level, levelLeft, levelTop, levelWindowWidth, levelWindowHeight, tmpBlock ) )
+      {
+        tmpWidth = levelWindowWidth;
+        tmpHeight = levelWindowHeight;
+        tmpXMin = mExtent.xMinimum() + levelLeft * levelXRes;
+        tmpYMax = mExtent.yMaximum() + levelTop * levelYRes;
+        tmpXRes = levelXRes;
+        tmpYRes = levelYRes;
+      }
+      else
+      {
+        qgsFree( tmpBlock );
+        tmpBlock = 0;
+      }
+    }
   }
-  GDALRasterBandH gdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
-  GDALDataType type = ( GDALDataType )mGdalDataType[theBandNo-1];
-  CPLErrorReset();
-  CPLErr err = gdalRasterIO( gdalBand, GF_Read,
-                             srcLeft, srcTop, srcWidth, srcHeight,
-                             ( void * )tmpBlock,
-                             tmpWidth, tmpHeight, type,
-                             0, 0 );
+  QgsDebugMsg( QString( "tmpXMin = %1 tmpYMax = %2 tmpWidth = %3 tmpHeight = %4" ).arg( tmpXMin ).arg( tmpYMax ).arg( tmpWidth ).arg( tmpHeight ) );
 
-  if ( err != CPLE_None )
+  if ( !tmpBlock )
   {
-    QgsLogger::warning( "RasterIO error: " + QString::fromUtf8( CPLGetLastErrorMsg() ) );
-    qgsFree( tmpBlock );
-    return;
-  }
+    // Allocate temporary block
+    tmpBlock = ( char * )qgsMalloc( dataSize * tmpWidth * tmpHeight );
+    if ( ! tmpBlock )
+    {
+      QgsDebugMsg( QString( "Coudn't allocate temporary buffer of %1 bytes" ).arg( dataSize * tmpWidth * tmpHeight ) );
+      return;
+    }
+    GDALDataType type = ( GDALDataType )mGdalDataType[theBandNo-1];
+    CPLErrorReset();
+    CPLErr err = gdalRasterIO( gdalBand, GF_Read,
+                               srcLeft, srcTop, srcWidth, srcHeight,
+                               ( void * )tmpBlock,
+                               tmpWidth, tmpHeight, type,
+                               0, 0 );
 
-  double tmpXRes = srcWidth * srcXRes / tmpWidth;
-  double tmpYRes = srcHeight * srcYRes / tmpHeight; // negative
+    if ( err != CPLE_None )
+    {
+      QgsLogger::warning( "RasterIO error: " + QString::fromUtf8( CPLGetLastErrorMsg() ) );
+      qgsFree( tmpBlock );
+      return;
+    }
+  }
 
   double y = myRasterExtent.yMaximum() - 0.5 * yRes;
   for ( int row = 0; row < height; row++ )
   {
-    int tmpRow = static_cast<int>( floor( -1. * ( tmpYMax - y ) / tmpYRes ) );
+    int tmpRow = qBound( 0, static_cast<int>( floor( -1. * ( tmpYMax - y ) / tmpYRes ) ), tmpHeight - 1 );
 
     char *srcRowBlock = tmpBlock + dataSize * tmpRow * tmpWidth;
     char *dstRowBlock = ( char * )theBlock + dataSize * ( top + row ) * thePixelWidth;
@@ -631,6 +692,79 @@ void QgsGdalProvider::readBlock( int theBandNo, QgsRectangle  const & theExtent,
   return;
 }
 
+bool QgsGdalProvider::readCachedWindow( int theBandNo, int theLevel, int theLeft, int theTop, int theWidth, int theHeight, char *theBuffer )
+{
+  GDALRasterBandH gdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
+  if ( theLevel > 0 )
+  {
+    gdalBand = GDALGetOverview( gdalBand, theLevel - 1 );
+  }
+  if ( !gdalBand )
+  {
+    return false;
+  }
+  int levelWidth = GDALGetRasterBandXSize( gdalBand );
+  int levelHeight = GDALGetRasterBandYSize( gdalBand );
+  GDALDataType type = ( GDALDataType )mGdalDataType[theBandNo-1];
+  int dataSize = dataTypeSize( theBandNo );
+
+  // Tiles are natural blocks of the band, strips are merged to tiles of at least 64k cells
+  int tileWidth, tileHeight;
+  GDALGetBlockSize( gdalBand, &tileWidth, &tileHeight );
+  tileWidth = qBound( 1, tileWidth, levelWidth );
+  tileHeight = qBound( 1, tileHeight, levelHeight );
+  tileHeight = qMin( tileHeight * qMax( 1, ( 1 << 16 ) / ( tileWidth * tileHeight ) ), levelHeight );
+
+  QgsGdalBlockCache* cache = QgsGdalBlockCache::instance();
+  QgsGdalBlockKey key;
+  key.source = mBlockCacheSource;
+  key.band = theBandNo;
+  key.level = theLevel;
+
+  for ( int tileY = theTop / tileHeight; tileY <= ( theTop + theHeight - 1 ) / tileHeight; tileY++ )
+  {
+    int tileTop = tileY * tileHeight;
+    int tileRows = qMin( tileHeight, levelHeight - tileTop );
+    for ( int tileX = theLeft / tileWidth; tileX <= ( theLeft + theWidth - 1 ) / tileWidth; tileX++ )
+    {
+      int tileLeft = tileX * tileWidth;
+      int tileCols = qMin( tileWidth, levelWidth - tileLeft );
+
+      key.x = tileX;
+      key.y = tileY;
+      QByteArray data = cache->tile( key );
+      if ( data.isNull() )
+      {
+        data.resize( dataSize * tileCols * tileRows );
+        CPLErrorReset();
+        CPLErr err = gdalRasterIO( gdalBand, GF_Read, tileLeft, tileTop, tileCols, tileRows,
+                                   data.data(), tileCols, tileRows, type, 0, 0 );
+        if ( err != CPLE_None )
+        {
+          QgsLogger::warning( "RasterIO error: " + QString::fromUtf8( CPLGetLastErrorMsg() ) );
+          return false;
+        }
+        cache->insert( key, data );
+      }
+
+      // copy the part of the tile inside the window
+      int left = qMax( theLeft, tileLeft );
+      int right = qMin( theLeft + theWidth, tileLeft + tileCols );
+      int top = qMax( theTop, tileTop );
+      int bottom = qMin( theTop + theHeight, tileTop + tileRows );
+      const char *src = data.constData() + dataSize * (( top - tileTop ) * tileCols + left - tileLeft );
+      char *dst = theBuffer + dataSize * (( top - theTop ) * theWidth + left - theLeft );
+      for ( int row = top; row < bottom; row++ )
+      {
+        memcpy( dst, src, dataSize * ( right - left ) );
+        src += dataSize * tileCols;
+        dst += dataSize * theWidth;
+      }
+    }
+  }
+  return true;
+}
+
 //void * QgsGdalProvider::readBlock( int bandNo, QgsRectangle  const & extent, int width, int height )
 //{
 //  return 0;
@@ -1135,6 +1269,8 @@ bool QgsGdalProvider::hasHistogram( int theBandNo,
 {
   QgsDebugMsg( QString( "theBandNo = %1 theBinCount = %2 theMinimum = %3 theMaximum = %4 theSampleSize = %5" ).arg( theBandNo ).arg( theBinCount ).arg( theMinimum ).arg( theMaximum ).arg( theSampleSize ) );
 
+  readStatisticsCache( theBandNo );
+
   // First check if cached in mHistograms
   if ( QgsRasterDataProvider::hasHistogram( theBandNo, theBinCount, theMinimum, theMaximum, theExtent, theSampleSize, theIncludeOutOfRange ) )
   {
@@ -1220,6 +1356,8 @@ QgsRasterHistogram QgsGdalProvider::histogram( int theBandNo,
 {
   QgsDebugMsg( QString( "theBandNo = %1 theBinCount = %2 theMinimum = %3 theMaximum = %4 theSampleSize = %5" ).arg( theBandNo ).arg( theBinCount ).arg( theMinimum ).arg( theMaximum ).arg( theSampleSize ) );
 
+  readStatisticsCache( theBandNo );
+
   QgsRasterHistogram myHistogram;
   initHistogram( myHistogram, theBandNo, theBinCount, theMinimum, theMaximum, theExtent, theSampleSize, theIncludeOutOfRange );
 
@@ -1237,7 +1375,9 @@ QgsRasterHistogram QgsGdalProvider::histogram( int theBandNo,
       userNoDataValues( theBandNo ).size() > 0 )
   {
     QgsDebugMsg( "Custom no data values, using generic histogram." );
-    return QgsRasterDataProvider::histogram( theBandNo, theBinCount, theMinimum, theMaximum, theExtent, theSampleSize, theIncludeOutOfRange );
+    myHistogram = QgsRasterDataProvider::histogram( theBandNo, theBinCount, theMinimum, theMaximum, theExtent, theSampleSize, theIncludeOutOfRange );
+    writeStatisticsCache( theBandNo );
+    return myHistogram;
   }
 
   if ( myHistogram.extent != extent() )
@@ -1351,6 +1491,7 @@ QgsRasterHistogram QgsGdalProvider::histogram( int theBandNo,
   QgsDebugMsg( ">>>>> Histogram vector now contains " + QString::number( myHistogram.histogramVector.size() ) + " elements" );
 
   mHistograms.append( myHistogram );
+  writeStatisticsCache( theBandNo );
   return myHistogram;
 }
 
@@ -1382,6 +1523,8 @@ QString QgsGdalProvider::buildPyramids( const QList<QgsRasterPyramid> & theRaste
   // TODO add signal and connect from rasterlayer
   //emit drawingProgress( 0, 0 );
 
+  mBuildPyramidsCanceled = 0;
+
   if ( mGdalDataset != mGdalBaseDataset )
   {
     QgsLogger::warning( "Pyramid building not currently supported for 'warped virtual dataset'." );
@@ -1510,12 +1653,50 @@ QString QgsGdalProvider::buildPyramids( const QList<QgsRasterPyramid> & theRaste
     QgsGdalProgress myProg;
     myProg.type = QgsRaster::ProgressPyramids;
     myProg.provider = this;
-    myError = GDALBuildOverviews( mGdalBaseDataset, theMethod,
-                                  myOverviewLevelsVector.size(), myOverviewLevelsVector.data(),
-                                  0, NULL,
-                                  progressCallback, &myProg ); //this is the arg for the gdal progress callback
 
-    if ( myError == CE_Failure || CPLGetLastErrorNo() == CPLE_NotSupported )
+    // derive every level from the previous one, the position of an unfinished build is kept next to the
+    // data source so that the written overviews are not computed again
+    QgsGdalPyramidBuilder myBuilder( mGdalBaseDataset, dataSourceUri(), dataSourceUri() + ".pyramids.resume" );
+    QgsGdalPyramidBuilder::Result myResult = myBuilder.build( myOverviewLevelsVector, theResamplingMethod,
+        progressCallback, &myProg );
+    if ( myResult == QgsGdalPyramidBuilder::Unsupported )
+    {
+      QgsDebugMsg( "Pyramid builder not supported, using GDALBuildOverviews" );
+      CPLErrorReset();
+      myError = GDALBuildOverviews( mGdalBaseDataset, theMethod,
+                                    myOverviewLevelsVector.size(), myOverviewLevelsVector.data(),
+                                    0, NULL,
+                                    progressCallback, &myProg ); //this is the arg for the gdal progress callback
+    }
+    else
+    {
+      myError = myResult == QgsGdalPyramidBuilder::Failed ? CE_Failure : CE_None;
+    }
+
+    if ( myResult == QgsGdalPyramidBuilder::Canceled || buildPyramidsCanceled() )
+    {
+      QgsDebugMsg( "Building pyramids canceled" );
+      GDALClose( mGdalBaseDataset );
+      //closing the dataset writes to the overview file, the resume file is bound to its final state
+      myBuilder.updateResumeFile();
+      mGdalBaseDataset = gdalOpen( TO8F( dataSourceUri() ), mUpdate ? GA_Update : GA_ReadOnly );
+      //Since we are not a virtual warped dataset, mGdalDataSet and mGdalBaseDataset are supposed to be the same
+      mGdalDataset = mGdalBaseDataset;
+
+      // restore former configOptions
+      for ( QgsStringMap::const_iterator it = myConfigOptionsOld.begin();
+            it != myConfigOptionsOld.end(); ++it )
+      {
+        QByteArray key = it.key().toLocal8Bit();
+        QByteArray value = it.value().toLocal8Bit();
+        CPLSetConfigOption( key.data(), value.data() );
+      }
+
+      return "CANCELED";
+    }
+
+    if ( myError == CE_Failure ||
+         ( myResult == QgsGdalPyramidBuilder::Unsupported && CPLGetLastErrorNo() == CPLE_NotSupported ) )
     {
       QgsDebugMsg( QString( "Building pyramids failed using resampling method [%1]" ).arg( theMethod ) );
       //something bad happenend
@@ -1562,6 +1743,9 @@ QString QgsGdalProvider::buildPyramids( const QList<QgsRasterPyramid> & theRaste
 
   QgsDebugMsg( "Pyramid overviews built" );
 
+  // overview levels may have been added, the cached tiles use their indices
+  QgsGdalBlockCache::instance()->removeSource( mBlockCacheSource );
+
   // Observed problem: if a *.rrd file exists and GDALBuildOverviews() is called,
   // the *.rrd is deleted and no overviews are created, if GDALBuildOverviews()
   // is called next time, it crashes somewhere in GDAL:
@@ -2062,6 +2246,8 @@ bool QgsGdalProvider::hasStatistics( int theBandNo,
 {
   QgsDebugMsg( QString( "theBandNo = %1 theSampleSize = %2" ).arg( theBandNo ).arg( theSampleSize ) );
 
+  readStatisticsCache( theBandNo );
+
   // First check if cached in mStatistics
   if ( QgsRasterDataProvider::hasStatistics( theBandNo, theStats, theExtent, theSampleSize ) )
   {
@@ -2151,6 +2337,8 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
   // and it is not possible to use GDAL we call generic provider method,
   // otherwise we use GDAL (faster, cache)
 
+  readStatisticsCache( theBandNo );
+
   QgsRasterBandStats myRasterBandStats;
   initStatistics( myRasterBandStats, theBandNo, theStats, theExtent, theSampleSize );
 
@@ -2169,7 +2357,9 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
       userNoDataValues( theBandNo ).size() > 0 )
   {
     QgsDebugMsg( "Custom no data values, using generic statistics." );
-    return QgsRasterDataProvider::bandStatistics( theBandNo, theStats, theExtent, theSampleSize );
+    myRasterBandStats = QgsRasterDataProvider::bandStatistics( theBandNo, theStats, theExtent, theSampleSize );
+    writeStatisticsCache( theBandNo );
+    return myRasterBandStats;
   }
 
   int supportedStats = QgsRasterBandStats::Min | QgsRasterBandStats::Max
@@ -2249,6 +2439,8 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
     myRasterBandStats.elementCount = 0; //not available via gdal
     myRasterBandStats.sumOfSquares = 0; //not available via gdal
     myRasterBandStats.stdDev = pdfStdDev;
+    // GDAL does not tell how many cells an approximation is based on
+    myRasterBandStats.meanStandardError = bApproxOK ? std::numeric_limits<double>::quiet_NaN() : 0.0;
     myRasterBandStats.statsGathered = QgsRasterBandStats::Min | QgsRasterBandStats::Max
                                       | QgsRasterBandStats::Range | QgsRasterBandStats::Mean
                                       | QgsRasterBandStats::StdDev;
@@ -2264,6 +2456,7 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
   }
 
   mStatistics.append( myRasterBandStats );
+  writeStatisticsCache( theBandNo );
   return myRasterBandStats;
 
 } // QgsGdalProvider::bandStatistics
@@ -2310,6 +2503,19 @@ void QgsGdalProvider::initBaseDataset()
     GDALReferenceDataset( mGdalDataset );
   }
 
+  // Tiles in the shared block cache are identified by the data source, files also by their size and
+  // modification time, so that the tiles of a replaced file are not used
+  mBlockCacheSource = dataSourceUri();
+  QFileInfo myFileInfo( dataSourceUri() );
+  if ( myFileInfo.exists() )
+  {
+    mBlockCacheSource += QString( "|%1|%2" ).arg( myFileInfo.size() ).arg( myFileInfo.lastModified().toTime_t() );
+  }
+  if ( mGdalDataset != mGdalBaseDataset )
+  {
+    mBlockCacheSource += "|warped";
+  }
+
   if ( !hasGeoTransform )
   {
     // Initialise the affine transform matrix
@@ -2537,6 +2743,7 @@ bool QgsGdalProvider::write( void* data, int band, int width, int height, int xO
   {
     return false;
   }
+  QgsGdalBlockCache::instance()->removeSource( mBlockCacheSource );
   return gdalRasterIO( rasterBand, GF_Write, xOffset, yOffset, width, height, data, width, height, GDALGetRasterDataType( rasterBand ), 0, 0 ) == CE_None;
 }
 
@@ -2565,6 +2772,7 @@ bool QgsGdalProvider::remove()
 {
   if ( mGdalDataset )
   {
+    QgsGdalBlockCache::instance()->removeSource( mBlockCacheSource );
     GDALDriverH driver = GDALGetDatasetDriver( mGdalDataset );
     GDALClose( mGdalDataset );
     mGdalDataset = 0;
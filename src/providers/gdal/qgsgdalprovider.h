@@ -253,6 +253,11 @@ class QgsGdalProvider : public QgsRasterDataProvider, QgsGdalProviderBase
     /**Do some initialisation on the dataset (e.g. handling of south-up datasets)*/
     void initBaseDataset();
 
+    /**Reads a window of a band through the shared block cache
+      @param theLevel 0 for the full resolution, i + 1 for overview i
+      @return false if reading failed*/
+    bool readCachedWindow( int theBandNo, int theLevel, int theLeft, int theTop, int theWidth, int theHeight, char *theBuffer );
+
     /**
     * Flag indicating if the layer data source is a valid layer
     */
@@ -296,6 +301,9 @@ class QgsGdalProvider : public QgsRasterDataProvider, QgsGdalProviderBase
 
     /** \brief sublayers list saved for subsequent access */
     QStringList mSubLayers;
+
+    /** \brief Data source key of the tiles in the shared block cache */
+    QString mBlockCacheSource;
 };
 
 #endif
@@ -0,0 +1,528 @@
+/***************************************************************************
+                          qgsgdalpyramidbuilder.cpp
+            Builds overviews level by level from the previous level
+                          --------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsgdalpyramidbuilder.h"
+#include "qgslogger.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <qnumeric.h>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrentMap>
+
+#include <cpl_error.h>
+#include <limits>
+
+//! approximate count of source cells of a tile, all bands together
+static const int sTileCells = 1 << 18;
+
+//! target rows of all bands of an overview calculated by one job
+struct QgsGdalPyramidTile
+{
+  int firstRow;
+  int nRows;
+  int targetWidth;
+  int srcWidth;
+  //! rows of input per band, nRows for nearest, up to nRows * ratio for average
+  int srcRows;
+  int ratio;
+  //! source cell picked by nearest within the ratio x ratio window
+  int offset;
+  bool average;
+  //! nodata of every band
+  QVector<int> hasNoData;
+  QVector<double> noData;
+  //! input and result of the bands one after the other
+  QVector<double> input;
+  QVector<double> result;
+
+  bool isNoData( int band, double value ) const
+  {
+    return qIsNaN( value ) || ( hasNoData[band] && value == noData[band] );
+  }
+
+  void run()
+  {
+    int nBands = noData.size();
+    result.resize( nBands * nRows * targetWidth );
+    double* out = result.data();
+
+    for ( int band = 0; band < nBands; ++band )
+    {
+      const double* in = input.constData() + band * srcRows * srcWidth;
+
+      if ( !average )
+      {
+        //nearest: the input holds the picked source row of every target row
+        for ( int row = 0; row < nRows; ++row )
+        {
+          const double* srcRow = in + row * srcWidth;
+          for ( int x = 0; x < targetWidth; ++x )
+          {
+            *out++ = srcRow[qMin( x * ratio + offset, srcWidth - 1 )];
+          }
+        }
+        continue;
+      }
+
+      double empty = hasNoData[band] ? noData[band] : std::numeric_limits<double>::quiet_NaN();
+      for ( int row = 0; row < nRows; ++row )
+      {
+        int srcRow0 = row * ratio;
+        int srcRow1 = qMin( srcRow0 + ratio, srcRows );
+        for ( int x = 0; x < targetWidth; ++x )
+        {
+          int srcX0 = x * ratio;
+          int srcX1 = qMin( srcX0 + ratio, srcWidth );
+          double sum = 0;
+          int count = 0;
+          for ( int srcRow = srcRow0; srcRow < srcRow1; ++srcRow )
+          {
+            const double* value = in + srcRow * srcWidth;
+            for ( int srcX = srcX0; srcX < srcX1; ++srcX )
+            {
+              if ( !isNoData( band, value[srcX] ) )
+              {
+                sum += value[srcX];
+                ++count;
+              }
+            }
+          }
+          *out++ = count > 0 ? sum / count : empty;
+        }
+      }
+    }
+  }
+};
+
+QgsGdalPyramidBuilder::QgsGdalPyramidBuilder( GDALDatasetH theDataset, const QString& theSourceFile, const QString& theResumeFile )
+    : mDataset( theDataset )
+    , mSourceFile( theSourceFile )
+    , mResumeFile( theResumeFile )
+    , mFailed( false )
+{
+}
+
+QgsGdalPyramidBuilder::Result QgsGdalPyramidBuilder::build( const QVector<int>& theLevels, const QString& theMethod,
+    GDALProgressFunc theProgress, void* theProgressArg )
+{
+  mFailed = false;
+
+  QVector<int> myLevels;
+  foreach ( int level, theLevels )
+  {
+    if ( level > 1 && !myLevels.contains( level ) )
+      myLevels.append( level );
+  }
+  qSort( myLevels );
+  int myBandCount = GDALGetRasterCount( mDataset );
+  if ( myLevels.isEmpty() || myBandCount < 1 )
+  {
+    return Success;
+  }
+
+  //read the position before creating the overview structure, which may touch the overview file
+  Position myStart = readResumeFile( myLevels, theMethod );
+
+  //create the overview structure without calculating it, levels which exist already are kept
+  CPLErrorReset();
+  CPLErr myError = GDALBuildOverviews( mDataset, "NONE", myLevels.size(), myLevels.data(), 0, NULL, NULL, NULL );
+  if ( myError == CE_Failure || CPLGetLastErrorNo() == CPLE_NotSupported )
+  {
+    QgsDebugMsg( "Creating the overview structure failed" );
+    return Unsupported;
+  }
+  for ( int band = 1; band <= myBandCount; ++band )
+  {
+    foreach ( int level, myLevels )
+    {
+      if ( !overviewBand( GDALGetRasterBand( mDataset, band ), level ) )
+      {
+        QgsDebugMsg( QString( "Overview %1 of band %2 not found" ).arg( level ).arg( band ) );
+        return Unsupported;
+      }
+    }
+  }
+
+  if ( myStart.levelIndex > 0 || myStart.row > 0 )
+  {
+    QgsDebugMsg( QString( "Resuming pyramid build at level %1 row %2" ).arg( myLevels[myStart.levelIndex] ).arg( myStart.row ) );
+  }
+  writeResumeFile( myLevels, theMethod, myStart );
+
+  QByteArray myMethod = theMethod.toLocal8Bit();
+  bool myNearest = theMethod.compare( "NEAREST", Qt::CaseInsensitive ) == 0;
+  bool myTiledMethod = myNearest || theMethod.compare( "AVERAGE", Qt::CaseInsensitive ) == 0;
+  double myProgressSize = 1.0 / myLevels.size();
+
+  for ( int levelIndex = myStart.levelIndex; levelIndex < myLevels.size(); ++levelIndex )
+  {
+    int myLevel = myLevels[levelIndex];
+
+    //the finest level already built whose factor divides this one, nearest reads one row per target row anyway
+    int mySourceLevel = 1;
+    for ( int i = levelIndex - 1; i >= 0 && !myNearest; --i )
+    {
+      if ( myLevel % myLevels[i] == 0 )
+      {
+        mySourceLevel = myLevels[i];
+        break;
+      }
+    }
+
+    QVector<GDALRasterBandH> myBaseBands;
+    QVector<GDALRasterBandH> myTargets;
+    QVector<GDALRasterBandH> mySources;
+    bool myComplex = false;
+    for ( int band = 1; band <= myBandCount; ++band )
+    {
+      GDALRasterBandH myBaseBand = GDALGetRasterBand( mDataset, band );
+      myBaseBands << myBaseBand;
+      myTargets << overviewBand( myBaseBand, myLevel );
+      mySources << ( mySourceLevel > 1 ? overviewBand( myBaseBand, mySourceLevel ) : myBaseBand );
+      myComplex = myComplex || GDALDataTypeIsComplex( GDALGetRasterDataType( myBaseBand ) );
+    }
+
+    //all bands of a dataset have the same size
+    int myRatio = myLevel / mySourceLevel;
+    int myTargetWidth = GDALGetRasterBandXSize( myTargets[0] );
+    int myTargetHeight = GDALGetRasterBandYSize( myTargets[0] );
+    bool myAligned = myTargetWidth == ( GDALGetRasterBandXSize( mySources[0] ) + myRatio - 1 ) / myRatio
+                     && myTargetHeight == ( GDALGetRasterBandYSize( mySources[0] ) + myRatio - 1 ) / myRatio;
+    if ( !myAligned && mySourceLevel > 1 )
+    {
+      mySources = myBaseBands;
+      myRatio = myLevel;
+      myAligned = myTargetWidth == ( GDALGetRasterBandXSize( mySources[0] ) + myRatio - 1 ) / myRatio
+                  && myTargetHeight == ( GDALGetRasterBandYSize( mySources[0] ) + myRatio - 1 ) / myRatio;
+    }
+    bool myTiled = myTiledMethod && myAligned && !myComplex;
+
+    Position myPosition = { levelIndex, 0 };
+    if ( levelIndex == myStart.levelIndex && myTiled )
+    {
+      myPosition.row = myStart.row;
+    }
+
+    QString myMessage = QString( "Building overview level %1 of %2 (1:%3)" ).arg( levelIndex + 1 ).arg( myLevels.size() ).arg( myLevel );
+    QByteArray myMessageData = myMessage.toLocal8Bit();
+    double myProgressStart = levelIndex * myProgressSize;
+    if ( theProgress && !theProgress( myProgressStart, myMessageData.constData(), theProgressArg ) )
+    {
+      writeResumeFile( myLevels, theMethod, myPosition );
+      return Canceled;
+    }
+
+    if ( myTiled )
+    {
+      if ( !buildLevel( mySources, myTargets, myRatio, myLevels, theMethod, myPosition,
+                        theProgress, theProgressArg, myProgressStart, myProgressSize ) )
+      {
+        return mFailed ? Failed : Canceled;
+      }
+    }
+    else
+    {
+      //other methods are calculated by GDAL band by band, the level is resumed from its start
+      for ( int band = 0; band < myBandCount; ++band )
+      {
+        double myBandStart = myProgressStart + myProgressSize * band / myBandCount;
+        void* myScaledProgress = GDALCreateScaledProgress( myBandStart, myBandStart + myProgressSize / myBandCount,
+                                 theProgress ? theProgress : GDALDummyProgress, theProgressArg );
+        CPLErrorReset();
+        myError = GDALRegenerateOverviews( mySources[band], 1, &myTargets[band], myMethod.constData(), GDALScaledProgress, myScaledProgress );
+        GDALDestroyScaledProgress( myScaledProgress );
+        if ( myError == CE_Failure )
+        {
+          return CPLGetLastErrorNo() == CPLE_UserInterrupt ? Canceled : Failed;
+        }
+        GDALFlushRasterCache( myTargets[band] );
+      }
+    }
+
+    Position myNext = { levelIndex + 1, 0 };
+    writeResumeFile( myLevels, theMethod, myNext );
+  }
+
+  removeResumeFile();
+  if ( theProgress )
+  {
+    theProgress( 1.0, "", theProgressArg );
+  }
+  return Success;
+}
+
+bool QgsGdalPyramidBuilder::buildLevel( const QVector<GDALRasterBandH>& theSources, const QVector<GDALRasterBandH>& theTargets, int theRatio,
+                                        const QVector<int>& theLevels, const QString& theMethod, Position thePosition,
+                                        GDALProgressFunc theProgress, void* theProgressArg, double theProgressStart, double theProgressSize )
+{
+  int myTargetWidth = GDALGetRasterBandXSize( theTargets[0] );
+  int myTargetHeight = GDALGetRasterBandYSize( theTargets[0] );
+
+  QgsGdalPyramidTile myTemplate;
+  myTemplate.targetWidth = myTargetWidth;
+  myTemplate.srcWidth = GDALGetRasterBandXSize( theSources[0] );
+  myTemplate.ratio = theRatio;
+  myTemplate.average = theMethod.compare( "AVERAGE", Qt::CaseInsensitive ) == 0;
+#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 2000000
+  //GDAL 2 picks the center cell of the window
+  myTemplate.offset = theRatio / 2;
+#else
+  myTemplate.offset = 0;
+#endif
+  foreach ( GDALRasterBandH mySource, theSources )
+  {
+    int myHasNoData = 0;
+    myTemplate.noData << GDALGetRasterNoDataValue( mySource, &myHasNoData );
+    myTemplate.hasNoData << myHasNoData;
+  }
+
+  //the tiles of one batch are calculated in parallel while the next batch is read and the previous one written from this thread
+  QVector<QgsGdalPyramidTile> myBatches[2];
+  int myCurrent = 0;
+  int myNextRow = readTiles( theSources, myBatches[myCurrent], myTemplate, thePosition.row, myTargetHeight );
+
+  while ( !myBatches[myCurrent].isEmpty() )
+  {
+    QFuture<void> myFuture = QtConcurrent::map( myBatches[myCurrent], &QgsGdalPyramidTile::run );
+    myNextRow = readTiles( theSources, myBatches[1 - myCurrent], myTemplate, myNextRow, myTargetHeight );
+    myFuture.waitForFinished();
+    if ( mFailed )
+    {
+      return false;
+    }
+
+    //write the tiles in order, all bands of a tile together
+    for ( int i = 0; i < myBatches[myCurrent].size(); ++i )
+    {
+      QgsGdalPyramidTile& tile = myBatches[myCurrent][i];
+      for ( int band = 0; band < theTargets.size(); ++band )
+      {
+        if ( GDALRasterIO( theTargets[band], GF_Write, 0, tile.firstRow, myTargetWidth, tile.nRows,
+                           tile.result.data() + band * tile.nRows * myTargetWidth,
+                           myTargetWidth, tile.nRows, GDT_Float64, 0, 0 ) != CE_None )
+        {
+          QgsDebugMsg( "Writing overview failed" );
+          mFailed = true;
+          return false;
+        }
+      }
+    }
+
+    //store the position only after the rows of every band are on disk
+    foreach ( GDALRasterBandH myTarget, theTargets )
+    {
+      GDALFlushRasterCache( myTarget );
+    }
+    const QgsGdalPyramidTile& myLast = myBatches[myCurrent].last();
+    thePosition.row = myLast.firstRow + myLast.nRows;
+    writeResumeFile( theLevels, theMethod, thePosition );
+
+    myBatches[myCurrent].clear();
+    myCurrent = 1 - myCurrent;
+
+    double myProgress = theProgressStart + theProgressSize * thePosition.row / myTargetHeight;
+    if ( theProgress && !theProgress( myProgress, "", theProgressArg ) )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+int QgsGdalPyramidBuilder::readTiles( const QVector<GDALRasterBandH>& theSources, QVector<QgsGdalPyramidTile>& theTiles,
+                                      const QgsGdalPyramidTile& theTemplate, int theFirstRow, int theTargetHeight )
+{
+  int myBandCount = theSources.size();
+  int mySrcWidth = theTemplate.srcWidth;
+  int mySrcHeight = GDALGetRasterBandYSize( theSources[0] );
+  int myRatio = theTemplate.ratio;
+  int myRowsPerTile = qMax( 1, sTileCells / ( mySrcWidth * myBandCount * ( theTemplate.average ? myRatio : 1 ) ) );
+  int myMaxTiles = 2 * qMax( 1, QThread::idealThreadCount() );
+
+  while ( theFirstRow < theTargetHeight && theTiles.size() < myMaxTiles && !mFailed )
+  {
+    QgsGdalPyramidTile tile = theTemplate;
+    tile.firstRow = theFirstRow;
+    tile.nRows = qMin( myRowsPerTile, theTargetHeight - theFirstRow );
+
+    int mySrcFirstRow = theFirstRow * myRatio;
+    if ( tile.average )
+    {
+      tile.srcRows = qMin( tile.nRows * myRatio, mySrcHeight - mySrcFirstRow );
+      tile.input.resize( myBandCount * tile.srcRows * mySrcWidth );
+      for ( int band = 0; band < myBandCount && !mFailed; ++band )
+      {
+        if ( GDALRasterIO( theSources[band], GF_Read, 0, mySrcFirstRow, mySrcWidth, tile.srcRows,
+                           tile.input.data() + band * tile.srcRows * mySrcWidth,
+                           mySrcWidth, tile.srcRows, GDT_Float64, 0, 0 ) != CE_None )
+        {
+          mFailed = true;
+        }
+      }
+    }
+    else
+    {
+      //nearest only needs the picked source row of every target row
+      tile.srcRows = tile.nRows;
+      tile.input.resize( myBandCount * tile.nRows * mySrcWidth );
+      for ( int band = 0; band < myBandCount && !mFailed; ++band )
+      {
+        double* myBandInput = tile.input.data() + band * tile.nRows * mySrcWidth;
+        for ( int row = 0; row < tile.nRows && !mFailed; ++row )
+        {
+          int mySrcRow = qMin( mySrcFirstRow + row * myRatio + tile.offset, mySrcHeight - 1 );
+          if ( GDALRasterIO( theSources[band], GF_Read, 0, mySrcRow, mySrcWidth, 1, myBandInput + row * mySrcWidth,
+                             mySrcWidth, 1, GDT_Float64, 0, 0 ) != CE_None )
+          {
+            mFailed = true;
+          }
+        }
+      }
+    }
+    if ( mFailed )
+    {
+      QgsDebugMsg( "Reading overview source failed" );
+      break;
+    }
+
+    theTiles.append( tile );
+    theFirstRow += tile.nRows;
+  }
+  return theFirstRow;
+}
+
+GDALRasterBandH QgsGdalPyramidBuilder::overviewBand( GDALRasterBandH theBand, int theFactor )
+{
+  int myWidth = ( GDALGetRasterBandXSize( theBand ) + theFactor - 1 ) / theFactor;
+  int myHeight = ( GDALGetRasterBandYSize( theBand ) + theFactor - 1 ) / theFactor;
+  for ( int i = 0; i < GDALGetOverviewCount( theBand ); ++i )
+  {
+    GDALRasterBandH myOverview = GDALGetOverview( theBand, i );
+    if ( GDALGetRasterBandXSize( myOverview ) == myWidth && GDALGetRasterBandYSize( myOverview ) == myHeight )
+    {
+      return myOverview;
+    }
+  }
+  return 0;
+}
+
+QString QgsGdalPyramidBuilder::fileStamp( const QString& theFile )
+{
+  QFileInfo myFileInfo( theFile );
+  if ( !myFileInfo.isFile() )
+  {
+    return QString();
+  }
+  return QString( "%1 %2" ).arg( myFileInfo.size() ).arg( myFileInfo.lastModified().toMSecsSinceEpoch() );
+}
+
+QgsGdalPyramidBuilder::Position QgsGdalPyramidBuilder::readResumeFile( const QVector<int>& theLevels, const QString& theMethod ) const
+{
+  Position myStart = { 0, 0 };
+  QFile myFile( mResumeFile );
+  if ( mResumeFile.isEmpty() || !myFile.open( QIODevice::ReadOnly | QIODevice::Text ) )
+  {
+    return myStart;
+  }
+
+  //method, levels, source and overview stamps and position on five lines, the file is only used for the same build
+  //of the same source whose overviews were not modified since the position was stored
+  QTextStream myStream( &myFile );
+  QString myMethod = myStream.readLine();
+  QStringList myLevels = myStream.readLine().split( " ", QString::SkipEmptyParts );
+  QString myStamp = myStream.readLine();
+  QString myOverviewStamp = myStream.readLine();
+  QStringList myPosition = myStream.readLine().split( " ", QString::SkipEmptyParts );
+  if ( myMethod.compare( theMethod, Qt::CaseInsensitive ) != 0 || myLevels.size() != theLevels.size() || myPosition.size() != 2 )
+  {
+    return myStart;
+  }
+  for ( int i = 0; i < theLevels.size(); ++i )
+  {
+    if ( myLevels[i].toInt() != theLevels[i] )
+    {
+      return myStart;
+    }
+  }
+  QString mySourceStamp = fileStamp( mSourceFile );
+  if ( mySourceStamp.isEmpty() || myStamp != mySourceStamp )
+  {
+    QgsDebugMsg( "The source was modified, the pyramid build starts from the beginning" );
+    return myStart;
+  }
+  //an external overview file written after the position was stored (e.g. by an interrupted write) or replaced
+  if ( myOverviewStamp != fileStamp( mSourceFile + ".ovr" ) )
+  {
+    QgsDebugMsg( "The overview file was modified, the pyramid build starts from the beginning" );
+    return myStart;
+  }
+
+  Position myResume = { myPosition[0].toInt(), myPosition[1].toInt() };
+  if ( myResume.levelIndex < 0 || myResume.levelIndex >= theLevels.size() || myResume.row < 0 )
+  {
+    return myStart;
+  }
+  return myResume;
+}
+
+void QgsGdalPyramidBuilder::writeResumeFile( const QVector<int>& theLevels, const QString& theMethod, const Position& thePosition )
+{
+  if ( mResumeFile.isEmpty() )
+  {
+    return;
+  }
+  mResumeLevels = theLevels;
+  mResumeMethod = theMethod;
+  mResumePosition = thePosition;
+
+  QFile myFile( mResumeFile );
+  if ( !myFile.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+  {
+    QgsDebugMsg( "Cannot write pyramid resume file " + mResumeFile );
+    return;
+  }
+  QTextStream myStream( &myFile );
+  myStream << theMethod << "\n";
+  foreach ( int level, theLevels )
+  {
+    myStream << level << " ";
+  }
+  myStream << "\n" << fileStamp( mSourceFile ) << "\n" << fileStamp( mSourceFile + ".ovr" ) << "\n";
+  myStream << thePosition.levelIndex << " " << thePosition.row << "\n";
+}
+
+void QgsGdalPyramidBuilder::updateResumeFile()
+{
+  if ( mResumeLevels.isEmpty() || !QFile::exists( mResumeFile ) )
+  {
+    return;
+  }
+  writeResumeFile( mResumeLevels, mResumeMethod, mResumePosition );
+}
+
+void QgsGdalPyramidBuilder::removeResumeFile()
+{
+  mResumeLevels.clear();
+  if ( !mResumeFile.isEmpty() )
+  {
+    QFile::remove( mResumeFile );
+  }
+}
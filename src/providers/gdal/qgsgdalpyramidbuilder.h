@@ -0,0 +1,110 @@
+/***************************************************************************
+                          qgsgdalpyramidbuilder.h
+            Builds overviews level by level from the previous level
+                          --------------------
+    begin                : 2013-12-22
+    copyright            : (C) 2013 by the QGIS Development Team
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSGDALPYRAMIDBUILDER_H
+#define QGSGDALPYRAMIDBUILDER_H
+
+#include <QString>
+#include <QVector>
+
+#include <gdal.h>
+
+struct QgsGdalPyramidTile;
+
+/**Builds the overviews of a GDAL dataset one level after the other.
+
+  GDALBuildOverviews computes every level from the full resolution raster. The builder creates the
+  overview structure with GDALBuildOverviews( "NONE" ) first and then derives every AVERAGE level from the
+  finest level already built whose factor divides its own factor. NEAREST only needs one source row per
+  target row and reads the full resolution raster, so that it picks the same cells as GDAL. Both are
+  calculated for tiles of rows of all bands on a worker pool like GDALRegenerateOverviewsMultiBand, the
+  other methods are passed to GDALRegenerateOverviews. Reads and writes are done from the calling thread only.
+
+  Progress is reported per level through the GDAL progress function, returning false from it cancels the
+  build. The written tiles are flushed and the position is stored in a resume file together with the size
+  and modification time of the source and of the external overview file (.ovr), so that a canceled or
+  interrupted build continues where it stopped when it is started again with the same levels and method
+  on the unchanged source and overviews. GDAL writes to the overview file when the dataset is closed, the
+  caller updates the stored sizes and times with updateResumeFile() once it has closed a canceled build.
+  */
+class QgsGdalPyramidBuilder
+{
+  public:
+    enum Result
+    {
+      Success,
+      Canceled,
+      Failed,
+      //! the overview structure could not be created, GDALBuildOverviews should be used directly
+      Unsupported
+    };
+
+    /**@param theDataset dataset to build the overviews for, opened in update mode for internal overviews
+      @param theSourceFile file of the dataset, a resume file is only used while it is not modified
+      @param theResumeFile file storing the position of an unfinished build, empty to disable resuming*/
+    QgsGdalPyramidBuilder( GDALDatasetH theDataset, const QString& theSourceFile, const QString& theResumeFile );
+
+    /**Builds the overviews
+      @param theLevels decimation factors
+      @param theMethod GDAL resampling method
+      @param theProgress progress function, may be 0
+      @param theProgressArg argument of the progress function*/
+    Result build( const QVector<int>& theLevels, const QString& theMethod,
+                  GDALProgressFunc theProgress, void* theProgressArg );
+
+    /**Stores the current size and modification time of the source and overview files in the resume file
+      of an unfinished build, to be called after the dataset was closed*/
+    void updateResumeFile();
+
+  private:
+    //! position of the build, the levels before levelIndex and the rows before row of all bands are done
+    struct Position
+    {
+      int levelIndex;
+      int row;
+    };
+
+    Position readResumeFile( const QVector<int>& theLevels, const QString& theMethod ) const;
+    void writeResumeFile( const QVector<int>& theLevels, const QString& theMethod, const Position& thePosition );
+    void removeResumeFile();
+
+    /**Size and modification time of a file, empty if it does not exist*/
+    static QString fileStamp( const QString& theFile );
+
+    /**Overview band of theBand for the given factor or 0*/
+    static GDALRasterBandH overviewBand( GDALRasterBandH theBand, int theFactor );
+
+    /**Calculates the target rows of all bands from theFirstRow on, returns false if the build was canceled or failed*/
+    bool buildLevel( const QVector<GDALRasterBandH>& theSources, const QVector<GDALRasterBandH>& theTargets, int theRatio,
+                     const QVector<int>& theLevels, const QString& theMethod, Position thePosition,
+                     GDALProgressFunc theProgress, void* theProgressArg, double theProgressStart, double theProgressSize );
+
+    int readTiles( const QVector<GDALRasterBandH>& theSources, QVector<QgsGdalPyramidTile>& theTiles,
+                   const QgsGdalPyramidTile& theTemplate, int theFirstRow, int theTargetHeight );
+
+    GDALDatasetH mDataset;
+    QString mSourceFile;
+    QString mResumeFile;
+    bool mFailed;
+
+    //! the last stored build, the levels are empty if none was stored or the build finished
+    QVector<int> mResumeLevels;
+    QString mResumeMethod;
+    Position mResumePosition;
+};
+
+#endif // QGSGDALPYRAMIDBUILDER_H
@@ -44,8 +44,7 @@ QgsMemoryFeatureIterator::QgsMemoryFeatureIterator( QgsMemoryProvider* p, const
   else if ( mRequest.filterType() == QgsFeatureRequest::FilterFid )
   {
     mUsingFeatureIdList = true;
-    QgsFeatureMap::iterator it = P->mFeatures.find( mRequest.filterFid() );
-    if ( it != P->mFeatures.end() )
+    if ( P->mRows.contains( mRequest.filterFid() ) )
       mFeatureIdList.append( mRequest.filterFid() );
   }
   else
@@ -81,15 +80,19 @@ bool QgsMemoryFeatureIterator::nextFeatureUsingList( QgsFeature& feature )
   bool hasFeature = false;
 
   // option 1: we have a list of features to traverse
+  int row = -1;
   while ( mFeatureIdListIterator != mFeatureIdList.end() )
   {
-    if ( mRequest.filterType() == QgsFeatureRequest::FilterRect && mRequest.flags() & QgsFeatureRequest::ExactIntersect )
+    // skip features deleted since the list was made
+    row = P->mRows.value( *mFeatureIdListIterator, -1 );
+    if ( row >= 0 && mRequest.filterType() == QgsFeatureRequest::FilterRect && mRequest.flags() & QgsFeatureRequest::ExactIntersect )
     {
       // do exact check in case we're doing intersection
-      if ( P->mFeatures[*mFeatureIdListIterator].geometry() && P->mFeatures[*mFeatureIdListIterator].geometry()->intersects( mSelectRectGeom ) )
+      QgsGeometry* geom = P->mTable.geometry( row );
+      if ( geom && geom->intersects( mSelectRectGeom ) )
         hasFeature = true;
     }
-    else
+    else if ( row >= 0 )
       hasFeature = true;
 
     if ( hasFeature )
@@ -101,8 +104,9 @@ bool QgsMemoryFeatureIterator::nextFeatureUsingList( QgsFeature& feature )
   // copy feature
   if ( hasFeature )
   {
-    feature = P->mFeatures[*mFeatureIdListIterator];
+    P->mTable.feature( row, feature );
     ++mFeatureIdListIterator;
+    feature.setValid( true );
   }
   else
     close();
@@ -119,7 +123,7 @@ bool QgsMemoryFeatureIterator::nextFeatureTraverseAll( QgsFeature& feature )
   bool hasFeature = false;
 
   // option 2: traversing the whole layer
-  while ( mSelectIterator != P->mFeatures.end() )
+  while ( mSelectIterator != P->mRows.constEnd() )
   {
     if ( mRequest.filterType() != QgsFeatureRequest::FilterRect )
     {
@@ -128,16 +132,17 @@ bool QgsMemoryFeatureIterator::nextFeatureTraverseAll( QgsFeature& feature )
     }
     else
     {
+      QgsGeometry* geom = P->mTable.geometry( mSelectIterator.value() );
       if ( mRequest.flags() & QgsFeatureRequest::ExactIntersect )
       {
         // using exact test when checking for intersection
-        if ( mSelectIterator->geometry() && mSelectIterator->geometry()->intersects( mSelectRectGeom ) )
+        if ( geom && geom->intersects( mSelectRectGeom ) )
           hasFeature = true;
       }
       else
       {
         // check just bounding box against rect when not using intersection
-        if ( mSelectIterator->geometry() && mSelectIterator->geometry()->boundingBox().intersects( mRequest.filterRect() ) )
+        if ( geom && geom->boundingBox().intersects( mRequest.filterRect() ) )
           hasFeature = true;
       }
     }
@@ -151,7 +156,7 @@ bool QgsMemoryFeatureIterator::nextFeatureTraverseAll( QgsFeature& feature )
   // copy feature
   if ( hasFeature )
   {
-    feature = mSelectIterator.value();
+    P->mTable.feature( mSelectIterator.value(), feature );
     ++mSelectIterator;
     feature.setValid( true );
     feature.setFields( &P->mFields ); // allow name-based attribute lookups
@@ -170,7 +175,7 @@ bool QgsMemoryFeatureIterator::rewind()
   if ( mUsingFeatureIdList )
     mFeatureIdListIterator = mFeatureIdList.begin();
   else
-    mSelectIterator = P->mFeatures.begin();
+    mSelectIterator = P->mRows.constBegin();
 
   return true;
 }
@@ -19,8 +19,6 @@
 
 class QgsMemoryProvider;
 
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
-
 
 class QgsMemoryFeatureIterator : public QgsAbstractFeatureIterator
 {
@@ -46,7 +44,7 @@ class QgsMemoryFeatureIterator : public QgsAbstractFeatureIterator
     QgsMemoryProvider* P;
 
     QgsGeometry* mSelectRectGeom;
-    QgsFeatureMap::iterator mSelectIterator;
+    QMap<QgsFeatureId, int>::const_iterator mSelectIterator;
     bool mUsingFeatureIdList;
     QList<QgsFeatureId> mFeatureIdList;
     QList<QgsFeatureId>::iterator mFeatureIdListIterator;
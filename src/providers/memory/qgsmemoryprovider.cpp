@@ -270,7 +270,7 @@ QGis::WkbType QgsMemoryProvider::geometryType() const
 
 long QgsMemoryProvider::featureCount() const
 {
-  return mFeatures.count();
+  return mRows.count();
 }
 
 const QgsFields & QgsMemoryProvider::fields() const
@@ -293,16 +293,15 @@ QgsCoordinateReferenceSystem QgsMemoryProvider::crs()
 bool QgsMemoryProvider::addFeatures( QgsFeatureList & flist )
 {
   // TODO: sanity checks of fields and geometries
+  mTable.reserve( mTable.count() + flist.size() );
   for ( QgsFeatureList::iterator it = flist.begin(); it != flist.end(); ++it )
   {
-    mFeatures[mNextFeatureId] = *it;
-    QgsFeature& newfeat = mFeatures[mNextFeatureId];
-    newfeat.setFeatureId( mNextFeatureId );
     it->setFeatureId( mNextFeatureId );
+    mRows.insert( mNextFeatureId, mTable.append( *it ) );
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->insertFeature( newfeat );
+      mSpatialIndex->insertFeature( *it );
 
     mNextFeatureId++;
   }
@@ -316,17 +315,28 @@ bool QgsMemoryProvider::deleteFeatures( const QgsFeatureIds & id )
 {
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( *it );
+    QMap<QgsFeatureId, int>::iterator fit = mRows.find( *it );
 
     // check whether such feature exists
-    if ( fit == mFeatures.end() )
+    if ( fit == mRows.end() )
       continue;
 
+    int row = fit.value();
+
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
+    {
+      QgsFeature f;
+      mTable.feature( row, f );
+      mSpatialIndex->deleteFeature( f );
+    }
 
-    mFeatures.erase( fit );
+    mRows.erase( fit );
+
+    // the last feature moves into the row
+    mTable.removeRow( row );
+    if ( row < mTable.count() )
+      mRows[mTable.id( row )] = row;
   }
 
   updateExtent();
@@ -353,12 +363,7 @@ bool QgsMemoryProvider::addAttributes( const QList<QgsField> &attributes )
     }
     // add new field as a last one
     mFields.append( *it );
-
-    for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
-    {
-      QgsFeature& f = fit.value();
-      f.attributes().append( QVariant() );
-    }
+    mTable.addField( *it );
   }
   return true;
 }
@@ -373,12 +378,7 @@ bool QgsMemoryProvider::deleteAttributes( const QgsAttributeIds& attributes )
   {
     int idx = *it;
     mFields.remove( idx );
-
-    for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
-    {
-      QgsFeature& f = fit.value();
-      f.attributes().remove( idx );
-    }
+    mTable.removeField( idx );
   }
   return true;
 }
@@ -387,13 +387,13 @@ bool QgsMemoryProvider::changeAttributeValues( const QgsChangedAttributesMap & a
 {
   for ( QgsChangedAttributesMap::const_iterator it = attr_map.begin(); it != attr_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    QMap<QgsFeatureId, int>::const_iterator fit = mRows.constFind( it.key() );
+    if ( fit == mRows.constEnd() )
       continue;
 
     const QgsAttributeMap& attrs = it.value();
     for ( QgsAttributeMap::const_iterator it2 = attrs.begin(); it2 != attrs.end(); ++it2 )
-      fit->setAttribute( it2.key(), it2.value() );
+      mTable.setAttribute( fit.value(), it2.key(), it2.value() );
   }
   return true;
 }
@@ -402,19 +402,21 @@ bool QgsMemoryProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
 {
   for ( QgsGeometryMap::const_iterator it = geometry_map.begin(); it != geometry_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    QMap<QgsFeatureId, int>::const_iterator fit = mRows.constFind( it.key() );
+    if ( fit == mRows.constEnd() )
       continue;
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
-
-    fit->setGeometry( it.value() );
+    {
+      QgsFeature f;
+      mTable.feature( fit.value(), f );
+      mSpatialIndex->deleteFeature( f );
+      f.setGeometry( it.value() );
+      mSpatialIndex->insertFeature( f );
+    }
 
-    // update spatial index
-    if ( mSpatialIndex )
-      mSpatialIndex->insertFeature( *fit );
+    mTable.setGeometry( fit.value(), &it.value() );
   }
 
   updateExtent();
@@ -422,17 +424,40 @@ bool QgsMemoryProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
   return true;
 }
 
-bool QgsMemoryProvider::createSpatialIndex()
+// bounding boxes of the features for bulk loading the spatial index
+class QgsMemoryFeatureEntryStream : public QgsSpatialIndex::EntryStream
 {
-  if ( !mSpatialIndex )
-  {
-    mSpatialIndex = new QgsSpatialIndex();
+  public:
+    QgsMemoryFeatureEntryStream( const QgsFeatureTable& table )
+        : mTable( table ), mRow( 0 ) {}
 
-    // add existing features to index
-    for ( QgsFeatureMap::iterator it = mFeatures.begin(); it != mFeatures.end(); ++it )
+    bool nextEntry( QgsFeatureId& theId, QgsRectangle& theRect )
     {
-      mSpatialIndex->insertFeature( *it );
+      for ( ; mRow < mTable.count(); ++mRow )
+      {
+        if ( mTable.geometry( mRow ) )
+        {
+          theId = mTable.id( mRow );
+          theRect = mTable.geometry( mRow )->boundingBox();
+          ++mRow;
+          return true;
+        }
+      }
+      return false;
     }
+
+  private:
+    const QgsFeatureTable& mTable;
+    int mRow;
+};
+
+bool QgsMemoryProvider::createSpatialIndex()
+{
+  if ( !mSpatialIndex )
+  {
+    // bulk load the existing features
+    QgsMemoryFeatureEntryStream stream( mTable );
+    mSpatialIndex = new QgsSpatialIndex( stream );
   }
   return true;
 }
@@ -447,16 +472,16 @@ int QgsMemoryProvider::capabilities() const
 
 void QgsMemoryProvider::updateExtent()
 {
-  if ( mFeatures.count() == 0 )
+  if ( mTable.count() == 0 )
   {
     mExtent = QgsRectangle();
   }
   else
   {
-    Q_FOREACH( const QgsFeature& feat, mFeatures )
+    for ( int row = 0; row < mTable.count(); ++row )
     {
-      if ( feat.geometry() )
-        mExtent.unionRect( feat.geometry()->boundingBox() );
+      if ( mTable.geometry( row ) )
+        mExtent.unionRect( mTable.geometry( row )->boundingBox() );
     }
   }
 }
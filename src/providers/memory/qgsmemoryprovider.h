@@ -15,10 +15,9 @@
 
 #include "qgsvectordataprovider.h"
 #include "qgscoordinatereferencesystem.h"
+#include "qgsfeaturetable.h"
 
 
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
-
 class QgsSpatialIndex;
 
 class QgsMemoryFeatureIterator;
@@ -161,8 +160,10 @@ class QgsMemoryProvider : public QgsVectorDataProvider
     QGis::WkbType mWkbType;
     QgsRectangle mExtent;
 
-    // features
-    QgsFeatureMap mFeatures;
+    // features, attributes in typed columns
+    QgsFeatureTable mTable;
+    // row of each feature in mTable
+    QMap<QgsFeatureId, int> mRows;
     QgsFeatureId mNextFeatureId;
 
     // indexing
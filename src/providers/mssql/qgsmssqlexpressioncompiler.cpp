@@ -0,0 +1,40 @@
+/***************************************************************************
+    qgsmssqlexpressioncompiler.cpp
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgsmssqlexpressioncompiler.h"
+
+// the default collations of SQL Server ignore case and trailing blanks,
+// so only numeric comparisons are translated
+QgsMssqlExpressionCompiler::QgsMssqlExpressionCompiler( const QgsFields& fields )
+    : QgsSqlExpressionCompiler( fields, CaseInsensitiveStrings )
+{
+}
+
+QString QgsMssqlExpressionCompiler::quotedIdentifier( const QString& identifier )
+{
+  QString quoted = identifier;
+  quoted.replace( "]", "]]" );
+  return QString( "[%1]" ).arg( quoted );
+}
+
+QString QgsMssqlExpressionCompiler::quotedValue( const QVariant& value )
+{
+  if ( value.type() == QVariant::String )
+  {
+    QString quoted = value.toString();
+    quoted.replace( "'", "''" );
+    return QString( "N'%1'" ).arg( quoted );
+  }
+
+  return QgsSqlExpressionCompiler::quotedValue( value );
+}
@@ -17,9 +17,11 @@
 
 #include "qgsmssqlfeatureiterator.h"
 #include "qgsmssqlprovider.h"
+#include "qgsmssqlexpressioncompiler.h"
 #include "qgslogger.h"
 
 #include <QObject>
+#include <QSettings>
 #include <QTextStream>
 
 
@@ -27,6 +29,7 @@ QgsMssqlFeatureIterator::QgsMssqlFeatureIterator( QgsMssqlProvider* provider, co
     : QgsAbstractFeatureIterator( request ), mProvider( provider )
 {
   mIsOpen = false;
+  mExpressionCompiled = false;
   BuildStatement( request );
 
   mQuery = NULL;
@@ -169,6 +172,23 @@ void QgsMssqlFeatureIterator::BuildStatement( const QgsFeatureRequest& request )
     filterAdded = true;
   }
 
+  // translate the filter expression
+  if ( request.filterType() == QgsFeatureRequest::FilterExpression
+       && QSettings().value( "/qgis/compileExpressions", true ).toBool() )
+  {
+    QgsMssqlExpressionCompiler compiler( mProvider->mAttributeFields );
+    QgsSqlExpressionCompiler::Result result = compiler.compile( request.filterExpression() );
+    if ( result == QgsSqlExpressionCompiler::Complete || result == QgsSqlExpressionCompiler::Partial )
+    {
+      if ( !filterAdded )
+        mStatement += " where " + compiler.result();
+      else
+        mStatement += " and " + compiler.result();
+      filterAdded = true;
+      mExpressionCompiled = result == QgsSqlExpressionCompiler::Complete;
+    }
+  }
+
   if ( !mProvider->mSqlWhereClause.isEmpty() )
   {
     if ( !filterAdded )
@@ -185,6 +205,15 @@ void QgsMssqlFeatureIterator::BuildStatement( const QgsFeatureRequest& request )
 }
 
 
+bool QgsMssqlFeatureIterator::nextFeatureFilterExpression( QgsFeature& f )
+{
+  if ( mExpressionCompiled )
+    return fetchFeature( f );
+
+  return QgsAbstractFeatureIterator::nextFeatureFilterExpression( f );
+}
+
+
 bool QgsMssqlFeatureIterator::fetchFeature( QgsFeature& feature )
 {
   feature.setValid( false );
@@ -48,6 +48,9 @@ class QgsMssqlFeatureIterator : public QgsAbstractFeatureIterator
     //! fetch next feature, return true on success
     virtual bool fetchFeature( QgsFeature& feature );
 
+    //! skips the local evaluation if the whole filter expression is part of the query
+    virtual bool nextFeatureFilterExpression( QgsFeature& f );
+
     // The current database
     QSqlDatabase mDatabase;
 
@@ -63,6 +66,9 @@ class QgsMssqlFeatureIterator : public QgsAbstractFeatureIterator
     // Open connection flag
     bool mIsOpen;
 
+    // The whole filter expression is part of the statement
+    bool mExpressionCompiled;
+
     // Field index of FID column
     long mFidCol;
 
@@ -0,0 +1,35 @@
+/***************************************************************************
+    qgsogrexpressioncompiler.cpp
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgsogrexpressioncompiler.h"
+
+#include <QStringList>
+
+QgsOgrExpressionCompiler::QgsOgrExpressionCompiler( const QgsFields& fields, const QString& driverName )
+    : QgsSqlExpressionCompiler( fields, flags( driverName ) )
+{
+}
+
+int QgsOgrExpressionCompiler::flags( const QString& driverName )
+{
+  // drivers which evaluate attribute filters with their own SQL engine
+  static QStringList sqlDrivers = QStringList()
+                                  << "PostgreSQL" << "MySQL" << "OCI" << "MSSQLSpatial" << "SQLite"
+                                  << "GPKG" << "ODBC" << "PGeo" << "Geomedia" << "Walk" << "FileGDB"
+                                  << "Ingres" << "IDB" << "SDE";
+  if ( sqlDrivers.contains( driverName ) )
+    return CaseInsensitiveStrings;
+
+  // string comparisons of OGR SQL ignore case with some GDAL versions
+  return LikeIsCaseInsensitive | CaseInsensitiveStrings;
+}
@@ -0,0 +1,33 @@
+/***************************************************************************
+    qgsogrexpressioncompiler.h
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSOGREXPRESSIONCOMPILER_H
+#define QGSOGREXPRESSIONCOMPILER_H
+
+#include "qgssqlexpressioncompiler.h"
+
+/** translates filter expressions to OGR attribute filters (the WHERE clause of OGR SQL)
+ * OGR SQL compares strings ignoring case with some GDAL versions, and drivers of databases
+ * pass the filter on to the database, whose string comparisons may differ: only numeric
+ * terms are translated.
+ */
+class QgsOgrExpressionCompiler : public QgsSqlExpressionCompiler
+{
+  public:
+    QgsOgrExpressionCompiler( const QgsFields& fields, const QString& driverName );
+
+  private:
+    static int flags( const QString& driverName );
+};
+
+#endif // QGSOGREXPRESSIONCOMPILER_H
@@ -16,6 +16,7 @@
 
 #include "qgsogrprovider.h"
 #include "qgsogrgeometrysimplifier.h"
+#include "qgsogrexpressioncompiler.h"
 
 #include "qgsapplication.h"
 #include "qgsgeometry.h"
@@ -24,6 +25,7 @@
 
 #include <QTextCodec>
 #include <QFile>
+#include <QSettings>
 
 // using from provider:
 // - setRelevantFields(), mRelevantFieldsForNextFeature
@@ -39,6 +41,7 @@ QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrProvider* p, const QgsFeatur
     , ogrDataSource( 0 )
     , ogrLayer( 0 )
     , mSubsetStringSet( false )
+    , mExpressionCompiled( false )
     , mGeometrySimplifier( NULL )
 {
   mFeatureFetched = false;
@@ -80,6 +83,27 @@ QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrProvider* p, const QgsFeatur
     OGR_L_SetSpatialFilter( ogrLayer, 0 );
   }
 
+  // the attribute filter only affects the layer of this iterator's data source
+  if ( mRequest.filterType() == QgsFeatureRequest::FilterExpression
+       && QSettings().value( "/qgis/compileExpressions", true ).toBool() )
+  {
+    QgsOgrExpressionCompiler compiler( P->mAttributeFields, P->ogrDriverName );
+    QgsSqlExpressionCompiler::Result result = compiler.compile( mRequest.filterExpression() );
+    if ( result == QgsSqlExpressionCompiler::Complete || result == QgsSqlExpressionCompiler::Partial )
+    {
+      QByteArray whereClause = P->mEncoding->fromUnicode( compiler.result() );
+      QgsDebugMsg( "Setting attribute filter " + compiler.result() );
+      if ( OGR_L_SetAttributeFilter( ogrLayer, whereClause.constData() ) == OGRERR_NONE )
+      {
+        mExpressionCompiled = result == QgsSqlExpressionCompiler::Complete;
+      }
+      else
+      {
+        OGR_L_SetAttributeFilter( ogrLayer, 0 );
+      }
+    }
+  }
+
   //start with first feature
   rewind();
 }
@@ -154,6 +178,14 @@ bool QgsOgrFeatureIterator::providerCanSimplify( QgsSimplifyMethod::MethodType m
   return false;
 }
 
+bool QgsOgrFeatureIterator::nextFeatureFilterExpression( QgsFeature& f )
+{
+  if ( mExpressionCompiled )
+    return fetchFeature( f );
+
+  return QgsAbstractFeatureIterator::nextFeatureFilterExpression( f );
+}
+
 bool QgsOgrFeatureIterator::fetchFeature( QgsFeature& feature )
 {
   feature.setValid( false );
@@ -294,13 +326,14 @@ bool QgsOgrFeatureIterator::readFeature( OGRFeatureH fet, QgsFeature& feature )
       if ( mGeometrySimplifier )
         mGeometrySimplifier->simplifyGeometry( geom );
 
-      // get the wkb representation
+      // get the wkb representation, into the buffer of the previous feature if it fits in
       int memorySize = OGR_G_WkbSize( geom );
-      unsigned char *wkb = new unsigned char[memorySize];
+      unsigned char *wkb = feature.geometryBuffer( memorySize );
       OGR_G_ExportToWkb( geom, ( OGRwkbByteOrder ) QgsApplication::endian(), wkb );
-
-      QgsGeometry* geometry = feature.geometry();
-      if ( !geometry ) feature.setGeometryAndOwnership( wkb, memorySize ); else geometry->fromWkb( wkb, memorySize );
+    }
+    else
+    {
+      feature.setGeometry( 0 );
     }
     if (( useIntersect && ( !feature.geometry() || !feature.geometry()->intersects( mRequest.filterRect() ) ) )
         || ( geometryTypeFilter && ( !feature.geometry() || QgsOgrProvider::ogrWkbSingleFlatten(( OGRwkbGeometryType )feature.geometry()->wkbType() ) != P->mOgrGeometryTypeFilter ) ) )
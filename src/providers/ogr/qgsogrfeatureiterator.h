@@ -39,6 +39,9 @@ class QgsOgrFeatureIterator : public QgsAbstractFeatureIterator
     //! fetch next feature, return true on success
     virtual bool fetchFeature( QgsFeature& feature );
 
+    //! skips the local evaluation if the whole filter expression is set as attribute filter
+    virtual bool nextFeatureFilterExpression( QgsFeature& f );
+
     //! Setup the simplification of geometries to fetch using the specified simplify method
     virtual bool prepareSimplification( const QgsSimplifyMethod& simplifyMethod );
 
@@ -58,6 +61,9 @@ class QgsOgrFeatureIterator : public QgsAbstractFeatureIterator
 
     bool mSubsetStringSet;
 
+    //! Set to true, if the filter expression was completely translated to an attribute filter
+    bool mExpressionCompiled;
+
     //! Set to true, if geometry is in the requested columns
     bool mFetchGeometry;
 
@@ -0,0 +1,41 @@
+/***************************************************************************
+    qgsoracleexpressioncompiler.cpp
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgsoracleexpressioncompiler.h"
+#include "qgsoracleconn.h"
+
+// Oracle has no ILIKE, UPPER() is used instead
+QgsOracleExpressionCompiler::QgsOracleExpressionCompiler( const QgsFields& fields )
+    : QgsSqlExpressionCompiler( fields )
+{
+}
+
+QString QgsOracleExpressionCompiler::quotedIdentifier( const QString& identifier )
+{
+  return QgsOracleConn::quotedIdentifier( identifier );
+}
+
+QString QgsOracleExpressionCompiler::quotedValue( const QVariant& value )
+{
+  if ( value.type() == QVariant::String )
+    return QgsOracleConn::quotedValue( value );
+
+  return QgsSqlExpressionCompiler::quotedValue( value );
+}
+
+bool QgsOracleExpressionCompiler::isStringField( const QgsField& field )
+{
+  // CHAR comparisons ignore trailing blanks, the type names include the length, e.g. VARCHAR2(20 CHAR)
+  return field.type() == QVariant::String &&
+         ( field.typeName().startsWith( "VARCHAR2(" ) || field.typeName().startsWith( "NVARCHAR2(" ) );
+}
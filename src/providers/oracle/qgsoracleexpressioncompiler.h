@@ -0,0 +1,31 @@
+/***************************************************************************
+    qgsoracleexpressioncompiler.h
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSORACLEEXPRESSIONCOMPILER_H
+#define QGSORACLEEXPRESSIONCOMPILER_H
+
+#include "qgssqlexpressioncompiler.h"
+
+//! translates filter expressions to Oracle WHERE clauses
+class QgsOracleExpressionCompiler : public QgsSqlExpressionCompiler
+{
+  public:
+    QgsOracleExpressionCompiler( const QgsFields& fields );
+
+  protected:
+    virtual QString quotedIdentifier( const QString& identifier );
+    virtual QString quotedValue( const QVariant& value );
+    virtual bool isStringField( const QgsField& field );
+};
+
+#endif // QGSORACLEEXPRESSIONCOMPILER_H
@@ -15,17 +15,20 @@
 
 #include "qgsoraclefeatureiterator.h"
 #include "qgsoracleprovider.h"
+#include "qgsoracleexpressioncompiler.h"
 
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
 #include "qgsgeometry.h"
 
 #include <QObject>
+#include <QSettings>
 
 QgsOracleFeatureIterator::QgsOracleFeatureIterator( QgsOracleProvider *p, const QgsFeatureRequest &request )
     : QgsAbstractFeatureIterator( request )
     , P( p )
     , mRewind( false )
+    , mExpressionCompiled( false )
 {
   P->mActiveIterators << this;
 
@@ -45,6 +48,16 @@ QgsOracleFeatureIterator::QgsOracleFeatureIterator( QgsOracleProvider *p, const
   switch ( request.filterType() )
   {
     case QgsFeatureRequest::FilterExpression:
+      if ( QSettings().value( "/qgis/compileExpressions", true ).toBool() )
+      {
+        QgsOracleExpressionCompiler compiler( P->mAttributeFields );
+        QgsSqlExpressionCompiler::Result result = compiler.compile( request.filterExpression() );
+        if ( result == QgsSqlExpressionCompiler::Complete || result == QgsSqlExpressionCompiler::Partial )
+        {
+          whereClause = compiler.result();
+          mExpressionCompiled = result == QgsSqlExpressionCompiler::Complete;
+        }
+      }
       break;
 
     case QgsFeatureRequest::FilterRect:
@@ -236,6 +249,14 @@ bool QgsOracleFeatureIterator::fetchFeature( QgsFeature& feature )
   }
 }
 
+bool QgsOracleFeatureIterator::nextFeatureFilterExpression( QgsFeature& f )
+{
+  if ( mExpressionCompiled )
+    return fetchFeature( f );
+
+  return QgsAbstractFeatureIterator::nextFeatureFilterExpression( f );
+}
+
 bool QgsOracleFeatureIterator::rewind()
 {
   if ( !mQry.isActive() )
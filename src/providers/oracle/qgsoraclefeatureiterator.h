@@ -42,6 +42,9 @@ class QgsOracleFeatureIterator : public QgsAbstractFeatureIterator
     //! fetch next feature, return true on success
     virtual bool fetchFeature( QgsFeature& feature );
 
+    //! skips the local evaluation if the whole filter expression is part of the query
+    virtual bool nextFeatureFilterExpression( QgsFeature& f );
+
     QgsOracleProvider *P;
 
     bool openQuery( QString whereClause );
@@ -49,6 +52,9 @@ class QgsOracleFeatureIterator : public QgsAbstractFeatureIterator
     QSqlQuery mQry;
     bool mRewind;
     QgsAttributeList mAttributeList;
+
+    //! Set to true, if the filter expression was completely translated to SQL
+    bool mExpressionCompiled;
 };
 
 #endif // QGSORACLEFEATUREITERATOR_H
@@ -125,22 +125,27 @@ Oid QgsPostgresResult::PQoidValue()
   return ::PQoidValue( mRes );
 }
 
-QMap<QString, QgsPostgresConn *> QgsPostgresConn::sConnectionsRO;
-QMap<QString, QgsPostgresConn *> QgsPostgresConn::sConnectionsRW;
+QMap<QThread *, QMap<QString, QgsPostgresConn *> > QgsPostgresConn::sConnectionsRO;
+QMap<QThread *, QMap<QString, QgsPostgresConn *> > QgsPostgresConn::sConnectionsRW;
+QMutex QgsPostgresConn::sConnectionsMutex;
 const int QgsPostgresConn::sGeomTypeSelectLimit = 100;
 
 QgsPostgresConn *QgsPostgresConn::connectDb( QString conninfo, bool readonly )
 {
-  QMap<QString, QgsPostgresConn *> &connections =
-    readonly ? QgsPostgresConn::sConnectionsRO : QgsPostgresConn::sConnectionsRW;
-
-  if ( connections.contains( conninfo ) )
   {
-    QgsDebugMsg( QString( "Using cached connection for %1" ).arg( conninfo ) );
-    connections[conninfo]->mRef++;
-    return connections[conninfo];
+    QMutexLocker locker( &sConnectionsMutex );
+    QMap<QString, QgsPostgresConn *> &connections =
+      ( readonly ? QgsPostgresConn::sConnectionsRO : QgsPostgresConn::sConnectionsRW )[ QThread::currentThread() ];
+
+    if ( connections.contains( conninfo ) )
+    {
+      QgsDebugMsg( QString( "Using cached connection for %1" ).arg( conninfo ) );
+      connections[conninfo]->mRef++;
+      return connections[conninfo];
+    }
   }
 
+  // connect without holding the lock, other threads use their own connections anyway
   QgsPostgresConn *conn = new QgsPostgresConn( conninfo, readonly );
 
   if ( conn->mRef == 0 )
@@ -149,7 +154,8 @@ QgsPostgresConn *QgsPostgresConn::connectDb( QString conninfo, bool readonly )
     return 0;
   }
 
-  connections.insert( conninfo, conn );
+  QMutexLocker locker( &sConnectionsMutex );
+  ( readonly ? QgsPostgresConn::sConnectionsRO : QgsPostgresConn::sConnectionsRW )[ conn->mThread ].insert( conninfo, conn );
 
   return conn;
 }
@@ -160,6 +166,7 @@ QgsPostgresConn::QgsPostgresConn( QString conninfo, bool readOnly )
     , mConnInfo( conninfo )
     , mGotPostgisVersion( false )
     , mReadOnly( readOnly )
+    , mThread( QThread::currentThread() )
 {
   QgsDebugMsg( QString( "New PostgreSQL connection for " ) + conninfo );
 
@@ -263,12 +270,18 @@ void QgsPostgresConn::disconnect()
   if ( --mRef > 0 )
     return;
 
-  QMap<QString, QgsPostgresConn *>& connections = mReadOnly ? sConnectionsRO : sConnectionsRW;
+  {
+    QMutexLocker locker( &sConnectionsMutex );
+    QMap<QThread *, QMap<QString, QgsPostgresConn *> >& threadConnections = mReadOnly ? sConnectionsRO : sConnectionsRW;
+    QMap<QString, QgsPostgresConn *>& connections = threadConnections[ mThread ];
 
-  QString key = connections.key( this, QString::null );
+    QString key = connections.key( this, QString::null );
 
-  Q_ASSERT( !key.isNull() );
-  connections.remove( key );
+    Q_ASSERT( !key.isNull() );
+    connections.remove( key );
+    if ( connections.isEmpty() )
+      threadConnections.remove( mThread );
+  }
 
   if ( !QApplication::instance() || QThread::currentThread() == QApplication::instance()->thread() )
     deleteLater();
@@ -22,6 +22,7 @@
 #include <QStringList>
 #include <QVector>
 #include <QMap>
+#include <QMutex>
 
 #include "qgis.h"
 #include "qgsdatasourceuri.h"
@@ -32,6 +33,7 @@ extern "C"
 }
 
 class QgsField;
+class QThread;
 
 enum QgsPostgresGeometryColumnType
 {
@@ -299,8 +301,13 @@ class QgsPostgresConn : public QObject
 
     bool mReadOnly;
 
-    static QMap<QString, QgsPostgresConn *> sConnectionsRW;
-    static QMap<QString, QgsPostgresConn *> sConnectionsRO;
+    //! thread the connection is shared in
+    QThread *mThread;
+
+    //! shared connections by thread, a connection must not be used by several threads
+    static QMap<QThread *, QMap<QString, QgsPostgresConn *> > sConnectionsRW;
+    static QMap<QThread *, QMap<QString, QgsPostgresConn *> > sConnectionsRO;
+    static QMutex sConnectionsMutex;
 
     /** count number of spatial columns in a given relation */
     void addColumnInfo( QgsPostgresLayerProperty& layerProperty, const QString& schemaName, const QString& viewName, bool fetchPkCandidates );
@@ -0,0 +1,40 @@
+/***************************************************************************
+    qgspostgresexpressioncompiler.cpp
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgspostgresexpressioncompiler.h"
+#include "qgspostgresconn.h"
+
+QgsPostgresExpressionCompiler::QgsPostgresExpressionCompiler( const QgsFields& fields )
+    : QgsSqlExpressionCompiler( fields, ILikeOperator )
+{
+}
+
+QString QgsPostgresExpressionCompiler::quotedIdentifier( const QString& identifier )
+{
+  return QgsPostgresConn::quotedIdentifier( identifier );
+}
+
+QString QgsPostgresExpressionCompiler::quotedValue( const QVariant& value )
+{
+  if ( value.type() == QVariant::String )
+    return QgsPostgresConn::quotedValue( value );
+
+  return QgsSqlExpressionCompiler::quotedValue( value );
+}
+
+bool QgsPostgresExpressionCompiler::isStringField( const QgsField& field )
+{
+  // bool, uuid, inet, hstore, geometry, enums, arrays etc. are strings too, and bpchar
+  // ignores trailing blanks, only real text columns compare like QGIS strings
+  return field.type() == QVariant::String && ( field.typeName() == "text" || field.typeName() == "varchar" );
+}
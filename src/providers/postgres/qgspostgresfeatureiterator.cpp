@@ -14,12 +14,14 @@
  ***************************************************************************/
 #include "qgspostgresfeatureiterator.h"
 #include "qgspostgresprovider.h"
+#include "qgspostgresexpressioncompiler.h"
 #include "qgsgeometry.h"
 
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
 
 #include <QObject>
+#include <QSettings>
 
 // provider:
 // - mProviderId
@@ -47,6 +49,8 @@ const int QgsPostgresFeatureIterator::sFeatureQueueSize = 2000;
 QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresProvider* p, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIterator( request ), P( p )
     , mFeatureQueueSize( sFeatureQueueSize )
+    , mFetchRow( 0 )
+    , mExpressionCompiled( false )
 {
   mCursorName = QString( "qgisf%1_%2" ).arg( P->mProviderId ).arg( P->mIteratorCounter++ );
 
@@ -64,6 +68,17 @@ QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresProvider* p,
   {
     whereClause = P->whereClause( request.filterFids() );
   }
+  else if ( request.filterType() == QgsFeatureRequest::FilterExpression
+            && QSettings().value( "/qgis/compileExpressions", true ).toBool() )
+  {
+    QgsPostgresExpressionCompiler compiler( P->mAttributeFields );
+    QgsSqlExpressionCompiler::Result result = compiler.compile( request.filterExpression() );
+    if ( result == QgsSqlExpressionCompiler::Complete || result == QgsSqlExpressionCompiler::Partial )
+    {
+      whereClause = compiler.result();
+      mExpressionCompiled = result == QgsSqlExpressionCompiler::Complete;
+    }
+  }
 
   if ( !P->mSqlWhereClause.isEmpty() )
   {
@@ -98,7 +113,14 @@ bool QgsPostgresFeatureIterator::fetchFeature( QgsFeature& feature )
   if ( mClosed )
     return false;
 
-  if ( mFeatureQueue.empty() )
+  // drop the results that have been read completely
+  while ( !mFetchResults.empty() && mFetchRow >= mFetchResults.head()->PQntuples() )
+  {
+    delete mFetchResults.dequeue();
+    mFetchRow = 0;
+  }
+
+  if ( mFetchResults.empty() )
   {
     QString fetch = QString( "FETCH FORWARD %1 FROM %2" ).arg( mFeatureQueueSize ).arg( mCursorName );
     QgsDebugMsgLevel( QString( "fetching %1 features." ).arg( mFeatureQueueSize ), 4 );
@@ -107,32 +129,35 @@ bool QgsPostgresFeatureIterator::fetchFeature( QgsFeature& feature )
       QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName ).arg( P->mConnectionRO->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
     }
 
-    QgsPostgresResult queryResult;
     for ( ;; )
     {
-      queryResult = P->mConnectionRO->PQgetResult();
-      if ( !queryResult.result() )
+      QgsPostgresResult *queryResult = new QgsPostgresResult( P->mConnectionRO->PQgetResult() );
+      if ( !queryResult->result() )
+      {
+        delete queryResult;
         break;
+      }
 
-      if ( queryResult.PQresultStatus() != PGRES_TUPLES_OK )
+      if ( queryResult->PQresultStatus() != PGRES_TUPLES_OK )
       {
         QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName ).arg( P->mConnectionRO->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
+        delete queryResult;
         break;
       }
 
-      int rows = queryResult.PQntuples();
-      if ( rows == 0 )
+      if ( queryResult->PQntuples() == 0 )
+      {
+        delete queryResult;
         continue;
+      }
 
-      for ( int row = 0; row < rows; row++ )
-      {
-        mFeatureQueue.enqueue( QgsFeature() );
-        getFeature( queryResult, row, mFeatureQueue.back() );
-      } // for each row in queue
+      // the rows are only converted when they are returned
+      mFetchResults.enqueue( queryResult );
     }
+    mFetchRow = 0;
   }
 
-  if ( mFeatureQueue.empty() )
+  if ( mFetchResults.empty() )
   {
     QgsDebugMsg( QString( "Finished after %1 features" ).arg( mFetched ) );
     close();
@@ -149,20 +174,13 @@ bool QgsPostgresFeatureIterator::fetchFeature( QgsFeature& feature )
     return false;
   }
 
-  // Now return the next feature from the queue
+  // Now read the next row into the feature, reusing its geometry buffer and attributes
+  getFeature( *mFetchResults.head(), mFetchRow++, feature );
   if ( !mFetchGeometry )
   {
-    feature.setGeometryAndOwnership( 0, 0 );
+    feature.setGeometry( 0 );
   }
-  else
-  {
-    QgsGeometry* featureGeom = mFeatureQueue.front().geometryAndOwnership();
-    feature.setGeometry( featureGeom );
-  }
-  feature.setFeatureId( mFeatureQueue.front().id() );
-  feature.setAttributes( mFeatureQueue.front().attributes() );
 
-  mFeatureQueue.dequeue();
   mFetched++;
 
   feature.setValid( true );
@@ -171,6 +189,14 @@ bool QgsPostgresFeatureIterator::fetchFeature( QgsFeature& feature )
   return true;
 }
 
+bool QgsPostgresFeatureIterator::nextFeatureFilterExpression( QgsFeature& f )
+{
+  if ( mExpressionCompiled )
+    return fetchFeature( f );
+
+  return QgsAbstractFeatureIterator::nextFeatureFilterExpression( f );
+}
+
 bool QgsPostgresFeatureIterator::prepareSimplification( const QgsSimplifyMethod& simplifyMethod )
 {
   // setup simplification of geometries to fetch
@@ -202,7 +228,9 @@ bool QgsPostgresFeatureIterator::rewind()
 
   // move cursor to first record
   P->mConnectionRO->PQexecNR( QString( "move absolute 0 in %1" ).arg( mCursorName ) );
-  mFeatureQueue.clear();
+  qDeleteAll( mFetchResults );
+  mFetchResults.clear();
+  mFetchRow = 0;
   mFetched = 0;
 
   return true;
@@ -215,10 +243,8 @@ bool QgsPostgresFeatureIterator::close()
 
   P->mConnectionRO->closeCursor( mCursorName );
 
-  while ( !mFeatureQueue.empty() )
-  {
-    mFeatureQueue.dequeue();
-  }
+  qDeleteAll( mFetchResults );
+  mFetchResults.clear();
 
   P->mActiveIterators.remove( this );
 
@@ -403,7 +429,7 @@ bool QgsPostgresFeatureIterator::getFeature( QgsPostgresResult &queryResult, int
       int returnedLength = ::PQgetlength( queryResult.result(), row, col );
       if ( returnedLength > 0 )
       {
-        unsigned char *featureGeom = new unsigned char[returnedLength + 1];
+        unsigned char *featureGeom = feature.geometryBuffer( returnedLength + 1 );
         memcpy( featureGeom, PQgetvalue( queryResult.result(), row, col ), returnedLength );
         memset( featureGeom + returnedLength, 0, 1 );
 
@@ -462,7 +488,6 @@ bool QgsPostgresFeatureIterator::getFeature( QgsPostgresResult &queryResult, int
           }
         }
 
-        feature.setGeometryAndOwnership( featureGeom, returnedLength + 1 );
       }
       else
       {
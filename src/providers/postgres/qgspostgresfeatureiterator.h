@@ -40,6 +40,9 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIterator
     //! fetch next feature, return true on success
     virtual bool fetchFeature( QgsFeature& feature );
 
+    //! skips the local evaluation if the whole filter expression is part of the query
+    virtual bool nextFeatureFilterExpression( QgsFeature& f );
+
     //! Setup the simplification of geometries to fetch using the specified simplify method
     virtual bool prepareSimplification( const QgsSimplifyMethod& simplifyMethod );
 
@@ -53,20 +56,26 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIterator
     QString mCursorName;
 
     /**
-     * Feature queue that GetNextFeature will retrieve from
-     * before the next fetch from PostgreSQL
+     * Results of the last fetch from PostgreSQL that GetNextFeature
+     * reads the features from, directly into the caller's feature
      */
-    QQueue<QgsFeature> mFeatureQueue;
+    QQueue<QgsPostgresResult*> mFetchResults;
 
-    //! Maximal size of the feature queue
+    //! Maximal number of features fetched at once
     int mFeatureQueueSize;
 
+    //! Next row to read from the first of mFetchResults
+    int mFetchRow;
+
     //! Number of retrieved features
     int mFetched;
 
     //! Set to true, if geometry is in the requested columns
     bool mFetchGeometry;
 
+    //! Set to true, if the filter expression was completely translated to SQL
+    bool mExpressionCompiled;
+
     static const int sFeatureQueueSize;
 
   private:
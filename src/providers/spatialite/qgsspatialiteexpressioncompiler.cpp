@@ -0,0 +1,34 @@
+/***************************************************************************
+    qgsspatialiteexpressioncompiler.cpp
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgsspatialiteexpressioncompiler.h"
+#include "qgsspatialiteprovider.h"
+
+// LIKE of SQLite ignores the case of ASCII characters
+QgsSpatiaLiteExpressionCompiler::QgsSpatiaLiteExpressionCompiler( const QgsFields& fields )
+    : QgsSqlExpressionCompiler( fields, LikeIsCaseInsensitive )
+{
+}
+
+QString QgsSpatiaLiteExpressionCompiler::quotedIdentifier( const QString& identifier )
+{
+  return QgsSpatiaLiteProvider::quotedIdentifier( identifier );
+}
+
+QString QgsSpatiaLiteExpressionCompiler::quotedValue( const QVariant& value )
+{
+  if ( value.type() == QVariant::String )
+    return QgsSpatiaLiteProvider::quotedValue( value.toString() );
+
+  return QgsSqlExpressionCompiler::quotedValue( value );
+}
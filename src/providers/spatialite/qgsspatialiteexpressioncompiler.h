@@ -0,0 +1,30 @@
+/***************************************************************************
+    qgsspatialiteexpressioncompiler.h
+    ---------------------
+    begin                : December 2013
+    copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSSPATIALITEEXPRESSIONCOMPILER_H
+#define QGSSPATIALITEEXPRESSIONCOMPILER_H
+
+#include "qgssqlexpressioncompiler.h"
+
+//! translates filter expressions to SpatiaLite WHERE clauses
+class QgsSpatiaLiteExpressionCompiler : public QgsSqlExpressionCompiler
+{
+  public:
+    QgsSpatiaLiteExpressionCompiler( const QgsFields& fields );
+
+  protected:
+    virtual QString quotedIdentifier( const QString& identifier );
+    virtual QString quotedValue( const QVariant& value );
+};
+
+#endif // QGSSPATIALITEEXPRESSIONCOMPILER_H
@@ -15,10 +15,13 @@
 #include "qgsspatialitefeatureiterator.h"
 
 #include "qgsspatialiteprovider.h"
+#include "qgsspatialiteexpressioncompiler.h"
 
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
 
+#include <QSettings>
+
 
 // from provider:
 // isQuery
@@ -41,6 +44,7 @@ QgsSpatiaLiteFeatureIterator::QgsSpatiaLiteFeatureIterator( QgsSpatiaLiteProvide
     : QgsAbstractFeatureIterator( request )
     , P( p )
     , sqliteStatement( NULL )
+    , mExpressionCompiled( false )
 {
   P->mActiveIterators << this;
 
@@ -58,6 +62,18 @@ QgsSpatiaLiteFeatureIterator::QgsSpatiaLiteFeatureIterator( QgsSpatiaLiteProvide
     whereClause += whereClauseFid();
   }
 
+  if ( request.filterType() == QgsFeatureRequest::FilterExpression
+       && QSettings().value( "/qgis/compileExpressions", true ).toBool() )
+  {
+    QgsSpatiaLiteExpressionCompiler compiler( P->attributeFields );
+    QgsSqlExpressionCompiler::Result result = compiler.compile( request.filterExpression() );
+    if ( result == QgsSqlExpressionCompiler::Complete || result == QgsSqlExpressionCompiler::Partial )
+    {
+      whereClause += compiler.result();
+      mExpressionCompiled = result == QgsSqlExpressionCompiler::Complete;
+    }
+  }
+
   if ( !P->mSubsetString.isEmpty() )
   {
     if ( !whereClause.isEmpty() )
@@ -109,6 +125,15 @@ bool QgsSpatiaLiteFeatureIterator::fetchFeature( QgsFeature& feature )
 }
 
 
+bool QgsSpatiaLiteFeatureIterator::nextFeatureFilterExpression( QgsFeature& f )
+{
+  if ( mExpressionCompiled )
+    return fetchFeature( f );
+
+  return QgsAbstractFeatureIterator::nextFeatureFilterExpression( f );
+}
+
+
 bool QgsSpatiaLiteFeatureIterator::rewind()
 {
   if ( mClosed )
@@ -43,6 +43,9 @@ class QgsSpatiaLiteFeatureIterator : public QgsAbstractFeatureIterator
     //! fetch next feature, return true on success
     virtual bool fetchFeature( QgsFeature& feature );
 
+    //! skips the local evaluation if the whole filter expression is part of the query
+    virtual bool nextFeatureFilterExpression( QgsFeature& f );
+
     QgsSpatiaLiteProvider* P;
 
     QString whereClauseRect();
@@ -65,6 +68,9 @@ class QgsSpatiaLiteFeatureIterator : public QgsAbstractFeatureIterator
 
     //! Set to true, if geometry is in the requested columns
     bool mFetchGeometry;
+
+    //! Set to true, if the filter expression was completely translated to SQL
+    bool mExpressionCompiled;
 };
 
 #endif // QGSSPATIALITEFEATUREITERATOR_H
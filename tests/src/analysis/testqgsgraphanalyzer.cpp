@@ -0,0 +1,519 @@
+/***************************************************************************
+     testqgsgraphanalyzer.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QThreadPool>
+
+#include <limits>
+
+//header for class being tested
+#include <qgsgraph.h>
+#include <qgscompactgraph.h>
+#include <qgsgraphanalyzer.h>
+#include <qgsgraphbuilder.h>
+#include <qgscontractionhierarchy.h>
+#include <qgslinevectorlayerdirector.h>
+#include <qgsdistancearcproperter.h>
+#include <qgsapplication.h>
+#include <qgsgeometry.h>
+#include <qgsvectorlayer.h>
+#include <qgsvectordataprovider.h>
+
+Q_DECLARE_METATYPE( QgsGraphAnalyzer::PathAlgorithm )
+
+class TestQgsGraphAnalyzer: public QObject
+{
+    Q_OBJECT;
+
+  private:
+    /**
+     * grid of size x size vertices with arcs to the right and down neighbours and,
+     * for three of four pairs, arcs back. Costs are pseudo random in [1, 10].
+     */
+    QgsGraph* createGrid( int size )
+    {
+      QgsGraph* graph = new QgsGraph();
+      for ( int y = 0; y < size; ++y )
+        for ( int x = 0; x < size; ++x )
+          graph->addVertex( QgsPoint( x, y ) );
+
+      uint seed = 1;
+      for ( int y = 0; y < size; ++y )
+      {
+        for ( int x = 0; x < size; ++x )
+        {
+          int v = y * size + x;
+          QList<int> neighbours;
+          if ( x + 1 < size )
+            neighbours << v + 1;
+          if ( y + 1 < size )
+            neighbours << v + size;
+
+          foreach ( int w, neighbours )
+          {
+            seed = seed * 1103515245 + 12345;
+            graph->addArc( v, w, QVector<QVariant>() << QVariant( 1.0 + ( seed >> 16 ) % 10 ) );
+            if ( seed % 4 )
+              graph->addArc( w, v, QVector<QVariant>() << QVariant( 1.0 + ( seed >> 20 ) % 10 ) );
+          }
+        }
+      }
+      return graph;
+    }
+
+    /**
+     * memory layer of count pseudo random polylines of 2 to 5 vertices in a 1000 x 1000 square,
+     * their segments are appended to firstPoints and lastPoints
+     */
+    QgsVectorLayer* createRoads( int count, QVector<QgsPoint>& firstPoints, QVector<QgsPoint>& lastPoints )
+    {
+      QgsVectorLayer* layer = new QgsVectorLayer( "LineString?crs=epsg:3857", "roads", "memory" );
+      if ( !layer->isValid() )
+        return layer;
+
+      uint seed = 1;
+      QgsFeatureList features;
+      for ( int i = 0; i < count; ++i )
+      {
+        QgsPolyline line;
+        seed = seed * 1103515245 + 12345;
+        int vertices = 2 + ( seed >> 16 ) % 4;
+        for ( int j = 0; j < vertices; ++j )
+        {
+          seed = seed * 1103515245 + 12345;
+          double x = ( seed >> 16 ) % 1000;
+          seed = seed * 1103515245 + 12345;
+          double y = ( seed >> 16 ) % 1000;
+          line << QgsPoint( x, y );
+          if ( j > 0 )
+          {
+            firstPoints << line[j - 1];
+            lastPoints << line[j];
+          }
+        }
+        QgsFeature f;
+        f.setGeometry( QgsGeometry::fromPolyline( line ) );
+        features << f;
+      }
+      layer->dataProvider()->addFeatures( features );
+      return layer;
+    }
+
+    //! pseudo random points in a 1200 x 1200 square around the roads
+    QVector<QgsPoint> createAdditionalPoints( int count )
+    {
+      uint seed = 7;
+      QVector<QgsPoint> points;
+      for ( int i = 0; i < count; ++i )
+      {
+        seed = seed * 1103515245 + 12345;
+        double x = ( seed >> 16 ) % 1200 - 100.0;
+        seed = seed * 1103515245 + 12345;
+        points << QgsPoint( x, ( seed >> 16 ) % 1200 - 100.0 );
+      }
+      return points;
+    }
+
+    QgsGraph* buildGraph( QgsVectorLayer* layer, const QVector<QgsPoint>& additionalPoints, QVector<QgsPoint>& tiedPoints )
+    {
+      QgsLineVectorLayerDirector director( layer, -1, QString(), QString(), QString(), 3 );
+      director.addProperter( new QgsDistanceArcProperter() );
+      QgsGraphBuilder builder( layer->crs(), false );
+      director.makeGraph( &builder, additionalPoints, tiedPoints );
+      return builder.graph();
+    }
+
+    //! cost of a path, or -1 if the arcs do not form a path from start to end
+    double pathCost( const QgsGraph* graph, const QList<int>& path, int start, int end )
+    {
+      double cost = 0.0;
+      int v = start;
+      foreach ( int arcIdx, path )
+      {
+        const QgsGraphArc& arc = graph->arc( arcIdx );
+        if ( arc.outVertex() != v )
+          return -1;
+        cost += arc.property( 0 ).toDouble();
+        v = arc.inVertex();
+      }
+      return v == end ? cost : -1;
+    }
+
+  private slots:
+
+    void initTestCase()
+    {
+      // the memory provider is needed for the line director test
+      QgsApplication::init();
+      QgsApplication::initQgis();
+    }
+
+    void compactGraph()
+    {
+      QgsGraph graph;
+      graph.addVertex( QgsPoint( 0, 0 ) );
+      graph.addVertex( QgsPoint( 3, 4 ) );
+      graph.addVertex( QgsPoint( 3, 0 ) );
+      graph.addArc( 0, 1, QVector<QVariant>() << QVariant( 10.0 ) );
+      graph.addArc( 0, 2, QVector<QVariant>() << QVariant( "6" ) );
+      graph.addArc( 2, 1, QVector<QVariant>() << QVariant( 8.0 ) );
+
+      QgsCompactGraph compact( &graph, 0 );
+      QCOMPARE( compact.vertexCount(), 3 );
+      QCOMPARE( compact.arcCount(), 3 );
+
+      QCOMPARE( compact.outEnd( 0 ) - compact.outBegin( 0 ), 2 );
+      QCOMPARE( compact.outHead( compact.outBegin( 0 ) ), 1 );
+      QCOMPARE( compact.outHead( compact.outBegin( 0 ) + 1 ), 2 );
+      QCOMPARE( compact.outCost( compact.outBegin( 0 ) + 1 ), 6.0 );
+      QCOMPARE( compact.outBegin( 1 ), compact.outEnd( 1 ) );
+
+      QCOMPARE( compact.inEnd( 1 ) - compact.inBegin( 1 ), 2 );
+      QCOMPARE( compact.inTail( compact.inBegin( 1 ) + 1 ), 2 );
+      QCOMPARE( compact.inArc( compact.inBegin( 1 ) + 1 ), 2 );
+
+      // arc 0 -> 1 has cost 10 for length 5
+      QCOMPARE( compact.minCostPerDistance(), 2.0 );
+    }
+
+    void dijkstra()
+    {
+      QgsGraph graph;
+      for ( int i = 0; i < 4; ++i )
+        graph.addVertex( QgsPoint( i, 0 ) );
+      graph.addArc( 0, 1, QVector<QVariant>() << QVariant( 1.0 ) );
+      graph.addArc( 1, 2, QVector<QVariant>() << QVariant( 1.0 ) );
+      graph.addArc( 0, 2, QVector<QVariant>() << QVariant( 3.0 ) );
+
+      QVector<int> tree;
+      QVector<double> cost;
+      QgsGraphAnalyzer::dijkstra( &graph, 0, 0, &tree, &cost );
+
+      QCOMPARE( cost[0], 0.0 );
+      QCOMPARE( cost[2], 2.0 );
+      QVERIFY( cost[3] == std::numeric_limits<double>::infinity() );
+      QCOMPARE( tree[0], -1 );
+      QCOMPARE( tree[2], 1 );
+      QCOMPARE( tree[3], -1 );
+    }
+
+    void shortestPath_data()
+    {
+      QTest::addColumn<QgsGraphAnalyzer::PathAlgorithm>( "algorithm" );
+
+      QTest::newRow( "dijkstra" ) << QgsGraphAnalyzer::Dijkstra;
+      QTest::newRow( "bidirectional" ) << QgsGraphAnalyzer::BidirectionalDijkstra;
+      QTest::newRow( "a*" ) << QgsGraphAnalyzer::AStar;
+    }
+
+    void shortestPath()
+    {
+      QFETCH( QgsGraphAnalyzer::PathAlgorithm, algorithm );
+
+      QgsGraph* graph = createGrid( 30 );
+      QgsCompactGraph compact( graph, 0 );
+
+      // compare with the cost of the complete shortest path tree
+      for ( int start = 0; start < graph->vertexCount(); start += 97 )
+      {
+        QVector<double> costs;
+        QgsGraphAnalyzer::dijkstra( compact, start, NULL, &costs );
+
+        for ( int end = 0; end < graph->vertexCount(); end += 31 )
+        {
+          QList<int> path;
+          double cost = QgsGraphAnalyzer::shortestPath( compact, start, end, &path, algorithm );
+          if ( costs[end] == std::numeric_limits<double>::infinity() )
+          {
+            QVERIFY( cost == costs[end] );
+            QVERIFY( path.isEmpty() );
+          }
+          else
+          {
+            QCOMPARE( cost, costs[end] );
+            QCOMPARE( pathCost( graph, path, start, end ), cost );
+          }
+        }
+      }
+
+      delete graph;
+    }
+
+    void costMatrix()
+    {
+      QgsGraph* graph = createGrid( 20 );
+      QgsCompactGraph compact( graph, 0 );
+
+      QVector<int> sources;
+      sources << 0 << 57 << 399 << -1;
+      QVector<int> targets;
+      targets << 399 << 0 << 210 << 57 << 1000;
+
+      QVector< QVector<double> > matrix = QgsGraphAnalyzer::costMatrix( graph, sources, targets, 0 );
+      QCOMPARE( matrix.size(), sources.size() );
+
+      for ( int i = 0; i < sources.size(); ++i )
+      {
+        QVector<double> costs;
+        if ( sources[i] >= 0 )
+          QgsGraphAnalyzer::dijkstra( compact, sources[i], NULL, &costs );
+
+        QCOMPARE( matrix[i].size(), targets.size() );
+        for ( int j = 0; j < targets.size(); ++j )
+        {
+          if ( sources[i] < 0 || targets[j] >= graph->vertexCount() )
+            QVERIFY( matrix[i][j] == std::numeric_limits<double>::infinity() );
+          else
+            QVERIFY( matrix[i][j] == costs[ targets[j] ] );
+        }
+      }
+
+      delete graph;
+    }
+
+    void isochrones()
+    {
+      // straight road from ( 0, 0 ) to ( 20, 0 ), cost equals length
+      QgsGraph graph;
+      graph.addVertex( QgsPoint( 0, 0 ) );
+      graph.addVertex( QgsPoint( 10, 0 ) );
+      graph.addVertex( QgsPoint( 20, 0 ) );
+      for ( int i = 0; i < 2; ++i )
+      {
+        graph.addArc( i, i + 1, QVector<QVariant>() << QVariant( 10.0 ) );
+        graph.addArc( i + 1, i, QVector<QVariant>() << QVariant( 10.0 ) );
+      }
+
+      QList<double> costs;
+      costs << 5.0 << 15.0 << 0.0;
+      QList<QgsGeometry*> areas = QgsGraphAnalyzer::isochrones( &graph, 0, 0, costs, 1.0 );
+      QCOMPARE( areas.size(), 3 );
+
+      QgsPoint inside( 4.5, 0.5 );
+      QgsPoint outside( 6.5, 0 );
+      QVERIFY( areas[0]->contains( &inside ) );
+      QVERIFY( !areas[0]->contains( &outside ) );
+
+      inside = QgsPoint( 15.5, 0 );
+      outside = QgsPoint( 16.5, 0 );
+      QVERIFY( areas[1]->contains( &inside ) );
+      QVERIFY( !areas[1]->contains( &outside ) );
+
+      // nothing reachable, the area around the start vertex
+      inside = QgsPoint( 0.5, 0 );
+      outside = QgsPoint( 1.5, 0 );
+      QVERIFY( areas[2]->contains( &inside ) );
+      QVERIFY( !areas[2]->contains( &outside ) );
+
+      qDeleteAll( areas );
+    }
+
+    void contractionHierarchy()
+    {
+      QgsGraph* graph = createGrid( 20 );
+      QgsCompactGraph compact( graph, 0 );
+      QgsContractionHierarchy hierarchy( compact );
+      QVERIFY( hierarchy.isValid() );
+      QCOMPARE( hierarchy.vertexCount(), graph->vertexCount() );
+
+      QVector<int> ends;
+      for ( int end = 0; end < graph->vertexCount(); end += 7 )
+        ends << end;
+
+      for ( int start = 0; start < graph->vertexCount(); start += 23 )
+      {
+        QVector<double> costs;
+        QgsGraphAnalyzer::dijkstra( compact, start, NULL, &costs );
+        QVector<double> distances = hierarchy.distances( start, ends );
+
+        for ( int i = 0; i < ends.size(); ++i )
+        {
+          int end = ends[i];
+          QList<int> path;
+          double cost = hierarchy.shortestPath( start, end, &path );
+          if ( costs[end] == std::numeric_limits<double>::infinity() )
+          {
+            QVERIFY( cost == costs[end] );
+            QVERIFY( distances[i] == costs[end] );
+            QVERIFY( path.isEmpty() );
+          }
+          else
+          {
+            QCOMPARE( cost, costs[end] );
+            QCOMPARE( distances[i], costs[end] );
+            QCOMPARE( pathCost( graph, path, start, end ), cost );
+          }
+        }
+      }
+
+      delete graph;
+    }
+
+    void contractionHierarchyFile()
+    {
+      QgsGraph* graph = createGrid( 10 );
+      QgsContractionHierarchy hierarchy( graph, 0 );
+      QString fileName = QDir::tempPath() + "/testqgscontractionhierarchy.bin";
+      QVERIFY( hierarchy.save( fileName ) );
+
+      {
+        QgsContractionHierarchy loaded;
+        QVERIFY( !loaded.isValid() );
+        QVERIFY( loaded.load( fileName ) );
+        QCOMPARE( loaded.vertexCount(), hierarchy.vertexCount() );
+        QCOMPARE( loaded.arcCount(), hierarchy.arcCount() );
+        for ( int end = 0; end < graph->vertexCount(); ++end )
+        {
+          QVERIFY( loaded.shortestPath( 5, end ) == hierarchy.shortestPath( 5, end ) );
+        }
+      }
+
+      // truncated file
+      QVERIFY( QFile::resize( fileName, QFile( fileName ).size() - 4 ) );
+      QgsContractionHierarchy truncated;
+      QVERIFY( !truncated.load( fileName ) );
+      QVERIFY( !truncated.isValid() );
+
+      QFile::remove( fileName );
+      delete graph;
+    }
+
+    void lineDirectorTiePoints()
+    {
+      QVector<QgsPoint> firstPoints;
+      QVector<QgsPoint> lastPoints;
+      QgsVectorLayer* layer = createRoads( 300, firstPoints, lastPoints );
+      QVERIFY( layer->isValid() );
+      QCOMPARE( layer->featureCount(), 300L );
+
+      QVector<QgsPoint> additionalPoints = createAdditionalPoints( 50 );
+      QVector<QgsPoint> tiedPoints;
+      QgsGraph* graph = buildGraph( layer, additionalPoints, tiedPoints );
+      QCOMPARE( tiedPoints.size(), additionalPoints.size() );
+
+      for ( int i = 0; i < additionalPoints.size(); ++i )
+      {
+        // the tie point is on a nearest segment, compared with all segments
+        double minDist = std::numeric_limits<double>::infinity();
+        for ( int j = 0; j < firstPoints.size(); ++j )
+        {
+          QgsPoint onSegment;
+          double dist = additionalPoints[i].sqrDistToSegment( firstPoints[j].x(), firstPoints[j].y(),
+                        lastPoints[j].x(), lastPoints[j].y(), onSegment );
+          minDist = qMin( minDist, dist );
+        }
+        QVERIFY( qAbs( additionalPoints[i].sqrDist( tiedPoints[i] ) - minDist ) < 1e-6 );
+
+        // and the segment was split at the tie point, so that it can be reached in both directions
+        int vertex = graph->findVertex( tiedPoints[i] );
+        QVERIFY( vertex >= 0 );
+        QVERIFY( !graph->vertex( vertex ).outArc().isEmpty() );
+        QVERIFY( !graph->vertex( vertex ).inArc().isEmpty() );
+      }
+
+      delete graph;
+      delete layer;
+    }
+
+    void lineDirectorSerialParallel()
+    {
+      // more features than one batch of the director
+      QVector<QgsPoint> firstPoints;
+      QVector<QgsPoint> lastPoints;
+      QgsVectorLayer* layer = createRoads( 5000, firstPoints, lastPoints );
+      QVERIFY( layer->isValid() );
+      QVector<QgsPoint> additionalPoints = createAdditionalPoints( 200 );
+
+      // the lines are extracted by jobs of the global thread pool, one thread runs them one after another
+      int maxThreadCount = QThreadPool::globalInstance()->maxThreadCount();
+      QThreadPool::globalInstance()->setMaxThreadCount( 1 );
+      QVector<QgsPoint> serialTiedPoints;
+      QgsGraph* serial = buildGraph( layer, additionalPoints, serialTiedPoints );
+      QThreadPool::globalInstance()->setMaxThreadCount( qMax( 4, maxThreadCount ) );
+      QVector<QgsPoint> parallelTiedPoints;
+      QgsGraph* parallel = buildGraph( layer, additionalPoints, parallelTiedPoints );
+      QThreadPool::globalInstance()->setMaxThreadCount( maxThreadCount );
+
+      QVERIFY( serialTiedPoints == parallelTiedPoints );
+      QVERIFY( serial->vertexCount() > 0 );
+      QCOMPARE( parallel->vertexCount(), serial->vertexCount() );
+      for ( int i = 0; i < serial->vertexCount(); ++i )
+      {
+        QVERIFY( parallel->vertex( i ).point() == serial->vertex( i ).point() );
+      }
+      QCOMPARE( parallel->arcCount(), serial->arcCount() );
+      for ( int i = 0; i < serial->arcCount(); ++i )
+      {
+        QCOMPARE( parallel->arc( i ).outVertex(), serial->arc( i ).outVertex() );
+        QCOMPARE( parallel->arc( i ).inVertex(), serial->arc( i ).inVertex() );
+        QCOMPARE( parallel->arc( i ).property( 0 ).toDouble(), serial->arc( i ).property( 0 ).toDouble() );
+      }
+
+      delete serial;
+      delete parallel;
+      delete layer;
+    }
+
+    void benchmark_data()
+    {
+      QTest::addColumn<int>( "mode" );
+
+      QTest::newRow( "compact graph" ) << 0;
+      QTest::newRow( "shortest path tree" ) << 1;
+      QTest::newRow( "dijkstra" ) << 2;
+      QTest::newRow( "bidirectional" ) << 3;
+      QTest::newRow( "a*" ) << 4;
+    }
+
+    void benchmark()
+    {
+      QFETCH( int, mode );
+
+      // QGIS_BENCHMARK_GRID_SIZE=1000 gives a grid of one million vertices
+      QByteArray sizeEnv = qgetenv( "QGIS_BENCHMARK_GRID_SIZE" );
+      int size = sizeEnv.isEmpty() ? 200 : qMax( 2, sizeEnv.toInt() );
+
+      QgsGraph* graph = createGrid( size );
+      QgsCompactGraph compact( graph, 0 );
+      int start = size / 2;
+      int end = graph->vertexCount() - 1 - size / 2;
+
+      switch ( mode )
+      {
+        case 0:
+          QBENCHMARK { QgsCompactGraph g( graph, 0 ); }
+          break;
+        case 1:
+        {
+          QVector<double> costs;
+          QBENCHMARK { QgsGraphAnalyzer::dijkstra( compact, start, NULL, &costs ); }
+          break;
+        }
+        default:
+        {
+          QgsGraphAnalyzer::PathAlgorithm algorithm = ( QgsGraphAnalyzer::PathAlgorithm )( mode - 2 );
+          QBENCHMARK { QgsGraphAnalyzer::shortestPath( compact, start, end, NULL, algorithm ); }
+          break;
+        }
+      }
+
+      delete graph;
+    }
+};
+
+QTEST_MAIN( TestQgsGraphAnalyzer )
+
+#include "moc_testqgsgraphanalyzer.cxx"
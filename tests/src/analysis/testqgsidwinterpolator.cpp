@@ -0,0 +1,208 @@
+/***************************************************************************
+     testqgsidwinterpolator.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QtTest>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <cmath>
+#include <limits>
+
+#include "qgsapplication.h"
+#include "qgsgeometry.h"
+#include "qgsvectorlayer.h"
+#include "qgsvectordataprovider.h"
+#include "qgsidwinterpolator.h"
+#include "qgsgridfilewriter.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the inverse distance weighted interpolation
+ */
+class TestQgsIDWInterpolator: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void unlimited();
+    void neighbourLimits();
+    void gridFile();
+
+  private:
+    // weighted mean of the given points as QgsIDWInterpolator calculates it
+    double reference( QList< QPair<double, int> > theDistances, int theMaxCount, double theRadius );
+
+    QgsVectorLayer* mLayer;
+    QList<QgsInterpolator::LayerData> mLayerData;
+    QList<QgsPoint> mPoints;
+    QList<double> mValues;
+};
+
+void TestQgsIDWInterpolator::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mLayer = new QgsVectorLayer( "Point?field=value:double", "points", "memory" );
+  QVERIFY( mLayer->isValid() );
+
+  qsrand( 1 );
+  QgsFeatureList myFeatures;
+  for ( int i = 0; i < 2000; ++i )
+  {
+    QgsPoint myPoint( qrand() % 10000 / 10.0, qrand() % 10000 / 10.0 );
+    double myValue = qrand() % 1000;
+    QgsFeature myFeature;
+    myFeature.setGeometry( QgsGeometry::fromPoint( myPoint ) );
+    myFeature.setAttributes( QgsAttributes() << myValue );
+    myFeatures << myFeature;
+    mPoints << myPoint;
+    mValues << myValue;
+  }
+  QVERIFY( mLayer->dataProvider()->addFeatures( myFeatures ) );
+
+  QgsInterpolator::LayerData myData;
+  myData.vectorLayer = mLayer;
+  myData.zCoordInterpolation = false;
+  myData.interpolationAttribute = 0;
+  myData.mInputType = QgsInterpolator::POINTS;
+  mLayerData << myData;
+}
+
+void TestQgsIDWInterpolator::cleanupTestCase()
+{
+  delete mLayer;
+}
+
+double TestQgsIDWInterpolator::reference( QList< QPair<double, int> > theDistances, int theMaxCount, double theRadius )
+{
+  qSort( theDistances );
+  double mySum = 0;
+  double myWeights = 0;
+  for ( int i = 0; i < theDistances.size(); ++i )
+  {
+    double myDistance = theDistances[i].first;
+    if (( theMaxCount > 0 && i >= theMaxCount ) || ( theRadius > 0 && myDistance > theRadius ) )
+      break;
+    if ( myDistance == 0 )
+      return mValues[theDistances[i].second];
+    mySum += mValues[theDistances[i].second] / ( myDistance * myDistance );
+    myWeights += 1 / ( myDistance * myDistance );
+  }
+  return myWeights > 0 ? mySum / myWeights : std::numeric_limits<double>::quiet_NaN();
+}
+
+void TestQgsIDWInterpolator::unlimited()
+{
+  QgsIDWInterpolator myInterpolator( mLayerData );
+  double myResult = 0;
+  QCOMPARE( myInterpolator.interpolatePoint( mPoints[5].x(), mPoints[5].y(), myResult ), 0 );
+  QCOMPARE( myResult, mValues[5] );
+
+  QList< QPair<double, int> > myDistances;
+  for ( int i = 0; i < mPoints.size(); ++i )
+  {
+    myDistances << qMakePair( sqrt( mPoints[i].sqrDist( 333.3, 666.6 ) ), i );
+  }
+  QCOMPARE( myInterpolator.interpolatePoint( 333.3, 666.6, myResult ), 0 );
+  QVERIFY( qAbs( myResult - reference( myDistances, 0, 0 ) ) < 1e-6 );
+}
+
+void TestQgsIDWInterpolator::neighbourLimits()
+{
+  int myCounts[] = { 0, 1, 12, 0, 12 };
+  double myRadii[] = { 0, 0, 0, 30, 30 };
+  for ( int c = 0; c < 5; ++c )
+  {
+    QgsIDWInterpolator myInterpolator( mLayerData );
+    myInterpolator.setMaximumNeighbours( myCounts[c] );
+    myInterpolator.setSearchRadius( myRadii[c] );
+
+    // off the 0.1 grid of the points, so that there are no ties
+    for ( double y = -49.987; y < 1050; y += 73.3 )
+    {
+      for ( double x = -49.9863; x < 1050; x += 61.7 )
+      {
+        QList< QPair<double, int> > myDistances;
+        for ( int i = 0; i < mPoints.size(); ++i )
+        {
+          myDistances << qMakePair( sqrt( mPoints[i].sqrDist( x, y ) ), i );
+        }
+        double myExpected = reference( myDistances, myCounts[c], myRadii[c] );
+        double myResult = 0;
+        int myError = myInterpolator.interpolatePoint( x, y, myResult );
+        if ( qIsNaN( myExpected ) )
+        {
+          QCOMPARE( myError, 1 );
+        }
+        else
+        {
+          QCOMPARE( myError, 0 );
+          QVERIFY( qAbs( myResult - myExpected ) < 1e-6 );
+        }
+      }
+    }
+  }
+}
+
+// the grid interpolated in parallel has the values of the single points
+void TestQgsIDWInterpolator::gridFile()
+{
+  QgsIDWInterpolator myInterpolator( mLayerData );
+  myInterpolator.setMaximumNeighbours( 8 );
+  myInterpolator.setSearchRadius( 40 );
+
+  QTemporaryFile myFile( QDir::tempPath() + QDir::separator() + "idwXXXXXX.asc" );
+  QVERIFY( myFile.open() );
+  myFile.close();
+
+  int myCols = 50;
+  int myRows = 40;
+  QgsRectangle myExtent( 0, 0, 1000, 800 );
+  QgsGridFileWriter myWriter( &myInterpolator, myFile.fileName(), myExtent, myCols, myRows, 20, 20 );
+  QCOMPARE( myWriter.writeFile( false ), 0 );
+
+  QVERIFY( myFile.open() );
+  QTextStream myStream( &myFile );
+  for ( int i = 0; i < 6; ++i )
+  {
+    myStream.readLine(); // header
+  }
+  QgsIDWInterpolator mySerial( mLayerData );
+  mySerial.setMaximumNeighbours( 8 );
+  mySerial.setSearchRadius( 40 );
+  for ( int i = 0; i < myRows; ++i )
+  {
+    QStringList myValues = myStream.readLine().split( " ", QString::SkipEmptyParts );
+    QCOMPARE( myValues.size(), myCols );
+    for ( int j = 0; j < myCols; ++j )
+    {
+      double myValue = 0;
+      if ( mySerial.interpolatePoint( 10 + j * 20, 790 - i * 20, myValue ) != 0 )
+      {
+        QCOMPARE( myValues[j], QString( "-9999" ) );
+      }
+      else
+      {
+        QVERIFY( qAbs( myValues[j].toDouble() - myValue ) <= 1e-7 * qMax( 1.0, qAbs( myValue ) ) );
+      }
+    }
+  }
+}
+
+QTEST_MAIN( TestQgsIDWInterpolator )
+#include "moc_testqgsidwinterpolator.cxx"
@@ -0,0 +1,111 @@
+/***************************************************************************
+     testqgsninecellfilter.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QVector>
+
+//header for classes being tested
+#include <qgsaspectfilter.h>
+#include <qgshillshadefilter.h>
+#include <qgsruggednessfilter.h>
+#include <qgsslopefilter.h>
+#include <qgstotalcurvaturefilter.h>
+
+/** \ingroup UnitTests
+ * Checks that the row kernels of the terrain filters give the same values as the cell windows
+ */
+class TestQgsNineCellFilter: public QObject
+{
+    Q_OBJECT;
+
+  private slots:
+    void processNineCellRow_data()
+    {
+      QTest::addColumn<int>( "filterType" );
+
+      QTest::newRow( "slope" ) << 0;
+      QTest::newRow( "aspect" ) << 1;
+      QTest::newRow( "hillshade" ) << 2;
+      QTest::newRow( "ruggedness" ) << 3;
+      QTest::newRow( "total curvature" ) << 4;
+    }
+
+    void processNineCellRow()
+    {
+      QFETCH( int, filterType );
+
+      QgsNineCellFilter* filter = 0;
+      switch ( filterType )
+      {
+        case 0:
+          filter = new QgsSlopeFilter( "", "", "GTiff" );
+          break;
+        case 1:
+          filter = new QgsAspectFilter( "", "", "GTiff" );
+          break;
+        case 2:
+          filter = new QgsHillshadeFilter( "", "", "GTiff", 315, 45 );
+          break;
+        case 3:
+          filter = new QgsRuggednessFilter( "", "", "GTiff" );
+          break;
+        default:
+          filter = new QgsTotalCurvatureFilter( "", "", "GTiff" );
+          break;
+      }
+      filter->setCellSizeX( 25 );
+      filter->setCellSizeY( 20 );
+      filter->setZFactor( 1.5 );
+      filter->setInputNodataValue( -9999 );
+      filter->setOutputNodataValue( -9999 );
+
+      // three rows with a nodata border cell on both sides, some nodata and flat cells inside
+      const int nCells = 40;
+      const int stride = nCells + 2;
+      QVector<float> rows( 3 * stride, -9999 );
+      uint seed = 7;
+      for ( int r = 0; r < 3; ++r )
+      {
+        for ( int j = 1; j <= nCells; ++j )
+        {
+          seed = seed * 1103515245 + 12345;
+          float value = 100 + ( seed >> 16 ) % 500 / 10.0;
+          if (( seed >> 8 ) % 11 == 0 )
+            value = -9999;
+          else if ( j > 30 )
+            value = 200;
+          rows[r * stride + j] = value;
+        }
+      }
+
+      float* above = rows.data() + 1;
+      float* row = above + stride;
+      float* below = row + stride;
+      QVector<float> result( nCells );
+      filter->processNineCellRow( above, row, below, result.data(), nCells );
+
+      for ( int j = 0; j < nCells; ++j )
+      {
+        float expected = filter->processNineCellWindow( &above[j-1], &above[j], &above[j+1], &row[j-1], &row[j], &row[j+1],
+                         &below[j-1], &below[j], &below[j+1] );
+        QVERIFY( result[j] == expected );
+      }
+
+      delete filter;
+    }
+};
+
+QTEST_MAIN( TestQgsNineCellFilter )
+
+#include "moc_testqgsninecellfilter.cxx"
@@ -0,0 +1,140 @@
+/***************************************************************************
+     testqgsrastercalculator.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+#include <cfloat>
+
+//header for classes being tested
+#include <qgsrastercalcnode.h>
+#include <qgsrastercalcprogram.h>
+#include <qgsrastermatrix.h>
+
+/** \ingroup UnitTests
+ * Checks that the compiled raster calculator expressions give the same values as the expression tree
+ */
+class TestQgsRasterCalculator: public QObject
+{
+    Q_OBJECT;
+
+  private slots:
+    void evaluate_data()
+    {
+      QTest::addColumn<QString>( "formula" );
+
+      QTest::newRow( "raster" ) << "a@1";
+      QTest::newRow( "arithmetic" ) << "a@1 + b@1 * 2 - c@1 / b@1";
+      QTest::newRow( "number first" ) << "3 - a@1 / ( 2 * 0.5 )";
+      QTest::newRow( "power" ) << "a@1 ^ b@1 + 2 ^ a@1 + a@1 ^ 0.5";
+      QTest::newRow( "comparisons" ) << "( a@1 > b@1 ) + ( a@1 <= 1 ) * 2 + ( b@1 = c@1 ) * 4 + ( c@1 != 0 ) * 8";
+      QTest::newRow( "logical" ) << "a@1 > 0 AND b@1 < 0 OR c@1 >= 1";
+      QTest::newRow( "functions" ) << "sqrt( a@1 ) + sin( b@1 ) * cos( c@1 ) - tan( a@1 ) + asin( b@1 ) - acos( c@1 ) + atan( a@1 )";
+      QTest::newRow( "sign" ) << "-a@1 * -( b@1 + 1 )";
+      QTest::newRow( "constant" ) << "sqrt( 16 ) + 2 ^ 3";
+      QTest::newRow( "constant subexpression" ) << "a@1 * ( 1 + 2 * 3 ) - ( 10 / 4 ) ^ b@1";
+      QTest::newRow( "division by zero" ) << "a@1 / 0 + b@1 / ( c@1 - c@1 )";
+      QTest::newRow( "deep" ) << "( ( a@1 + b@1 ) * ( c@1 - a@1 ) ) / ( ( b@1 + 1 ) * ( c@1 + 2 ) ) + ( ( a@1 - 1 ) * ( b@1 - 2 ) )";
+    }
+
+    void evaluate()
+    {
+      QFETCH( QString, formula );
+
+      QString errorString;
+      QgsRasterCalcNode* node = QgsRasterCalcNode::parseRasterCalcString( formula, errorString );
+      QVERIFY( node );
+
+      // more cells than one chunk of the program, with nodata, zero and negative values
+      const int nCells = 2500;
+      QStringList names;
+      names << "a@1" << "b@1" << "c@1";
+      QVector<double> nodataValues;
+      nodataValues << -9999 << 0 << -FLT_MAX;
+
+      QVector< QVector<float> > data;
+      QMap<QString, QgsRasterMatrix*> matrices;
+      uint seed = 11;
+      for ( int i = 0; i < names.size(); ++i )
+      {
+        QVector<float> values( nCells );
+        for ( int j = 0; j < nCells; ++j )
+        {
+          seed = seed * 1103515245 + 12345;
+          int r = ( seed >> 16 ) % 1000;
+          if ( r < 80 )
+            values[j] = nodataValues[i];
+          else if ( r < 200 )
+            values[j] = r % 3 - 1;
+          else
+            values[j] = ( r - 600 ) / 100.0;
+        }
+        data << values;
+
+        float* matrixData = new float[nCells];
+        memcpy( matrixData, values.constData(), nCells * sizeof( float ) );
+        matrices.insert( names[i], new QgsRasterMatrix( nCells, 1, matrixData, nodataValues[i] ) );
+      }
+
+      QgsRasterMatrix expected;
+      QVERIFY( node->calculate( matrices, expected ) );
+
+      QgsRasterCalcProgram program( node, names, nodataValues );
+      QVERIFY( program.isValid() );
+      QVERIFY( program.nodataValue() == expected.nodataValue() );
+      QCOMPARE( program.isNumber(), expected.isNumber() );
+
+      QVector<const float*> inputs;
+      for ( int i = 0; i < data.size(); ++i )
+      {
+        inputs << data[i].constData();
+      }
+      QVector<float> result( nCells );
+      program.evaluate( inputs, nCells, result.data() );
+
+      for ( int j = 0; j < nCells; ++j )
+      {
+        float value = expected.isNumber() ? expected.number() : expected.data()[j];
+        if ( value != value )
+        {
+          QVERIFY( result[j] != result[j] );
+        }
+        else
+        {
+          QVERIFY( result[j] == value );
+        }
+      }
+
+      qDeleteAll( matrices );
+      delete node;
+    }
+
+    void unknownRaster()
+    {
+      QString errorString;
+      QgsRasterCalcNode* node = QgsRasterCalcNode::parseRasterCalcString( "a@1 + d@1", errorString );
+      QVERIFY( node );
+
+      QStringList names;
+      names << "a@1";
+      QgsRasterCalcProgram program( node, names, QVector<double>() << -9999 );
+      QVERIFY( !program.isValid() );
+      delete node;
+    }
+};
+
+QTEST_MAIN( TestQgsRasterCalculator )
+
+#include "moc_testqgsrastercalculator.cxx"
@@ -33,6 +33,7 @@ class TestQgsZonalStatistics: public QObject
     void cleanup() {};
 
     void testStatistics();
+    void testAdditionalStatistics();
 
   private:
     QgsVectorLayer* mVectorLayer;
@@ -116,5 +117,38 @@ void TestQgsZonalStatistics::testStatistics()
   QCOMPARE( f.attribute( "myqgis2_me" ).toDouble(), 0.833333333333333 );
 }
 
+void TestQgsZonalStatistics::testAdditionalStatistics()
+{
+  QgsZonalStatistics zs( mVectorLayer, mRasterPath, "a_", 1, QgsZonalStatistics::All );
+  QCOMPARE( zs.calculateStatistics( NULL ), 0 );
+
+  QgsFeature f;
+  QgsFeatureRequest request;
+  request.setFilterFid( 0 );
+  bool fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "a_count" ).toDouble(), 12.0 );
+  QCOMPARE( f.attribute( "a_min" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "a_max" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "a_stdev" ).toDouble(), 0.471404520791032 );
+  QCOMPARE( f.attribute( "a_median" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "a_majority" ).toDouble(), 1.0 );
+
+  request.setFilterFid( 1 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "a_count" ).toDouble(), 9.0 );
+  QCOMPARE( f.attribute( "a_stdev" ).toDouble(), 0.496903994999953 );
+  QCOMPARE( f.attribute( "a_median" ).toDouble(), 1.0 );
+
+  request.setFilterFid( 2 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "a_count" ).toDouble(), 6.0 );
+  QCOMPARE( f.attribute( "a_min" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "a_stdev" ).toDouble(), 0.372677996249965 );
+  QCOMPARE( f.attribute( "a_majority" ).toDouble(), 1.0 );
+}
+
 QTEST_MAIN( TestQgsZonalStatistics )
 #include "moc_testqgszonalstatistics.cxx"
@@ -0,0 +1,165 @@
+/***************************************************************************
+     testqgscolorrampshader.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QVector>
+//header for class being tested
+#include <qgscolorrampshader.h>
+#include <qgsrasterblock.h>
+
+class TestQgsColorRampShader: public QObject
+{
+    Q_OBJECT;
+
+  private:
+    QList<QgsColorRampShader::ColorRampItem> mItems;
+
+    QRgb shadeOne( QgsColorRampShader &shader, double value, QRgb defaultColor )
+    {
+      int r, g, b, a;
+      if ( !shader.shade( value, &r, &g, &b, &a ) )
+        return defaultColor;
+      if ( a < 255 )
+      {
+        r *= ( a / 255.0 );
+        g *= ( a / 255.0 );
+        b *= ( a / 255.0 );
+      }
+      return qRgba( r, g, b, a );
+    }
+
+    // shadeBlock() must give the same colors as shade() for every value
+    void compareBlock( QgsColorRampShader &shader, QgsRasterBlock &block, int count )
+    {
+      const QRgb defaultColor = qRgba( 1, 2, 3, 4 );
+      QVector<QRgb> colors( count );
+      shader.shadeBlock( &block, colors.data(), defaultColor );
+      for ( int i = 0; i < count; i++ )
+      {
+        QRgb expected = block.isNoData( i ) ? defaultColor : shadeOne( shader, block.value( i ), defaultColor );
+        QCOMPARE( colors[i], expected );
+      }
+    }
+
+  private slots:
+
+    void initTestCase()
+    {
+      mItems << QgsColorRampShader::ColorRampItem( 100, QColor( 200, 100, 0 ) );
+      mItems << QgsColorRampShader::ColorRampItem( 0, QColor( 0, 0, 0 ) );
+      mItems << QgsColorRampShader::ColorRampItem( 200, QColor( 0, 100, 200, 100 ) );
+    }
+
+    void interpolated()
+    {
+      QgsColorRampShader shader;
+      shader.setColorRampType( QgsColorRampShader::INTERPOLATED );
+      shader.setColorRampItemList( mItems );
+      int r, g, b, a;
+      QVERIFY( shader.shade( 50, &r, &g, &b, &a ) );
+      QCOMPARE( r, 100 );
+      QCOMPARE( g, 50 );
+      QCOMPARE( b, 0 );
+      QCOMPARE( a, 255 );
+      QVERIFY( shader.shade( 150, &r, &g, &b, &a ) );
+      QCOMPARE( r, 100 );
+      QCOMPARE( b, 100 );
+      QCOMPARE( a, 177 );
+      QVERIFY( shader.shade( 300, &r, &g, &b, &a ) );
+      QCOMPARE( b, 200 );
+      QVERIFY( shader.shade( -10, &r, &g, &b, &a ) );
+      QCOMPARE( r, 0 );
+
+      shader.setClip( true );
+      QVERIFY( !shader.shade( 300, &r, &g, &b, &a ) );
+      QVERIFY( !shader.shade( -10, &r, &g, &b, &a ) );
+      QVERIFY( shader.shade( 200, &r, &g, &b, &a ) );
+      QVERIFY( shader.shade( 0, &r, &g, &b, &a ) );
+    }
+
+    void discrete()
+    {
+      QgsColorRampShader shader;
+      shader.setColorRampType( QgsColorRampShader::DISCRETE );
+      shader.setColorRampItemList( mItems );
+      int r, g, b, a;
+      QVERIFY( shader.shade( -5, &r, &g, &b, &a ) );
+      QCOMPARE( r, 0 );
+      QVERIFY( shader.shade( 50, &r, &g, &b, &a ) );
+      QCOMPARE( r, 200 );
+      QVERIFY( shader.shade( 100, &r, &g, &b, &a ) );
+      QCOMPARE( r, 200 );
+      QVERIFY( shader.shade( 101, &r, &g, &b, &a ) );
+      QCOMPARE( b, 200 );
+      QVERIFY( !shader.shade( 201, &r, &g, &b, &a ) );
+    }
+
+    void exact()
+    {
+      QgsColorRampShader shader;
+      shader.setColorRampType( QgsColorRampShader::EXACT );
+      shader.setColorRampItemList( mItems );
+      int r, g, b, a;
+      QVERIFY( shader.shade( 100, &r, &g, &b, &a ) );
+      QCOMPARE( r, 200 );
+      QVERIFY( !shader.shade( 99, &r, &g, &b, &a ) );
+      QVERIFY( !shader.shade( 100.5, &r, &g, &b, &a ) );
+    }
+
+    void shadeBlock_data()
+    {
+      QTest::addColumn<int>( "type" );
+      QTest::addColumn<bool>( "clip" );
+      QTest::addColumn<int>( "cacheSize" );
+
+      QTest::newRow( "interpolated" ) << ( int )QgsColorRampShader::INTERPOLATED << false << 65536;
+      QTest::newRow( "interpolated clip" ) << ( int )QgsColorRampShader::INTERPOLATED << true << 65536;
+      QTest::newRow( "interpolated no table" ) << ( int )QgsColorRampShader::INTERPOLATED << false << 10;
+      QTest::newRow( "discrete" ) << ( int )QgsColorRampShader::DISCRETE << false << 65536;
+      QTest::newRow( "exact" ) << ( int )QgsColorRampShader::EXACT << false << 65536;
+    }
+
+    void shadeBlock()
+    {
+      QFETCH( int, type );
+      QFETCH( bool, clip );
+      QFETCH( int, cacheSize );
+
+      QgsColorRampShader shader;
+      shader.setColorRampType(( QgsColorRampShader::ColorRamp_TYPE ) type );
+      shader.setColorRampItemList( mItems );
+      shader.setClip( clip );
+      shader.setMaximumColorCacheSize( cacheSize );
+
+      // integer data, values outside of the lookup table and no data
+      QgsRasterBlock intBlock( QGis::Int16, 64, 8, -999 );
+      for ( int i = 0; i < 512; i++ )
+      {
+        intBlock.setValue(( qgssize )i, i % 7 == 0 ? -999 : i - 100 );
+      }
+      compareBlock( shader, intBlock, 512 );
+
+      // floating point data
+      QgsRasterBlock floatBlock( QGis::Float32, 64, 8 );
+      for ( int i = 0; i < 512; i++ )
+      {
+        floatBlock.setValue(( qgssize )i, i * 0.5 - 20.25 );
+      }
+      compareBlock( shader, floatBlock, 512 );
+    }
+};
+
+QTEST_MAIN( TestQgsColorRampShader )
+
+#include "moc_testqgscolorrampshader.cxx"
@@ -28,6 +28,17 @@
 Q_DECLARE_METATYPE( QVariant )
 #endif
 
+// function using the interface with the parent expression
+static QVariant fcnParentRowNumber( const QVariantList& values, const QgsFeature*, QgsExpression* parent )
+{
+  if ( values.at( 0 ).toInt() < 0 )
+  {
+    parent->setEvalErrorString( "negative offset" );
+    return QVariant();
+  }
+  return QVariant( parent->currentRowNumber() + values.at( 0 ).toInt() );
+}
+
 class TestQgsExpression: public QObject
 {
     Q_OBJECT;
@@ -839,6 +850,350 @@ class TestQgsExpression: public QObject
       QgsExpression::unsetSpecialColumn( "$var1" );
     }
 
+    void eval_context()
+    {
+      QgsExpression::setSpecialColumn( "$var1", QVariant(( int )42 ) );
+
+      QgsExpression exp( "$var1 + $rownum" );
+      QgsExpressionContext context1;
+      QgsExpressionContext context2;
+      context2.setSpecialColumn( "$var1", QVariant(( int )100 ) );
+      context2.setCurrentRowNumber( 5 );
+
+      // context values override the global ones, the expression itself is not touched
+      QCOMPARE( exp.evaluate( 0, &context1 ).toInt(), 42 );
+      QCOMPARE( exp.evaluate( 0, &context2 ).toInt(), 105 );
+      QCOMPARE( exp.evaluate().toInt(), 42 );
+
+      context2.unsetSpecialColumn( "$var1" );
+      QCOMPARE( exp.evaluate( 0, &context2 ).toInt(), 47 );
+
+      // evaluation errors are reported to the context only
+      QgsExpression exp2( "toint('abc')" );
+      QVERIFY( exp2.evaluate( 0, &context1 ).isNull() );
+      QVERIFY( context1.hasEvalError() );
+      QVERIFY( !exp2.hasEvalError() );
+      QCOMPARE( exp.evaluate( 0, &context1 ).toInt(), 42 );
+      QVERIFY( !context1.hasEvalError() );
+
+      QgsExpression::unsetSpecialColumn( "$var1" );
+    }
+
+    void eval_context_parent_function()
+    {
+      QgsExpression::StaticFunction* fnc = new QgsExpression::StaticFunction( "parent_rownum", 1, fcnParentRowNumber, "Record" );
+      QVERIFY( QgsExpression::registerFunction( fnc ) );
+
+      // the function sees the context through its parent expression
+      QgsExpression exp( "parent_rownum(10)" );
+      QgsExpressionContext context;
+      context.setCurrentRowNumber( 5 );
+      QCOMPARE( exp.evaluate( 0, &context ).toInt(), 15 );
+      QVERIFY( !context.hasEvalError() );
+      QCOMPARE( context.currentRowNumber(), 5 );
+
+      QgsExpression exp2( "parent_rownum(-1)" );
+      QVERIFY( exp2.evaluate( 0, &context ).isNull() );
+      QCOMPARE( context.evalErrorString(), QString( "negative offset" ) );
+
+      // and can still be called with a parent expression
+      QVariantList args;
+      args << 1;
+      exp.setCurrentRowNumber( 3 );
+      QCOMPARE( fnc->func( args, 0, &exp ).toInt(), 4 );
+
+      QVERIFY( QgsExpression::unregisterFunction( "parent_rownum" ) );
+      delete fnc;
+    }
+
+    void eval_context_scope()
+    {
+      QgsExpressionContext atlasContext;
+      atlasContext.setSpecialColumn( "$atlasfeatureid", QVariant(( int )7 ) );
+
+      QgsExpression exp( "$atlasfeatureid" );
+      QVERIFY( exp.evaluate().isNull() );
+      {
+        // the scoped columns are seen by evaluations without explicit context
+        QgsExpressionContextScope scope( &atlasContext );
+        QCOMPARE( exp.evaluate().toInt(), 7 );
+
+        // columns of the evaluation context take precedence
+        QgsExpressionContext context;
+        context.setSpecialColumn( "$atlasfeatureid", QVariant(( int )3 ) );
+        QCOMPARE( exp.evaluate( 0, &context ).toInt(), 3 );
+
+        // a null context keeps the current scope
+        QgsExpressionContextScope nullScope( 0 );
+        QCOMPARE( exp.evaluate().toInt(), 7 );
+      }
+      QVERIFY( exp.evaluate().isNull() );
+      QVERIFY( !QgsExpressionContextScope::current() );
+    }
+
+    void eval_context_substitution()
+    {
+      QList<QgsExpression::Function*> myColumns = QgsExpression::specialColumns();
+      int myColumnCount = myColumns.size();
+      qDeleteAll( myColumns );
+
+      QMap<QString, QVariant> subs;
+      subs.insert( "$var2", QVariant(( int )7 ) );
+      QString text = QgsExpression::replaceExpressionText( "[% $var2 * 2 %]", 0, 0, &subs );
+      QCOMPARE( text, QString( "14" ) );
+
+      // substituted names and values must not leak into the global special columns
+      QVERIFY( !QgsExpression::hasSpecialColumn( "$var2" ) );
+      QCOMPARE( QgsExpression::specialColumn( "$var2" ), QVariant() );
+      myColumns = QgsExpression::specialColumns();
+      QCOMPARE( myColumns.size(), myColumnCount );
+      qDeleteAll( myColumns );
+      QgsExpression exp( "$var2" );
+      QVERIFY( exp.hasParserError() );
+    }
+
+    void evaluation_compiled_data()
+    {
+      evaluation_data();
+    }
+
+    void evaluation_compiled()
+    {
+      QFETCH( QString, string );
+      QFETCH( bool, evalError );
+      QFETCH( QVariant, result );
+
+      // the compiled program must give exactly the same results as the tree
+      QgsExpression exp( string );
+      exp.prepare( QgsFields() );
+      QVariant res = exp.evaluate();
+      QCOMPARE( exp.hasEvalError(), evalError );
+      QCOMPARE( res.type(), result.type() );
+      if ( res.type() == QVariant::Int || res.type() == QVariant::Double || res.type() == QVariant::String )
+        QCOMPARE( res, result );
+
+      QgsExpression tree( string );
+      tree.setCompilationEnabled( false );
+      tree.prepare( QgsFields() );
+      QVERIFY( !tree.isCompiled() );
+      QVariant treeRes = tree.evaluate();
+      QCOMPARE( treeRes.type(), res.type() );
+      if ( res.type() != QVariant::UserType )
+        QCOMPARE( treeRes, res );
+    }
+
+    void eval_compiled_columns()
+    {
+      QgsFields fields;
+      fields.append( QgsField( "x1", QVariant::Double ) );
+      fields.append( QgsField( "x2", QVariant::Int ) );
+      fields.append( QgsField( "name", QVariant::String ) );
+
+      QgsFeature f;
+      f.initAttributes( 3 );
+      f.setAttribute( 0, QVariant( 1.5 ) );
+      f.setAttribute( 1, QVariant( 4 ) );
+      f.setAttribute( 2, QVariant( "abc" ) );
+
+      QgsExpression exp( "x1 * x2 + 2 ^ 3 > 10 AND name = 'abc' AND sqrt(x2) = 2" );
+      QVERIFY( exp.prepare( fields ) );
+      QVERIFY( exp.isCompiled() );
+      QCOMPARE( exp.evaluate( &f ), QVariant( 1 ) );
+
+      // NULL attributes propagate through operators and functions
+      f.setAttribute( 1, QVariant( QVariant::Int ) );
+      QCOMPARE( exp.evaluate( &f ), QVariant() );
+      QgsExpression exp2( "coalesce(x2, x1 * 2)" );
+      QVERIFY( exp2.prepare( fields ) );
+      QCOMPARE( exp2.evaluate( &f ), QVariant( 3.0 ) );
+
+      // errors are reported like in the tree
+      QgsExpression exp3( "x1 + name" );
+      QVERIFY( exp3.prepare( fields ) );
+      QVERIFY( exp3.evaluate( &f ).isNull() );
+      QVERIFY( exp3.hasEvalError() );
+
+      // integer division by zero
+      QgsExpression exp4( "x2 % 0" );
+      QVERIFY( exp4.prepare( fields ) );
+      f.setAttribute( 1, QVariant( 4 ) );
+      QCOMPARE( exp4.evaluate( &f ), QVariant() );
+    }
+
+    void eval_fields_reprepare()
+    {
+      QgsFields fields;
+      fields.append( QgsField( "a", QVariant::Int ) );
+      fields.append( QgsField( "b", QVariant::Int ) );
+      QgsFields swapped;
+      swapped.append( QgsField( "b", QVariant::Int ) );
+      swapped.append( QgsField( "a", QVariant::Int ) );
+
+      QgsFeature f;
+      f.setAttributes( QgsAttributes() << 10 << 3 );
+
+      // the program prepared for the first call is reused while the fields are the same
+      QgsExpression exp( "a - b" );
+      QCOMPARE( exp.evaluate( &f, fields ), QVariant( 7 ) );
+      QVERIFY( exp.isCompiled() );
+      f.setAttributes( QgsAttributes() << 20 << 5 );
+      QCOMPARE( exp.evaluate( &f, fields ), QVariant( 15 ) );
+
+      // and prepared again for other fields
+      QCOMPARE( exp.evaluate( &f, swapped ), QVariant( -15 ) );
+      QCOMPARE( exp.evaluate( &f, fields ), QVariant( 15 ) );
+
+      // an expression which failed to prepare is prepared again
+      QgsExpression exp2( "c + 1" );
+      QVERIFY( exp2.evaluate( &f, fields ).isNull() );
+      QVERIFY( exp2.hasEvalError() );
+      QVERIFY( exp2.evaluate( &f, fields ).isNull() );
+      QVERIFY( exp2.hasEvalError() );
+    }
+
+    void eval_batch_data()
+    {
+      QTest::addColumn<QString>( "string" );
+      QTest::newRow( "arithmetic" ) << "x1 * x2 + 2 ^ 3";
+      QTest::newRow( "int arithmetic" ) << "-x2 * 3 - x2 % 3";
+      QTest::newRow( "division by zero" ) << "10 / x2";
+      QTest::newRow( "comparison" ) << "x1 > 1 AND NOT x2 = 2 OR x1 IS NULL";
+      QTest::newRow( "string" ) << "name || '-' || x2";
+      QTest::newRow( "functions" ) << "coalesce(sqrt(x1 + x2), -1)";
+      QTest::newRow( "case" ) << "CASE WHEN x2 > 1 THEN x1 ELSE 0 END";
+      QTest::newRow( "rownum" ) << "$rownum * 10 + x2";
+      QTest::newRow( "error" ) << "x1 + name";
+    }
+
+    void eval_batch()
+    {
+      QFETCH( QString, string );
+
+      QgsFields fields;
+      fields.append( QgsField( "x1", QVariant::Double ) );
+      fields.append( QgsField( "x2", QVariant::Int ) );
+      fields.append( QgsField( "name", QVariant::String ) );
+
+      QgsFeatureList features;
+      for ( int i = 0; i < 6; ++i )
+      {
+        QgsFeature f;
+        f.initAttributes( 3 );
+        f.setAttribute( 0, i == 2 ? QVariant( QVariant::Double ) : QVariant( i * 0.75 ) );
+        f.setAttribute( 1, i == 4 ? QVariant( QVariant::Int ) : QVariant( i % 3 ) );
+        f.setAttribute( 2, i == 1 ? QVariant( "12" ) : QVariant( "abc" ) );
+        features << f;
+      }
+
+      // the batch must give the same values as evaluating the features one by one
+      for ( int compiled = 0; compiled < 2; ++compiled )
+      {
+        QgsExpression exp( string );
+        exp.setCompilationEnabled( compiled );
+        QVERIFY( exp.prepare( fields ) );
+
+        QgsExpressionContext context;
+        context.setCurrentRowNumber( 1 );
+        QVariantList results = exp.evaluate( features, &context );
+        QCOMPARE( results.count(), features.count() );
+        QCOMPARE( context.currentRowNumber(), 1 );
+
+        QString firstError;
+        for ( int i = 0; i < features.count(); ++i )
+        {
+          QgsExpressionContext rowContext;
+          rowContext.setCurrentRowNumber( 1 + i );
+          QVariant expected = exp.evaluate( &features[i], &rowContext );
+          if ( rowContext.hasEvalError() && firstError.isNull() )
+            firstError = rowContext.evalErrorString();
+          QCOMPARE( results.at( i ).type(), expected.type() );
+          QCOMPARE( results.at( i ), expected );
+        }
+        QCOMPARE( context.evalErrorString(), firstError );
+      }
+    }
+
+    void eval_batch_null_feature()
+    {
+      QgsFields fields;
+      fields.append( QgsField( "name", QVariant::String ) );
+      QgsFeature f;
+      f.setAttributes( QgsAttributes() << QVariant( "abc" ) );
+
+      // a missing feature gives the same value as evaluating without feature
+      for ( int compiled = 0; compiled < 2; ++compiled )
+      {
+        QgsExpression exp( "name" );
+        exp.setCompilationEnabled( compiled );
+        QVERIFY( exp.prepare( fields ) );
+
+        QList<const QgsFeature*> features;
+        features << &f << 0;
+        QVariantList results = exp.evaluate( features );
+        QCOMPARE( results.count(), 2 );
+        QCOMPARE( results.at( 0 ), QVariant( "abc" ) );
+        QCOMPARE( results.at( 1 ), exp.evaluate( ( const QgsFeature* ) 0 ) );
+        QCOMPARE( results.at( 1 ), QVariant( "[name]" ) );
+      }
+    }
+
+    void benchmark_evaluation_data()
+    {
+      QTest::addColumn<bool>( "compiled" );
+      QTest::addColumn<bool>( "batch" );
+      QTest::newRow( "tree" ) << false << false;
+      QTest::newRow( "compiled" ) << true << false;
+      QTest::newRow( "compiled batch" ) << true << true;
+    }
+
+    void benchmark_evaluation()
+    {
+      QFETCH( bool, compiled );
+      QFETCH( bool, batch );
+
+      QgsFields fields;
+      fields.append( QgsField( "a", QVariant::Double ) );
+      fields.append( QgsField( "b", QVariant::Double ) );
+
+      QList<QgsFeature> features;
+      for ( int i = 0; i < 10000; ++i )
+      {
+        QgsFeature f;
+        f.initAttributes( 2 );
+        f.setAttribute( 0, QVariant( i * 0.5 ) );
+        f.setAttribute( 1, QVariant( 10000.0 - i ) );
+        features << f;
+      }
+
+      QgsExpression exp( "(a * 2 + b) > 10 AND b < 100" );
+      exp.setCompilationEnabled( compiled );
+      QVERIFY( exp.prepare( fields ) );
+      QCOMPARE( exp.isCompiled(), compiled );
+
+      int count = 0;
+      QBENCHMARK
+      {
+        count = 0;
+        if ( batch )
+        {
+          foreach ( const QVariant& value, exp.evaluate( features ) )
+          {
+            if ( value.toInt() != 0 )
+              ++count;
+          }
+        }
+        else
+        {
+          foreach ( const QgsFeature& f, features )
+          {
+            if ( exp.evaluate( &f ).toInt() != 0 )
+              ++count;
+          }
+        }
+      }
+      QCOMPARE( count, 99 );
+    }
+
     void expression_from_expression()
     {
       {
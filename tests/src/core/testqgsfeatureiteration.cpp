@@ -0,0 +1,226 @@
+/***************************************************************************
+     testqgsfeatureiteration.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QDir>
+#include <QTemporaryFile>
+
+#include <qgsapplication.h>
+#include <qgsfeature.h>
+#include <qgsgeometry.h>
+#include <qgsvectorlayer.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorfilewriter.h>
+
+/** \ingroup UnitTests
+ * Iterating with one feature for all nextFeature calls, which lets the providers
+ * reuse its geometry buffer and attributes, compared to a new feature per call.
+ * The postgres provider is only included if QGIS_PGTEST_LAYER holds the uri of
+ * a postgres layer to read.
+ */
+class TestQgsFeatureIteration: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void reuse_data();
+    void reuse();
+    void benchmark_data();
+    void benchmark();
+
+  private:
+    QgsVectorLayer* layer( const QString& theProvider );
+    void addRows( bool theBenchmark );
+
+    QgsVectorLayer* mMemoryLayer;
+    QgsVectorLayer* mOgrLayer;
+    QgsVectorLayer* mPostgresLayer;
+    QString mShapeFile;
+};
+
+void TestQgsFeatureIteration::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  mMemoryLayer = new QgsVectorLayer( "LineString?field=id:integer&field=value:double&field=name:string(20)", "lines", "memory" );
+  QVERIFY( mMemoryLayer->isValid() );
+
+  // lines of 2 to 50 vertices
+  qsrand( 1 );
+  QgsFeatureList myFeatures;
+  for ( int i = 0; i < 20000; ++i )
+  {
+    QgsPolyline myLine;
+    int myVertices = 2 + qrand() % 49;
+    for ( int j = 0; j < myVertices; ++j )
+    {
+      myLine << QgsPoint( qrand() % 100000 / 10.0, qrand() % 100000 / 10.0 );
+    }
+    QgsFeature myFeature;
+    myFeature.setGeometry( QgsGeometry::fromPolyline( myLine ) );
+    myFeature.setAttributes( QgsAttributes() << i << qrand() / 7.0 << QString( "line %1" ).arg( i ) );
+    myFeatures << myFeature;
+  }
+  QVERIFY( mMemoryLayer->dataProvider()->addFeatures( myFeatures ) );
+
+  QTemporaryFile myFile( QDir::tempPath() + QDir::separator() + "iterationXXXXXX.shp" );
+  QVERIFY( myFile.open() );
+  mShapeFile = myFile.fileName();
+  myFile.close();
+  myFile.remove();
+  QCOMPARE( QgsVectorFileWriter::writeAsVectorFormat( mMemoryLayer, mShapeFile, "UTF-8", ( const QgsCoordinateReferenceSystem* ) 0 ), QgsVectorFileWriter::NoError );
+  mOgrLayer = new QgsVectorLayer( mShapeFile, "lines", "ogr" );
+  QVERIFY( mOgrLayer->isValid() );
+
+  mPostgresLayer = 0;
+  QString myUri = QString::fromLocal8Bit( qgetenv( "QGIS_PGTEST_LAYER" ) );
+  if ( !myUri.isEmpty() )
+  {
+    mPostgresLayer = new QgsVectorLayer( myUri, "postgres", "postgres" );
+  }
+}
+
+void TestQgsFeatureIteration::cleanupTestCase()
+{
+  delete mMemoryLayer;
+  delete mOgrLayer;
+  delete mPostgresLayer;
+  QgsVectorFileWriter::deleteShapeFile( mShapeFile );
+}
+
+QgsVectorLayer* TestQgsFeatureIteration::layer( const QString& theProvider )
+{
+  if ( theProvider == "memory" )
+    return mMemoryLayer;
+  if ( theProvider == "ogr" )
+    return mOgrLayer;
+  return mPostgresLayer;
+}
+
+void TestQgsFeatureIteration::addRows( bool theBenchmark )
+{
+  QTest::addColumn<QString>( "provider" );
+  if ( theBenchmark )
+    QTest::addColumn<bool>( "reuseFeature" );
+
+  QStringList myProviders;
+  myProviders << "memory" << "ogr" << "postgres";
+  foreach ( QString myProvider, myProviders )
+  {
+    if ( !theBenchmark )
+    {
+      QTest::newRow( myProvider.toAscii() ) << myProvider;
+      continue;
+    }
+    QTest::newRow(( myProvider + " reused feature" ).toAscii() ) << myProvider << true;
+    QTest::newRow(( myProvider + " new feature" ).toAscii() ) << myProvider << false;
+  }
+}
+
+void TestQgsFeatureIteration::reuse_data()
+{
+  addRows( false );
+}
+
+// the geometry buffer of the feature is only replaced for geometries larger than all before
+void TestQgsFeatureIteration::reuse()
+{
+  QFETCH( QString, provider );
+  QgsVectorLayer* myLayer = layer( provider );
+  if ( !myLayer || !myLayer->isValid() )
+    QSKIP( "Set QGIS_PGTEST_LAYER to the uri of a postgres layer to include it", SkipSingle );
+
+  int myFeatures = 0;
+  int myGrowths = 0;
+  int myReallocations = 0;
+  size_t myMaxSize = 0;
+  const unsigned char* myBuffer = 0;
+
+  QgsFeature myFeature;
+  QgsFeatureIterator myIterator = myLayer->getFeatures();
+  while ( myIterator.nextFeature( myFeature ) )
+  {
+    ++myFeatures;
+    QVERIFY( myFeature.geometry() );
+    const unsigned char* myWkb = myFeature.geometry()->asWkb();
+    size_t mySize = myFeature.geometry()->wkbSize();
+    if ( mySize > myMaxSize )
+    {
+      myMaxSize = mySize;
+      ++myGrowths;
+    }
+    if ( myWkb != myBuffer )
+    {
+      myBuffer = myWkb;
+      ++myReallocations;
+    }
+
+    if ( provider != "postgres" )
+    {
+      QgsFeature mySource;
+      QVERIFY( mMemoryLayer->getFeatures( QgsFeatureRequest().setFilterFid( myFeature.attribute( 0 ).toInt() + 1 ) ).nextFeature( mySource ) );
+      QCOMPARE( myFeature.attribute( 2 ), mySource.attribute( 2 ) );
+      QCOMPARE( myFeature.geometry()->asPolyline(), mySource.geometry()->asPolyline() );
+    }
+  }
+
+  QVERIFY( myFeatures > 0 );
+  QVERIFY( myReallocations <= myGrowths );
+  if ( provider != "postgres" )
+  {
+    // the generated lines have one of 49 sizes
+    QCOMPARE( myFeatures, 20000 );
+    QVERIFY( myReallocations <= 49 );
+  }
+}
+
+void TestQgsFeatureIteration::benchmark_data()
+{
+  addRows( true );
+}
+
+void TestQgsFeatureIteration::benchmark()
+{
+  QFETCH( QString, provider );
+  QFETCH( bool, reuseFeature );
+  QgsVectorLayer* myLayer = layer( provider );
+  if ( !myLayer || !myLayer->isValid() )
+    QSKIP( "Set QGIS_PGTEST_LAYER to the uri of a postgres layer to include it", SkipSingle );
+
+  QBENCHMARK
+  {
+    QgsFeatureIterator myIterator = myLayer->getFeatures();
+    if ( reuseFeature )
+    {
+      QgsFeature myFeature;
+      while ( myIterator.nextFeature( myFeature ) )
+        ;
+    }
+    else
+    {
+      for ( ;; )
+      {
+        QgsFeature myFeature;
+        if ( !myIterator.nextFeature( myFeature ) )
+          break;
+      }
+    }
+  }
+}
+
+QTEST_MAIN( TestQgsFeatureIteration )
+#include "moc_testqgsfeatureiteration.cxx"
@@ -37,6 +37,7 @@
 #include <qgsmaprenderer.h>
 #include <qgsmaplayer.h>
 #include <qgsvectorlayer.h>
+#include <qgsrasterlayer.h>
 #include <qgsapplication.h>
 #include <qgsproviderregistry.h>
 #include <qgsmaplayerregistry.h>
@@ -61,7 +62,23 @@ class TestQgsMapRenderer: public QObject
     /** This method tests render perfomance */
     void performanceTest();
 
+    /** This method tests that parallel rendering matches sequential rendering */
+    void parallelRenderTest();
+
+    /** This method tests parallel rendering of vector and raster layers against sequential rendering */
+    void parallelMultiLayerTest();
+
+    /** This method tests that cancelling a parallel render stops all layers */
+    void parallelCancelTest();
+
+  public slots:
+    /** Cancels the render in progress, called by drawingProgress */
+    void stopRendering();
+
   private:
+    QImage renderImage( bool theParallel );
+    int differentPixels( const QImage& theImage1, const QImage& theImage2 );
+
     QString mEncoding;
     QgsVectorFileWriter::WriterError mError;
     QgsCoordinateReferenceSystem mCRS;
@@ -194,6 +211,111 @@ void TestQgsMapRenderer::performanceTest()
   QVERIFY( myResultFlag );
 }
 
+void TestQgsMapRenderer::parallelRenderTest()
+{
+  mpMapRenderer->setExtent( mpPolysLayer->extent() );
+  mpMapRenderer->setParallelRenderingEnabled( true );
+  QgsRenderChecker myChecker;
+  myChecker.setControlName( "expected_maprender" );
+  myChecker.setMapRenderer( mpMapRenderer );
+  bool myResultFlag = myChecker.runTest( "maprender_parallel" );
+  mpMapRenderer->setParallelRenderingEnabled( false );
+  mReport += myChecker.report();
+  QVERIFY( myResultFlag );
+}
+
+void TestQgsMapRenderer::parallelMultiLayerTest()
+{
+  QString myDataDir = QString( TEST_DATA_DIR ) + QDir::separator();
+  QList<QgsMapLayer *> myLayers;
+  myLayers << new QgsRasterLayer( myDataDir + "tenbytenraster.asc", "raster" );
+  myLayers << new QgsVectorLayer( myDataDir + "polys.shp", "polys", "ogr" );
+  myLayers << new QgsVectorLayer( myDataDir + "lines.shp", "lines", "ogr" );
+  myLayers << new QgsVectorLayer( myDataDir + "points.shp", "points", "ogr" );
+  QStringList myLayerSet;
+  foreach ( QgsMapLayer* myLayer, myLayers )
+  {
+    QVERIFY( myLayer->isValid() );
+    // top layer first
+    myLayerSet.prepend( myLayer->id() );
+  }
+  QgsMapLayerRegistry::instance()->addMapLayers( myLayers );
+
+  QgsRectangle myExtent = myLayers[1]->extent();
+  QgsRectangle myLinesExtent = myLayers[2]->extent();
+  myExtent.combineExtentWith( &myLinesExtent );
+  myExtent.scale( 1.1 );
+  mpMapRenderer->setLayerSet( myLayerSet );
+  mpMapRenderer->setExtent( myExtent );
+
+  QImage mySerialImage = renderImage( false );
+  QImage myParallelImage = renderImage( true );
+  QCOMPARE( differentPixels( mySerialImage, myParallelImage ), 0 );
+
+  foreach ( QgsMapLayer* myLayer, myLayers )
+  {
+    QgsMapLayerRegistry::instance()->removeMapLayers( QStringList( myLayer->id() ) );
+  }
+  mpMapRenderer->setLayerSet( QStringList( mpPolysLayer->id() ) );
+}
+
+void TestQgsMapRenderer::parallelCancelTest()
+{
+  mpMapRenderer->setExtent( mpPolysLayer->extent() );
+  QImage myCompleteImage = renderImage( true );
+
+  // stop as soon as the workers have been started
+  connect( mpMapRenderer, SIGNAL( drawingProgress( int, int ) ), this, SLOT( stopRendering() ) );
+  QImage myCancelledImage = renderImage( true );
+  disconnect( mpMapRenderer, SIGNAL( drawingProgress( int, int ) ), this, SLOT( stopRendering() ) );
+
+  QVERIFY( mpMapRenderer->rendererContext()->renderingStopped() );
+  QVERIFY( differentPixels( myCompleteImage, myCancelledImage ) > 0 );
+
+  // the next render is complete again
+  QCOMPARE( differentPixels( myCompleteImage, renderImage( true ) ), 0 );
+  QVERIFY( !mpMapRenderer->rendererContext()->renderingStopped() );
+}
+
+void TestQgsMapRenderer::stopRendering()
+{
+  mpMapRenderer->rendererContext()->setRenderingStopped( true );
+}
+
+QImage TestQgsMapRenderer::renderImage( bool theParallel )
+{
+  QImage myImage( 600, 400, QImage::Format_RGB32 );
+  myImage.fill( qRgb( 152, 219, 249 ) );
+  mpMapRenderer->setOutputSize( myImage.size(), myImage.logicalDpiX() );
+  mpMapRenderer->setParallelRenderingEnabled( theParallel );
+  QPainter myPainter( &myImage );
+  mpMapRenderer->render( &myPainter );
+  myPainter.end();
+  mpMapRenderer->setParallelRenderingEnabled( false );
+  return myImage;
+}
+
+int TestQgsMapRenderer::differentPixels( const QImage& theImage1, const QImage& theImage2 )
+{
+  // allow for rounding differences of the alpha blending
+  int myCount = 0;
+  for ( int y = 0; y < theImage1.height(); ++y )
+  {
+    for ( int x = 0; x < theImage1.width(); ++x )
+    {
+      QRgb myPixel1 = theImage1.pixel( x, y );
+      QRgb myPixel2 = theImage2.pixel( x, y );
+      if ( qAbs( qRed( myPixel1 ) - qRed( myPixel2 ) ) > 2 ||
+           qAbs( qGreen( myPixel1 ) - qGreen( myPixel2 ) ) > 2 ||
+           qAbs( qBlue( myPixel1 ) - qBlue( myPixel2 ) ) > 2 )
+      {
+        ++myCount;
+      }
+    }
+  }
+  return myCount;
+}
+
 QTEST_MAIN( TestQgsMapRenderer )
 #include "moc_testqgsmaprenderer.cxx"
 
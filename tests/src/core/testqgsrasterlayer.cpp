@@ -26,6 +26,7 @@
 #include <QDesktopServices>
 
 #include "cpl_conv.h"
+#include "gdal.h"
 
 //qgis includes...
 #include <qgsrasterlayer.h>
@@ -67,6 +68,9 @@ class TestQgsRasterLayer: public QObject
     void checkDimensions();
     void checkStats();
     void buildExternalOverviews();
+    void cancelAndResumeOverviews();
+    void compareOverviewsWithGdal();
+    void cachedBlocks();
     void registry();
     void transparency();
     void setRenderer();
@@ -102,6 +106,23 @@ class TestSignalReceiver : public QObject
     }
 };
 
+class TestPyramidCanceler : public QObject
+{
+    Q_OBJECT;
+
+  public:
+    TestPyramidCanceler( QgsRasterDataProvider* provider ) : QObject( 0 ),
+        mProvider( provider )
+    {}
+  public slots:
+    void onProgress( int, double, QString )
+    {
+      mProvider->cancelBuildPyramids();
+    }
+  private:
+    QgsRasterDataProvider* mProvider;
+};
+
 //runs before all tests
 void TestQgsRasterLayer::initTestCase()
 {
@@ -404,6 +425,179 @@ void TestQgsRasterLayer::buildExternalOverviews()
   mReport += "<p>Passed</p>";
 }
 
+void TestQgsRasterLayer::cancelAndResumeOverviews()
+{
+  QString myTempPath = QDir::tempPath() + QDir::separator();
+  QFile::remove( myTempPath + "landsat.tif.ovr" );
+  QFile::remove( myTempPath + "landsat.tif.pyramids.resume" );
+  QFile::remove( myTempPath + "landsat.tif" );
+  QVERIFY( QFile::copy( mTestDataDir + "landsat.tif", myTempPath + "landsat.tif" ) );
+  QFileInfo myRasterFileInfo( myTempPath + "landsat.tif" );
+  QgsRasterLayer * mypLayer = new QgsRasterLayer( myRasterFileInfo.filePath(),
+      myRasterFileInfo.completeBaseName() );
+  QVERIFY( mypLayer->isValid() );
+  QgsRasterDataProvider* myProvider = mypLayer->dataProvider();
+
+  QList< QgsRasterPyramid > myPyramidList = myProvider->buildPyramidList();
+  for ( int myCounterInt = 0; myCounterInt < myPyramidList.count(); myCounterInt++ )
+  {
+    myPyramidList[myCounterInt].build = true;
+  }
+
+  //cancel on the first progress report, the position of the build is kept
+  TestPyramidCanceler myCanceler( myProvider );
+  connect( myProvider, SIGNAL( progress( int, double, QString ) ),
+           &myCanceler, SLOT( onProgress( int, double, QString ) ) );
+  QString myResult = myProvider->buildPyramids( myPyramidList, "AVERAGE", QgsRaster::PyramidsGTiff );
+  QCOMPARE( myResult, QString( "CANCELED" ) );
+  QVERIFY( myProvider->buildPyramidsCanceled() );
+  QVERIFY( QFile::exists( myTempPath + "landsat.tif.pyramids.resume" ) );
+  //the resume file holds the size and modification time of the closed overview file
+  QFile myResumeFile( myTempPath + "landsat.tif.pyramids.resume" );
+  QVERIFY( myResumeFile.open( QIODevice::ReadOnly | QIODevice::Text ) );
+  QStringList myResumeLines = QString( myResumeFile.readAll() ).split( "\n" );
+  myResumeFile.close();
+  QVERIFY( myResumeLines.size() >= 5 );
+  QFileInfo myOverviewFileInfo( myTempPath + "landsat.tif.ovr" );
+  QVERIFY( myOverviewFileInfo.isFile() );
+  QCOMPARE( myResumeLines[3], QString( "%1 %2" ).arg( myOverviewFileInfo.size() ).arg( myOverviewFileInfo.lastModified().toMSecsSinceEpoch() ) );
+  disconnect( myProvider, SIGNAL( progress( int, double, QString ) ),
+              &myCanceler, SLOT( onProgress( int, double, QString ) ) );
+
+  //the second build finishes and removes the resume file
+  myResult = myProvider->buildPyramids( myPyramidList, "AVERAGE", QgsRaster::PyramidsGTiff );
+  QVERIFY( myResult.isNull() );
+  QVERIFY( !myProvider->buildPyramidsCanceled() );
+  QVERIFY( !QFile::exists( myTempPath + "landsat.tif.pyramids.resume" ) );
+  myPyramidList = myProvider->buildPyramidList();
+  for ( int myCounterInt = 0; myCounterInt < myPyramidList.count(); myCounterInt++ )
+  {
+    QVERIFY( myPyramidList.at( myCounterInt ).exists );
+  }
+  delete mypLayer;
+  mReport += "<h2>Check Canceled Overviews</h2>\n";
+  mReport += "<p>Passed</p>";
+}
+
+void TestQgsRasterLayer::cachedBlocks()
+{
+  QgsRasterDataProvider* myProvider = mpLandsatRasterLayer->dataProvider();
+  QgsRectangle myExtent = myProvider->extent();
+  int myWidth = myProvider->xSize();
+  int myHeight = myProvider->ySize();
+  double myXRes = myExtent.width() / myWidth;
+  double myYRes = myExtent.height() / myHeight;
+
+  QgsRasterBlock* myFullBlock = myProvider->block( 1, myExtent, myWidth, myHeight );
+  QVERIFY( myFullBlock );
+
+  //a panned window at the native resolution is read from the cached tiles, twice to read it from memory
+  int myLeft = 10;
+  int myTop = 5;
+  int mySubWidth = myWidth / 2;
+  int mySubHeight = myHeight / 2;
+  QgsRectangle mySubExtent( myExtent.xMinimum() + myLeft * myXRes,
+                            myExtent.yMaximum() - ( myTop + mySubHeight ) * myYRes,
+                            myExtent.xMinimum() + ( myLeft + mySubWidth ) * myXRes,
+                            myExtent.yMaximum() - myTop * myYRes );
+  for ( int myPass = 0; myPass < 2; myPass++ )
+  {
+    QgsRasterBlock* mySubBlock = myProvider->block( 1, mySubExtent, mySubWidth, mySubHeight );
+    QVERIFY( mySubBlock );
+    for ( int myRow = 0; myRow < mySubHeight; myRow++ )
+    {
+      for ( int myCol = 0; myCol < mySubWidth; myCol++ )
+      {
+        QCOMPARE( mySubBlock->value( myRow, myCol ), myFullBlock->value( myTop + myRow, myLeft + myCol ) );
+      }
+    }
+    delete mySubBlock;
+  }
+  delete myFullBlock;
+  mReport += "<h2>Check Cached Blocks</h2>\n";
+  mReport += "<p>Passed</p>";
+}
+
+void TestQgsRasterLayer::compareOverviewsWithGdal()
+{
+  GDALAllRegister();
+  QString myTempPath = QDir::tempPath() + QDir::separator();
+  QStringList myMethods;
+  myMethods << "NEAREST" << "AVERAGE";
+  foreach ( QString myMethod, myMethods )
+  {
+    QString myQgisFile = myTempPath + "landsat_qgis.tif";
+    QString myGdalFile = myTempPath + "landsat_gdal.tif";
+    foreach ( QString myFile, QStringList() << myQgisFile << myGdalFile )
+    {
+      QFile::remove( myFile + ".ovr" );
+      QFile::remove( myFile + ".pyramids.resume" );
+      QFile::remove( myFile );
+      QVERIFY( QFile::copy( mTestDataDir + "landsat.tif", myFile ) );
+    }
+
+    //overviews of the pyramid builder
+    QgsRasterLayer * mypLayer = new QgsRasterLayer( myQgisFile, "landsat_qgis" );
+    QVERIFY( mypLayer->isValid() );
+    QList< QgsRasterPyramid > myPyramidList = mypLayer->dataProvider()->buildPyramidList();
+    QVector<int> myLevels;
+    for ( int myCounterInt = 0; myCounterInt < myPyramidList.count(); myCounterInt++ )
+    {
+      myPyramidList[myCounterInt].build = true;
+      myLevels << myPyramidList[myCounterInt].level;
+    }
+    QVERIFY( myLevels.size() > 1 );
+    QVERIFY( mypLayer->dataProvider()->buildPyramids( myPyramidList, myMethod, QgsRaster::PyramidsGTiff ).isNull() );
+    delete mypLayer;
+
+    //overviews of GDAL calculated from the full resolution
+    GDALDatasetH myGdalDataset = GDALOpen( QFile::encodeName( myGdalFile ).constData(), GA_ReadOnly );
+    QVERIFY( myGdalDataset );
+    QCOMPARE( GDALBuildOverviews( myGdalDataset, myMethod.toLocal8Bit().constData(), myLevels.size(), myLevels.data(),
+                                  0, NULL, NULL, NULL ), CE_None );
+    GDALClose( myGdalDataset );
+
+    myGdalDataset = GDALOpen( QFile::encodeName( myGdalFile ).constData(), GA_ReadOnly );
+    GDALDatasetH myQgisDataset = GDALOpen( QFile::encodeName( myQgisFile ).constData(), GA_ReadOnly );
+    QVERIFY( myGdalDataset && myQgisDataset );
+    for ( int myBand = 1; myBand <= GDALGetRasterCount( myGdalDataset ); myBand++ )
+    {
+      GDALRasterBandH myGdalBand = GDALGetRasterBand( myGdalDataset, myBand );
+      GDALRasterBandH myQgisBand = GDALGetRasterBand( myQgisDataset, myBand );
+      QCOMPARE( GDALGetOverviewCount( myQgisBand ), GDALGetOverviewCount( myGdalBand ) );
+      for ( int myOverview = 0; myOverview < GDALGetOverviewCount( myGdalBand ); myOverview++ )
+      {
+        GDALRasterBandH myGdalOverview = GDALGetOverview( myGdalBand, myOverview );
+        GDALRasterBandH myQgisOverview = GDALGetOverview( myQgisBand, myOverview );
+        int myWidth = GDALGetRasterBandXSize( myGdalOverview );
+        int myHeight = GDALGetRasterBandYSize( myGdalOverview );
+        QCOMPARE( GDALGetRasterBandXSize( myQgisOverview ), myWidth );
+        QCOMPARE( GDALGetRasterBandYSize( myQgisOverview ), myHeight );
+        QVector<double> myGdalData( myWidth * myHeight );
+        QVector<double> myQgisData( myWidth * myHeight );
+        QCOMPARE( GDALRasterIO( myGdalOverview, GF_Read, 0, 0, myWidth, myHeight, myGdalData.data(),
+                                myWidth, myHeight, GDT_Float64, 0, 0 ), CE_None );
+        QCOMPARE( GDALRasterIO( myQgisOverview, GF_Read, 0, 0, myWidth, myHeight, myQgisData.data(),
+                                myWidth, myHeight, GDT_Float64, 0, 0 ), CE_None );
+
+        //nearest picks the same cells, averages of levels derived from rounded averages may differ by one
+        double myTolerance = myMethod == "AVERAGE" && myOverview > 0 ? 1 : 0;
+        for ( int i = 0; i < myWidth * myHeight; i++ )
+        {
+          if ( qAbs( myQgisData[i] - myGdalData[i] ) > myTolerance )
+          {
+            QFAIL( QString( "%1 overview %2 of band %3 differs at cell %4: %5 != %6" ).arg( myMethod ).arg( myOverview ).arg( myBand )
+                   .arg( i ).arg( myQgisData[i] ).arg( myGdalData[i] ).toLocal8Bit().constData() );
+          }
+        }
+      }
+    }
+    GDALClose( myGdalDataset );
+    GDALClose( myQgisDataset );
+  }
+  mReport += "<h2>Compare Overviews with GDAL</h2>\n";
+  mReport += "<p>Passed</p>";
+}
 
 void TestQgsRasterLayer::registry()
 {
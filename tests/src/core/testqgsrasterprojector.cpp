@@ -0,0 +1,126 @@
+/***************************************************************************
+     testqgsrasterprojector.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QDir>
+#include <QFileInfo>
+
+#include "cpl_conv.h"
+
+//header for class being tested
+#include <qgsrasterprojector.h>
+#include <qgsrasterlayer.h>
+#include <qgsrasterblock.h>
+#include <qgscoordinatetransform.h>
+#include <qgsapplication.h>
+
+class TestQgsRasterProjector: public QObject
+{
+    Q_OBJECT;
+
+  private:
+    QgsRasterLayer *mLayer;
+
+  private slots:
+
+    void initTestCase()
+    {
+      QgsApplication::init();
+      QgsApplication::initQgis();
+      CPLSetConfigOption( "GDAL_PAM_ENABLED", "NO" );
+      QFileInfo myFileInfo( QString( TEST_DATA_DIR ) + QDir::separator() + "landsat.tif" );
+      mLayer = new QgsRasterLayer( myFileInfo.filePath(), myFileInfo.completeBaseName() );
+      QVERIFY( mLayer->isValid() );
+    }
+
+    void cleanupTestCase()
+    {
+      delete mLayer;
+    }
+
+    // every projected cell comes from the source cell under the precisely transformed cell center
+    // or one of its neighbours, a repeated request (grid from cache) gives the same block
+    void projectBlock()
+    {
+      QgsRasterDataProvider *myProvider = mLayer->dataProvider();
+      QgsCoordinateReferenceSystem mySrcCrs = myProvider->crs();
+      QgsCoordinateReferenceSystem myDestCrs( "EPSG:4326" );
+      QVERIFY( mySrcCrs.isValid() && myDestCrs.isValid() );
+
+      QgsRectangle mySrcExtent = myProvider->extent();
+      int mySrcWidth = myProvider->xSize();
+      int mySrcHeight = myProvider->ySize();
+      double mySrcXRes = mySrcExtent.width() / mySrcWidth;
+      double mySrcYRes = mySrcExtent.height() / mySrcHeight;
+
+      QgsCoordinateTransform myTransform( mySrcCrs, myDestCrs );
+      QgsRectangle myDestExtent = myTransform.transformBoundingBox( mySrcExtent );
+
+      QgsRasterProjector myProjector( mySrcCrs, myDestCrs, mySrcXRes, mySrcYRes, mySrcExtent );
+      myProjector.setInput( myProvider );
+
+      // large enough to be filled in parallel
+      int myWidth = 600;
+      int myHeight = 600;
+      QgsRasterBlock *myBlock = myProjector.block( 1, myDestExtent, myWidth, myHeight );
+      QgsRasterBlock *myRepeated = myProjector.block( 1, myDestExtent, myWidth, myHeight );
+      QgsRasterBlock *mySource = myProvider->block( 1, mySrcExtent, mySrcWidth, mySrcHeight );
+      QVERIFY( myBlock && myBlock->isValid() );
+      QVERIFY( myRepeated && myRepeated->isValid() );
+      QVERIFY( mySource && mySource->isValid() );
+
+      double myDestXRes = myDestExtent.width() / myWidth;
+      double myDestYRes = myDestExtent.height() / myHeight;
+      int myChecked = 0;
+      for ( int myRow = 0; myRow < myHeight; myRow++ )
+      {
+        for ( int myCol = 0; myCol < myWidth; myCol++ )
+        {
+          QCOMPARE( myRepeated->isNoData( myRow, myCol ), myBlock->isNoData( myRow, myCol ) );
+          if ( myBlock->isNoData( myRow, myCol ) )
+            continue;
+          QCOMPARE( myRepeated->value( myRow, myCol ), myBlock->value( myRow, myCol ) );
+
+          if ( myRow % 7 != 0 || myCol % 7 != 0 )
+            continue;
+
+          QgsPoint myPoint = myTransform.transform( QgsPoint( myDestExtent.xMinimum() + ( myCol + 0.5 ) * myDestXRes,
+                             myDestExtent.yMaximum() - ( myRow + 0.5 ) * myDestYRes ),
+                             QgsCoordinateTransform::ReverseTransform );
+          int mySrcRow = ( int ) floor(( mySrcExtent.yMaximum() - myPoint.y() ) / mySrcYRes );
+          int mySrcCol = ( int ) floor(( myPoint.x() - mySrcExtent.xMinimum() ) / mySrcXRes );
+          bool myFound = false;
+          for ( int r = qMax( 0, mySrcRow - 1 ); r <= qMin( mySrcHeight - 1, mySrcRow + 1 ); r++ )
+          {
+            for ( int c = qMax( 0, mySrcCol - 1 ); c <= qMin( mySrcWidth - 1, mySrcCol + 1 ); c++ )
+            {
+              if ( mySource->value( r, c ) == myBlock->value( myRow, myCol ) )
+                myFound = true;
+            }
+          }
+          QVERIFY( myFound );
+          myChecked++;
+        }
+      }
+      QVERIFY( myChecked > 0 );
+
+      delete myBlock;
+      delete myRepeated;
+      delete mySource;
+    }
+};
+
+QTEST_MAIN( TestQgsRasterProjector )
+
+#include "moc_testqgsrasterprojector.cxx"
@@ -0,0 +1,193 @@
+/***************************************************************************
+     testqgsrasterresampler.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QImage>
+
+//header for class being tested
+#include <qgsrasterresamplerkernels.h>
+#include <qgsbilinearrasterresampler.h>
+#include <qgscubicrasterresampler.h>
+
+Q_DECLARE_METATYPE( QgsRasterResamplerKernels::InstructionSet );
+
+class TestQgsRasterResampler: public QObject
+{
+    Q_OBJECT;
+
+  private:
+    // premultiplied image with sharp edges (which make the cubic patches overshoot) and varying alpha
+    QImage testImage( int theWidth, int theHeight )
+    {
+      QImage myImage( theWidth, theHeight, QImage::Format_ARGB32_Premultiplied );
+      qsrand( 1 );
+      for ( int y = 0; y < theHeight; y++ )
+      {
+        for ( int x = 0; x < theWidth; x++ )
+        {
+          int a = ( x / 5 + y / 3 ) % 4 == 0 ? 255 : ( x * 7 + y * 3 ) % 256;
+          myImage.setPixel( x, y, qRgba( qrand() % ( a + 1 ), qrand() % ( a + 1 ), ( x * a / theWidth ) % ( a + 1 ), a ) );
+        }
+      }
+      return myImage;
+    }
+
+    int maxDifference( const QImage& theImage1, const QImage& theImage2 )
+    {
+      int myMax = 0;
+      for ( int y = 0; y < theImage1.height(); y++ )
+      {
+        for ( int x = 0; x < theImage1.width(); x++ )
+        {
+          QRgb p1 = theImage1.pixel( x, y );
+          QRgb p2 = theImage2.pixel( x, y );
+          myMax = qMax( myMax, qAbs( qRed( p1 ) - qRed( p2 ) ) );
+          myMax = qMax( myMax, qAbs( qGreen( p1 ) - qGreen( p2 ) ) );
+          myMax = qMax( myMax, qAbs( qBlue( p1 ) - qBlue( p2 ) ) );
+          myMax = qMax( myMax, qAbs( qAlpha( p1 ) - qAlpha( p2 ) ) );
+        }
+      }
+      return myMax;
+    }
+
+    bool isPremultiplied( const QImage& theImage )
+    {
+      for ( int y = 0; y < theImage.height(); y++ )
+      {
+        for ( int x = 0; x < theImage.width(); x++ )
+        {
+          QRgb p = theImage.pixel( x, y );
+          if ( qRed( p ) > qAlpha( p ) || qGreen( p ) > qAlpha( p ) || qBlue( p ) > qAlpha( p ) )
+            return false;
+        }
+      }
+      return true;
+    }
+
+  private slots:
+
+    void cleanup()
+    {
+      QgsRasterResamplerKernels::setInstructionSet( QgsRasterResamplerKernels::supportedInstructionSet() );
+    }
+
+    // pixel centers of the same size are not interpolated
+    void identity()
+    {
+      QImage mySrc = testImage( 50, 40 );
+      QImage myBilinear( 50, 40, QImage::Format_ARGB32_Premultiplied );
+      QgsBilinearRasterResampler().resample( mySrc, myBilinear );
+      QCOMPARE( maxDifference( myBilinear, mySrc ), 0 );
+      QImage myCubic( 50, 40, QImage::Format_ARGB32_Premultiplied );
+      QgsCubicRasterResampler().resample( mySrc, myCubic );
+      QCOMPARE( maxDifference( myCubic, mySrc ), 0 );
+    }
+
+    // a uniform image stays uniform, also if it is not premultiplied
+    void uniform()
+    {
+      QImage mySrc( 13, 7, QImage::Format_ARGB32 );
+      mySrc.fill( qRgba( 200, 100, 50, 128 ) );
+      QImage myExpected = mySrc.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+      QImage myDst( 61, 29, QImage::Format_ARGB32_Premultiplied );
+      QgsCubicRasterResampler().resample( mySrc, myDst );
+      QCOMPARE( myDst.format(), QImage::Format_ARGB32_Premultiplied );
+      for ( int y = 0; y < myDst.height(); y++ )
+      {
+        for ( int x = 0; x < myDst.width(); x++ )
+        {
+          QCOMPARE( myDst.pixel( x, y ), myExpected.pixel( 0, 0 ) );
+        }
+      }
+    }
+
+    // all instruction sets give the same result up to rounding, and valid premultiplied colors
+    void instructionSets()
+    {
+      QImage mySrc = testImage( 37, 23 );
+      QImage myScalarCubic( 301, 97, QImage::Format_ARGB32_Premultiplied );
+      QImage myScalarBilinear = myScalarCubic;
+      QgsRasterResamplerKernels::setInstructionSet( QgsRasterResamplerKernels::Scalar );
+      QgsRasterResamplerKernels::cubic( mySrc, myScalarCubic );
+      QgsRasterResamplerKernels::bilinear( mySrc, myScalarBilinear );
+      QVERIFY( isPremultiplied( myScalarCubic ) );
+
+      for ( int mySet = QgsRasterResamplerKernels::SSE2; mySet <= QgsRasterResamplerKernels::supportedInstructionSet(); mySet++ )
+      {
+        QgsRasterResamplerKernels::setInstructionSet(( QgsRasterResamplerKernels::InstructionSet ) mySet );
+        QImage myCubic( 301, 97, QImage::Format_ARGB32_Premultiplied );
+        QImage myBilinear = myCubic;
+        QgsRasterResamplerKernels::cubic( mySrc, myCubic );
+        QgsRasterResamplerKernels::bilinear( mySrc, myBilinear );
+        QVERIFY( isPremultiplied( myCubic ) );
+        QVERIFY( maxDifference( myCubic, myScalarCubic ) <= 1 );
+        QVERIFY( maxDifference( myBilinear, myScalarBilinear ) <= 1 );
+      }
+    }
+
+    void benchmark_data()
+    {
+      QTest::addColumn<QString>( "resampler" );
+      QTest::addColumn<QgsRasterResamplerKernels::InstructionSet>( "instructionSet" );
+      QTest::addColumn<int>( "srcSize" );
+      QTest::addColumn<int>( "dstSize" );
+
+      // zoomed in tiles, the source block has a quarter of the output resolution
+      QList< QPair<int, int> > mySizes;
+      mySizes << qMakePair( 64, 256 ) << qMakePair( 256, 1024 ) << qMakePair( 512, 2048 );
+      QPair<int, int> mySize;
+      foreach ( mySize, mySizes )
+      {
+        QString mySizeName = QString( "%1 to %2" ).arg( mySize.first ).arg( mySize.second );
+        // what QgsBilinearRasterResampler used before
+        QTest::newRow(( "qt smooth " + mySizeName ).toAscii() ) << "qt" << QgsRasterResamplerKernels::Scalar << mySize.first << mySize.second;
+        for ( int mySet = QgsRasterResamplerKernels::Scalar; mySet <= QgsRasterResamplerKernels::supportedInstructionSet(); mySet++ )
+        {
+          QgsRasterResamplerKernels::InstructionSet mySetEnum = ( QgsRasterResamplerKernels::InstructionSet ) mySet;
+          QString mySetName = QgsRasterResamplerKernels::instructionSetName( mySetEnum );
+          QTest::newRow(( "bilinear " + mySetName + " " + mySizeName ).toAscii() ) << "bilinear" << mySetEnum << mySize.first << mySize.second;
+          QTest::newRow(( "cubic " + mySetName + " " + mySizeName ).toAscii() ) << "cubic" << mySetEnum << mySize.first << mySize.second;
+        }
+      }
+    }
+
+    void benchmark()
+    {
+      QFETCH( QString, resampler );
+      QFETCH( QgsRasterResamplerKernels::InstructionSet, instructionSet );
+      QFETCH( int, srcSize );
+      QFETCH( int, dstSize );
+
+      QgsRasterResamplerKernels::setInstructionSet( instructionSet );
+      QImage mySrc = testImage( srcSize, srcSize );
+      QImage myDst( dstSize, dstSize, QImage::Format_ARGB32_Premultiplied );
+
+      if ( resampler == "qt" )
+      {
+        QBENCHMARK { myDst = mySrc.scaled( dstSize, dstSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ); }
+      }
+      else if ( resampler == "bilinear" )
+      {
+        QBENCHMARK { QgsRasterResamplerKernels::bilinear( mySrc, myDst ); }
+      }
+      else
+      {
+        QBENCHMARK { QgsRasterResamplerKernels::cubic( mySrc, myDst ); }
+      }
+    }
+};
+
+QTEST_MAIN( TestQgsRasterResampler )
+
+#include "moc_testqgsrasterresampler.cxx"
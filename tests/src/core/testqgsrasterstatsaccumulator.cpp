@@ -0,0 +1,129 @@
+/***************************************************************************
+     testqgsrasterstatsaccumulator.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <cmath>
+//header for class being tested
+#include <qgsrasterstatsaccumulator.h>
+#include <qgsrasterblock.h>
+
+class TestQgsRasterStatsAccumulator: public QObject
+{
+    Q_OBJECT;
+
+  private:
+    // 1000 cells, every 10th is no data
+    QgsRasterBlock* createBlock( int offset )
+    {
+      QgsRasterBlock* block = new QgsRasterBlock( QGis::Float64, 50, 20, -1 );
+      for ( int i = 0; i < 1000; i++ )
+      {
+        block->setValue(( qgssize )i, i % 10 == 0 ? -1 : ( i * 7 + offset ) % 101 + 0.25 );
+      }
+      return block;
+    }
+
+  private slots:
+
+    void statistics()
+    {
+      QgsRasterBlock* block1 = createBlock( 0 );
+      QgsRasterBlock* block2 = createBlock( 33 );
+
+      // all values in one pass
+      QgsRasterStatsAccumulator all;
+      all.addBlock( block1 );
+      all.addBlock( block2 );
+      QCOMPARE( all.count(), ( qgssize )1800 );
+
+      // blocks collected separately and merged
+      QgsRasterStatsAccumulator part1, part2, merged;
+      part1.addBlock( block1 );
+      part2.addBlock( block2 );
+      merged.merge( part1 );
+      merged.merge( part2 );
+
+      QgsRasterBandStats allStats, mergedStats;
+      all.fillStatistics( allStats );
+      merged.fillStatistics( mergedStats );
+
+      QCOMPARE( mergedStats.elementCount, allStats.elementCount );
+      QCOMPARE( mergedStats.minimumValue, 0.25 );
+      QCOMPARE( mergedStats.maximumValue, 100.25 );
+      QCOMPARE( mergedStats.range, 100.0 );
+      QVERIFY( qAbs( mergedStats.sum - allStats.sum ) < 1e-8 );
+      QVERIFY( qAbs( mergedStats.mean - allStats.mean ) < 1e-10 );
+      QVERIFY( qAbs( mergedStats.stdDev - allStats.stdDev ) < 1e-10 );
+
+      // naive two pass reference
+      double sum = 0;
+      QList<double> values;
+      for ( int i = 0; i < 1000; i++ )
+      {
+        if ( i % 10 == 0 ) continue;
+        values << block1->value(( qgssize )i ) << block2->value(( qgssize )i );
+      }
+      foreach ( double v, values ) sum += v;
+      double mean = sum / values.size();
+      double squares = 0;
+      foreach ( double v, values ) squares += ( v - mean ) * ( v - mean );
+      QVERIFY( qAbs( mergedStats.mean - mean ) < 1e-10 );
+      QVERIFY( qAbs( mergedStats.stdDev - sqrt( squares / ( values.size() - 1 ) ) ) < 1e-10 );
+
+      delete block1;
+      delete block2;
+    }
+
+    void histogram()
+    {
+      QgsRasterBlock* block1 = createBlock( 0 );
+      QgsRasterBlock* block2 = createBlock( 33 );
+
+      // bins of 10 from 0 to 50, values above are dropped
+      QgsRasterHistogramAccumulator part1( 0, 10, 5, false ), part2( 0, 10, 5, false );
+      part1.addBlock( block1 );
+      part2.addBlock( block2 );
+      part1.merge( part2 );
+
+      QgsRasterHistogramAccumulator clamped( 0, 10, 5, true );
+      clamped.addBlock( block1 );
+      clamped.addBlock( block2 );
+      QCOMPARE( clamped.nonNullCount(), 1800 );
+
+      int inRange = 0;
+      for ( int i = 0; i < 1000; i++ )
+      {
+        if ( i % 10 == 0 ) continue;
+        if ( block1->value(( qgssize )i ) < 50 ) inRange++;
+        if ( block2->value(( qgssize )i ) < 50 ) inRange++;
+      }
+      QCOMPARE( part1.nonNullCount(), inRange );
+
+      int total = 0;
+      for ( int i = 0; i < 5; i++ )
+      {
+        total += part1.histogramVector()[i];
+        QCOMPARE( clamped.histogramVector()[i] >= part1.histogramVector()[i], true );
+      }
+      QCOMPARE( total, inRange );
+      QCOMPARE( clamped.histogramVector()[4] - part1.histogramVector()[4], 1800 - inRange );
+
+      delete block1;
+      delete block2;
+    }
+};
+
+QTEST_MAIN( TestQgsRasterStatsAccumulator )
+
+#include "moc_testqgsrasterstatsaccumulator.cxx"
@@ -0,0 +1,150 @@
+/***************************************************************************
+     testqgsrasterstatscache.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+
+#include <cpl_conv.h>
+#ifdef Q_OS_WIN
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+//header for class being tested
+#include <qgsrasterstatscache.h>
+#include <qgsapplication.h>
+#include <qgsrasterdataprovider.h>
+#include <qgsrasterlayer.h>
+
+/** \ingroup UnitTests
+ * Statistics and histograms of the gdal provider kept in the persistent cache
+ */
+class TestQgsRasterStatsCache: public QObject
+{
+    Q_OBJECT;
+
+  private:
+    QString mConfigDir;
+    QString mRasterFile;
+
+    static void removeDir( const QString& theDir )
+    {
+      QDir myDir( theDir );
+      foreach ( QString myFile, myDir.entryList( QDir::Files ) )
+        myDir.remove( myFile );
+      foreach ( QString mySubDir, myDir.entryList( QDir::Dirs | QDir::NoDotAndDotDot ) )
+        removeDir( myDir.filePath( mySubDir ) );
+      QDir().rmdir( theDir );
+    }
+
+    //! the cache directory holds the cache file of the raster only
+    static QByteArray cacheFileContent()
+    {
+      QDir myDir( QgsRasterStatsCache::cacheDirectory() );
+      QStringList myFiles = myDir.entryList( QDir::Files );
+      if ( myFiles.size() != 1 )
+        return QByteArray();
+      QFile myFile( myDir.filePath( myFiles[0] ) );
+      if ( !myFile.open( QIODevice::ReadOnly ) )
+        return QByteArray();
+      return myFile.readAll();
+    }
+
+  private slots:
+
+    void initTestCase()
+    {
+      // the cache is written to the settings directory, keep it out of the user's one
+      mConfigDir = QDir::tempPath() + "/qgsrasterstatscachetest/";
+      removeDir( mConfigDir );
+      QVERIFY( QDir().mkpath( mConfigDir ) );
+      QgsApplication::init( mConfigDir );
+      QgsApplication::initQgis();
+      // statistics must not come from .aux.xml files
+      CPLSetConfigOption( "GDAL_PAM_ENABLED", "NO" );
+
+      mRasterFile = mConfigDir + "tenbytenraster.asc";
+      QVERIFY( QFile::copy( QString( TEST_DATA_DIR ) + "/tenbytenraster.asc", mRasterFile ) );
+    }
+
+    void cleanupTestCase()
+    {
+      removeDir( mConfigDir );
+    }
+
+    void roundTrip()
+    {
+      QgsRasterBandStats myStats;
+      QgsRasterHistogram myHistogram;
+      {
+        QgsRasterLayer myLayer( mRasterFile, "test" );
+        QVERIFY( myLayer.isValid() );
+        QgsRasterDataProvider* myProvider = myLayer.dataProvider();
+        QVERIFY( !myProvider->hasStatistics( 1, QgsRasterBandStats::All ) );
+        myStats = myProvider->bandStatistics( 1, QgsRasterBandStats::All );
+        myHistogram = myProvider->histogram( 1, 10 );
+        QVERIFY( myHistogram.valid );
+
+        // approximations are not kept
+        myProvider->bandStatistics( 1, QgsRasterBandStats::All, QgsRectangle(), 20 );
+        QDomDocument myDoc;
+        QVERIFY( myDoc.setContent( cacheFileContent() ) );
+        QCOMPARE( myDoc.elementsByTagName( "statistics" ).size(), 1 );
+        QCOMPARE( myDoc.elementsByTagName( "histogram" ).size(), 1 );
+      }
+
+      // a new provider finds them in the cache
+      QgsRasterLayer myLayer( mRasterFile, "test" );
+      QgsRasterDataProvider* myProvider = myLayer.dataProvider();
+      QVERIFY( myProvider->hasStatistics( 1, QgsRasterBandStats::All ) );
+      QVERIFY( myProvider->hasHistogram( 1, 10 ) );
+      QgsRasterBandStats myCachedStats = myProvider->bandStatistics( 1, QgsRasterBandStats::All );
+      QCOMPARE( myCachedStats.elementCount, myStats.elementCount );
+      QCOMPARE( myCachedStats.minimumValue, myStats.minimumValue );
+      QCOMPARE( myCachedStats.maximumValue, myStats.maximumValue );
+      QCOMPARE( myCachedStats.mean, myStats.mean );
+      QCOMPARE( myCachedStats.stdDev, myStats.stdDev );
+      QCOMPARE( myProvider->histogram( 1, 10 ).histogramVector, myHistogram.histogramVector );
+
+      // no temporary files are left behind
+      QVERIFY( !cacheFileContent().isEmpty() );
+    }
+
+    void invalidation()
+    {
+      {
+        QgsRasterLayer myLayer( mRasterFile, "test" );
+        myLayer.dataProvider()->bandStatistics( 1, QgsRasterBandStats::All );
+        QgsRasterLayer myReopenedLayer( mRasterFile, "test" );
+        QVERIFY( myReopenedLayer.dataProvider()->hasStatistics( 1, QgsRasterBandStats::All ) );
+      }
+
+      // the statistics are calculated again when the file was modified
+      struct utimbuf myTimes;
+      myTimes.actime = myTimes.modtime = QFileInfo( mRasterFile ).lastModified().addSecs( -3600 ).toTime_t();
+      QCOMPARE( utime( QFile::encodeName( mRasterFile ).constData(), &myTimes ), 0 );
+
+      QgsRasterLayer myLayer( mRasterFile, "test" );
+      QVERIFY( !myLayer.dataProvider()->hasStatistics( 1, QgsRasterBandStats::All ) );
+    }
+};
+
+QTEST_MAIN( TestQgsRasterStatsCache )
+
+#include "moc_testqgsrasterstatscache.cxx"
@@ -0,0 +1,146 @@
+/***************************************************************************
+     testqgssqlexpressioncompiler.cpp
+     --------------------------------------
+    Date                 : December 2013
+    Copyright            : (C) 2013 by the QGIS Development Team
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QObject>
+#include <QString>
+//header for class being tested
+#include <qgssqlexpressioncompiler.h>
+#include <qgsexpression.h>
+#include <qgsfield.h>
+
+Q_DECLARE_METATYPE( QgsSqlExpressionCompiler::Result )
+
+// only text columns are compared like strings, as in the postgres provider
+class TestTextOnlyCompiler : public QgsSqlExpressionCompiler
+{
+  public:
+    TestTextOnlyCompiler( const QgsFields& fields ) : QgsSqlExpressionCompiler( fields ) {}
+
+  protected:
+    virtual bool isStringField( const QgsField& field )
+    {
+      return field.type() == QVariant::String && field.typeName() == "text";
+    }
+};
+
+class TestQgsSqlExpressionCompiler: public QObject
+{
+    Q_OBJECT;
+
+  private:
+    QgsFields mFields;
+
+  private slots:
+
+    void initTestCase()
+    {
+      mFields.append( QgsField( "num", QVariant::Int ) );
+      mFields.append( QgsField( "val", QVariant::Double ) );
+      mFields.append( QgsField( "name", QVariant::String ) );
+      mFields.append( QgsField( "big", QVariant::LongLong ) );
+    }
+
+    void compile_data()
+    {
+      QTest::addColumn<QString>( "string" );
+      QTest::addColumn<int>( "flags" );
+      QTest::addColumn<QgsSqlExpressionCompiler::Result>( "result" );
+      QTest::addColumn<QString>( "sql" );
+
+      // numeric comparisons and arithmetic
+      QTest::newRow( "compare" ) << "num > 5" << 0 << QgsSqlExpressionCompiler::Complete << "(\"num\" > 5)";
+      QTest::newRow( "arithmetic" ) << "num + 1.5 >= val * 2" << 0 << QgsSqlExpressionCompiler::Complete << "((\"num\" + 1.5) >= (\"val\" * 2))";
+      QTest::newRow( "integer arithmetic" ) << "num * 2 > 5" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "minus" ) << "-val < 2.5" << 0 << QgsSqlExpressionCompiler::Complete << "(-(\"val\") < 2.5)";
+      QTest::newRow( "integer minus" ) << "-num < 2" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "negative literal" ) << "num > -2" << 0 << QgsSqlExpressionCompiler::Complete << "(\"num\" > -(2))";
+      QTest::newRow( "not or" ) << "not (num = 1 or val <> 2.5)" << 0 << QgsSqlExpressionCompiler::Complete << "(NOT ((\"num\" = 1) OR (\"val\" <> 2.5)))";
+      QTest::newRow( "is null" ) << "num is null" << 0 << QgsSqlExpressionCompiler::Complete << "(\"num\" IS NULL)";
+      QTest::newRow( "is not null" ) << "name is not null" << 0 << QgsSqlExpressionCompiler::Complete << "(\"name\" IS NOT NULL)";
+      QTest::newRow( "in" ) << "num in (1,2,3)" << 0 << QgsSqlExpressionCompiler::Complete << "(\"num\" IN (1,2,3))";
+      QTest::newRow( "division" ) << "num / 2 = 1" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "long long" ) << "big = 1" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "unknown column" ) << "missing = 1" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "function" ) << "abs(num) = 1" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "not boolean" ) << "num" << 0 << QgsSqlExpressionCompiler::Fail << "";
+
+      // strings
+      QTest::newRow( "string equal" ) << "name = 'it''s'" << 0 << QgsSqlExpressionCompiler::Complete << "(\"name\" = 'it''s')";
+      QTest::newRow( "string not in" ) << "name not in ('a','b')" << 0 << QgsSqlExpressionCompiler::Complete << "(\"name\" NOT IN ('a','b'))";
+      QTest::newRow( "numeric string" ) << "name = '1'" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "string order" ) << "name < 'b'" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "like" ) << "name like 'a%'" << 0 << QgsSqlExpressionCompiler::Complete << "(\"name\" LIKE 'a%')";
+      QTest::newRow( "ilike" ) << "name ilike 'a%'" << 0 << QgsSqlExpressionCompiler::Complete << "(UPPER(\"name\") LIKE UPPER('a%'))";
+      QTest::newRow( "ilike operator" ) << "name not ilike 'a%'" << int( QgsSqlExpressionCompiler::ILikeOperator ) << QgsSqlExpressionCompiler::Complete << "(\"name\" NOT ILIKE 'a%')";
+      QTest::newRow( "ilike case insensitive" ) << "name ilike 'a%'" << int( QgsSqlExpressionCompiler::LikeIsCaseInsensitive ) << QgsSqlExpressionCompiler::Complete << "(\"name\" LIKE 'a%')";
+      QTest::newRow( "like case insensitive" ) << "name like 'a%'" << int( QgsSqlExpressionCompiler::LikeIsCaseInsensitive ) << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "ilike non-ascii" ) << QString::fromUtf8( "name ilike '\xc3\xa4%'" ) << int( QgsSqlExpressionCompiler::LikeIsCaseInsensitive ) << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "like escape" ) << "name like 'a\\\\_%'" << 0 << QgsSqlExpressionCompiler::Fail << "";
+      QTest::newRow( "case insensitive strings" ) << "name = 'a'" << int( QgsSqlExpressionCompiler::CaseInsensitiveStrings ) << QgsSqlExpressionCompiler::Fail << "";
+
+      // top level AND
+      QTest::newRow( "and" ) << "num = 1 and name = 'a'" << 0 << QgsSqlExpressionCompiler::Complete << "(\"num\" = 1) AND (\"name\" = 'a')";
+      QTest::newRow( "partial" ) << "num = 1 and upper(name) = 'A' and val > 2.5" << 0 << QgsSqlExpressionCompiler::Partial << "(\"num\" = 1) AND (\"val\" > 2.5)";
+      QTest::newRow( "partial or" ) << "num = 1 or upper(name) = 'A'" << 0 << QgsSqlExpressionCompiler::Fail << "";
+    }
+
+    void compile()
+    {
+      QFETCH( QString, string );
+      QFETCH( int, flags );
+      QFETCH( QgsSqlExpressionCompiler::Result, result );
+      QFETCH( QString, sql );
+
+      QgsExpression exp( string );
+      QVERIFY( !exp.hasParserError() );
+
+      QgsSqlExpressionCompiler compiler( mFields, flags );
+      QCOMPARE( compiler.compile( &exp ), result );
+      QCOMPARE( compiler.result(), sql );
+    }
+
+    void compile_invalid()
+    {
+      QgsSqlExpressionCompiler compiler( mFields );
+      QCOMPARE( compiler.compile( 0 ), QgsSqlExpressionCompiler::None );
+
+      QgsExpression exp( "num = " );
+      QVERIFY( exp.hasParserError() );
+      QCOMPARE( compiler.compile( &exp ), QgsSqlExpressionCompiler::Fail );
+    }
+
+    void compile_string_fields()
+    {
+      QgsFields fields;
+      fields.append( QgsField( "name", QVariant::String, "text" ) );
+      fields.append( QgsField( "flag", QVariant::String, "bool" ) );
+      fields.append( QgsField( "num", QVariant::Int, "int4" ) );
+      TestTextOnlyCompiler compiler( fields );
+
+      QgsExpression exp( "name = 'abc'" );
+      QCOMPARE( compiler.compile( &exp ), QgsSqlExpressionCompiler::Complete );
+      QCOMPARE( compiler.result(), QString( "(\"name\" = 'abc')" ) );
+
+      // other types mapped to strings are left to the client
+      QgsExpression exp2( "flag = 'true'" );
+      QCOMPARE( compiler.compile( &exp2 ), QgsSqlExpressionCompiler::Fail );
+      QgsExpression exp3( "flag LIKE 't%' AND num > 1" );
+      QCOMPARE( compiler.compile( &exp3 ), QgsSqlExpressionCompiler::Partial );
+      QCOMPARE( compiler.result(), QString( "(\"num\" > 1)" ) );
+    }
+};
+
+QTEST_MAIN( TestQgsSqlExpressionCompiler )
+
+#include "moc_testqgssqlexpressioncompiler.cxx"
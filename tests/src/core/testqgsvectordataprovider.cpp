@@ -23,6 +23,8 @@
 #include <qgsvectordataprovider.h>
 #include <qgsvectorlayer.h>
 
+#include <QSettings>
+
 #if QT_VERSION < 0x40701
 // See http://hub.qgis.org/issues/4284
 Q_DECLARE_METATYPE( QVariant )
@@ -48,6 +50,10 @@ class TestQgsVectorDataProvider : public QObject
 
     void featureAtId();
 
+    // test whether filter expressions translated to OGR SQL give the same features
+    void select_compiledExpression_data();
+    void select_compiledExpression();
+
   private:
 
     QgsVectorLayer* vlayerPoints;
@@ -226,6 +232,64 @@ void TestQgsVectorDataProvider::featureAtId()
   QVERIFY( !feature.isValid() );
 }
 
+static QList<QgsFeatureId> filteredFeatureIds( QgsVectorDataProvider* pr, const QString& expression, bool compile )
+{
+  QSettings().setValue( "/qgis/compileExpressions", compile );
+
+  QgsFeatureRequest request;
+  request.setFilterExpression( expression ).setFlags( QgsFeatureRequest::NoGeometry );
+  QgsFeatureIterator fi = pr->getFeatures( request );
+
+  QList<QgsFeatureId> ids;
+  QgsFeature f;
+  while ( fi.nextFeature( f ) )
+  {
+    ids << f.id();
+  }
+  qSort( ids );
+  return ids;
+}
+
+void TestQgsVectorDataProvider::select_compiledExpression_data()
+{
+  QTest::addColumn<QString>( "expression" );
+  QTest::addColumn<int>( "count" );
+
+  QTest::newRow( "compare" ) << "Heading > 90" << 9;
+  QTest::newRow( "in" ) << "Heading in (0, 90)" << 4;
+  QTest::newRow( "or" ) << "Heading > 90 or Pilots = 3" << 10;
+  QTest::newRow( "is null" ) << "Staff is null" << 0;
+  QTest::newRow( "double arithmetic" ) << "Importance * 2 >= 20" << 6;
+  QTest::newRow( "integer arithmetic" ) << "Pilots + \"Cabin Crew\" = 3" << 4;
+  QTest::newRow( "minus" ) << "-Importance < -5" << 6;
+  QTest::newRow( "string" ) << "Class = 'Jet'" << 8;
+  QTest::newRow( "string case" ) << "Class = 'jet'" << 0;
+  QTest::newRow( "partial" ) << "Heading > 90 and Class = 'Jet'" << 5;
+  QTest::newRow( "ilike" ) << "Class ilike 'b%'" << 9;
+  QTest::newRow( "like case" ) << "Class like 'b%'" << 0;
+}
+
+void TestQgsVectorDataProvider::select_compiledExpression()
+{
+  QFETCH( QString, expression );
+  QFETCH( int, count );
+
+  QSettings settings;
+  QVariant compileSetting = settings.value( "/qgis/compileExpressions" );
+
+  QgsVectorDataProvider* pr = vlayerPoints->dataProvider();
+  QList<QgsFeatureId> compiled = filteredFeatureIds( pr, expression, true );
+  QList<QgsFeatureId> uncompiled = filteredFeatureIds( pr, expression, false );
+
+  if ( compileSetting.isNull() )
+    settings.remove( "/qgis/compileExpressions" );
+  else
+    settings.setValue( "/qgis/compileExpressions", compileSetting );
+
+  QCOMPARE( uncompiled.count(), count );
+  QCOMPARE( compiled, uncompiled );
+}
+
 
 QTEST_MAIN( TestQgsVectorDataProvider )
 
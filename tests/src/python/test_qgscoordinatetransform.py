@@ -13,9 +13,13 @@ __copyright__ = 'Copyright 2012, The QGIS Project'
 __revision__ = '$Format:%H$'
 
 import qgis
+from PyQt4.QtCore import QPointF
+from PyQt4.QtGui import QPolygonF
 from qgis.core import (QgsRectangle,
+                       QgsPoint,
                        QgsCoordinateReferenceSystem,
                        QgsCoordinateTransform,
+                       QgsCsException,
                        QGis)
 from utilities import (unitTestDataPath,
                        getQgisTestApp,
@@ -51,6 +55,41 @@ class TestQgsCoordinateTransform(TestCase):
         self.assertAlmostEqual(myExpectedValues[2], myProjectedExtent.xMaximum(), msg=myMessage)
         self.assertAlmostEqual(myExpectedValues[3], myProjectedExtent.yMaximum(), msg=myMessage)
 
+    def testTransformPolygon(self):
+        """Test that a polygon is transformed like its single points,
+        also with a datum shift which uses z values"""
+        myGeoCrs = QgsCoordinateReferenceSystem()
+        myGeoCrs.createFromId(4326, QgsCoordinateReferenceSystem.EpsgCrsId)
+        for myEpsg in [32756, 27700]:
+            myCrs = QgsCoordinateReferenceSystem()
+            myCrs.createFromId(myEpsg, QgsCoordinateReferenceSystem.EpsgCrsId)
+            myXForm = QgsCoordinateTransform(myCrs, myGeoCrs)
+            myPoints = [QPointF(242270 + i * 1000, 6043737 - i * 500) for i in range(50)]
+            myPolygon = QPolygonF(myPoints)
+            myXForm.transformPolygon(myPolygon)
+            self.assertEqual(myPolygon.size(), len(myPoints))
+            for i, myPoint in enumerate(myPoints):
+                myExpected = myXForm.transform(QgsPoint(myPoint.x(), myPoint.y()))
+                myMessage = 'EPSG:%d point %d Expected: %s Got: %s, %s' % (
+                    myEpsg, i, myExpected.toString(), myPolygon[i].x(), myPolygon[i].y())
+                self.assertAlmostEqual(myExpected.x(), myPolygon[i].x(), 9, msg=myMessage)
+                self.assertAlmostEqual(myExpected.y(), myPolygon[i].y(), 9, msg=myMessage)
+
+    def testTransformPolygonFailure(self):
+        """Test that a polygon is left unchanged if one of its points
+        cannot be transformed"""
+        myGeoCrs = QgsCoordinateReferenceSystem()
+        myGeoCrs.createFromId(4326, QgsCoordinateReferenceSystem.EpsgCrsId)
+        myCrs = QgsCoordinateReferenceSystem()
+        myCrs.createFromId(3857, QgsCoordinateReferenceSystem.EpsgCrsId)
+        myXForm = QgsCoordinateTransform(myGeoCrs, myCrs)
+        myPoints = [QPointF(10 + i, 40 + i) for i in range(10)] + [QPointF(20, 95)]
+        myPolygon = QPolygonF(myPoints)
+        self.assertRaises(QgsCsException, myXForm.transformPolygon, myPolygon)
+        self.assertEqual(myPolygon.size(), len(myPoints))
+        for i, myPoint in enumerate(myPoints):
+            self.assertEqual(myPoint, myPolygon[i], 'point %d changed' % i)
+
 if __name__ == '__main__':
     unittest.main()
 
@@ -26,6 +26,7 @@ __revision__ = '$Format:%H$'
 import os
 import os.path
 import re
+import shutil
 import tempfile
 import inspect
 import time
@@ -38,7 +39,9 @@ import qgis
 from PyQt4.QtCore import (QVariant,
                           QCoreApplication,
                         QUrl,
-                        QObject
+                        QObject,
+                        QSettings,
+                        QThreadPool
                         )
 
 from qgis.core import (QGis,
@@ -654,6 +657,62 @@ class TestQgsDelimitedTextProvider(TestCase):
         requests=None
         runTest(filename,requests,**params)
 
+    def test_038_spatial_index_cache(self):
+        # The spatial index of the file is cached, reused by other layers
+        # and rebuilt when the file changes
+        cachedir = tempfile.mkdtemp()
+        indexdir = os.path.join(cachedir, 'spatialindex')
+        settings = QSettings()
+        oldcachedir = settings.value('cache/directory')
+        settings.setValue('cache/directory', cachedir)
+        (filehandle,filename) = tempfile.mkstemp(suffix='.csv')
+        with os.fdopen(filehandle,"w") as f:
+            f.write("id,x,y\n1,10,40\n2,20,45\n3,120,140\n")
+        url = QUrl.fromLocalFile(filename)
+        for k,v in (('type','csv'),('xField','x'),('yField','y'),('spatialIndex','yes')):
+            url.addQueryItem(k,v)
+
+        def openlayer():
+            layer = QgsVectorLayer(url.toString(),'test','delimitedtext')
+            assert layer.isValid()
+            # the index is built in the background
+            QThreadPool.globalInstance().waitForDone()
+            QCoreApplication.instance().processEvents()
+            return layer
+
+        def selected( layer ):
+            request = QgsFeatureRequest().setFilterRect(QgsRectangle(0,30,50,50))
+            return sorted([f['id'] for f in layer.getFeatures(request)])
+
+        try:
+            layer = openlayer()
+            files = os.listdir(indexdir)
+            assert len(files) == 1, files
+            indexfile = os.path.join(indexdir,files[0])
+            built = os.stat(indexfile).st_mtime
+            assert selected(layer) == [1,2], selected(layer)
+
+            # a second layer reads the cached index instead of writing it again
+            time.sleep(1)
+            layer2 = openlayer()
+            assert os.stat(indexfile).st_mtime == built
+            assert selected(layer2) == [1,2], selected(layer2)
+
+            # the index is rebuilt for the changed file, no temporary files are left
+            with open(filename,'a') as f:
+                f.write("4,30,35\n")
+            layer3 = openlayer()
+            assert os.listdir(indexdir) == files, os.listdir(indexdir)
+            assert os.stat(indexfile).st_mtime != built
+            assert selected(layer3) == [1,2,4], selected(layer3)
+        finally:
+            if oldcachedir is None:
+                settings.remove('cache/directory')
+            else:
+                settings.setValue('cache/directory', oldcachedir)
+            shutil.rmtree(cachedir)
+            os.remove(filename)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,181 @@
+# -*- coding: utf-8 -*-
+"""QGIS Unit tests for QgsFeatureTable.
+
+.. note:: This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+"""
+__author__ = 'QGIS Development Team'
+__date__ = '22/12/2013'
+__copyright__ = 'Copyright 2013, The QGIS Project'
+# This will get replaced with a git SHA1 when you do a git archive
+__revision__ = '$Format:%H$'
+
+import unittest
+import qgis
+
+from PyQt4.QtCore import QVariant, QDate, QPyNullVariant
+
+from qgis.core import (QgsFeatureTable,
+                       QgsFeature,
+                       QgsField,
+                       QgsFields,
+                       QgsGeometry,
+                       QgsPoint,
+                       NULL)
+
+from utilities import getQgisTestApp
+
+QGISAPP, CANVAS, IFACE, PARENT = getQgisTestApp()
+
+class TestQgsFeatureTable(unittest.TestCase):
+    def fields(self):
+        fields = QgsFields()
+        fields.append(QgsField("id", QVariant.Int))
+        fields.append(QgsField("big", QVariant.LongLong))
+        fields.append(QgsField("value", QVariant.Double))
+        fields.append(QgsField("name", QVariant.String))
+        fields.append(QgsField("date", QVariant.Date))
+        return fields
+
+    def feature(self, fid, attributes):
+        f = QgsFeature()
+        f.setFeatureId(fid)
+        f.setGeometry(QgsGeometry.fromPoint(QgsPoint(fid, 2 * fid)))
+        f.setAttributes(attributes)
+        return f
+
+    def testValues(self):
+        table = QgsFeatureTable(self.fields())
+        assert table.fieldCount() == 5
+        attributes = [7, 12345678901, 1.5, u'abc', QDate(2013, 12, 22)]
+        row = table.append(self.feature(3, attributes))
+        assert row == 0
+        assert table.count() == 1
+        assert table.id(0) == 3
+        assert table.attributes(0) == attributes, table.attributes(0)
+        assert table.geometry(0).asPoint() == QgsPoint(3, 6)
+
+        f = table.feature(0)
+        assert f.id() == 3
+        assert f.attributes() == attributes
+        assert f.geometry().asPoint() == QgsPoint(3, 6)
+
+        # nulls, missing attributes are null
+        table.append(self.feature(4, [NULL, NULL, 2.5]))
+        assert table.attributes(1) == [NULL, NULL, 2.5, NULL, NULL], table.attributes(1)
+
+        # values not of the field type are kept as they are
+        assert table.setAttribute(1, 0, u'not a number')
+        assert table.attribute(1, 0) == u'not a number'
+        assert table.setAttribute(1, 0, 8)
+        assert table.attribute(1, 0) == 8
+
+        assert not table.setAttribute(1, 5, 1)
+        table.setGeometry(1, None)
+        assert table.geometry(1) is None
+
+    def testNulls(self):
+        table = QgsFeatureTable(self.fields())
+        table.append(self.feature(1, [1, 2, 3.5, u'abc']))
+
+        # nulls of the field type, also for missing attributes
+        assert table.setAttribute(0, 3, QPyNullVariant(unicode))
+        assert isinstance(table.attribute(0, 3), QPyNullVariant)
+        assert isinstance(table.attribute(0, 4), QPyNullVariant)
+        table.setAttributes(0, [1])
+        assert table.attributes(0) == [1, NULL, NULL, NULL, NULL], table.attributes(0)
+
+        # invalid values stay invalid
+        assert table.setAttribute(0, 1, None)
+        assert table.attribute(0, 1) is None
+        assert table.setAttribute(0, 4, None)
+        assert table.attribute(0, 4) is None
+        assert table.setAttribute(0, 4, QDate(2013, 12, 24))
+        assert table.attribute(0, 4) == QDate(2013, 12, 24)
+
+    def testRowRange(self):
+        table = QgsFeatureTable(self.fields())
+        table.append(self.feature(1, [1]))
+        for row in [-1, 1]:
+            self.assertRaises(IndexError, table.id, row)
+            self.assertRaises(IndexError, table.setId, row, 5)
+            self.assertRaises(IndexError, table.geometry, row)
+            self.assertRaises(IndexError, table.setGeometry, row, None)
+            self.assertRaises(IndexError, table.attribute, row, 0)
+            self.assertRaises(IndexError, table.setAttribute, row, 0, 1)
+            self.assertRaises(IndexError, table.attributes, row)
+            self.assertRaises(IndexError, table.setAttributes, row, [1])
+            self.assertRaises(IndexError, table.feature, row)
+            self.assertRaises(IndexError, table.removeRow, row)
+        assert table.count() == 1
+        assert table.id(0) == 1
+
+    def testRemove(self):
+        table = QgsFeatureTable(self.fields())
+        for i in range(10):
+            table.append(self.feature(i, [i, i * 10, i / 2.0, u'name %d' % (i % 3)]))
+
+        # the last feature moves into the removed row
+        table.removeRow(2)
+        assert table.count() == 9
+        assert table.id(2) == 9
+        assert table.attributes(2)[:4] == [9, 90, 4.5, u'name 0'], table.attributes(2)
+        assert table.geometry(2).asPoint() == QgsPoint(9, 18)
+        table.removeRow(8)
+        assert table.count() == 8
+        assert [table.id(i) for i in range(8)] == [0, 1, 9, 3, 4, 5, 6, 7]
+
+        table.removeField(1)
+        assert table.fieldCount() == 4
+        assert table.attributes(3)[:3] == [3, 1.5, u'name 0']
+        table.addField(QgsField("new", QVariant.Int))
+        assert table.attribute(3, 4) == NULL
+
+        table.clear()
+        assert table.count() == 0
+        assert table.fieldCount() == 4
+
+    def testMemoryUsage(self):
+        fields = QgsFields()
+        for i in range(10):
+            fields.append(QgsField("i%d" % i, QVariant.Int))
+            fields.append(QgsField("s%d" % i, QVariant.String))
+        table = QgsFeatureTable(fields)
+        count = 20000
+        table.reserve(count)
+        for i in range(count):
+            f = QgsFeature()
+            f.setFeatureId(i)
+            f.setAttributes([i, u'category %d' % (i % 10)] * 10)
+            table.append(f)
+        assert table.attribute(count - 1, 19) == u'category 9'
+
+        # below the size of the QVariants alone without the strings
+        assert table.memoryUsage() < count * 20 * 12, table.memoryUsage()
+
+    def testStringDictionary(self):
+        table = QgsFeatureTable(self.fields())
+        for i in range(3):
+            table.append(self.feature(i, [i, i, 0.5, u'name %d' % (i % 2)]))
+        usage = table.memoryUsage()
+
+        # strings no longer used are removed and their codes reused
+        for i in range(1000):
+            table.setAttribute(0, 3, u'unique %d' % i)
+        assert table.memoryUsage() < usage + 1000, (usage, table.memoryUsage())
+        assert [table.attribute(i, 3) for i in range(3)] == [u'unique 999', u'name 1', u'name 0']
+
+        table.removeRow(1)
+        table.setAttribute(0, 3, u'other')
+        table.append(self.feature(3, [3, 3, 0.5, u'name 1']))
+        assert [table.attribute(i, 3) for i in range(3)] == [u'other', u'name 0', u'name 1']
+        for i in range(1000):
+            table.append(self.feature(i, [i, i, 0.5, u'row %d' % i]))
+        while table.count() > 3:
+            table.removeRow(3)
+        assert [table.attribute(i, 3) for i in range(3)] == [u'other', u'name 0', u'name 1']
+
+if __name__ == '__main__':
+    unittest.main()
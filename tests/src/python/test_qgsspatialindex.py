@@ -12,14 +12,20 @@ __copyright__ = 'Copyright 2012, The QGIS Project'
 # This will get replaced with a git SHA1 when you do a git archive
 __revision__ = '$Format:%H$'
 
+import os
+import struct
+import tempfile
 import unittest
 import qgis
 
+from PyQt4.QtCore import QFileInfo
+
 from qgis.core import (QgsSpatialIndex,
                        QgsFeature,
                        QgsGeometry,
                        QgsRectangle,
-                       QgsPoint)
+                       QgsPoint,
+                       QgsVectorLayer)
 
 from utilities import getQgisTestApp
 
@@ -59,3 +65,127 @@ class TestQgsSpatialIndex(unittest.TestCase):
         myMessage = ('Expected: %s\nGot: %s\n' %
                      ([0, 1, 5], fids))
         assert fids == [0, 1, 5], myMessage
+
+    def testBulkLoad(self):
+        layer = QgsVectorLayer("Point", "points", "memory")
+        features = []
+        for y in range(100):
+            for x in range(100):
+                ft = QgsFeature()
+                ft.setGeometry(QgsGeometry.fromPoint(QgsPoint(x, y)))
+                features.append(ft)
+        res, features = layer.dataProvider().addFeatures(features)
+        assert res
+
+        incremental = QgsSpatialIndex()
+        for ft in layer.getFeatures():
+            incremental.insertFeature(ft)
+        bulk = QgsSpatialIndex(layer.getFeatures())
+
+        for rect in [QgsRectangle(7.0, 3.0, 17.0, 13.0),
+                     QgsRectangle(-5.0, -5.0, 0.5, 120.0),
+                     QgsRectangle(50.5, 50.5, 50.7, 50.7),
+                     QgsRectangle(-10.0, -10.0, 200.0, 200.0)]:
+            expected = incremental.intersects(rect)
+            expected.sort()
+            fids = bulk.intersects(rect)
+            fids.sort()
+            myMessage = 'Expected: %s\nGot: %s\n' % (expected, fids)
+            assert fids == expected, myMessage
+
+        # the three nearest points are unique
+        expected = incremental.nearestNeighbor(QgsPoint(20.1, 30.2), 3)
+        expected.sort()
+        fids = bulk.nearestNeighbor(QgsPoint(20.1, 30.2), 3)
+        fids.sort()
+        myMessage = 'Expected: %s\nGot: %s\n' % (expected, fids)
+        assert fids == expected, myMessage
+
+        # features can still be added
+        ft = QgsFeature()
+        ft.setFeatureId(100000)
+        ft.setGeometry(QgsGeometry.fromPoint(QgsPoint(500, 500)))
+        assert bulk.insertFeature(ft)
+        assert bulk.intersects(QgsRectangle(499, 499, 501, 501)) == [100000]
+
+    def testCancelBulkLoad(self):
+        layer = QgsVectorLayer("Point", "points", "memory")
+        features = []
+        for x in range(2500):
+            ft = QgsFeature()
+            ft.setGeometry(QgsGeometry.fromPoint(QgsPoint(x, 0)))
+            features.append(ft)
+        layer.dataProvider().addFeatures(features)
+
+        class Feedback(QgsSpatialIndex.BuildFeedback):
+            def __init__(self, cancelAt):
+                QgsSpatialIndex.BuildFeedback.__init__(self)
+                self.cancelAt = cancelAt
+                self.counts = []
+
+            def progress(self, count):
+                self.counts.append(count)
+                return count < self.cancelAt
+
+        feedback = Feedback(100000)
+        idx = QgsSpatialIndex(layer.getFeatures(), feedback)
+        assert feedback.counts == [1000, 2000], feedback.counts
+        assert len(idx.intersects(QgsRectangle(-1, -1, 3000, 1))) == 2500
+
+        # a canceled index is empty
+        feedback = Feedback(1000)
+        idx = QgsSpatialIndex(layer.getFeatures(), feedback)
+        assert feedback.counts == [1000], feedback.counts
+        assert idx.intersects(QgsRectangle(-1, -1, 3000, 1)) == []
+
+    def testWriteRead(self):
+        idx = QgsSpatialIndex()
+        for fid in range(3000):
+            ft = QgsFeature()
+            ft.setFeatureId(fid)
+            ft.setGeometry(QgsGeometry.fromRect(QgsRectangle(fid % 50, fid / 50, fid % 50 + 1.5, fid / 50 + 0.5)))
+            idx.insertFeature(ft)
+
+        (handle, source) = tempfile.mkstemp()
+        with os.fdopen(handle, 'w') as f:
+            f.write('source data')
+        indexFile = source + '.qsi'
+        info = QFileInfo(source)
+        assert idx.writeToFile(indexFile, source, info.size(), info.lastModified())
+
+        loaded = QgsSpatialIndex()
+        assert loaded.readFromFile(indexFile, source)
+        for rect in [QgsRectangle(7.0, 3.0, 17.0, 13.0),
+                     QgsRectangle(-5.0, -5.0, 0.5, 120.0),
+                     QgsRectangle(-10.0, -10.0, 200.0, 200.0)]:
+            expected = idx.intersects(rect)
+            expected.sort()
+            fids = loaded.intersects(rect)
+            fids.sort()
+            myMessage = 'Expected: %s\nGot: %s\n' % (expected, fids)
+            assert fids == expected, myMessage
+
+        # the file belongs to another source
+        other = QgsSpatialIndex()
+        assert not other.readFromFile(indexFile, source + 'x')
+        assert other.intersects(QgsRectangle(-10.0, -10.0, 200.0, 200.0)) == []
+
+        # a corrupt count whose entries would wrap around to the size of the file
+        with open(indexFile, 'rb') as f:
+            data = f.read()
+        corruptFile = source + '.corrupt.qsi'
+        with open(corruptFile, 'wb') as f:
+            f.write(data[:32] + struct.pack('=q', 3000 + 2 ** 61) + data[40:])
+        assert not other.readFromFile(corruptFile, source)
+        os.remove(corruptFile)
+
+        # the source has changed since
+        with open(source, 'a') as f:
+            f.write('more data')
+        assert not other.readFromFile(indexFile, source)
+
+        os.remove(indexFile)
+        os.remove(source)
+
+if __name__ == '__main__':
+    unittest.main()